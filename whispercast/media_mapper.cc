@@ -239,6 +239,8 @@ bool MediaMapper::LoadElements() {
     LOG_ERROR << "Error decoding ElementConfigurationSpecs from file: "
               << config_file;
     success = false;
+    // drop what is left of the bad value, go on w/ the next one
+    decoder.Reset1();
   }
   vector<ElementExportSpec> exports;
   const rpc::DECODE_RESULT exports_error = decoder.Decode(iomis, &exports);
@@ -246,6 +248,7 @@ bool MediaMapper::LoadElements() {
     LOG_ERROR << "Error decoding vector<ElementExportSpec> from file: "
               << config_file;
     success = false;
+    decoder.Reset1();
   }
   vector<MediaSaverSpec> saves;
   const rpc::DECODE_RESULT saves_error = decoder.Decode(iomis, &saves);
@@ -33,6 +33,7 @@
 
 #include <vector>
 #include "stream_request.h"
+#include <whisperlib/net/base/outbuf_budget.h>
 #include <whisperlib/net/util/ipclassifier.h>
 
 #include <whisperstreamlib/internal/internal_frame.h>
@@ -254,8 +255,23 @@ bool StreamRequest::CanSendTag() const {
   if ( http_request_ == NULL ) {
     return false;
   }
+  // we buffer less under memory pressure (see net::OutbufBudget)
   return http_request_->pending_output_bytes() <
-         http_request_->protocol_params().max_reply_buffer_size_/2;
+         net::OutbufBudget::ScaledLimit(
+             http_request_->protocol_params().max_reply_buffer_size_)/2;
+}
+int32 StreamRequest::PendingOutputBytes() const {
+  if ( http_request_ == NULL ) {
+    return 0;
+  }
+  return http_request_->pending_output_bytes() +
+         http_request_->kernel_output_bytes();
+}
+bool StreamRequest::SetMaxPacingRate(int64 bytes_per_sec) {
+  if ( http_request_ == NULL ) {
+    return false;
+  }
+  return http_request_->SetMaxPacingRate(bytes_per_sec);
 }
 void StreamRequest::SetNotifyReady() {
   if ( http_request_ == NULL ) {
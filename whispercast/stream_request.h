@@ -98,6 +98,8 @@ public:
   virtual bool CanSendTag() const;
   virtual void SetNotifyReady();
   virtual void SendTag(const streaming::Tag* tag, int64 timestamp_ms);
+  virtual int32 PendingOutputBytes() const;
+  virtual bool SetMaxPacingRate(int64 bytes_per_sec);
 
   ///////////////////////////////////////////////////////////////////////////
   // StreamRequest own methods
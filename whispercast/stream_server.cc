@@ -51,7 +51,9 @@
 #include <whisperstreamlib/stats2/stats_collector.h>
 #include <whisperstreamlib/stats2/log_stats_saver.h>
 #include <whisperstreamlib/base/element.h>
+#include <whisperstreamlib/base/stream_auth.h>
 #include <whisperlib/net/util/ipclassifier.h>
+#include <whisperlib/net/util/admission_controller.h>
 
 #include <whisperlib/net/base/user_authenticator.h>
 #include <whisperlib/net/http/http_server_protocol.h>
@@ -114,6 +116,12 @@ DEFINE_bool(http_connection_dlog_level,
 DEFINE_int32(http_max_num_connections,
              1000,
              "Accept at most these many concurrent HTTP connections");
+DEFINE_int32(http_response_cache_size,
+             0,
+             "Keep at most these many bytes of cacheable HTTP replies "
+             "(GETs w/o credentials or cookies, whose processor sets "
+             "Cache-Control: max-age - e.g. robots.txt). "
+             "0 turns off the cache.");
 
 DEFINE_string(http_ssl_certificate,
               "",
@@ -149,6 +157,25 @@ DEFINE_string(ip_classifiers,
 
 //////////////////////////////////////////////////////////////////////
 
+DEFINE_int32(admission_max_connections_per_thread,
+             0,
+             "Accept time admission control: the capacity of a client "
+             "networking thread (connections). The load of the busiest "
+             "thread counts in the server load. 0 - ignore this.");
+DEFINE_int32(admission_max_pending_authorizations,
+             0,
+             "Accept time admission control: how many authorizations can "
+             "be in progress. They count in the server load. 0 - ignore.");
+DEFINE_string(admission_class_max_load,
+              "",
+              "Accept time admission control: comma separated max server "
+              "loads (percents) over which we refuse new HTTP / RTMP "
+              "clients, one for each --ip_classifiers class (in order), and "
+              "a last one for the unclassified clients. Missing => 100. "
+              "E.g. '150,100,80'");
+
+//////////////////////////////////////////////////////////////////////
+
 
 DEFINE_string(log_stats_dir,
               "",
@@ -218,6 +245,9 @@ DEFINE_int32(rtsp_port,
 void RobotsProcessor(http::ServerRequest* req) {
   req->request()->server_header()->AddField(
     http::kHeaderContentType, "text/plain", true);
+  // never changes - let the response cache (and the crawlers) keep it
+  req->request()->server_header()->AddField(
+    http::kHeaderCacheControl, "public, max-age=86400", true);
   req->request()->server_data()->Write(
     "User-agent: *\n"
     "Disallow: /\n");
@@ -233,6 +263,19 @@ void QuickStats(
   req->Reply();
 }
 
+void AdmissionStats(
+  const net::AdmissionController* admission_controller,
+  http::ServerRequest* req) {
+  req->request()->server_header()->AddField(
+    http::kHeaderContentType, "text/plain", true);
+  req->request()->server_data()->Write(admission_controller->ToString());
+  req->Reply();
+}
+
+int64 PendingAuthorizations() {
+  return streaming::AsyncAuthorize::num_pending();
+}
+
 string DecodeAdminPasswd(const string& s) {
   const string tmp = URL::UrlUnescape(s);
   string ret;
@@ -267,6 +310,7 @@ class Whispercast : public app::App {
       rtsp_server_(NULL),
       stats_collector_(NULL),
       classifiers_(),
+      admission_controller_(NULL),
       connection_id_(0) {
     google::SetUsageMessage("Whispercast - stream broadcasting server.");
   }
@@ -289,6 +333,7 @@ class Whispercast : public app::App {
     CHECK_NULL(rtsp_server_);
     CHECK_NULL(stats_collector_);
     CHECK(classifiers_.empty());
+    CHECK_NULL(admission_controller_);
   }
 
  protected:
@@ -325,6 +370,32 @@ class Whispercast : public app::App {
 
     //////////////////////////////////////////////////////////////////////
 
+    // Accept time admission control (for media clients only)
+    vector<int32> class_max_load;
+    if ( !FLAGS_admission_class_max_load.empty() ) {
+      vector<string> loads;
+      strutil::SplitString(FLAGS_admission_class_max_load, ",", &loads);
+      for ( int i = 0; i < loads.size(); ++i ) {
+        class_max_load.push_back(::atoi(
+            strutil::StrTrim(loads[i]).c_str()));
+      }
+    }
+    admission_controller_ = new net::AdmissionController(&classifiers_,
+                                                         class_max_load);
+    if ( client_threads != NULL ) {
+      admission_controller_->AddProbe("connections_per_thread",
+          net::AdmissionController::NewThreadLoadProbe(client_threads),
+          FLAGS_admission_max_connections_per_thread);
+    }
+    admission_controller_->AddProbe("pending_authorizations",
+        NewPermanentCallback(&PendingAuthorizations),
+        FLAGS_admission_max_pending_authorizations);
+    admission_controller_->AddProbe("outbuf_memory",
+        NewPermanentCallback(&net::OutbufBudget::usage),
+        net::OutbufBudget::budget());
+
+    //////////////////////////////////////////////////////////////////////
+
     // Initialize the stats collection
     vector<streaming::StatsSaver*> stats_savers;
     if(FLAGS_log_stats_dir != "") {
@@ -378,6 +449,7 @@ class Whispercast : public app::App {
     p.request_read_timeout_ms_ = FLAGS_http_connection_read_timeout;
     p.dlog_level_ = FLAGS_http_connection_dlog_level;
     p.max_concurrent_connections_ = FLAGS_http_max_num_connections;
+    p.response_cache_size_ = FLAGS_http_response_cache_size;
     // Is essential to have the keep-alive active as our rpc-s should keep-alive
     // The loss for streaming is not big deal..
     //
@@ -388,6 +460,7 @@ class Whispercast : public app::App {
     http_server_->RegisterProcessor(FLAGS_http_base_media_path,
         NewPermanentCallback(this, &Whispercast::ProcessMediaRequest),
         true, true);
+    http_server_->set_admission_controller(admission_controller_);
     rpc_http_server_ = new http::Server("Whispercast 0.03",
         selector_, *rpc_http_net_factory_, p);
 
@@ -463,6 +536,7 @@ class Whispercast : public app::App {
         stats_collector_,
         &classifiers_,
         &rtmp_flags_);
+    rtmp_server_->set_admission_controller(admission_controller_);
 
     //////////////////////////////////////////////////////////////////////
 
@@ -476,6 +550,10 @@ class Whispercast : public app::App {
     // Register stats processor
     rpc_http_server_->RegisterProcessor("__stats__",
         NewPermanentCallback(QuickStats,  stats_collector_), true, true);
+    rpc_http_server_->RegisterProcessor("__admission__",
+        NewPermanentCallback(AdmissionStats,
+            static_cast<const net::AdmissionController*>(admission_controller_)),
+        true, true);
 
     //////////////////////////////////////////////////////////////////////
 
@@ -577,7 +655,9 @@ class Whispercast : public app::App {
 
     //////////////////////////////////////////////////////////////////////
 
-    // Delete the classifiers
+    // Delete the classifiers (and who uses them)
+    delete admission_controller_;
+    admission_controller_ = NULL;
     for ( int i = 0; i < classifiers_.size(); ++i ) {
       delete classifiers_[i];
     }
@@ -704,6 +784,7 @@ class Whispercast : public app::App {
   streaming::StatsCollector* stats_collector_;
 
   vector<const net::IpClassifier*> classifiers_;
+  net::AdmissionController* admission_controller_;
   int64 connection_id_;
 };
 
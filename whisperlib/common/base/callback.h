@@ -34,6 +34,7 @@
 #define __COMMON_BASE_CALLBACK_H__
 
 #include <whisperlib/common/base/callback/closure.h>
+#include <whisperlib/common/base/callback/inline_closure.h>
 #include <whisperlib/common/base/callback/callback.h>
 #include <whisperlib/common/base/callback/callback1.h>
 #include <whisperlib/common/base/callback/callback2.h>
@@ -33,9 +33,13 @@
 
 #include <whisperlib/common/base/log.h>
 
+namespace synch {
+template <typename T> class MpscQueue;
+}
+
 class Closure {
 public:
-  Closure(bool is_permanent) : is_permanent_(is_permanent) {
+  Closure(bool is_permanent) : is_permanent_(is_permanent), next_(NULL) {
     #ifdef _DEBUG
     selector_registered_ = false;
     is_running_ = false;
@@ -83,10 +87,14 @@ protected:
   virtual void RunInternal() = 0;
 private:
   const bool is_permanent_;
+  // Links the closures waiting to run in a synch::MpscQueue
+  // (e.g. in net::Selector)
+  Closure* next_;
 #ifdef _DEBUG
   bool selector_registered_;
   bool is_running_;
 #endif
+  friend class synch::MpscQueue<Closure>;
 };
 
 
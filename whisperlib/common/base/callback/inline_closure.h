@@ -0,0 +1,99 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+// Closures that live inside the object they call, for the callbacks we
+// post again and again (e.g. moving each tag from the media thread to the
+// network thread). They cost no allocation per run, as
+// NewCallback(..) does.
+//
+
+#ifndef __COMMON_BASE_CALLBACK_INLINE_CLOSURE_H__
+#define __COMMON_BASE_CALLBACK_INLINE_CLOSURE_H__
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/callback/closure.h>
+
+// A permanent closure that calls a member of its owner - declare it as a
+// member of the owner:
+//
+//   class A {
+//     A() : process_task_(this, &A::Process) {}
+//     void Post() {
+//       if ( process_task_.Schedule() ) {
+//         selector_->RunInSelectLoop(&process_task_);
+//       }
+//     }
+//     void Process();
+//     InlineClosure<A> process_task_;
+//   };
+//
+// It also knows if it is scheduled (i.e. posted and not run yet), so the
+// users can post it from any thread w/o queueing it twice (which is not
+// allowed). The scheduled flag is cleared *before* calling the owner, so
+// whatever comes after that start needs a new Schedule() (and the closure
+// can be queued again while running).
+// The owner must outlive the scheduled closure (i.e. hold a reference
+// while is_scheduled()).
+template<typename C>
+class InlineClosure : public Closure {
+ public:
+  typedef void (C::*Fun)();
+  InlineClosure(C* c, Fun fun)
+      : Closure(true),
+        c_(c),
+        fun_(fun),
+        scheduled_(0) {
+  }
+  // Marks the closure as scheduled. Returns true if it was not,
+  // and the caller must post it now, or false if it already is (so
+  // it will run anyway).
+  bool Schedule() {
+    return __sync_bool_compare_and_swap(&scheduled_, 0, 1);
+  }
+  bool is_scheduled() const {
+    return scheduled_ != 0;
+  }
+ protected:
+  virtual void RunInternal() {
+    // (full barrier: whatever was posted before a failed Schedule() is
+    // visible to fun_)
+    __sync_bool_compare_and_swap(&scheduled_, 1, 0);
+    (c_->*fun_)();
+  }
+ private:
+  C* const c_;
+  const Fun fun_;
+  volatile int32 scheduled_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(InlineClosure);
+};
+
+#endif  //  __COMMON_BASE_CALLBACK_INLINE_CLOSURE_H__
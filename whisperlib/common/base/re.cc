@@ -29,6 +29,11 @@
 //
 // Author: Catalin Popescu
 
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include "common/base/log.h"
 #include "common/base/re.h"
 
 namespace re {
@@ -160,4 +165,685 @@ bool RE::Replace(const char* s, const char* r, string& out) {
 bool RE::Replace(const string& s, const string& r, string& out) {
   return Replace(s.c_str(), r.c_str(), out);
 }
+
+//////////////////////////////////////////////////////////////////////
+//
+// RESet
+//
+
+struct RESet::Ast {
+  enum Kind {
+    EMPTY,
+    CHARS,
+    CAT,
+    ALT,
+    REPEAT,
+    BEGIN,
+    END
+  };
+  const Kind kind_;
+  CharSet chars_;         // CHARS
+  vector<Ast*> kids_;     // CAT, ALT, REPEAT (one kid)
+  int min_;               // REPEAT
+  int max_;               // REPEAT, < 0 => unbounded
+  explicit Ast(Kind kind) : kind_(kind), min_(0), max_(0) {}
+  ~Ast() {
+    for ( int i = 0; i < kids_.size(); ++i ) {
+      delete kids_[i];
+    }
+  }
+};
+
+// Parses POSIX basic (or, w/ REG_EXTENDED, extended) regular expressions,
+// w/ the GNU extensions regcomp() has. We parse only expressions regcomp()
+// already accepted, so anything we do not understand (or cannot put in
+// an automaton) just makes Parse() return NULL.
+class RESet::Parser {
+ public:
+  Parser(const string& regex, bool extended, bool icase)
+      : p_(regex.data()),
+        end_(regex.data() + regex.size()),
+        extended_(extended),
+        icase_(icase),
+        depth_(0) {
+  }
+  Ast* Parse() {
+    Ast* const ast = ParseAlt();
+    if ( ast != NULL && p_ != end_ ) {
+      delete ast;
+      return NULL;
+    }
+    return ast;
+  }
+
+ private:
+  static const int kMaxRepeat = 255;
+
+  bool Is(const char* s) const {
+    const int len = strlen(s);
+    return end_ - p_ >= len && memcmp(p_, s, len) == 0;
+  }
+  bool AtAltEnd() const {
+    if ( p_ == end_ ) {
+      return true;
+    }
+    if ( extended_ ) {
+      return *p_ == '|' || (*p_ == ')' && depth_ > 0);
+    }
+    return Is("\\|") || (Is("\\)") && depth_ > 0);
+  }
+  bool AtAltSeparator() const {
+    return extended_ ? Is("|") : Is("\\|");
+  }
+  Ast* Chars(const CharSet& chars) const {
+    Ast* const ast = new Ast(Ast::CHARS);
+    ast->chars_ = chars;
+    if ( icase_ ) {
+      for ( int c = 0; c < 256; ++c ) {
+        if ( chars.test(c) ) {
+          ast->chars_.set(tolower(c));
+          ast->chars_.set(toupper(c));
+        }
+      }
+    }
+    ast->chars_.reset(0);
+    return ast;
+  }
+  Ast* Char(uint8 c) const {
+    CharSet chars;
+    chars.set(c);
+    return Chars(chars);
+  }
+
+  Ast* ParseAlt() {
+    Ast* const alt = new Ast(Ast::ALT);
+    while ( true ) {
+      Ast* const branch = ParseBranch();
+      if ( branch == NULL ) {
+        delete alt;
+        return NULL;
+      }
+      alt->kids_.push_back(branch);
+      if ( !AtAltSeparator() ) {
+        break;
+      }
+      p_ += extended_ ? 1 : 2;
+    }
+    return alt;
+  }
+  Ast* ParseBranch() {
+    Ast* const cat = new Ast(Ast::CAT);
+    bool branch_start = true;
+    bool star_literal = true;
+    while ( !AtAltEnd() ) {
+      Ast* atom = ParseAtom(branch_start, star_literal);
+      if ( atom == NULL ||
+           (!(atom->kind_ == Ast::BEGIN && !extended_) &&
+            !ParsePostfix(&atom)) ) {
+        delete atom;
+        delete cat;
+        return NULL;
+      }
+      // in basic expressions a '*' right after a leading '^' is literal,
+      // but a second '^' is not an anchor anymore
+      star_literal = branch_start && atom->kind_ == Ast::BEGIN;
+      branch_start = false;
+      cat->kids_.push_back(atom);
+    }
+    return cat;
+  }
+  Ast* ParseGroup() {
+    ++depth_;
+    Ast* const ast = ParseAlt();
+    --depth_;
+    if ( ast == NULL ) {
+      return NULL;
+    }
+    if ( extended_ ? !Is(")") : !Is("\\)") ) {
+      delete ast;
+      return NULL;
+    }
+    p_ += extended_ ? 1 : 2;
+    return ast;
+  }
+  // branch_start: we are at the start of the RE, or right after a '\(' or
+  // a '\|' - the only places a basic '^' is an anchor.
+  // star_literal: a basic '*' here is a plain character.
+  Ast* ParseAtom(bool branch_start, bool star_literal) {
+    const char c = *p_;
+    if ( extended_ ) {
+      switch ( c ) {
+        case '(': ++p_; return ParseGroup();
+        case '^': ++p_; return new Ast(Ast::BEGIN);
+        case '$': ++p_; return new Ast(Ast::END);
+        case '*': case '+': case '?': case '{':
+          return NULL;
+      }
+    } else {
+      if ( Is("\\(") ) {
+        p_ += 2;
+        return ParseGroup();
+      }
+      if ( Is("\\{") || Is("\\}") || Is("\\+") || Is("\\?") ) {
+        return NULL;
+      }
+      if ( c == '^' && branch_start ) {
+        ++p_;
+        return new Ast(Ast::BEGIN);
+      }
+      if ( c == '$' ) {
+        ++p_;
+        if ( AtAltEnd() ) {
+          return new Ast(Ast::END);
+        }
+        return Char(c);
+      }
+      if ( c == '*' && !star_literal ) {
+        return NULL;
+      }
+    }
+    switch ( c ) {
+      case '.': {
+        ++p_;
+        CharSet chars;
+        return Chars(chars.set());
+      }
+      case '[': {
+        ++p_;
+        CharSet chars;
+        if ( !ParseBracket(&chars) ) {
+          return NULL;
+        }
+        return Chars(chars);
+      }
+      case '\\':
+        ++p_;
+        return ParseEscape();
+    }
+    ++p_;
+    return Char(c);
+  }
+  Ast* ParseEscape() {
+    if ( p_ == end_ ) {
+      return NULL;
+    }
+    const char c = *p_++;
+    CharSet chars;
+    switch ( c ) {
+      case 'w': case 'W':
+        for ( int i = 0; i < 256; ++i ) {
+          chars.set(i, isalnum(i) || i == '_');
+        }
+        return Chars(c == 'w' ? chars : chars.flip());
+      case 's': case 'S':
+        for ( int i = 0; i < 256; ++i ) {
+          chars.set(i, isspace(i));
+        }
+        return Chars(c == 's' ? chars : chars.flip());
+    }
+    if ( (c >= '1' && c <= '9') || strchr("bB<>`'", c) != NULL ) {
+      // back references and word / buffer boundaries
+      return NULL;
+    }
+    return Char(c);
+  }
+  bool ParseBracket(CharSet* chars) {
+    bool negate = false;
+    if ( p_ < end_ && *p_ == '^' ) {
+      negate = true;
+      ++p_;
+    }
+    bool first = true;
+    while ( true ) {
+      if ( p_ >= end_ ) {
+        return false;
+      }
+      if ( *p_ == ']' && !first ) {
+        ++p_;
+        break;
+      }
+      first = false;
+      if ( Is("[:") ) {
+        const char* const name = p_ + 2;
+        const char* const name_end = strstr(name, ":]");
+        if ( name_end == NULL || name_end > end_ ||
+             !AddClass(string(name, name_end - name), chars) ) {
+          return false;
+        }
+        p_ = name_end + 2;
+        continue;
+      }
+      if ( Is("[.") || Is("[=") ) {
+        return false;
+      }
+      const uint8 lo = *p_++;
+      if ( end_ - p_ >= 2 && *p_ == '-' && p_[1] != ']' ) {
+        const uint8 hi = p_[1];
+        if ( hi < lo || hi == '[' ) {
+          return false;
+        }
+        p_ += 2;
+        for ( int i = lo; i <= hi; ++i ) {
+          chars->set(i);
+        }
+      } else {
+        chars->set(lo);
+      }
+    }
+    if ( negate ) {
+      if ( icase_ ) {
+        // fold before negating, as [^a] w/ REG_ICASE matches no 'A'
+        const CharSet set = *chars;
+        for ( int c = 0; c < 256; ++c ) {
+          if ( set.test(c) ) {
+            chars->set(tolower(c));
+            chars->set(toupper(c));
+          }
+        }
+      }
+      chars->flip();
+    }
+    return true;
+  }
+  static bool AddClass(const string& name, CharSet* chars) {
+    int (*is)(int) = NULL;
+    if ( name == "alpha" ) is = isalpha;
+    else if ( name == "digit" ) is = isdigit;
+    else if ( name == "alnum" ) is = isalnum;
+    else if ( name == "upper" ) is = isupper;
+    else if ( name == "lower" ) is = islower;
+    else if ( name == "space" ) is = isspace;
+    else if ( name == "blank" ) is = isblank;
+    else if ( name == "punct" ) is = ispunct;
+    else if ( name == "print" ) is = isprint;
+    else if ( name == "graph" ) is = isgraph;
+    else if ( name == "cntrl" ) is = iscntrl;
+    else if ( name == "xdigit" ) is = isxdigit;
+    else return false;
+    for ( int c = 0; c < 256; ++c ) {
+      if ( is(c) ) {
+        chars->set(c);
+      }
+    }
+    return true;
+  }
+  bool ParsePostfix(Ast** atom) {
+    while ( p_ < end_ ) {
+      int min = 0, max = -1;
+      if ( *p_ == '*' ) {
+        ++p_;
+      } else if ( extended_ && *p_ == '+' ) {
+        ++p_;
+        min = 1;
+      } else if ( extended_ && *p_ == '?' ) {
+        ++p_;
+        max = 1;
+      } else if ( !extended_ && Is("\\+") ) {
+        p_ += 2;
+        min = 1;
+      } else if ( !extended_ && Is("\\?") ) {
+        p_ += 2;
+        max = 1;
+      } else if ( extended_ ? Is("{") : Is("\\{") ) {
+        p_ += extended_ ? 1 : 2;
+        if ( !ParseInterval(&min, &max) ) {
+          return false;
+        }
+      } else {
+        break;
+      }
+      if ( (*atom)->kind_ == Ast::BEGIN || (*atom)->kind_ == Ast::END ) {
+        return false;
+      }
+      Ast* const repeat = new Ast(Ast::REPEAT);
+      repeat->min_ = min;
+      repeat->max_ = max;
+      repeat->kids_.push_back(*atom);
+      *atom = repeat;
+    }
+    return true;
+  }
+  bool ParseNumber(int* n) {
+    if ( p_ == end_ || !isdigit(*p_) ) {
+      return false;
+    }
+    *n = 0;
+    while ( p_ < end_ && isdigit(*p_) ) {
+      *n = *n * 10 + (*p_++ - '0');
+      if ( *n > kMaxRepeat ) {
+        return false;
+      }
+    }
+    return true;
+  }
+  bool ParseInterval(int* min, int* max) {
+    if ( !ParseNumber(min) ) {
+      return false;
+    }
+    *max = *min;
+    if ( p_ < end_ && *p_ == ',' ) {
+      ++p_;
+      *max = -1;
+      if ( p_ < end_ && isdigit(*p_) &&
+           (!ParseNumber(max) || *max < *min) ) {
+        return false;
+      }
+    }
+    if ( extended_ ? !Is("}") : !Is("\\}") ) {
+      return false;
+    }
+    p_ += extended_ ? 1 : 2;
+    return true;
+  }
+
+  const char* p_;
+  const char* const end_;
+  const bool extended_;
+  const bool icase_;
+  int depth_;   // of the groups we are in
+};
+
+RESet::RESet(int cflags)
+    : cflags_(cflags),
+      compiled_(false) {
+  memset(byte_class_, 0, sizeof(byte_class_));
+}
+
+RESet::~RESet() {
+  for ( int i = 0; i < fallback_.size(); ++i ) {
+    delete fallback_[i].second;
+  }
+}
+
+int RESet::Add(const string& regex) {
+  CHECK(!compiled_) << " Add() after Compile()";
+  RE* re = new RE(regex, cflags_);
+  if ( re->HasError() ) {
+    LOG_ERROR << "Invalid regex: [" << regex << "], error: "
+              << re->ErrorName();
+    delete re;
+    return -1;
+  }
+  const int index = regex_.size();
+  regex_.push_back(regex);
+
+  Ast* ast = NULL;
+  if ( (cflags_ & ~(REG_EXTENDED | REG_ICASE | REG_NOSUB)) == 0 ) {
+    ast = Parser(regex,
+                 (cflags_ & REG_EXTENDED) != 0,
+                 (cflags_ & REG_ICASE) != 0).Parse();
+  }
+  if ( ast != NULL ) {
+    const int num_nodes = nodes_.size();
+    const int num_chars = chars_.size();
+    const int start = CompileAst(ast, NewNode(Node::MATCH, index, -1, -1),
+                                 num_nodes + kMaxNodesPerRegex);
+    delete ast;
+    if ( start >= 0 ) {
+      starts_.push_back(start);
+      delete re;
+      return index;
+    }
+    nodes_.resize(num_nodes, Node(Node::MATCH, 0, -1, -1));
+    chars_.resize(num_chars);
+  }
+  fallback_.push_back(make_pair(index, re));
+  return index;
+}
+
+int RESet::NewNode(Node::Type type, int arg, int out, int out1) {
+  nodes_.push_back(Node(type, arg, out, out1));
+  return nodes_.size() - 1;
+}
+
+int RESet::CompileAst(const Ast* ast, int next, int limit) {
+  if ( next < 0 || nodes_.size() >= limit ) {
+    return -1;
+  }
+  switch ( ast->kind_ ) {
+    case Ast::EMPTY:
+      return next;
+    case Ast::CHARS:
+      chars_.push_back(ast->chars_);
+      return NewNode(Node::CHARS, chars_.size() - 1, next, -1);
+    case Ast::BEGIN:
+      return NewNode(Node::BEGIN, 0, next, -1);
+    case Ast::END:
+      return NewNode(Node::END, 0, next, -1);
+    case Ast::CAT:
+      for ( int i = ast->kids_.size() - 1; i >= 0 && next >= 0; --i ) {
+        next = CompileAst(ast->kids_[i], next, limit);
+      }
+      return next;
+    case Ast::ALT: {
+      int start = CompileAst(ast->kids_.back(), next, limit);
+      for ( int i = ast->kids_.size() - 2; i >= 0 && start >= 0; --i ) {
+        const int kid = CompileAst(ast->kids_[i], next, limit);
+        if ( kid < 0 ) {
+          return -1;
+        }
+        start = NewNode(Node::SPLIT, 0, kid, start);
+      }
+      return start;
+    }
+    case Ast::REPEAT: {
+      const Ast* const kid = ast->kids_[0];
+      int start = next;
+      if ( ast->max_ < 0 ) {
+        const int loop = NewNode(Node::SPLIT, 0, -1, next);
+        const int body = CompileAst(kid, loop, limit);
+        nodes_[loop].out_ = body;
+        start = body < 0 ? -1 : loop;
+      } else {
+        for ( int i = ast->min_; i < ast->max_ && start >= 0; ++i ) {
+          const int body = CompileAst(kid, start, limit);
+          start = body < 0 ? -1 : NewNode(Node::SPLIT, 0, body, next);
+        }
+      }
+      for ( int i = 0; i < ast->min_ && start >= 0; ++i ) {
+        start = CompileAst(kid, start, limit);
+      }
+      return start;
+    }
+  }
+  return -1;
+}
+
+void RESet::AddClosure(int node, bool at_begin, bool at_end,
+                       vector<int32>* mark, int32 mark_id,
+                       vector<int32>* out) const {
+  vector<int32> stack(1, node);
+  while ( !stack.empty() ) {
+    const int n = stack.back();
+    stack.pop_back();
+    if ( (*mark)[n] == mark_id ) {
+      continue;
+    }
+    (*mark)[n] = mark_id;
+    const Node& crt = nodes_[n];
+    switch ( crt.type_ ) {
+      case Node::CHARS:
+      case Node::MATCH:
+        out->push_back(n);
+        break;
+      case Node::SPLIT:
+        stack.push_back(crt.out1_);
+        stack.push_back(crt.out_);
+        break;
+      case Node::BEGIN:
+        if ( at_begin ) {
+          stack.push_back(crt.out_);
+        }
+        break;
+      case Node::END:
+        if ( at_end ) {
+          stack.push_back(crt.out_);
+        } else {
+          out->push_back(n);   // we may get to the end later
+        }
+        break;
+    }
+  }
+}
+
+void RESet::StartNodes(bool at_begin, vector<int32>* mark, int32* mark_id,
+                       vector<int32>* out) const {
+  ++*mark_id;
+  out->clear();
+  for ( int i = 0; i < starts_.size(); ++i ) {
+    AddClosure(starts_[i], at_begin, false, mark, *mark_id, out);
+  }
+  sort(out->begin(), out->end());
+}
+
+void RESet::Step(const vector<int32>& from, uint8 c,
+                 vector<int32>* mark, int32* mark_id,
+                 vector<int32>* out) const {
+  ++*mark_id;
+  out->clear();
+  for ( int i = 0; i < from.size(); ++i ) {
+    const Node& crt = nodes_[from[i]];
+    if ( crt.type_ == Node::CHARS && chars_[crt.arg_].test(c) ) {
+      AddClosure(crt.out_, false, false, mark, *mark_id, out);
+    }
+  }
+  // a match can start anywhere
+  for ( int i = 0; i < starts_.size(); ++i ) {
+    AddClosure(starts_[i], false, false, mark, *mark_id, out);
+  }
+  sort(out->begin(), out->end());
+}
+
+int RESet::BestMatch(const vector<int32>& nodes, bool at_begin, bool at_end,
+                     vector<int32>* mark, int32* mark_id) const {
+  int best = kNoMatch;
+  vector<int32> end_nodes;
+  ++*mark_id;
+  for ( int i = 0; i < nodes.size(); ++i ) {
+    const Node& crt = nodes_[nodes[i]];
+    if ( crt.type_ == Node::MATCH ) {
+      best = min(best, crt.arg_);
+    } else if ( crt.type_ == Node::END && at_end ) {
+      AddClosure(crt.out_, at_begin, true, mark, *mark_id, &end_nodes);
+    }
+  }
+  for ( int i = 0; i < end_nodes.size(); ++i ) {
+    const Node& crt = nodes_[end_nodes[i]];
+    if ( crt.type_ == Node::MATCH ) {
+      best = min(best, crt.arg_);
+    }
+  }
+  return best;
+}
+
+void RESet::ComputeByteClasses() {
+  // refine the partition of the bytes w/ each char set
+  int num_classes = 1;
+  for ( int i = 0; i < chars_.size(); ++i ) {
+    vector<int> split(2 * num_classes, -1);
+    int crt_classes = 0;
+    for ( int c = 0; c < 256; ++c ) {
+      int& cls = split[2 * byte_class_[c] + chars_[i].test(c)];
+      if ( cls < 0 ) {
+        cls = crt_classes++;
+      }
+      byte_class_[c] = cls;
+    }
+    num_classes = crt_classes;
+  }
+  class_byte_.resize(num_classes);
+  for ( int c = 255; c >= 0; --c ) {
+    class_byte_[byte_class_[c]] = c;
+  }
+}
+
+bool RESet::BuildDfa() {
+  vector<int32> mark(nodes_.size(), 0);
+  int32 mark_id = 0;
+  vector< vector<int32> > sets(1);
+  map<vector<int32>, int32> ids;  // w/o the start state (it is special)
+  StartNodes(true, &mark, &mark_id, &sets[0]);
+  vector<int32> next;
+  for ( int s = 0; s < sets.size(); ++s ) {
+    DfaState state;
+    state.match_ = BestMatch(sets[s], s == 0, false, &mark, &mark_id);
+    state.end_match_ = BestMatch(sets[s], s == 0, true, &mark, &mark_id);
+    state.next_.resize(class_byte_.size());
+    for ( int k = 0; k < class_byte_.size(); ++k ) {
+      Step(sets[s], class_byte_[k], &mark, &mark_id, &next);
+      const pair<map<vector<int32>, int32>::iterator, bool> res =
+          ids.insert(make_pair(next, static_cast<int32>(sets.size())));
+      if ( res.second ) {
+        if ( sets.size() >= kMaxDfaStates ) {
+          dfa_.clear();
+          return false;
+        }
+        sets.push_back(next);
+      }
+      state.next_[k] = res.first->second;
+    }
+    dfa_.push_back(state);
+  }
+  return true;
+}
+
+void RESet::Compile() {
+  CHECK(!compiled_);
+  compiled_ = true;
+  if ( starts_.empty() ) {
+    return;
+  }
+  ComputeByteClasses();
+  if ( !BuildDfa() ) {
+    LOG_WARNING << "Too many DFA states for " << starts_.size()
+                << " expressions, matching w/ the NFA";
+  }
+}
+
+int RESet::AutomatonMatch(const char* s) const {
+  const uint8* p = reinterpret_cast<const uint8*>(s);
+  if ( !dfa_.empty() ) {
+    int best = kNoMatch;
+    int state = 0;
+    for ( ; *p != 0; ++p ) {
+      const DfaState& crt = dfa_[state];
+      if ( crt.match_ < best ) {
+        best = crt.match_;
+        if ( best == 0 ) {
+          return 0;
+        }
+      }
+      state = crt.next_[byte_class_[*p]];
+    }
+    return min(best, min(dfa_[state].match_, dfa_[state].end_match_));
+  }
+  // simulate the NFA
+  vector<int32> mark(nodes_.size(), 0);
+  int32 mark_id = 0;
+  vector<int32> crt, next;
+  StartNodes(true, &mark, &mark_id, &crt);
+  int best = kNoMatch;
+  const bool empty = (*p == 0);
+  for ( ; *p != 0; ++p ) {
+    best = min(best, BestMatch(crt, false, false, &mark, &mark_id));
+    if ( best == 0 ) {
+      return 0;
+    }
+    Step(crt, *p, &mark, &mark_id, &next);
+    crt.swap(next);
+  }
+  return min(best, BestMatch(crt, empty, true, &mark, &mark_id));
+}
+
+int RESet::FirstMatch(const char* s) const {
+  CHECK(compiled_) << " FirstMatch() before Compile()";
+  int best = starts_.empty() ? kNoMatch : AutomatonMatch(s);
+  for ( int i = 0; i < fallback_.size() && fallback_[i].first < best; ++i ) {
+    if ( fallback_[i].second->Matches(s) ) {
+      best = fallback_[i].first;
+      break;
+    }
+  }
+  return best == kNoMatch ? -1 : best;
+}
 }
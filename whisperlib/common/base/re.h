@@ -36,7 +36,9 @@
 #define __COMMON_BASE_RE_H__
 
 #include <regex.h>
+#include <bitset>
 #include <string>
+#include <vector>
 #include <whisperlib/common/base/types.h>
 
 namespace re {
@@ -80,6 +82,122 @@ class RE {
   regmatch_t match_;
   bool match_begin_;
 };
+
+// A set of regular expressions (same syntax and cflags as RE) that are
+// matched together: FirstMatch(s) returns the index of the first
+// expression (in the order they were added) that RE::Matches(s).
+//
+// The expressions are compiled into one automaton (a DFA, or, if that
+// gets too large, an NFA we simulate), so matching is one pass over s
+// no matter how many expressions we have. Expressions that an automaton
+// cannot express (back references, word boundaries, collating elements)
+// are kept as RE-s and tried only when they can beat the automaton's
+// answer.
+//
+// Add() and Compile() are not thread safe. After Compile() the set is
+// read only, and FirstMatch() can be called from any number of threads.
+class RESet {
+ public:
+  // cflags: as for RE (we understand REG_EXTENDED and REG_ICASE; any
+  // other flag sends all expressions to the RE fallback)
+  explicit RESet(int cflags = 0);
+  ~RESet();
+
+  // Adds an expression. Returns its index, or -1 if it is invalid.
+  int Add(const string& regex);
+  // Builds the automaton. Call it once, after adding all expressions.
+  void Compile();
+
+  // Returns the index of the first expression that matches s, or -1.
+  int FirstMatch(const char* s) const;
+  int FirstMatch(const string& s) const {
+    return FirstMatch(s.c_str());
+  }
+
+  int size() const { return regex_.size(); }
+  const string& regex(int i) const { return regex_[i]; }
+  // How many expressions we match w/ the RE fallback
+  int num_fallback() const { return fallback_.size(); }
+  // How many DFA states we have (0 => we simulate the NFA)
+  int num_dfa_states() const { return dfa_.size(); }
+
+ private:
+  // Past this many DFA states we give up the DFA
+  static const int kMaxDfaStates = 4096;
+  static const int kNoMatch = kMaxInt32;
+
+  struct Node {
+    enum Type {
+      CHARS,     // consume a char from chars_[arg_], goto out_
+      SPLIT,     // goto out_ and out1_
+      BEGIN,     // assert beginning of string, goto out_
+      END,       // assert end of string, goto out_
+      MATCH      // expression arg_ matched
+    };
+    Type type_;
+    int arg_;
+    int out_;
+    int out1_;
+    Node(Type type, int arg, int out, int out1)
+        : type_(type), arg_(arg), out_(out), out1_(out1) {}
+  };
+  struct DfaState {
+    // smallest expression matched when we are here, and when we are
+    // here at the end of the string
+    int match_;
+    int end_match_;
+    // next state, by byte class
+    vector<int32> next_;
+  };
+  typedef bitset<256> CharSet;
+  // the syntax tree of an expression, and its parser (in re.cc)
+  struct Ast;
+  class Parser;
+  // Past this many nodes for one expression we send it to the fallback
+  static const int kMaxNodesPerRegex = 10000;
+
+  int NewNode(Node::Type type, int arg, int out, int out1);
+  // Appends the nodes for ast, continuing w/ next. Returns the start
+  // node, or -1 if we have more than limit nodes.
+  int CompileAst(const Ast* ast, int next, int limit);
+  void ComputeByteClasses();
+
+  // Adds the closure of node to out (CHARS, END, MATCH nodes);
+  // mark / mark_id are a scratch 'visited' vector
+  void AddClosure(int node, bool at_begin, bool at_end,
+                  vector<int32>* mark, int32 mark_id,
+                  vector<int32>* out) const;
+  // The nodes we are in after consuming c from 'from'
+  // (we also restart all unanchored expressions)
+  void Step(const vector<int32>& from, uint8 c,
+            vector<int32>* mark, int32* mark_id,
+            vector<int32>* out) const;
+  // The best match in 'nodes' (at_end: we are at the end of the string)
+  int BestMatch(const vector<int32>& nodes, bool at_begin, bool at_end,
+                vector<int32>* mark, int32* mark_id) const;
+  void StartNodes(bool at_begin, vector<int32>* mark, int32* mark_id,
+                  vector<int32>* out) const;
+  bool BuildDfa();
+  int AutomatonMatch(const char* s) const;
+
+  const int cflags_;
+  vector<string> regex_;
+
+  // the NFA
+  vector<Node> nodes_;
+  vector<CharSet> chars_;
+  vector<int32> starts_;          // start node of each expression
+  // expressions handled by RE
+  vector< pair<int, RE*> > fallback_;
+
+  // the DFA
+  uint16 byte_class_[256];
+  vector<uint8> class_byte_;      // a byte of each class
+  vector<DfaState> dfa_;
+  bool compiled_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(RESet);
+};
 }
 
 #endif  // __COMMON_BASE_RE_H__
@@ -30,6 +30,8 @@
 // Author: Catalin Popescu
 #include <stdlib.h>
 
+#include <stdlib.h>
+#include <vector>
 #include "common/base/types.h"
 #include "common/base/log.h"
 #include "common/base/re.h"
@@ -83,5 +85,97 @@ int main(int argc, char* argv[]) {
     CHECK(re4.Replace(t.c_str(), "a$1+b$2+c$3+d$4+e$5+f$6+g$7+h$8+i$9", s));
     CHECK_EQ(s, string("a1+b2+c3+d4+e5+f6+g7+h8+i9"));
   }
+  {
+    re::RESet set;
+    CHECK_EQ(set.Add("\\.flv$"), 0);
+    CHECK_EQ(set.Add("\\.f4v$"), 1);
+    CHECK_EQ(set.Add("^live/"), 2);
+    CHECK_EQ(set.Add("\\(a\\)\\1"), 3);   // back reference => RE
+    CHECK_EQ(set.Add("\\(x"), -1);
+    set.Compile();
+    CHECK_EQ(set.num_fallback(), 1);
+    CHECK_EQ(set.FirstMatch("movies/a.flv"), 0);
+    CHECK_EQ(set.FirstMatch("live/a.flv"), 0);
+    CHECK_EQ(set.FirstMatch("live/a.f4v"), 1);
+    CHECK_EQ(set.FirstMatch("live/a.mp4"), 2);
+    CHECK_EQ(set.FirstMatch("x/live/a.mp4"), -1);
+    CHECK_EQ(set.FirstMatch("x/aa"), 3);
+    CHECK_EQ(set.FirstMatch("a.flv.mp4"), -1);
+    CHECK_EQ(set.FirstMatch(""), -1);
+  }
+  {
+    re::RESet set(REG_EXTENDED | REG_ICASE);
+    CHECK_EQ(set.Add("^(ab|cd)+[0-9]{2,3}$"), 0);
+    CHECK_EQ(set.Add("^$"), 1);
+    CHECK_EQ(set.Add("[[:digit:]]x?"), 2);
+    set.Compile();
+    CHECK_EQ(set.FirstMatch("AbCd12"), 0);
+    CHECK_EQ(set.FirstMatch("abcd1234"), 2);
+    CHECK_EQ(set.FirstMatch(""), 1);
+    CHECK_EQ(set.FirstMatch("zzz"), -1);
+  }
+  for ( int icase = 0; icase < 2; ++icase ) {
+    // a basic '^' is an anchor only first in the RE, or right after
+    // '\(' or '\|' - anywhere else it is a plain character
+    re::RESet set(icase ? REG_ICASE : 0);
+    CHECK_EQ(set.Add("^^a"), 0);
+    CHECK_EQ(set.Add("b^"), 1);
+    CHECK_EQ(set.Add("x\\|\\(^a\\)"), 2);
+    set.Compile();
+    CHECK_EQ(set.num_fallback(), 0);
+    CHECK_EQ(set.FirstMatch("a"), 2);
+    CHECK_EQ(set.FirstMatch("^a"), 0);
+    CHECK_EQ(set.FirstMatch("cb^"), 1);
+    CHECK_EQ(set.FirstMatch("b"), -1);
+    CHECK_EQ(set.FirstMatch(icase ? "A" : "a"), 2);
+    CHECK_EQ(set.FirstMatch(icase ? "^A" : "A"), icase ? 0 : -1);
+  }
+  {
+    // RESet must agree w/ matching the RE-s one by one
+    const char* const kPatterns[] = {
+      "a*b", "^a\\{2,3\\}$", "[^a-c]x", "b\\|c$", "^\\(ab\\)*c",
+      ".a.", "^$", "a\\+b\\?c", "[]a]", "^*a", "a$b", "\\w\\W",
+      "[[:upper:]][[:lower:]]", "x\\{0,1\\}y\\{2,\\}", "^^a", "a^*b",
+      "\\(^b\\)", "c\\|^x^",
+    };
+    const char* const kExtendedPatterns[] = {
+      "(a|b)*c", "^a{2,3}$", "b+$", "^(ab|a)(bc|c)$", "a?b?c?d",
+      "[.]x", "(^a|b$)", "(a|)b", "[a-]x", "(x*)*y",
+    };
+    const char kAlphabet[] = "abcxyA-]. ^";
+    for ( int extended = 0; extended < 2; ++extended ) {
+      const char* const* patterns = extended ? kExtendedPatterns : kPatterns;
+      const int num_patterns = extended ? NUMBEROF(kExtendedPatterns)
+                                        : NUMBEROF(kPatterns);
+      const int cflags = extended ? REG_EXTENDED : 0;
+      re::RESet set(cflags);
+      vector<re::RE*> res;
+      for ( int i = 0; i < num_patterns; ++i ) {
+        CHECK_EQ(set.Add(patterns[i]), i) << patterns[i];
+        res.push_back(new re::RE(patterns[i], cflags));
+      }
+      set.Compile();
+      CHECK_EQ(set.num_fallback(), 0);
+      CHECK_GT(set.num_dfa_states(), 0);
+      srandom(extended);
+      for ( int n = 0; n < 20000; ++n ) {
+        string s;
+        const int len = random() % 8;
+        for ( int i = 0; i < len; ++i ) {
+          s.push_back(kAlphabet[random() % (sizeof(kAlphabet) - 1)]);
+        }
+        int expected = -1;
+        for ( int i = 0; i < res.size() && expected < 0; ++i ) {
+          if ( res[i]->Matches(s) ) {
+            expected = i;
+          }
+        }
+        CHECK_EQ(set.FirstMatch(s), expected) << " for: [" << s << "]";
+      }
+      for ( int i = 0; i < res.size(); ++i ) {
+        delete res[i];
+      }
+    }
+  }
   LOG_INFO << "PASS";
 }
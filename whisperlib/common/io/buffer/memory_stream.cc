@@ -530,6 +530,45 @@ void MemoryStream::AppendStream(MemoryStream* buffer, int32 size) {
 
 #endif  //  __APPEND_WITH_BLOCK_REUSE__
 
+void MemoryStream::AppendStreamByReference(MemoryStream* in, int32 size) {
+  if ( !in->MaybeInitReadPointer() ) {
+    return;
+  }
+  if ( size < 0 || static_cast<uint32>(size) > in->Size() ) {
+    size = in->Size();
+  }
+  if ( size == 0 ) {
+    return;
+  }
+  DataBlockPointer begin(in->read_pointer_);
+  DataBlockPointer end(begin);
+  end.Advance(size);
+  BlockDqueue::const_iterator it = in->blocks_.buffer_it(begin.block_id());
+  while ( begin.block_id() <= end.block_id() ) {
+    const int32 pos_begin = begin.pos();
+    const int32 pos_end = (begin.block_id() == end.block_id() ?
+                           end.pos() : (*it)->size());
+    if ( pos_begin < pos_end ) {
+      if ( pos_begin == 0 && pos_end == (*it)->buffer_size() ) {
+        AppendBlock(*it);
+      } else {
+        // Data already written in a block never changes, so we can
+        // safely point in there (even in a block still being written)
+        DataBlock* const alloc_block = (*it)->GetAllocBlock();
+        alloc_block->IncRef();
+        AppendBlock(new DataBlock((*it)->buffer() + pos_begin,
+                                  pos_end - pos_begin,
+                                  NULL, alloc_block));
+      }
+    }
+    ++it;
+    begin.set_block_id(begin.block_id() + 1);
+    begin.set_pos(0);
+  }
+  write_pointer_.SkipToCurrentBlockEnd();
+  in->Skip(size);
+}
+
 void MemoryStream::AppendNewBlock(DataBlock* data,
                                   BlockSize pos_begin, BlockSize pos_end) {
   DCHECK_GE(pos_end, pos_begin);
@@ -127,6 +127,13 @@ class MemoryStream {
                                   int32 offset = 0,
                                   int32 size = -1);
 
+  // Moves size bytes (or all if size == -1) from 'in' to us, w/o copying:
+  // full blocks are shared, partial blocks are appended as read only
+  // blocks that point inside (and keep a reference to) the original
+  // buffers. Good for large payloads - small ones end up pinning a whole
+  // block for a few bytes, so better AppendStream those.
+  void AppendStreamByReference(MemoryStream* in, int32 size = -1);
+
  private:
   // As above, but appends between the pointers of the same owner
   void AppendStreamNonDestructive(DataBlockPointer* begin,
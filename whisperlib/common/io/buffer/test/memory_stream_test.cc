@@ -210,6 +210,55 @@ void TestRandomAppends(bool mix_operations,
 
 //////////////////////////////////////////////////////////////////////
 
+// Moves random pieces of a buffer (still being written) into a second
+// one by reference, then checks the content - also after the source
+// and its blocks are gone.
+void TestAppendByReference(int32 block_size,
+                           int32 total_size,
+                           int32 max_write_size,
+                           int32 max_append_size) {
+  string expected;
+  io::MemoryStream out(block_size);
+  {
+    io::MemoryStream in(block_size);
+    string written;
+    while ( expected.size() < total_size ) {
+      const int32 write_size = 1 + rand_r(&rand_seed) % max_write_size;
+      string s;
+      for ( int32 i = 0; i < write_size; ++i ) {
+        s.push_back(static_cast<char>(rand_r(&rand_seed)));
+      }
+      in.Write(s);
+      written += s;
+      // We also mix in regular appends / writes in the destination
+      const int32 op = rand_r(&rand_seed) % 4;
+      const int32 append_size = min(
+          static_cast<int32>(in.Size()),
+          static_cast<int32>(rand_r(&rand_seed) % max_append_size));
+      if ( op == 0 ) {
+        out.AppendStream(&in, append_size);
+      } else {
+        out.AppendStreamByReference(&in, append_size);
+      }
+      expected += written.substr(0, append_size);
+      written.erase(0, append_size);
+      if ( op == 1 ) {
+        out.Write("x");
+        expected += "x";
+      }
+      CHECK_EQ(out.Size(), expected.size());
+    }
+    out.AppendStreamByReference(&in);
+    expected += written;
+    CHECK(in.IsEmpty());
+  }
+  string s;
+  out.ReadString(&s);
+  CHECK(s == expected);
+}
+
+//////////////////////////////////////////////////////////////////////
+
 int main(int argc, char* argv[]) {
   common::Init(argc, argv);
   rand_seed = FLAGS_rand_seed;
@@ -328,6 +377,11 @@ int main(int argc, char* argv[]) {
   LOG_INFO << "TestRandomAppends /true/4";
   TestRandomAppends(true, 16384, 12000, 10000000, 128, 160, 256);
 
+  LOG_INFO << "TestAppendByReference /1";
+  TestAppendByReference(4096, 10000000, 3000, 6000);
+  LOG_INFO << "TestAppendByReference /2";
+  TestAppendByReference(128, 1000000, 300, 200);
+
   LOG_INFO << "Test 0";
   const int two_block_plus3 = 4096 * 2 + 3;
   TestPipeStyle(two_block_plus3, 0, two_block_plus3,
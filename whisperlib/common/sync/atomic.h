@@ -32,6 +32,12 @@ T AtomicSubAndFetch(T* ptr, T value) {
   return __sync_sub_and_fetch(ptr, value);
 }
 
+// Atomic read (w/ a full barrier) of a value updated from other threads.
+template <typename T>
+T AtomicLoad(const T* ptr) {
+  return __sync_add_and_fetch(const_cast<T*>(ptr), static_cast<T>(0));
+}
+
 // Atomic compare and swap: if the current value of *ptr is oldval,
 // then write newval into *ptr.
 
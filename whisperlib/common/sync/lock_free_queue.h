@@ -0,0 +1,176 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#ifndef __COMMON_SYNC_LOCK_FREE_QUEUE_H__
+#define __COMMON_SYNC_LOCK_FREE_QUEUE_H__
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+
+namespace synch {
+
+// A bounded multi producer / multi consumer queue that uses no locks.
+//
+// This is the classic array based queue where every cell carries a
+// sequence number that tells the producers and the consumers whose turn
+// it is to use the cell. A producer (or a consumer) claims a position w/
+// a single compare and swap, and there is no shared state besides the
+// two positions - so threads on different ends do not contend.
+//
+// The queue never blocks - it is up to the caller to wait when Put fails
+// (full queue) or Get fails (empty queue). C should be cheap to copy
+// (a pointer or a small struct).
+template<typename C>
+class LockFreeQueue {
+ public:
+  // The capacity is max_size rounded up to a power of two.
+  explicit LockFreeQueue(uint32 max_size)
+      : mask_(RoundUpCapacity(max_size) - 1),
+        cells_(new Cell[mask_ + 1]),
+        enqueue_pos_(0),
+        dequeue_pos_(0) {
+    for ( size_t i = 0; i <= mask_; ++i ) {
+      cells_[i].seq_ = i;
+    }
+  }
+  ~LockFreeQueue() {
+    delete [] cells_;
+  }
+
+  uint32 capacity() const {
+    return mask_ + 1;
+  }
+
+  // Appends p at the end of the queue.
+  // Returns false if the queue is full.
+  bool Put(const C& p) {
+    Cell* cell;
+    size_t pos = enqueue_pos_;
+    while ( true ) {
+      cell = &cells_[pos & mask_];
+      const intptr_t dif = static_cast<intptr_t>(cell->seq_) -
+                           static_cast<intptr_t>(pos);
+      if ( dif == 0 ) {
+        // the cell is free - claim the position
+        if ( __sync_bool_compare_and_swap(&enqueue_pos_, pos, pos + 1) ) {
+          break;
+        }
+        pos = enqueue_pos_;
+      } else if ( dif < 0 ) {
+        return false;    // full
+      } else {
+        pos = enqueue_pos_;   // somebody took it, try again
+      }
+    }
+    cell->data_ = p;
+    __sync_synchronize();
+    cell->seq_ = pos + 1;     // the cell is full
+    return true;
+  }
+
+  // Extracts the element at the front of the queue in *p.
+  // Returns false if the queue is empty.
+  bool Get(C* p) {
+    Cell* cell;
+    size_t pos = dequeue_pos_;
+    while ( true ) {
+      cell = &cells_[pos & mask_];
+      const intptr_t dif = static_cast<intptr_t>(cell->seq_) -
+                           static_cast<intptr_t>(pos + 1);
+      if ( dif == 0 ) {
+        // the cell is full - claim the position
+        if ( __sync_bool_compare_and_swap(&dequeue_pos_, pos, pos + 1) ) {
+          break;
+        }
+        pos = dequeue_pos_;
+      } else if ( dif < 0 ) {
+        return false;    // empty
+      } else {
+        pos = dequeue_pos_;
+      }
+    }
+    *p = cell->data_;
+    __sync_synchronize();
+    cell->seq_ = pos + mask_ + 1;    // the cell is free for the next round
+    return true;
+  }
+
+  // Extracts at most max_count elements from the front of the queue
+  // in out. Returns the number of extracted elements.
+  uint32 GetBatch(C* out, uint32 max_count) {
+    uint32 count = 0;
+    while ( count < max_count && Get(out + count) ) {
+      ++count;
+    }
+    return count;
+  }
+
+  // The number of elements in the queue - just a hint, as it may
+  // change by the time the caller looks at it.
+  uint32 Size() const {
+    const size_t dequeue_pos = dequeue_pos_;
+    const size_t enqueue_pos = enqueue_pos_;
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+  }
+  bool IsEmpty() const {
+    return Size() == 0;
+  }
+
+ private:
+  static size_t RoundUpCapacity(uint32 max_size) {
+    CHECK_GT(max_size, 0);
+    size_t capacity = 2;
+    while ( capacity < max_size ) {
+      capacity <<= 1;
+    }
+    return capacity;
+  }
+
+  struct Cell {
+    volatile size_t seq_;
+    C data_;
+  };
+  static const int kCacheLineSize = 64;
+
+  const size_t mask_;
+  Cell* const cells_;
+  // The producers and the consumers positions stay on separate cache lines
+  char pad0_[kCacheLineSize];
+  volatile size_t enqueue_pos_;
+  char pad1_[kCacheLineSize - sizeof(size_t)];
+  volatile size_t dequeue_pos_;
+  char pad2_[kCacheLineSize - sizeof(size_t)];
+
+  DISALLOW_EVIL_CONSTRUCTORS(LockFreeQueue);
+};
+}
+
+#endif  // __COMMON_SYNC_LOCK_FREE_QUEUE_H__
@@ -0,0 +1,103 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#ifndef __COMMON_SYNC_MPSC_QUEUE_H__
+#define __COMMON_SYNC_MPSC_QUEUE_H__
+
+#include <whisperlib/common/base/types.h>
+
+namespace synch {
+
+// An intrusive, unbounded, multi producer / single consumer queue that
+// uses no locks and allocates nothing.
+//
+// The elements are linked through their own "next_" member (T has to
+// declare synch::MpscQueue<T> as a friend) - so an element can wait in
+// only one queue at a time.
+//
+// The producers push on a (Treiber) stack w/ a compare and swap. The
+// consumer takes the whole stack at once w/ an exchange, and gets it back
+// in FIFO order. Since the consumer never pops single elements, there is
+// no ABA problem.
+template<typename T>
+class MpscQueue {
+ public:
+  MpscQueue() : head_(NULL) {
+  }
+  ~MpscQueue() {
+  }
+
+  // Adds p to the queue. Safe to call from any thread.
+  void Put(T* p) {
+    T* head;
+    do {
+      head = head_;
+      p->next_ = head;
+    } while ( !__sync_bool_compare_and_swap(&head_, head, p) );
+  }
+
+  // Takes all the elements from the queue, and returns them as a list
+  // in the order they were Put (walk it w/ Next()). Returns NULL if the
+  // queue is empty. Call only from the consumer thread.
+  T* GetAll() {
+    if ( head_ == NULL ) {
+      return NULL;
+    }
+    T* p = __sync_lock_test_and_set(&head_, static_cast<T*>(NULL));
+    // reverse the stack
+    T* list = NULL;
+    while ( p != NULL ) {
+      T* const next = p->next_;
+      p->next_ = list;
+      list = p;
+      p = next;
+    }
+    return list;
+  }
+
+  // The element after p in a list returned by GetAll().
+  static T* Next(const T* p) {
+    return p->next_;
+  }
+
+  // Approximate, when producers are at work.
+  bool IsEmpty() const {
+    return head_ == NULL;
+  }
+
+ private:
+  T* volatile head_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(MpscQueue);
+};
+}
+
+#endif  // __COMMON_SYNC_MPSC_QUEUE_H__
@@ -0,0 +1,134 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <vector>
+#include "common/base/log.h"
+#include "common/base/system.h"
+#include "common/base/gflags.h"
+#include "common/sync/atomic.h"
+#include "common/sync/thread.h"
+#include "common/sync/lock_free_queue.h"
+
+DEFINE_int32(num_elements, 200000,
+             "Each producer puts these many elements in the queue");
+DEFINE_int32(num_threads, 4,
+             "Run w/ these many producers and these many consumers");
+
+struct TestState {
+  explicit TestState(uint32 size)
+      : q_(size), sum_(0), count_(0) {
+  }
+  synch::LockFreeQueue<int64> q_;
+  int64 sum_;
+  int64 count_;
+};
+
+void Producer(TestState* state, int64 base) {
+  for ( int64 i = 0; i < FLAGS_num_elements; ++i ) {
+    while ( !state->q_.Put(base + i) ) {
+      sched_yield();
+    }
+  }
+}
+
+void Consumer(TestState* state, int64 total) {
+  int64 batch[16];
+  while ( synch::AtomicAddAndFetch(&state->count_, int64(0)) < total ) {
+    const uint32 n = state->q_.GetBatch(batch, NUMBEROF(batch));
+    if ( n == 0 ) {
+      sched_yield();
+      continue;
+    }
+    int64 sum = 0;
+    for ( uint32 i = 0; i < n; ++i ) {
+      sum += batch[i];
+    }
+    synch::AtomicAddAndFetch(&state->sum_, sum);
+    synch::AtomicAddAndFetch(&state->count_, static_cast<int64>(n));
+  }
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+
+  // Single threaded semantics
+  {
+    synch::LockFreeQueue<int> q(5);
+    CHECK_EQ(q.capacity(), 8);
+    CHECK(q.IsEmpty());
+    int x = 0;
+    CHECK(!q.Get(&x));
+    for ( int round = 0; round < 3; ++round ) {
+      for ( int i = 0; i < 8; ++i ) {
+        CHECK(q.Put(i));
+      }
+      CHECK(!q.Put(8));
+      CHECK_EQ(q.Size(), 8);
+      CHECK(q.Get(&x));
+      CHECK_EQ(x, 0);
+      int batch[16];
+      CHECK_EQ(q.GetBatch(batch, 3), 3);
+      CHECK_EQ(batch[0], 1);
+      CHECK_EQ(batch[2], 3);
+      CHECK_EQ(q.GetBatch(batch, 16), 4);
+      CHECK_EQ(batch[3], 7);
+      CHECK(q.IsEmpty());
+    }
+  }
+
+  // Many producers and consumers - everything that goes in must come
+  // out exactly once.
+  {
+    const int64 total = static_cast<int64>(FLAGS_num_elements) *
+                        FLAGS_num_threads;
+    TestState state(64);
+    vector<thread::Thread*> threads;
+    for ( int i = 0; i < FLAGS_num_threads; ++i ) {
+      threads.push_back(new thread::Thread(
+          NewCallback(&Producer, &state,
+                      static_cast<int64>(i) * FLAGS_num_elements)));
+      threads.push_back(new thread::Thread(
+          NewCallback(&Consumer, &state, total)));
+    }
+    for ( int i = 0; i < threads.size(); ++i ) {
+      threads[i]->SetJoinable();
+      threads[i]->Start();
+    }
+    for ( int i = 0; i < threads.size(); ++i ) {
+      threads[i]->Join();
+      delete threads[i];
+    }
+    CHECK_EQ(state.count_, total);
+    CHECK_EQ(state.sum_, total * (total - 1) / 2);
+    CHECK(state.q_.IsEmpty());
+  }
+  LOG_INFO << "PASS";
+}
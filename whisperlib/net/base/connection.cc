@@ -30,6 +30,8 @@
 // Authors: Cosmin Tudorache & Catalin Popescu
 
 #include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <unistd.h>
@@ -397,6 +399,15 @@ bool TcpAcceptor::HandleReadEvent(const SelectorEventData& event) {
   if ( !InvokeFilterHandler(hp) ) {
     ECONNLOG << "Dumping connection from " << hp
              << " because filter_handler_ refused it";
+    if ( !refuse_reply().empty() ) {
+      // A fresh socket has an empty send buffer, so this normally goes
+      // whole; if not, too bad - the peer is refused anyway.
+      if ( ::send(client_fd, refuse_reply().data(), refuse_reply().size(),
+                  MSG_DONTWAIT | MSG_NOSIGNAL) < 0 ) {
+        ICONNLOG << "::send refuse reply to " << hp << " failed: "
+                 << GetLastSystemErrorDescription();
+      }
+    }
     if ( ::close(client_fd) ) {
       ECONNLOG << "::close fd: " << fd_ << " failed: "
                << GetLastSystemErrorDescription();
@@ -524,7 +535,8 @@ TcpConnection::TcpConnection(Selector* selector,
       last_read_ts_(0),
       last_write_ts_(0),
       handle_dns_result_(NewPermanentCallback(this,
-          &TcpConnection::HandleDnsResult)) {
+          &TcpConnection::HandleDnsResult)),
+      outbuf_account_(tcp_params.block_size_) {
 }
 
 TcpConnection::~TcpConnection() {
@@ -573,6 +585,7 @@ bool TcpConnection::Wrap(int fd) {
   set_write_closed(false);
   InitializeLocalAddress();
   InitializeRemoteAddress();
+  outbuf_account_.set_name(remote_address_.ToString());
   RequestReadEvents(true);
   return true;
 }
@@ -620,6 +633,7 @@ bool TcpConnection::Connect(const HostPort& remote_addr) {
   set_read_closed(false);
   set_write_closed(false);
   remote_address_ = remote_addr;
+  outbuf_account_.set_name(remote_address_.ToString());
 
   if ( ::connect(fd_,
                  reinterpret_cast<const struct sockaddr*>(&addr),
@@ -689,6 +703,21 @@ bool TcpConnection::SetRecvBufferSize(int size) {
   }
   return true;
 }
+bool TcpConnection::SetMaxPacingRate(int64 bytes_per_sec) {
+#ifdef SO_MAX_PACING_RATE
+  const uint32 rate = (bytes_per_sec <= 0 || bytes_per_sec >= kMaxUInt32)
+                      ? kMaxUInt32 : static_cast<uint32>(bytes_per_sec);
+  if ( ::setsockopt(fd_, SOL_SOCKET, SO_MAX_PACING_RATE,
+                    reinterpret_cast<const char *>(&rate), sizeof(rate)) ) {
+    ECONNLOG << "::setsockopt SO_MAX_PACING_RATE failed: "
+             << GetLastSystemErrorDescription();
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
 
 void TcpConnection::RequestReadEvents(bool enable) {
   D10CONNLOG << "RequestReadEvents => " << std::boolalpha << enable;
@@ -697,6 +726,8 @@ void TcpConnection::RequestReadEvents(bool enable) {
 void TcpConnection::RequestWriteEvents(bool enable) {
   D10CONNLOG << "RequestWriteEvents => " << std::boolalpha << enable;
   selector()->EnableWriteCallback(this, enable);
+  // the application calls this after filling the outbuf()
+  outbuf_account_.Update(outbuf()->Size());
 }
 
 const HostPort& TcpConnection::local_address() const {
@@ -705,6 +736,19 @@ const HostPort& TcpConnection::local_address() const {
 const HostPort& TcpConnection::remote_address() const {
   return remote_address_;
 }
+const OutbufBudget::Account* TcpConnection::outbuf_account() const {
+  return &outbuf_account_;
+}
+int32 TcpConnection::kernel_outbuf_size() const {
+  if ( fd_ == INVALID_FD_VALUE ) {
+    return 0;
+  }
+  int value = 0;
+  if ( ::ioctl(fd_, SIOCOUTQ, &value) < 0 ) {
+    return 0;
+  }
+  return value;
+}
 
 string TcpConnection::PrefixInfo() const {
   ostringstream oss;
@@ -843,6 +887,7 @@ bool TcpConnection::HandleWriteEvent(const SelectorEventData& event) {
       return false;
     }
   }
+  outbuf_account_.Update(outbuf()->Size());
 
   if ( outbuf()->IsEmpty() ) {
     RequestWriteEvents(false);   // stop write events.
@@ -1031,6 +1076,18 @@ bool TcpConnection::SetSocketOptions() {
       return false;
     }
   }
+#ifdef SO_BUSY_POLL
+  // a busy polling selector wants the socket to busy poll too
+  const int busy_poll_us = selector()->busy_poll_us();
+  if ( busy_poll_us > 0 &&
+       ::setsockopt(fd_, SOL_SOCKET, SO_BUSY_POLL,
+                    reinterpret_cast<const char *>(&busy_poll_us),
+                    sizeof(busy_poll_us)) < 0 ) {
+    // not fatal (e.g. we may lack CAP_NET_ADMIN)
+    WCONNLOG << "::setsockopt SO_BUSY_POLL failed for fd=" << fd_
+             << " err: " << GetLastSystemErrorDescription();
+  }
+#endif
   return true;
 }
 
@@ -1097,6 +1154,7 @@ void TcpConnection::InternalClose(int err, bool call_close_handler) {
   timeouter_.UnsetAllTimeouts();
   inbuf()->Clear();
   outbuf()->Clear();
+  outbuf_account_.Update(0);
   if ( call_close_handler ) {
     InvokeCloseHandler(err, CLOSE_READ_WRITE);
   }
@@ -1302,6 +1360,10 @@ bool SslConnection::SetRecvBufferSize(int size) {
   CHECK_NOT_NULL(tcp_connection_);
   return tcp_connection_->SetRecvBufferSize(size);
 }
+bool SslConnection::SetMaxPacingRate(int64 bytes_per_sec) {
+  CHECK_NOT_NULL(tcp_connection_);
+  return tcp_connection_->SetMaxPacingRate(bytes_per_sec);
+}
 void SslConnection::RequestReadEvents(bool enable) {
   CHECK_NOT_NULL(tcp_connection_);
   tcp_connection_->RequestReadEvents(enable);
@@ -1320,6 +1382,13 @@ const HostPort& SslConnection::remote_address() const {
   return tcp_connection_ == NULL ? empty_address :
                                    tcp_connection_->remote_address();
 }
+const OutbufBudget::Account* SslConnection::outbuf_account() const {
+  // what we really hold is the encrypted data, in the TCP connection
+  return tcp_connection_ == NULL ? NULL : tcp_connection_->outbuf_account();
+}
+int32 SslConnection::kernel_outbuf_size() const {
+  return tcp_connection_ == NULL ? 0 : tcp_connection_->kernel_outbuf_size();
+}
 string SslConnection::PrefixInfo() const {
   CHECK_NOT_NULL(tcp_connection_);
   return tcp_connection_->PrefixInfo() +
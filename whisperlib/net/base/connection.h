@@ -43,6 +43,7 @@
 #include <whisperlib/net/base/selectable.h>
 #include <whisperlib/net/base/timeouter.h>
 #include <whisperlib/net/base/dns_resolver.h>
+#include <whisperlib/net/base/outbuf_budget.h>
 
 // apt-get install libssl-dev
 #include <openssl/ssl.h>
@@ -213,6 +214,16 @@ class NetAcceptor {
   void DetachAcceptHandler();
   void DetachAllHandlers();
 
+  // Bytes written (best effort, no blocking) to the peers refused by the
+  // filter handler, right before closing them - e.g. a canned HTTP 503.
+  // Empty (default) => the refused peers are just closed.
+  void set_refuse_reply(const string& refuse_reply) {
+    refuse_reply_ = refuse_reply;
+  }
+  const string& refuse_reply() const {
+    return refuse_reply_;
+  }
+
  protected:
   bool InvokeFilterHandler(const net::HostPort& incoming_peer_address);
   void InvokeAcceptHandler(NetConnection* new_connection);
@@ -239,6 +250,9 @@ class NetAcceptor {
   // We call this handler to deliver a fully connected client to application.
   AcceptHandler* accept_handler_;
   bool own_accept_handler_;
+
+  // See set_refuse_reply()
+  string refuse_reply_;
 };
 
 class NetConnection {
@@ -310,6 +324,10 @@ class NetConnection {
   // tune connection
   virtual bool SetSendBufferSize(int size) = 0;
   virtual bool SetRecvBufferSize(int size) = 0;
+  // Asks the kernel to pace our transmissions at (at most) this rate
+  // (needs the fq qdisc / a kernel w/ TCP internal pacing).
+  // <= 0 removes the limit. Returns false if not supported.
+  virtual bool SetMaxPacingRate(int64 bytes_per_sec) = 0;
   // These functions registers/unregisters the connection for read/write
   // events with the selector.
   virtual void RequestReadEvents(bool enable) = 0;
@@ -317,12 +335,19 @@ class NetConnection {
   // Return local/remote connection address.
   virtual const HostPort& local_address() const = 0;
   virtual const HostPort& remote_address() const = 0;
+  // Returns the number of bytes written to the socket, but not yet
+  // acknowledged by the peer (i.e. still in the kernel send queue).
+  // 0 if unknown.
+  virtual int32 kernel_outbuf_size() const = 0;
   // returns a description of this acceptor, useful as log line header
   // Usage example:
   //  LOG_INFO << connection.PrefixInfo() << "foo";
   // yields a log line like:
   //  "CONNECTED : [12.34.56.78:5665 -> 87.65.43.21:6556 (fd: 7)] foo"
   virtual string PrefixInfo() const = 0;
+  // Our output buffer memory, in the process wide OutbufBudget
+  // (NULL if not accounted).
+  virtual const OutbufBudget::Account* outbuf_account() const = 0;
 
 
   typedef Closure ConnectHandler;
@@ -561,11 +586,14 @@ class TcpConnection : public NetConnection, private Selectable {
   virtual void ForceClose();
   virtual bool SetSendBufferSize(int size);
   virtual bool SetRecvBufferSize(int size);
+  virtual bool SetMaxPacingRate(int64 bytes_per_sec);
   virtual void RequestReadEvents(bool enable);
   virtual void RequestWriteEvents(bool enable);
   virtual const HostPort& local_address() const;
   virtual const HostPort& remote_address() const;
+  virtual int32 kernel_outbuf_size() const;
   virtual string PrefixInfo() const;
+  virtual const OutbufBudget::Account* outbuf_account() const;
   //////////////////////////////////////////////////////////////////////
 
   //////////////////////////////////////////////////////////////////////
@@ -578,6 +606,7 @@ class TcpConnection : public NetConnection, private Selectable {
   virtual bool HandleErrorEvent(const SelectorEventData& event);
   virtual void Close();
   virtual int GetFd() const { return fd_; }
+  virtual bool SupportsEdgeTriggered() const { return true; }
   //////////////////////////////////////////////////////////////////////
 
  private:
@@ -652,6 +681,9 @@ class TcpConnection : public NetConnection, private Selectable {
 
   // permanent callback to HandleDnsResult
   DnsResultHandler* handle_dns_result_;
+
+  // accounts the outbuf() memory (updated on write requests / events)
+  OutbufBudget::Account outbuf_account_;
 };
 
 ////////////////////////////////////////////////////////////////////////
@@ -752,11 +784,14 @@ class SslConnection : public NetConnection {
   virtual void ForceClose();
   virtual bool SetSendBufferSize(int size);
   virtual bool SetRecvBufferSize(int size);
+  virtual bool SetMaxPacingRate(int64 bytes_per_sec);
   virtual void RequestReadEvents(bool enable);
   virtual void RequestWriteEvents(bool enable);
   virtual const HostPort& local_address() const;
   virtual const HostPort& remote_address() const;
+  virtual int32 kernel_outbuf_size() const;
   virtual string PrefixInfo() const;
+  virtual const OutbufBudget::Account* outbuf_account() const;
   //////////////////////////////////////////////////////////////////////
 
   //////////////////////////////////////////////////////////////////////
@@ -31,20 +31,35 @@
 //
 
 #include <set>
+#include <stdio.h>
+#include <poll.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <openssl/rand.h>
 
 #include <whisperlib/common/base/gflags.h>
+#include <whisperlib/common/base/errno.h>
 #include <whisperlib/common/base/strutil.h>
 #include <whisperlib/common/base/scoped_ptr.h>
-#include <whisperlib/common/base/cache.h>
+#include <whisperlib/common/base/timer.h>
 #include <whisperlib/common/sync/thread.h>
 #include <whisperlib/common/sync/producer_consumer_queue.h>
 #include <whisperlib/net/base/dns_resolver.h>
 
 DEFINE_int32(dns_timeout_ms, 10000,
              "Timeout for DNS queries.");
+DEFINE_int32(dns_num_threads, 4,
+             "Resolve DNS queries on these many threads.");
+DEFINE_int32(dns_cache_ttl_ms, 300000,
+             "Keep DNS answers in cache for this long when we don't know "
+             "their TTL. This is also an upper bound for the record TTLs.");
+DEFINE_int32(dns_negative_cache_ttl_ms, 10000,
+             "Keep DNS failures in cache for this long.");
+DEFINE_string(dns_nameserver, "",
+              "If set, we resolve by sending our own UDP queries to this "
+              "nameserver (ip[:port]), instead of using getaddrinfo. "
+              "Use 'system' for the first nameserver in /etc/resolv.conf");
 
 
 namespace {
@@ -62,42 +77,70 @@ class DnsResolver {
     }
   };
   typedef map<net::DnsResultHandler*, Query*> QueryMap;
+  // hostname -> queries waiting for it (coalesced)
+  typedef map<string, vector<Query*> > PendingMap;
+
+  struct CacheEntry {
+    // NULL for a failed resolve
+    scoped_ref<net::DnsHostInfo> info_;
+    // expiration time stamp (ms by CLOCK_MONOTONIC)
+    int64 expiration_ts_;
+  };
+  typedef map<string, CacheEntry> CacheMap;
 
   static const uint32 kQueryQueueMaxSize = 1000;
-  static const uint32 kCacheSize = 100;
-  static const int64 kCacheTimeout = 24*3600*1000LL; // 1 day
+  static const uint32 kCacheSize = 1000;
 
  public:
-  DnsResolver()
-    : thread_(NULL),
+  DnsResolver(int32 num_threads, const net::HostPort& nameserver)
+    : num_threads_(max(num_threads, 1)),
+      nameserver_(nameserver),
+      threads_(),
       query_map_(),
+      pending_map_(),
       query_queue_(kQueryQueueMaxSize),
-      cache_(util::CacheBase::LRU, kCacheSize, kCacheTimeout, NULL, NULL,
-             false) {
+      cache_() {
   }
   virtual ~DnsResolver() {
     Stop();
   }
 
   void Start() {
-    CHECK_NULL(thread_) << "Already started";
-    thread_ = new thread::Thread(NewCallback(this, &DnsResolver::Run));
-    bool success = thread_->Start();
-    CHECK(success) << "Failed to start DNS";
+    CHECK(threads_.empty()) << "Already started";
+    for ( int32 i = 0; i < num_threads_; ++i ) {
+      thread::Thread* const t =
+          new thread::Thread(NewCallback(this, &DnsResolver::Run));
+      threads_.push_back(t);
+      bool success = t->SetJoinable() && t->Start();
+      CHECK(success) << "Failed to start DNS";
+    }
   }
   void Stop() {
     if ( !IsRunning() ) {
       return;
     }
     LOG_WARNING << "DnsResolver is stopping...";
-    // a NULL Query is the exit signal
-    query_queue_.Put(NULL);
-    thread_->Join();
-    delete thread_;
-    thread_ = NULL;
+    // a NULL hostname is the exit signal (one for each thread)
+    for ( int32 i = 0; i < threads_.size(); ++i ) {
+      query_queue_.Put(NULL);
+    }
+    for ( int32 i = 0; i < threads_.size(); ++i ) {
+      threads_[i]->Join();
+      delete threads_[i];
+    }
+    threads_.clear();
+    // whatever is still pending is not going to be answered
+    for ( PendingMap::iterator it = pending_map_.begin();
+          it != pending_map_.end(); ++it ) {
+      for ( int i = 0; i < it->second.size(); ++i ) {
+        delete it->second[i];
+      }
+    }
+    pending_map_.clear();
+    query_map_.clear();
   }
   bool IsRunning() const {
-    return thread_ != NULL;
+    return !threads_.empty();
   }
 
   void Resolve(net::Selector* selector, const string& hostname,
@@ -106,24 +149,37 @@ class DnsResolver {
     CHECK_NOT_NULL(result_handler);
     CHECK(result_handler->is_permanent());
     CHECK(IsRunning());
-    if ( query_queue_.IsFull() ) {
+
+    synch::MutexLocker lock(&mutex_);
+    CacheMap::iterator it = cache_.find(hostname);
+    if ( it != cache_.end() ) {
+      if ( it->second.expiration_ts_ > timer::TicksMsec() ) {
+        VLOG(LDEBUG) << "Cache hit for hostname: [" << hostname << "]";
+        Return(selector, result_handler, it->second.info_);
+        return;
+      }
+      cache_.erase(it);
+    }
+    Query* query = new Query(selector, hostname, result_handler);
+    PendingMap::iterator pit = pending_map_.find(hostname);
+    if ( pit != pending_map_.end() ) {
+      VLOG(LINFO) << "Already resolving hostname: [" << hostname << "]";
+      pit->second.push_back(query);
+      query_map_[result_handler] = query;
+      return;
+    }
+    string* const to_resolve = new string(hostname);
+    if ( !query_queue_.Put(to_resolve, 0) ) {
       LOG_ERROR << "Too many queries, fail for hostname: ["
                 << hostname << "]";
+      delete to_resolve;
+      delete query;
       Return(selector, result_handler, NULL);
       return;
     }
-
-    synch::MutexLocker lock(&mutex_);
-    scoped_ref<net::DnsHostInfo> info = cache_.Get(hostname);
-    if ( info.get() != NULL ) {
-      VLOG(LDEBUG) << "Cache hit for hostname: [" << hostname << "]";
-      Return(selector, result_handler, info);
-      return;
-    }
     VLOG(LINFO) << "Cache miss for hostname: [" << hostname
                 << "]" << ". Resolving";
-    Query* query = new Query(selector, hostname, result_handler);
-    query_queue_.Put(query);
+    pending_map_[hostname].push_back(query);
     query_map_[result_handler] = query;
   }
   void Cancel(net::DnsResultHandler* result_handler) {
@@ -133,42 +189,85 @@ class DnsResolver {
       return;
     }
     it->second->result_handler_ = NULL;
+    query_map_.erase(it);
   }
 
  private:
   void Run() {
     LOG_INFO << "DnsResolver running..";
     while ( true ) {
-      Query* query = query_queue_.Get();
-      scoped_ptr<Query> auto_del_query(query);
+      string* hostname = query_queue_.Get();
+      scoped_ptr<string> auto_del_hostname(hostname);
 
-      // a NULL Query is the exit signal
-      if ( query == NULL ) {
+      // a NULL hostname is the exit signal
+      if ( hostname == NULL ) {
         break;
       }
 
-      // a NULL result_handler means a Canceled query
-      if ( query->result_handler_ == NULL ) {
-        continue;
-      }
-
       // blocking resolve
-      scoped_ref<net::DnsHostInfo> info =
-          net::DnsBlockingResolve(query->hostname_);
+      int64 ttl_ms = FLAGS_dns_cache_ttl_ms;
+      scoped_ref<net::DnsHostInfo> info;
+      if ( nameserver_.IsInvalid() ) {
+        info = net::DnsBlockingResolve(*hostname);
+      } else {
+        info = net::DnsUdpResolve(nameserver_, *hostname,
+                                  FLAGS_dns_timeout_ms, &ttl_ms);
+      }
+      if ( info.get() == NULL ) {
+        ttl_ms = FLAGS_dns_negative_cache_ttl_ms;
+      }
+      ttl_ms = min(ttl_ms, static_cast<int64>(FLAGS_dns_cache_ttl_ms));
 
       // deliver result
-      {
-        synch::MutexLocker lock(&mutex_);
-        cache_.Add(query->hostname_, info);
+      synch::MutexLocker lock(&mutex_);
+      AddToCache(*hostname, info, ttl_ms);
+      PendingMap::iterator it = pending_map_.find(*hostname);
+      if ( it == pending_map_.end() ) {
+        continue;
+      }
+      for ( int i = 0; i < it->second.size(); ++i ) {
+        Query* const query = it->second[i];
         // a NULL result_handler means a Canceled query
         if ( query->result_handler_ != NULL ) {
           query_map_.erase(query->result_handler_);
           Return(query->selector_, query->result_handler_, info);
         }
+        delete query;
       }
+      pending_map_.erase(it);
     }
     LOG_INFO << "DnsResolver stopped.";
   }
+  // PRECONDITION: mutex_ is held
+  void AddToCache(const string& hostname,
+                  scoped_ref<net::DnsHostInfo> info, int64 ttl_ms) {
+    if ( ttl_ms <= 0 ) {
+      cache_.erase(hostname);
+      return;
+    }
+    const int64 now = timer::TicksMsec();
+    if ( cache_.size() >= kCacheSize ) {
+      // drop the expired entries, and make room if still needed
+      CacheMap::iterator to_del = cache_.end();
+      for ( CacheMap::iterator it = cache_.begin(); it != cache_.end(); ) {
+        if ( it->second.expiration_ts_ <= now ) {
+          cache_.erase(it++);
+          continue;
+        }
+        if ( to_del == cache_.end() ||
+             it->second.expiration_ts_ < to_del->second.expiration_ts_ ) {
+          to_del = it;
+        }
+        ++it;
+      }
+      if ( cache_.size() >= kCacheSize && to_del != cache_.end() ) {
+        cache_.erase(to_del);
+      }
+    }
+    CacheEntry& entry = cache_[hostname];
+    entry.info_ = info;
+    entry.expiration_ts_ = now + ttl_ms;
+  }
   void Return(net::Selector* selector, net::DnsResultHandler* handler,
               scoped_ref<net::DnsHostInfo> info) {
     selector->RunInSelectLoop(NewCallback(this, &DnsResolver::Return,
@@ -179,31 +278,183 @@ class DnsResolver {
   }
 
  private:
-  // internal resolver thread
-  thread::Thread* thread_;
+  const int32 num_threads_;
+  // if valid, we send our own queries to this guy
+  const net::HostPort nameserver_;
+
+  // internal resolver threads
+  vector<thread::Thread*> threads_;
 
-  // synchronize access to query_map_, cache_
+  // synchronize access to query_map_, pending_map_, cache_
   synch::Mutex mutex_;
 
   // map by DnsResultHandler, useful when we want to Cancel a query
   QueryMap query_map_;
 
-  // communicates with the internal resolver thread
-  synch::ProducerConsumerQueue<Query*> query_queue_;
+  // queries waiting for a hostname being resolved
+  PendingMap pending_map_;
 
-  // cache of solved queries
-  util::Cache<string, scoped_ref<net::DnsHostInfo> > cache_;
+  // communicates with the internal resolver threads
+  synch::ProducerConsumerQueue<string*> query_queue_;
+
+  // cache of solved queries (by hostname)
+  CacheMap cache_;
 };
 
 DnsResolver* g_dns_resolver = NULL;
 
+//////////////////////////////////////////////////////////////////////
+//
+// DNS wire format helpers (RFC 1035)
+//
+static const uint16 kDnsTypeA = 1;
+static const uint16 kDnsTypeCNAME = 5;
+static const uint16 kDnsTypeAAAA = 28;
+static const uint16 kDnsClassIN = 1;
+static const uint16 kDnsRcodeNxDomain = 3;
+static const int32 kDnsMaxPacketSize = 512;
+// Once we have the A answer we wait at most this long for the AAAA one
+// (some nameservers / middleboxes never answer AAAA queries)
+static const int64 kDnsAaaaGraceMs = 200;
+
+void DnsAppendUint16(string* s, uint16 x) {
+  s->push_back(static_cast<char>(x >> 8));
+  s->push_back(static_cast<char>(x & 0xff));
+}
+uint16 DnsReadUint16(const uint8* p) {
+  return (static_cast<uint16>(p[0]) << 8) | p[1];
+}
+uint32 DnsReadUint32(const uint8* p) {
+  return (static_cast<uint32>(DnsReadUint16(p)) << 16) |
+         DnsReadUint16(p + 2);
+}
+
+// Composes a recursive query for 'hostname' of the given type.
+// Returns false if the hostname cannot be encoded.
+bool DnsComposeQuery(uint16 id, const string& hostname, uint16 qtype,
+                     string* out) {
+  out->clear();
+  DnsAppendUint16(out, id);
+  DnsAppendUint16(out, 0x0100);   // standard query, recursion desired
+  DnsAppendUint16(out, 1);        // QDCOUNT
+  DnsAppendUint16(out, 0);        // ANCOUNT
+  DnsAppendUint16(out, 0);        // NSCOUNT
+  DnsAppendUint16(out, 0);        // ARCOUNT
+  vector<string> labels;
+  strutil::SplitString(hostname, ".", &labels);
+  for ( int i = 0; i < labels.size(); ++i ) {
+    if ( labels[i].empty() ) {
+      continue;
+    }
+    if ( labels[i].size() > 63 ) {
+      return false;
+    }
+    out->push_back(static_cast<char>(labels[i].size()));
+    out->append(labels[i]);
+  }
+  out->push_back('\0');
+  DnsAppendUint16(out, qtype);
+  DnsAppendUint16(out, kDnsClassIN);
+  return out->size() <= kDnsMaxPacketSize;
+}
+
+// Skips a (possibly compressed) domain name. Returns the position after
+// the name, or NULL on malformed data.
+const uint8* DnsSkipName(const uint8* p, const uint8* end) {
+  while ( p < end ) {
+    if ( *p == 0 ) {
+      return p + 1;
+    }
+    if ( (*p & 0xc0) == 0xc0 ) {
+      return p + 2 <= end ? p + 2 : NULL;
+    }
+    p += *p + 1;
+  }
+  return NULL;
+}
+
+enum DnsAnswerStatus {
+  DNS_ANSWER_BAD,        // not a (valid) answer to our query
+  DNS_ANSWER_OK,         // a valid answer (maybe w/o any address)
+  DNS_ANSWER_NXDOMAIN,   // the hostname does not exist
+};
+// Parses an answer to the query w/ the given id. Appends the addresses
+// found to ipv4 / ipv6 and updates min_ttl_ms.
+DnsAnswerStatus DnsParseAnswer(const uint8* data, int32 size, uint16 id,
+                               set<net::IpAddress>* ipv4,
+                               set<net::IpAddress>* ipv6,
+                               int64* min_ttl_ms) {
+  const uint8* const end = data + size;
+  if ( size < 12 || DnsReadUint16(data) != id ||
+       (data[2] & 0x80) == 0 ) {    // not a response
+    return DNS_ANSWER_BAD;
+  }
+  const uint16 rcode = data[3] & 0x0f;
+  if ( rcode == kDnsRcodeNxDomain ) {
+    return DNS_ANSWER_NXDOMAIN;
+  }
+  if ( rcode != 0 ) {
+    return DNS_ANSWER_BAD;
+  }
+  const uint16 qdcount = DnsReadUint16(data + 4);
+  const uint16 ancount = DnsReadUint16(data + 6);
+  const uint8* p = data + 12;
+  for ( uint16 i = 0; i < qdcount; ++i ) {
+    p = DnsSkipName(p, end);
+    if ( p == NULL || p + 4 > end ) {
+      return DNS_ANSWER_BAD;
+    }
+    p += 4;   // QTYPE, QCLASS
+  }
+  for ( uint16 i = 0; i < ancount; ++i ) {
+    p = DnsSkipName(p, end);
+    if ( p == NULL || p + 10 > end ) {
+      return DNS_ANSWER_BAD;
+    }
+    const uint16 type = DnsReadUint16(p);
+    const uint16 klass = DnsReadUint16(p + 2);
+    const int64 ttl_ms = static_cast<int64>(DnsReadUint32(p + 4)) * 1000;
+    const uint16 rdlength = DnsReadUint16(p + 8);
+    p += 10;
+    if ( p + rdlength > end ) {
+      return DNS_ANSWER_BAD;
+    }
+    if ( klass == kDnsClassIN ) {
+      if ( type == kDnsTypeA && rdlength == 4 ) {
+        ipv4->insert(net::IpAddress(static_cast<int32>(DnsReadUint32(p))));
+        *min_ttl_ms = min(*min_ttl_ms, ttl_ms);
+      } else if ( type == kDnsTypeAAAA && rdlength == 16 ) {
+        ipv6->insert(net::IpAddress(p[ 0], p[ 1], p[ 2], p[ 3],
+                                    p[ 4], p[ 5], p[ 6], p[ 7],
+                                    p[ 8], p[ 9], p[10], p[11],
+                                    p[12], p[13], p[14], p[15]));
+        *min_ttl_ms = min(*min_ttl_ms, ttl_ms);
+      } else if ( type == kDnsTypeCNAME ) {
+        // the recursive server follows the alias for us
+        *min_ttl_ms = min(*min_ttl_ms, ttl_ms);
+      }
+    }
+    p += rdlength;
+  }
+  return DNS_ANSWER_OK;
+}
 }
 
 namespace net {
 
 void DnsInit() {
   CHECK_NULL(g_dns_resolver) << "DNS Resolver already initialized!";
-  g_dns_resolver = new DnsResolver();
+  HostPort nameserver;
+  if ( FLAGS_dns_nameserver == "system" ) {
+    nameserver = DnsSystemNameserver();
+    LOG_ERROR_IF(nameserver.IsInvalid())
+        << "No nameserver found in /etc/resolv.conf, using getaddrinfo";
+  } else if ( !FLAGS_dns_nameserver.empty() ) {
+    nameserver = HostPort(FLAGS_dns_nameserver, 53);
+    CHECK(!nameserver.ip_object().IsInvalid())
+        << "Invalid --dns_nameserver: [" << FLAGS_dns_nameserver << "]";
+  }
+  g_dns_resolver = new DnsResolver(FLAGS_dns_num_threads, nameserver);
   g_dns_resolver->Start();
 }
 
@@ -264,4 +515,158 @@ scoped_ref<DnsHostInfo> DnsBlockingResolve(const string& hostname) {
   return info;
 }
 
+scoped_ref<DnsHostInfo> DnsUdpResolve(const HostPort& nameserver,
+                                      const string& hostname,
+                                      int32 timeout_ms,
+                                      int64* ttl_ms) {
+  set<IpAddress> ipv4, ipv6;
+  int64 min_ttl_ms = kMaxInt64;
+
+  // IP literals need no resolving
+  const IpAddress literal(hostname);
+  if ( !literal.IsInvalid() ) {
+    (literal.is_ipv4() ? ipv4 : ipv6).insert(literal);
+    if ( ttl_ms != NULL ) {
+      *ttl_ms = FLAGS_dns_cache_ttl_ms;
+    }
+    return new DnsHostInfo(hostname, ipv4, ipv6);
+  }
+
+  static const uint16 kQueryTypes[] = { kDnsTypeA, kDnsTypeAAAA };
+  string queries[NUMBEROF(kQueryTypes)];
+  uint16 ids[NUMBEROF(kQueryTypes)];
+  bool answered[NUMBEROF(kQueryTypes)];
+  // the ids are the only thing (beside the port) an off path attacker
+  // has to guess to spoof an answer - make them unpredictable
+  if ( RAND_bytes(reinterpret_cast<unsigned char*>(ids), sizeof(ids)) != 1 ) {
+    LOG_ERROR << "RAND_bytes failed, cannot generate DNS query ids";
+    return NULL;
+  }
+  for ( int i = 0; i < NUMBEROF(kQueryTypes); ++i ) {
+    answered[i] = false;
+    if ( !DnsComposeQuery(ids[i], hostname, kQueryTypes[i], &queries[i]) ) {
+      LOG_ERROR << "Invalid hostname: [" << hostname << "]";
+      return NULL;
+    }
+  }
+
+  struct sockaddr_storage addr;
+  nameserver.SockAddr(&addr);
+  const int fd = ::socket(addr.ss_family, SOCK_DGRAM, 0);
+  if ( fd < 0 ) {
+    LOG_ERROR << "::socket failed: " << GetLastSystemErrorDescription();
+    return NULL;
+  }
+  // we accept answers only from the nameserver
+  if ( ::connect(fd, reinterpret_cast<const struct sockaddr*>(&addr),
+                 addr.ss_family == AF_INET ? sizeof(struct sockaddr_in)
+                                           : sizeof(struct sockaddr_in6)) ) {
+    LOG_ERROR << "::connect to nameserver: " << nameserver
+              << " failed: " << GetLastSystemErrorDescription();
+    ::close(fd);
+    return NULL;
+  }
+
+  // We (re)send the unanswered queries every resend_ms, until timeout.
+  int64 end_ts = timer::TicksMsec() + timeout_ms;
+  const int64 resend_ms = max(timeout_ms / 3, 1);
+  int64 resend_ts = 0;
+  int num_answered = 0;
+  bool nxdomain = false;
+  while ( num_answered < NUMBEROF(kQueryTypes) && !nxdomain ) {
+    int64 now = timer::TicksMsec();
+    if ( now >= end_ts ) {
+      if ( answered[0] ) {
+        LOG_WARNING << "No AAAA answer for hostname: [" << hostname << "]"
+                    << " from nameserver: " << nameserver
+                    << ", going on w/ the A records";
+        break;
+      }
+      LOG_ERROR << "Timeout resolving hostname: [" << hostname << "]"
+                << " on nameserver: " << nameserver;
+      break;
+    }
+    if ( now >= resend_ts ) {
+      for ( int i = 0; i < NUMBEROF(kQueryTypes); ++i ) {
+        if ( !answered[i] &&
+             ::send(fd, queries[i].data(), queries[i].size(), 0) < 0 ) {
+          LOG_ERROR << "::send to nameserver: " << nameserver
+                    << " failed: " << GetLastSystemErrorDescription();
+        }
+      }
+      resend_ts = now + resend_ms;
+    }
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    const int r = ::poll(&pfd, 1, min(resend_ts, end_ts) - now);
+    if ( r <= 0 ) {
+      continue;
+    }
+    uint8 buffer[kDnsMaxPacketSize];
+    const ssize_t size = ::recv(fd, buffer, sizeof(buffer), 0);
+    if ( size <= 0 ) {
+      continue;
+    }
+    for ( int i = 0; i < NUMBEROF(kQueryTypes); ++i ) {
+      if ( answered[i] ) {
+        continue;
+      }
+      const DnsAnswerStatus status = DnsParseAnswer(buffer, size, ids[i],
+          &ipv4, &ipv6, &min_ttl_ms);
+      if ( status == DNS_ANSWER_NXDOMAIN ) {
+        nxdomain = true;
+      }
+      if ( status != DNS_ANSWER_BAD ) {
+        answered[i] = true;
+        ++num_answered;
+        if ( kQueryTypes[i] == kDnsTypeA ) {
+          // don't let a missing AAAA answer hold the A records for the
+          // whole timeout
+          now = timer::TicksMsec();
+          end_ts = min(end_ts,
+                       now + min(kDnsAaaaGraceMs, (end_ts - now) / 2));
+        }
+        break;
+      }
+    }
+  }
+  ::close(fd);
+
+  if ( ipv4.empty() && ipv6.empty() ) {
+    LOG_ERROR << "Error resolving hostname: [" << hostname << "]"
+              << (nxdomain ? ": no such host" : "");
+    return NULL;
+  }
+  if ( ttl_ms != NULL ) {
+    *ttl_ms = min_ttl_ms;
+  }
+  DnsHostInfo* info = new DnsHostInfo(hostname, ipv4, ipv6);
+  LOG_INFO << "Resolved: [" << hostname << "] to: " << info->ToString()
+           << " for: " << min_ttl_ms << " ms";
+  return info;
+}
+
+HostPort DnsSystemNameserver(const char* resolv_conf) {
+  FILE* f = ::fopen(resolv_conf, "r");
+  if ( f == NULL ) {
+    return HostPort();
+  }
+  HostPort nameserver;
+  char line[1024];
+  char address[64];
+  while ( ::fgets(line, sizeof(line), f) != NULL ) {
+    if ( ::sscanf(line, " nameserver %63s", address) == 1 ) {
+      const IpAddress ip(address);
+      if ( !ip.IsInvalid() ) {
+        nameserver = HostPort(ip, 53);
+        break;
+      }
+    }
+  }
+  ::fclose(f);
+  return nameserver;
+}
+
 }
@@ -50,9 +50,16 @@ namespace net {
 //   either: - your result callback is called with the resolved query
 //           - Or you call DnsCancel(..) to cancel the query.
 // Implementation:
-//   Uses a single separate thread (solver) to resolve the queries.
-//   The solver receives queries through a limited ProducerConsumerQueue.
-//   The actual resolve uses ::getaddrinfo().. but that may be changed.
+//   A pool of solver threads (--dns_num_threads) resolve the queries.
+//   The solvers receive hostnames through a limited ProducerConsumerQueue.
+//   Queries for a hostname that is already being resolved are coalesced
+//   and get the same answer.
+//   The answers are cached for their TTL (--dns_cache_ttl_ms when
+//   the TTL is unknown); failures are cached too, for a shorter time
+//   (--dns_negative_cache_ttl_ms).
+//   The actual resolve uses ::getaddrinfo(), or, if --dns_nameserver is
+//   given, our own UDP queries to that nameserver (DnsUdpResolve), which
+//   give us the record TTLs and honor --dns_timeout_ms.
 
 struct DnsHostInfo : public RefCounted {
   string hostname_;
@@ -92,6 +99,21 @@ void DnsExit();
 // Synchronous DNS query.
 scoped_ref<DnsHostInfo> DnsBlockingResolve(const string& hostname);
 
+// Synchronous DNS query, sent over UDP to the given nameserver (A and AAAA
+// records). Waits at most timeout_ms for the answers; once the A answer is
+// in, only a short while more for the AAAA one.
+// Returns NULL on error (and on a nonexistent hostname).
+// If ttl_ms is not NULL, it receives how long the answer is good for
+// (the minimum TTL of the records we used).
+scoped_ref<DnsHostInfo> DnsUdpResolve(const HostPort& nameserver,
+                                      const string& hostname,
+                                      int32 timeout_ms,
+                                      int64* ttl_ms);
+
+// Returns the first nameserver configured in the given resolv.conf file
+// (or an invalid HostPort if none was found).
+HostPort DnsSystemNameserver(const char* resolv_conf = "/etc/resolv.conf");
+
 }
 
 inline ostream& operator<<(ostream& os, const net::DnsHostInfo& info) {
@@ -0,0 +1,221 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+
+#include <algorithm>
+#include "net/base/outbuf_budget.h"
+#include "common/base/log.h"
+#include "common/base/gflags.h"
+#include "common/sync/atomic.h"
+#include "common/sync/mutex.h"
+
+//////////////////////////////////////////////////////////////////////
+
+DEFINE_int32(outbuf_budget_mb,
+             0,
+             "Process wide budget (in MB) for the memory in the connection "
+             "output buffers. 0 => unlimited.");
+DEFINE_int32(outbuf_budget_shrink_percent,
+             60,
+             "Over this percent of --outbuf_budget_mb in use, we feed a "
+             "connection only while its output buffer is under half the "
+             "usual threshold (a quarter over "
+             "--outbuf_budget_keyframes_percent)");
+DEFINE_int32(outbuf_budget_keyframes_percent,
+             80,
+             "Over this percent of --outbuf_budget_mb in use, we send "
+             "only the video keyframes to the media clients");
+DEFINE_int32(outbuf_budget_evict_percent,
+             95,
+             "Over this percent of --outbuf_budget_mb in use, we drop the "
+             "connections w/ the largest output backlog");
+
+//////////////////////////////////////////////////////////////////////
+
+namespace {
+// Guards the list of accounts (and their names)
+synch::Mutex g_accounts_mutex;
+// We never evict connections w/ less than this in the output buffer
+const int64 kMinEvictBytes = 1 << 16;
+// Reads a counter updated (atomically) from other threads
+template <typename T>
+T AtomicLoad(const T* ptr) {
+  return synch::AtomicAddAndFetch(const_cast<T*>(ptr), static_cast<T>(0));
+}
+}
+
+namespace net {
+
+int64 OutbufBudget::usage_ = 0;
+int32 OutbufBudget::num_accounts_ = 0;
+OutbufBudget::Account* OutbufBudget::head_ = NULL;
+
+const char* OutbufBudget::LevelName(Level level) {
+  switch ( level ) {
+    CONSIDER(LEVEL_NORMAL);
+    CONSIDER(LEVEL_SHRINK);
+    CONSIDER(LEVEL_KEYFRAMES);
+    CONSIDER(LEVEL_EVICT);
+  }
+  return "UNKNOWN";
+}
+
+OutbufBudget::Account::Account(int32 block_size)
+    : block_size_(max(block_size, 1)),
+      bytes_(0),
+      name_(),
+      prev_(NULL),
+      next_(NULL) {
+  OutbufBudget::Link(this);
+}
+
+OutbufBudget::Account::~Account() {
+  Update(0);
+  OutbufBudget::Unlink(this);
+}
+
+void OutbufBudget::Account::Update(int64 size) {
+  // round up to whole blocks - this is what we actually hold
+  const int64 bytes = (size + block_size_ - 1) / block_size_ * block_size_;
+  if ( bytes != bytes_ ) {
+    const int64 delta = bytes - bytes_;
+    synch::AtomicAddAndFetch(&OutbufBudget::usage_, delta);
+    // we are the only writer, but others read it (GetTopConsumers)
+    synch::AtomicAddAndFetch(&bytes_, delta);
+  }
+}
+
+void OutbufBudget::Account::set_name(const string& name) {
+  synch::MutexLocker l(&g_accounts_mutex);
+  name_ = name;
+}
+
+int64 OutbufBudget::budget() {
+  return static_cast<int64>(FLAGS_outbuf_budget_mb) << 20;
+}
+
+int64 OutbufBudget::usage() {
+  return AtomicLoad(&usage_);
+}
+
+int32 OutbufBudget::num_accounts() {
+  return AtomicLoad(&num_accounts_);
+}
+
+OutbufBudget::Level OutbufBudget::level() {
+  const int64 total = budget();
+  if ( total <= 0 ) {
+    return LEVEL_NORMAL;
+  }
+  const int64 percent = usage() * 100 / total;
+  if ( percent >= FLAGS_outbuf_budget_evict_percent ) {
+    return LEVEL_EVICT;
+  }
+  if ( percent >= FLAGS_outbuf_budget_keyframes_percent ) {
+    return LEVEL_KEYFRAMES;
+  }
+  if ( percent >= FLAGS_outbuf_budget_shrink_percent ) {
+    return LEVEL_SHRINK;
+  }
+  return LEVEL_NORMAL;
+}
+
+int64 OutbufBudget::ScaledLimit(int64 limit) {
+  switch ( level() ) {
+    case LEVEL_NORMAL:
+      return limit;
+    case LEVEL_SHRINK:
+      return limit / 2;
+    case LEVEL_KEYFRAMES:
+    case LEVEL_EVICT:
+      return limit / 4;
+  }
+  return limit;
+}
+
+bool OutbufBudget::ShouldEvict(const Account* account) {
+  if ( account == NULL ) {
+    return false;
+  }
+  const int64 bytes = AtomicLoad(&account->bytes_);
+  if ( bytes < kMinEvictBytes || level() != LEVEL_EVICT ) {
+    return false;
+  }
+  // the slow ones: w/ twice the average backlog
+  const int32 n = max(num_accounts(), 1);
+  return bytes >= 2 * (usage() / n);
+}
+
+void OutbufBudget::GetTopConsumers(int max_count,
+                                   vector< pair<string, int64> >* out) {
+  vector< pair<int64, const Account*> > all;
+  synch::MutexLocker l(&g_accounts_mutex);
+  for ( const Account* a = head_; a != NULL; a = a->next_ ) {
+    // the mutex keeps the account alive, but its owner updates bytes_
+    // w/o it, from its own thread
+    const int64 bytes = AtomicLoad(&a->bytes_);
+    if ( bytes > 0 ) {
+      all.push_back(make_pair(-bytes, a));
+    }
+  }
+  const int count = min(max_count, static_cast<int>(all.size()));
+  partial_sort(all.begin(), all.begin() + count, all.end());
+  for ( int i = 0; i < count; ++i ) {
+    out->push_back(make_pair(all[i].second->name_, -all[i].first));
+  }
+}
+
+void OutbufBudget::Link(Account* account) {
+  synch::MutexLocker l(&g_accounts_mutex);
+  account->next_ = head_;
+  if ( head_ != NULL ) {
+    head_->prev_ = account;
+  }
+  head_ = account;
+  synch::AtomicAddAndFetch(&num_accounts_, 1);
+}
+
+void OutbufBudget::Unlink(Account* account) {
+  synch::MutexLocker l(&g_accounts_mutex);
+  if ( account->prev_ != NULL ) {
+    account->prev_->next_ = account->next_;
+  } else {
+    head_ = account->next_;
+  }
+  if ( account->next_ != NULL ) {
+    account->next_->prev_ = account->prev_;
+  }
+  account->prev_ = NULL;
+  account->next_ = NULL;
+  synch::AtomicSubAndFetch(&num_accounts_, 1);
+}
+
+}
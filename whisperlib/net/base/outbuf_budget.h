@@ -0,0 +1,127 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#ifndef __NET_BASE_OUTBUF_BUDGET_H__
+#define __NET_BASE_OUTBUF_BUDGET_H__
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <whisperlib/common/base/types.h>
+
+namespace net {
+
+// Process wide budget for the memory held in the connection output
+// buffers (--outbuf_budget_mb). Each connection keeps an Account, updated
+// (in whole DataBlocks) as its output buffer grows and drains, on whatever
+// networking thread it lives.
+//
+// As the usage crosses the thresholds, we degrade gracefully:
+//  - LEVEL_SHRINK: the protocols stop feeding a connection sooner (see
+//    ScaledLimit()) - the hard per connection limits, over which they
+//    close, stay the same
+//  - LEVEL_KEYFRAMES: the media exporters send only the video keyframes
+//  - LEVEL_EVICT: the slowest connections (the ones w/ the largest
+//    backlog) are dropped (see ShouldEvict())
+//
+class OutbufBudget {
+ public:
+  enum Level {
+    LEVEL_NORMAL,
+    LEVEL_SHRINK,
+    LEVEL_KEYFRAMES,
+    LEVEL_EVICT,
+  };
+  static const char* LevelName(Level level);
+
+  class Account {
+   public:
+    explicit Account(int32 block_size);
+    ~Account();
+
+    // Sets the current size of the accounted output buffer.
+    // Call it from the thread of the connection.
+    void Update(int64 size);
+
+    // Shows in the top consumers (e.g. the remote address).
+    void set_name(const string& name);
+
+    // Only for the thread of the connection - the other threads read it
+    // through OutbufBudget (atomically).
+    int64 bytes() const { return bytes_; }
+
+   private:
+    const int32 block_size_;
+    // written only by Update() (atomically), on the connection thread
+    int64 bytes_;
+    string name_;
+    // all the accounts are linked in a list (guarded by the budget mutex)
+    Account* prev_;
+    Account* next_;
+
+    friend class OutbufBudget;
+    DISALLOW_EVIL_CONSTRUCTORS(Account);
+  };
+
+  // --outbuf_budget_mb in bytes (0 => unlimited)
+  static int64 budget();
+  // The bytes accounted now, over all the connections.
+  static int64 usage();
+  static int32 num_accounts();
+  // The current degradation level.
+  static Level level();
+
+  // Scales down a per connection output buffer limit for the current level.
+  // Use it for the flow control thresholds (when to ask for more data),
+  // not for closing the connection.
+  static int64 ScaledLimit(int64 limit);
+
+  // Returns true if the owner of the given account should be disconnected,
+  // to free some memory (NULL account => false).
+  static bool ShouldEvict(const Account* account);
+
+  // Returns the largest max_count accounts, as (name, bytes), descending.
+  static void GetTopConsumers(int max_count,
+                              vector< pair<string, int64> >* out);
+
+ private:
+  static void Link(Account* account);
+  static void Unlink(Account* account);
+
+  static int64 usage_;
+  static int32 num_accounts_;
+  static Account* head_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(OutbufBudget);
+};
+}
+
+#endif  // __NET_BASE_OUTBUF_BUDGET_H__
@@ -46,6 +46,7 @@ int32 Selectable::Write(const char* buf, int32 size) {
   if ( cb <= 0 ) {
     if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
       // Not really an error for non-blocking sockets
+      ready_ &= ~Selector::kWantWrite;
       return 0;
     }
     return -1;
@@ -97,6 +98,7 @@ int32 Selectable::Write(io::MemoryStream* ms, int32 size) {
         ms->MarkerRestore();
         if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
           // Not really an error for non-blocking sockets
+          ready_ &= ~Selector::kWantWrite;
 #ifdef _DEBUG
           DCHECK_EQ(initial_size, cb + ms->Size());
 #endif
@@ -176,6 +178,8 @@ int32 Selectable::Write(io::MemoryStream* ms) {
 int32 Selectable::Read(char* buf, int32 size) {
   const int32 cb = ::read(GetFd(), buf, size);
   if ( cb <= 0 ) {
+    // No more data for now (EAGAIN) or ever (end of file)
+    ready_ &= ~Selector::kWantRead;
     if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
       // Not really an error for non-blocking sockets
       return 0;
@@ -41,7 +41,10 @@ class Selectable {
  public:
   Selectable()
       : desire_(Selector::kWantRead | Selector::kWantError),
-        registered_selector_(NULL) {
+        registered_selector_(NULL),
+        edge_triggered_(false),
+        ready_(0),
+        edge_pending_(false) {
   }
 
   virtual ~Selectable() {
@@ -84,6 +87,12 @@ class Selectable {
 
   virtual void Close() = 0;
 
+  // Return true if this object can work w/ edge triggered events, i.e.
+  // it reads / writes only through the Read / Write below (which note
+  // when the fd would block), and is fine w/ being called again (w/o a
+  // new event) while its fd is still readable / writable.
+  virtual bool SupportsEdgeTriggered() const { return false; }
+
  protected:
   // Read/Write basics
   int32 Write(const char* buf, int32 size);
@@ -101,6 +110,15 @@ class Selectable {
   // This is meant not for regular usage but rather for bug trap & testing.
   Selector* registered_selector_;
 
+  // Edge triggered mode (see --selector_edge_triggered) state:
+  // - if the fd is registered in edge triggered mode
+  bool edge_triggered_;
+  // - kWantRead / kWantWrite if the fd is readable / writable, i.e. we
+  //   got the edge and did not get an EAGAIN after that
+  int32 ready_;
+  // - if we are in the selector's list to revisit w/o an event
+  bool edge_pending_;
+
   friend class Selector;
 };
 }
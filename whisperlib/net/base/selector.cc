@@ -39,6 +39,7 @@
 #include <sys/eventfd.h>
 #endif
 
+#include <algorithm>
 #include <whisperlib/common/base/log.h>
 #include <whisperlib/common/base/errno.h>
 #include <whisperlib/common/base/timer.h>
@@ -56,7 +57,26 @@ DEFINE_int32(selector_num_closures_per_event,
              "We don't run more than these many closures per event");
 DEFINE_int32(selector_events_to_read_per_poll,
              64,
+             "We start by processing at most these many events per poll "
+             "step - and we go up to --selector_max_events_to_read_per_poll "
+             "when the steps are full");
+DEFINE_int32(selector_max_events_to_read_per_poll,
+             1024,
              "We process at most these many events per poll step");
+DEFINE_bool(selector_edge_triggered,
+            false,
+            "Register the selectables that support it (TCP connections) "
+            "for edge triggered events (when supported - i.e. epoll). "
+            "These get all events from the start, and read / write until "
+            "EAGAIN, so turning on / off their desires costs no system call.");
+DEFINE_int32(selector_busy_poll_us,
+             0,
+             "If positive, before blocking for events a selector polls "
+             "for them (w/o sleeping) for up to these many microseconds");
+DEFINE_int32(selector_timer_wheel_tick_ms,
+             5,
+             "The granularity of the selector's timer wheel (coarse timers "
+             "used e.g. for pacing)");
 DEFINE_int32(debug_check_long_callbacks_ms,
              500,
              "If greater than zero, we check (in debug mode only !) "
@@ -70,6 +90,10 @@ namespace net {
 Selector::Selector()
   : tid_(0),
     should_end_(false),
+    num_registered_(0),
+    timer_wheel_(FLAGS_selector_timer_wheel_tick_ms, kTimerWheelSlots),
+    pending_closures_(NULL),
+    sleeping_(0),
     now_(timer::TicksMsec()),
     call_on_close_(NULL) {
 #ifdef __USE_EVENTFD__
@@ -91,12 +115,18 @@ Selector::Selector()
   event_fd_ = signal_pipe_[0];
 #endif
   base_ = new SelectorBase(event_fd_,
-                           FLAGS_selector_events_to_read_per_poll);
+                           FLAGS_selector_events_to_read_per_poll,
+                           FLAGS_selector_max_events_to_read_per_poll);
+  base_->set_busy_poll_us(FLAGS_selector_busy_poll_us);
 }
 
 Selector::~Selector() {
   CHECK(tid_ == 0);
   CHECK(registered_.empty());
+  for ( int i = 0; i < free_deleters_.size(); ++i ) {
+    delete free_deleters_[i];
+  }
+  free_deleters_.clear();
 #ifdef __USE_EVENTFD__
   close(event_fd_);
 #else
@@ -122,14 +152,28 @@ void Selector::Loop() {
         to_sleep_ms = alarms_.begin()->first - now_;
       }
     }
-    if ( !to_run_.empty() ) {
+    const int64 wheel_timeout_ms = timer_wheel_.NextTimeoutMs(now_);
+    if ( wheel_timeout_ms >= 0 && wheel_timeout_ms < to_sleep_ms ) {
+      to_sleep_ms = wheel_timeout_ms;
+    }
+    if ( to_sleep_ms > 0 ) {
+      // Tell the others that we need a wake signal, then check that
+      // nothing came in the mean time (they first Put, then check
+      // sleeping_ - so one of us sees the other).
+      sleeping_ = 1;
+      __sync_synchronize();
+    }
+    if ( HasClosures() || !edge_pending_.empty() ) {
       to_sleep_ms = 0;
     }
     events.clear();
-    if (!base_->LoopStep(to_sleep_ms, &events)) {
+    const bool success = base_->LoopStep(to_sleep_ms, &events);
+    sleeping_ = 0;
+    if ( !success ) {
       LOG_ERROR << "ERROR in select loop step. Exiting Loop.";
       break;
     }
+    AddEdgePendingEvents(&events);
     now_ = timer::TicksMsec();
 #ifdef _DEBUG
     const int64 processing_begin =
@@ -139,14 +183,21 @@ void Selector::Loop() {
       const SelectorEventData& event = events[i];
       Selectable* const s = static_cast<Selectable *>(event.data_);
       if ( s == NULL ) {
-        // was probably a wake signal..
+        // was a wake signal..
+        ClearWakeSignal();
         continue;
       }
       if ( s->registered_selector() == NULL ) {
         // already unregistered
         continue;
       }
-      const int32 desire = event.desires_;
+      int32 desire = event.desires_;
+      if ( s->edge_triggered_ ) {
+        // we get each edge once, so we remember what is ready until
+        // the selectable reaches EAGAIN
+        s->ready_ |= desire & (kWantRead | kWantWrite);
+        desire = (desire & kWantError) | (s->ready_ & s->desire_);
+      }
       // During HandleXEvent the obj may be closed loosing so track of
       // it's fd value.
       bool keep_processing = true;
@@ -159,7 +210,13 @@ void Selector::Loop() {
                           s->GetFd() != INVALID_FD_VALUE;
       }
       if ( keep_processing && (desire & kWantWrite) ) {
-        s->HandleWriteEvent(event);
+        keep_processing = s->HandleWriteEvent(event) &&
+                          s->GetFd() != INVALID_FD_VALUE;
+      }
+      if ( keep_processing && s->edge_triggered_ &&
+           s->registered_selector() == this ) {
+        // stopped before EAGAIN (e.g. on a read / write limit)
+        MaybeAddEdgePending(s);
       }
     }  // else, was probably a timeout
 #ifdef _DEBUG
@@ -220,6 +277,8 @@ void Selector::Loop() {
       }
 #endif
     }
+    // And the coarse timers
+    run_count += timer_wheel_.Advance(now_);
     if ( run_count > 2 * FLAGS_selector_num_closures_per_event ) {
       LOG_ERROR << this << " We run to many closures per event: " << run_count;
     }
@@ -241,7 +300,7 @@ void Selector::Loop() {
     run_count += n;
     LOG_INFO << "Running closures on shutdown, count: " << run_count;
   }
-  CHECK(to_run_.empty());
+  CHECK(!HasClosures());
 
   // Run remaining alarms
   while ( !alarms_.empty() ) {
@@ -263,6 +322,8 @@ void Selector::Loop() {
     LOG_ERROR << "Leaking alarm, run at: " << it->first
               << " ms, due in: " << (it->first - now_) << " ms";
   }
+  LOG_ERROR_IF(timer_wheel_.size() > 0)
+      << "Leaking " << timer_wheel_.size() << " timer wheel timers";
 
   delete base_;
   base_ = NULL;
@@ -284,13 +345,37 @@ void Selector::RunInSelectLoop(Closure* callback) {
   #ifdef _DEBUG
   callback->set_selector_registered(true);
   #endif
-  mutex_.Lock();
-  to_run_.push_back(callback);
-  mutex_.Unlock();
-  if ( !IsInSelectThread() ) {
+  closures_.Put(callback);
+  // (Put is a full barrier, so we see sleeping_ as set before our Put
+  // became visible)
+  if ( sleeping_ && !IsInSelectThread() &&
+       __sync_bool_compare_and_swap(&sleeping_, 1, 0) ) {
     SendWakeSignal();
   }
 }
+Closure* Selector::NewDeleter(void (*fun)(void*), void* ob) {
+  Deleter* deleter = NULL;
+  if ( !free_deleters_.empty() && IsInSelectThread() ) {
+    deleter = free_deleters_.back();
+    free_deleters_.pop_back();
+  } else {
+    deleter = new Deleter(this);
+  }
+  deleter->Set(fun, ob);
+  return deleter;
+}
+
+void Selector::Deleter::RunInternal() {
+  (*fun_)(ob_);
+  Set(NULL, NULL);
+  // (we are permanent, so Run() does not touch us after this)
+  if ( selector_->free_deleters_.size() < kMaxFreeDeleters ) {
+    selector_->free_deleters_.push_back(this);
+  } else {
+    delete this;
+  }
+}
+
 void Selector::RegisterAlarm(Closure* callback, int64 timeout_in_ms) {
   DCHECK(tid_ != 0 || !should_end_) << "Selector already stopped";
   CHECK(IsInSelectThread() || (tid_ == 0 && !should_end_));
@@ -339,27 +424,18 @@ void Selector::CleanAndCloseAll() {
   }
 }
 
-int Selector::RunClosures(int num_closures) {
-#ifdef __USE_EVENTFD__
-  char buffer[1024];
-#else
-  char buffer[32];
-#endif
-
-  int cb = 0;
-  while ( (cb = ::read(event_fd_, buffer, sizeof(buffer))) > 0 ) {
-    VLOG(10) << " Cleaned some " << cb << " bytes from signal pipe.";
-  }
+int Selector::RunClosures(int max_num_closures) {
   int run_count = 0;
-  while ( run_count < FLAGS_selector_num_closures_per_event ) {
-    mutex_.Lock();
-    if ( to_run_.empty() ) {
-      mutex_.Unlock();
-      break;
+  while ( run_count < max_num_closures ) {
+    if ( pending_closures_ == NULL ) {
+      // take all the queued closures in one shot
+      pending_closures_ = closures_.GetAll();
+      if ( pending_closures_ == NULL ) {
+        break;
+      }
     }
-    Closure* closure = to_run_.front();
-    to_run_.pop_front();
-    mutex_.Unlock();
+    Closure* const closure = pending_closures_;
+    pending_closures_ = synch::MpscQueue<Closure>::Next(closure);
 
 #ifdef _DEBUG
     const int64 processing_begin = FLAGS_debug_check_long_callbacks_ms > 0 ?
@@ -413,8 +489,18 @@ bool Selector::Register(Selectable* s) {
   }
   // Insert in the local set of registered objs
   registered_.insert(s);
+  num_registered_ = registered_.size();
   s->set_registered_selector(this);
 
+  s->ready_ = 0;
+  s->edge_triggered_ = FLAGS_selector_edge_triggered &&
+                       SelectorBase::kSupportsEdgeTriggered &&
+                       s->SupportsEdgeTriggered();
+  if ( s->edge_triggered_ ) {
+    // we want everything, once - the desires just filter the events
+    return base_->Add(fd, s,
+        kWantRead | kWantWrite | kWantError | kEdgeTriggered);
+  }
   return base_->Add(fd, s, s->desire_);
 }
 
@@ -428,7 +514,14 @@ void Selector::Unregister(Selectable* s) {
 
   base_->Delete(fd);
   registered_.erase(it);
+  num_registered_ = registered_.size();
   s->set_registered_selector(NULL);
+  if ( s->edge_pending_ ) {
+    edge_pending_.erase(find(edge_pending_.begin(), edge_pending_.end(), s));
+    s->edge_pending_ = false;
+  }
+  s->edge_triggered_ = false;
+  s->ready_ = 0;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -445,8 +538,51 @@ void Selector::UpdateDesire(Selectable* s, bool enable, int32 desire) {
   } else {
     s->desire_ &= ~desire;
   }
+  if ( s->edge_triggered_ ) {
+    // no need to touch the registration
+    if ( enable ) {
+      MaybeAddEdgePending(s);
+    }
+    return;
+  }
   base_->Update(s->GetFd(), s, s->desire_);
 }
 
+void Selector::MaybeAddEdgePending(Selectable* s) {
+  if ( !s->edge_pending_ &&
+       (s->ready_ & s->desire_ & (kWantRead | kWantWrite)) != 0 ) {
+    s->edge_pending_ = true;
+    edge_pending_.push_back(s);
+  }
+}
+
+void Selector::AddEdgePendingEvents(vector<SelectorEventData>* events) {
+  for ( int i = 0; i < edge_pending_.size(); ++i ) {
+    Selectable* const s = edge_pending_[i];
+    s->edge_pending_ = false;
+    events->push_back(SelectorEventData(s, 0, 0));
+  }
+  edge_pending_.clear();
+}
+
+void Selector::set_busy_poll_us(int32 busy_poll_us) {
+  base_->set_busy_poll_us(busy_poll_us);
+}
+int32 Selector::busy_poll_us() const {
+  return base_->busy_poll_us();
+}
+
 //////////////////////////////////////////////////////////////////////
+
+void Selector::ClearWakeSignal() {
+#ifdef __USE_EVENTFD__
+  char buffer[1024];
+#else
+  char buffer[32];
+#endif
+  int cb = 0;
+  while ( (cb = ::read(event_fd_, buffer, sizeof(buffer))) > 0 ) {
+    VLOG(10) << " Cleaned some " << cb << " bytes from signal pipe.";
+  }
+}
 }
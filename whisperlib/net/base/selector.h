@@ -34,17 +34,19 @@
 
 #include <sys/types.h>
 #include <list>
-#include <deque>
 #include <set>
 #include <map>
+#include <vector>
 
 #include <whisperlib/common/base/types.h>
 #include WHISPER_HASH_MAP_HEADER
 
 #include <whisperlib/common/base/callback.h>
+#include <whisperlib/common/sync/mpsc_queue.h>
 #include <whisperlib/common/sync/mutex.h>
 #include <whisperlib/common/sync/thread.h>
 #include <whisperlib/net/base/selector_base.h>
+#include <whisperlib/net/base/timer_wheel.h>
 
 // Just a helper function
 
@@ -107,16 +109,40 @@ class Selector {
   // - THIS IS SAFE TO CALL FROM ANOTHER THREAD -
   // NOTE: It is legal to add closures while the selector is shutting down..
   //       (i.e. IsExiting() == true)
+  // NOTE: The closures are linked in an intrusive (lock free) queue, so
+  //       a closure can be waiting to run in only one select loop, only
+  //       once at a time (it is OK to re-add a permanent one after it ran).
   //
  private:
-  template <typename T> static void GeneralAsynchronousDelete(T* ob) {
-    delete ob;
+  template <typename T> static void GeneralAsynchronousDelete(void* ob) {
+    delete static_cast<T*>(ob);
   }
+  // The closure that DeleteInSelectLoop posts. After running it goes
+  // back to free_deleters_, so a deletion posted from the select thread
+  // does not allocate (in the steady state).
+  class Deleter : public Closure {
+   public:
+    explicit Deleter(Selector* selector)
+        : Closure(true), selector_(selector), fun_(NULL), ob_(NULL) {
+    }
+    void Set(void (*fun)(void*), void* ob) {
+      fun_ = fun;
+      ob_ = ob;
+    }
+   protected:
+    virtual void RunInternal();
+   private:
+    Selector* const selector_;
+    void (*fun_)(void*);
+    void* ob_;
+  };
+  friend class Deleter;
+  Closure* NewDeleter(void (*fun)(void*), void* ob);
  public:
   void RunInSelectLoop(Closure* callback);
   template <typename T> void DeleteInSelectLoop(T* ob) {
-    RunInSelectLoop(
-        NewCallback(&Selector::GeneralAsynchronousDelete<T>, ob));
+    RunInSelectLoop(NewDeleter(&Selector::GeneralAsynchronousDelete<T>,
+        const_cast<void*>(static_cast<const void*>(ob))));
   }
 
   // Functions for running in the select loop the given Closure after
@@ -129,29 +155,55 @@ class Selector {
   // Cancels a previously registered alarm.
   void UnregisterAlarm(Closure* callback);
 
+  // Coarse, allocation free timers (e.g. for pacing lots of connections):
+  // schedule your TimerWheel::Timer w/ timer_wheel()->Schedule(t, now(), ms)
+  TimerWheel* timer_wheel() { return &timer_wheel_; }
+
   // The current moment when the select loop was broken:
   int64 now() const { return now_; }
 
+  // The number of registered selectables. Can be read from any thread
+  // (e.g. by an acceptor balancing the load), but it is just a hint.
+  int32 num_registered() const { return num_registered_; }
+
   // Desires of selectables
   static const int32 kWantRead  = 1;
   static const int32 kWantWrite = 2;
   static const int32 kWantError = 4;
+  // Not a desire - asks SelectorBase for edge triggered events
+  static const int32 kEdgeTriggered = 8;
+
+  // See SelectorBase::set_busy_poll_us (call from the select thread,
+  // or before starting the loop).
+  void set_busy_poll_us(int32 busy_poll_us);
+  int32 busy_poll_us() const;
 
  private:
   // helper that turns on/off fd desires in the assoiciated RegistrationData
   void UpdateDesire(Selectable* s, bool enable, int32 desire);
+  // For edge triggered selectables: if s wants something it is ready
+  // for, we call it in the next step, w/o waiting for an event.
+  void MaybeAddEdgePending(Selectable* s);
+  // Moves edge_pending_ to events (as events w/ no desires)
+  void AddEdgePendingEvents(vector<SelectorEventData>* events);
 
  public:
   // Cleans and closes the entire list of selectable objects
   void CleanAndCloseAll();
 
  private:
-  // This runs all the functions from to_run_ (if any)
+  // This runs up to max_num_closures functions from those registered w/
+  // RunInSelectLoop (if any)
   int RunClosures(int max_num_closures);
+  bool HasClosures() const {
+    return pending_closures_ != NULL || !closures_.IsEmpty();
+  }
 
   // This writes a byte in the internal pipe in order to make the
   // select loop wake up
   void SendWakeSignal();
+  // Reads what SendWakeSignal wrote
+  void ClearWakeSignal();
 
  private:
   // selector's internal thread id
@@ -169,13 +221,16 @@ class Selector {
 
   // the set of registered I/O objects
   SelectableSet registered_;
+  // registered_.size(), for the other threads
+  volatile int32 num_registered_;
+  // edge triggered selectables to call w/o an event in the next step
+  vector<Selectable*> edge_pending_;
   // Alarms..
   AlarmSet alarms_;
   // The same alarms, mapped by closure; allows us to cancel an alarm
   ReverseAlarmsMap reverse_alarms_;
-
-  // guards access to closure queue: to_run_
-  synch::Mutex mutex_;
+  // Coarse timers
+  TimerWheel timer_wheel_;
 
   // Internal control:
 
@@ -187,7 +242,20 @@ class Selector {
                            //  event_fd_
 #endif
   // functions registered to be run in the select loop
-  deque<Closure*> to_run_;
+  synch::MpscQueue<Closure> closures_;
+  // functions taken from closures_, not run yet (in order, linked by
+  // MpscQueue::Next) - accessed only from the select loop
+  Closure* pending_closures_;
+  // Deleters ready for reuse by DeleteInSelectLoop - accessed only from
+  // the select loop
+  vector<Deleter*> free_deleters_;
+  static const int kMaxFreeDeleters = 256;
+  // (w/ the default 5 ms tick, a turn of the wheel is ~1.3 sec)
+  static const int kTimerWheelSlots = 256;
+  // 1 while the select loop waits for events (w/ a timeout) - the other
+  // threads send us a wake signal only then, and only one of them
+  // (the one that resets it).
+  volatile int32 sleeping_;
 
   // Cache for timer::TicksMsec(); Instead of calling TicksMsec() you can easily
   // take the value of selector_->now()
@@ -34,6 +34,7 @@
 //
 
 #include <whisperlib/net/base/selector_base.h>
+#include <whisperlib/common/base/timer.h>
 #include <whisperlib/net/base/selector.h>
 
 namespace net {
@@ -44,10 +45,17 @@ namespace net {
 //
 #ifdef __USE_EPOLL__
 
-SelectorBase::SelectorBase(int pipe_fd, int max_events_per_step)
-    : max_events_per_step_(max_events_per_step),
+const bool SelectorBase::kSupportsEdgeTriggered = true;
+
+SelectorBase::SelectorBase(int pipe_fd,
+                           int min_events_per_step, int max_events_per_step)
+    : min_events_per_step_(max(1, min(min_events_per_step,
+                                      max_events_per_step))),
+      max_events_per_step_(max(1, max_events_per_step)),
+      busy_poll_us_(0),
       epfd_(epoll_create(10)),
-      events_(new epoll_event[max_events_per_step]) {
+      events_(min_events_per_step_),
+      num_small_steps_(0) {
   CHECK(epfd_ >= 0) << "epoll_create() failed: "
                     << GetLastSystemErrorDescription();
   CHECK(Add(pipe_fd, NULL, Selector::kWantRead | Selector::kWantError));
@@ -56,7 +64,6 @@ SelectorBase::SelectorBase(int pipe_fd, int max_events_per_step)
 SelectorBase::~SelectorBase() {
   // cleanup epoll
   ::close(epfd_);
-  delete[] events_;
 }
 
 bool SelectorBase::Add(int fd, void* user_data, int32 desires) {
@@ -115,19 +122,53 @@ int SelectorBase::DesiresToEpollEvents (int32 desires) {
     events |= EPOLLOUT;
   if ( desires & Selector::kWantError )
     events |= EPOLLERR | EPOLLHUP;
+  if ( desires & Selector::kEdgeTriggered )
+    events |= EPOLLET;
   return events;
 }
 
+int SelectorBase::Wait(int32 timeout_in_ms) {
+  return epoll_wait(epfd_, &events_[0], events_.size(), timeout_in_ms);
+}
+
 bool SelectorBase::LoopStep(int32 timeout_in_ms,
                             vector<SelectorEventData>*  events) {
-  const int num_events = epoll_wait(epfd_, events_, max_events_per_step_,
-                                    timeout_in_ms);
-  if ( num_events == -1 && errno != EINTR ) {
-    LOG_ERROR << "epoll_wait() error: " << GetLastSystemErrorDescription();
-    return false;
+  int num_events = 0;
+  if ( busy_poll_us_ > 0 && timeout_in_ms != 0 ) {
+    const int64 end_us = timer::TicksUsec() + busy_poll_us_;
+    do {
+      num_events = Wait(0);
+    } while ( num_events == 0 && timer::TicksUsec() < end_us );
+  }
+  if ( num_events == 0 ) {
+    num_events = Wait(timeout_in_ms);
+  }
+  if ( num_events == -1 ) {
+    if ( errno != EINTR ) {
+      LOG_ERROR << "epoll_wait() error: " << GetLastSystemErrorDescription();
+      return false;
+    }
+    num_events = 0;
+  }
+  // adapt the size of the next step to the current load
+  if ( num_events == events_.size() ) {
+    num_small_steps_ = 0;
+    if ( events_.size() < max_events_per_step_ ) {
+      events_.resize(min(2 * events_.size(),
+                         static_cast<size_t>(max_events_per_step_)));
+    }
+  } else if ( num_events < events_.size() / 4 &&
+              events_.size() > min_events_per_step_ ) {
+    if ( ++num_small_steps_ >= kShrinkSteps ) {
+      num_small_steps_ = 0;
+      events_.resize(max(events_.size() / 2,
+                         static_cast<size_t>(min_events_per_step_)));
+    }
+  } else {
+    num_small_steps_ = 0;
   }
   for ( int i = 0; i < num_events; ++i ) {
-    struct epoll_event* event = (events_ + i);
+    const struct epoll_event* event = &events_[i];
     int32 desire = 0;
     if ( event->events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP) ) {
       desire |= Selector::kWantError;
@@ -155,8 +196,13 @@ bool SelectorBase::LoopStep(int32 timeout_in_ms,
 //
 #ifdef __USE_POLL__
 
-SelectorBase::SelectorBase(int pipe_fd, int max_events_per_step)
-    : max_events_per_step_(max_events_per_step),
+const bool SelectorBase::kSupportsEdgeTriggered = false;
+
+SelectorBase::SelectorBase(int pipe_fd,
+                           int min_events_per_step, int max_events_per_step)
+    : min_events_per_step_(min_events_per_step),
+      max_events_per_step_(max_events_per_step),
+      busy_poll_us_(0),
       fds_size_(0) {
   CHECK(Add(pipe_fd, NULL, Selector::kWantRead | Selector::kWantError));
 }
@@ -90,8 +90,14 @@ struct SelectorEventData {
 
 class SelectorBase {
  public:
-
-  SelectorBase(int pipe_fd, int max_events_per_step);
+  // If we can register fds in edge triggered mode (i.e. w/ desires
+  // containing Selector::kEdgeTriggered)
+  static const bool kSupportsEdgeTriggered;
+
+  // We return at most max_events_per_step events per step, but we start
+  // by asking for min_events_per_step (and we grow / shrink between
+  // the two, as per the load).
+  SelectorBase(int pipe_fd, int min_events_per_step, int max_events_per_step);
   ~SelectorBase();
 
   //  add a file descriptor in the epoll, and link to the given data pointer.
@@ -107,8 +113,16 @@ class SelectorBase {
   bool LoopStep(int32 timeout_in_ms,
                 vector<SelectorEventData>*  events);
 
+  // If positive, before blocking for events we poll for them (w/o
+  // sleeping) for up to these many microseconds. This burns CPU, but
+  // saves the wake up latency.
+  void set_busy_poll_us(int32 busy_poll_us) { busy_poll_us_ = busy_poll_us; }
+  int32 busy_poll_us() const { return busy_poll_us_; }
+
  private:
+  const int min_events_per_step_;
   const int max_events_per_step_;
+  int32 busy_poll_us_;
 
   //////////////////////////////////////////////////////////////////////
   //
@@ -118,12 +132,17 @@ class SelectorBase {
 #ifdef __USE_EPOLL__
   // Converts a Selector desire in some epoll flags.
   int DesiresToEpollEvents(int32 desires);
+  // One epoll_wait, for events_.size() events
+  int Wait(int32 timeout_in_ms);
 
   // epoll file descriptor
   const int epfd_;
 
-  // here we get events that we poll
-  struct epoll_event* const events_;
+  // here we get events that we poll. Grows when a step fills it, and
+  // shrinks back after kShrinkSteps steps that used under 1/4 of it.
+  vector<struct epoll_event> events_;
+  int num_small_steps_;
+  static const int kShrinkSteps = 64;
 #endif
 
   //////////////////////////////////////////////////////////////////////
@@ -30,12 +30,18 @@
 // Author: Cosmin Tudorache
 
 #include <stdlib.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
 
 #include <whisperlib/common/base/types.h>
 #include <whisperlib/common/base/log.h>
 #include <whisperlib/common/base/system.h>
 #include <whisperlib/common/base/gflags.h>
 #include <whisperlib/common/base/scoped_ptr.h>
+#include <whisperlib/common/base/timer.h>
+#include <whisperlib/common/sync/mutex.h>
+#include <whisperlib/common/sync/thread.h>
 
 #include <whisperlib/net/base/timeouter.h>
 #include <whisperlib/net/base/address.h>
@@ -47,6 +53,12 @@
 DEFINE_bool(just_server,
             false,
             "True runs only the server.");
+DEFINE_bool(test_system_resolver,
+            true,
+            "Test the system resolver too (needs network access).");
+
+DECLARE_string(dns_nameserver);
+DECLARE_int32(dns_negative_cache_ttl_ms);
 
 #define LOG_TEST LOG_INFO
 
@@ -79,18 +91,255 @@ void TestDnsQuery(const string& hostname, bool expected_success) {
       hostname, expected_success));
 }
 
-int main(int argc, char ** argv) {
-  common::Init(argc, argv);
+// Runs a selector until all the queries issued by 'issue' are answered
+void RunQueries(Closure* issue) {
   g_selector = new net::Selector();
+  issue->Run();
+  g_selector->Loop();
+  delete g_selector;
+  g_selector = NULL;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// A local nameserver stub: answers A queries from a fixed table,
+// w/ a fixed TTL, after an (optional) delay. It can be told to ignore
+// the AAAA queries, like some broken nameservers do.
+//
+class StubNameserver {
+ public:
+  StubNameserver(uint32 ttl_sec, int32 delay_ms)
+    : ttl_sec_(ttl_sec), delay_ms_(delay_ms),
+      fd_(-1), port_(0), thread_(NULL), should_stop_(false),
+      ignore_aaaa_(false) {
+  }
+  ~StubNameserver() {
+    Stop();
+  }
+  void Add(const string& hostname, const net::IpAddress& ip) {
+    synch::MutexLocker l(&mutex_);
+    ips_[hostname] = ip;
+  }
+  void set_ignore_aaaa(bool ignore_aaaa) {
+    synch::MutexLocker l(&mutex_);
+    ignore_aaaa_ = ignore_aaaa;
+  }
+  int32 num_queries(const string& hostname) {
+    synch::MutexLocker l(&mutex_);
+    return num_queries_[hostname];
+  }
+  net::HostPort address() const {
+    return net::HostPort(net::IpAddress("127.0.0.1"), port_);
+  }
+  void Start() {
+    fd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+    CHECK_GE(fd_, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    CHECK(!::bind(fd_, reinterpret_cast<struct sockaddr*>(&addr),
+                  sizeof(addr)));
+    socklen_t len = sizeof(addr);
+    CHECK(!::getsockname(fd_, reinterpret_cast<struct sockaddr*>(&addr),
+                         &len));
+    port_ = ntohs(addr.sin_port);
+    thread_ = new thread::Thread(NewCallback(this, &StubNameserver::Run));
+    CHECK(thread_->SetJoinable() && thread_->Start());
+  }
+  void Stop() {
+    if ( thread_ == NULL ) {
+      return;
+    }
+    should_stop_ = true;
+    thread_->Join();
+    delete thread_;
+    thread_ = NULL;
+    ::close(fd_);
+  }
+
+ private:
+  void Run() {
+    while ( !should_stop_ ) {
+      struct pollfd pfd;
+      pfd.fd = fd_;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      if ( ::poll(&pfd, 1, 50) <= 0 ) {
+        continue;
+      }
+      uint8 query[512];
+      struct sockaddr_storage from;
+      socklen_t from_len = sizeof(from);
+      const ssize_t size = ::recvfrom(fd_, query, sizeof(query), 0,
+          reinterpret_cast<struct sockaddr*>(&from), &from_len);
+      if ( size < 17 ) {
+        continue;
+      }
+      // Decode the question
+      string hostname;
+      int32 pos = 12;
+      while ( pos < size && query[pos] != 0 ) {
+        if ( !hostname.empty() ) {
+          hostname += ".";
+        }
+        hostname.append(reinterpret_cast<const char*>(query + pos + 1),
+                        query[pos]);
+        pos += query[pos] + 1;
+      }
+      const int32 question_end = pos + 5;
+      CHECK_LE(question_end, size);
+      const uint16 qtype = (query[pos + 1] << 8) | query[pos + 2];
+
+      net::IpAddress ip;
+      bool found = false;
+      {
+        synch::MutexLocker l(&mutex_);
+        if ( qtype == 28 && ignore_aaaa_ ) {
+          continue;
+        }
+        if ( qtype == 1 ) {
+          ++num_queries_[hostname];
+        }
+        map<string, net::IpAddress>::const_iterator it = ips_.find(hostname);
+        if ( it != ips_.end() ) {
+          found = true;
+          ip = it->second;
+        }
+      }
+      if ( delay_ms_ > 0 ) {
+        ::usleep(delay_ms_ * 1000);
+      }
+      string answer(reinterpret_cast<const char*>(query), question_end);
+      answer[2] = 0x81;                          // response, RD
+      answer[3] = found ? 0x80 : 0x83;           // RA, NOERROR / NXDOMAIN
+      const bool has_record = found && qtype == 1;
+      answer[7] = has_record ? 1 : 0;            // ANCOUNT
+      if ( has_record ) {
+        const uint8 record[] = {
+          0xc0, 0x0c,                            // name: the question
+          0x00, 0x01, 0x00, 0x01,                // A, IN
+          static_cast<uint8>(ttl_sec_ >> 24),
+          static_cast<uint8>(ttl_sec_ >> 16),
+          static_cast<uint8>(ttl_sec_ >> 8),
+          static_cast<uint8>(ttl_sec_),
+          0x00, 0x04,
+          static_cast<uint8>(ip.ipv4() >> 24),
+          static_cast<uint8>(ip.ipv4() >> 16),
+          static_cast<uint8>(ip.ipv4() >> 8),
+          static_cast<uint8>(ip.ipv4()),
+        };
+        answer.append(reinterpret_cast<const char*>(record), sizeof(record));
+      }
+      ::sendto(fd_, answer.data(), answer.size(), 0,
+               reinterpret_cast<struct sockaddr*>(&from), from_len);
+    }
+  }
+
+  const uint32 ttl_sec_;
+  const int32 delay_ms_;
+  int fd_;
+  uint16 port_;
+  thread::Thread* thread_;
+  volatile bool should_stop_;
+
+  synch::Mutex mutex_;
+  map<string, net::IpAddress> ips_;
+  map<string, int32> num_queries_;
+  bool ignore_aaaa_;
+};
 
+void IssueSystemQueries() {
   TestDnsQuery("google.com", true);
   TestDnsQuery("localhost", true);
   TestDnsQuery("asd90fas8df0as8d908asd0", false);
+}
+void IssueStubQueries() {
+  // These are coalesced in a single query
+  for ( int i = 0; i < 5; ++i ) {
+    TestDnsQuery("www.whispercast.org", true);
+  }
+  TestDnsQuery("nonexistent.whispercast.org", false);
+  TestDnsQuery("10.0.0.1", true);
+}
+void IssueCachedQueries() {
+  TestDnsQuery("www.whispercast.org", true);
+  TestDnsQuery("nonexistent.whispercast.org", false);
+}
 
-  g_selector->Loop();
-  delete g_selector;
-  g_selector = NULL;
+void TestUdpResolve(StubNameserver* stub) {
+  int64 ttl_ms = 0;
+  scoped_ref<net::DnsHostInfo> info = net::DnsUdpResolve(
+      stub->address(), "www.whispercast.org", 2000, &ttl_ms);
+  CHECK(info.get() != NULL);
+  CHECK_EQ(info->ipv4_.size(), 1);
+  CHECK(info->ipv4_[0] == net::IpAddress("10.1.2.3"));
+  CHECK(info->ipv6_.empty());
+  CHECK_EQ(ttl_ms, 2000);
+  CHECK(net::DnsUdpResolve(stub->address(), "nonexistent.whispercast.org",
+                           2000, NULL).get() == NULL);
+  // Nobody answers here
+  StubNameserver dead(1, 0);
+  dead.Start();
+  const net::HostPort dead_address(dead.address());
+  dead.Stop();
+  const int64 start = timer::TicksMsec();
+  CHECK(net::DnsUdpResolve(dead_address, "www.whispercast.org",
+                           300, NULL).get() == NULL);
+  CHECK_LT(timer::TicksMsec() - start, 1000);
+
+  // No AAAA answer: we don't wait the whole timeout for it
+  stub->set_ignore_aaaa(true);
+  const int64 aaaa_start = timer::TicksMsec();
+  info = net::DnsUdpResolve(stub->address(), "www.whispercast.org",
+                            5000, NULL);
+  CHECK(info.get() != NULL);
+  CHECK_EQ(info->ipv4_.size(), 1);
+  CHECK(info->ipv6_.empty());
+  CHECK_LT(timer::TicksMsec() - aaaa_start, 1000);
+  stub->set_ignore_aaaa(false);
+}
+
+int main(int argc, char ** argv) {
+  common::Init(argc, argv);
+
+  if ( FLAGS_test_system_resolver ) {
+    RunQueries(NewCallback(&IssueSystemQueries));
+  }
+
+  StubNameserver stub(2, 100);
+  stub.Add("www.whispercast.org", net::IpAddress("10.1.2.3"));
+  stub.Start();
+  TestUdpResolve(&stub);
+
+  // Resolve through the stub
+  net::DnsExit();
+  FLAGS_dns_nameserver = stub.address().ToString();
+  FLAGS_dns_negative_cache_ttl_ms = 1000;
+  net::DnsInit();
+  const int32 initial_queries = stub.num_queries("www.whispercast.org");
+  const int32 initial_nx_queries =
+      stub.num_queries("nonexistent.whispercast.org");
+  RunQueries(NewCallback(&IssueStubQueries));
+  CHECK_EQ(stub.num_queries("www.whispercast.org"), initial_queries + 1);
+  CHECK_EQ(stub.num_queries("nonexistent.whispercast.org"),
+           initial_nx_queries + 1);
+
+  // Served from the cache
+  RunQueries(NewCallback(&IssueCachedQueries));
+  CHECK_EQ(stub.num_queries("www.whispercast.org"), initial_queries + 1);
+  CHECK_EQ(stub.num_queries("nonexistent.whispercast.org"),
+           initial_nx_queries + 1);
+
+  // Expired (TTL is 2 seconds, negative TTL 1 second)
+  ::usleep(2100000);
+  RunQueries(NewCallback(&IssueCachedQueries));
+  CHECK_EQ(stub.num_queries("www.whispercast.org"), initial_queries + 2);
+  CHECK_EQ(stub.num_queries("nonexistent.whispercast.org"),
+           initial_nx_queries + 2);
 
+  stub.Stop();
   LOG_INFO << "Pass";
   common::Exit(0);
 }
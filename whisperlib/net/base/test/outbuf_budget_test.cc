@@ -0,0 +1,339 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include "common/base/types.h"
+#include "common/base/log.h"
+#include "common/base/system.h"
+#include "common/base/gflags.h"
+#include "common/base/strutil.h"
+
+#include "net/base/outbuf_budget.h"
+#include "net/base/connection.h"
+#include "net/base/selector.h"
+
+DECLARE_int32(outbuf_budget_mb);
+
+using net::OutbufBudget;
+
+namespace {
+
+void TestAccounting() {
+  FLAGS_outbuf_budget_mb = 0;
+  CHECK_EQ(OutbufBudget::usage(), 0);
+  {
+    OutbufBudget::Account a(1024);
+    OutbufBudget::Account b(1000);
+    CHECK_EQ(OutbufBudget::num_accounts(), 2);
+    // whole blocks
+    a.Update(1);
+    CHECK_EQ(a.bytes(), 1024);
+    a.Update(1024);
+    CHECK_EQ(a.bytes(), 1024);
+    a.Update(1025);
+    CHECK_EQ(a.bytes(), 2048);
+    b.Update(3500);
+    CHECK_EQ(b.bytes(), 4000);
+    CHECK_EQ(OutbufBudget::usage(), 6048);
+    a.Update(0);
+    CHECK_EQ(OutbufBudget::usage(), 4000);
+    // no budget: nothing degrades
+    CHECK_EQ(OutbufBudget::level(), OutbufBudget::LEVEL_NORMAL);
+    CHECK_EQ(OutbufBudget::ScaledLimit(100), 100);
+    CHECK(!OutbufBudget::ShouldEvict(&b));
+  }
+  // the destructors give everything back
+  CHECK_EQ(OutbufBudget::usage(), 0);
+  CHECK_EQ(OutbufBudget::num_accounts(), 0);
+}
+
+void TestLevels() {
+  FLAGS_outbuf_budget_mb = 10;
+  const int64 kMB = 1 << 20;
+  const int32 kBlock = 1 << 16;
+  CHECK_EQ(OutbufBudget::budget(), 10 * kMB);
+
+  // ten slow guys w/ 128K each, one w/ 1M
+  vector<OutbufBudget::Account*> accounts;
+  for ( int i = 0; i < 10; ++i ) {
+    accounts.push_back(new OutbufBudget::Account(kBlock));
+    accounts.back()->set_name(strutil::StringPrintf("client%d", i));
+    accounts.back()->Update(2 * kBlock);
+  }
+  OutbufBudget::Account big(kBlock);
+  big.set_name("big");
+  big.Update(kMB);
+  CHECK_EQ(OutbufBudget::usage(), 10 * 2 * kBlock + kMB);
+  CHECK_EQ(OutbufBudget::level(), OutbufBudget::LEVEL_NORMAL);
+  CHECK(!OutbufBudget::ShouldEvict(&big));
+
+  big.Update(6 * kMB);        // ~ 6.25 / 10 MB
+  CHECK_EQ(OutbufBudget::level(), OutbufBudget::LEVEL_SHRINK);
+  CHECK_EQ(OutbufBudget::ScaledLimit(1000), 500);
+  CHECK(!OutbufBudget::ShouldEvict(&big));
+
+  big.Update(8 * kMB);        // ~ 8.25 / 10 MB
+  CHECK_EQ(OutbufBudget::level(), OutbufBudget::LEVEL_KEYFRAMES);
+  CHECK_EQ(OutbufBudget::ScaledLimit(1000), 250);
+
+  big.Update(9 * kMB + kMB / 2);  // ~ 9.75 / 10 MB
+  CHECK_EQ(OutbufBudget::level(), OutbufBudget::LEVEL_EVICT);
+  // only the one w/ the large backlog goes away
+  CHECK(OutbufBudget::ShouldEvict(&big));
+  for ( int i = 0; i < accounts.size(); ++i ) {
+    CHECK(!OutbufBudget::ShouldEvict(accounts[i]));
+  }
+  CHECK(!OutbufBudget::ShouldEvict(NULL));
+
+  vector< pair<string, int64> > top;
+  OutbufBudget::GetTopConsumers(3, &top);
+  CHECK_EQ(top.size(), 3);
+  CHECK_EQ(top[0].first, "big");
+  CHECK_EQ(top[0].second, 9 * kMB + kMB / 2);
+  CHECK_EQ(top[1].second, 2 * kBlock);
+
+  big.Update(0);
+  CHECK_EQ(OutbufBudget::level(), OutbufBudget::LEVEL_NORMAL);
+  for ( int i = 0; i < accounts.size(); ++i ) {
+    delete accounts[i];
+  }
+  FLAGS_outbuf_budget_mb = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Drives the levels through a real connection, whose peer never reads.
+// The server side is fed the way the protocols do it (see the rtmp
+// ServerConnection::ConnectionWriteHandler): we close over the hard limit
+// or when evicted, and we feed only under the scaled limit.
+class ConnectionTest {
+ public:
+  static const int64 kMaxOutbuf = 2 << 20;
+  static const int32 kChunk = 1 << 16;
+  static const int64 kStepMs = 500;
+
+  explicit ConnectionTest(net::Selector* selector)
+      : selector_(selector),
+        acceptor_(selector),
+        client_(new net::TcpConnection(selector, net::TcpConnectionParams())),
+        server_(NULL),
+        chunk_(kChunk, 'x'),
+        outbuf_size_(0),
+        num_over_limit_(0),
+        num_evicted_(0) {
+    acceptor_.SetFilterHandler(NewPermanentCallback(
+        this, &ConnectionTest::AcceptFilter), true);
+    acceptor_.SetAcceptHandler(NewPermanentCallback(
+        this, &ConnectionTest::Accepted), true);
+    client_->SetConnectHandler(NewPermanentCallback(
+        this, &ConnectionTest::Connected), true);
+    SetIdleHandlers(client_);
+    client_->SetWriteHandler(NewPermanentCallback(
+        this, &ConnectionTest::Idle), true);
+  }
+  ~ConnectionTest() {
+    for ( int i = 0; i < others_.size(); ++i ) {
+      delete others_[i];
+    }
+  }
+
+  void Start() {
+    FLAGS_outbuf_budget_mb = 4;
+    CHECK(acceptor_.Listen(net::HostPort("127.0.0.1", 0)));
+    CHECK(client_->Connect(
+        net::HostPort("127.0.0.1", acceptor_.local_address().port())));
+  }
+
+ private:
+  bool AcceptFilter(const net::HostPort& addr) {
+    return true;
+  }
+  bool Idle() {
+    return true;
+  }
+  void Closed(int err, net::NetConnection::CloseWhat what) {
+  }
+  void SetIdleHandlers(net::NetConnection* connection) {
+    connection->SetReadHandler(NewPermanentCallback(
+        this, &ConnectionTest::Idle), true);
+    connection->SetCloseHandler(NewPermanentCallback(
+        this, &ConnectionTest::Closed), true);
+  }
+  void Connected() {
+    // the peer never reads: whatever the kernel does not take stays
+    // in the server outbuf
+    client_->SetRecvBufferSize(kChunk);
+    client_->RequestReadEvents(false);
+  }
+  void Accepted(net::NetConnection* server) {
+    CHECK(server_ == NULL);
+    server_ = server;
+    server_->SetSendBufferSize(kChunk);
+    SetIdleHandlers(server_);
+    server_->SetWriteHandler(NewPermanentCallback(
+        this, &ConnectionTest::Feed), true);
+    Feed();
+    server_->RequestWriteEvents(true);
+    selector_->RegisterAlarm(NewCallback(
+        this, &ConnectionTest::TestNormal), kStepMs);
+  }
+
+  // Returns false if the connection has to go
+  bool Feed() {
+    if ( server_->outbuf()->Size() > kMaxOutbuf ) {
+      ++num_over_limit_;
+      return false;
+    }
+    if ( OutbufBudget::ShouldEvict(server_->outbuf_account()) ) {
+      ++num_evicted_;
+      return false;
+    }
+    while ( server_->outbuf()->Size() <
+            OutbufBudget::ScaledLimit(kMaxOutbuf) / 2 ) {
+      server_->outbuf()->Write(chunk_);
+    }
+    return true;
+  }
+  // Feeds as on a write event, checks the connection is still there
+  void FeedAndCheck() {
+    outbuf_size_ = server_->outbuf()->Size();
+    CHECK(Feed());
+    server_->RequestWriteEvents(true);
+    CHECK_EQ(server_->state(), net::NetConnection::CONNECTED);
+    CHECK_EQ(num_over_limit_, 0);
+    CHECK_EQ(num_evicted_, 0);
+  }
+  // The other (slow) connections hold this much each
+  void SetOthers(int count, int64 bytes) {
+    while ( others_.size() < count ) {
+      others_.push_back(new OutbufBudget::Account(1024));
+    }
+    for ( int i = 0; i < others_.size(); ++i ) {
+      others_[i]->Update(bytes);
+    }
+  }
+
+  void TestNormal() {
+    // the kernel buffers are full by now, we fed up to half the limit
+    CHECK_EQ(OutbufBudget::level(), OutbufBudget::LEVEL_NORMAL);
+    CHECK_GE(server_->outbuf()->Size(), kMaxOutbuf / 2);
+    CHECK_GE(server_->outbuf_account()->bytes(), kMaxOutbuf / 2);
+    CHECK_EQ(OutbufBudget::usage(), server_->outbuf_account()->bytes());
+    FeedAndCheck();
+    LOG_INFO << "OK normal, outbuf: " << server_->outbuf()->Size();
+
+    // ~ 2.5 / 4 MB
+    SetOthers(10, 160 << 10);
+    CHECK_EQ(OutbufBudget::level(), OutbufBudget::LEVEL_SHRINK);
+    selector_->RegisterAlarm(NewCallback(
+        this, &ConnectionTest::TestShrink), kStepMs);
+  }
+  void TestShrink() {
+    // over the scaled limit, but under the hard one: we just stop feeding
+    CHECK_GE(server_->outbuf()->Size(), OutbufBudget::ScaledLimit(kMaxOutbuf));
+    FeedAndCheck();
+    CHECK_LE(server_->outbuf()->Size(), outbuf_size_);
+    LOG_INFO << "OK shrink, outbuf: " << server_->outbuf()->Size();
+
+    // ~ 3.4 / 4 MB
+    SetOthers(10, 240 << 10);
+    CHECK_EQ(OutbufBudget::level(), OutbufBudget::LEVEL_KEYFRAMES);
+    selector_->RegisterAlarm(NewCallback(
+        this, &ConnectionTest::TestKeyframes), kStepMs);
+  }
+  void TestKeyframes() {
+    FeedAndCheck();
+    CHECK_LE(server_->outbuf()->Size(), outbuf_size_);
+    LOG_INFO << "OK keyframes, outbuf: " << server_->outbuf()->Size();
+
+    // some large reply, written w/o flow control: ~ 4.1 / 4 MB
+    for ( int i = 0; i < 12; ++i ) {
+      server_->outbuf()->Write(chunk_);
+    }
+    server_->RequestWriteEvents(true);
+    CHECK_EQ(OutbufBudget::level(), OutbufBudget::LEVEL_EVICT);
+    selector_->RegisterAlarm(NewCallback(
+        this, &ConnectionTest::TestEvict), kStepMs);
+  }
+  void TestEvict() {
+    // only the slow guy goes, and frees its memory at once
+    for ( int i = 0; i < others_.size(); ++i ) {
+      CHECK(!OutbufBudget::ShouldEvict(others_[i]));
+    }
+    CHECK(!Feed());
+    CHECK_EQ(num_evicted_, 1);
+    CHECK_EQ(num_over_limit_, 0);
+    server_->ForceClose();
+    CHECK_EQ(server_->outbuf_account()->bytes(), 0);
+    CHECK_EQ(OutbufBudget::usage(), 10 * (240 << 10));
+    LOG_INFO << "OK evict";
+
+    SetOthers(10, 0);
+    CHECK_EQ(OutbufBudget::level(), OutbufBudget::LEVEL_NORMAL);
+    client_->ForceClose();
+    acceptor_.Close();
+    selector_->DeleteInSelectLoop(server_);
+    selector_->DeleteInSelectLoop(client_);
+    FLAGS_outbuf_budget_mb = 0;
+    selector_->MakeLoopExit();
+  }
+
+  net::Selector* const selector_;
+  net::TcpAcceptor acceptor_;
+  net::TcpConnection* client_;
+  net::NetConnection* server_;
+  const string chunk_;
+  // outbuf size before the last feed
+  int32 outbuf_size_;
+  int num_over_limit_;
+  int num_evicted_;
+  vector<OutbufBudget::Account*> others_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ConnectionTest);
+};
+
+void TestConnection() {
+  net::Selector selector;
+  ConnectionTest test(&selector);
+  selector.RunInSelectLoop(NewCallback(&test, &ConnectionTest::Start));
+  selector.Loop();
+  CHECK_EQ(OutbufBudget::usage(), 0);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestAccounting();
+  TestLevels();
+  TestConnection();
+  LOG_INFO << "PASS";
+  common::Exit(0);
+}
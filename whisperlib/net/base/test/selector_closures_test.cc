@@ -0,0 +1,271 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+// Measures the rate at which closures posted from other threads
+// (w/ Selector::RunInSelectLoop) get run in the select loop, and checks
+// that posting inline closures and deletions does not allocate.
+//
+
+#include <stdlib.h>
+#include <new>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/gflags.h>
+#include <whisperlib/common/base/strutil.h>
+#include <whisperlib/common/base/timer.h>
+#include <whisperlib/common/base/callback.h>
+#include <whisperlib/common/sync/event.h>
+#include <whisperlib/common/sync/thread.h>
+#include <whisperlib/net/base/selector.h>
+
+//////////////////////////////////////////////////////////////////////
+
+DEFINE_int32(num_closures_per_producer,
+             200000,
+             "Each producer thread posts these many closures");
+DEFINE_string(num_producers,
+              "1,4,16",
+              "Run a round w/ each of these many producer threads");
+
+//////////////////////////////////////////////////////////////////////
+
+// Counts the allocations made by each thread
+static __thread int64 g_num_allocs = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc) {
+  ++g_num_allocs;
+  void* const p = ::malloc(size == 0 ? 1 : size);
+  if ( p == NULL ) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void operator delete(void* p) throw() {
+  ::free(p);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+class Counter {
+ public:
+  Counter(int64 expected)
+      : expected_(expected),
+        count_(0),
+        done_(false, true) {
+  }
+  // Runs in the select loop
+  void Inc() {
+    ++count_;
+    if ( count_ == expected_ ) {
+      done_.Signal();
+    }
+  }
+  void Wait() {
+    CHECK(done_.Wait(60000)) << " Timeout, count: " << count_
+                             << " of " << expected_;
+  }
+ private:
+  const int64 expected_;
+  int64 count_;
+  synch::Event done_;
+};
+
+void Produce(net::Selector* selector, Counter* counter, synch::Event* start) {
+  start->Wait();
+  for ( int32 i = 0; i < FLAGS_num_closures_per_producer; ++i ) {
+    selector->RunInSelectLoop(NewCallback(counter, &Counter::Inc));
+  }
+}
+
+void RunRound(net::Selector* selector, int num_producers) {
+  Counter counter(static_cast<int64>(num_producers) *
+                  FLAGS_num_closures_per_producer);
+  synch::Event start(false, true);
+  vector<thread::Thread*> producers;
+  for ( int i = 0; i < num_producers; ++i ) {
+    producers.push_back(new thread::Thread(
+        NewCallback(&Produce, selector, &counter, &start)));
+    CHECK(producers.back()->SetJoinable());
+    CHECK(producers.back()->Start());
+  }
+  const int64 start_ts = timer::TicksMsec();
+  start.Signal();
+  counter.Wait();
+  const int64 duration_ms = max(timer::TicksMsec() - start_ts,
+                                static_cast<int64>(1));
+  for ( int i = 0; i < producers.size(); ++i ) {
+    producers[i]->Join();
+    delete producers[i];
+  }
+  const int64 total = static_cast<int64>(num_producers) *
+                      FLAGS_num_closures_per_producer;
+  LOG_WARNING << "Producers: " << num_producers
+              << ", closures: " << total
+              << ", time: " << duration_ms << " ms"
+              << ", rate: " << (total * 1000 / duration_ms) << " closures/s";
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Posts an InlineClosure from the main thread for each "item"
+class Poster {
+ public:
+  Poster(net::Selector* selector, int64 expected)
+      : selector_(selector),
+        expected_(expected),
+        task_(this, &Poster::Process),
+        num_posted_(0),
+        num_processed_(0),
+        num_runs_(0),
+        done_(false, true) {
+  }
+  // Not in the select thread
+  void Post() {
+    __sync_add_and_fetch(&num_posted_, 1);
+    if ( task_.Schedule() ) {
+      selector_->RunInSelectLoop(&task_);
+    }
+  }
+  void Wait() {
+    CHECK(done_.Wait(60000)) << " Timeout, processed: " << num_processed_
+                             << " of " << expected_;
+    CHECK(!task_.is_scheduled());
+  }
+  int64 num_runs() const {
+    return num_runs_;
+  }
+ private:
+  // In the select thread
+  void Process() {
+    ++num_runs_;
+    num_processed_ = num_posted_;
+    if ( num_processed_ == expected_ ) {
+      done_.Signal();
+    }
+  }
+  net::Selector* const selector_;
+  const int64 expected_;
+  InlineClosure<Poster> task_;
+  volatile int64 num_posted_;
+  int64 num_processed_;
+  int64 num_runs_;
+  synch::Event done_;
+};
+
+void TestInlineClosure(net::Selector* selector) {
+  const int64 n = FLAGS_num_closures_per_producer;
+  Poster poster(selector, n);
+  const int64 num_allocs = g_num_allocs;
+  for ( int64 i = 0; i < n; ++i ) {
+    poster.Post();
+  }
+  CHECK_EQ(g_num_allocs - num_allocs, 0);
+  poster.Wait();
+  LOG_WARNING << "InlineClosure: " << n << " posts, "
+              << poster.num_runs() << " runs, 0 allocations";
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int g_num_deleted = 0;
+struct Deletable {
+  ~Deletable() {
+    ++g_num_deleted;
+  }
+};
+const int kNumDeletables = 100;
+
+void DeleteSome(net::Selector* selector, vector<Deletable*>* obs) {
+  for ( int i = 0; i < obs->size(); ++i ) {
+    selector->DeleteInSelectLoop((*obs)[i]);
+  }
+  obs->clear();
+}
+void CheckDeletes(net::Selector* selector, synch::Event* done) {
+  CHECK_EQ(g_num_deleted, kNumDeletables);
+  // Now the deleters are back, so this should not allocate
+  vector<Deletable*> obs;
+  for ( int i = 0; i < kNumDeletables; ++i ) {
+    obs.push_back(new Deletable());
+  }
+  const int64 num_allocs = g_num_allocs;
+  DeleteSome(selector, &obs);
+  CHECK_EQ(g_num_allocs - num_allocs, 0);
+  selector->RunInSelectLoop(NewCallback(done, &synch::Event::Signal));
+}
+void StartDeletes(net::Selector* selector, synch::Event* done) {
+  vector<Deletable*> obs;
+  for ( int i = 0; i < kNumDeletables; ++i ) {
+    obs.push_back(new Deletable());
+  }
+  DeleteSome(selector, &obs);
+  // (runs after the deletions)
+  selector->RunInSelectLoop(NewCallback(&CheckDeletes, selector, done));
+}
+
+void TestDeleteInSelectLoop(net::Selector* selector) {
+  synch::Event done(false, true);
+  selector->RunInSelectLoop(NewCallback(&StartDeletes, selector, &done));
+  CHECK(done.Wait(10000));
+  CHECK_EQ(g_num_deleted, 2 * kNumDeletables);
+  LOG_WARNING << "DeleteInSelectLoop: " << kNumDeletables
+              << " deletions w/ 0 allocations";
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+
+  net::SelectorThread selector_thread;
+  selector_thread.Start();
+
+  // make sure we count right ..
+  const int64 num_allocs = g_num_allocs;
+  delete NewCallback(&Produce, static_cast<net::Selector*>(NULL),
+                     static_cast<Counter*>(NULL),
+                     static_cast<synch::Event*>(NULL));
+  CHECK_EQ(g_num_allocs - num_allocs, 1);
+
+  TestInlineClosure(selector_thread.mutable_selector());
+  TestDeleteInSelectLoop(selector_thread.mutable_selector());
+
+  vector<string> num_producers;
+  strutil::SplitString(FLAGS_num_producers, ",", &num_producers);
+  for ( int i = 0; i < num_producers.size(); ++i ) {
+    const int n = ::atoi(num_producers[i].c_str());
+    CHECK_GT(n, 0) << " Bad --num_producers: " << FLAGS_num_producers;
+    RunRound(selector_thread.mutable_selector(), n);
+  }
+  LOG_WARNING << "PASS";
+  common::Exit(0);
+}
@@ -0,0 +1,189 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <stdlib.h>
+
+#include "common/base/types.h"
+#include "common/base/log.h"
+#include "common/base/system.h"
+#include "common/base/callback.h"
+#include "common/base/timer.h"
+
+#include "net/base/selector.h"
+#include "net/base/timer_wheel.h"
+
+namespace {
+
+class Counter {
+ public:
+  Counter(net::TimerWheel* wheel)
+      : wheel_(wheel),
+        callback_(NewPermanentCallback(this, &Counter::Fire)),
+        timer_(callback_),
+        count_(0),
+        reschedule_ms_(-1),
+        now_(0) {
+  }
+  ~Counter() {
+    timer_.Cancel();
+    delete callback_;
+  }
+  void Fire() {
+    ++count_;
+    if ( reschedule_ms_ >= 0 ) {
+      wheel_->Schedule(&timer_, now_, reschedule_ms_);
+    }
+  }
+  net::TimerWheel* wheel_;
+  Closure* callback_;
+  net::TimerWheel::Timer timer_;
+  int count_;
+  int64 reschedule_ms_;
+  int64 now_;
+};
+
+void TestBasic() {
+  net::TimerWheel wheel(10, 8);
+  Counter a(&wheel), b(&wheel), c(&wheel);
+  CHECK_EQ(wheel.NextTimeoutMs(1000), -1);
+
+  wheel.Schedule(&a.timer_, 1000, 25);
+  wheel.Schedule(&b.timer_, 1000, 500);   // a few turns of the wheel
+  wheel.Schedule(&c.timer_, 1000, 0);
+  CHECK_EQ(wheel.size(), 3);
+  CHECK_EQ(wheel.NextTimeoutMs(1000), 0);
+
+  CHECK_EQ(wheel.Advance(1000), 1);
+  CHECK_EQ(c.count_, 1);
+  CHECK(!c.timer_.is_scheduled());
+  CHECK_EQ(wheel.NextTimeoutMs(1000), 25);
+
+  // never earlier
+  CHECK_EQ(wheel.Advance(1024), 0);
+  CHECK_EQ(a.count_, 0);
+  CHECK_EQ(wheel.Advance(1025), 1);
+  CHECK_EQ(a.count_, 1);
+
+  // b is due in a following turn - we should not run it, nor wake up
+  // for it in this turn
+  for ( int64 now = 1030; now < 1500; now += 10 ) {
+    CHECK_EQ(wheel.Advance(now), 0) << " now: " << now;
+    CHECK_GT(wheel.NextTimeoutMs(now), 0);
+  }
+  CHECK_EQ(wheel.Advance(1500), 1);
+  CHECK_EQ(b.count_, 1);
+  CHECK_EQ(wheel.size(), 0);
+
+  // cancel
+  wheel.Schedule(&a.timer_, 1500, 10);
+  a.timer_.Cancel();
+  CHECK_EQ(wheel.size(), 0);
+  CHECK_EQ(wheel.Advance(2000), 0);
+  CHECK_EQ(a.count_, 1);
+
+  // a timer that re-arms itself runs once per step
+  a.reschedule_ms_ = 0;
+  a.now_ = 2000;
+  wheel.Schedule(&a.timer_, 2000, 0);
+  CHECK_EQ(wheel.Advance(2000), 1);
+  CHECK_EQ(wheel.Advance(2000), 1);
+  CHECK_EQ(a.count_, 3);
+  a.timer_.Cancel();
+  a.reschedule_ms_ = -1;
+
+  // a long sleep - all run
+  wheel.Schedule(&a.timer_, 2000, 15);
+  wheel.Schedule(&b.timer_, 2000, 35);
+  wheel.Schedule(&c.timer_, 2000, 75);
+  CHECK_EQ(wheel.Advance(5000), 3);
+}
+
+// Many timers in a selector, w/ their real precision
+int64 g_num_pending = 0;
+int64 g_max_late_ms = 0;
+net::Selector* g_selector = NULL;
+
+class SelectorTimer {
+ public:
+  SelectorTimer()
+      : callback_(NewPermanentCallback(this, &SelectorTimer::Fire)),
+        timer_(callback_),
+        when_(0) {
+  }
+  ~SelectorTimer() {
+    delete callback_;
+  }
+  void Schedule(int64 delay_ms) {
+    when_ = g_selector->now() + delay_ms;
+    g_selector->timer_wheel()->Schedule(&timer_, g_selector->now(),
+                                        delay_ms);
+  }
+  void Fire() {
+    CHECK_GE(g_selector->now(), when_);
+    const int64 now = timer::TicksMsec();
+    g_max_late_ms = max(g_max_late_ms, now - when_);
+    if ( --g_num_pending == 0 ) {
+      g_selector->MakeLoopExit();
+    }
+  }
+ private:
+  Closure* callback_;
+  net::TimerWheel::Timer timer_;
+  int64 when_;
+};
+
+void StartTimers(SelectorTimer* timers, int num_timers) {
+  for ( int i = 0; i < num_timers; ++i ) {
+    timers[i].Schedule(i % 500);
+  }
+}
+
+void TestSelector() {
+  const int kNumTimers = 10000;
+  SelectorTimer* timers = new SelectorTimer[kNumTimers];
+  net::Selector selector;
+  g_selector = &selector;
+  g_num_pending = kNumTimers;
+  selector.RunInSelectLoop(NewCallback(&StartTimers, timers, kNumTimers));
+  selector.Loop();
+  CHECK_EQ(g_num_pending, 0);
+  LOG_INFO << "Max late: " << g_max_late_ms << " ms";
+  delete [] timers;
+}
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestBasic();
+  TestSelector();
+  LOG_INFO << "PASS";
+  common::Exit(0);
+}
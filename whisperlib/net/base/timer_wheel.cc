@@ -0,0 +1,158 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include "net/base/timer_wheel.h"
+#include "common/base/log.h"
+
+namespace net {
+
+void TimerWheel::Timer::Cancel() {
+  if ( wheel_ != NULL ) {
+    wheel_->Cancel(this);
+  }
+}
+
+TimerWheel::TimerWheel(int64 tick_ms, int32 num_slots)
+    : tick_ms_(tick_ms),
+      slots_(num_slots),
+      last_tick_(-1),
+      size_(0) {
+  CHECK_GT(tick_ms, 0);
+  CHECK_GT(num_slots, 0);
+  // (the vector copied the heads - make them point to themselves)
+  for ( int i = 0; i < slots_.size(); ++i ) {
+    slots_[i].prev_ = slots_[i].next_ = &slots_[i];
+  }
+}
+
+TimerWheel::~TimerWheel() {
+  // Just detach the timers - they are not ours
+  for ( int i = 0; i < slots_.size(); ++i ) {
+    while ( slots_[i].next_ != &slots_[i] ) {
+      Timer* const timer = static_cast<Timer*>(slots_[i].next_);
+      Unlink(timer);
+      timer->wheel_ = NULL;
+    }
+  }
+}
+
+void TimerWheel::Schedule(Timer* timer, int64 now_ms, int64 delay_ms) {
+  if ( timer->wheel_ != NULL ) {
+    CHECK(timer->wheel_ == this);
+    Unlink(timer);
+  } else {
+    ++size_;
+  }
+  timer->wheel_ = this;
+  timer->when_ms_ = now_ms + max(delay_ms, static_cast<int64>(0));
+  if ( last_tick_ < 0 ) {
+    last_tick_ = now_ms / tick_ms_;
+  }
+  // Never in the past - we would not look there until the next turn
+  Append(Slot(max(timer->when_ms_ / tick_ms_, last_tick_)), timer);
+}
+
+void TimerWheel::Cancel(Timer* timer) {
+  if ( timer->wheel_ == NULL ) {
+    return;
+  }
+  CHECK(timer->wheel_ == this);
+  Unlink(timer);
+  timer->wheel_ = NULL;
+  --size_;
+}
+
+int TimerWheel::Advance(int64 now_ms) {
+  const int64 now_tick = now_ms / tick_ms_;
+  if ( size_ == 0 || last_tick_ < 0 ) {
+    last_tick_ = now_tick;
+    return 0;
+  }
+  int run_count = 0;
+  // (if we are late by more then a turn, look once at each slot)
+  int64 tick = max(last_tick_,
+                   now_tick - static_cast<int64>(slots_.size()) + 1);
+  last_tick_ = now_tick;
+  for ( ; tick <= now_tick && size_ > 0; ++tick ) {
+    // Detach the slot, so the timers (re)scheduled by callbacks don't run
+    // again in this step.
+    Link* const slot = Slot(tick);
+    if ( slot->next_ == slot ) {
+      continue;
+    }
+    Link pending;
+    pending.next_ = slot->next_;
+    pending.prev_ = slot->prev_;
+    pending.next_->prev_ = &pending;
+    pending.prev_->next_ = &pending;
+    slot->next_ = slot->prev_ = slot;
+
+    while ( pending.next_ != &pending ) {
+      Timer* const timer = static_cast<Timer*>(pending.next_);
+      Unlink(timer);
+      if ( timer->when_ms_ > now_ms ) {
+        // due in a following turn (or later in this tick)
+        Append(Slot(timer->when_ms_ / tick_ms_), timer);
+        continue;
+      }
+      timer->wheel_ = NULL;
+      --size_;
+      ++run_count;
+      timer->callback_->Run();
+    }
+  }
+  return run_count;
+}
+
+int64 TimerWheel::NextTimeoutMs(int64 now_ms) const {
+  if ( size_ == 0 ) {
+    return -1;
+  }
+  const int64 now_tick = now_ms / tick_ms_;
+  const int64 start_tick = min(last_tick_, now_tick);
+  for ( int64 tick = start_tick; tick < start_tick + slots_.size(); ++tick ) {
+    const Link* const slot = &slots_[tick % slots_.size()];
+    int64 next_ms = -1;
+    for ( const Link* l = slot->next_; l != slot; l = l->next_ ) {
+      const int64 when_ms = static_cast<const Timer*>(l)->when_ms_;
+      // only timers in this turn of the wheel
+      if ( when_ms / tick_ms_ <= tick &&
+           (next_ms < 0 || when_ms < next_ms) ) {
+        next_ms = when_ms;
+      }
+    }
+    if ( next_ms >= 0 ) {
+      return max(next_ms - now_ms, static_cast<int64>(0));
+    }
+  }
+  return slots_.size() * tick_ms_;
+}
+}
@@ -0,0 +1,129 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#ifndef __NET_BASE_TIMER_WHEEL_H__
+#define __NET_BASE_TIMER_WHEEL_H__
+
+#include <vector>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/callback.h>
+
+namespace net {
+
+// A hashed timer wheel: coarse, allocation free timers for things that
+// re-arm all the time, in large numbers (e.g. pacing many connections),
+// where Selector::RegisterAlarm (a sorted set) would be too expensive.
+//
+// The timers are intrusive (you own the Timer, we just link it) and they
+// run at tick_ms granularity, never earlier then asked.
+//
+// -- NOT THREAD SAFE -- use it from one thread (each Selector has one,
+// for use from its select thread).
+class TimerWheel {
+ private:
+  struct Link {
+    Link() : prev_(this), next_(this) {}
+    Link* prev_;
+    Link* next_;
+  };
+ public:
+  class Timer : private Link {
+   public:
+    // callback: we don't take ownership. It must outlive the Timer.
+    explicit Timer(Closure* callback)
+        : callback_(callback), when_ms_(0), wheel_(NULL) {
+    }
+    ~Timer() {
+      Cancel();
+    }
+    bool is_scheduled() const { return wheel_ != NULL; }
+    // When the timer is (was) due
+    int64 when_ms() const { return when_ms_; }
+    void Cancel();
+
+   private:
+    Closure* const callback_;
+    int64 when_ms_;
+    TimerWheel* wheel_;
+
+    friend class TimerWheel;
+    DISALLOW_EVIL_CONSTRUCTORS(Timer);
+  };
+
+  // tick_ms: the granularity of the timers
+  // num_slots: the wheel size. Timers further then tick_ms * num_slots
+  //            are fine, they are just looked at each turn of the wheel.
+  TimerWheel(int64 tick_ms, int32 num_slots);
+  ~TimerWheel();
+
+  // (Re)Schedules timer to run at now_ms + delay_ms.
+  void Schedule(Timer* timer, int64 now_ms, int64 delay_ms);
+  // Same as timer->Cancel()
+  void Cancel(Timer* timer);
+
+  // Runs the timers that are due at now_ms. Returns how many.
+  int Advance(int64 now_ms);
+
+  // Returns how long (ms) we can sleep w/o missing a timer,
+  // or -1 if no timer is scheduled.
+  int64 NextTimeoutMs(int64 now_ms) const;
+
+  int32 size() const { return size_; }
+  int64 tick_ms() const { return tick_ms_; }
+
+ private:
+  static void Unlink(Link* l) {
+    l->prev_->next_ = l->next_;
+    l->next_->prev_ = l->prev_;
+    l->prev_ = l->next_ = l;
+  }
+  static void Append(Link* head, Link* l) {
+    l->prev_ = head->prev_;
+    l->next_ = head;
+    head->prev_->next_ = l;
+    head->prev_ = l;
+  }
+  Link* Slot(int64 tick) {
+    return &slots_[tick % slots_.size()];
+  }
+
+  const int64 tick_ms_;
+  // Circular lists (w/ the heads here) of timers in each slot
+  vector<Link> slots_;
+  // The tick we last advanced to (we look at it again the next time)
+  int64 last_tick_;
+  int32 size_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TimerWheel);
+};
+}
+
+#endif  // __NET_BASE_TIMER_WHEEL_H__
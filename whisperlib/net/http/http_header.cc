@@ -31,6 +31,7 @@
 
 #include <time.h>
 #include "net/http/http_header.h"
+#include "net/http/http_header_scanner.h"
 #include "common/io/buffer/memory_stream.h"
 #include "common/base/errno.h"
 #include "common/base/strutil.h"
@@ -271,6 +272,68 @@ bool Header::ParseHeader(io::MemoryStream* io,
   return ReadHeaderFields(io);
 }
 
+bool Header::ParseFromScanner(const HeaderScanner& scanner,
+                              FirstLineType expected_first_line) {
+  CHECK_EQ(scanner.result(), HeaderScanner::SCAN_DONE);
+  CHECK_EQ(bytes_parsed_, 0);
+  bytes_parsed_ = scanner.header_size();
+  ParseFirstLine(scanner.first_line().ToString(), expected_first_line);
+
+  bool last_field_ok = true;
+  for ( int32 i = 0; i < scanner.num_fields(); ++i ) {
+    const HeaderScanner::Field& field = scanner.field(i);
+    if ( !field.is_folded_ ) {
+      if ( field.known_ >= 0 ) {
+        // no need to validate or normalize the name
+        last_field_ok = AddParsedNormalizedField(
+            HeaderScanner::KnownFieldName(
+                static_cast<HeaderScanner::KnownField>(field.known_)),
+            field.value_.data_, field.value_.size_);
+      } else {
+        last_field_ok = AddParsedField(field.name_.data_, field.name_.size_,
+                                       field.value_.data_,
+                                       field.value_.size_);
+      }
+      continue;
+    }
+    // Unfold the value - same as ReadHeaderFields: each continuation line
+    // is appended w/ a space, w/o its leading LWF
+    crt_parsing_field_content_.clear();
+    const char* p = field.value_.data_;
+    const char* const end = field.value_.data_ + field.value_.size_;
+    while ( p < end ) {
+      const char* lf = reinterpret_cast<const char*>(memchr(p, '\n', end - p));
+      if ( lf == NULL ) {
+        lf = end;
+      }
+      const char* line_end = lf;
+      while ( line_end > p && *(line_end - 1) == '\r' ) {
+        --line_end;
+      }
+      crt_parsing_field_content_.append(p, line_end - p);
+      if ( lf == end ) {
+        break;
+      }
+      crt_parsing_field_content_.append(" ");
+      p = lf + 1;
+      while ( p < end && IsLwfChar(*p) ) {
+        ++p;
+      }
+    }
+    last_field_ok = AddParsedField(field.name_.data_, field.name_.size_,
+                                   crt_parsing_field_content_.data(),
+                                   crt_parsing_field_content_.size());
+    crt_parsing_field_content_.clear();
+  }
+  if ( scanner.num_bad_lines() > 0 ) {
+    set_parse_error(READ_NO_FIELD);
+  }
+  if ( last_field_ok ) {
+    set_parse_error(READ_OK);
+  }
+  return last_parse_error_ == READ_OK;
+}
+
 //////////////////////////////////////////////////////////////////////
 //
 // Parsing for the first line
@@ -287,7 +350,12 @@ bool Header::ReadFirstLine(io::MemoryStream* io,
                                        min(static_cast<size_t>(line.size()),
                                            static_cast<size_t>(0x100U))) << "]";
   bytes_parsed_ += line.size(); // without CRLF
+  ParseFirstLine(line, expected_first_line);
+  return true;
+}
 
+void Header::ParseFirstLine(const string& line,
+                            FirstLineType expected_first_line) {
   // We have three ' ' separated tokens. The meaning of each depend
   // on the type of line (status vs. request)
 
@@ -310,7 +378,7 @@ bool Header::ReadFirstLine(io::MemoryStream* io,
       set_parse_error(READ_NO_STATUS_CODE);
       http_version_ = GetHttpVersion(line.c_str());
     }
-    return true;  // we can parse more
+    return;  // we can parse more
   }
   // Got a good first token !
   if ( expected_first_line == REQUEST_LINE ) {
@@ -345,7 +413,7 @@ bool Header::ReadFirstLine(io::MemoryStream* io,
       }
       ParseStatusCode(line.substr(method_pos));
     }
-    return true;  // we can parse more
+    return;  // we can parse more
   }
 
   // Got the second token !!
@@ -372,8 +440,6 @@ bool Header::ReadFirstLine(io::MemoryStream* io,
   }
   // We met our expectation !
   first_line_type_ = expected_first_line;
-
-  return true;
 }
 
 void Header::ParseStatusCode(const string& status_code_str) {
@@ -390,29 +456,61 @@ void Header::ParseStatusCode(const string& status_code_str) {
 bool Header::AddCrtParsingData() {
   bool ret = true;
   if ( !crt_parsing_field_name_.empty() ) {
-    if ( !IsValidFieldName(crt_parsing_field_name_) ||
-         !IsValidFieldContent(crt_parsing_field_content_) ) {
-      set_parse_error(READ_BAD_FIELD_SPEC);
-      ret = false;
-    }
-    if ( !is_strict_ || ret ) {
-      string normalized_name(
-        NormalizeFieldName(crt_parsing_field_name_));
-      const FieldMap::iterator it = fields_.find(normalized_name);
-      if ( it == fields_.end() ) {
-        fields_.insert(make_pair(normalized_name,
-                                 crt_parsing_field_content_));
-      } else {
-        it->second.append(", ");
-        it->second.append(crt_parsing_field_content_);
-      }
-    }
+    ret = AddParsedField(crt_parsing_field_name_.data(),
+                         crt_parsing_field_name_.size(),
+                         crt_parsing_field_content_.data(),
+                         crt_parsing_field_content_.size());
   }
   crt_parsing_field_name_.clear();
   crt_parsing_field_content_.clear();
   return ret;
 }
 
+bool Header::AddParsedField(const char* field_name, int32 field_name_len,
+                            const char* field_content,
+                            int32 field_content_len) {
+  bool ret = true;
+  if ( !IsValidFieldName(field_name, field_name_len) ||
+       !IsValidFieldContent(field_content, field_content_len) ) {
+    set_parse_error(READ_BAD_FIELD_SPEC);
+    ret = false;
+  }
+  if ( !is_strict_ || ret ) {
+    string normalized_name(NormalizeFieldName(field_name, field_name_len));
+    const FieldMap::iterator it = fields_.find(normalized_name);
+    if ( it == fields_.end() ) {
+      fields_.insert(make_pair(normalized_name,
+                               string(field_content, field_content_len)));
+    } else {
+      it->second.append(", ");
+      it->second.append(field_content, field_content_len);
+    }
+  }
+  return ret;
+}
+
+bool Header::AddParsedNormalizedField(const char* normalized_name,
+                                      const char* field_content,
+                                      int32 field_content_len) {
+  bool ret = true;
+  if ( !IsValidFieldContent(field_content, field_content_len) ) {
+    set_parse_error(READ_BAD_FIELD_SPEC);
+    ret = false;
+  }
+  if ( !is_strict_ || ret ) {
+    const string name(normalized_name);
+    const FieldMap::iterator it = fields_.lower_bound(name);
+    if ( it == fields_.end() || it->first != name ) {
+      fields_.insert(it, make_pair(name,
+                                   string(field_content, field_content_len)));
+    } else {
+      it->second.append(", ");
+      it->second.append(field_content, field_content_len);
+    }
+  }
+  return ret;
+}
+
 bool Header::ReadHeaderFields(io::MemoryStream* io) {
   string line;
   while ( io->ReadLine(&line) ) {
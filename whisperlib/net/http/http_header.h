@@ -72,6 +72,8 @@
 namespace io { class MemoryStream; }
 
 namespace http {
+class HeaderScanner;
+
 class Header {
  public:
   explicit Header(bool is_strict = true);
@@ -266,6 +268,14 @@ class Header {
     return ParseHeader(io, STATUS_LINE);
   }
 
+  // Parses the header from a scanner that finished successfully
+  // (i.e. returned SCAN_DONE). Call this from a Clear state, before
+  // consuming the scanned data from the input stream (the scanner points
+  // in there). The expected first line type is as in ParseHeader.
+  // Returns true if we ended in a READ_OK state.
+  bool ParseFromScanner(const HeaderScanner& scanner,
+                        FirstLineType expected_first_line);
+
   // Reads the next header fields. Returns true when we are at the end of
   // the headers. May set in the meantime parsing_error and saves a number
   // of encountered fields into the fields_ map. The read pointer in io
@@ -376,11 +386,22 @@ class Header {
   // Returns true if passed after the first line in io (the read pointer
   // in io will be set after that consumed first line)
   bool ReadFirstLine(io::MemoryStream* io, FirstLineType expected_first_line);
+  // Does the actual first line parsing for ReadFirstLine (line is w/o CRLF)
+  void ParseFirstLine(const string& line, FirstLineType expected_first_line);
   // Extracts a http status code (and saves it to status_code_) from the
   // given name. On error sets the parsing error
   void ParseStatusCode(const string& status_code_str);
   // Appends the current intermediate values as a field name.
   bool AddCrtParsingData();
+  // Adds a parsed field (name, content) to fields_ - sets the parse error
+  // and returns false on invalid data.
+  bool AddParsedField(const char* field_name, int32 field_name_len,
+                      const char* field_content, int32 field_content_len);
+  // Same, for a name that is already valid and normalized (a known field
+  // spotted by the HeaderScanner)
+  bool AddParsedNormalizedField(const char* normalized_name,
+                                const char* field_content,
+                                int32 field_content_len);
 
   // If this is on we refuse a bunch of field name/values. Else, we are more
   // permissive
@@ -0,0 +1,335 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Author: Catalin Popescu
+
+#include <string.h>
+#include "net/http/http_header_scanner.h"
+#include "common/io/buffer/memory_stream.h"
+
+namespace http {
+
+static const char* const kKnownFieldNames[] = {
+  kHeaderHost,
+  kHeaderConnection,
+  kHeaderContentLength,
+  kHeaderContentType,
+  kHeaderContentEncoding,
+  kHeaderTransferEncoding,
+  kHeaderAcceptEncoding,
+  kHeaderUserAgent,
+  kHeaderRange,
+  kHeaderCookie,
+  kHeaderAuthorization,
+  kHeaderCacheControl,
+  kHeaderIfNoneMatch,
+  kHeaderIfModifiedSince,
+  kHeaderReferer,
+};
+static const int32 kKnownFieldSizes[] = {
+  sizeof(kHeaderHost) - 1,
+  sizeof(kHeaderConnection) - 1,
+  sizeof(kHeaderContentLength) - 1,
+  sizeof(kHeaderContentType) - 1,
+  sizeof(kHeaderContentEncoding) - 1,
+  sizeof(kHeaderTransferEncoding) - 1,
+  sizeof(kHeaderAcceptEncoding) - 1,
+  sizeof(kHeaderUserAgent) - 1,
+  sizeof(kHeaderRange) - 1,
+  sizeof(kHeaderCookie) - 1,
+  sizeof(kHeaderAuthorization) - 1,
+  sizeof(kHeaderCacheControl) - 1,
+  sizeof(kHeaderIfNoneMatch) - 1,
+  sizeof(kHeaderIfModifiedSince) - 1,
+  sizeof(kHeaderReferer) - 1,
+};
+
+const char* HeaderScanner::KnownFieldName(KnownField field) {
+  if ( field < 0 || field >= NUM_KNOWN_FIELDS ) {
+    return "UNKNOWN";
+  }
+  return kKnownFieldNames[field];
+}
+
+const char* HeaderScanner::ScanResultName(ScanResult result) {
+  switch ( result ) {
+    CONSIDER(SCAN_MORE_DATA);
+    CONSIDER(SCAN_DONE);
+    CONSIDER(SCAN_TOO_LONG);
+    CONSIDER(SCAN_TOO_MANY_FIELDS);
+  }
+  return "UNKNOWN";
+}
+
+HeaderScanner::HeaderScanner(int32 max_header_size)
+  : max_header_size_(max_header_size) {
+  Clear();
+}
+
+HeaderScanner::~HeaderScanner() {
+}
+
+void HeaderScanner::Clear() {
+  result_ = SCAN_MORE_DATA;
+  scanned_ = 0;
+  line_size_ = 0;
+  line_first_char_ = '\0';
+  num_lines_ = 0;
+  header_size_ = 0;
+  header_begin_ = NULL;
+  // NOTE: linear_ keeps its capacity, so it is allocated only once
+  linear_.clear();
+  first_line_ = View();
+  for ( int32 i = 0; i < NUMBEROF(first_line_tokens_); ++i ) {
+    first_line_tokens_[i] = View();
+  }
+  num_first_line_tokens_ = 0;
+  num_fields_ = 0;
+  num_bad_lines_ = 0;
+  for ( int32 i = 0; i < NUM_KNOWN_FIELDS; ++i ) {
+    known_[i] = -1;
+  }
+}
+
+bool HeaderScanner::ScanSpan(const char* data, int32 size) {
+  const char* p = data;
+  const char* const end = data + size;
+  while ( p < end ) {
+    if ( line_size_ == 0 ) {
+      line_first_char_ = *p;
+    }
+    const char* const lf = reinterpret_cast<const char*>(
+        memchr(p, '\n', end - p));
+    if ( lf == NULL ) {
+      line_size_ += end - p;
+      scanned_ += end - p;
+      return false;
+    }
+    line_size_ += lf - p;
+    scanned_ += lf - p + 1;
+    p = lf + 1;
+    // An empty line (w/ or w/o CR) terminates the header - except for
+    // the first line, that we leave to the header parser to judge.
+    const bool is_empty_line = (line_size_ == 0 ||
+                                (line_size_ == 1 && line_first_char_ == '\r'));
+    line_size_ = 0;
+    ++num_lines_;
+    if ( is_empty_line && num_lines_ > 1 ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+HeaderScanner::ScanResult HeaderScanner::Scan(const io::MemoryStream& in) {
+  CHECK_EQ(result_, SCAN_MORE_DATA) << " Clear() the scanner first";
+  if ( in.Size() <= static_cast<uint32>(scanned_) ) {
+    return result_;
+  }
+  io::DataBlockPointer ptr(in.GetReadPointer());
+  if ( scanned_ > 0 ) {
+    ptr.Advance(scanned_);
+  }
+  bool found = false;
+  const char* data = NULL;
+  int32 size = 0;
+  while ( !found && scanned_ <= max_header_size_ &&
+          ptr.ReadBlock(&data, &size) ) {
+    found = ScanSpan(data, size);
+    size = 0;
+  }
+  if ( !found ) {
+    if ( scanned_ > max_header_size_ ) {
+      result_ = SCAN_TOO_LONG;
+    }
+    return result_;
+  }
+  header_size_ = scanned_;
+  if ( header_size_ > max_header_size_ ) {
+    result_ = SCAN_TOO_LONG;
+    return result_;
+  }
+  // Split in place if the header is all in the first block, else
+  // make a linear copy
+  io::DataBlockPointer begin(in.GetReadPointer());
+  size = 0;
+  CHECK(begin.ReadBlock(&data, &size));
+  if ( size >= header_size_ ) {
+    header_begin_ = data;
+  } else {
+    linear_.resize(header_size_);
+    CHECK_EQ(in.Peek(&linear_[0], header_size_), header_size_);
+    header_begin_ = linear_.data();
+  }
+  result_ = Split();
+  return result_;
+}
+
+HeaderScanner::ScanResult HeaderScanner::ScanBuffer(const char* buffer,
+                                                    int32 size) {
+  CHECK_EQ(result_, SCAN_MORE_DATA) << " Clear() the scanner first";
+  if ( !ScanSpan(buffer, min(size, max_header_size_)) ) {
+    if ( scanned_ >= max_header_size_ ) {
+      result_ = SCAN_TOO_LONG;
+    }
+    return result_;
+  }
+  header_size_ = scanned_;
+  header_begin_ = buffer;
+  result_ = Split();
+  return result_;
+}
+
+HeaderScanner::ScanResult HeaderScanner::Split() {
+  const char* p = header_begin_;
+  const char* const end = header_begin_ + header_size_;
+  // The field that continuation lines would continue
+  int32 crt_field = -1;
+  bool is_first_line = true;
+  while ( p < end ) {
+    const char* const lf = reinterpret_cast<const char*>(
+        memchr(p, '\n', end - p));
+    DCHECK(lf != NULL);
+    const char* line_end = lf;
+    while ( line_end > p && *(line_end - 1) == '\r' ) {
+      --line_end;
+    }
+    if ( is_first_line ) {
+      is_first_line = false;
+      first_line_.data_ = p;
+      first_line_.size_ = line_end - p;
+      SplitFirstLine();
+    } else if ( line_end == p ) {
+      // The final empty line
+      break;
+    } else if ( IsLwfChar(*p) ) {
+      // Continuation line
+      if ( crt_field < 0 ) {
+        ++num_bad_lines_;
+      } else {
+        Field* const f = &fields_[crt_field];
+        f->value_.size_ = line_end - f->value_.data_;
+        f->is_folded_ = true;
+      }
+    } else {
+      const char* const colon = reinterpret_cast<const char*>(
+          memchr(p, ':', line_end - p));
+      if ( colon == NULL ) {
+        ++num_bad_lines_;
+        crt_field = -1;
+      } else {
+        if ( num_fields_ >= kMaxFields ) {
+          return SCAN_TOO_MANY_FIELDS;
+        }
+        Field* const f = &fields_[num_fields_];
+        f->name_.data_ = p;
+        f->name_.size_ = colon - p;
+        const char* value = colon + 1;
+        while ( value < line_end && IsLwfChar(*value) ) {
+          ++value;
+        }
+        f->value_.data_ = value;
+        f->value_.size_ = line_end - value;
+        f->is_folded_ = false;
+        IndexField(num_fields_);
+        crt_field = num_fields_++;
+      }
+    }
+    p = lf + 1;
+  }
+  return SCAN_DONE;
+}
+
+void HeaderScanner::SplitFirstLine() {
+  const char* p = first_line_.data_;
+  const char* const end = first_line_.data_ + first_line_.size_;
+  num_first_line_tokens_ = 0;
+  while ( p < end && num_first_line_tokens_ < NUMBEROF(first_line_tokens_) ) {
+    View* const token = &first_line_tokens_[num_first_line_tokens_++];
+    token->data_ = p;
+    if ( num_first_line_tokens_ == NUMBEROF(first_line_tokens_) ) {
+      // The last token (the reason in replies) takes the rest of the line
+      token->size_ = end - p;
+      break;
+    }
+    const char* const space = reinterpret_cast<const char*>(
+        memchr(p, ' ', end - p));
+    if ( space == NULL ) {
+      token->size_ = end - p;
+      break;
+    }
+    token->size_ = space - p;
+    p = space;
+    while ( p < end && *p == ' ' ) {
+      ++p;
+    }
+  }
+}
+
+// Returns the name size, w/o trailing white spaces
+static inline int32 TrimmedNameSize(const HeaderScanner::View& name) {
+  int32 size = name.size_;
+  while ( size > 0 && IsLwfChar(name.data_[size - 1]) ) {
+    --size;
+  }
+  return size;
+}
+
+void HeaderScanner::IndexField(int32 index) {
+  Field* const field = &fields_[index];
+  const View& name = field->name_;
+  const int32 size = TrimmedNameSize(name);
+  field->known_ = -1;
+  for ( int32 i = 0; i < NUM_KNOWN_FIELDS; ++i ) {
+    if ( kKnownFieldSizes[i] == size &&
+         strncasecmp(kKnownFieldNames[i], name.data_, size) == 0 ) {
+      if ( known_[i] < 0 ) {
+        known_[i] = index;
+      }
+      if ( size == name.size_ ) {
+        field->known_ = i;
+      }
+      return;
+    }
+  }
+}
+
+const HeaderScanner::Field* HeaderScanner::FindField(const char* name,
+                                                     int32 len) const {
+  for ( int32 i = 0; i < num_fields_; ++i ) {
+    const View& crt = fields_[i].name_;
+    if ( TrimmedNameSize(crt) == len &&
+         strncasecmp(crt.data_, name, len) == 0 ) {
+      return &fields_[i];
+    }
+  }
+  return NULL;
+}
+}
@@ -0,0 +1,210 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Author: Catalin Popescu
+//
+
+#ifndef __NET_HTTP_HTTP_HEADER_SCANNER_H__
+#define __NET_HTTP_HTTP_HEADER_SCANNER_H__
+
+#include <string>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/net/http/http_consts.h>
+
+namespace io { class MemoryStream; }
+
+namespace http {
+
+// A resumable, allocation free scanner for HTTP message headers.
+//
+// Scan() is called repeatedly on the connection input buffer (without
+// consuming it) as data arrives. It remembers how far it got, so every
+// byte is looked at only once, and it searches for line ends (and ':'
+// separators) with memchr, which is vectorized in any decent libc.
+//
+// Once the terminating empty line is found the header is split in place:
+// the first line, the field names and values are exposed as views
+// (pointer + length) into the input buffer. If the header straddles
+// several data blocks we copy it once in an internal buffer that is
+// reused from request to request.
+//
+// IMPORTANT: the views are valid only until the input stream is modified
+//            (normally the caller consumes header_size() bytes after
+//             being done with the scanner), or until Clear().
+//
+// The most commonly used fields are indexed in a fixed table, so looking
+// them up costs nothing.
+//
+class HeaderScanner {
+ public:
+  // Maximum number of fields that we index. Headers with more fields
+  // are reported as SCAN_TOO_MANY_FIELDS (and should be parsed
+  // by the slower http::Header parsing).
+  static const int32 kMaxFields = 64;
+
+  // The fields that we index upon parsing
+  enum KnownField {
+    FIELD_HOST = 0,
+    FIELD_CONNECTION,
+    FIELD_CONTENT_LENGTH,
+    FIELD_CONTENT_TYPE,
+    FIELD_CONTENT_ENCODING,
+    FIELD_TRANSFER_ENCODING,
+    FIELD_ACCEPT_ENCODING,
+    FIELD_USER_AGENT,
+    FIELD_RANGE,
+    FIELD_COOKIE,
+    FIELD_AUTHORIZATION,
+    FIELD_CACHE_CONTROL,
+    FIELD_IF_NONE_MATCH,
+    FIELD_IF_MODIFIED_SINCE,
+    FIELD_REFERER,
+    NUM_KNOWN_FIELDS,
+  };
+  static const char* KnownFieldName(KnownField field);
+
+  enum ScanResult {
+    SCAN_MORE_DATA = 0,       // the end of the header was not found yet
+    SCAN_DONE,                // header scanned and split OK
+    SCAN_TOO_LONG,            // header longer than the max allowed size
+    SCAN_TOO_MANY_FIELDS,     // too many fields for our table
+  };
+  static const char* ScanResultName(ScanResult result);
+
+  // A piece of the scanned data
+  struct View {
+    const char* data_;
+    int32 size_;
+    View() : data_(NULL), size_(0) { }
+    bool empty() const { return size_ == 0; }
+    string ToString() const { return string(data_, size_); }
+  };
+  struct Field {
+    View name_;
+    View value_;
+    // The value continues on multiple lines - the value view includes the
+    // CRLF and leading spaces of the continuation lines
+    bool is_folded_;
+    // The KnownField that the name spells exactly (no trailing spaces,
+    // any case), or -1
+    int8 known_;
+  };
+
+  explicit HeaderScanner(int32 max_header_size = 16384);
+  ~HeaderScanner();
+
+  // Prepares for scanning a new header
+  void Clear();
+
+  // Scans for the header end in 'in' starting from the read pointer.
+  // Can (and should) be called again with the same stream, with more data
+  // appended, while SCAN_MORE_DATA is returned. Once a result different
+  // from SCAN_MORE_DATA is returned, you need to Clear() before scanning
+  // another header.
+  ScanResult Scan(const io::MemoryStream& in);
+
+  // Splits a contiguous memory region that ends with an empty line.
+  // Same as Scan, but when you already have all data.
+  ScanResult ScanBuffer(const char* buffer, int32 size);
+
+  ScanResult result() const { return result_; }
+  // The full size of the header, including the last empty line
+  // (valid after SCAN_DONE)
+  int32 header_size() const { return header_size_; }
+  // How many bytes we looked at so far
+  int32 scanned_size() const { return scanned_; }
+
+  // First line access - the line itself and its (space separated) tokens.
+  // For requests the tokens are: method, uri and version, for replies:
+  // version, status code and reason.
+  const View& first_line() const { return first_line_; }
+  const View& first_line_token(int32 index) const {
+    return first_line_tokens_[index];
+  }
+  // The number of tokens that we found on the first line
+  int32 num_first_line_tokens() const { return num_first_line_tokens_; }
+
+  // Field access
+  int32 num_fields() const { return num_fields_; }
+  const Field& field(int32 index) const { return fields_[index]; }
+  // Lines in which we could not identify a field (no ':', or continuation
+  // lines with no previous field)
+  int32 num_bad_lines() const { return num_bad_lines_; }
+
+  // Returns the first occurrence of a known field, or NULL if not present
+  const Field* FindField(KnownField field) const {
+    return known_[field] < 0 ? NULL : &fields_[known_[field]];
+  }
+  // Returns the first field that matches (case insensitive) the given name
+  const Field* FindField(const char* name, int32 len) const;
+
+ private:
+  // Looks in the given span for the end of the header, continuing
+  // the line state from previous spans. Returns true when found.
+  bool ScanSpan(const char* data, int32 size);
+  // Splits the [header_begin_, header_begin_ + header_size_) region
+  // into views.
+  ScanResult Split();
+  // Splits the first line into space separated tokens
+  void SplitFirstLine();
+  // Records the (known) field with the given index.
+  void IndexField(int32 index);
+
+  const int32 max_header_size_;
+
+  // Scan state:
+  ScanResult result_;
+  int32 scanned_;             // bytes looked at so far
+  int32 line_size_;           // bytes in the current line (so far)
+  char line_first_char_;      // the first char in the current line
+  int32 num_lines_;           // lines terminated so far
+  int32 header_size_;         // the header size (when done)
+
+  // Where the header lives after the scan
+  const char* header_begin_;
+  // Linear copy of the header, if it straddles multiple blocks
+  string linear_;
+
+  // First line
+  View first_line_;
+  View first_line_tokens_[3];
+  int32 num_first_line_tokens_;
+
+  // The fields
+  Field fields_[kMaxFields];
+  int32 num_fields_;
+  int32 num_bad_lines_;
+  int8 known_[NUM_KNOWN_FIELDS];
+
+  DISALLOW_EVIL_CONSTRUCTORS(HeaderScanner);
+};
+}
+
+#endif  //  __NET_HTTP_HTTP_HEADER_SCANNER_H__
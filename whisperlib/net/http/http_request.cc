@@ -54,6 +54,7 @@ Request::Request(bool strict_headers,
     gzip_state_begin_(true),
     gzip_zwrapper_(NULL),
     server_use_gzip_encoding_(true),
+    server_data_encoded_(false),
     compress_option_(COMPRESS_NONE) {
 }
 
@@ -175,7 +176,10 @@ void Request::AppendServerReply(io::MemoryStream* out,
     server_header_.set_http_version(VERSION_1_0);
   }
   const bool zippable_content = server_header_.IsZippableContentType();
-  if ( server_use_gzip_encoding_ && zippable_content ) {
+  if ( server_data_encoded_ ) {
+    // Content-Encoding stays as set by whoever encoded the data
+    compress_option_ = COMPRESS_NONE;
+  } else if ( server_use_gzip_encoding_ && zippable_content ) {
     if ( client_header_.IsGzipAcceptableEncoding() ) {
       delete gzip_zwrapper_;
       gzip_zwrapper_ = new io::ZlibGzipEncodeWrapper();
@@ -373,6 +377,7 @@ RequestParser::RequestParser(
     worst_accepted_header_error_(worst_accepted_header_error),
     name_(name),
     dlog_level_(false),
+    header_scanner_(max_header_size),
     inflate_zwrapper_(NULL),
     gzip_zwrapper_(NULL) {
   Clear();
@@ -463,6 +468,7 @@ void RequestParser::Clear() {
   next_chunk_expectation_ = EXPECT_CHUNK_NONE;
   partial_data_.Clear();
   trail_header_.Clear();
+  header_scanner_.Clear();
   delete inflate_zwrapper_;
   inflate_zwrapper_ = NULL;
   delete gzip_zwrapper_;
@@ -487,27 +493,14 @@ int32 RequestParser::ParseClientRequest(io::MemoryStream* in, Request* req) {
   // Header reading for client
   //
   if ( parse_state_ == STATE_HEADER_READING ) {
-    if ( !req->client_header()->ParseHttpRequest(in) ) {
-      if ( in->Size() + req->client_header()->bytes_parsed() >
-           max_header_size_ ) {
-        // ERROR - header too big
-        LOG_HTTP_ERR << " Header too long. Got at least: "
-                     << in->Size() + req->client_header()->bytes_parsed()
-                     << " max: " << max_header_size_;
-        set_parse_state(ERROR_HEADER_TOO_LONG);
-        return REQUEST_FINISHED;
+    const int32 header_state = ReadHeaderInternal(in, req->client_header(),
+                                                  Header::REQUEST_LINE);
+    if ( header_state != HEADER_READ ) {
+      if ( header_state == 0 ) {
+        // Clear any error w/ the first line
+        req->server_header()->set_first_line_type(Header::REQUEST_LINE);
       }
-      // Clear any error w/ the first line
-      req->server_header()->set_first_line_type(Header::REQUEST_LINE);
-      // CONTINUE - with header parsing next call
-      return 0;
-    } else if ( req->client_header()->bytes_parsed() > max_header_size_ ) {
-      // ERROR - header too big
-      LOG_HTTP_ERR << " Header too long. Parsed: "
-                   << in->Size() + req->client_header()->bytes_parsed()
-                   << " max: " << max_header_size_;
-      set_parse_state(ERROR_HEADER_TOO_LONG);
-      return REQUEST_FINISHED;
+      return header_state;
     }
     // Header parsed at this point (w/ errors or not..)
     if ( (req->client_header()->http_version() == VERSION_UNKNOWN &&
@@ -555,27 +548,14 @@ int32 RequestParser::ParseServerReply(io::MemoryStream* in, Request* req) {
   // Header reading for server
   //
   if ( parse_state_ == STATE_HEADER_READING ) {
-    if ( !req->server_header()->ParseHttpReply(in) ) {
-      if ( in->Size() + req->server_header()->bytes_parsed() >
-           max_header_size_ ) {
-        // ERROR - header too big
-        LOG_HTTP_ERR << " Header too long. Got at least: "
-                     << in->Size() + req->server_header()->bytes_parsed()
-                     << " on max: " << max_header_size_;
-        set_parse_state(ERROR_HEADER_TOO_LONG);
-        return REQUEST_FINISHED;
+    const int32 header_state = ReadHeaderInternal(in, req->server_header(),
+                                                  Header::STATUS_LINE);
+    if ( header_state != HEADER_READ ) {
+      if ( header_state == 0 ) {
+        // Clear any error w/ the first line
+        req->server_header()->set_first_line_type(Header::STATUS_LINE);
       }
-      // Clear any error w/ the first line
-      req->server_header()->set_first_line_type(Header::STATUS_LINE);
-      // CONTINUE - with header parsing next call
-      return 0;
-    } else if ( req->server_header()->bytes_parsed() > max_header_size_ ) {
-      // ERROR - header too big
-      LOG_HTTP_ERR << " Header too long. Parsed: "
-                   << req->server_header()->bytes_parsed()
-                   << " on max: " << max_header_size_;
-      set_parse_state(ERROR_HEADER_TOO_LONG);
-      return REQUEST_FINISHED;
+      return header_state;
     }
     if ( req->server_header()->parse_error() > worst_accepted_header_error_ ) {
       // ERROR - unacceptable error in the header
@@ -601,6 +581,45 @@ int32 RequestParser::ParseServerReply(io::MemoryStream* in, Request* req) {
   return ParsePayloadInternal(in, req->server_header(), req->server_data());
 }
 
+//////////////////////////////////////////////////////////////////////
+//
+// ReadHeaderInternal - reads the message header
+//
+int32 RequestParser::ReadHeaderInternal(
+    io::MemoryStream* in, http::Header* header,
+    Header::FirstLineType expected_first_line) {
+  const HeaderScanner::ScanResult scan_result = header_scanner_.Scan(*in);
+  if ( scan_result == HeaderScanner::SCAN_MORE_DATA ) {
+    // CONTINUE - with header parsing next call
+    return 0;
+  }
+  if ( scan_result == HeaderScanner::SCAN_TOO_LONG ) {
+    // ERROR - header too big
+    LOG_HTTP_ERR << " Header too long. Got at least: "
+                 << header_scanner_.scanned_size()
+                 << " max: " << max_header_size_;
+    set_parse_state(ERROR_HEADER_TOO_LONG);
+    return REQUEST_FINISHED;
+  }
+  if ( scan_result == HeaderScanner::SCAN_DONE ) {
+    header->ParseFromScanner(header_scanner_, expected_first_line);
+    in->Skip(header_scanner_.header_size());
+    return HEADER_READ;
+  }
+  // Too many fields for the scanner - the whole header is in, so
+  // the regular parsing finishes it in one go.
+  const bool parsed = (expected_first_line == Header::REQUEST_LINE
+                       ? header->ParseHttpRequest(in)
+                       : header->ParseHttpReply(in));
+  if ( !parsed ) {
+    LOG_HTTP_ERR << " Header parsing failed after scanning: "
+                 << header->ParseErrorName();
+    set_parse_state(ERROR_HEADER_BAD);
+    return REQUEST_FINISHED;
+  }
+  return HEADER_READ;
+}
+
 //////////////////////////////////////////////////////////////////////
 //
 // ParsePayloadInternal - parses the message payload (body)
@@ -38,6 +38,7 @@
 #include <whisperlib/common/base/types.h>
 #include <whisperlib/net/http/http_consts.h>
 #include <whisperlib/net/http/http_header.h>
+#include <whisperlib/net/http/http_header_scanner.h>
 #include <whisperlib/common/io/buffer/memory_stream.h>
 #include <whisperlib/common/io/zlib/zlibwrapper.h>
 #include <whisperlib/net/url/url.h>
@@ -143,6 +144,15 @@ class Request {
   void set_server_use_gzip_encoding(bool use_gzip_encoding) {
     server_use_gzip_encoding_ = use_gzip_encoding;
   }
+  // When this is turned on, server_data_ is already encoded as declared
+  // by the Content-Encoding in the server_header_ (e.g. comes
+  // precompressed from a cache) and we send it as it is.
+  bool server_data_encoded() const {
+    return server_data_encoded_;
+  }
+  void set_server_data_encoded(bool server_data_encoded) {
+    server_data_encoded_ = server_data_encoded;
+  }
 
   // In these cases no body must be transmitted
   bool NoServerBodyTransmitted() {
@@ -185,6 +195,7 @@ class Request {
   io::ZlibGzipEncodeWrapper* gzip_zwrapper_;
 
   bool server_use_gzip_encoding_;
+  bool server_data_encoded_;
   enum CompressOption {
     COMPRESS_NONE,
     COMPRESS_GZIP,
@@ -385,6 +396,12 @@ class RequestParser {
   // Various parse helper functions
   //
 
+  // Reads the message header into the given header, by scanning it
+  // first in place. Returns 0 if more data is needed, HEADER_READ if
+  // the header was read (maybe w/ errors), or REQUEST_FINISHED on
+  // errors that prevent us to continue.
+  int32 ReadHeaderInternal(io::MemoryStream* in, http::Header* header,
+                           Header::FirstLineType expected_first_line);
   // Parses the payload of a message (body..)
   int32 ParsePayloadInternal(io::MemoryStream* in, http::Header* header,
                              io::MemoryStream* out);
@@ -432,6 +449,8 @@ class RequestParser {
                                     // (depends on gzip decompression state).
   io::MemoryStream partial_data_;   // intermediate data holder
   http::Header trail_header_;       // we parse the chunk trailing header here
+  http::HeaderScanner header_scanner_;
+                                    // scans the message header in place
 
   // Used for decompression:
   io::ZlibInflateWrapper* inflate_zwrapper_;
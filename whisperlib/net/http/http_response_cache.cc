@@ -0,0 +1,293 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+
+#include "net/http/http_response_cache.h"
+#include "common/base/strutil.h"
+#include "common/base/timer.h"
+#include "common/io/zlib/zlibwrapper.h"
+
+namespace http {
+
+namespace {
+// These describe the connection / the transfer of a particular reply,
+// and are set again by the server for each reply.
+const char* const kNonCacheableFields[] = {
+  kHeaderDate,
+  kHeaderServer,
+  kHeaderConnection,
+  kHeaderKeepAlive,
+  kHeaderContentLength,
+  kHeaderContentEncoding,
+  kHeaderTransferEncoding,
+  kHeaderETag,
+};
+bool IsCacheableField(const string& name) {
+  for ( int i = 0; i < NUMBEROF(kNonCacheableFields); ++i ) {
+    if ( strutil::StrCaseEqual(name, kNonCacheableFields[i]) ) {
+      return false;
+    }
+  }
+  return true;
+}
+// A strong validator for a body we got w/o one (64 bit FNV-1a)
+string ComputeETag(const string& body) {
+  uint64 h = 14695981039346656037ULL;
+  for ( int i = 0; i < body.size(); ++i ) {
+    h ^= static_cast<uint8>(body[i]);
+    h *= 1099511628211ULL;
+  }
+  return strutil::StringPrintf("\"%016" PRIx64 "-%x\"",
+                               h, static_cast<uint32>(body.size()));
+}
+}
+
+ResponseCache::ResponseCache(int64 max_size, int32 max_entry_size)
+    : max_size_(max_size),
+      max_entry_size_(max_entry_size),
+      size_(0),
+      num_hits_(0),
+      num_misses_(0) {
+}
+
+ResponseCache::~ResponseCache() {
+  Clear();
+}
+
+string ResponseCache::GetCacheKey(const http::Request* req) {
+  const http::Header* const hc = req->client_header();
+  if ( hc->method() != METHOD_GET ||
+       req->url() == NULL || !req->url()->is_valid() ||
+       hc->HasField(kHeaderAuthorization) ||
+       hc->HasField(kHeaderProxyAuthorization) ||
+       hc->HasField(kHeaderCookie) ) {
+    // the reply may depend on who asks - and the key would not show it
+    return "";
+  }
+  return req->url()->spec();
+}
+
+int64 ResponseCache::GetCacheMaxAge(const http::Header* hs) {
+  string cache_control;
+  if ( !hs->FindField(kHeaderCacheControl, &cache_control) ) {
+    return -1;
+  }
+  strutil::StrToLower(cache_control);
+  if ( cache_control.find("no-cache") != string::npos ||
+       cache_control.find("no-store") != string::npos ||
+       cache_control.find("private") != string::npos ) {
+    return -1;
+  }
+  const size_t pos = cache_control.find("max-age=");
+  if ( pos == string::npos ) {
+    return -1;
+  }
+  int64 max_age = 0;
+  for ( const char* p = cache_control.c_str() + pos + 8;
+        *p >= '0' && *p <= '9'; ++p ) {
+    max_age = max_age * 10 + (*p - '0');
+    if ( max_age > kMaxInt32 ) {
+      break;
+    }
+  }
+  return max_age > 0 ? max_age : -1;
+}
+
+const ResponseCache::Entry* ResponseCache::Lookup(const string& key) {
+  synch::MutexLocker l(&mutex_);
+  const EntryMap::iterator it = entries_.find(key);
+  if ( it == entries_.end() ) {
+    ++num_misses_;
+    return NULL;
+  }
+  const Entry* const entry = it->second.entry_;
+  if ( entry->expiration_ts() <= timer::TicksMsec() ) {
+    DelSlot(it);
+    ++num_misses_;
+    return NULL;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second.lru_it_);
+  ++num_hits_;
+  entry->IncRef();
+  return entry;
+}
+
+bool ResponseCache::MaybeAdd(const string& key, const http::Request* req,
+                             HttpReturnCode status) {
+  if ( key.empty() || status != OK ) {
+    return false;
+  }
+  const http::Header* const hs = req->server_header();
+  const int64 max_age = GetCacheMaxAge(hs);
+  if ( max_age <= 0 ||
+       req->server_data()->Size() > max_entry_size_ ||
+       hs->HasField(kHeaderSetCookie) ||
+       hs->IsChunkedTransfer() ) {
+    return false;
+  }
+  string vary;
+  if ( hs->FindField(kHeaderVary, &vary) &&
+       !strutil::StrCaseEqual(strutil::StrTrim(vary), kHeaderAcceptEncoding) ) {
+    return false;
+  }
+
+  Entry* const entry = new Entry();
+  entry->status_ = status;
+  for ( Header::FieldMap::const_iterator it = hs->fields().begin();
+        it != hs->fields().end(); ++it ) {
+    if ( IsCacheableField(it->first) ) {
+      entry->fields_.push_back(*it);
+    }
+  }
+  req->server_data()->PeekString(&entry->body_);
+  if ( !hs->FindField(Header::NormalizeFieldName(kHeaderETag),
+                      &entry->etag_) ) {
+    entry->etag_ = ComputeETag(entry->body_);
+  }
+  if ( req->server_use_gzip_encoding() && hs->IsZippableContentType() ) {
+    io::MemoryStream in, out;
+    in.Write(entry->body_);
+    io::ZlibGzipEncodeWrapper().Encode(&in, &out);
+    if ( out.Size() < entry->body_.size() ) {
+      out.ReadString(&entry->gzip_body_);
+    }
+  }
+  entry->expiration_ts_ = timer::TicksMsec() + max_age * 1000;
+  entry->IncRef();
+
+  synch::MutexLocker l(&mutex_);
+  const EntryMap::iterator it = entries_.find(key);
+  if ( it != entries_.end() ) {
+    DelSlot(it);
+  }
+  if ( entry->size() > max_size_ ) {
+    entry->DecRef();
+    return false;
+  }
+  MakeRoom(entry->size());
+  lru_.push_front(key);
+  Slot& slot = entries_[key];
+  slot.entry_ = entry;
+  slot.lru_it_ = lru_.begin();
+  size_ += entry->size();
+  return true;
+}
+
+HttpReturnCode ResponseCache::PrepareReply(const Entry* entry,
+                                           http::Request* req) {
+  http::Header* const hs = req->server_header();
+  for ( int i = 0; i < entry->fields().size(); ++i ) {
+    hs->AddField(entry->fields()[i].first, entry->fields()[i].second, true);
+  }
+  hs->AddField(kHeaderETag, entry->etag(), true);
+  if ( !entry->gzip_body().empty() ) {
+    hs->AddField(kHeaderVary, kHeaderAcceptEncoding, true);
+  }
+
+  string if_none_match;
+  if ( req->client_header()->FindField(kHeaderIfNoneMatch, &if_none_match) &&
+       (if_none_match.find(entry->etag()) != string::npos ||
+        strutil::StrTrim(if_none_match) == "*") ) {
+    return NOT_MODIFIED;
+  }
+  if ( !entry->gzip_body().empty() &&
+       req->server_use_gzip_encoding() &&
+       req->client_header()->IsGzipAcceptableEncoding() ) {
+    hs->SetContentEncoding("gzip");
+    req->server_data()->Write(entry->gzip_body());
+  } else {
+    hs->SetContentEncoding(NULL);
+    req->server_data()->Write(entry->body());
+  }
+  req->set_server_data_encoded(true);
+  return entry->status();
+}
+
+void ResponseCache::Erase(const string& key) {
+  synch::MutexLocker l(&mutex_);
+  const EntryMap::iterator it = entries_.find(key);
+  if ( it != entries_.end() ) {
+    DelSlot(it);
+  }
+}
+
+void ResponseCache::Clear() {
+  synch::MutexLocker l(&mutex_);
+  for ( EntryMap::const_iterator it = entries_.begin();
+        it != entries_.end(); ++it ) {
+    it->second.entry_->DecRef();
+  }
+  entries_.clear();
+  lru_.clear();
+  size_ = 0;
+}
+
+int64 ResponseCache::size() const {
+  synch::MutexLocker l(&mutex_);
+  return size_;
+}
+int32 ResponseCache::num_entries() const {
+  synch::MutexLocker l(&mutex_);
+  return entries_.size();
+}
+int64 ResponseCache::num_hits() const {
+  synch::MutexLocker l(&mutex_);
+  return num_hits_;
+}
+int64 ResponseCache::num_misses() const {
+  synch::MutexLocker l(&mutex_);
+  return num_misses_;
+}
+
+string ResponseCache::ToString() const {
+  synch::MutexLocker l(&mutex_);
+  return strutil::StringPrintf(
+      "ResponseCache{entries: %d, size: %" PRId64 "/%" PRId64 ", "
+      "hits: %" PRId64 ", misses: %" PRId64 "}",
+      static_cast<int>(entries_.size()), size_, max_size_,
+      num_hits_, num_misses_);
+}
+
+void ResponseCache::DelSlot(EntryMap::iterator it) {
+  size_ -= it->second.entry_->size();
+  lru_.erase(it->second.lru_it_);
+  it->second.entry_->DecRef();
+  entries_.erase(it);
+}
+
+void ResponseCache::MakeRoom(int64 size) {
+  while ( !lru_.empty() && size_ + size > max_size_ ) {
+    const EntryMap::iterator it = entries_.find(lru_.back());
+    CHECK(it != entries_.end());
+    DelSlot(it);
+  }
+}
+}
@@ -0,0 +1,169 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+
+#ifndef __NET_HTTP_HTTP_RESPONSE_CACHE_H__
+#define __NET_HTTP_HTTP_RESPONSE_CACHE_H__
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/ref_counted.h>
+#include <whisperlib/common/sync/mutex.h>
+#include <whisperlib/net/http/http_request.h>
+
+namespace http {
+
+// A cache of complete replies, used by http::Server to answer repeated
+// GETs for small static pages without calling the processor again
+// (and without compressing the body again).
+//
+// A reply gets in the cache only if the processor opted in by setting
+// an explicit "Cache-Control: max-age=<seconds>" (w/o no-cache, no-store
+// or private), the status is 200, it sets no cookies, it does not vary
+// on anything but Accept-Encoding and the body is small enough.
+// Requests carrying credentials or session state (Authorization,
+// Proxy-Authorization, Cookie) are never served from (nor stored in)
+// the cache, as the key is only the URL.
+//
+// For each entry we keep the identity body and, for zippable content
+// types, a gzip encoded variant computed once at insertion time. We also
+// keep (or generate) an ETag and answer conditional GETs w/ a 304.
+//
+// The entries are evicted when they expire (per their max-age) or, in
+// LRU order, when the total size goes over the limit.
+//
+// Thread safe - all the public members are synchronized.
+class ResponseCache {
+ public:
+  class Entry : public RefCounted {
+   public:
+    Entry() : status_(UNKNOWN), expiration_ts_(0) {}
+
+    // The status and the end to end header fields of the reply
+    HttpReturnCode status() const { return status_; }
+    const vector< pair<string, string> >& fields() const { return fields_; }
+    // The reply body, as produced by the processor
+    const string& body() const { return body_; }
+    // The gzip encoded body (empty if not zippable or not worth it)
+    const string& gzip_body() const { return gzip_body_; }
+    // Our ETag (quoted)
+    const string& etag() const { return etag_; }
+    // When this expires (ms by CLOCK_MONOTONIC)
+    int64 expiration_ts() const { return expiration_ts_; }
+
+    int64 size() const {
+      return body_.size() + gzip_body_.size() + etag_.size();
+    }
+
+   private:
+    HttpReturnCode status_;
+    vector< pair<string, string> > fields_;
+    string body_;
+    string gzip_body_;
+    string etag_;
+    int64 expiration_ts_;
+
+    friend class ResponseCache;
+    DISALLOW_EVIL_CONSTRUCTORS(Entry);
+  };
+
+  // max_size: the maximum total size (bytes) of the cached bodies.
+  // max_entry_size: we do not cache replies w/ bodies larger then this.
+  ResponseCache(int64 max_size, int32 max_entry_size);
+  ~ResponseCache();
+
+  // Returns the key under which a reply for the given request would be
+  // cached - or an empty string if the request should bypass the cache.
+  static string GetCacheKey(const http::Request* req);
+
+  // Looks up a fresh entry for the given key. If found, it returns it
+  // with a reference taken on behalf of the caller (DecRef() it
+  // when done). Returns NULL if not found.
+  const Entry* Lookup(const string& key);
+
+  // Examines the server side of the given request (a reply w/ the
+  // given status, prepared by the processor) and, if cacheable, stores
+  // a copy under the given key. The request is not modified.
+  // Returns true if the reply was cached.
+  bool MaybeAdd(const string& key, const http::Request* req,
+                HttpReturnCode status);
+
+  // Prepares the server side of req (header and data) to reply w/ the
+  // given cached entry. Returns the status to reply with (may be
+  // NOT_MODIFIED for a matching conditional request).
+  static HttpReturnCode PrepareReply(const Entry* entry, http::Request* req);
+
+  // Removes the entry for the given key (if any).
+  void Erase(const string& key);
+  // Removes all entries.
+  void Clear();
+
+  int64 size() const;
+  int32 num_entries() const;
+  int64 num_hits() const;
+  int64 num_misses() const;
+
+  string ToString() const;
+
+ private:
+  struct Slot {
+    const Entry* entry_;
+    list<string>::iterator lru_it_;
+  };
+  typedef map<string, Slot> EntryMap;
+
+  // Returns the max-age (seconds) the reply in hs can be cached for,
+  // or -1 if it cannot be cached.
+  static int64 GetCacheMaxAge(const http::Header* hs);
+
+  // These expect mutex_ to be held:
+  void DelSlot(EntryMap::iterator it);
+  void MakeRoom(int64 size);
+
+  const int64 max_size_;
+  const int32 max_entry_size_;
+
+  mutable synch::Mutex mutex_;
+  EntryMap entries_;
+  // Keys in use order (front is the most recently used).
+  list<string> lru_;
+  int64 size_;
+  int64 num_hits_;
+  int64 num_misses_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ResponseCache);
+};
+}
+
+#endif  // __NET_HTTP_HTTP_RESPONSE_CACHE_H__
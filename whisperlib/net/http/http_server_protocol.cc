@@ -55,7 +55,9 @@ ServerParams::ServerParams()
       max_reply_buffer_size_(1 << 20),
       reply_full_buffer_policy_(ServerParams::POLICY_CLOSE),
       default_content_type_("text/html; charset=UTF-8"),
-      ignore_different_http_hosts_(true) {
+      ignore_different_http_hosts_(true),
+      response_cache_size_(0),
+      response_cache_max_entry_size_(1 << 16) {
 }
 
 ServerParams::ServerParams(
@@ -97,7 +99,9 @@ ServerParams::ServerParams(
       max_reply_buffer_size_(max_reply_buffer_size),
       reply_full_buffer_policy_(reply_full_buffer_policy),
       default_content_type_(default_content_type),
-      ignore_different_http_hosts_(ignore_different_http_hosts) {
+      ignore_different_http_hosts_(ignore_different_http_hosts),
+      response_cache_size_(0),
+      response_cache_max_entry_size_(1 << 16) {
 }
 
 
@@ -118,6 +122,13 @@ ServerAcceptor::ServerAcceptor(net::Selector* selector,
       this, &ServerAcceptor::AcceptorFilterHandler), true);
   acceptor_->SetAcceptHandler(NewPermanentCallback(
       this, &ServerAcceptor::AcceptorAcceptHandler), true);
+  // What the refused clients get, instead of a plain close
+  acceptor_->set_refuse_reply(
+      "HTTP/1.1 503 Service Unavailable\r\n"
+      "Content-Length: 0\r\n"
+      "Connection: close\r\n"
+      "Retry-After: 5\r\n"
+      "\r\n");
 }
 
 ServerAcceptor::~ServerAcceptor() {
@@ -133,7 +144,7 @@ void ServerAcceptor::Close() {
 }
 
 bool ServerAcceptor::AcceptorFilterHandler(const net::HostPort& peer_address) {
-  LOG_INFO << acceptor_->PrefixInfo()
+  LOG_DEBUG << acceptor_->PrefixInfo()
            << "Filtering an accept from: " << peer_address
            << " with: " << server_->num_connections() << " active connections"
            << " and a max of: "
@@ -143,6 +154,10 @@ bool ServerAcceptor::AcceptorFilterHandler(const net::HostPort& peer_address) {
     LOG_ERROR << acceptor_->PrefixInfo() << "Too many connections ! - refusing";
     return false;
   }
+  if ( server_->admission_controller_ != NULL &&
+       !server_->admission_controller_->Admit(peer_address) ) {
+    return false;
+  }
   return true;
 }
 void ServerAcceptor::AcceptorAcceptHandler(net::NetConnection* net_connection) {
@@ -230,7 +245,12 @@ Server::Server(const char* name,
       default_processor_(NewPermanentCallback(
                              this, &Server::DefaultRequestProcessor)),
       error_processor_(NewPermanentCallback(
-                           this, &Server::ErrorRequestProcessor)) {
+                           this, &Server::ErrorRequestProcessor)),
+      response_cache_(protocol_params.response_cache_size_ <= 0 ? NULL :
+                      new ResponseCache(
+                          protocol_params.response_cache_size_,
+                          protocol_params.response_cache_max_entry_size_)),
+      admission_controller_(NULL) {
 }
 
 Server::~Server() {
@@ -248,6 +268,7 @@ Server::~Server() {
     delete processors_.begin()->second;
     processors_.erase(processors_.begin());
   }
+  delete response_cache_;
 }
 
 void Server::AddAcceptor(net::PROTOCOL net_protocol,
@@ -466,11 +487,31 @@ void Server::ProcessRequest(http::ServerRequest* req) {
       req->server_callback_ = error_processor_;
     } else {
       req->server_callback_ = proc->callback_;
+      if ( response_cache_ != NULL && ReplyFromCache(req) ) {
+        return;
+      }
     }
   }
   req->server_callback_->Run(req);
 }
 
+bool Server::ReplyFromCache(http::ServerRequest* req) {
+  const string key(ResponseCache::GetCacheKey(req->request()));
+  if ( key.empty() ) {
+    return false;
+  }
+  const ResponseCache::Entry* const entry = response_cache_->Lookup(key);
+  if ( entry == NULL ) {
+    req->cache_key_ = key;
+    return false;
+  }
+  const HttpReturnCode status =
+      ResponseCache::PrepareReply(entry, req->request());
+  entry->DecRef();
+  req->ReplyWithStatus(status);
+  return true;
+}
+
 
 //////////////////////////////////////////////////////////////////////
 //
@@ -586,6 +627,22 @@ void ServerProtocol::HandleTimeout(int64 timeout_id) {
 
 bool ServerProtocol::ProcessMoreData() {
   CHECK(net_selector()->IsInSelectThread());
+  while ( true ) {
+    if ( !ProcessNextRequest() ) {
+      return false;
+    }
+    // Pipelined keep-alive requests: if the last request got answered
+    // right away and we have more data, we go on w/ the next one. The
+    // replies pile up in the outbuf and go out together on the next
+    // write event.
+    if ( closed_ || connection_ == NULL || crt_recv_ != NULL ||
+         !active_requests_.empty() || connection_->inbuf()->IsEmpty() ) {
+      return true;
+    }
+  }
+}
+
+bool ServerProtocol::ProcessNextRequest() {
   if ( closed_ ) {
     connection_->inbuf()->Clear();
     return true;   // 'soft' closed ..
@@ -808,6 +865,10 @@ void ServerProtocol::ReplyForRequest(ServerRequest* req,
     crt_send_->is_orphaned_ = true;
     should_close = true;
   } else {
+    if ( !req->cache_key_.empty() ) {
+      server_->response_cache()->MaybeAdd(req->cache_key_, req->request(),
+                                          status);
+    }
     should_close = PrepareResponse(req, status);
   }
   EndRequestProcessing(crt_send_,
@@ -828,8 +889,17 @@ void ServerProtocol::StreamData(ServerRequest* req, bool is_eos) {
     // while in the second we will have nothing to output..
     if ( !req->request()->server_data()->IsEmpty() ) {
       // Write the data out
-      if ( connection_->outbuf()->Size() >
-           protocol_params().max_reply_buffer_size_ ) {
+      if ( net::OutbufBudget::ShouldEvict(connection_->outbuf_account()) ) {
+        // Free the memory now - don't wait to flush it to this slow guy
+        LOG_WARNING << name() << ": output memory budget exhausted, "
+                    << "dropping slow client w/ outbuf size: "
+                    << connection_->outbuf()->Size();
+        connection_->outbuf()->Clear();
+        req->request()->server_data()->Clear();
+        is_eos = true;
+        req->is_keep_alive_ = false;
+      } else if ( connection_->outbuf()->Size() >
+                  protocol_params().max_reply_buffer_size_ ) {
         LOG_WARNING << "HTTP outbuf size exceeded: "
                     << connection_->outbuf()->Size()
                     << " > max_reply_buffer_size: "
@@ -933,7 +1003,9 @@ void ServerProtocol::NotifyConnectionWrite() {
   if ( crt_send_ != NULL ) {
     // update outbuf_size proxies (outbuf is depleting)
     crt_send_->UpdateOutputBytes();
-    if ( crt_send_->pending_output_bytes() < crt_send_->ready_pending_limit_ ) {
+    // under memory pressure we want less buffered before asking for more
+    if ( crt_send_->pending_output_bytes() <
+         net::OutbufBudget::ScaledLimit(crt_send_->ready_pending_limit_) ) {
       crt_send_->SignalReady();
     }
   }
@@ -76,12 +76,14 @@
 #include <whisperlib/common/base/alarm.h>
 #include <whisperlib/common/sync/mutex.h>
 #include <whisperlib/net/http/http_request.h>
+#include <whisperlib/net/http/http_response_cache.h>
 #include <whisperlib/net/base/selector.h>
 #include <whisperlib/net/base/timeouter.h>
 #include <whisperlib/net/base/connection.h>
 #include <whisperlib/net/base/address.h>
 #include <whisperlib/net/url/url.h>
 #include <whisperlib/net/base/user_authenticator.h>
+#include <whisperlib/net/util/admission_controller.h>
 
 namespace http {
 
@@ -167,6 +169,13 @@ struct ServerParams {
   string default_content_type_;
   // If true we ignore different http hosts received in the sourece urls..
   bool ignore_different_http_hosts_;
+
+  // How many bytes can we keep in the response cache ? (0 => no cache).
+  // Only the replies that processors mark explicitly as cacheable
+  // (Cache-Control: max-age=..) are cached - check http_response_cache.h
+  int64 response_cache_size_;
+  // Replies w/ bodies larger then this are not cached.
+  int32 response_cache_max_entry_size_;
 };
 
 class ServerRequest;
@@ -318,9 +327,21 @@ class Server {
 
   net::Selector* selector() { return selector_; }
   const string& name() const { return name_; }
+
+  // The cache of replies (NULL if not enabled in protocol params).
+  ResponseCache* response_cache() { return response_cache_; }
+
+  // Consulted by our acceptors for every new client (after the
+  // max_concurrent_connections_ check). Not owned, NULL to turn off.
+  void set_admission_controller(net::AdmissionController* ac) {
+    admission_controller_ = ac;
+  }
  private:
   void DefaultRequestProcessor(ServerRequest* req);
   void ErrorRequestProcessor(ServerRequest* req);
+  // Replies to req from the response cache, if possible (returns true).
+  // Else it marks the request to have its reply cached.
+  bool ReplyFromCache(ServerRequest* req);
 
   // Name of the server - we return this in the "Server" field
   const string name_;
@@ -374,7 +395,14 @@ class Server {
   // w/ these the over to top clients and orphaned requests..
   typedef hash_map<http::ServerProtocol*, int> ProtoReqMap;
   ProtoReqMap protocol_outstanding_requests_;
+
+  // Cached replies for repeated requests (may be NULL)
+  ResponseCache* const response_cache_;
+
+  // Accept time admission control (may be NULL)
+  net::AdmissionController* admission_controller_;
  private:
+  friend class ServerAcceptor;
   DISALLOW_EVIL_CONSTRUCTORS(Server);
 };
 
@@ -417,6 +445,10 @@ class ServerConnection {
       net_connection_->RequestWriteEvents(enable);
     }
   }
+  bool SetMaxPacingRate(int64 bytes_per_sec) {
+    return net_connection_ != NULL &&
+           net_connection_->SetMaxPacingRate(bytes_per_sec);
+  }
 
   const http::ServerProtocol* protocol() const;
 
@@ -435,6 +467,12 @@ class ServerConnection {
   int64 count_bytes_written() const {
     return net_connection_->count_bytes_written();
   }
+  int32 kernel_outbuf_size() const {
+    return net_connection_ == NULL ? 0 : net_connection_->kernel_outbuf_size();
+  }
+  const net::OutbufBudget::Account* outbuf_account() const {
+    return net_connection_ == NULL ? NULL : net_connection_->outbuf_account();
+  }
   int64 count_bytes_read() const {
     return net_connection_->count_bytes_read();
   }
@@ -503,10 +541,19 @@ class ServerProtocol {
   }
   int32 free_outbuf_size() const {
     return connection_ == NULL ? 0 :
-             max(0, protocol_params().max_reply_buffer_size_ -
+             max(0, static_cast<int32>(net::OutbufBudget::ScaledLimit(
+                        protocol_params().max_reply_buffer_size_)) -
                     protocol_params().max_header_size_ -
                     outbuf_size());
   }
+  // Bytes already written to the socket but still in the kernel send queue
+  int32 kernel_outbuf_size() const {
+    return connection_ == NULL ? 0 : connection_->kernel_outbuf_size();
+  }
+  // Asks the kernel to pace our output (see NetConnection)
+  bool SetMaxPacingRate(int64 bytes_per_sec) {
+    return connection_ != NULL && connection_->SetMaxPacingRate(bytes_per_sec);
+  }
 
   // Sets the underground TCP connection - call it once
   // (We also set some parameters)
@@ -549,6 +596,7 @@ class ServerProtocol {
   void CloseAllActiveRequests();
 
   // This callback processes more data from connection_->inbuf()
+  // (i.e. all the pipelined requests that we can answer right away)
   bool ProcessMoreData();
 
   // Response finalization - replies to the given request. If
@@ -574,6 +622,8 @@ class ServerProtocol {
   const bool dlog_level() const { return dlog_level_; }
 
  private:
+  // Parses (and processes) the next request from connection_->inbuf()
+  bool ProcessNextRequest();
   // Prepares what status to return on a parsing error
   void PrepareErrorRequest(ServerRequest* server_request);
   // This disposes the request and maybe closes the connection..
@@ -691,6 +741,7 @@ class ServerRequest {
         ready_callback_(NULL),
         closed_callback_(NULL),
         server_callback_(NULL),
+        cache_key_(),
         is_initialized_(false) {
     UpdateOutputBytes();
   }
@@ -740,6 +791,18 @@ class ServerRequest {
   // discarded / determine connection closing etc
   // WARNING !!! this function is called on both: media & net threads
   int32 free_output_bytes() const { return free_outbuf_size_; }
+  // The bytes already handed to the kernel but not yet acknowledged by
+  // the peer. Call it only from the net thread.
+  int32 kernel_output_bytes() const {
+    CHECK(protocol_->net_selector()->IsInSelectThread());
+    return protocol_->kernel_outbuf_size();
+  }
+  // Asks the kernel to pace the output of our connection at (at most)
+  // this rate. Call it only from the net thread.
+  bool SetMaxPacingRate(int64 bytes_per_sec) {
+    CHECK(protocol_->net_selector()->IsInSelectThread());
+    return protocol_->SetMaxPacingRate(bytes_per_sec);
+  }
   // update the local copy of outbuf_size
   void UpdateOutputBytes() {
     CHECK(protocol_->net_selector()->IsInSelectThread());
@@ -941,6 +1004,8 @@ class ServerRequest {
   // The callback that processes this event - set and used internally by
   // the server
   Server::ServerCallback* server_callback_;
+  // If not empty, the reply is to be cached under this key
+  string cache_key_;
   // Used internally to signal the header is passed and request has some
   // specific members set.
   bool is_initialized_;
@@ -0,0 +1,154 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Author: Catalin Popescu
+
+// Measures how many requests per second (on one core) we can parse
+// with the different header parsing methods.
+
+#include "common/base/types.h"
+#include "common/base/log.h"
+#include "common/base/system.h"
+#include "common/base/gflags.h"
+#include "common/base/timer.h"
+#include "common/io/buffer/memory_stream.h"
+
+#include "net/http/http_header.h"
+#include "net/http/http_header_scanner.h"
+#include "net/http/http_request.h"
+
+//////////////////////////////////////////////////////////////////////
+
+DEFINE_int32(num_requests,
+             500000,
+             "Parse these many requests for each method");
+DEFINE_int32(memstream_bufsize,
+             4096,
+             "We dimmensionate the MemoryStream buffer to this value");
+
+//////////////////////////////////////////////////////////////////////
+
+// A typical HLS segment fetch
+static const char kRequest[] =
+    "GET /live/channel1/media_20111207-151246-601.ts?wsp=1&token=abcdef "
+    "HTTP/1.1\r\n"
+    "Host: streaming.example.com\r\n"
+    "User-Agent: AppleCoreMedia/1.0.0.9A405 (iPad; U; CPU OS 5_0_1 like "
+    "Mac OS X; en_us)\r\n"
+    "Accept: */*\r\n"
+    "Accept-Encoding: identity\r\n"
+    "Range: bytes=0-\r\n"
+    "X-Playback-Session-Id: 2E0A1B6C-7A33-4A0F-8C10-5C1F3E2B0D11\r\n"
+    "Cookie: session=0123456789abcdef0123456789abcdef\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+static void Report(const char* name, int64 start_ns, int32 num) {
+  const int64 duration_ns = max(timer::TicksNsec() - start_ns,
+                                static_cast<int64>(1));
+  LOG_INFO << name << ": " << num << " requests in "
+           << duration_ns / 1000000LL << " ms => "
+           << static_cast<int64>(num * 1e9 / duration_ns)
+           << " requests/s";
+}
+
+// Fills the stream w/ num copies of the request (as in pipelining)
+static void FillStream(io::MemoryStream* ms, int32 num) {
+  for ( int32 i = 0; i < num; ++i ) {
+    ms->Write(kRequest, sizeof(kRequest) - 1);
+  }
+}
+
+static const int32 kBatchSize = 1000;
+
+void BenchmarkHeader() {
+  http::Header header(true);
+  int64 start = timer::TicksNsec();
+  int32 parsed = 0;
+  while ( parsed < FLAGS_num_requests ) {
+    io::MemoryStream ms(FLAGS_memstream_bufsize);
+    FillStream(&ms, kBatchSize);
+    for ( int32 i = 0; i < kBatchSize; ++i ) {
+      header.Clear();
+      CHECK(header.ParseHttpRequest(&ms));
+    }
+    parsed += kBatchSize;
+  }
+  Report("http::Header::ParseHttpRequest", start, parsed);
+}
+
+void BenchmarkScanner() {
+  http::HeaderScanner scanner;
+  int64 start = timer::TicksNsec();
+  int32 parsed = 0;
+  while ( parsed < FLAGS_num_requests ) {
+    io::MemoryStream ms(FLAGS_memstream_bufsize);
+    FillStream(&ms, kBatchSize);
+    for ( int32 i = 0; i < kBatchSize; ++i ) {
+      scanner.Clear();
+      CHECK_EQ(scanner.Scan(ms), http::HeaderScanner::SCAN_DONE);
+      CHECK(scanner.FindField(http::HeaderScanner::FIELD_HOST) != NULL);
+      ms.Skip(scanner.header_size());
+    }
+    parsed += kBatchSize;
+  }
+  Report("http::HeaderScanner::Scan", start, parsed);
+}
+
+void BenchmarkRequestParser() {
+  http::RequestParser parser("benchmark");
+  http::Request req;
+  int64 start = timer::TicksNsec();
+  int32 parsed = 0;
+  while ( parsed < FLAGS_num_requests ) {
+    io::MemoryStream ms(FLAGS_memstream_bufsize);
+    FillStream(&ms, kBatchSize);
+    for ( int32 i = 0; i < kBatchSize; ++i ) {
+      // Back to STATE_INITIALIZED: the next ParseClientRequest clears
+      // the request header & data before reusing them
+      parser.Clear();
+      // First call reads the header, the next one the (empty) body
+      while ( !(parser.ParseClientRequest(&ms, &req) &
+                http::RequestParser::REQUEST_FINISHED) ) {
+      }
+      CHECK(!parser.InErrorState()) << parser.ParseStateName();
+    }
+    parsed += kBatchSize;
+  }
+  Report("http::RequestParser::ParseClientRequest", start, parsed);
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  BenchmarkHeader();
+  BenchmarkScanner();
+  BenchmarkRequestParser();
+  LOG_INFO << "DONE";
+}
@@ -35,6 +35,7 @@
 #include "common/base/gflags.h"
 
 #include "net/http/http_header.h"
+#include "net/http/http_header_scanner.h"
 #include "common/io/file/file.h"
 #include "common/io/file/file_input_stream.h"
 #include "common/io/file/file_output_stream.h"
@@ -139,6 +140,84 @@ void RunSimpleTests() {
   }
 }
 
+// Same tests as above, but through the scanner, fed in small pieces
+void RunScannerTests() {
+  for ( int i = 0; i < NUMBEROF(test); ++i ) {
+    LOG_INFO << " ======================================== \n"
+             << " SCANNER TEST " << i;
+    http::Header expected(test[i].is_strict);
+    io::MemoryStream ms_expected;
+    ms_expected.Write(test[i].header);
+    CHECK(expected.ParseHttpRequest(&ms_expected));
+
+    http::Header headers(test[i].is_strict);
+    http::HeaderScanner scanner;
+    io::MemoryStream ms(7);
+    const int32 size = strlen(test[i].header);
+    for ( int32 j = 0; j < size; ++j ) {
+      CHECK_EQ(scanner.Scan(ms), http::HeaderScanner::SCAN_MORE_DATA);
+      ms.Write(test[i].header + j, 1);
+    }
+    CHECK_EQ(scanner.Scan(ms), http::HeaderScanner::SCAN_DONE)
+        << http::HeaderScanner::ScanResultName(scanner.result());
+    CHECK_EQ(scanner.header_size(), size);
+    headers.ParseFromScanner(scanner, http::Header::REQUEST_LINE);
+    ms.Skip(scanner.header_size());
+    CHECK(ms.IsEmpty());
+
+    CHECK_EQ(headers.parse_error(), test[i].expected_error);
+    CHECK_EQ(headers.ToString(), expected.ToString());
+    CHECK_EQ(headers.method(), expected.method());
+    CHECK_EQ(headers.uri(), expected.uri());
+    CHECK_EQ(headers.http_version(), expected.http_version());
+  }
+
+  http::HeaderScanner scanner;
+  const char kRequest[] =
+      "GET /a/b?c=d HTTP/1.1\r\n"
+      "host : example.com\r\n"
+      "X-Custom: 1\r\n"
+      "Connection:keep-alive\r\n"
+      "\r\n"
+      "GET /next";
+  CHECK_EQ(scanner.ScanBuffer(kRequest, sizeof(kRequest) - 1),
+           http::HeaderScanner::SCAN_DONE);
+  CHECK_EQ(scanner.header_size(),
+           sizeof(kRequest) - 1 - strlen("GET /next"));
+  CHECK_EQ(scanner.num_first_line_tokens(), 3);
+  CHECK_EQ(scanner.first_line_token(1).ToString(), "/a/b?c=d");
+  CHECK_EQ(scanner.first_line_token(2).ToString(), "HTTP/1.1");
+  CHECK_EQ(scanner.num_fields(), 3);
+  const http::HeaderScanner::Field* f =
+      scanner.FindField(http::HeaderScanner::FIELD_HOST);
+  CHECK(f != NULL);
+  CHECK_EQ(f->value_.ToString(), "example.com");
+  f = scanner.FindField(http::HeaderScanner::FIELD_CONNECTION);
+  CHECK(f != NULL);
+  CHECK_EQ(f->value_.ToString(), "keep-alive");
+  CHECK(scanner.FindField(http::HeaderScanner::FIELD_RANGE) == NULL);
+  f = scanner.FindField("x-custom", 8);
+  CHECK(f != NULL);
+  CHECK_EQ(f->value_.ToString(), "1");
+  // only exact spellings take the known field shortcut in ParseFromScanner
+  CHECK_EQ(scanner.field(0).known_, -1);   // "host " (trailing space)
+  CHECK_EQ(scanner.field(1).known_, -1);
+  CHECK_EQ(scanner.field(2).known_, http::HeaderScanner::FIELD_CONNECTION);
+  http::Header scanned(false);
+  scanned.ParseFromScanner(scanner, http::Header::REQUEST_LINE);
+  http::Header parsed(false);
+  io::MemoryStream ms_parsed;
+  ms_parsed.Write(kRequest);
+  CHECK(parsed.ParseHttpRequest(&ms_parsed));
+  CHECK_EQ(scanned.ToString(), parsed.ToString());
+
+  // Too long
+  http::HeaderScanner short_scanner(16);
+  io::MemoryStream ms;
+  ms.Write(kRequest);
+  CHECK_EQ(short_scanner.Scan(ms), http::HeaderScanner::SCAN_TOO_LONG);
+}
+
 int main(int argc, char* argv[]) {
   common::Init(argc, argv);
 
@@ -226,6 +305,7 @@ int main(int argc, char* argv[]) {
           "\t !@#$%^&*()_+{}[]|:;\"'\\<>,./?"));
 
   RunSimpleTests();
+  RunScannerTests();
 
   if ( !FLAGS_data_file.empty() ) {
     io::MemoryStream ms(FLAGS_memstream_bufsize);
@@ -0,0 +1,257 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include "common/base/types.h"
+#include "common/base/log.h"
+#include "common/base/system.h"
+#include "common/base/gflags.h"
+
+#include "net/http/http_response_cache.h"
+#include "common/io/buffer/memory_stream.h"
+#include "common/io/zlib/zlibwrapper.h"
+
+//////////////////////////////////////////////////////////////////////
+
+static const URL kRoot("http://localhost:8080/");
+
+// Prepares a request as received by a server
+static http::Request* NewRequest(const char* uri,
+                                 http::HttpMethod method,
+                                 const char* accept_encoding) {
+  http::Request* const req = new http::Request();
+  req->client_header()->PrepareRequestLine(uri, method);
+  if ( accept_encoding != NULL ) {
+    req->client_header()->AddField(http::kHeaderAcceptEncoding,
+                                   accept_encoding, true);
+  }
+  req->InitializeUrlFromClientRequest(kRoot);
+  return req;
+}
+
+// Prepares a reply, as a processor would
+static void PrepareReply(http::Request* req,
+                         const char* cache_control,
+                         const string& body) {
+  req->server_header()->AddField(http::kHeaderContentType,
+                                 "text/plain", true);
+  if ( cache_control != NULL ) {
+    req->server_header()->AddField(http::kHeaderCacheControl,
+                                   cache_control, true);
+  }
+  req->server_data()->Write(body);
+}
+
+static string BigBody() {
+  string body;
+  for ( int i = 0; i < 200; ++i ) {
+    body += "All work and no play makes Jack a dull boy.\n";
+  }
+  return body;
+}
+
+void TestCacheability() {
+  http::ResponseCache cache(1 << 20, 1 << 16);
+  const string body(BigBody());
+
+  // Not marked as cacheable
+  http::Request* req = NewRequest("/a", http::METHOD_GET, NULL);
+  string key(http::ResponseCache::GetCacheKey(req));
+  CHECK(!key.empty());
+  PrepareReply(req, NULL, body);
+  CHECK(!cache.MaybeAdd(key, req, http::OK));
+  delete req;
+
+  req = NewRequest("/a", http::METHOD_GET, NULL);
+  PrepareReply(req, "no-cache, max-age=10", body);
+  CHECK(!cache.MaybeAdd(key, req, http::OK));
+  delete req;
+
+  req = NewRequest("/a", http::METHOD_GET, NULL);
+  PrepareReply(req, "private, max-age=10", body);
+  CHECK(!cache.MaybeAdd(key, req, http::OK));
+  delete req;
+
+  // Bad status
+  req = NewRequest("/a", http::METHOD_GET, NULL);
+  PrepareReply(req, "max-age=10", body);
+  CHECK(!cache.MaybeAdd(key, req, http::NOT_FOUND));
+  delete req;
+
+  // Sets cookies
+  req = NewRequest("/a", http::METHOD_GET, NULL);
+  PrepareReply(req, "max-age=10", body);
+  req->server_header()->AddField(http::kHeaderSetCookie, "a=b", true);
+  CHECK(!cache.MaybeAdd(key, req, http::OK));
+  delete req;
+
+  // Varies on something else
+  req = NewRequest("/a", http::METHOD_GET, NULL);
+  PrepareReply(req, "max-age=10", body);
+  req->server_header()->AddField(http::kHeaderVary, "Cookie", true);
+  CHECK(!cache.MaybeAdd(key, req, http::OK));
+  delete req;
+
+  // Too big
+  req = NewRequest("/a", http::METHOD_GET, NULL);
+  PrepareReply(req, "max-age=10", string(1 << 17, 'x'));
+  CHECK(!cache.MaybeAdd(key, req, http::OK));
+  delete req;
+
+  // Not a GET / w/ credentials
+  req = NewRequest("/a", http::METHOD_POST, NULL);
+  CHECK(http::ResponseCache::GetCacheKey(req).empty());
+  delete req;
+  req = NewRequest("/a", http::METHOD_GET, NULL);
+  req->client_header()->AddField(http::kHeaderAuthorization,
+                                 "Basic QWxhZGRpbjpvcGVuIHNlc2FtZQ==", true);
+  CHECK(http::ResponseCache::GetCacheKey(req).empty());
+  delete req;
+  req = NewRequest("/a", http::METHOD_GET, NULL);
+  req->client_header()->AddField(http::kHeaderCookie, "session=1234", true);
+  CHECK(http::ResponseCache::GetCacheKey(req).empty());
+  delete req;
+
+  CHECK_EQ(cache.num_entries(), 0);
+  CHECK_EQ(cache.size(), 0);
+}
+
+void TestHits() {
+  http::ResponseCache cache(1 << 20, 1 << 16);
+  const string body(BigBody());
+
+  http::Request* req = NewRequest("/a?x=1", http::METHOD_GET, NULL);
+  const string key(http::ResponseCache::GetCacheKey(req));
+  CHECK(cache.Lookup(key) == NULL);
+  PrepareReply(req, "public, max-age=10", body);
+  req->server_header()->AddField("X-Whisper", "test", true);
+  CHECK(cache.MaybeAdd(key, req, http::OK));
+  // The request was not touched
+  CHECK_EQ(req->server_data()->Size(), body.size());
+  delete req;
+  CHECK_EQ(cache.num_entries(), 1);
+
+  // Identity
+  req = NewRequest("/a?x=1", http::METHOD_GET, NULL);
+  CHECK_EQ(http::ResponseCache::GetCacheKey(req), key);
+  const http::ResponseCache::Entry* entry = cache.Lookup(key);
+  CHECK(entry != NULL);
+  CHECK_EQ(http::ResponseCache::PrepareReply(entry, req), http::OK);
+  const string etag(entry->etag());
+  entry->DecRef();
+  CHECK(req->server_data_encoded());
+  CHECK(!req->server_header()->IsGzipContentEncoding());
+  CHECK_EQ(req->server_header()->FindField("X-Whisper"), "test");
+  CHECK_EQ(req->server_data()->ToString(), body);
+  delete req;
+
+  // Gzipped
+  req = NewRequest("/a?x=1", http::METHOD_GET, "gzip, deflate");
+  entry = cache.Lookup(key);
+  CHECK(entry != NULL);
+  CHECK_EQ(http::ResponseCache::PrepareReply(entry, req), http::OK);
+  entry->DecRef();
+  CHECK(req->server_header()->IsGzipContentEncoding());
+  const int32 gzip_size = req->server_data()->Size();
+  CHECK_LT(gzip_size, body.size());
+  // Sent as it is (not compressed again)
+  io::MemoryStream out;
+  req->server_header()->PrepareStatusLine(http::OK);
+  req->AppendServerReply(&out, false, false);
+  CHECK(req->server_header()->IsGzipContentEncoding());
+  CHECK_EQ(req->server_header()->FindField(http::kHeaderContentLength),
+           strutil::IntToString(gzip_size));
+  string reply(out.ToString());
+  io::MemoryStream zipped, unzipped;
+  zipped.Write(reply.substr(reply.find("\r\n\r\n") + 4));
+  CHECK_EQ(zipped.Size(), gzip_size);
+  io::ZlibGzipDecodeWrapper decoder;
+  CHECK_EQ(decoder.Decode(&zipped, &unzipped), Z_STREAM_END);
+  CHECK_EQ(unzipped.ToString(), body);
+  delete req;
+
+  // Conditional
+  req = NewRequest("/a?x=1", http::METHOD_GET, "gzip");
+  req->client_header()->AddField(http::kHeaderIfNoneMatch, etag, true);
+  entry = cache.Lookup(key);
+  CHECK(entry != NULL);
+  CHECK_EQ(http::ResponseCache::PrepareReply(entry, req), http::NOT_MODIFIED);
+  entry->DecRef();
+  CHECK(req->server_data()->IsEmpty());
+  delete req;
+
+  // Other urls miss
+  req = NewRequest("/a?x=2", http::METHOD_GET, NULL);
+  CHECK(cache.Lookup(http::ResponseCache::GetCacheKey(req)) == NULL);
+  delete req;
+
+  CHECK_EQ(cache.num_hits(), 3);
+  CHECK_EQ(cache.num_misses(), 2);
+  cache.Erase(key);
+  CHECK(cache.Lookup(key) == NULL);
+  CHECK_EQ(cache.size(), 0);
+}
+
+void TestEviction() {
+  const string body(BigBody());
+  // room for three entries (w/ their etags)
+  const int64 max_size = 3 * (body.size() + 64);
+  http::ResponseCache cache(max_size, 1 << 16);
+  for ( int i = 0; i < 10; ++i ) {
+    http::Request* const req = NewRequest(
+        strutil::StringPrintf("/%d", i).c_str(), http::METHOD_GET, NULL);
+    PrepareReply(req, "max-age=100", body);
+    req->set_server_use_gzip_encoding(false);   // no gzip variant
+    CHECK(cache.MaybeAdd(http::ResponseCache::GetCacheKey(req),
+                         req, http::OK));
+    delete req;
+    CHECK_LE(cache.size(), max_size);
+    // Keep the first one in use.
+    const http::ResponseCache::Entry* const entry =
+        cache.Lookup(kRoot.Resolve("/0").spec());
+    CHECK(entry != NULL);
+    entry->DecRef();
+  }
+  CHECK_EQ(cache.num_entries(), 3);
+  const http::ResponseCache::Entry* const entry =
+      cache.Lookup(kRoot.Resolve("/9").spec());
+  CHECK(entry != NULL);
+  entry->DecRef();
+  CHECK(cache.Lookup(kRoot.Resolve("/7").spec()) == NULL);
+  LOG_INFO << cache.ToString();
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestCacheability();
+  TestHits();
+  TestEviction();
+  LOG_INFO << "PASS!";
+}
@@ -30,224 +30,485 @@
 // Author: Cosmin Tudorache & Catalin Popescu
 //
 
-#include <deque>
-#include <unicode/utf8.h>      // ICU/source/common/unicode/utf8.h
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
 
 #include "common/base/log.h"
 #include "common/base/common.h"
+#include "common/base/strutil.h"
 #include "net/rpc/lib/codec/json/rpc_json_decoder.h"
 
 namespace rpc {
 
-DECODE_RESULT JsonDecoder::DecodeElementContinue(io::MemoryStream& in,
-                                                 bool* more_attribs,
-                                                 const char* separator) {
-  string s;
+namespace {
+
+// Character classes for the scanner (follow the ones used by
+// io::MemoryStream::ReadNextAsciiToken)
+enum JsonCharClass {
+  JSON_ERROR = 0,    // control and non-ASCII chars, outside strings
+  JSON_SPACE,        // blanks
+  JSON_QUOTE,        // " and '
+  JSON_OPEN,         // { [
+  JSON_CLOSE,        // } ]
+  JSON_SEP,          // , :
+  JSON_ATOM,         // letters, digits, + - . etc (numbers, true, null ..)
+  JSON_BAD_SEP,      // other punctuation: never valid
+};
+
+struct JsonCharTable {
+  uint8 class_[0x100];
+  JsonCharTable() {
+    for ( int c = 0; c < 0x100; ++c ) {
+      if ( c >= 0x80 || c < ' ' ) {
+        class_[c] = JSON_ERROR;
+      } else if ( isalnum(c) || strchr("+-./?@_~\x7f", c) != NULL ) {
+        class_[c] = JSON_ATOM;
+      } else {
+        class_[c] = JSON_BAD_SEP;
+      }
+    }
+    class_[static_cast<uint8>(' ')] = JSON_SPACE;
+    class_[static_cast<uint8>('\t')] = JSON_SPACE;
+    class_[static_cast<uint8>('\n')] = JSON_SPACE;
+    class_[static_cast<uint8>('\r')] = JSON_SPACE;
+    class_[static_cast<uint8>('"')] = JSON_QUOTE;
+    class_[static_cast<uint8>('\'')] = JSON_QUOTE;
+    class_[static_cast<uint8>('{')] = JSON_OPEN;
+    class_[static_cast<uint8>('[')] = JSON_OPEN;
+    class_[static_cast<uint8>('}')] = JSON_CLOSE;
+    class_[static_cast<uint8>(']')] = JSON_CLOSE;
+    class_[static_cast<uint8>(',')] = JSON_SEP;
+    class_[static_cast<uint8>(':')] = JSON_SEP;
+  }
+};
+const JsonCharTable kJsonChars;
+
+inline uint8 CharClass(char c) {
+  return kJsonChars.class_[static_cast<uint8>(c)];
+}
+
+// The first piece of data we scan for a value, and the maximum
+const int32 kMinReadSize = 512;
+const int32 kMaxReadSize = 1 << 16;
+
+const uint64 kOnes = 0x0101010101010101ULL;
+const uint64 kHighBits = 0x8080808080808080ULL;
+
+// Non zero if any of the bytes in v is zero
+inline uint64 HasZeroByte(uint64 v) {
+  return (v - kOnes) & ~v & kHighBits;
+}
+
+// Looks for the end quote of a string that starts at pos (after the
+// opening quote) in data[0..size). Returns its position, or -1 if the
+// string is not complete. Sets *escaped if the string needs unescaping.
+// The plain parts are skipped 8 bytes at a time.
+int64 FindStringEnd(const char* data, uint32 pos, uint32 size,
+                    char quote, bool* escaped) {
+  const uint64 quotes = kOnes * static_cast<uint8>(quote);
+  const uint64 backslashes = kOnes * static_cast<uint8>('\\');
+  while ( pos < size ) {
+    while ( pos + sizeof(uint64) <= size ) {
+      uint64 v;
+      memcpy(&v, data + pos, sizeof(v));
+      if ( (HasZeroByte(v ^ quotes) | HasZeroByte(v ^ backslashes) |
+            (v & kHighBits)) != 0 ) {
+        break;
+      }
+      pos += sizeof(uint64);
+    }
+    if ( pos >= size ) {
+      break;
+    }
+    const char c = data[pos];
+    if ( c == quote ) {
+      return pos;
+    }
+    if ( c == '\\' ) {
+      *escaped = true;
+      pos += 2;
+      continue;
+    }
+    if ( (c & 0x80) != 0 ) {
+      *escaped = true;
+    }
+    ++pos;
+  }
+  return -1;
+}
+}
+
+DECODE_RESULT JsonDecoder::PrepareTape(io::MemoryStream& in) {
+  if ( tape_pos_ < tape_.size() ) {
+    return DECODE_RESULT_SUCCESS;
+  }
+  ClearTape();
+  buffer_.clear();
+
+  // We pull the data in increasing pieces, so we don't copy around much
+  // more than the value when the stream holds many (small) values.
+  DECODE_RESULT result = DECODE_RESULT_NOT_ENOUGH_DATA;
   in.MarkerSet();
-  const io::TokenReadError res = in.ReadNextAsciiToken(&s);
-  if ( res == io::TOKEN_NO_DATA ) {
-    in.MarkerRestore();
-    return DECODE_RESULT_NOT_ENOUGH_DATA;
-  }
-  if ( res == io::TOKEN_SEP_OK ) {
-    if ( s == separator ) {
-      *more_attribs = false;
-      in.MarkerClear();
-      return DECODE_RESULT_SUCCESS;
+  const char* buf;
+  int32 max_size = kMinReadSize;
+  int32 size = max_size;
+  while ( result == DECODE_RESULT_NOT_ENOUGH_DATA &&
+          in.ReadNext(&buf, &size) ) {
+    buffer_.append(buf, size);
+    max_size = min(2 * max_size, kMaxReadSize);
+    size = max_size;
+    result = ScanTape();
+  }
+  in.MarkerRestore();
+  if ( result != DECODE_RESULT_SUCCESS ) {
+    ClearTape();
+    return result;
+  }
+  in.Skip(value_end_);
+  return DECODE_RESULT_SUCCESS;
+}
+
+DECODE_RESULT JsonDecoder::ScanTape() {
+  const char* const data = buffer_.data();
+  const uint32 size = buffer_.size();
+  uint32 pos = scan_pos_;
+  while ( true ) {
+    while ( pos < size && CharClass(data[pos]) == JSON_SPACE ) {
+      ++pos;
+    }
+    // We restart from here when more data comes
+    scan_pos_ = pos;
+    if ( pos >= size ) {
+      return DECODE_RESULT_NOT_ENOUGH_DATA;
+    }
+    Token t;
+    t.type_ = data[pos];
+    t.escaped_ = false;
+    t.begin_ = pos;
+    t.end_ = pos + 1;
+    t.match_ = 0;
+    switch ( CharClass(data[pos]) ) {
+      case JSON_OPEN:
+        open_brackets_.push_back(tape_.size());
+        break;
+      case JSON_CLOSE: {
+        if ( open_brackets_.empty() ) {
+          DLOG_ERROR << "Json Decoder: Badly started paranthesis";
+          return DECODE_RESULT_ERROR;
+        }
+        Token& open = tape_[open_brackets_.back()];
+        if ( open.type_ != (t.type_ == '}' ? '{' : '[') ) {
+          DLOG_ERROR << "Json Decoder: Badly closed paranthesis: "
+                     << t.type_ << " for: " << open.type_;
+          return DECODE_RESULT_ERROR;
+        }
+        open.match_ = tape_.size();
+        open_brackets_.pop_back();
+        break;
+      }
+      case JSON_SEP:
+        if ( open_brackets_.empty() ) {
+          DLOG_ERROR << "Json Decoder: Value starts w/ a separator: "
+                     << t.type_;
+          return DECODE_RESULT_ERROR;
+        }
+        break;
+      case JSON_QUOTE: {
+        const int64 end = FindStringEnd(data, pos + 1, size, data[pos],
+                                        &t.escaped_);
+        if ( end < 0 ) {
+          return DECODE_RESULT_NOT_ENOUGH_DATA;
+        }
+        t.type_ = '"';
+        t.begin_ = pos + 1;
+        t.end_ = end;
+        pos = end;
+        break;
+      }
+      case JSON_ATOM: {
+        uint32 end = pos + 1;
+        while ( end < size && CharClass(data[end]) == JSON_ATOM ) {
+          ++end;
+        }
+        if ( end >= size ) {
+          // we cannot tell yet if the atom is complete
+          return DECODE_RESULT_NOT_ENOUGH_DATA;
+        }
+        t.type_ = 'a';
+        t.end_ = end;
+        pos = end - 1;
+        break;
+      }
+      default:
+        DLOG_ERROR << "Json Decoder: Invalid char: "
+                   << static_cast<int>(static_cast<uint8>(data[pos]))
+                   << " at: " << pos;
+        return DECODE_RESULT_ERROR;
     }
-    if ( s == "," ) {
-      *more_attribs = true;
-      in.MarkerClear();
+    tape_.push_back(t);
+    ++pos;
+    if ( open_brackets_.empty() ) {
+      scan_pos_ = pos;
+      value_end_ = pos;
       return DECODE_RESULT_SUCCESS;
     }
   }
-  if ( !is_first_item_ ) {
-    in.MarkerRestore();
-    DLOG_ERROR << "Json Bad Struct continues: " << s;
-    return DECODE_RESULT_ERROR;
+}
+
+const JsonDecoder::Token* JsonDecoder::ReadToken(io::MemoryStream& in,
+                                                 char type,
+                                                 DECODE_RESULT* result) {
+  *result = PrepareTape(in);
+  if ( *result != DECODE_RESULT_SUCCESS ) {
+    return NULL;
   }
-  in.MarkerRestore();
-  is_first_item_ = false;
-  *more_attribs = true;
+  const Token* const t = &tape_[tape_pos_];
+  if ( t->type_ != type ) {
+    DLOG_ERROR << "Json Decoder: Expected '" << type << "', but found: '"
+               << t->type_ << "' at: " << t->begin_;
+    *result = Error();
+    return NULL;
+  }
+  ++tape_pos_;
+  return t;
+}
+
+DECODE_RESULT JsonDecoder::Error() {
+  ClearTape();
+  return DECODE_RESULT_ERROR;
+}
+
+DECODE_RESULT JsonDecoder::DecodeElementContinue(io::MemoryStream& in,
+                                                 bool* more_elements,
+                                                 char end_bracket) {
+  const DECODE_RESULT result = PrepareTape(in);
+  if ( result != DECODE_RESULT_SUCCESS ) {
+    return result;
+  }
+  const char type = tape_[tape_pos_].type_;
+  if ( type == end_bracket ) {
+    ++tape_pos_;
+    *more_elements = false;
+    return DECODE_RESULT_SUCCESS;
+  }
+  const char prev = tape_pos_ > 0 ? tape_[tape_pos_ - 1].type_ : '\0';
+  const bool is_first_item = (prev == '{' || prev == '[');
+  if ( type == ',' && !is_first_item ) {
+    ++tape_pos_;
+    *more_elements = true;
+    return DECODE_RESULT_SUCCESS;
+  }
+  if ( !is_first_item ) {
+    DLOG_ERROR << "Json Bad Struct continues: " << type;
+    return Error();
+  }
+  *more_elements = true;
   return DECODE_RESULT_SUCCESS;
 }
 
 DECODE_RESULT JsonDecoder::DecodeStructStart(io::MemoryStream& in) {
-  is_first_item_ = true;
-  return ReadExpectedSeparator(in, '{');
+  DECODE_RESULT result;
+  ReadToken(in, '{', &result);
+  return result;
 }
-
 DECODE_RESULT JsonDecoder::DecodeStructContinue(io::MemoryStream& in,
                                                 bool* more_attribs) {
-  return DecodeElementContinue(in, more_attribs, "}");
+  return DecodeElementContinue(in, more_attribs, '}');
 }
-
 DECODE_RESULT JsonDecoder::DecodeStructAttribStart(io::MemoryStream& in) {
   return DECODE_RESULT_SUCCESS;
 }
 DECODE_RESULT JsonDecoder::DecodeStructAttribMiddle(io::MemoryStream& in) {
-  return ReadExpectedSeparator(in, ':');
+  DECODE_RESULT result;
+  ReadToken(in, ':', &result);
+  return result;
 }
 DECODE_RESULT JsonDecoder::DecodeStructAttribEnd(io::MemoryStream& in) {
   return DECODE_RESULT_SUCCESS;
 }
+
 DECODE_RESULT JsonDecoder::DecodeArrayStart(io::MemoryStream& in) {
-  is_first_item_ = true;
-  return ReadExpectedSeparator(in, '[');
+  DECODE_RESULT result;
+  ReadToken(in, '[', &result);
+  return result;
 }
 DECODE_RESULT JsonDecoder::DecodeArrayContinue(io::MemoryStream& in,
                                                bool* more_elements) {
-  return DecodeElementContinue(in, more_elements, "]");
+  return DecodeElementContinue(in, more_elements, ']');
 }
 
 DECODE_RESULT JsonDecoder::DecodeMapStart(io::MemoryStream& in) {
-  is_first_item_ = true;
-  return ReadExpectedSeparator(in, '{');
+  DECODE_RESULT result;
+  ReadToken(in, '{', &result);
+  return result;
 }
-
 DECODE_RESULT JsonDecoder::DecodeMapContinue(io::MemoryStream& in,
                                              bool* more_pairs) {
-  return DecodeElementContinue(in, more_pairs, "}");
+  return DecodeElementContinue(in, more_pairs, '}');
 }
-
 DECODE_RESULT JsonDecoder::DecodeMapPairStart(io::MemoryStream& in) {
   decoding_map_key_ = true;
   return DECODE_RESULT_SUCCESS;
 }
 DECODE_RESULT JsonDecoder::DecodeMapPairMiddle(io::MemoryStream& in) {
   decoding_map_key_ = false;
-  return ReadExpectedSeparator(in, ':');
+  DECODE_RESULT result;
+  ReadToken(in, ':', &result);
+  return result;
 }
 DECODE_RESULT JsonDecoder::DecodeMapPairEnd(io::MemoryStream& in) {
   return DECODE_RESULT_SUCCESS;
 }
 
 DECODE_RESULT JsonDecoder::Decode(io::MemoryStream& in, rpc::Void* out) {
-  string s;
-  const io::TokenReadError res = in.ReadNextAsciiToken(&s);
-  if ( res == io::TOKEN_NO_DATA ) {
-    return DECODE_RESULT_NOT_ENOUGH_DATA;
+  DECODE_RESULT result;
+  const Token* const t = ReadToken(in, 'a', &result);
+  if ( t == NULL ) {
+    return result;
   }
-  if ( res == io::TOKEN_OK && s == "null" ) {
-    return DECODE_RESULT_SUCCESS;
+  if ( buffer_.compare(t->begin_, t->end_ - t->begin_, "null") != 0 ) {
+    DLOG_ERROR << "bad void: "
+               << buffer_.substr(t->begin_, t->end_ - t->begin_);
+    return Error();
   }
-  DLOG_ERROR << "bad void: " << res << " Got: " << s;
-  return DECODE_RESULT_ERROR;
+  return DECODE_RESULT_SUCCESS;
 }
 
 DECODE_RESULT JsonDecoder::Decode(io::MemoryStream& in, bool* out) {
-  string s;
-  const io::TokenReadError res = in.ReadNextAsciiToken(&s);
-  if ( res == io::TOKEN_NO_DATA ) {
-    return DECODE_RESULT_NOT_ENOUGH_DATA;
-  }
-  if ( res == io::TOKEN_OK ) {
-    if ( s == "true" ) {
-      *out = true;
-      return DECODE_RESULT_SUCCESS;
-    } else if ( s == "false" ) {
-      *out = false;
-      return DECODE_RESULT_SUCCESS;
-    }
+  DECODE_RESULT result;
+  const Token* const t = ReadToken(in, 'a', &result);
+  if ( t == NULL ) {
+    return result;
   }
-  DLOG_ERROR << "bad bool: " << res << " Got: " << s;
-  return DECODE_RESULT_ERROR;
+  if ( buffer_.compare(t->begin_, t->end_ - t->begin_, "true") == 0 ) {
+    *out = true;
+  } else if ( buffer_.compare(t->begin_, t->end_ - t->begin_,
+                              "false") == 0 ) {
+    *out = false;
+  } else {
+    DLOG_ERROR << "bad bool: "
+               << buffer_.substr(t->begin_, t->end_ - t->begin_);
+    return Error();
+  }
+  return DECODE_RESULT_SUCCESS;
 }
 
 DECODE_RESULT JsonDecoder::Decode(io::MemoryStream& in, int32* out)  {
-  return ReadNumber(in, out, false, decoding_map_key_);
+  return ReadInteger(in, out);
 }
 DECODE_RESULT JsonDecoder::Decode(io::MemoryStream& in, uint32* out) {
-  return ReadNumber(in, out, false, decoding_map_key_);
+  return ReadInteger(in, out);
 }
 DECODE_RESULT JsonDecoder::Decode(io::MemoryStream& in, int64* out)  {
-  return ReadNumber(in, out, false, decoding_map_key_);
+  return ReadInteger(in, out);
 }
 DECODE_RESULT JsonDecoder::Decode(io::MemoryStream& in, uint64* out) {
-  return ReadNumber(in, out, false, decoding_map_key_);
+  return ReadInteger(in, out);
 }
+
+bool JsonDecoder::ParseInteger(const Token* t, int64* out) {
+  const char* p = buffer_.data() + t->begin_;
+  const char* const end = buffer_.data() + t->end_;
+  if ( !t->escaped_ ) {
+    // The usual case: a plain decimal, that surely fits in 64 bits
+    const bool negative = (p < end && *p == '-');
+    const char* const digits = negative ? p + 1 : p;
+    const int32 num_digits = end - digits;
+    if ( num_digits > 0 && num_digits <= 18 &&
+         (*digits != '0' || num_digits == 1) ) {
+      int64 value = 0;
+      const char* d = digits;
+      for ( ; d < end && *d >= '0' && *d <= '9'; ++d ) {
+        value = value * 10 + (*d - '0');
+      }
+      if ( d == end ) {
+        *out = negative ? -value : value;
+        return true;
+      }
+    }
+  }
+  // Anything else (hex, octal, overflows, errors..)
+  const string s(t->escaped_ ? strutil::JsonStrUnescape(p, end - p)
+                             : string(p, end - p));
+  char* endp;
+  errno = 0;
+  const long long int l = strtoll(s.c_str(), &endp, 0);
+  if ( errno || s.c_str() == endp || *endp != '\0' ) {
+    DLOG_ERROR << "Json: Got wrong data for int: " << s;
+    return false;
+  }
+  *out = l;
+  return true;
+}
+
 DECODE_RESULT JsonDecoder::Decode(io::MemoryStream& in, double* out) {
-  return ReadNumber(in, out, true , decoding_map_key_);
+  DECODE_RESULT result;
+  const Token* const t = ReadToken(in, decoding_map_key_ ? '"' : 'a',
+                                   &result);
+  if ( t == NULL ) {
+    return result;
+  }
+  const char* const p = buffer_.data() + t->begin_;
+  const string s(t->escaped_ ? strutil::JsonStrUnescape(p, t->end_ - t->begin_)
+                             : string(p, t->end_ - t->begin_));
+  char* endp;
+  errno = 0;
+  const double d = strtod(s.c_str(), &endp);
+  if ( errno || s.c_str() == endp || *endp != '\0' ) {
+    DLOG_ERROR << "Json: Got wrong data for double: " << s;
+    return Error();
+  }
+  *out = d;
+  return DECODE_RESULT_SUCCESS;
 }
 
 DECODE_RESULT JsonDecoder::Decode(io::MemoryStream& in, string* out) {
-  string s;
-  const io::TokenReadError res = in.ReadNextAsciiToken(&s);
-  if ( res == io::TOKEN_NO_DATA ) {
-    return DECODE_RESULT_NOT_ENOUGH_DATA;
-  }
-  if ( res == io::TOKEN_QUOTED_OK ) {
-    DCHECK_GE(s.size(), 2);
-      *out = strutil::JsonStrUnescape(s.substr(1, s.length() - 2));
-      return DECODE_RESULT_SUCCESS;
+  DECODE_RESULT result;
+  const Token* const t = ReadToken(in, '"', &result);
+  if ( t == NULL ) {
+    return result;
   }
-  DLOG_ERROR << "Json Decoder bad string: " << res << " Got: " << s;
-  return DECODE_RESULT_ERROR;
+  const char* const p = buffer_.data() + t->begin_;
+  if ( t->escaped_ ) {
+    *out = strutil::JsonStrUnescape(p, t->end_ - t->begin_);
+  } else {
+    out->assign(p, t->end_ - t->begin_);
+  }
+  return DECODE_RESULT_SUCCESS;
 }
 
 DECODE_RESULT JsonDecoder::ReadRawObject(io::MemoryStream& in,
                                          io::MemoryStream* out) {
-  deque<char> paranthesis;
-  in.MarkerSet();
-  do {
-    string s;
-    const io::TokenReadError res = in.ReadNextAsciiToken(&s);
-    switch ( res ) {
-      case io::TOKEN_OK:
-      case io::TOKEN_QUOTED_OK:
-        out->Write(s);
-        break;
-      case io::TOKEN_SEP_OK:
-        out->Write(s);
-        if ( s == "{" ) {
-          paranthesis.push_back('}');
-        } else if ( s == "[" ) {
-          paranthesis.push_back(']');
-        } else if ( s == "}" || s == "]" ) {
-          if ( paranthesis.empty() ) {
-            DLOG_DEBUG << "Json Decoder: Badly started paranthesis";
-            in.MarkerClear();
-            return DECODE_RESULT_ERROR;
-          }
-          const char p = paranthesis.back();
-          paranthesis.pop_back();
-          if ( p != s[0] ) {
-            DLOG_DEBUG << "Json Decoder: Badly closed paranthesis: "
-                       << "expecting: " << p;
-            in.MarkerClear();
-            return DECODE_RESULT_ERROR;
-          }
-        }
-        break;
-      case io::TOKEN_ERROR_CHAR:
-        in.MarkerClear();
-        return DECODE_RESULT_ERROR;
-      case io::TOKEN_NO_DATA:
-        in.MarkerRestore();
-        return DECODE_RESULT_NOT_ENOUGH_DATA;
-    }
-  } while ( !paranthesis.empty() );
-  in.MarkerClear();
-  out->Write(" ");    // append always a separator at the end in this cases..
-  return DECODE_RESULT_SUCCESS;
-}
-
-DECODE_RESULT JsonDecoder::ReadExpectedSeparator(io::MemoryStream& in,
-                                                 char expected) {
-  string s;
-  const io::TokenReadError res = in.ReadNextAsciiToken(&s);
-  if ( res == io::TOKEN_NO_DATA ) {
-    return DECODE_RESULT_NOT_ENOUGH_DATA;
-  }
-  if ( s[0] == expected ) {
-    return DECODE_RESULT_SUCCESS;      // read the expected char
+  const DECODE_RESULT result = PrepareTape(in);
+  if ( result != DECODE_RESULT_SUCCESS ) {
+    return result;
   }
-  if ( res != io::TOKEN_SEP_OK ) {
-    LOG_ERROR << "Expected '" << expected << "', but found: " << s
-              << " - erros: " << res;
-    return DECODE_RESULT_ERROR;
+  const Token& t = tape_[tape_pos_];
+  uint32 begin = t.begin_;
+  uint32 end = t.end_;
+  switch ( t.type_ ) {
+    case '{':
+    case '[':
+      end = tape_[t.match_].end_;
+      tape_pos_ = t.match_ + 1;
+      break;
+    case '"':
+      // include the quotes
+      --begin;
+      ++end;
+      ++tape_pos_;
+      break;
+    case 'a':
+      ++tape_pos_;
+      break;
+    default:
+      DLOG_DEBUG << "Json Decoder: Raw object starts w/: " << t.type_;
+      return Error();
   }
-  return DECODE_RESULT_ERROR;
+  out->Write(buffer_.data() + begin, end - begin);
+  out->Write(" ");    // append always a separator at the end in this cases..
+  return DECODE_RESULT_SUCCESS;
 }
 
 }
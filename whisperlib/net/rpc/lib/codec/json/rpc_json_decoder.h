@@ -33,16 +33,30 @@
 #define __NET_RPC_LIB_CODEC_JSON_RPC_JSON_DECODER_H__
 
 #include <string>
+#include <vector>
 #include <whisperlib/net/rpc/lib/codec/rpc_decoder.h>
 
 namespace rpc {
 
+// Decodes JSON in two steps:
+//  - when asked to decode a new (top level) value, we scan it all at once
+//    from the input stream and record its tokens in a "tape" (type and
+//    position of each token, and for brackets the index of the matching
+//    bracket). If the value is incomplete we return
+//    DECODE_RESULT_NOT_ENOUGH_DATA and leave the stream untouched;
+//    else the value is consumed from the stream.
+//  - the Decode* calls for the parts of the value (as issued by the
+//    generated code) just walk the tape and convert the tokens in place,
+//    w/o touching the stream again.
+// On any error the rest of the current value is dropped.
 class JsonDecoder : public rpc::Decoder {
  public:
   JsonDecoder()
       : Decoder(kCodecIdJson),
         decoding_map_key_(false),
-        is_first_item_(true) { }
+        tape_pos_(0),
+        scan_pos_(0),
+        value_end_(0) { }
   virtual ~JsonDecoder() { }
 
   //////////////////////////////////////////////////////////////////////
@@ -88,9 +102,11 @@ class JsonDecoder : public rpc::Decoder {
     return Decoder::Decode(in, out);
   }
 
+  // Drops the rest of the current value, if any (e.g. when a SerializeLoad
+  // gave up in the middle of a structure).
   void Reset1() {
-    is_first_item_ = true;
     decoding_map_key_ = false;
+    ClearTape();
   }
 
   // Reads raw data of the next value. You don't have to know the type.
@@ -121,71 +137,92 @@ class JsonDecoder : public rpc::Decoder {
     }
     return true;
   }
+
  private:
-  DECODE_RESULT DecodeElementContinue(io::MemoryStream& in,
-                                      bool* more_attribs,
-                                      const char* separator);
+  struct Token {
+    // One of: { } [ ] , : for separators, " for strings (either quote
+    // char), 'a' for anything else (numbers, true, false, null).
+    char type_;
+    // true for strings that need unescaping (have escapes or non ASCII
+    // chars)
+    bool escaped_;
+    // The token text in buffer_ (w/o the quotes, for strings)
+    uint32 begin_;
+    uint32 end_;
+    // For { and [ - the index of the matching bracket in tape_
+    uint32 match_;
+  };
 
-  // read next stuff and expect it to be a separator
-  DECODE_RESULT ReadExpectedSeparator(io::MemoryStream& in,
-                                      char expected);
+  // Makes sure we have a tape w/ unread tokens - scanning a new value
+  // from in, if needed.
+  DECODE_RESULT PrepareTape(io::MemoryStream& in);
+  // Appends to the tape the tokens in buffer_ from scan_pos_ on. Returns
+  // SUCCESS when the value completed, NOT_ENOUGH_DATA if we need more.
+  DECODE_RESULT ScanTape();
+  void ClearTape() {
+    tape_.clear();
+    tape_pos_ = 0;
+    scan_pos_ = 0;
+    value_end_ = 0;
+    open_brackets_.clear();
+  }
+  // Returns the next token, if of the expected type (and advances).
+  // Else returns NULL and drops the tape.
+  const Token* ReadToken(io::MemoryStream& in, char type,
+                         DECODE_RESULT* result);
+  // Handles the ',' - or end bracket - between the elements of a
+  // struct / array / map
+  DECODE_RESULT DecodeElementContinue(io::MemoryStream& in,
+                                      bool* more_elements,
+                                      char end_bracket);
+  // Drops the tape and returns DECODE_RESULT_ERROR
+  DECODE_RESULT Error();
 
+  // Converts a number token. Map keys come as strings.
   template <typename T>
-  DECODE_RESULT ReadNumber(io::MemoryStream& in,
-                           T* out,
-                           bool is_floating_point = false,
-                           bool has_quotes = false) {
-    string s;
-    const io::TokenReadError res = in.ReadNextAsciiToken(&s);
-    switch ( res ) {
-      case io::TOKEN_NO_DATA:
-        return DECODE_RESULT_NOT_ENOUGH_DATA;
-      case io::TOKEN_OK:
-        if ( has_quotes ) {
-          DLOG_ERROR << "Json: Expecting quotes, got a no quotes token: "
-                     << s;
-          return DECODE_RESULT_ERROR;
-        }
-        break;
-      case io::TOKEN_QUOTED_OK:
-        if ( !has_quotes ) {
-          DLOG_ERROR << "Json: Expecting non-quoted, got a no quoted token: "
-                     << s;
-          return DECODE_RESULT_ERROR;
-        }
-        s = strutil::JsonStrUnescape(s.substr(1, s.length() - 2));
-        break;
-      default:
-        DLOG_ERROR << "Json: Error decoding expected number";
-        return DECODE_RESULT_ERROR;
+  DECODE_RESULT ReadInteger(io::MemoryStream& in, T* out) {
+    DECODE_RESULT result;
+    const Token* const t = ReadToken(in, decoding_map_key_ ? '"' : 'a',
+                                     &result);
+    if ( t == NULL ) {
+      return result;
     }
-    char *endp;
-    errno = 0;
-    if ( !is_floating_point ) {
-      long long int l = strtoll(s.c_str(), &endp, 0);
-      if ( !errno && s.c_str() != endp && *endp == '\0' ) {
-        *out = l;
-        return DECODE_RESULT_SUCCESS;
-      } else {
-        DLOG_ERROR << "Json: Got wrong data for int: " << s;
-      }
-    } else {
-      double d = strtod(s.c_str(), &endp);
-      if ( !errno && s.c_str() != endp && *endp == '\0') {
-        *out = d;
-        return DECODE_RESULT_SUCCESS;
-      }
-      DLOG_ERROR << "Json: Got wrong data for double: " << s;
+    int64 value;
+    if ( !ParseInteger(t, &value) ) {
+      return Error();
     }
-    return DECODE_RESULT_ERROR;
+    // Reject what does not fit in T (for int32 / uint32 - the 64 bit
+    // overflows are caught by ParseInteger)
+    if ( sizeof(T) < sizeof(value) &&
+         static_cast<int64>(static_cast<T>(value)) != value ) {
+      DLOG_ERROR << "Json: Integer out of range: " << value;
+      return Error();
+    }
+    *out = value;
+    return DECODE_RESULT_SUCCESS;
   }
+  bool ParseInteger(const Token* t, int64* out);
 
  private:
   // if true we're decoding the key of a map
   // usefull in decoding map<int, ... > as map<string, ... >
   // because javascript does not support map<int..>
   bool decoding_map_key_;
-  bool is_first_item_;
+
+  // The text of the current value
+  string buffer_;
+  // The tokens of the current value
+  vector<Token> tape_;
+  // The next token to return
+  uint32 tape_pos_;
+  // Where we are w/ the scan in buffer_
+  uint32 scan_pos_;
+  // The end of the value in buffer_ (when fully scanned)
+  uint32 value_end_;
+  // Tape indices of the brackets not yet closed (while scanning)
+  vector<uint32> open_brackets_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(JsonDecoder);
 };
 }
 #endif   // __NET_RPC_LIB_CODEC_JSON_RPC_JSON_DECODER_H__
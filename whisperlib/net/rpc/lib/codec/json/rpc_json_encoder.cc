@@ -36,4 +36,28 @@
 
 namespace rpc {
 
+namespace {
+// True if str has chars that strutil::JsonStrEscape changes
+bool NeedsJsonEscape(const string& str) {
+  for ( size_t i = 0; i < str.size(); ++i ) {
+    const uint8 c = str[i];
+    if ( c < ' ' || c > '~' || c == '\\' || c == '"' || c == '/' ) {
+      return true;
+    }
+  }
+  return false;
+}
+}
+
+void JsonEncoder::Encode(const string& str, io::MemoryStream* out) {
+  Append("\"", 1, out);
+  if ( !NeedsJsonEscape(str) ) {
+    pending_.append(str);
+  } else {
+    pending_.append(strutil::JsonStrEscape(str));
+  }
+  pending_.append("\"", 1);
+  EndValue();
+}
+
 }
@@ -32,15 +32,28 @@
 #ifndef __NET_RPC_LIB_CODEC_JSON_RPC_JSON_ENCODER_H__
 #define __NET_RPC_LIB_CODEC_JSON_RPC_JSON_ENCODER_H__
 
+#include <stdio.h>
 #include <string>
 #include <whisperlib/net/rpc/lib/codec/rpc_encoder.h>
 
 namespace rpc {
 
+// Encodes to JSON. The output is put together in an internal buffer and
+// written to the output stream in one piece when a top level value is
+// complete (or when the buffer gets large), instead of many small writes.
+// NOTE: so the output of a structure / array / map appears in the
+//       output stream only after its End.. call.
 class JsonEncoder : public Encoder {
  public:
-  JsonEncoder() : Encoder(kCodecIdJson), encoding_map_key_(false) {}
-  virtual ~JsonEncoder() {}
+  JsonEncoder()
+      : Encoder(kCodecIdJson),
+        encoding_map_key_(false),
+        depth_(0),
+        out_(NULL) {
+  }
+  virtual ~JsonEncoder() {
+    DCHECK(pending_.empty()) << " Unbalanced encoding, lost: " << pending_;
+  }
 
   template<class C>
   static void EncodeToString(const C& obj, string* out) {
@@ -61,39 +74,45 @@ class JsonEncoder : public Encoder {
   //
   //                   rpc::Encoder interface methods
   //
-  void EncodeStructStart(uint32, io::MemoryStream* out) { out->Write("{"); }
-  void EncodeStructContinue(io::MemoryStream* out)      { out->Write(", "); }
-  void EncodeStructEnd(io::MemoryStream* out)           { out->Write("}"); }
+  void EncodeStructStart(uint32, io::MemoryStream* out) { Open("{", out); }
+  void EncodeStructContinue(io::MemoryStream* out)      { Append(", ", 2, out); }
+  void EncodeStructEnd(io::MemoryStream* out)           { Close("}", out); }
   void EncodeStructAttribStart(io::MemoryStream* out)   {  }
-  void EncodeStructAttribMiddle(io::MemoryStream* out)  { out->Write(": "); }
+  void EncodeStructAttribMiddle(io::MemoryStream* out)  { Append(": ", 2, out); }
   void EncodeStructAttribEnd(io::MemoryStream* out)     {  }
-  void EncodeArrayStart(uint32, io::MemoryStream* out)  { out->Write("["); }
-  void EncodeArrayContinue(io::MemoryStream* out)       { out->Write(", "); }
-  void EncodeArrayEnd(io::MemoryStream* out)            { out->Write("]"); }
-  void EncodeMapStart(uint32, io::MemoryStream* out)    { out->Write("{"); }
-  void EncodeMapContinue(io::MemoryStream* out)         { out->Write(", "); }
-  void EncodeMapEnd(io::MemoryStream* out)              { out->Write("}"); }
+  void EncodeArrayStart(uint32, io::MemoryStream* out)  { Open("[", out); }
+  void EncodeArrayContinue(io::MemoryStream* out)       { Append(", ", 2, out); }
+  void EncodeArrayEnd(io::MemoryStream* out)            { Close("]", out); }
+  void EncodeMapStart(uint32, io::MemoryStream* out)    { Open("{", out); }
+  void EncodeMapContinue(io::MemoryStream* out)         { Append(", ", 2, out); }
+  void EncodeMapEnd(io::MemoryStream* out)              { Close("}", out); }
   void EncodeMapPairStart(io::MemoryStream* out)        { encoding_map_key_ = true; }
-  void EncodeMapPairMiddle(io::MemoryStream* out)       { out->Write(": ");
+  void EncodeMapPairMiddle(io::MemoryStream* out)       { Append(": ", 2, out);
                                                           encoding_map_key_ = false; }
   void EncodeMapPairEnd(io::MemoryStream* out)          {  }
 
 #define PrintBody(format, object, out_ms)                               \
   do {                                                                  \
-      if ( !encoding_map_key_ ) {                                       \
-        out_ms->Write(strutil::StringPrintf(                            \
-                        format" ", object));                            \
-      } else {                                                          \
-        out_ms->Write(strutil::StringPrintf(                            \
-                        "\""format"\"", object));                       \
-      }                                                                 \
-    } while(false)
+    char buf[64];                                                       \
+    const int len = !encoding_map_key_                                  \
+        ? snprintf(buf, sizeof(buf), format " ", object)                \
+        : snprintf(buf, sizeof(buf), "\"" format "\"", object);         \
+    Append(buf, len, out_ms);                                           \
+    EndValue();                                                         \
+  } while ( false )
 
+  // NOTE: we put a space after atoms, so a top level one is delimited.
   virtual void Encode(const rpc::Void&, io::MemoryStream* out) {
-    out->Write("null");
+    Append("null ", 5, out);
+    EndValue();
   }
   virtual void Encode(const bool v, io::MemoryStream* out) {
-    out->Write(v ? "true" : "false");
+    if ( v ) {
+      Append("true ", 5, out);
+    } else {
+      Append("false ", 6, out);
+    }
+    EndValue();
   }
   virtual void Encode(const int32 v, io::MemoryStream* out) {
     PrintBody("%d", v, out);
@@ -102,19 +121,18 @@ class JsonEncoder : public Encoder {
     PrintBody("%u", v, out);
   }
   virtual void Encode(const int64 v, io::MemoryStream* out) {
-    PrintBody("%"PRId64, v, out);
+    PrintBody("%" PRId64, v, out);
   }
   virtual void Encode(const uint64 v, io::MemoryStream* out) {
-    PrintBody("%"PRIu64, v, out);
+    PrintBody("%" PRIu64, v, out);
   }
   virtual void Encode(const double v, io::MemoryStream* out) {
-    PrintBody("%.60e", v, out);
-  }
-  virtual void Encode(const string& str, io::MemoryStream* out) {
-    out->Write("\"");
-    out->Write(strutil::JsonStrEscape(str));
-    out->Write("\"");
+    // 17 significant digits are enough to read back the same double
+    PrintBody("%.17g", v, out);
   }
+  virtual void Encode(const string& str, io::MemoryStream* out);
+
+#undef PrintBody
 
   // these methods are public in the base class, but because of some compiler
   // issue they need to be re-declared here.
@@ -126,14 +144,60 @@ class JsonEncoder : public Encoder {
   void Encode(const rpc::Message& m, io::MemoryStream* out) { Encoder::Encode(m, out); }
 
   virtual void WriteRawObject(const io::MemoryStream& obj, io::MemoryStream* out) {
+    if ( out != out_ ) {
+      Flush();
+      out_ = out;
+    }
+    Flush();
     out->AppendStreamNonDestructive(&obj);
   }
 
  private:
+  // We write the pending output when it gets over this size, even in the
+  // middle of a value
+  static const size_t kMaxPendingSize = 16384;
+
+  void Append(const char* s, size_t len, io::MemoryStream* out) {
+    if ( out != out_ ) {
+      Flush();
+      out_ = out;
+    }
+    pending_.append(s, len);
+  }
+  void Open(const char* bracket, io::MemoryStream* out) {
+    Append(bracket, 1, out);
+    ++depth_;
+  }
+  void Close(const char* bracket, io::MemoryStream* out) {
+    Append(bracket, 1, out);
+    DCHECK_GT(depth_, 0);
+    --depth_;
+    EndValue();
+  }
+  // Called after each complete value
+  void EndValue() {
+    if ( depth_ <= 0 || pending_.size() >= kMaxPendingSize ) {
+      Flush();
+    }
+  }
+  void Flush() {
+    if ( !pending_.empty() ) {
+      out_->Write(pending_);
+      pending_.clear();
+    }
+  }
+
   // if true we're encoding the key of a map.
   // useful in encoding map<int, ... > as map<string, ... >
   // because javascript does not support map<int..>
   bool encoding_map_key_;
+  // How many structures / arrays / maps we are in
+  int32 depth_;
+  // Where the pending_ output goes
+  io::MemoryStream* out_;
+  // Output not yet written to out_
+  string pending_;
+
   DISALLOW_EVIL_CONSTRUCTORS(JsonEncoder);
 };
 }
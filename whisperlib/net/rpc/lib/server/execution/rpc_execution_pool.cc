@@ -29,7 +29,12 @@
 //
 // Author: Cosmin Tudorache
 
+#include <sched.h>
+#include <algorithm>
 #include "common/base/errno.h"
+#include "common/base/timer.h"
+#include "common/base/strutil.h"
+#include "common/sync/atomic.h"
 #include "net/rpc/lib/server/execution/rpc_execution_pool.h"
 #include "net/rpc/lib/server/execution/rpc_execution_worker.h"
 
@@ -39,21 +44,28 @@ rpc::ExecutionPool::ExecutionPool(rpc::ServicesManager& servicesManager,
                                   uint64 max_concurent_queries)
     : IAsyncQueryExecutor(max_concurent_queries),
       servicesManager_(servicesManager),
-      queries_(),
-      sync_queries_(),
-      new_query_(false, true),
+      queries_(max(max_concurent_queries, static_cast<uint64>(1))),
+      high_watermark_(max_concurent_queries * 3 / 4),
       workers_(),
+      num_workers_(0),
+      num_wakers_(0),
+      idle_workers_(
+          new synch::LockFreeQueue<rpc::ExecutionWorker*>(kMaxWorkers)),
       completion_callback_(
-          NewPermanentCallback(this, &rpc::ExecutionPool::QueryCompleted)) {
+          NewPermanentCallback(this, &rpc::ExecutionPool::QueryCompleted)),
+      num_rejected_(0) {
+  ResetStats();
 }
 
 rpc::ExecutionPool::~ExecutionPool() {
   Stop();
-  while ( !queries_.empty() ) {
-    rpc::Query* q = queries_.front();
-    queries_.pop_front();
-    delete q;
+  QueuedQuery qq;
+  while ( queries_.Get(&qq) ) {
+    delete qq.query_;
   }
+  delete completion_callback_;
+  completion_callback_ = NULL;
+  delete idle_workers_;
 }
 
 rpc::ServicesManager& rpc::ExecutionPool::GetServicesManager() {
@@ -61,17 +73,24 @@ rpc::ServicesManager& rpc::ExecutionPool::GetServicesManager() {
 }
 
 bool rpc::ExecutionPool::Start(uint32 nWorkers) {
-  if ( IsRunning() ) {
+  if ( IsRunning() || nWorkers == 0 ) {
     return false;
   }
+  if ( nWorkers > kMaxWorkers ) {
+    LOG_ERROR << "Too many workers: " << nWorkers << " > " << kMaxWorkers;
+    return false;
+  }
+  synch::AtomicAddAndFetch(&num_workers_, static_cast<int32>(nWorkers));
   for ( uint32 i = 0; i < nWorkers; i++ ) {
     rpc::ExecutionWorker* const w = new rpc::ExecutionWorker(*this);
     if ( !w->Start() ) {
       LOG_ERROR << "Failed to start worker #" << i
                 << " reason: " << GetLastSystemErrorDescription();
       delete w;
+      Stop();
       return false;
     }
+    synch::MutexLocker l(&mutex_);
     workers_.push_back(w);
   }
   LOG_INFO << "Started. " << nWorkers << " workers running...";
@@ -79,43 +98,95 @@ bool rpc::ExecutionPool::Start(uint32 nWorkers) {
 }
 
 void rpc::ExecutionPool::Stop() {
-  if ( !IsRunning() ) {
+  const int32 num_workers = synch::AtomicLoad(&num_workers_);
+  if ( num_workers == 0 ) {
     // if we're not running => do nothing
     return;
   }
-  // stop & destroy all workers
-  LOG_INFO << "Stopping... (" << workers_.size() << " workers active)";
-  while ( !workers_.empty() ) {
-    rpc::ExecutionWorker* const w = workers_.front();
-    workers_.pop_front();
-    w->Stop();
-    delete w;
+  vector<rpc::ExecutionWorker*> workers;
+  {
+    synch::MutexLocker l(&mutex_);
+    workers.swap(workers_);
+  }
+  // From now on WakeUpWorker() does nothing - wait for the calls already
+  // in progress, which may still hold a worker from idle_workers_
+  synch::AtomicSubAndFetch(&num_workers_, num_workers);
+  while ( synch::AtomicLoad(&num_wakers_) > 0 ) {
+    sched_yield();
+  }
+  LOG_INFO << "Stopping... (" << workers.size() << " workers active)";
+  for ( uint32 i = 0; i < workers.size(); ++i ) {
+    workers[i]->Stop();
+  }
+  // the stopped workers may still be in idle_workers_
+  rpc::ExecutionWorker* w;
+  while ( idle_workers_->Get(&w) ) {
+    w->queued_ = 0;
+  }
+  while ( !workers.empty() ) {
+    delete workers.back();
+    workers.pop_back();
   }
   LOG_INFO << "Stopped.";
 }
 
 bool rpc::ExecutionPool::IsRunning() {
-  return !workers_.empty();
+  return synch::AtomicLoad(&num_workers_) > 0;
 }
 
-rpc::Query* rpc::ExecutionPool::WaitForQuery(uint32 timeout) {
-  // wait for a new query
-  if ( !new_query_.Wait(timeout) ) {
-    // timeout = no query, or system error (check GetLastError())
-    return NULL;
+uint32 rpc::ExecutionPool::WaitForQueries(rpc::ExecutionWorker* worker,
+                                          rpc::Query** out, uint32 max_count,
+                                          uint32 timeout) {
+  // Take our fair share of the queue - leave something for the others
+  // (when the queue is short, we just take one query at a time).
+  QueuedQuery batch[kMaxBatchSize];
+  const int32 num_workers = synch::AtomicLoad(&num_workers_);
+  const uint32 share = queries_.Size() / max(num_workers, 1);
+  max_count = min(max_count, min(kMaxBatchSize, max(share, 1U)));
+
+  uint32 count = queries_.GetBatch(batch, max_count);
+  if ( count == 0 ) {
+    // Park the worker. We first announce that we are idle, then look
+    // again in the queue - so a query queued meanwhile will either be
+    // seen here, or its producer will see us in idle_workers_.
+    worker->idle_ = 1;
+    if ( __sync_bool_compare_and_swap(&worker->queued_, 0, 1) &&
+         !idle_workers_->Put(worker) ) {
+      worker->queued_ = 0;
+    }
+    count = queries_.GetBatch(batch, 1);
+    if ( count == 0 ) {
+      worker->wakeup_.Wait(timeout);
+      count = queries_.GetBatch(batch, 1);
+    }
+    // nobody woke us up - we are no longer idle anyway
+    __sync_bool_compare_and_swap(&worker->idle_, 1, 0);
   }
-  // dequeue the new query and return it
-  synch::MutexLocker lock(&sync_queries_);
-  if ( queries_.empty() ) {
-    new_query_.Reset();
-    return NULL;
+
+  const int64 now = timer::TicksUsec();
+  for ( uint32 i = 0; i < count; ++i ) {
+    RecordQueueLatency(now - batch[i].queue_ts_);
+    out[i] = batch[i].query_;
   }
-  rpc::Query* const q = queries_.front();
-  queries_.pop_front();
-  if ( queries_.empty() ) {
-    new_query_.Reset();
+  return count;
+}
+
+void rpc::ExecutionPool::WakeUpWorker() {
+  // Stop() deletes the workers once it sees no wakers and no workers
+  synch::AtomicAddAndFetch(&num_wakers_, 1);
+  if ( synch::AtomicLoad(&num_workers_) > 0 ) {
+    rpc::ExecutionWorker* w;
+    while ( idle_workers_->Get(&w) ) {
+      w->queued_ = 0;
+      __sync_synchronize();
+      // may have woken up on timeout in the meantime - try the next one
+      if ( __sync_bool_compare_and_swap(&w->idle_, 1, 0) ) {
+        w->wakeup_.Signal();
+        break;
+      }
+    }
   }
-  return q;
+  synch::AtomicSubAndFetch(&num_wakers_, 1);
 }
 
 void rpc::ExecutionPool::QueryCompleted(const rpc::Query& q) {
@@ -123,10 +194,81 @@ void rpc::ExecutionPool::QueryCompleted(const rpc::Query& q) {
 }
 
 bool rpc::ExecutionPool::InternalQueueRPC(rpc::Query* q) {
-  synch::MutexLocker lock(&sync_queries_);
   q->SetCompletionCallback(completion_callback_);
-  queries_.push_back(q);
-  new_query_.Signal();
+  QueuedQuery qq;
+  qq.query_ = q;
+  qq.queue_ts_ = timer::TicksUsec();
+  while ( !queries_.Put(qq) ) {
+    if ( queries_.Size() >= queries_.capacity() ) {
+      synch::AtomicAddAndFetch(&num_rejected_, static_cast<int64>(1));
+      q->Complete(RPC_SERVER_BUSY);
+      return true;
+    }
+    // Not really full: a worker claimed the next cell but did not
+    // release it yet (was preempted) - let it finish.
+    sched_yield();
+  }
+  WakeUpWorker();
   return true;
 }
+
+bool rpc::ExecutionPool::IsOverloaded() const {
+  return queries_.Size() >= high_watermark_;
+}
+
+void rpc::ExecutionPool::RecordQueueLatency(int64 latency_us) {
+  int bucket = 0;
+  while ( latency_us > 0 && bucket < kNumLatencyBuckets - 1 ) {
+    latency_us >>= 1;
+    ++bucket;
+  }
+  synch::AtomicAddAndFetch(&latency_buckets_[bucket], static_cast<int64>(1));
+}
+
+int64 rpc::ExecutionPool::num_dequeued() const {
+  int64 total = 0;
+  for ( int i = 0; i < kNumLatencyBuckets; ++i ) {
+    total += latency_buckets_[i];
+  }
+  return total;
+}
+
+int64 rpc::ExecutionPool::QueueLatencyPercentileUs(double p) const {
+  int64 buckets[kNumLatencyBuckets];
+  int64 total = 0;
+  for ( int i = 0; i < kNumLatencyBuckets; ++i ) {
+    buckets[i] = latency_buckets_[i];
+    total += buckets[i];
+  }
+  if ( total == 0 ) {
+    return 0;
+  }
+  const int64 rank = max(static_cast<int64>(p * total + 0.5),
+                         static_cast<int64>(1));
+  int64 crt = 0;
+  for ( int i = 0; i < kNumLatencyBuckets; ++i ) {
+    crt += buckets[i];
+    if ( crt >= rank ) {
+      return static_cast<int64>(1) << i;
+    }
+  }
+  return static_cast<int64>(1) << (kNumLatencyBuckets - 1);
+}
+
+void rpc::ExecutionPool::ResetStats() {
+  for ( int i = 0; i < kNumLatencyBuckets; ++i ) {
+    latency_buckets_[i] = 0;
+  }
+  num_rejected_ = 0;
+}
+
+string rpc::ExecutionPool::StatsString() const {
+  return strutil::StringPrintf(
+      "ExecutionPool{workers: %d, queued: %u, dequeued: %" PRId64
+      ", rejected: %" PRId64 ", queue latency p50: %" PRId64
+      "us, p99: %" PRId64 "us}",
+      synch::AtomicLoad(&num_workers_), queue_size(), num_dequeued(),
+      num_rejected_,
+      QueueLatencyPercentileUs(0.50), QueueLatencyPercentileUs(0.99));
+}
 }
@@ -32,10 +32,11 @@
 #ifndef __NET_RPC_LIB_RPC_SERVER_EXECUTION_RPC_EXECUTION_POOL__
 #define __NET_RPC_LIB_RPC_SERVER_EXECUTION_RPC_EXECUTION_POOL__
 
-#include <list>
+#include <vector>
+#include <string>
 #include <whisperlib/common/base/types.h>
+#include <whisperlib/common/sync/lock_free_queue.h>
 #include <whisperlib/common/sync/mutex.h>
-#include <whisperlib/common/sync/event.h>
 #include <whisperlib/net/rpc/lib/server/irpc_async_query_executor.h>
 #include <whisperlib/net/rpc/lib/server/irpc_result_handler.h>
 #include <whisperlib/net/rpc/lib/server/rpc_services_manager.h>
@@ -44,9 +45,27 @@ namespace rpc {
 
 // This is the execution layer. It receives rpc::Querys, executes them and
 // passes the rpc::Response to the IResponseHandler.
+//
+// The queries wait for execution in a bounded lock free queue. Idle workers
+// park on their own event, and a new query wakes up exactly one of them
+// (no thundering herd on a shared event, no mutex on the hot path).
+// A worker takes the queries in batches (its fair share of the queue) to
+// reduce the number of wakeups under load.
+//
+// When the queue goes over a high watermark we report IsOverloaded(), and
+// the transport (rpc::ServerConnection) stops reading new queries for a
+// while. If the queue is full anyway, the query is completed right away
+// with RPC_SERVER_BUSY.
 class ExecutionWorker;
 class ExecutionPool : public IAsyncQueryExecutor {
  public:
+  // The maximum number of queries a worker takes from the queue at once.
+  static const uint32 kMaxBatchSize = 16;
+  // The maximum number of workers (the capacity of the idle workers queue).
+  static const uint32 kMaxWorkers = 1024;
+
+  // max_concurent_queries: we reject queries over this limit; this is
+  //                        also the capacity of the execution queue.
   ExecutionPool(rpc::ServicesManager& servicesManager,
                 uint64 max_concurent_queries = 999);
   virtual ~ExecutionPool();
@@ -63,25 +82,27 @@ class ExecutionPool : public IAsyncQueryExecutor {
   // Test if the execution pool is running.
   bool IsRunning();
 
-  //  Asynchronous called by every worker, to obtain a new query.
-  //  Gets a new query from the queries_ queue. If the queue is empty, the call
-  //  will wait untill a new query is queued or the timeout expires.
-  //  The worker will execute the obtained query and the result will comeback
-  //  through the completion handler QueryCompleted(..) in either way:
+  //  Called by every worker, to obtain new queries.
+  //  Extracts at most max_count queries from the queue in out. If the queue
+  //  is empty, the worker is parked until a new query is queued or the
+  //  timeout expires.
+  //  The worker will execute the obtained queries and the result will
+  //  comeback through the completion handler QueryCompleted(..) in either way:
   //   1. The implementation completes the query right away,
   //      calling the completion handler from the worker context.
   //   2. The implementation delays query execution (probably using a
   //      private thread) and the completion handler is called later from
   //      a private context.
   // returns:
-  //   - non-NULL = the query to be executed.
-  //   - NULL = timeout. No query available.
-  rpc::Query* WaitForQuery(uint32 timeout);
+  //   the number of queries in out - 0 on timeout.
+  uint32 WaitForQueries(rpc::ExecutionWorker* worker,
+                        rpc::Query** out, uint32 max_count,
+                        uint32 timeout);
 
   //  Asynchronous called (private thread context) to pass back a query's
   //  result.
   // input:
-  //   q: a query previously obtained by WaitForQuery(..),
+  //   q: a query previously obtained by WaitForQueries(..),
   //      executed in the meanwhile, and now containing the result.
   //      We need to propagate this query down to the transport layer.
   //
@@ -96,24 +117,64 @@ class ExecutionPool : public IAsyncQueryExecutor {
   //  When execution is completed the query is passed to QueryCompleted.
   bool InternalQueueRPC(rpc::Query* q);
 
+  // True when the queue is over the high watermark.
+  virtual bool IsOverloaded() const;
+
+  //////////////////////////////////////////////////////////////////////
+  //         statistics
+  //
+  // The number of queries waiting execution (approximate).
+  uint32 queue_size() const { return queries_.Size(); }
+  // The number of queries we rejected because the queue was full.
+  int64 num_rejected() const { return num_rejected_; }
+  // The number of queries that went through the queue.
+  int64 num_dequeued() const;
+  // The (approximate) percentile p (in [0, 1]) of the time the queries
+  // spent in the queue, in microseconds.
+  int64 QueueLatencyPercentileUs(double p) const;
+  // Resets the queue latency statistics.
+  void ResetStats();
+  string StatsString() const;
+
  protected:
-  ServicesManager& servicesManager_;
+  struct QueuedQuery {
+    rpc::Query* query_;
+    int64 queue_ts_;      // when it was queued (usec by CLOCK_MONOTONIC)
+  };
+  // Wakes up one idle worker (if any)
+  void WakeUpWorker();
+  // Accounts the time spent in queue by a dequeued query
+  void RecordQueueLatency(int64 latency_us);
 
-  list<rpc::Query*>queries_;    // queue of queries waiting execution
-  synch::Mutex sync_queries_;   // synchronize access to the queue of queries
+  ServicesManager& servicesManager_;
 
-  // Signals new queries.
-  // The QueueRPC method appends a new query and signals the event.
-  // The WaitForQuery method waits for this event and dequeues a query.
-  synch::Event new_query_;
+  // queue of queries waiting execution
+  synch::LockFreeQueue<QueuedQuery> queries_;
+  // IsOverloaded() when queries_ goes over this
+  const uint32 high_watermark_;
 
+  // protects workers_ (used only by Start() / Stop())
+  synch::Mutex mutex_;
   // the list of internal workers
-  list<rpc::ExecutionWorker*> workers_;
+  vector<rpc::ExecutionWorker*> workers_;
+  // the number of running workers, 0 when stopped (atomic)
+  int32 num_workers_;
+  // the WakeUpWorker() calls in progress - Stop() waits for them before
+  // deleting the workers (atomic)
+  int32 num_wakers_;
+  // the parked workers, waiting for a wakeup (lives as long as the pool)
+  synch::LockFreeQueue<rpc::ExecutionWorker*>* const idle_workers_;
 
   // a permanent callback to the local method QueryCompleted to be set in
   // every rpc::Query
   Callback1<const rpc::Query&>* completion_callback_;
 
+  // Queue latency histogram: bucket i counts the queries that waited
+  // less than 2^i microseconds (and at least 2^(i-1)).
+  static const int kNumLatencyBuckets = 32;
+  int64 latency_buckets_[kNumLatencyBuckets];
+  int64 num_rejected_;
+
  private:
   DISALLOW_EVIL_CONSTRUCTORS(ExecutionPool);
 };
@@ -52,18 +52,18 @@ void* rpc::ExecutionWorker::Run() {
   tid_ = pthread_self();
   // thread initialized
   evThreadInit_.Signal();
+  rpc::Query* queries[ExecutionPool::kMaxBatchSize];
   while ( !end_ ) {
-    // dequeue a new query
-    rpc::Query* q = pool_.WaitForQuery(100);
-    if ( !q ) {
-      // no queries available, try again
-      continue;
-    }
-    // execute the query
-    if ( !pool_.GetServicesManager().Call(q) ) {
-      q->Complete(RPC_SYSTEM_ERR,
-                  GetLastSystemErrorDescription());
-      continue;
+    // dequeue new queries
+    const uint32 count = pool_.WaitForQueries(
+        this, queries, ExecutionPool::kMaxBatchSize, 100);
+    // execute the queries (if none available, try again)
+    for ( uint32 i = 0; i < count; ++i ) {
+      rpc::Query* const q = queries[i];
+      if ( !pool_.GetServicesManager().Call(q) ) {
+        q->Complete(RPC_SYSTEM_ERR,
+                    GetLastSystemErrorDescription());
+      }
     }
   }
 
@@ -85,7 +85,10 @@ rpc::ExecutionWorker::ExecutionWorker(rpc::ExecutionPool& pool)
       end_(false),
       evThreadInit_(false, true),
       evThreadExit_(false, true),
-      pool_(pool) {
+      pool_(pool),
+      wakeup_(false, false),
+      idle_(0),
+      queued_(0) {
 }
 rpc::ExecutionWorker::~ExecutionWorker() {
   Stop();
@@ -133,6 +136,7 @@ void rpc::ExecutionWorker::Stop() {
   pthread_t tid = tid_;
   // set end signal
   end_ = true;
+  wakeup_.Signal();
   // wait for internal thread termination
   evThreadExit_.Wait(5000);
 
@@ -77,10 +77,18 @@ class ExecutionWorker {
   // the execution pool this worker is part of
   rpc::ExecutionPool& pool_;
 
+  // The pool parks an idle worker on this (and signals it on new queries)
+  synch::Event wakeup_;
+  // 1 while the worker is parked (and can be woken up), 0 otherwise
+  volatile int32 idle_;
+  // 1 while the worker is in the pool's idle_workers_ queue, 0 otherwise
+  volatile int32 queued_;
+
   static void* ThreadProc(void* param);
   void* Run();
 
  private:
+  friend class ExecutionPool;
   DISALLOW_EVIL_CONSTRUCTORS(ExecutionWorker);
 };
 }
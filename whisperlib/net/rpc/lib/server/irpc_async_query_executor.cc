@@ -29,6 +29,7 @@
 //
 // Author: Cosmin Tudorache
 
+#include "common/sync/atomic.h"
 #include "net/rpc/lib/server/irpc_async_query_executor.h"
 
 namespace rpc {
@@ -75,22 +76,21 @@ void IAsyncQueryExecutor::UnregisterResultHandler(
 }
 
 bool IAsyncQueryExecutor::QueueRPC(rpc::Query* q) {
+  #ifdef _DEBUG
   {
-    synch::MutexLocker lock(&sync_);
-
-    // one more query in execution
-    concurent_queries_++;
-
     // check we have the query's result handler registered
-    #ifdef _DEBUG
+    synch::MutexLocker lock(&sync_);
     CHECK(handlers_.find(q->rid()) != handlers_.end());
-    #endif
-
-    if ( concurent_queries_ >= max_concurent_queries_ ) {
-      q->SetCompletionCallback(return_result_callback_);
-      q->Complete(RPC_SERVER_BUSY);
-      return true;
-    }
+  }
+  #endif
+
+  // one more query in execution (no lock here - this is called for every
+  // query, from the selector, and would contend w/ ReturnResult)
+  if ( synch::AtomicAddAndFetch(&concurent_queries_, static_cast<uint64>(1))
+       >= max_concurent_queries_ ) {
+    q->SetCompletionCallback(return_result_callback_);
+    q->Complete(RPC_SERVER_BUSY);
+    return true;
   }
   // pass this query to executor implementation
   return InternalQueueRPC(q);
@@ -101,7 +101,7 @@ void IAsyncQueryExecutor::ReturnResult(const rpc::Query& q) {
   synch::MutexLocker lock(&sync_);
 
   // one less query in execution
-  concurent_queries_--;
+  synch::AtomicSubAndFetch(&concurent_queries_, static_cast<uint64>(1));
 
   MapOfResultHandlers::const_iterator it = handlers_.find(q.rid());
   if ( it == handlers_.end() ) {
@@ -67,6 +67,13 @@ class IAsyncQueryExecutor {
   //  completed with an error suitable status.
   bool QueueRPC(rpc::Query * q);
 
+  //  Returns true when the executor has too much work queued, and the
+  //  transport should stop reading new queries for a while (they would
+  //  only wait longer in queue, or be rejected w/ RPC_SERVER_BUSY).
+  virtual bool IsOverloaded() const {
+    return false;
+  }
+
  protected:
   //  Implementation specific, asynchronously executes the given query.
   //  When the execution finishes, the result is passed to ReturnResult(..).
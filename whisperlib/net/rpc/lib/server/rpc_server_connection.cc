@@ -235,7 +235,12 @@ rpc::ServerConnection::ServerConnection(
       decoder_(NULL),
       expectedWriteReplyCalls_(0),
       accessExpectedWriteReplyCalls_(),
-      auto_delete_on_close_(auto_delete_on_close) {
+      auto_delete_on_close_(auto_delete_on_close),
+      read_paused_(false),
+      resume_read_alarm_(*selector) {
+  resume_read_alarm_.Set(
+      NewPermanentCallback(this, &ServerConnection::ResumeReading), true,
+      kResumeReadIntervalMs, false, false);
   net_connection_->SetReadHandler(
       NewPermanentCallback(
           this, &ServerConnection::ConnectionReadHandler), true);
@@ -364,6 +369,11 @@ bool rpc::ServerConnection::ConnectionReadHandler() {
   CHECK_NOT_NULL(decoder_);
 
   while ( !in->IsEmpty() ) {
+    if ( asyncQueryExecutor_.IsOverloaded() ) {
+      // leave the rest of the queries in inbuf for later
+      PauseReading();
+      return true;
+    }
     // set a marker, to be able to restore read data on incomplete packets.
     in->MarkerSet();
 
@@ -416,6 +426,8 @@ void rpc::ServerConnection::ConnectionCloseHandler(
   LOG_INFO << "Closed connection to " << net_connection_->remote_address()
            << " err: " << GetSystemErrorDescription(err);
 
+  resume_read_alarm_.Stop();
+
   // stop RPC result receiving
   if ( registeredToQueryExecutor_ ) {
     asyncQueryExecutor_.UnregisterResultHandler(*this);
@@ -423,6 +435,32 @@ void rpc::ServerConnection::ConnectionCloseHandler(
   }
 }
 
+void rpc::ServerConnection::PauseReading() {
+  if ( !read_paused_ ) {
+    LOG_DEBUG << ToString() << " executor overloaded, pause reading";
+    read_paused_ = true;
+    net_connection_->RequestReadEvents(false);
+  }
+  resume_read_alarm_.Start();
+}
+
+void rpc::ServerConnection::ResumeReading() {
+  if ( net_connection_->state() != net::NetConnection::CONNECTED ) {
+    return;
+  }
+  if ( asyncQueryExecutor_.IsOverloaded() ) {
+    resume_read_alarm_.Start();
+    return;
+  }
+  LOG_DEBUG << ToString() << " resume reading";
+  read_paused_ = false;
+  net_connection_->RequestReadEvents(true);
+  // process the queries we left in inbuf
+  if ( !ConnectionReadHandler() ) {
+    net_connection_->ForceClose();
+  }
+}
+
 void rpc::ServerConnection::HandleRPCResult(const rpc::Query& q) {
   WriteReply(q.qid(), q.status(), q.result());
 }
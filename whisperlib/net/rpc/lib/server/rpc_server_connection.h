@@ -34,6 +34,7 @@
 
 #include <string>
 #include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/alarm.h>
 #include <whisperlib/common/io/buffer/io_memory_stream.h>
 #include <whisperlib/common/sync/mutex.h>
 #include <whisperlib/net/base/connection.h>
@@ -136,6 +137,12 @@ class ServerConnection : public rpc::IResultHandler {
   // Returns a description of this connection. Good for logging.
   string ToString() const;
 
+  // Backpressure: while the query executor is overloaded we stop reading
+  // (the client eventually blocks in TCP flow control), and periodically
+  // check if we can resume.
+  void PauseReading();
+  void ResumeReading();
+
  private:
   net::Selector * selector_;
 
@@ -176,6 +183,13 @@ class ServerConnection : public rpc::IResultHandler {
 
   bool auto_delete_on_close_;
 
+  // true while we do not read because the executor is overloaded
+  bool read_paused_;
+  // checks if we can resume reading
+  util::Alarm resume_read_alarm_;
+  // how often we check, while the executor is overloaded (ms)
+  static const int64 kResumeReadIntervalMs = 10;
+
   // Does the initial handshake.
   // input:
   //  in: contains client data. There may be less than a full handshake message
@@ -38,12 +38,15 @@
 #include "common/sync/thread.h"
 #include "common/base/system.h"
 #include "common/base/gflags.h"
+#include "common/base/timer.h"
+#include "common/sync/atomic.h"
 #include "net/base/selector.h"
 #include "net/base/address.h"
 #include "net/rpc/lib/types/rpc_all_types.h"
 #include "net/rpc/lib/server/rpc_server.h"
 #include "net/rpc/lib/server/rpc_services_manager.h"
 #include "net/rpc/lib/server/execution/rpc_execution_pool.h"
+#include "net/rpc/lib/codec/binary/rpc_binary_encoder.h"
 
 #include "auto/types.h"
 #include "auto/invokers.h"
@@ -60,6 +63,22 @@ DEFINE_int32(port,
              5682,
              "The port on which this rpc server listens.");
 
+DEFINE_bool(scaling_test,
+            false,
+            "Instead of serving, measure the rpc-executor throughput "
+            "w/ 1, 2, 4 .. scaling_max_workers workers and exit.");
+DEFINE_int32(scaling_max_workers,
+             32,
+             "In scaling_test mode: the maximum number of workers.");
+DEFINE_int32(scaling_num_queries,
+             200000,
+             "In scaling_test mode: the number of queries to execute "
+             "for each number of workers.");
+DEFINE_int32(scaling_work_us,
+             20,
+             "In scaling_test mode: the time a worker spends executing "
+             "a query (busy loop), in microseconds.");
+
 //////////////////////////////////////////////////////////////////////
 //
 //       Custom RPC Server
@@ -83,11 +102,113 @@ void HandleNiceExit(int signum) {
   }
 }
 
+//////////////////////////////////////////////////////////////////////
+//
+//       Execution pool scaling test
+//
+// A service that burns FLAGS_scaling_work_us of CPU for every call.
+class BusyServiceInvoker : public rpc::ServiceInvoker {
+ public:
+  BusyServiceInvoker() : rpc::ServiceInvoker("Busy", "busy") {}
+  virtual bool Call(rpc::Query* q) {
+    const int64 end_ts = timer::TicksUsec() + FLAGS_scaling_work_us;
+    while ( timer::TicksUsec() < end_ts ) {
+    }
+    q->Complete();
+    return true;
+  }
+  virtual string GetTurntablePage(const string& base_path,
+                                  const string& url_path) const {
+    return "";
+  }
+};
+// Counts the results, signals when all came back.
+class CountingResultHandler : public rpc::IResultHandler {
+ public:
+  explicit CountingResultHandler(int64 expected)
+      : expected_(expected), completed_(0), rejected_(0),
+        done_(false, true) {
+  }
+  virtual void HandleRPCResult(const rpc::Query& q) {
+    if ( q.status() == rpc::RPC_SERVER_BUSY ) {
+      synch::AtomicAddAndFetch(&rejected_, static_cast<int64>(1));
+    }
+    if ( synch::AtomicAddAndFetch(&completed_, static_cast<int64>(1)) ==
+         expected_ ) {
+      done_.Signal();
+    }
+  }
+  int64 rejected() const { return rejected_; }
+  void Wait() { done_.Wait(); }
+ private:
+  const int64 expected_;
+  int64 completed_;
+  int64 rejected_;
+  synch::Event done_;
+};
+
+int RunScalingTest() {
+  rpc::ServicesManager servicesManager;
+  BusyServiceInvoker service;
+  CHECK(servicesManager.RegisterService(service));
+  const rpc::Transport transport(rpc::Transport::TCP,
+                                 net::HostPort(), net::HostPort());
+  io::MemoryStream params;
+  rpc::BinaryEncoder encoder;
+  encoder.EncodeArrayStart(0, &params);
+  encoder.EncodeArrayEnd(&params);
+
+  double base_qps = 0;
+  for ( int32 num_workers = 1; num_workers <= FLAGS_scaling_max_workers;
+        num_workers *= 2 ) {
+    rpc::ExecutionPool executor(servicesManager);
+    CountingResultHandler handler(FLAGS_scaling_num_queries);
+    executor.RegisterResultHandler(handler);
+    CHECK(executor.Start(num_workers));
+
+    const int64 start_ts = timer::TicksUsec();
+    for ( int32 i = 0; i < FLAGS_scaling_num_queries; ++i ) {
+      // play nice - as rpc::ServerConnection does
+      while ( executor.IsOverloaded() ) {
+        sched_yield();
+      }
+      executor.QueueRPC(new rpc::Query(transport, i, "busy", "Busy",
+                                       params, rpc::kCodecIdBinary,
+                                       handler.GetResultHandlerID()));
+    }
+    handler.Wait();
+    const int64 duration_us = max(timer::TicksUsec() - start_ts,
+                                  static_cast<int64>(1));
+    const double qps = FLAGS_scaling_num_queries * 1e6 / duration_us;
+    if ( base_qps == 0 ) {
+      base_qps = qps;
+    }
+    std::cout << "workers: " << num_workers
+              << " queries/s: " << static_cast<int64>(qps)
+              << " speedup: " << qps / base_qps
+              << " queue latency p50: "
+              << executor.QueueLatencyPercentileUs(0.50) << "us"
+              << " p99: " << executor.QueueLatencyPercentileUs(0.99) << "us"
+              << " rejected: " << handler.rejected()
+              << std::endl;
+    executor.Stop();
+    executor.UnregisterResultHandler(handler);
+  }
+  servicesManager.UnregisterService(service);
+  return 0;
+}
+
 int main(int argc, char ** argv) {
   // - Initialize logger.
   // - Install default signal handlers.
   common::Init(argc, argv);
 
+  if ( FLAGS_scaling_test ) {
+    const int ret = RunScalingTest();
+    common::Exit(ret);
+    return ret;
+  }
+
   unsigned nExecutionThreads = (unsigned)FLAGS_nExecutors;
   if (nExecutionThreads > 100 || nExecutionThreads == 0) {
     LOG_ERROR << "Execution threads max is 100";
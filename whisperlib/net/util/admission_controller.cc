@@ -0,0 +1,161 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+
+#include <sstream>
+#include "common/base/log.h"
+#include "common/sync/atomic.h"
+#include "net/util/admission_controller.h"
+
+namespace net {
+
+const int32 AdmissionController::kDefaultMaxLoad;
+
+AdmissionController::AdmissionController(
+    const vector<const IpClassifier*>* classifiers,
+    const vector<int32>& class_max_load)
+    : classifiers_(classifiers) {
+  const int32 num_classes =
+      (classifiers_ == NULL ? 0 : classifiers_->size()) + 1;
+  for ( int32 i = 0; i < num_classes; ++i ) {
+    max_load_.push_back(i < class_max_load.size() ? class_max_load[i]
+                                                  : kDefaultMaxLoad);
+  }
+  num_admitted_.resize(num_classes, 0);
+  num_refused_.resize(num_classes, 0);
+}
+
+AdmissionController::~AdmissionController() {
+  for ( int i = 0; i < probes_.size(); ++i ) {
+    delete probes_[i].probe_;
+  }
+  probes_.clear();
+}
+
+void AdmissionController::AddProbe(const string& name,
+                                   Probe* probe, int64 capacity) {
+  CHECK(probe->is_permanent());
+  if ( capacity <= 0 ) {
+    delete probe;
+    return;
+  }
+  probes_.push_back(ProbeInfo(name, probe, capacity));
+}
+
+int32 AdmissionController::Load(string* probe_name) const {
+  int64 load = 0;
+  int top = -1;
+  for ( int i = 0; i < probes_.size(); ++i ) {
+    const int64 crt = probes_[i].probe_->Run() * 100 / probes_[i].capacity_;
+    if ( top < 0 || crt > load ) {
+      load = crt;
+      top = i;
+    }
+  }
+  if ( probe_name != NULL && top >= 0 ) {
+    *probe_name = probes_[top].name_;
+  }
+  return static_cast<int32>(min(load, static_cast<int64>(kMaxInt32)));
+}
+
+int32 AdmissionController::Classify(const HostPort& peer) const {
+  if ( classifiers_ != NULL ) {
+    for ( int32 i = 0; i < classifiers_->size(); ++i ) {
+      if ( (*classifiers_)[i]->IsInClass(peer.ip_object()) ) {
+        return i;
+      }
+    }
+  }
+  return num_classes() - 1;
+}
+
+bool AdmissionController::Admit(const HostPort& peer) {
+  if ( probes_.empty() ) {
+    return true;
+  }
+  const int32 c = Classify(peer);
+  string probe_name;
+  const int32 load = Load(&probe_name);
+  if ( load >= max_load_[c] ) {
+    synch::AtomicAddAndFetch(&num_refused_[c], static_cast<int64>(1));
+    LOG_DEBUG << "Refusing " << peer << " (class " << c << ")"
+              << ", load: " << load << "% by " << probe_name
+              << ", class max load: " << max_load_[c] << "%";
+    return false;
+  }
+  synch::AtomicAddAndFetch(&num_admitted_[c], static_cast<int64>(1));
+  return true;
+}
+
+string AdmissionController::ToString() const {
+  ostringstream oss;
+  string probe_name;
+  const int32 load = Load(&probe_name);
+  oss << "load: " << load << "%";
+  if ( !probe_name.empty() ) {
+    oss << " by " << probe_name;
+  }
+  oss << "\n";
+  for ( int i = 0; i < probes_.size(); ++i ) {
+    oss << "probe " << probes_[i].name_ << ": "
+        << probes_[i].probe_->Run() << " of " << probes_[i].capacity_
+        << "\n";
+  }
+  for ( int32 c = 0; c < num_classes(); ++c ) {
+    oss << "class ";
+    if ( c == num_classes() - 1 ) {
+      oss << "default";
+    } else {
+      oss << c;
+    }
+    oss << ": max_load " << max_load_[c] << "%"
+        << ", admitted " << num_admitted_[c]
+        << ", refused " << num_refused_[c] << "\n";
+  }
+  return oss.str();
+}
+
+AdmissionController::Probe* AdmissionController::NewThreadLoadProbe(
+    const vector<SelectorThread*>* threads) {
+  return NewPermanentCallback(&AdmissionController::ThreadLoad, threads);
+}
+
+int64 AdmissionController::ThreadLoad(
+    const vector<SelectorThread*>* threads) {
+  int64 load = 0;
+  for ( int i = 0; i < threads->size(); ++i ) {
+    load = max(load, static_cast<int64>(
+        (*threads)[i]->selector()->num_registered()));
+  }
+  return load;
+}
+
+}
@@ -0,0 +1,121 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+// Accept time admission control: decides whether a new client is taken,
+// or refused right away - before we spend anything on it (no connection
+// object, no request parsing, no element lookup or authorization).
+//
+// The load is a percent: the max, over a set of probes, of
+// 100 * probe value / probe capacity (e.g. the connections on the busiest
+// networking thread, the pending authorizations, the output buffer memory).
+//
+// A peer goes in the first class (in the given classifiers order) that
+// contains it, else in the "default" class. Each class has its own max
+// load, so under pressure the less important clients are refused first.
+//
+
+#ifndef __NET_UTIL_ADMISSION_CONTROLLER_H__
+#define __NET_UTIL_ADMISSION_CONTROLLER_H__
+
+#include <string>
+#include <vector>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/callback.h>
+#include <whisperlib/net/base/address.h>
+#include <whisperlib/net/base/selector.h>
+#include <whisperlib/net/util/ipclassifier.h>
+
+namespace net {
+
+class AdmissionController {
+ public:
+  typedef ResultClosure<int64> Probe;
+  static const int32 kDefaultMaxLoad = 100;
+
+  // classifiers: the ip classes, in priority order (not owned, can be NULL)
+  // class_max_load: the max load for each class; the one after the last
+  //     classifier is for the default class. Missing => kDefaultMaxLoad.
+  AdmissionController(const vector<const IpClassifier*>* classifiers,
+                      const vector<int32>& class_max_load);
+  ~AdmissionController();
+
+  // Adds a load probe (we take ownership, must be permanent).
+  // The probes run in the accepting threads, on every accept, so they
+  // should be cheap and safe to call from any thread.
+  // A capacity <= 0 turns the probe off (we delete it).
+  void AddProbe(const string& name, Probe* probe, int64 capacity);
+
+  // Returns the current load percent. If probe_name is not NULL, we
+  // return there the name of the probe that determined it.
+  int32 Load(string* probe_name) const;
+
+  // Returns the class of the given peer.
+  int32 Classify(const HostPort& peer) const;
+
+  // Returns true if the given peer should be accepted, false if it should
+  // be refused. Updates the counters.
+  bool Admit(const HostPort& peer);
+
+  int32 num_classes() const { return max_load_.size(); }
+  int32 max_load(int32 c) const { return max_load_[c]; }
+  int64 num_admitted(int32 c) const { return num_admitted_[c]; }
+  int64 num_refused(int32 c) const { return num_refused_[c]; }
+
+  // Load, probes and per class counters - one per line.
+  string ToString() const;
+
+  // A probe returning the max number of selectables on the given threads.
+  static Probe* NewThreadLoadProbe(const vector<SelectorThread*>* threads);
+
+ private:
+  static int64 ThreadLoad(const vector<SelectorThread*>* threads);
+
+  const vector<const IpClassifier*>* const classifiers_;
+  // indexed by class, the default class last
+  vector<int32> max_load_;
+  vector<int64> num_admitted_;
+  vector<int64> num_refused_;
+
+  struct ProbeInfo {
+    string name_;
+    Probe* probe_;
+    int64 capacity_;
+    ProbeInfo(const string& name, Probe* probe, int64 capacity)
+        : name_(name), probe_(probe), capacity_(capacity) {
+    }
+  };
+  vector<ProbeInfo> probes_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(AdmissionController);
+};
+}
+
+#endif  // __NET_UTIL_ADMISSION_CONTROLLER_H__
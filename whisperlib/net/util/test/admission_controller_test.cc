@@ -0,0 +1,132 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include "common/base/types.h"
+#include "common/base/log.h"
+#include "common/base/system.h"
+#include "common/base/gflags.h"
+
+#include "net/base/address.h"
+#include "net/util/ipclassifier.h"
+#include "net/util/admission_controller.h"
+
+//////////////////////////////////////////////////////////////////////
+
+int64 g_connections = 0;
+int64 g_pending_auth = 0;
+
+int64 ReadValue(const int64* value) {
+  return *value;
+}
+
+using namespace net;
+void TestAdmission() {
+  vector<const IpClassifier*> classifiers;
+  classifiers.push_back(IpClassifier::CreateClassifier("IPFILTER(10.0.0.0/8)"));
+  classifiers.push_back(IpClassifier::CreateClassifier("IPFILTER(1.2.3.4)"));
+  vector<int32> max_load;
+  max_load.push_back(120);   // 10.x.x.x - get in even over the capacity
+  max_load.push_back(90);    // 1.2.3.4
+                             // default: 100
+  const HostPort internal("10.1.2.3", 80);
+  const HostPort partner("1.2.3.4", 80);
+  const HostPort other("5.6.7.8", 80);
+  {
+    // no probes - everybody gets in
+    AdmissionController ac(&classifiers, max_load);
+    CHECK_EQ(ac.num_classes(), 3);
+    CHECK(ac.Admit(other));
+    CHECK_EQ(ac.num_admitted(2), 0);   // no probes, no counting
+  }
+  AdmissionController ac(&classifiers, max_load);
+  CHECK_EQ(ac.max_load(0), 120);
+  CHECK_EQ(ac.max_load(1), 90);
+  CHECK_EQ(ac.max_load(2), AdmissionController::kDefaultMaxLoad);
+  CHECK_EQ(ac.Classify(internal), 0);
+  CHECK_EQ(ac.Classify(partner), 1);
+  CHECK_EQ(ac.Classify(other), 2);
+
+  ac.AddProbe("connections",
+              NewPermanentCallback(&ReadValue,
+                                   static_cast<const int64*>(&g_connections)),
+              1000);
+  ac.AddProbe("pending_auth",
+              NewPermanentCallback(&ReadValue,
+                                   static_cast<const int64*>(&g_pending_auth)),
+              100);
+  ac.AddProbe("disabled",
+              NewPermanentCallback(&ReadValue,
+                                   static_cast<const int64*>(&g_pending_auth)),
+              0);
+
+  // light load
+  g_connections = 100;
+  g_pending_auth = 5;
+  string probe;
+  CHECK_EQ(ac.Load(&probe), 10);
+  CHECK_EQ(probe, "connections");
+  CHECK(ac.Admit(internal));
+  CHECK(ac.Admit(partner));
+  CHECK(ac.Admit(other));
+
+  // the authorizations pile up - the partner is refused first
+  g_pending_auth = 95;
+  CHECK_EQ(ac.Load(&probe), 95);
+  CHECK_EQ(probe, "pending_auth");
+  CHECK(ac.Admit(internal));
+  CHECK(!ac.Admit(partner));
+  CHECK(ac.Admit(other));
+
+  // over capacity - only the internal guys
+  g_connections = 1100;
+  CHECK_EQ(ac.Load(NULL), 110);
+  CHECK(ac.Admit(internal));
+  CHECK(!ac.Admit(partner));
+  CHECK(!ac.Admit(other));
+
+  CHECK_EQ(ac.num_admitted(0), 3);
+  CHECK_EQ(ac.num_refused(0), 0);
+  CHECK_EQ(ac.num_admitted(1), 1);
+  CHECK_EQ(ac.num_refused(1), 2);
+  CHECK_EQ(ac.num_admitted(2), 2);
+  CHECK_EQ(ac.num_refused(2), 1);
+  LOG_INFO << "Admission status:\n" << ac.ToString();
+
+  for ( int i = 0; i < classifiers.size(); ++i ) {
+    delete classifiers[i];
+  }
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestAdmission();
+  LOG_INFO << "PASS";
+}
@@ -32,6 +32,7 @@
 #include "aac/aac_tag_splitter.h"
 
 #include <whisperlib/common/base/log.h>
+#include "base/sync_scanner.h"
 
 namespace streaming {
 
@@ -44,6 +45,7 @@ AacTagSplitter::AacTagSplitter(const string& name)
       samplerate_(0),
       channels_(0),
       header_extracted_(false),
+      last_stream_pos_(0),
       stream_offset_ms_(0.0) {
   faacDecConfigurationPtr config =
     faacDecGetCurrentConfiguration(aac_handle_);
@@ -60,16 +62,9 @@ AacTagSplitter::~AacTagSplitter() {
 
 streaming::TagReadStatus AacTagSplitter::ReadHeader(
   io::MemoryStream* in, scoped_ref<Tag>* tag, int64* timestamp_ms) {
-  uint8 buf2[2];
   // Skip until we get an 0xff 0xfX
-  while ( true ) {
-    if ( 2 != in->Peek(buf2, 2) ) {
-      return streaming::READ_NO_DATA;
-    }
-    if ( buf2[0] == 0xff && (buf2[1] & 0xf0) == 0xf0 ) {
-      break;
-    }
-    in->Skip(1);
+  if ( !SkipToAudioSync(in, kAdtsSyncMask) ) {
+    return streaming::READ_NO_DATA;
   }
 
   CHECK(!header_extracted_);
@@ -158,12 +153,13 @@ streaming::TagReadStatus AacTagSplitter::GetNextTagInternal(
     // If you get a faad crash: "ifilter_bank () from /usr/lib/libfaad.so.2"
     // it's because faacDecDecode has a problem with decoding few data.
     // So: Make sure we have a significant amount of data available.
-    if ( last_stream_.size() > 1000 ) {
+    if ( last_stream_.size() - last_stream_pos_ > 1000 ) {
       samplebuffer = faacDecDecode(
         aac_handle_, &frame_info_,
         const_cast<unsigned char*>(
-          reinterpret_cast<const unsigned char*>(last_stream_.data())),
-        last_stream_.size());
+          reinterpret_cast<const unsigned char*>(last_stream_.data() +
+                                                 last_stream_pos_)),
+        last_stream_.size() - last_stream_pos_);
     }
     if ( samplebuffer == NULL ) {
       // Error Path..
@@ -177,6 +173,12 @@ streaming::TagReadStatus AacTagSplitter::GetNextTagInternal(
       if ( in->IsEmpty() ) {
         return streaming::READ_NO_DATA;
       }
+      // Drop the decoded frames only now, once per block (instead of
+      // moving the data after every frame)
+      if ( last_stream_pos_ > 0 ) {
+        last_stream_.erase(0, last_stream_pos_);
+        last_stream_pos_ = 0;
+      }
       const char* buffer = NULL;
       int size = 0;
       in->ReadNext(&buffer, &size);
@@ -186,8 +188,9 @@ streaming::TagReadStatus AacTagSplitter::GetNextTagInternal(
 
     // Success - one frame decoded
     scoped_ref<AacFrameTag> aac_tag;
-    const TagReadStatus ret = FinalizeFrame(last_stream_.data(), &aac_tag);
-    last_stream_.erase(0, frame_info_.bytesconsumed);
+    const TagReadStatus ret = FinalizeFrame(
+        last_stream_.data() + last_stream_pos_, &aac_tag);
+    last_stream_pos_ += frame_info_.bytesconsumed;
     if ( ret == READ_SKIP ) {
       continue;
     }
@@ -151,7 +151,9 @@ class AacTagSplitter : public streaming::TagSplitter {
   unsigned char channels_;
   bool header_extracted_;
   faacDecFrameInfo frame_info_;
+  // the data we decode from - we already decoded up to last_stream_pos_
   string last_stream_;
+  uint32 last_stream_pos_;
 
   double stream_offset_ms_;
 
@@ -0,0 +1,239 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <openssl/evp.h>
+#include <whisperlib/common/base/timer.h>
+#include <whisperlib/common/base/strutil.h>
+#include <whisperstreamlib/base/authorizer_cache.h>
+
+namespace streaming {
+
+CachingAuthorizer::CachingAuthorizer(Authorizer* auth,
+                                     int64 ttl_ms,
+                                     int64 deny_ttl_ms,
+                                     int32 max_entries)
+    : Authorizer(auth->name()),
+      auth_(auth),
+      ttl_ms_(ttl_ms),
+      deny_ttl_ms_(deny_ttl_ms),
+      max_entries_(max_entries),
+      num_hits_(0),
+      num_misses_(0) {
+  auth_->IncRef();
+}
+
+CachingAuthorizer::~CachingAuthorizer() {
+  CHECK(pending_.empty());
+  auth_->DecRef();
+}
+
+bool CachingAuthorizer::Initialize() {
+  return auth_->Initialize();
+}
+
+void CachingAuthorizer::Authorize(const AuthorizerRequest& req,
+                                  CompletionCallback* completion) {
+  const string key = GetCacheKey(req);
+  AuthorizerReply reply(false, 0);
+  bool found = false;
+  Pending* pending = NULL;
+  {
+    synch::MutexLocker l(&mutex_);
+    const int64 now = timer::TicksMsec();
+    EntryMap::iterator it = entries_.find(key);
+    if ( it != entries_.end() && it->second.expiration_ts_ <= now ) {
+      DelEntry(it);
+      it = entries_.end();
+    }
+    if ( it != entries_.end() ) {
+      ++num_hits_;
+      lru_.splice(lru_.begin(), lru_, it->second.lru_it_);
+      reply.allowed_ = it->second.allowed_;
+      // the grant runs out at the same time as the original one
+      reply.time_limit_ms_ = it->second.time_limit_ms_ == 0 ? 0 :
+          it->second.time_limit_ms_ - (now - it->second.grant_ts_);
+      found = true;
+    }
+  }
+  if ( found ) {
+    completion->Run(reply);
+    return;
+  }
+  {
+    synch::MutexLocker l(&mutex_);
+    ++num_misses_;
+    pending = new Pending();
+    pending->key_ = key;
+    pending->completion_ = completion;
+    pending->auth_completion_ = NewCallback(
+        this, &CachingAuthorizer::AuthorizationCompleted, pending);
+    pending_[completion] = pending;
+  }
+  // we may get completed right away
+  IncRef();
+  auth_->Authorize(req, pending->auth_completion_);
+}
+
+void CachingAuthorizer::Cancel(CompletionCallback* completion) {
+  Pending* pending = NULL;
+  {
+    synch::MutexLocker l(&mutex_);
+    PendingMap::iterator it = pending_.find(completion);
+    if ( it == pending_.end() ) {
+      return;
+    }
+    pending = it->second;
+    pending_.erase(it);
+  }
+  auth_->Cancel(pending->auth_completion_);
+  delete pending->auth_completion_;
+  delete pending;
+  DecRef();
+}
+
+void CachingAuthorizer::AuthorizationCompleted(Pending* pending,
+                                               const AuthorizerReply& reply) {
+  {
+    synch::MutexLocker l(&mutex_);
+    pending_.erase(pending->completion_);
+    AddEntry(pending->key_, reply);
+  }
+  pending->completion_->Run(reply);
+  delete pending;
+  DecRef();
+}
+
+string CachingAuthorizer::GetCacheKey(const AuthorizerRequest& req) {
+  string key;
+  key.reserve(req.user_.size() + req.token_.size() +
+              req.resource_.size() + req.action_.size() + 128);
+  key.append(req.user_).append(1, '\0');
+  key.append(GetPasswordDigest(req.passwd_)).append(1, '\0');
+  key.append(req.token_).append(1, '\0');
+  key.append(req.resource_).append(1, '\0');
+  key.append(req.action_).append(1, '\0');
+  key.append(GetNetAddressClass(req.net_address_));
+  return key;
+}
+
+string CachingAuthorizer::GetPasswordDigest(const string& passwd) {
+  if ( passwd.empty() ) {
+    return "";
+  }
+  uint8 md[EVP_MAX_MD_SIZE];
+  unsigned int md_len = 0;
+  // (on failure different passwords would share the key - so no way)
+  CHECK(EVP_Digest(passwd.data(), passwd.size(), md, &md_len,
+                   EVP_sha256(), NULL)) << "SHA256 failed";
+  static const char kHex[] = "0123456789abcdef";
+  string ret(2 * md_len, '0');
+  for ( unsigned int i = 0; i < md_len; ++i ) {
+    ret[2 * i] = kHex[md[i] >> 4];
+    ret[2 * i + 1] = kHex[md[i] & 0x0f];
+  }
+  return ret;
+}
+
+string CachingAuthorizer::GetNetAddressClass(const string& net_address) {
+  // strip the port
+  string ip = net_address;
+  if ( !ip.empty() && ip[0] == '[' ) {
+    ip = ip.substr(1, ip.find(']') - 1);
+  } else if ( ip.find('.') != string::npos ) {
+    ip = ip.substr(0, ip.find(':'));
+  } else if ( ip.find(':') != ip.rfind(':') ) {
+    // ipv6 w/ a port w/o brackets (as HostPort prints it)
+    ip = ip.substr(0, ip.rfind(':'));
+  }
+  if ( ip.find(':') == string::npos ) {
+    return ip.substr(0, ip.rfind('.'));
+  }
+  size_t pos = 0;
+  for ( int i = 0; i < 4 && pos != string::npos; ++i ) {
+    pos = ip.find(':', pos == 0 ? 0 : pos + 1);
+  }
+  return ip.substr(0, pos);
+}
+
+int32 CachingAuthorizer::num_entries() const {
+  synch::MutexLocker l(&mutex_);
+  return entries_.size();
+}
+int64 CachingAuthorizer::num_hits() const {
+  synch::MutexLocker l(&mutex_);
+  return num_hits_;
+}
+int64 CachingAuthorizer::num_misses() const {
+  synch::MutexLocker l(&mutex_);
+  return num_misses_;
+}
+
+string CachingAuthorizer::ToString() const {
+  synch::MutexLocker l(&mutex_);
+  return strutil::StringPrintf(
+      "CachingAuthorizer{auth: %s, entries: %d, hits: %" PRId64 ", "
+      "misses: %" PRId64 "}",
+      auth_->name().c_str(), static_cast<int>(entries_.size()),
+      num_hits_, num_misses_);
+}
+
+void CachingAuthorizer::DelEntry(EntryMap::iterator it) {
+  lru_.erase(it->second.lru_it_);
+  entries_.erase(it);
+}
+
+void CachingAuthorizer::AddEntry(const string& key,
+                                 const AuthorizerReply& reply) {
+  int64 ttl_ms = reply.allowed_ ? ttl_ms_ : deny_ttl_ms_;
+  if ( reply.allowed_ && reply.time_limit_ms_ > 0 ) {
+    ttl_ms = min(ttl_ms, static_cast<int64>(reply.time_limit_ms_));
+  }
+  if ( ttl_ms <= 0 || max_entries_ <= 0 ) {
+    return;
+  }
+  EntryMap::iterator it = entries_.find(key);
+  if ( it != entries_.end() ) {
+    DelEntry(it);
+  }
+  while ( entries_.size() >= max_entries_ ) {
+    const EntryMap::iterator last = entries_.find(lru_.back());
+    CHECK(last != entries_.end());
+    DelEntry(last);
+  }
+  lru_.push_front(key);
+  Entry& entry = entries_[key];
+  entry.allowed_ = reply.allowed_;
+  entry.time_limit_ms_ = reply.time_limit_ms_;
+  entry.grant_ts_ = timer::TicksMsec();
+  entry.expiration_ts_ = entry.grant_ts_ + ttl_ms;
+  entry.lru_it_ = lru_.begin();
+}
+}
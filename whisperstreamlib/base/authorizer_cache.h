@@ -0,0 +1,128 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#ifndef __MEDIA_BASE_AUTHORIZER_CACHE_H__
+#define __MEDIA_BASE_AUTHORIZER_CACHE_H__
+
+#include <list>
+#include <map>
+#include <string>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/sync/mutex.h>
+#include <whisperstreamlib/base/stream_auth.h>
+
+namespace streaming {
+
+// An Authorizer that remembers the decisions of another authorizer for a
+// while - so repeated authorizations (reconnects, and mainly the periodic
+// reauthorizations of each viewer) don't go each time to the (usually
+// remote) authorizer.
+//
+// The decisions are keyed on (user, password, token, resource, action and
+// the class of the net address - the /24 for IPv4, the /64 for IPv6).
+// We keep only a digest of the password in the key.
+// Note that action_performed_ms_ is not in the key: an authorizer that
+// decides based on it should not be cached.
+//
+// Grants are kept for ttl_ms (but no longer than their time_limit_ms_,
+// and a cached grant is limited to what is left of the original one),
+// denials for deny_ttl_ms. When over max_entries we evict in LRU order.
+//
+// Thread safe.
+class CachingAuthorizer : public Authorizer {
+ public:
+  // We take a reference to auth (for our lifetime).
+  CachingAuthorizer(Authorizer* auth,
+                    int64 ttl_ms,
+                    int64 deny_ttl_ms,
+                    int32 max_entries);
+  virtual ~CachingAuthorizer();
+
+  /////////////////////////////////////////
+  // Authorizer methods
+  virtual bool Initialize();
+  virtual void Authorize(const AuthorizerRequest& req,
+                         CompletionCallback* completion);
+  virtual void Cancel(CompletionCallback* completion);
+
+  // The cache key for a request
+  static string GetCacheKey(const AuthorizerRequest& req);
+  // The hex SHA256 of passwd (empty for an empty passwd)
+  static string GetPasswordDigest(const string& passwd);
+  // "1.2.3.4:80" -> "1.2.3", "2001:db8:1:2:3::4" -> "2001:db8:1:2"
+  static string GetNetAddressClass(const string& net_address);
+
+  int32 num_entries() const;
+  int64 num_hits() const;
+  int64 num_misses() const;
+  string ToString() const;
+
+ private:
+  struct Entry {
+    bool allowed_;
+    int32 time_limit_ms_;
+    int64 grant_ts_;
+    int64 expiration_ts_;
+    list<string>::iterator lru_it_;
+  };
+  typedef map<string, Entry> EntryMap;
+  // An authorization in progress w/ the wrapped authorizer
+  struct Pending {
+    string key_;
+    CompletionCallback* completion_;
+    CompletionCallback* auth_completion_;
+  };
+  typedef map<CompletionCallback*, Pending*> PendingMap;
+
+  void AuthorizationCompleted(Pending* pending, const AuthorizerReply& reply);
+
+  // These expect mutex_ to be held:
+  void DelEntry(EntryMap::iterator it);
+  void AddEntry(const string& key, const AuthorizerReply& reply);
+
+  Authorizer* const auth_;
+  const int64 ttl_ms_;
+  const int64 deny_ttl_ms_;
+  const int32 max_entries_;
+
+  mutable synch::Mutex mutex_;
+  EntryMap entries_;
+  // keys in use order (front is the most recent)
+  list<string> lru_;
+  PendingMap pending_;
+  int64 num_hits_;
+  int64 num_misses_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(CachingAuthorizer);
+};
+}
+
+#endif  // __MEDIA_BASE_AUTHORIZER_CACHE_H__
@@ -0,0 +1,160 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <whisperlib/common/base/gflags.h>
+#include <whisperlib/common/base/strutil.h>
+#include <whisperstreamlib/base/egress_pacer.h>
+
+DEFINE_bool(egress_pacing,
+            false,
+            "Pace the media we send to each viewer by the media timestamps "
+            "(instead of pushing all the write ahead at once)");
+DEFINE_int32(egress_pacing_initial_burst_ms,
+             3000,
+             "When pacing, we send these many milliseconds of media to a "
+             "new viewer as fast as possible");
+DEFINE_int32(egress_pacing_max_burst_ms,
+             250,
+             "When pacing, after the initial burst, we send at most these "
+             "many milliseconds of media at once");
+DEFINE_int32(egress_pacing_rate_percent,
+             125,
+             "When pacing, we send media at this rate, in percents of "
+             "the real time");
+DEFINE_bool(egress_pacing_use_kernel,
+            true,
+            "When pacing, let the kernel do it (SO_MAX_PACING_RATE, "
+            "best w/ the fq qdisc) once we know the media bitrate");
+
+namespace {
+// Timestamp jumps over this are discontinuities, not media to pace
+const int64 kMaxStreamTimeJumpMs = 10000;
+// We update the kernel pacing rate if the media rate changes this much
+const int64 kKernelRateChangePercent = 20;
+}
+
+namespace streaming {
+
+EgressPacer::EgressPacer()
+    : enabled_(FLAGS_egress_pacing),
+      initial_burst_us_(FLAGS_egress_pacing_initial_burst_ms * 1000LL),
+      max_burst_us_(FLAGS_egress_pacing_max_burst_ms * 1000LL),
+      rate_percent_(max(FLAGS_egress_pacing_rate_percent, 1)),
+      use_kernel_(FLAGS_egress_pacing_use_kernel),
+      tokens_us_(0),
+      last_refill_ms_(0),
+      last_stream_time_ms_(-1),
+      kernel_rate_(0) {
+}
+
+EgressPacer::EgressPacer(bool enabled,
+                         int64 initial_burst_ms,
+                         int64 max_burst_ms,
+                         int32 rate_percent,
+                         bool use_kernel)
+    : enabled_(enabled),
+      initial_burst_us_(initial_burst_ms * 1000),
+      max_burst_us_(max_burst_ms * 1000),
+      rate_percent_(max(rate_percent, 1)),
+      use_kernel_(use_kernel),
+      tokens_us_(0),
+      last_refill_ms_(0),
+      last_stream_time_ms_(-1),
+      kernel_rate_(0) {
+}
+
+EgressPacer::~EgressPacer() {
+}
+
+int64 EgressPacer::Delay(int64 stream_time_ms, int64 now_ms) {
+  if ( !enabled_ || kernel_rate_ > 0 ) {
+    return 0;
+  }
+  if ( last_stream_time_ms_ < 0 ) {
+    tokens_us_ = initial_burst_us_;
+    last_refill_ms_ = now_ms;
+    last_stream_time_ms_ = stream_time_ms;
+    return 0;
+  }
+  // refill - w/o going over max_burst (but we keep what is left from
+  // the initial burst)
+  if ( now_ms > last_refill_ms_ ) {
+    const int64 refill_us = (now_ms - last_refill_ms_) * 10 * rate_percent_;
+    tokens_us_ = min(tokens_us_ + refill_us, max(tokens_us_, max_burst_us_));
+    last_refill_ms_ = now_ms;
+  }
+  const int64 cost_ms = stream_time_ms - last_stream_time_ms_;
+  if ( cost_ms <= 0 ) {
+    return 0;
+  }
+  if ( cost_ms > kMaxStreamTimeJumpMs ) {
+    last_stream_time_ms_ = stream_time_ms;
+    return 0;
+  }
+  const int64 cost_us = cost_ms * 1000;
+  if ( tokens_us_ >= cost_us ) {
+    tokens_us_ -= cost_us;
+    last_stream_time_ms_ = stream_time_ms;
+    return 0;
+  }
+  const int64 rate_us_per_ms = 10 * rate_percent_;
+  return (cost_us - tokens_us_ + rate_us_per_ms - 1) / rate_us_per_ms;
+}
+
+bool EgressPacer::KernelRateNeeded(int64 media_bytes_per_sec,
+                                   int64* rate) const {
+  if ( !enabled_ || !use_kernel_ || media_bytes_per_sec <= 0 ) {
+    return false;
+  }
+  *rate = media_bytes_per_sec * rate_percent_ / 100;
+  return kernel_rate_ == 0 ||
+         abs(*rate - kernel_rate_) * 100 >
+         kernel_rate_ * kKernelRateChangePercent;
+}
+
+void EgressPacer::KernelRateSet(int64 rate, bool success) {
+  if ( !success ) {
+    // not supported - we keep pacing in user space
+    use_kernel_ = false;
+    kernel_rate_ = 0;
+    return;
+  }
+  kernel_rate_ = rate;
+}
+
+string EgressPacer::ToString() const {
+  return strutil::StringPrintf(
+      "EgressPacer{enabled: %s, tokens: %" PRId64 " ms, "
+      "kernel_rate: %" PRId64 " Bps}",
+      strutil::BoolToString(enabled_).c_str(),
+      tokens_us_ / 1000, kernel_rate_);
+}
+}
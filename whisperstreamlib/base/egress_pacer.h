@@ -0,0 +1,98 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#ifndef __MEDIA_BASE_EGRESS_PACER_H__
+#define __MEDIA_BASE_EGRESS_PACER_H__
+
+#include <whisperlib/common/base/types.h>
+
+namespace streaming {
+
+// Paces the tags we send to a viewer, by their media timestamps, so we
+// don't push a full GOP (or the whole write ahead) on the wire at once.
+//
+// It is a token bucket, counted in milliseconds of media:
+//  - we start w/ initial_burst_ms (so the player fills its buffer fast)
+//  - we refill at rate_percent of the real time (> 100 lets a viewer
+//    that fell behind catch up)
+//  - the refill does not go over max_burst_ms.
+//
+// When the kernel can pace the connection (SO_MAX_PACING_RATE) we hand
+// the pacing over to it (see KernelRateNeeded()) and stop pacing here.
+//
+// Not thread safe - use it from the net thread.
+class EgressPacer {
+ public:
+  // Uses the parameters from flags
+  EgressPacer();
+  EgressPacer(bool enabled,
+              int64 initial_burst_ms,
+              int64 max_burst_ms,
+              int32 rate_percent,
+              bool use_kernel);
+  ~EgressPacer();
+
+  bool is_enabled() const { return enabled_; }
+  bool is_kernel_pacing() const { return kernel_rate_ > 0; }
+
+  // Returns 0 if we can send now (at now_ms) a tag w/ stream_time_ms
+  // (and takes its tokens), or how many ms to wait before trying again.
+  int64 Delay(int64 stream_time_ms, int64 now_ms);
+
+  // Given the media byte rate, returns true if we should set the kernel
+  // pacing rate for the connection, to *rate (bytes per second).
+  bool KernelRateNeeded(int64 media_bytes_per_sec, int64* rate) const;
+  // Call it w/ the result of setting the kernel pacing rate
+  void KernelRateSet(int64 rate, bool success);
+
+  string ToString() const;
+
+ private:
+  const bool enabled_;
+  const int64 initial_burst_us_;
+  const int64 max_burst_us_;
+  const int32 rate_percent_;
+  bool use_kernel_;
+
+  // The tokens - in microseconds of media
+  int64 tokens_us_;
+  // When we last refilled (ms, net selector time)
+  int64 last_refill_ms_;
+  // The stream time of the last tag we let go (-1 => none yet)
+  int64 last_stream_time_ms_;
+  // The pacing rate we set on the connection (0 => none)
+  int64 kernel_rate_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(EgressPacer);
+};
+}
+
+#endif  // __MEDIA_BASE_EGRESS_PACER_H__
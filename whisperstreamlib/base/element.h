@@ -42,6 +42,7 @@
 #include <whisperstreamlib/base/request.h>
 #include <whisperstreamlib/base/element_mapper.h>
 #include <whisperstreamlib/base/media_info.h>
+#include <whisperstreamlib/base/time_range.h>
 
 
 namespace streaming {
@@ -100,6 +101,21 @@ class Element {
   virtual bool HasMedia(const string& media) = 0;
   // list the name of the contained medias (under the given media path)
   virtual void ListMedia(const string& media, vector<string>* out) = 0;
+  // find the timerange media (see time_range.h) under media_dir to play
+  // at play_ts (ms from epoch) - returns the name, relative to us, like
+  // ListMedia. By default we search in the ListMedia() names; the
+  // elements w/ a time range index (recordings) search in the index.
+  virtual bool FindTimeRangeMedia(const string& media_dir, int64 play_ts,
+                                  string* out_media) {
+    vector<string> medias;
+    ListMedia(media_dir, &medias);
+    const int32 index = GetTimeRangeMediaIndex(medias, play_ts);
+    if ( index < 0 ) {
+      return false;
+    }
+    *out_media = medias[index];
+    return true;
+  }
 
   // asynchronously returns media description through the given 'callback'.
   typedef Callback1<const MediaInfo*> MediaInfoCallback;
@@ -201,6 +217,14 @@ class PolicyDrivenElement : public Element {
                                   bool force_switch) = 0;
   virtual const string& current_media() const = 0;
 
+  // Usually called by the policy, to announce the media it will most
+  // probably switch to next. The element may open it ahead of time, so
+  // the following SwitchCurrentMedia(media_name, ..) is instant.
+  // An empty media_name cancels a previous announcement.
+  // Default: ignored.
+  virtual void PrefetchMedia(const string& media_name) {
+  }
+
   // Basically a way to interrogate the underneath media mapper
   bool HasElementMedia(const string& media_name) {
     return mapper_->HasMedia(media_name);
@@ -44,6 +44,7 @@
 #include <whisperstreamlib/base/stream_auth.h>
 #include <whisperstreamlib/base/media_info.h>
 #include <whisperstreamlib/base/importer.h>
+#include <whisperstreamlib/base/time_range.h>
 #include <whisperlib/net/base/selector.h>
 
 namespace streaming {
@@ -77,6 +78,21 @@ class ElementMapper {
   virtual bool HasMedia(const string& media_name) = 0;
   virtual void ListMedia(const string& media_dir,
                          vector<string>* medias) = 0;
+  // Finds the timerange media (see time_range.h) under media_dir to play
+  // at play_ts (ms from epoch). Default: lists media_dir and searches the
+  // names (the mappers should route to the elements, which may know
+  // better - see Element::FindTimeRangeMedia).
+  virtual bool FindTimeRangeMedia(const string& media_dir, int64 play_ts,
+                                  string* out_media) {
+    vector<string> medias;
+    ListMedia(media_dir, &medias);
+    const int32 index = GetTimeRangeMediaIndex(medias, play_ts);
+    if ( index < 0 ) {
+      return false;
+    }
+    *out_media = medias[index];
+    return true;
+  }
 
   typedef hash_set<streaming::Element*> ElementSet;
   typedef hash_map<streaming::Element*, vector<streaming::Policy*>*> PolicyMap;
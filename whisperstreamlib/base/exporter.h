@@ -36,9 +36,12 @@
 #include <queue>
 
 #include <whisperlib/net/base/selector.h>
+#include <whisperlib/net/base/outbuf_budget.h>
 #include <whisperstreamlib/base/element_mapper.h>
 #include <whisperstreamlib/base/tag.h>
 #include <whisperstreamlib/base/request.h>
+#include <whisperstreamlib/base/egress_pacer.h>
+#include <whisperstreamlib/base/send_scheduler.h>
 #include <whisperstreamlib/base/stream_auth.h>
 #include <whisperstreamlib/base/tag_normalizer.h>
 #include <whisperstreamlib/stats2/stats_keeper.h>
@@ -91,11 +94,19 @@ class Exporter {
         media_id_(0),
         dropping_interframes_(false),
         pausing_(false),
-        scheduled_tags_length_(0) {
+        scheduled_tags_length_(0),
+        send_scheduler_(),
+        pacer_(),
+        pacing_task_(this, &Exporter::ProcessLocalizedTagsTask),
+        pacing_timer_(&pacing_task_),
+        process_localized_tags_task_(this,
+            &Exporter::ProcessLocalizedTagsTask) {
     DCHECK(net_selector_->IsInSelectThread());
   }
   virtual ~Exporter() {
     DCHECK(net_selector_->IsInSelectThread());
+    CHECK(!process_localized_tags_task_.is_scheduled());
+    CHECK(!pacing_timer_.is_scheduled());
 
     CHECK_NULL(request_);
     CHECK(!stream_stats_opened_);
@@ -140,6 +151,13 @@ class Exporter {
   // outbuf space.
   virtual void SetNotifyReady() = 0;
   virtual void SendTag(const streaming::Tag* tag, int64 tag_timestamp_ms) = 0;
+  // returns: the number of bytes queued towards the peer, but not yet
+  //          received: in our output buffer + in the kernel send queue.
+  //          (called from the net thread)
+  virtual int32 PendingOutputBytes() const = 0;
+  // Asks the kernel to pace the output to the peer at (at most) this rate.
+  // returns: false if not supported.
+  virtual bool SetMaxPacingRate(int64 bytes_per_sec) = 0;
 
  protected:
   void StartRequest(const string& path) {
@@ -464,7 +482,10 @@ class Exporter {
             scheduled_ms > flow_control_total_ms_) ||
         // drop video tags above flow_control_video_ms_
         (tag->is_video_tag() && flow_control_video_ms_ > 0 &&
-            tag->is_droppable() && scheduled_ms > flow_control_video_ms_);
+            tag->is_droppable() && scheduled_ms > flow_control_video_ms_) ||
+        // keyframes only, when short on output buffer memory
+        (tag->is_video_tag() && tag->is_droppable() && !tag->can_resync() &&
+            net::OutbufBudget::level() >= net::OutbufBudget::LEVEL_KEYFRAMES);
     dropping_interframes_ = dropping_interframes_ || drop_tag;
 
     // maybe drop tag, update stats
@@ -542,13 +563,17 @@ class Exporter {
   // The rest of the processing happens in NET selector.
   void ProcessLocalizedTags(bool dec_ref = false) {
     if ( !net_selector_->IsInSelectThread() ) {
-      IncRef();
-      net_selector_->RunInSelectLoop(NewCallback(this,
-          &Exporter::ProcessLocalizedTags, true));
+      // This happens for most tags - so we use our inline closure.
+      // If already scheduled, it will find the new tags too.
+      if ( process_localized_tags_task_.Schedule() ) {
+        IncRef();
+        net_selector_->RunInSelectLoop(&process_localized_tags_task_);
+      }
       return;
     }
     AutoDecRef auto_dec_ref(dec_ref ? this : NULL);
 
+    int64 pacing_delay_ms = 0;
     while ( true ) {
       if ( !CanSendTag() ) {
         SetNotifyReady();
@@ -557,20 +582,50 @@ class Exporter {
 
       // pop a tag
       ScheduledTag stag;
+      int64 queued_ms = 0;
       {
         synch::MutexLocker l(mutex());
         if ( scheduled_tags_.empty() ) {
           break;
         }
+        pacing_delay_ms = pacer_.Delay(
+            scheduled_tags_.front().stream_time_ms_, net_selector_->now());
+        if ( pacing_delay_ms > 0 ) {
+          break;
+        }
 
         stag = scheduled_tags_.front();
         scheduled_tags_length_ = scheduled_tags_.back().stream_time_ms_ -
             stag.stream_time_ms_;
         scheduled_tags_.pop();
+        queued_ms = scheduled_tags_length_;
+      }
+
+      // skip the tag if the viewer cannot keep up (the tags still
+      // waiting here - e.g. held back by the pacer - count too)
+      const streaming::Tag* tag = stag.tag_.get();
+      const SendScheduler::Action action = send_scheduler_.Schedule(
+          tag, stag.stream_time_ms_,
+          SendScheduler::IsDroppable(tag) ? PendingOutputBytes() : 0,
+          queued_ms);
+      if ( action == SendScheduler::DROP_NON_REFERENCE ) {
+        stats_keeper_.congestion_non_reference_dropped_add(1);
+        continue;
+      }
+      if ( action == SendScheduler::DROP_INTERFRAME ) {
+        stats_keeper_.congestion_interframes_dropped_add(1);
+        continue;
       }
 
       // send the tag
-      SendTag(stag.tag_.get(), stag.stream_time_ms_);
+      SendTag(tag, stag.stream_time_ms_);
+      MaybeSetKernelPacing();
+    }
+    // too early for the next tag - try again later
+    if ( pacing_delay_ms > 0 && !pacing_timer_.is_scheduled() ) {
+      IncRef();
+      net_selector_->timer_wheel()->Schedule(&pacing_timer_,
+          net_selector_->now(), pacing_delay_ms);
     }
 
     // Flow control on schedule_tags_ length. Because we don't have a constant
@@ -584,6 +639,17 @@ class Exporter {
   }
 
  private:
+  void ProcessLocalizedTagsTask() {
+    ProcessLocalizedTags(true);
+  }
+  // Once we know the media bitrate, hands the pacing over to the kernel
+  // (if it can do it)
+  void MaybeSetKernelPacing() {
+    int64 rate = 0;
+    if ( pacer_.KernelRateNeeded(send_scheduler_.bytes_per_sec(), &rate) ) {
+      pacer_.KernelRateSet(rate, SetMaxPacingRate(rate));
+    }
+  }
   void UpdateMediaInfo(MediaInfo* media_info) {
     // media_info should be updated in media thread, before sending to net
     CHECK(media_selector_->IsInSelectThread());
@@ -729,6 +795,19 @@ class Exporter {
 
   queue<ScheduledTag> scheduled_tags_;
   int64 scheduled_tags_length_;
+
+  // Drops video when the viewer falls behind (codec aware)
+  SendScheduler send_scheduler_;
+  // Paces the tags by their timestamps (w/ the kernel's help, if possible)
+  EgressPacer pacer_;
+  // Runs ProcessLocalizedTags() when pacing_timer_ fires (holds a
+  // reference while the timer is scheduled)
+  InlineClosure<Exporter> pacing_task_;
+  net::TimerWheel::Timer pacing_timer_;
+
+  // Moves ProcessLocalizedTags() into the net thread (holds a reference
+  // while scheduled)
+  InlineClosure<Exporter> process_localized_tags_task_;
 };
 
 }
@@ -29,7 +29,9 @@
 //
 // Author: Catalin Popescu & Cosmin Tudorache
 
+#include <set>
 #include "base/filtering_element.h"
+#include "base/tag_distributor.h"
 
 namespace streaming {
 
@@ -154,6 +156,147 @@ void FilteringCallbackData::Close() {
 }
 
 
+//////////////////////////////////////////////////////////////////////
+//
+// FilteringElement::SharedChain - one FilteringCallbackData (registered
+// upstream w/ an internal request) whose output goes to many clients.
+//
+class FilteringElement::SharedChain {
+ public:
+  // client_req: the request of the first client (we register upstream
+  // w/ its caps and auth)
+  SharedChain(FilteringElement* master, const string& key,
+              const Request* client_req)
+      : master_(master),
+        key_(key),
+        req_(new Request()),
+        registered_(false),
+        data_(NULL),
+        distributor_(client_req->caps().flavour_mask_, ""),
+        process_tag_callback_(
+            NewPermanentCallback(this, &SharedChain::ProcessTag)),
+        distributing_(false),
+        eos_received_(false) {
+    *req_->mutable_caps() = client_req->caps();
+    req_->mutable_info()->auth_req_ = client_req->info().auth_req_;
+    req_->mutable_info()->is_internal_ = true;
+  }
+  ~SharedChain() {
+    CHECK(clients_.empty());
+    CHECK(to_remove_.empty());
+    CHECK(data_ == NULL);
+    if ( !registered_ ) {
+      delete req_;
+    }
+    delete process_tag_callback_;
+  }
+
+  const string& key() const { return key_; }
+  FilteringCallbackData* data() const { return data_; }
+  bool eos_received() const { return eos_received_; }
+  bool empty() const { return clients_.empty(); }
+
+  // Registers data upstream w/ our request (from now on the request
+  // belongs to the mapper, until Unregister())
+  bool Register(FilteringCallbackData* data) {
+    CHECK(data_ == NULL && !registered_);
+    data->client_process_tag_callback_ = process_tag_callback_;
+    if ( !data->Register(req_) ) {
+      data->client_process_tag_callback_ = NULL;
+      return false;
+    }
+    data_ = data;
+    registered_ = true;
+    return true;
+  }
+  // Stops the tags and unregisters our request from upstream (if not
+  // already done by data_->Close()) - the mapper deletes the request on
+  // RemoveRequest. Returns the data, for the element to delete.
+  FilteringCallbackData* Unregister() {
+    FilteringCallbackData* const data = data_;
+    data_ = NULL;
+    data->client_process_tag_callback_ = NULL;
+    data->Unregister(req_);
+    req_ = NULL;
+    return data;
+  }
+
+  void AddClient(Request* req, ProcessingCallback* callback) {
+    Client* const client = new Client(callback);
+    client->distributor_callback_ =
+        NewPermanentCallback(this, &SharedChain::SendToClient, client);
+    clients_[req] = client;
+    distributor_.add_callback(req, client->distributor_callback_);
+  }
+  void RemoveClient(Request* req) {
+    ClientMap::iterator it = clients_.find(req);
+    CHECK(it != clients_.end());
+    Client* const client = it->second;
+    clients_.erase(it);
+    client->removed_ = true;
+    if ( distributing_ ) {
+      // the distributor is iterating its callbacks, we remove it after
+      to_remove_.push_back(make_pair(req, client));
+      return;
+    }
+    distributor_.remove_callback(req);
+    delete client;
+  }
+
+ private:
+  struct Client {
+    explicit Client(ProcessingCallback* callback)
+        : callback_(callback),
+          distributor_callback_(NULL),
+          removed_(false) {
+    }
+    ~Client() {
+      delete distributor_callback_;
+    }
+    ProcessingCallback* callback_;
+    ProcessingCallback* distributor_callback_;
+    bool removed_;
+  };
+  typedef map<Request*, Client*> ClientMap;
+
+  void ProcessTag(const Tag* tag, int64 timestamp_ms) {
+    if ( tag->type() == Tag::TYPE_EOS && !eos_received_ ) {
+      eos_received_ = true;
+      master_->SharedChainEnded(this);
+    }
+    distributing_ = true;
+    distributor_.DistributeTag(tag, timestamp_ms);
+    distributing_ = false;
+    while ( !to_remove_.empty() ) {
+      distributor_.remove_callback(to_remove_.back().first);
+      delete to_remove_.back().second;
+      to_remove_.pop_back();
+    }
+  }
+  void SendToClient(Client* client, const Tag* tag, int64 timestamp_ms) {
+    if ( !client->removed_ ) {
+      client->callback_->Run(tag, timestamp_ms);
+    }
+  }
+
+  FilteringElement* const master_;
+  const string key_;
+  // the request we register upstream w/ - ours until registered
+  Request* req_;
+  bool registered_;
+  // the filtering - its 'client' callback is our ProcessTag
+  FilteringCallbackData* data_;
+  TagDistributor distributor_;
+  ProcessingCallback* const process_tag_callback_;
+  ClientMap clients_;
+  // clients removed while distributing a tag
+  vector< pair<Request*, Client*> > to_remove_;
+  bool distributing_;
+  bool eos_received_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(SharedChain);
+};
+
 //////////////////////////////////////////////////////////////////////
 //
 // FilteringElement implementation
@@ -172,11 +315,13 @@ FilteringElement::~FilteringElement() {
   // Close() should be called before deleting this element
   CHECK(callbacks_.empty()) << "#" << callbacks_.size()
                             << " callbacks pending";
+  CHECK(shared_clients_.empty()) << "#" << shared_clients_.size()
+                                 << " shared chain clients pending";
 }
 
 
 void FilteringElement::CloseAllClients(Closure* call_on_close) {
-  if ( callbacks_.empty() ) {
+  if ( callbacks_.empty() && shared_clients_.empty() ) {
     LOG_INFO << name() << ": No callbacks, completing close";
     call_on_close->Run();
     return;
@@ -187,15 +332,35 @@ void FilteringElement::CloseAllClients(Closure* call_on_close) {
         it != callbacks_.end(); ++it ) {
     it->second->Close();
   }
+  // Each chain sends the EOS to all its clients
+  set<FilteringCallbackData*> chain_data;
+  for ( SharedClientMap::const_iterator it = shared_clients_.begin();
+        it != shared_clients_.end(); ++it ) {
+    if ( chain_data.insert(it->second->data()).second ) {
+      it->second->data()->IncRef();
+    }
+  }
+  for ( set<FilteringCallbackData*>::const_iterator it = chain_data.begin();
+        it != chain_data.end(); ++it ) {
+    if ( (*it)->client_process_tag_callback_ != NULL ) {
+      (*it)->Close();
+    }
+    (*it)->DecRef();
+  }
 }
 
 bool FilteringElement::AddRequest(const string& media,
                                   streaming::Request* req,
                                   streaming::ProcessingCallback* callback) {
-  if ( callbacks_.find(req) != callbacks_.end() ) {
+  if ( callbacks_.find(req) != callbacks_.end() ||
+       shared_clients_.find(req) != shared_clients_.end() ) {
     LOG_FATAL << "Duplicate AddRequest on path: [" << media << "]";
     return false;
   }
+  const string key = GetSharedChainKey(media, req);
+  if ( !key.empty() ) {
+    return AddSharedRequest(key, media, req, callback);
+  }
   FilteringCallbackData* const data = CreateCallbackData(media, req);
   if ( data == NULL ) {
     LOG_ERROR << "NULL CallbackData for subpath: [" << media << "]";
@@ -221,6 +386,7 @@ bool FilteringElement::AddRequest(const string& media,
 void FilteringElement::RemoveRequest(streaming::Request* req) {
   FilteringCallbackMap::iterator it = callbacks_.find(req);
   if ( it == callbacks_.end() ) {
+    RemoveSharedRequest(req);
     return;
   }
   FilteringCallbackData* data = it->second;
@@ -231,12 +397,109 @@ void FilteringElement::RemoveRequest(streaming::Request* req) {
   DeleteCallbackData(data);
   data = NULL;
 
-  if ( callbacks_.empty() && close_completed_ != NULL ) {
+  MaybeCompleteClose();
+}
+
+void FilteringElement::MaybeCompleteClose() {
+  if ( callbacks_.empty() && shared_clients_.empty() &&
+       close_completed_ != NULL ) {
     LOG_INFO << name() << ": No more callbacks, completing close";
     close_completed_->Run();
   }
 }
 
+string FilteringElement::GetSharedChainKey(const string& media,
+                                           const Request* req) const {
+  if ( !IsClientIndependentFiltering() ) {
+    return "";
+  }
+  // Only the clients that play the same thing, from the start, get the
+  // same output (and a TagDistributor serves exactly one flavour)
+  const uint32 flavour_mask = req->caps().flavour_mask_;
+  if ( flavour_mask == 0 || (flavour_mask & (flavour_mask - 1)) != 0 ||
+       req->info().seek_pos_ms_ != 0 ||
+       req->info().media_origin_pos_ms_ != 0 ||
+       req->info().limit_ms_ >= 0 ) {
+    return "";
+  }
+  return strutil::StringPrintf("%u|", flavour_mask) + media;
+}
+
+bool FilteringElement::AddSharedRequest(const string& key,
+                                        const string& media,
+                                        Request* req,
+                                        ProcessingCallback* callback) {
+  SharedChain* chain = NULL;
+  const SharedChainMap::const_iterator it = shared_chains_.find(key);
+  if ( it != shared_chains_.end() ) {
+    chain = it->second;
+  } else {
+    chain = CreateSharedChain(key, media, req);
+    if ( chain == NULL ) {
+      return false;
+    }
+    shared_chains_[key] = chain;
+  }
+  chain->AddClient(req, callback);
+  shared_clients_[req] = chain;
+  return true;
+}
+
+FilteringElement::SharedChain* FilteringElement::CreateSharedChain(
+    const string& key, const string& media, Request* req) {
+  FilteringCallbackData* const data = CreateCallbackData(media, req);
+  if ( data == NULL ) {
+    LOG_ERROR << "NULL CallbackData for subpath: [" << media << "]";
+    return NULL;
+  }
+  SharedChain* const chain = new SharedChain(this, key, req);
+  data->IncRef();
+  data->master_ = this;
+  data->mapper_ = mapper_;
+  data->media_name_ = media;
+  data->filtering_element_name_ = name();
+
+  // We register upstream on behalf of all clients
+  if ( !chain->Register(data) ) {
+    LOG_ERROR << "FilteringElement cannot add shared callback for subpath: ["
+              << media << "]";
+    DeleteCallbackData(data);
+    delete chain;
+    return NULL;
+  }
+  LOG_INFO << name() << ": Created shared chain: [" << key << "]";
+  return chain;
+}
+
+void FilteringElement::RemoveSharedRequest(Request* req) {
+  const SharedClientMap::iterator it = shared_clients_.find(req);
+  if ( it == shared_clients_.end() ) {
+    return;
+  }
+  SharedChain* const chain = it->second;
+  shared_clients_.erase(it);
+  chain->RemoveClient(req);
+  if ( chain->empty() ) {
+    const SharedChainMap::iterator it_chain = shared_chains_.find(chain->key());
+    if ( it_chain != shared_chains_.end() && it_chain->second == chain ) {
+      shared_chains_.erase(it_chain);
+    }
+    // No more tags for the chain from now on (we may be inside its
+    // ProcessTag, so the chain itself goes away later)
+    DeleteCallbackData(chain->Unregister());
+    selector_->DeleteInSelectLoop(chain);
+    LOG_INFO << name() << ": Deleted shared chain: [" << chain->key() << "]";
+  }
+  MaybeCompleteClose();
+}
+
+void FilteringElement::SharedChainEnded(SharedChain* chain) {
+  const SharedChainMap::iterator it = shared_chains_.find(chain->key());
+  if ( it != shared_chains_.end() && it->second == chain ) {
+    shared_chains_.erase(it);
+  }
+}
+
 bool FilteringElement::HasMedia(const string& media) {
   return mapper_->HasMedia(media);
 }
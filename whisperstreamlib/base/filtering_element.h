@@ -33,6 +33,7 @@
 #define __MEDIA_BASE_MEDIA_FILTERING_ELEMENT_H__
 
 #include <list>
+#include <map>
 #include <string>
 
 #include <whisperlib/common/base/types.h>
@@ -171,6 +172,15 @@ class FilteringCallbackData {
 //   ...
 // };
 //
+// If the filtering does not depend on the client (e.g. a format conversion),
+// override IsClientIndependentFiltering() to return true. Then all the
+// requests for the same media and flavour that play from the start (no
+// seek, no limit) share one FilteringCallbackData (one upstream
+// registration, one FilterTag per tag), and its output is distributed to
+// them through a TagDistributor (which also bootstraps the late joiners).
+// As late joiners get the stream from where the shared chain is, this
+// makes sense only for live sources.
+//
 class FilteringElement : public Element {
  public:
   FilteringElement(const string& type,
@@ -191,6 +201,11 @@ class FilteringElement : public Element {
     data->client_process_tag_callback_ = NULL;
     data->DecRef();
   }
+  // Override this to return true if the FilteringCallbackData-s produce
+  // the same output for all clients (see above).
+  virtual bool IsClientIndependentFiltering() const {
+    return false;
+  }
 
  public:
   // The Element interface methods
@@ -216,6 +231,28 @@ class FilteringElement : public Element {
   Closure* close_completed_;
 
  private:
+  class SharedChain;
+
+  // Returns the key of the shared chain that can serve req, or an empty
+  // string if req needs its own FilteringCallbackData.
+  string GetSharedChainKey(const string& media, const Request* req) const;
+  bool AddSharedRequest(const string& key, const string& media,
+                        Request* req, ProcessingCallback* callback);
+  SharedChain* CreateSharedChain(const string& key, const string& media,
+                                 Request* req);
+  void RemoveSharedRequest(Request* req);
+  // Called when the chain got an EOS - no more joiners for it.
+  void SharedChainEnded(SharedChain* chain);
+  // Runs close_completed_ if we are closing and all clients are gone.
+  void MaybeCompleteClose();
+
+  // Shared chains that accept new clients, by key.
+  typedef map<string, SharedChain*> SharedChainMap;
+  SharedChainMap shared_chains_;
+  // The clients served by shared chains.
+  typedef map<Request*, SharedChain*> SharedClientMap;
+  SharedClientMap shared_clients_;
+
   DISALLOW_EVIL_CONSTRUCTORS(FilteringElement);
 };
 }
@@ -35,6 +35,7 @@
 #include <whisperlib/common/io/ioutil.h>
 #include <whisperlib/common/io/file/file.h>
 #include "base/saver.h"
+#include "base/time_range_index.h"
 #include "flv/flv_tag.h"
 #include "aac/aac_tag_splitter.h"
 #include "mp3/mp3_frame.h"
@@ -174,13 +175,24 @@ void Saver::CloseFile() {
   const string filename = current_file_.filename();
   current_file_.Close();
   // rename temporary file to final file
-  if ( strutil::StrEndsWith(filename, kTempFileSuffix) ) {
-    io::Rename(filename, MakeFilename(filename), false);
+  if ( strutil::StrEndsWith(filename, kTempFileSuffix) &&
+       io::Rename(filename, MakeFilename(filename), false) ) {
+    // and add it to the time range index of our directory
+    const string final_file = strutil::SplitLast(MakeFilename(filename),
+                                                 "/").second;
+    int64 begin_ts = 0;
+    if ( ParseFilename(final_file, &begin_ts, NULL) &&
+         !TimeRangeIndex::AppendToIndexFile(media_dir_, begin_ts,
+                                            timer::Date::Now(), final_file) ) {
+      ILOG_ERROR << "Cannot index: [" << final_file << "]";
+    }
   }
 }
 void Saver::RecoverTempFiles() {
   // rename all temp files that were left behind by a previous crash, to their
   // final name
+  const bool has_index = io::Exists(
+      strutil::JoinPaths(media_dir_, TimeRangeIndex::kIndexFile));
   re::RE tmp_re(kTempFileRE);
   vector<string> tmp_files;
   io::DirList(media_dir_, io::LIST_FILES | io::LIST_RECURSIVE, &tmp_re, &tmp_files);
@@ -188,7 +200,23 @@ void Saver::RecoverTempFiles() {
               ", probably from a previous crash.";
   for ( uint32 i = 0; i < tmp_files.size(); i++ ) {
     const string tmp_full_path = strutil::JoinPaths(media_dir_, tmp_files[i]);
-    io::Rename(tmp_full_path, MakeFilename(tmp_full_path), false);
+    if ( !io::Rename(tmp_full_path, MakeFilename(tmp_full_path), false) ) {
+      continue;
+    }
+    int64 begin_ts, end_ts;
+    const string file = MakeFilename(tmp_files[i]);
+    if ( has_index &&
+         TimeRangeIndex::GetFileTimeRange(media_dir_, file,
+                                          &begin_ts, &end_ts) ) {
+      TimeRangeIndex::AppendToIndexFile(media_dir_, begin_ts, end_ts, file);
+    }
+  }
+  // The first time we save here - have what is already there indexed
+  // (once, by the TimeRangeCatalog that loads the index first, on its
+  // thread - from now on we keep the index up to date as we close files)
+  if ( !has_index && !TimeRangeIndex::CreateIndexFile(media_dir_) ) {
+    ILOG_ERROR << "Cannot create the time range index in: ["
+               << media_dir_ << "]";
   }
 }
 
@@ -0,0 +1,153 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <whisperlib/common/base/gflags.h>
+#include <whisperstreamlib/base/send_scheduler.h>
+
+DEFINE_int32(viewer_congestion_drop_non_reference_ms,
+             2000,
+             "When we have more then these many milliseconds of media "
+             "queued towards a viewer we start dropping its non reference "
+             "video frames. <= 0 to disable.");
+DEFINE_int32(viewer_congestion_drop_interframes_ms,
+             4000,
+             "When we have more then these many milliseconds of media "
+             "queued towards a viewer we drop its video frames up to the "
+             "next keyframe. <= 0 to disable.");
+
+namespace {
+// We recompute the media byte rate over windows of this length
+const int64 kRateWindowMs = 5000;
+}
+
+namespace streaming {
+
+SendScheduler::SendScheduler()
+    : drop_non_reference_ms_(FLAGS_viewer_congestion_drop_non_reference_ms),
+      drop_interframes_ms_(FLAGS_viewer_congestion_drop_interframes_ms),
+      window_start_ms_(-1),
+      window_bytes_(0),
+      bytes_per_sec_(0),
+      backlog_ms_(0),
+      waiting_for_keyframe_(false),
+      non_reference_dropped_(0),
+      interframes_dropped_(0) {
+}
+
+SendScheduler::SendScheduler(int64 drop_non_reference_ms,
+                             int64 drop_interframes_ms)
+    : drop_non_reference_ms_(drop_non_reference_ms),
+      drop_interframes_ms_(drop_interframes_ms),
+      window_start_ms_(-1),
+      window_bytes_(0),
+      bytes_per_sec_(0),
+      backlog_ms_(0),
+      waiting_for_keyframe_(false),
+      non_reference_dropped_(0),
+      interframes_dropped_(0) {
+}
+
+SendScheduler::~SendScheduler() {
+}
+
+void SendScheduler::UpdateRate(const Tag* tag, int64 stream_time_ms) {
+  const io::MemoryStream* const data = tag->Data();
+  if ( data == NULL ) {
+    return;
+  }
+  if ( window_start_ms_ < 0 || stream_time_ms < window_start_ms_ ) {
+    window_start_ms_ = stream_time_ms;
+    window_bytes_ = 0;
+  }
+  window_bytes_ += data->Size();
+  const int64 window_ms = stream_time_ms - window_start_ms_;
+  if ( window_ms >= kRateWindowMs ) {
+    const int64 bytes_per_sec = window_bytes_ * 1000 / window_ms;
+    // smooth it a bit - one window of low motion should not make us
+    // believe the backlog is huge
+    bytes_per_sec_ = bytes_per_sec_ == 0 ? bytes_per_sec :
+                     (bytes_per_sec_ + bytes_per_sec) / 2;
+    window_start_ms_ = stream_time_ms;
+    window_bytes_ = 0;
+  }
+}
+
+SendScheduler::Action SendScheduler::Schedule(const Tag* tag,
+                                              int64 stream_time_ms,
+                                              int32 queued_bytes,
+                                              int64 queued_ms) {
+  UpdateRate(tag, stream_time_ms);
+  if ( !IsDroppable(tag) ) {
+    return SEND;
+  }
+  // W/o a byte rate we cannot tell the backlog (we send everything)
+  backlog_ms_ = 0;
+  if ( bytes_per_sec_ > 0 ) {
+    backlog_ms_ = queued_bytes * static_cast<int64>(1000) / bytes_per_sec_ +
+                  max(queued_ms, static_cast<int64>(0));
+  }
+  const bool over_interframes = drop_interframes_ms_ > 0 &&
+                                backlog_ms_ >= drop_interframes_ms_;
+  if ( waiting_for_keyframe_ ) {
+    if ( tag->can_resync() && !over_interframes ) {
+      waiting_for_keyframe_ = false;
+      return SEND;
+    }
+    ++interframes_dropped_;
+    return DROP_INTERFRAME;
+  }
+  if ( tag->is_non_reference() ) {
+    if ( over_interframes ||
+         (drop_non_reference_ms_ > 0 &&
+          backlog_ms_ >= drop_non_reference_ms_) ) {
+      ++non_reference_dropped_;
+      return DROP_NON_REFERENCE;
+    }
+    return SEND;
+  }
+  if ( over_interframes ) {
+    waiting_for_keyframe_ = true;
+    ++interframes_dropped_;
+    return DROP_INTERFRAME;
+  }
+  return SEND;
+}
+
+string SendScheduler::ToString() const {
+  return strutil::StringPrintf(
+      "SendScheduler{backlog: %" PRId64 " ms, rate: %" PRId64 " Bps, "
+      "waiting_for_keyframe: %s, non_reference_dropped: %" PRId64 ", "
+      "interframes_dropped: %" PRId64 "}",
+      backlog_ms_, bytes_per_sec_,
+      strutil::BoolToString(waiting_for_keyframe_).c_str(),
+      non_reference_dropped_, interframes_dropped_);
+}
+}
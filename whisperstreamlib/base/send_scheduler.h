@@ -0,0 +1,116 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#ifndef __MEDIA_BASE_SEND_SCHEDULER_H__
+#define __MEDIA_BASE_SEND_SCHEDULER_H__
+
+#include <whisperstreamlib/base/tag.h>
+
+namespace streaming {
+
+// Decides, per viewer, which tags to skip when the viewer cannot keep up.
+//
+// The exporter asks us about each tag right before sending it, telling us
+// how many bytes are still queued towards the peer (our output buffer +
+// the kernel send queue). We translate these into milliseconds of media
+// (using the byte rate of the stream), add the media still waiting in
+// the exporter (e.g. held back by the EgressPacer) and, as the backlog
+// grows:
+//  - over drop_non_reference_ms: we drop non reference video frames
+//    (nobody depends on them, so no resync is needed)
+//  - over drop_interframes_ms: we drop any video frame. Once we drop a
+//    reference frame we keep dropping video until the next keyframe
+//    (the next tag that can_resync()) comes with the backlog under
+//    drop_interframes_ms.
+// Audio, metadata and non droppable tags are never dropped.
+//
+// Not thread safe - use it from the net thread.
+class SendScheduler {
+ public:
+  enum Action {
+    SEND,
+    DROP_NON_REFERENCE,
+    DROP_INTERFRAME,
+  };
+  // Uses the thresholds from flags.
+  SendScheduler();
+  // A threshold <= 0 disables that kind of dropping
+  SendScheduler(int64 drop_non_reference_ms, int64 drop_interframes_ms);
+  ~SendScheduler();
+
+  // Only for these tags we need to know the output queue size
+  // (save a system call for the others..)
+  static bool IsDroppable(const Tag* tag) {
+    return tag->is_video_tag() && tag->is_droppable();
+  }
+
+  // Decides what to do w/ the given tag.
+  //  stream_time_ms: the stream time of the tag
+  //  queued_bytes: the bytes still queued towards the peer (0 if
+  //                !IsDroppable(tag))
+  //  queued_ms: the media (ms) queued before the connection, behind
+  //             this tag
+  Action Schedule(const Tag* tag, int64 stream_time_ms, int32 queued_bytes,
+                  int64 queued_ms);
+
+  int64 non_reference_dropped() const { return non_reference_dropped_; }
+  int64 interframes_dropped() const { return interframes_dropped_; }
+  // The last backlog we computed (ms of media)
+  int64 backlog_ms() const { return backlog_ms_; }
+  // The estimated media byte rate (bytes per second), 0 if unknown yet
+  int64 bytes_per_sec() const { return bytes_per_sec_; }
+
+  string ToString() const;
+
+ private:
+  void UpdateRate(const Tag* tag, int64 stream_time_ms);
+
+  const int64 drop_non_reference_ms_;
+  const int64 drop_interframes_ms_;
+
+  // Media byte rate estimation: bytes seen since window_start_ms_
+  int64 window_start_ms_;
+  int64 window_bytes_;
+  // The estimated byte rate of the media (bytes per second), 0 if unknown
+  int64 bytes_per_sec_;
+
+  int64 backlog_ms_;
+  // We dropped a reference frame - waiting for a keyframe
+  bool waiting_for_keyframe_;
+
+  int64 non_reference_dropped_;
+  int64 interframes_dropped_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(SendScheduler);
+};
+}
+
+#endif  // __MEDIA_BASE_SEND_SCHEDULER_H__
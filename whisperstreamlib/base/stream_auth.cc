@@ -2,6 +2,7 @@
 // All rights reserved.
 
 #include <whisperlib/common/base/timer.h>
+#include <whisperlib/common/sync/atomic.h>
 #include <whisperstreamlib/base/stream_auth.h>
 #include <whisperstreamlib/base/request.h>
 #include <whisperstreamlib/base/auto/request_types.h>
@@ -93,6 +94,8 @@ string AuthorizerReply::ToString() const {
   return oss.str();
 }
 
+int32 AsyncAuthorize::num_pending_ = 0;
+
 AsyncAuthorize::AsyncAuthorize(net::Selector& selector)
   : auth_(NULL),
     req_(),
@@ -132,6 +135,7 @@ void AsyncAuthorize::Start(Authorizer* auth,
   req_ = req;
   first_auth_completion_ = completion;
   reauthorization_failed_ = reauthorization_failed;
+  synch::AtomicAddAndFetch(&num_pending_, 1);
   auth_->Authorize(req_, authorization_completed_);
 }
 
@@ -144,6 +148,9 @@ void AsyncAuthorize::Stop() {
   auth_->DecRef();
   auth_ = NULL;
 
+  if ( first_auth_completion_ != NULL ) {
+    synch::AtomicSubAndFetch(&num_pending_, 1);
+  }
   delete first_auth_completion_;
   first_auth_completion_ = NULL;
 
@@ -163,6 +170,7 @@ void AsyncAuthorize::AuthorizationCompleted(const AuthorizerReply& reply) {
     first_auth_ts_ = timer::TicksMsec();
     Callback1<bool>* c = first_auth_completion_;
     first_auth_completion_ = NULL;
+    synch::AtomicSubAndFetch(&num_pending_, 1);
     if ( reauthorization_failed_ != NULL &&
          reply.allowed_ &&
          reply.time_limit_ms_ > 0 ) {
@@ -162,6 +162,10 @@ class AsyncAuthorize {
   // Also stops reauthorization.
   void Stop();
 
+  // The number of first authorizations in progress, in the whole process
+  // (a load indicator - e.g. for the accept time admission control).
+  static int32 num_pending() { return num_pending_; }
+
  private:
   // Restart authorization
   void Reauthorize();
@@ -188,6 +192,8 @@ class AsyncAuthorize {
   // timestamp of the first authorization. Used to calculate
   // action_performed_ms_ for reauthorization.
   int64 first_auth_ts_;
+
+  static int32 num_pending_;
 };
 
 }
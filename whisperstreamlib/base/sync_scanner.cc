@@ -0,0 +1,169 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+
+#include <string.h>
+
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/io/buffer/memory_stream.h>
+
+#include "base/sync_scanner.h"
+
+namespace streaming {
+
+int32 FindAudioSync(const uint8* data, int32 size, uint8 mask) {
+  const uint8* const end = data + size;
+  const uint8* p = data;
+  while ( p + 1 < end ) {
+    // only bytes that have a follower can start a sync word
+    p = reinterpret_cast<const uint8*>(memchr(p, 0xff, end - 1 - p));
+    if ( p == NULL ) {
+      return -1;
+    }
+    if ( (p[1] & mask) == mask ) {
+      return p - data;
+    }
+    ++p;
+  }
+  return -1;
+}
+
+int32 FindStartCode(const uint8* data, int32 size) {
+  const uint8* const end = data + size;
+  const uint8* p = data + 2;
+  while ( p < end ) {
+    p = reinterpret_cast<const uint8*>(memchr(p, 0x01, end - p));
+    if ( p == NULL ) {
+      return -1;
+    }
+    if ( p[-1] == 0x00 && p[-2] == 0x00 ) {
+      return p - 2 - data;
+    }
+    ++p;
+  }
+  return -1;
+}
+
+// Looks for the sync word in the blocks of 'in', starting at 'from'.
+// On -1 returns in *ends_in_ff if the last byte of the stream is 0xff
+// (i.e. a sync word may start there).
+static int32 ScanAudioSync(const io::MemoryStream& in, int32 from,
+                           uint8 mask, bool* ends_in_ff) {
+  *ends_in_ff = false;
+  if ( from < 0 ) {
+    from = 0;
+  }
+  if ( in.Size() <= static_cast<uint32>(from) ) {
+    return -1;
+  }
+  io::DataBlockPointer ptr(in.GetReadPointer());
+  if ( from > 0 ) {
+    ptr.Advance(from);
+  }
+  int32 offset = from;
+  const char* data = NULL;
+  int32 size = 0;
+  while ( ptr.ReadBlock(&data, &size) ) {
+    if ( size > 0 ) {
+      const uint8* const b = reinterpret_cast<const uint8*>(data);
+      // the seam: a 0xff at the end of the previous block
+      if ( *ends_in_ff && (b[0] & mask) == mask ) {
+        *ends_in_ff = false;
+        return offset - 1;
+      }
+      const int32 pos = FindAudioSync(b, size, mask);
+      if ( pos >= 0 ) {
+        *ends_in_ff = false;
+        return offset + pos;
+      }
+      *ends_in_ff = (b[size - 1] == 0xff);
+      offset += size;
+    }
+    size = 0;
+  }
+  return -1;
+}
+
+int32 FindAudioSync(const io::MemoryStream& in, int32 from, uint8 mask) {
+  bool ends_in_ff;
+  return ScanAudioSync(in, from, mask, &ends_in_ff);
+}
+
+int32 FindStartCode(const io::MemoryStream& in, int32 from) {
+  if ( from < 0 ) {
+    from = 0;
+  }
+  if ( in.Size() <= static_cast<uint32>(from) ) {
+    return -1;
+  }
+  io::DataBlockPointer ptr(in.GetReadPointer());
+  if ( from > 0 ) {
+    ptr.Advance(from);
+  }
+  int32 offset = from;
+  // consecutive 0x00 bytes right before the current block
+  int32 zeros = 0;
+  const char* data = NULL;
+  int32 size = 0;
+  while ( ptr.ReadBlock(&data, &size) ) {
+    const uint8* const b = reinterpret_cast<const uint8*>(data);
+    // the seam: start codes that begin in the previous block(s)
+    for ( int32 i = 0; i < size && i < 2; ++i ) {
+      if ( b[i] == 0x01 && zeros >= 2 ) {
+        return offset + i - 2;
+      }
+      zeros = (b[i] == 0x00) ? zeros + 1 : 0;
+    }
+    const int32 pos = FindStartCode(b, size);
+    if ( pos >= 0 ) {
+      return offset + pos;
+    }
+    if ( size >= 2 ) {
+      zeros = (b[size - 1] != 0x00) ? 0 : (b[size - 2] != 0x00) ? 1 : 2;
+    }
+    offset += size;
+    size = 0;
+  }
+  return -1;
+}
+
+bool SkipToAudioSync(io::MemoryStream* in, uint8 mask) {
+  bool ends_in_ff;
+  const int32 pos = ScanAudioSync(*in, 0, mask, &ends_in_ff);
+  if ( pos >= 0 ) {
+    in->Skip(pos);
+    return true;
+  }
+  const int32 size = in->Size();
+  in->Skip(ends_in_ff ? size - 1 : size);
+  return false;
+}
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+
+#ifndef __MEDIA_BASE_SYNC_SCANNER_H__
+#define __MEDIA_BASE_SYNC_SCANNER_H__
+
+#include <whisperlib/common/base/types.h>
+
+namespace io { class MemoryStream; }
+
+// Helpers for locating frame boundaries in elementary (raw) media streams:
+// MPEG audio sync words and MPEG / H.264 start codes.
+//
+// They work directly on the data blocks of the io::MemoryStream (no
+// copy, no per byte Peek()), searching each block with memchr, which is
+// vectorized in any decent libc. Only the few bytes where two blocks
+// meet are looked at one by one.
+
+namespace streaming {
+
+// MPEG audio sync masks, for the byte that follows the 0xff.
+static const uint8 kMp3SyncMask = 0xe0;   // 11 bit sync
+static const uint8 kAdtsSyncMask = 0xf0;  // 12 bit sync (AAC ADTS)
+
+// Returns the offset (relative to the read position of 'in') of the first
+// MPEG audio sync word at or after 'from': a 0xff byte followed by a byte b
+// with (b & mask) == mask. Returns -1 if there is none.
+int32 FindAudioSync(const io::MemoryStream& in, int32 from, uint8 mask);
+
+// Returns the offset (relative to the read position of 'in') of the first
+// 00 00 01 start code at or after 'from', or -1 if there is none.
+// For a four byte start code (00 00 00 01) we return the offset of its
+// last three bytes.
+int32 FindStartCode(const io::MemoryStream& in, int32 from);
+
+// Skips the data in 'in' until an audio sync word (see FindAudioSync) is
+// at the read position, and returns true. If there is no sync word we skip
+// all the data we can (keeping a possible last 0xff) and return false.
+bool SkipToAudioSync(io::MemoryStream* in, uint8 mask);
+
+// The same as above, for a contiguous buffer: the returned offsets are
+// relative to 'data'.
+int32 FindAudioSync(const uint8* data, int32 size, uint8 mask);
+int32 FindStartCode(const uint8* data, int32 size);
+}
+
+#endif  // __MEDIA_BASE_SYNC_SCANNER_H__
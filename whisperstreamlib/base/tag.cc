@@ -110,6 +110,7 @@ string Tag::AttributesName(uint32 attr) {
   CONSIDER_ATTR(ATTR_VIDEO);
   CONSIDER_ATTR(ATTR_DROPPABLE);
   CONSIDER_ATTR(ATTR_CAN_RESYNC);
+  CONSIDER_ATTR(ATTR_NON_REFERENCE);
 #undef CONSIDER_ATTR
   return ret;
 }
@@ -110,6 +110,9 @@ class Tag : public RefCounted {
     ATTR_VIDEO        = 0x0004,
     ATTR_DROPPABLE    = 0x0008,
     ATTR_CAN_RESYNC   = 0x0010,
+    // A video frame no other frame references (e.g. a disposable
+    // inter frame) - it can be dropped w/o waiting for a resync point.
+    ATTR_NON_REFERENCE = 0x0020,
   };
   static string AttributesName(uint32 attr);
 
@@ -174,6 +177,9 @@ class Tag : public RefCounted {
   bool can_resync() const {
     return (attributes_ & ATTR_CAN_RESYNC) == ATTR_CAN_RESYNC;
   }
+  bool is_non_reference() const {
+    return (attributes_ & ATTR_NON_REFERENCE) == ATTR_NON_REFERENCE;
+  }
   bool is_video_tag() const {
     return (attributes_ & ATTR_VIDEO) == ATTR_VIDEO;
   }
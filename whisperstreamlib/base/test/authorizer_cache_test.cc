@@ -0,0 +1,203 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/timer.h>
+#include <whisperlib/common/base/callback.h>
+#include <whisperstreamlib/base/authorizer_cache.h>
+
+using streaming::Authorizer;
+using streaming::AuthorizerReply;
+using streaming::AuthorizerRequest;
+using streaming::CachingAuthorizer;
+
+namespace {
+
+// Replies right away w/ the configured reply, counting the calls
+class FakeAuthorizer : public Authorizer {
+ public:
+  FakeAuthorizer()
+      : Authorizer("fake"),
+        reply_(true, 0),
+        num_calls_(0) {
+  }
+  virtual bool Initialize() { return true; }
+  virtual void Authorize(const AuthorizerRequest& req,
+                         CompletionCallback* completion) {
+    ++num_calls_;
+    completion->Run(reply_);
+  }
+  virtual void Cancel(CompletionCallback* completion) {
+  }
+  AuthorizerReply reply_;
+  int32 num_calls_;
+};
+
+bool g_completed = false;
+AuthorizerReply g_reply(false, 0);
+void Completed(const AuthorizerReply& reply) {
+  g_completed = true;
+  g_reply = reply;
+}
+
+AuthorizerReply Authorize(Authorizer* auth, const AuthorizerRequest& req) {
+  g_completed = false;
+  auth->Authorize(req, NewCallback(&Completed));
+  CHECK(g_completed);
+  return g_reply;
+}
+
+AuthorizerRequest MakeRequest(const string& passwd, const string& address) {
+  return AuthorizerRequest("john", passwd, "", address,
+                           "rtmp://host/app/stream", "view", 0);
+}
+
+void TestHitMiss() {
+  FakeAuthorizer* const fake = new FakeAuthorizer();
+  CachingAuthorizer* const cache =
+      new CachingAuthorizer(fake, 10000, 10000, 100);
+  cache->IncRef();
+
+  const AuthorizerRequest req(MakeRequest("secret-pass", "1.2.3.4:5000"));
+  CHECK(Authorize(cache, req).allowed_);
+  CHECK_EQ(fake->num_calls_, 1);
+  CHECK_EQ(cache->num_misses(), 1);
+  CHECK_EQ(cache->num_hits(), 0);
+
+  // hit: same request, and the same /24
+  CHECK(Authorize(cache, req).allowed_);
+  CHECK(Authorize(cache, MakeRequest("secret-pass", "1.2.3.7:80")).allowed_);
+  CHECK_EQ(fake->num_calls_, 1);
+  CHECK_EQ(cache->num_hits(), 2);
+
+  // miss: another password, another network
+  fake->reply_ = AuthorizerReply(false, 0);
+  CHECK(!Authorize(cache, MakeRequest("other-pass", "1.2.3.4:5000")).allowed_);
+  CHECK(!Authorize(cache, MakeRequest("secret-pass", "1.2.4.4:5000")).allowed_);
+  CHECK_EQ(fake->num_calls_, 3);
+  CHECK_EQ(cache->num_misses(), 3);
+  CHECK_EQ(cache->num_entries(), 3);
+  // .. while the grant is still cached
+  CHECK(Authorize(cache, req).allowed_);
+  CHECK_EQ(fake->num_calls_, 3);
+
+  cache->DecRef();
+  LOG_INFO << "OK hit / miss";
+}
+
+void TestKey() {
+  // The key keeps only a digest of the password
+  const AuthorizerRequest req(MakeRequest("secret-pass", "1.2.3.4:5000"));
+  const string key = CachingAuthorizer::GetCacheKey(req);
+  CHECK(key.find("secret-pass") == string::npos) << key;
+  CHECK(key.find(CachingAuthorizer::GetPasswordDigest("secret-pass")) !=
+        string::npos);
+  CHECK_EQ(CachingAuthorizer::GetPasswordDigest("").size(), 0);
+  CHECK_EQ(CachingAuthorizer::GetPasswordDigest("abc"),
+           "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  CHECK_NE(key, CachingAuthorizer::GetCacheKey(
+               MakeRequest("secret-pasS", "1.2.3.4:5000")));
+  CHECK_EQ(CachingAuthorizer::GetNetAddressClass("1.2.3.4:80"), "1.2.3");
+  CHECK_EQ(CachingAuthorizer::GetNetAddressClass("[2001:db8:1:2:3::4]:80"),
+           "2001:db8:1:2");
+  LOG_INFO << "OK key";
+}
+
+void TestExpiration() {
+  FakeAuthorizer* const fake = new FakeAuthorizer();
+  CachingAuthorizer* const cache =
+      new CachingAuthorizer(fake, 10000, 100, 100);
+  cache->IncRef();
+
+  // a grant is cached only for what is left of it
+  fake->reply_ = AuthorizerReply(true, 200);
+  const AuthorizerRequest req(MakeRequest("secret-pass", "1.2.3.4:5000"));
+  CHECK(Authorize(cache, req).allowed_);
+  timer::SleepMsec(50);
+  const AuthorizerReply cached = Authorize(cache, req);
+  CHECK(cached.allowed_);
+  CHECK_GT(cached.time_limit_ms_, 0);
+  CHECK_LE(cached.time_limit_ms_, 150);
+  CHECK_EQ(fake->num_calls_, 1);
+  timer::SleepMsec(200);
+  CHECK(Authorize(cache, req).allowed_);
+  CHECK_EQ(fake->num_calls_, 2);
+
+  // denials are kept for deny_ttl_ms
+  fake->reply_ = AuthorizerReply(false, 0);
+  const AuthorizerRequest deny_req(MakeRequest("bad-pass", "1.2.3.4:5000"));
+  CHECK(!Authorize(cache, deny_req).allowed_);
+  CHECK(!Authorize(cache, deny_req).allowed_);
+  CHECK_EQ(fake->num_calls_, 3);
+  timer::SleepMsec(150);
+  CHECK(!Authorize(cache, deny_req).allowed_);
+  CHECK_EQ(fake->num_calls_, 4);
+
+  cache->DecRef();
+  LOG_INFO << "OK expiration";
+}
+
+void TestEviction() {
+  FakeAuthorizer* const fake = new FakeAuthorizer();
+  CachingAuthorizer* const cache =
+      new CachingAuthorizer(fake, 10000, 10000, 2);
+  cache->IncRef();
+
+  const AuthorizerRequest a(MakeRequest("a", "1.2.3.4:5000"));
+  const AuthorizerRequest b(MakeRequest("b", "1.2.3.4:5000"));
+  const AuthorizerRequest c(MakeRequest("c", "1.2.3.4:5000"));
+  Authorize(cache, a);
+  Authorize(cache, b);
+  Authorize(cache, a);     // a is now the most recent
+  Authorize(cache, c);     // evicts b
+  CHECK_EQ(cache->num_entries(), 2);
+  CHECK_EQ(fake->num_calls_, 3);
+  Authorize(cache, a);
+  CHECK_EQ(fake->num_calls_, 3);
+  Authorize(cache, b);
+  CHECK_EQ(fake->num_calls_, 4);
+
+  cache->DecRef();
+  LOG_INFO << "OK eviction";
+}
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestHitMiss();
+  TestKey();
+  TestExpiration();
+  TestEviction();
+  LOG_INFO << "PASS";
+  common::Exit(0);
+}
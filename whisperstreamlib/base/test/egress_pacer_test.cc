@@ -0,0 +1,126 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperstreamlib/base/egress_pacer.h>
+
+using streaming::EgressPacer;
+
+namespace {
+
+const int64 kInitialBurstMs = 3000;
+const int64 kMaxBurstMs = 250;
+const int32 kRatePercent = 125;
+const int64 kTagIntervalMs = 40;
+
+void TestDisabled() {
+  EgressPacer pacer(false, kInitialBurstMs, kMaxBurstMs, kRatePercent, true);
+  for ( int64 t = 0; t < 100000; t += kTagIntervalMs ) {
+    CHECK_EQ(pacer.Delay(t, 0), 0);
+  }
+  int64 rate = 0;
+  CHECK(!pacer.KernelRateNeeded(10000, &rate));
+  LOG_INFO << "OK disabled";
+}
+
+void TestBursts() {
+  EgressPacer pacer(true, kInitialBurstMs, kMaxBurstMs, kRatePercent, false);
+  int64 now_ms = 1000;
+  int64 t = 0;
+  // The initial burst goes at once
+  for ( ; t <= kInitialBurstMs; t += kTagIntervalMs ) {
+    CHECK_EQ(pacer.Delay(t, now_ms), 0) << t;
+  }
+  // .. then we wait for the refill (at 125% of the real time)
+  const int64 delay_ms = pacer.Delay(t, now_ms);
+  CHECK_EQ(delay_ms, (kTagIntervalMs * 100 + kRatePercent - 1) / kRatePercent);
+  CHECK_GT(pacer.Delay(t, now_ms + delay_ms - 1), 0);
+  now_ms += delay_ms;
+  CHECK_EQ(pacer.Delay(t, now_ms), 0);
+  t += kTagIntervalMs;
+
+  // After a long pause we send at most max_burst at once
+  now_ms += 60000;
+  const int64 burst_start = t;
+  while ( pacer.Delay(t, now_ms) == 0 ) {
+    t += kTagIntervalMs;
+    CHECK_LT(t - burst_start, 10 * kMaxBurstMs);
+  }
+  CHECK_LE(t - burst_start, kMaxBurstMs + kTagIntervalMs);
+  CHECK_GT(t - burst_start, kMaxBurstMs - kTagIntervalMs);
+
+  // A timestamp jump is a discontinuity, not media to pace
+  t += 60000;
+  CHECK_EQ(pacer.Delay(t, now_ms), 0);
+  // .. and the same for going back in time
+  CHECK_EQ(pacer.Delay(t - 1000, now_ms), 0);
+  LOG_INFO << "OK bursts: " << pacer.ToString();
+}
+
+void TestKernelPacing() {
+  EgressPacer pacer(true, kInitialBurstMs, kMaxBurstMs, kRatePercent, true);
+  int64 rate = 0;
+  // No media rate yet
+  CHECK(!pacer.KernelRateNeeded(0, &rate));
+  CHECK(pacer.KernelRateNeeded(10000, &rate));
+  CHECK_EQ(rate, 10000 * kRatePercent / 100);
+  pacer.KernelRateSet(rate, true);
+  CHECK(pacer.is_kernel_pacing());
+  // The kernel paces - we let everything go
+  for ( int64 t = 0; t < 2 * kInitialBurstMs; t += kTagIntervalMs ) {
+    CHECK_EQ(pacer.Delay(t, 0), 0);
+  }
+  // Small media rate changes do not touch the kernel rate, large do
+  CHECK(!pacer.KernelRateNeeded(11000, &rate));
+  CHECK(pacer.KernelRateNeeded(20000, &rate));
+  // The kernel cannot pace - we fall back to user space pacing
+  pacer.KernelRateSet(rate, false);
+  CHECK(!pacer.is_kernel_pacing());
+  CHECK(!pacer.KernelRateNeeded(20000, &rate));
+  int64 t = 0;
+  for ( ; t <= kInitialBurstMs; t += kTagIntervalMs ) {
+    CHECK_EQ(pacer.Delay(t, 0), 0);
+  }
+  CHECK_GT(pacer.Delay(t, 0), 0);
+  LOG_INFO << "OK kernel pacing";
+}
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestDisabled();
+  TestBursts();
+  TestKernelPacing();
+  LOG_INFO << "PASS";
+  common::Exit(0);
+}
@@ -0,0 +1,308 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <set>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/callback.h>
+#include <whisperlib/net/base/selector.h>
+#include <whisperstreamlib/base/consts.h>
+#include <whisperstreamlib/base/filtering_element.h>
+#include <whisperstreamlib/base/test/test_tag.h>
+
+using namespace streaming;
+
+namespace {
+
+// Takes the requests of the filtering element: one registration per
+// upstream media. As the real mappers, deletes the requests on
+// RemoveRequest.
+class TestMapper : public ElementMapper {
+ public:
+  TestMapper() : ElementMapper(NULL), num_adds_(0) {}
+  virtual ~TestMapper() {
+    CHECK(upstream_.empty());
+  }
+  virtual bool AddRequest(const string& media, Request* req,
+                          ProcessingCallback* callback) {
+    CHECK(upstream_.find(req) == upstream_.end());
+    CHECK(req->info().is_internal_);
+    upstream_[req] = callback;
+    ++num_adds_;
+    return true;
+  }
+  virtual void RemoveRequest(Request* req, ProcessingCallback* callback) {
+    const map<Request*, ProcessingCallback*>::iterator it =
+        upstream_.find(req);
+    CHECK(it != upstream_.end());
+    CHECK(it->second == callback);
+    upstream_.erase(it);
+    delete req;
+  }
+  virtual void GetMediaDetails(const string& protocol, const string& path,
+                               Request* req,
+                               Callback1<bool>* completion_callback) {
+  }
+  virtual Authorizer* GetAuthorizer(const string& name) { return NULL; }
+  virtual bool HasMedia(const string& media) { return true; }
+  virtual void ListMedia(const string& media_dir, vector<string>* out) {}
+  virtual bool GetElementByName(const string& name, Element** element,
+                                vector<Policy*>** policies) {
+    return false;
+  }
+  virtual void GetAllElements(vector<string>* out_elements) const {}
+  virtual bool IsKnownElementName(const string& name) { return false; }
+  virtual bool GetMediaAlias(const string& alias_name,
+                             string* media_name) const {
+    return false;
+  }
+  virtual string TranslateMedia(const string& media) const { return media; }
+  virtual bool DescribeMedia(const string& media,
+                             MediaInfoCallback* callback) {
+    return false;
+  }
+  virtual int32 AddExportClient(const string& protocol,
+                                const string& export_path) {
+    return 0;
+  }
+  virtual void RemoveExportClient(const string& protocol,
+                                  const string& export_path) {}
+  virtual bool AddImporter(Importer* importer) { return false; }
+  virtual void RemoveImporter(Importer* importer) {}
+  virtual Importer* GetImporter(Importer::Type importer_type,
+                                const string& path) {
+    return NULL;
+  }
+
+  int num_adds() const { return num_adds_; }
+  int num_upstream() const { return upstream_.size(); }
+  // Sends a tag from upstream, to the registration w/ the given flavour
+  void Send(uint32 flavour_mask, const Tag* tag) {
+    for ( map<Request*, ProcessingCallback*>::iterator it = upstream_.begin();
+          it != upstream_.end(); ++it ) {
+      if ( it->first->caps().flavour_mask_ == flavour_mask ) {
+        it->second->Run(tag, 0);
+        return;
+      }
+    }
+    LOG_FATAL << "No upstream for flavour: " << flavour_mask;
+  }
+
+ private:
+  map<Request*, ProcessingCallback*> upstream_;
+  int num_adds_;
+};
+
+int g_num_filtered = 0;
+
+class TestCallbackData : public FilteringCallbackData {
+ public:
+  TestCallbackData() {}
+  virtual void FilterTag(const Tag* tag, int64 timestamp_ms, TagList* out) {
+    ++g_num_filtered;
+    out->push_back(FilteredTag(tag, timestamp_ms));
+  }
+};
+
+class TestElement : public FilteringElement {
+ public:
+  TestElement(ElementMapper* mapper, net::Selector* selector)
+      : FilteringElement("test", "test", mapper, selector) {
+  }
+  virtual bool Initialize() { return true; }
+ protected:
+  virtual FilteringCallbackData* CreateCallbackData(const string& media,
+                                                    Request* req) {
+    return new TestCallbackData();
+  }
+  virtual bool IsClientIndependentFiltering() const { return true; }
+};
+
+TestElement* g_element = NULL;
+
+// A downstream client - removes its request on EOS
+class Client {
+ public:
+  explicit Client(uint32 flavour_mask)
+      : callback_(NewPermanentCallback(this, &Client::ProcessTag)),
+        num_tags_(0),
+        eos_(false),
+        added_(false) {
+    req_.mutable_caps()->flavour_mask_ = flavour_mask;
+  }
+  ~Client() {
+    CHECK(!added_);
+    delete callback_;
+  }
+  int num_tags() const { return num_tags_; }
+  bool eos() const { return eos_; }
+
+  void Add(const string& media) {
+    CHECK(!added_);
+    CHECK(g_element->AddRequest(media, &req_, callback_));
+    added_ = true;
+    eos_ = false;
+    num_tags_ = 0;
+  }
+  void Remove() {
+    CHECK(added_);
+    added_ = false;
+    g_element->RemoveRequest(&req_);
+  }
+ private:
+  void ProcessTag(const Tag* tag, int64 timestamp_ms) {
+    if ( tag->type() == Tag::TYPE_EOS ) {
+      CHECK(!eos_);
+      eos_ = true;
+      Remove();
+      return;
+    }
+    if ( tag->type() == Tag::TYPE_RAW ) {
+      ++num_tags_;
+    }
+  }
+  Request req_;
+  ProcessingCallback* const callback_;
+  int num_tags_;
+  bool eos_;
+  bool added_;
+};
+
+net::Selector* g_selector = NULL;
+TestMapper* g_mapper = NULL;
+Client* g_a = NULL;
+Client* g_b = NULL;
+Client* g_c = NULL;
+Client* g_d = NULL;
+
+void Send(uint32 flavour_mask, int num_tags) {
+  for ( int i = 0; i < num_tags; ++i ) {
+    g_mapper->Send(flavour_mask,
+                   scoped_ref<Tag>(new TestTag(Tag::ATTR_AUDIO, 0)).get());
+  }
+}
+
+void CloseCompleted() {
+  CHECK(g_a->eos() && g_b->eos());
+  CHECK_EQ(g_mapper->num_upstream(), 0);
+  LOG_INFO << "TestClose OK";
+  g_selector->MakeLoopExit();
+}
+
+void TestSharedChain() {
+  // two clients, one upstream, one filtering
+  g_a->Add("live");
+  g_b->Add("live");
+  CHECK_EQ(g_mapper->num_adds(), 1);
+  Send(1, 10);
+  CHECK_EQ(g_num_filtered, 10);
+  CHECK_EQ(g_a->num_tags(), 10);
+  CHECK_EQ(g_b->num_tags(), 10);
+
+  // a late joiner gets the stream from where it is
+  g_c->Add("live");
+  CHECK_EQ(g_mapper->num_adds(), 1);
+  Send(1, 5);
+  CHECK_EQ(g_num_filtered, 15);
+  CHECK_EQ(g_a->num_tags(), 15);
+  CHECK_EQ(g_c->num_tags(), 5);
+
+  // another flavour - another chain
+  g_d->Add("live");
+  CHECK_EQ(g_mapper->num_adds(), 2);
+  CHECK_EQ(g_mapper->num_upstream(), 2);
+  Send(2, 3);
+  CHECK_EQ(g_d->num_tags(), 3);
+  CHECK_EQ(g_a->num_tags(), 15);
+  g_d->Remove();
+  CHECK_EQ(g_mapper->num_upstream(), 1);
+
+  // the upstream goes away w/ the last client (and the internal request
+  // w/ it - the mapper deletes it)
+  g_a->Remove();
+  g_b->Remove();
+  CHECK_EQ(g_mapper->num_upstream(), 1);
+  Send(1, 1);
+  CHECK_EQ(g_c->num_tags(), 6);
+  g_c->Remove();
+  CHECK_EQ(g_mapper->num_upstream(), 0);
+  LOG_INFO << "TestSharedChain OK";
+
+  // an upstream EOS ends the chain: all clients get it, and a new
+  // client gets a new chain
+  g_a->Add("live");
+  g_b->Add("live");
+  CHECK_EQ(g_mapper->num_adds(), 3);
+  g_mapper->Send(1, scoped_ref<Tag>(
+      new EosTag(0, kDefaultFlavourMask, false)).get());
+  CHECK(g_a->eos() && g_b->eos());
+  CHECK_EQ(g_mapper->num_upstream(), 0);
+  g_a->Add("live");
+  CHECK_EQ(g_mapper->num_adds(), 4);
+  g_a->Remove();
+  CHECK_EQ(g_mapper->num_upstream(), 0);
+  LOG_INFO << "TestSharedChainEos OK";
+
+  // teardown w/ clients on a chain: they get an EOS, the upstream is
+  // removed
+  g_a->Add("live");
+  g_b->Add("live");
+  Send(1, 2);
+  g_element->Close(NewCallback(&CloseCompleted));
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  net::Selector selector;
+  TestMapper mapper;
+  g_selector = &selector;
+  g_mapper = &mapper;
+  g_element = new TestElement(&mapper, &selector);
+  CHECK(g_element->Initialize());
+  g_a = new Client(1);
+  g_b = new Client(1);
+  g_c = new Client(1);
+  g_d = new Client(2);
+
+  selector.RunInSelectLoop(NewCallback(&TestSharedChain));
+  selector.Loop();
+
+  delete g_element;
+  delete g_a;
+  delete g_b;
+  delete g_c;
+  delete g_d;
+  LOG_INFO << "PASS";
+  return 0;
+}
@@ -0,0 +1,172 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperstreamlib/base/consts.h>
+#include <whisperstreamlib/base/send_scheduler.h>
+#include <whisperstreamlib/base/test/test_tag.h>
+
+using streaming::SendScheduler;
+using streaming::Tag;
+using streaming::TestTag;
+
+namespace {
+
+const uint32 kAudio = Tag::ATTR_AUDIO;
+const uint32 kKeyframe = Tag::ATTR_VIDEO | Tag::ATTR_DROPPABLE |
+                         Tag::ATTR_CAN_RESYNC;
+const uint32 kInterframe = Tag::ATTR_VIDEO | Tag::ATTR_DROPPABLE;
+const uint32 kNonReference = Tag::ATTR_VIDEO | Tag::ATTR_DROPPABLE |
+                             Tag::ATTR_NON_REFERENCE;
+
+const int32 kTagSize = 1000;
+const int64 kTagIntervalMs = 100;
+
+// Schedules a tag of the given kind, w/ a backlog of about backlog_ms
+SendScheduler::Action Schedule(SendScheduler* scheduler, int64* time_ms,
+                               uint32 attributes, int64 backlog_ms) {
+  scoped_ref<TestTag> tag(new TestTag(attributes, kTagSize));
+  const int32 queued = static_cast<int32>(
+      scheduler->bytes_per_sec() * backlog_ms / 1000);
+  *time_ms += kTagIntervalMs;
+  return scheduler->Schedule(tag.get(), *time_ms,
+      SendScheduler::IsDroppable(tag.get()) ? queued : 0, 0);
+}
+
+// Feeds the scheduler w/ uncongested tags until it knows the byte rate
+void WarmUp(SendScheduler* scheduler, int64* time_ms) {
+  while ( scheduler->bytes_per_sec() == 0 ) {
+    CHECK_EQ(Schedule(scheduler, time_ms, kInterframe, 0),
+             SendScheduler::SEND);
+  }
+  // ~ kTagSize every kTagIntervalMs
+  CHECK_GT(scheduler->bytes_per_sec(), 9000);
+  CHECK_LT(scheduler->bytes_per_sec(), 11000);
+}
+
+void TestOrdering() {
+  SendScheduler scheduler(2000, 4000);
+  int64 time_ms = 0;
+  WarmUp(&scheduler, &time_ms);
+
+  // Under both thresholds everything goes
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kNonReference, 1000),
+           SendScheduler::SEND);
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kInterframe, 1000),
+           SendScheduler::SEND);
+
+  // Between thresholds: only the non reference frames are dropped
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kNonReference, 3000),
+           SendScheduler::DROP_NON_REFERENCE);
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kInterframe, 3000),
+           SendScheduler::SEND);
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kKeyframe, 3000),
+           SendScheduler::SEND);
+  CHECK_EQ(scheduler.non_reference_dropped(), 1);
+  CHECK_EQ(scheduler.interframes_dropped(), 0);
+
+  // Over the second threshold: video goes up to the next keyframe
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kInterframe, 5000),
+           SendScheduler::DROP_INTERFRAME);
+  // .. audio is never dropped
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kAudio, 10000),
+           SendScheduler::SEND);
+  // .. the backlog went down, but we still wait for a keyframe
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kInterframe, 0),
+           SendScheduler::DROP_INTERFRAME);
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kNonReference, 0),
+           SendScheduler::DROP_INTERFRAME);
+  // .. a keyframe that comes while still congested does not resync
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kKeyframe, 5000),
+           SendScheduler::DROP_INTERFRAME);
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kKeyframe, 1000),
+           SendScheduler::SEND);
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kInterframe, 1000),
+           SendScheduler::SEND);
+  CHECK_EQ(scheduler.non_reference_dropped(), 1);
+  CHECK_EQ(scheduler.interframes_dropped(), 4);
+  LOG_INFO << "OK ordering: " << scheduler.ToString();
+}
+
+void TestQueuedMedia() {
+  // The media still waiting before the connection (e.g. held back by the
+  // pacer) is part of the backlog
+  SendScheduler scheduler(2000, 4000);
+  int64 time_ms = 0;
+  WarmUp(&scheduler, &time_ms);
+  scoped_ref<TestTag> tag(new TestTag(kNonReference, kTagSize));
+  time_ms += kTagIntervalMs;
+  CHECK_EQ(scheduler.Schedule(tag.get(), time_ms, 0, 2500),
+           SendScheduler::DROP_NON_REFERENCE);
+  CHECK_EQ(scheduler.backlog_ms(), 2500);
+  const int32 one_sec = static_cast<int32>(scheduler.bytes_per_sec());
+  time_ms += kTagIntervalMs;
+  CHECK_EQ(scheduler.Schedule(tag.get(), time_ms, one_sec, 500),
+           SendScheduler::SEND);
+  CHECK_EQ(scheduler.backlog_ms(), 1500);
+  LOG_INFO << "OK queued media";
+}
+
+void TestDisabled() {
+  SendScheduler scheduler(0, 0);
+  int64 time_ms = 0;
+  WarmUp(&scheduler, &time_ms);
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kNonReference, 100000),
+           SendScheduler::SEND);
+  CHECK_EQ(Schedule(&scheduler, &time_ms, kInterframe, 100000),
+           SendScheduler::SEND);
+  CHECK_EQ(scheduler.non_reference_dropped(), 0);
+  CHECK_EQ(scheduler.interframes_dropped(), 0);
+  LOG_INFO << "OK disabled";
+}
+
+void TestUnknownRate() {
+  // W/o a byte rate we cannot tell the backlog - we send everything
+  SendScheduler scheduler(2000, 4000);
+  scoped_ref<TestTag> tag(new TestTag(kInterframe, kTagSize));
+  CHECK_EQ(scheduler.Schedule(tag.get(), 0, 100000000, 0),
+           SendScheduler::SEND);
+  CHECK_EQ(scheduler.backlog_ms(), 0);
+  LOG_INFO << "OK unknown rate";
+}
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestOrdering();
+  TestQueuedMedia();
+  TestDisabled();
+  TestUnknownRate();
+  LOG_INFO << "PASS";
+  common::Exit(0);
+}
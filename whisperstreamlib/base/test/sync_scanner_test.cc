@@ -0,0 +1,158 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+//
+// Checks the sync word / start code scanning (base/sync_scanner.h)
+// against a plain byte by byte search, on streams with small blocks
+// (so we hit the block seams a lot).
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/gflags.h>
+#include <whisperlib/common/io/buffer/memory_stream.h>
+
+#include <whisperstreamlib/base/sync_scanner.h>
+
+//////////////////////////////////////////////////////////////////////
+
+DEFINE_int32(rand_seed,
+             0,
+             "Seed the random with this guy");
+
+//////////////////////////////////////////////////////////////////////
+
+static unsigned int rand_seed;
+
+static int32 SlowFindAudioSync(const string& s, int32 from, uint8 mask) {
+  for ( int32 i = from; i + 1 < static_cast<int32>(s.size()); ++i ) {
+    if ( static_cast<uint8>(s[i]) == 0xff &&
+         (static_cast<uint8>(s[i + 1]) & mask) == mask ) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int32 SlowFindStartCode(const string& s, int32 from) {
+  for ( int32 i = from; i + 2 < static_cast<int32>(s.size()); ++i ) {
+    if ( s[i] == 0x00 && s[i + 1] == 0x00 && s[i + 2] == 0x01 ) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Mostly bytes that take part in sync words / start codes
+static string RandomData(int32 size) {
+  static const uint8 kAlphabet[] = { 0x00, 0x00, 0x01, 0xff, 0xe5, 0xf3,
+                                     0x10, 0x42 };
+  string s;
+  for ( int32 i = 0; i < size; ++i ) {
+    s.push_back(static_cast<char>(
+        kAlphabet[rand_r(&rand_seed) % sizeof(kAlphabet)]));
+  }
+  return s;
+}
+
+void TestScan(int32 block_size, int32 size) {
+  const string data = RandomData(size);
+  // Start in the middle of the first block
+  const int32 skip = rand_r(&rand_seed) % block_size;
+  io::MemoryStream in(block_size);
+  in.Write(string(skip, 'x'));
+  in.Write(data);
+  in.Skip(skip);
+
+  for ( int32 from = 0; from <= size; ++from ) {
+    CHECK_EQ(streaming::FindAudioSync(in, from, streaming::kMp3SyncMask),
+             SlowFindAudioSync(data, from, streaming::kMp3SyncMask))
+        << " block_size: " << block_size << " from: " << from;
+    CHECK_EQ(streaming::FindAudioSync(in, from, streaming::kAdtsSyncMask),
+             SlowFindAudioSync(data, from, streaming::kAdtsSyncMask))
+        << " block_size: " << block_size << " from: " << from;
+    CHECK_EQ(streaming::FindStartCode(in, from),
+             SlowFindStartCode(data, from))
+        << " block_size: " << block_size << " from: " << from;
+  }
+  CHECK_EQ(streaming::FindAudioSync(
+               reinterpret_cast<const uint8*>(data.data()), data.size(),
+               streaming::kAdtsSyncMask),
+           SlowFindAudioSync(data, 0, streaming::kAdtsSyncMask));
+  CHECK_EQ(streaming::FindStartCode(
+               reinterpret_cast<const uint8*>(data.data()), data.size()),
+           SlowFindStartCode(data, 0));
+
+  // Skipping from sync to sync consumes everything
+  int32 pos = 0;
+  while ( streaming::SkipToAudioSync(&in, streaming::kMp3SyncMask) ) {
+    pos = SlowFindAudioSync(data, pos, streaming::kMp3SyncMask);
+    CHECK_GE(pos, 0);
+    CHECK_EQ(in.Size(), size - pos);
+    in.Skip(1);
+    ++pos;
+  }
+  CHECK_LE(in.Size(), 1);
+}
+
+void TestSkipNoSync() {
+  io::MemoryStream in(16);
+  in.Write(string(100, 'a'));
+  CHECK(!streaming::SkipToAudioSync(&in, streaming::kMp3SyncMask));
+  CHECK(in.IsEmpty());
+  // A last 0xff is kept, for the next data to complete the sync word
+  in.Write("abc\xff");
+  CHECK(!streaming::SkipToAudioSync(&in, streaming::kMp3SyncMask));
+  CHECK_EQ(in.Size(), 1);
+  in.Write("\xfb");
+  CHECK(streaming::SkipToAudioSync(&in, streaming::kMp3SyncMask));
+  CHECK_EQ(in.Size(), 2);
+  // Nothing in an empty stream
+  io::MemoryStream empty;
+  CHECK_EQ(streaming::FindAudioSync(empty, 0, streaming::kMp3SyncMask), -1);
+  CHECK_EQ(streaming::FindStartCode(empty, 0), -1);
+  CHECK(!streaming::SkipToAudioSync(&empty, streaming::kMp3SyncMask));
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  rand_seed = FLAGS_rand_seed;
+
+  TestSkipNoSync();
+  const int32 kBlockSizes[] = { 1, 2, 3, 5, 16, 128, 4096 };
+  for ( uint32 i = 0; i < NUMBEROF(kBlockSizes); ++i ) {
+    LOG_INFO << "TestScan block_size: " << kBlockSizes[i];
+    for ( int32 j = 0; j < 20; ++j ) {
+      TestScan(kBlockSizes[i], 1 + rand_r(&rand_seed) % 1000);
+    }
+  }
+  LOG_INFO << "PASS";
+}
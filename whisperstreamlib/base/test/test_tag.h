@@ -0,0 +1,72 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+// A media tag for the tests: the given attributes, some data, and an id
+// to recognize it downstream.
+
+#ifndef __MEDIA_BASE_TEST_TEST_TAG_H__
+#define __MEDIA_BASE_TEST_TEST_TAG_H__
+
+#include <string>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/io/buffer/memory_stream.h>
+#include <whisperstreamlib/base/consts.h>
+#include <whisperstreamlib/base/tag.h>
+
+namespace streaming {
+
+class TestTag : public Tag {
+ public:
+  TestTag(uint32 attributes, int32 size, int id = 0)
+      : Tag(Tag::TYPE_RAW, attributes, kDefaultFlavourMask),
+        id_(id) {
+    data_.Write(string(size, 'x'));
+  }
+  virtual ~TestTag() {
+  }
+  int id() const { return id_; }
+  virtual int64 duration_ms() const { return 0; }
+  virtual uint32 size() const { return data_.Size(); }
+  virtual int64 composition_offset_ms() const { return 0; }
+  virtual const io::MemoryStream* Data() const { return &data_; }
+  virtual Tag* Clone() const {
+    TestTag* const t = new TestTag(attributes(), 0, id_);
+    t->data_.AppendStreamNonDestructive(&data_);
+    return t;
+  }
+ private:
+  const int id_;
+  io::MemoryStream data_;
+};
+
+}
+
+#endif  // __MEDIA_BASE_TEST_TEST_TAG_H__
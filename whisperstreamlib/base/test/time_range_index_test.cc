@@ -0,0 +1,266 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/gflags.h>
+#include <whisperlib/common/base/strutil.h>
+#include <whisperlib/common/base/callback.h>
+#include <whisperlib/common/io/ioutil.h>
+#include <whisperlib/common/io/file/file.h>
+#include <whisperlib/common/sync/thread.h>
+#include <whisperstreamlib/base/time_range.h>
+#include <whisperstreamlib/base/time_range_index.h>
+
+DEFINE_string(test_tmp_dir, "/tmp", "Where to write temporarely test files");
+
+using streaming::TimeRangeIndex;
+using streaming::TimeRangeCatalog;
+
+namespace {
+
+const int64 kBeginTs = 1323270766601LL;     // 07.12.2011 15:12:46.601
+const int64 kPeriod = 300000;               // a file every 5 min
+const int64 kDuration = 290000;             // .. 10 sec gaps between
+
+int64 BeginTs(int i) { return kBeginTs + i * kPeriod; }
+int64 EndTs(int i) { return BeginTs(i) + kDuration; }
+
+string MakeTestDir(const string& name) {
+  const string dir = strutil::JoinPaths(FLAGS_test_tmp_dir, name);
+  if ( io::Exists(dir) ) {
+    CHECK(io::Rm(dir));
+  }
+  CHECK(io::Mkdir(strutil::JoinPaths(dir, "sub"), true));
+  return dir;
+}
+// Creates the recording i in dir (every other one in a subdirectory)
+string MakeRecording(const string& dir, int i) {
+  const string file = string(i % 2 ? "sub/" : "") +
+      streaming::MakeTimeRangeFile(BeginTs(i), EndTs(i),
+                                   streaming::MFORMAT_FLV);
+  CHECK(io::Touch(strutil::JoinPaths(dir, file)));
+  return file;
+}
+
+void TestRebuildFind() {
+  const string dir = MakeTestDir("time_range_index_test_find");
+  const int kNumFiles = 20;
+  for ( int i = 0; i < kNumFiles; ++i ) {
+    MakeRecording(dir, i);
+  }
+  CHECK(io::Touch(strutil::JoinPaths(dir, "other.txt")));
+
+  TimeRangeIndex index(dir);
+  CHECK(!index.Load());
+  CHECK(index.Rebuild());
+  CHECK_EQ(index.size(), kNumFiles);
+  for ( int i = 1; i < kNumFiles; ++i ) {
+    CHECK_LT(index.range(i - 1).begin_ts_, index.range(i).begin_ts_);
+  }
+
+  CHECK_EQ(index.Find(BeginTs(0) - 1), -1);
+  CHECK_EQ(index.Find(BeginTs(0)), 0);
+  CHECK_EQ(index.Find(EndTs(0)), 0);
+  CHECK_EQ(index.Find(EndTs(0) + 1), 1);              // in a gap
+  CHECK_EQ(index.Find(BeginTs(7) + 1234), 7);
+  CHECK_EQ(index.Find(EndTs(kNumFiles - 1)), kNumFiles - 1);
+  CHECK_EQ(index.Find(EndTs(kNumFiles - 1) + 1), -1);
+
+  // we find what we found by parsing the names
+  vector<string> files;
+  index.ListFiles(NULL, &files);
+  CHECK_EQ(files.size(), kNumFiles);
+  for ( int64 ts = BeginTs(0) - kPeriod; ts < BeginTs(kNumFiles);
+        ts += kPeriod / 7 ) {
+    CHECK_EQ(index.Find(ts), streaming::GetTimeRangeMediaIndex(files, ts))
+        << " ts: " << ts;
+  }
+
+  // the index file is there for the others
+  TimeRangeIndex loaded(dir);
+  CHECK(loaded.Load());
+  CHECK_EQ(loaded.size(), kNumFiles);
+  for ( int i = 0; i < kNumFiles; ++i ) {
+    CHECK_EQ(loaded.range(i).file_, index.range(i).file_);
+    CHECK_EQ(loaded.range(i).end_ts_, index.range(i).end_ts_);
+  }
+  LOG_INFO << "TestRebuildFind OK";
+}
+
+void TestRefresh() {
+  const string dir = MakeTestDir("time_range_index_test_refresh");
+  for ( int i = 0; i < 10; ++i ) {
+    MakeRecording(dir, i);
+  }
+  CHECK(TimeRangeIndex(dir).Rebuild());
+  TimeRangeIndex index(dir);
+  CHECK(index.Load());
+  CHECK_EQ(index.size(), 10);
+  CHECK(index.Refresh());
+  CHECK_EQ(index.size(), 10);
+
+  // appended
+  string file = MakeRecording(dir, 10);
+  CHECK(TimeRangeIndex::AppendToIndexFile(dir, BeginTs(10), EndTs(10), file));
+  CHECK(index.Refresh());
+  CHECK_EQ(index.size(), 11);
+  CHECK_EQ(index.Find(BeginTs(10) + 1), 10);
+  CHECK_EQ(index.range(10).file_, file);
+
+  // appended twice (i.e. by a Saver during a Rebuild()) - the last wins
+  CHECK(TimeRangeIndex::AppendToIndexFile(dir, BeginTs(10), EndTs(10) + 5,
+                                          file));
+  CHECK(index.Refresh());
+  CHECK_EQ(index.size(), 11);
+  CHECK_EQ(index.range(10).end_ts_, EndTs(10) + 5);
+
+  // rewritten by someone else, w/ more content than we read - we have to
+  // see it as rewritten, not as appended
+  MakeRecording(dir, 11);
+  MakeRecording(dir, 12);
+  TimeRangeIndex rebuilt(dir);
+  CHECK(rebuilt.Rebuild());
+  CHECK_EQ(rebuilt.size(), 13);
+  CHECK(index.Refresh());
+  CHECK_EQ(index.size(), 13);
+  for ( int i = 0; i < 13; ++i ) {
+    CHECK_EQ(index.range(i).file_, rebuilt.range(i).file_);
+  }
+  CHECK_EQ(index.range(10).end_ts_, EndTs(10));
+
+  // w/ less content
+  CHECK(io::Rm(strutil::JoinPaths(dir, rebuilt.range(12).file_)));
+  CHECK(rebuilt.Rebuild());
+  CHECK(index.Refresh());
+  CHECK_EQ(index.size(), 12);
+  LOG_INFO << "TestRefresh OK";
+}
+
+void TestRebuildMark() {
+  const string dir = MakeTestDir("time_range_index_test_mark");
+  for ( int i = 0; i < 10; ++i ) {
+    MakeRecording(dir, i);
+  }
+  // what a Saver does when it starts recording in dir
+  CHECK(TimeRangeIndex::CreateIndexFile(dir));
+  const string file = MakeRecording(dir, 10);
+  CHECK(TimeRangeIndex::AppendToIndexFile(dir, BeginTs(10), EndTs(10), file));
+
+  TimeRangeIndex index(dir);
+  CHECK(!index.Load());
+  CHECK(index.needs_rebuild());
+
+  // the catalog rebuilds it (on its thread)
+  TimeRangeCatalog catalog;
+  CHECK(catalog.GetIndex(dir + "/none") == NULL);
+  const TimeRangeIndex* built = NULL;
+  for ( int i = 0; i < 500 && built == NULL; ++i ) {
+    built = catalog.GetIndex(dir);
+    if ( built == NULL ) {
+      ::usleep(10000);
+    }
+  }
+  CHECK(built != NULL);
+  CHECK(!built->needs_rebuild());
+  CHECK_EQ(built->size(), 11);
+
+  // .. once
+  CHECK(index.Load());
+  CHECK_EQ(index.size(), 11);
+  CHECK(TimeRangeIndex::CreateIndexFile(dir));
+  CHECK(index.Load());
+  CHECK_EQ(index.size(), 11);
+
+  // the catalog follows the appends
+  const string next = MakeRecording(dir, 11);
+  CHECK(TimeRangeIndex::AppendToIndexFile(dir, BeginTs(11), EndTs(11), next));
+  built = catalog.GetIndex(dir);
+  CHECK(built != NULL);
+  CHECK_EQ(built->size(), 12);
+  CHECK_EQ(built->Find(BeginTs(11) + 1), 11);
+  LOG_INFO << "TestRebuildMark OK";
+}
+
+const int kNumRecorded = 500;
+int32 g_num_recorded = 0;
+
+// Records (and appends to the index) kNumRecorded files, starting w/ first
+void Record(string dir, int first) {
+  for ( int i = first; i < first + kNumRecorded; ++i ) {
+    const string file = MakeRecording(dir, i);
+    CHECK(TimeRangeIndex::AppendToIndexFile(dir, BeginTs(i), EndTs(i), file));
+    __sync_fetch_and_add(&g_num_recorded, 1);
+  }
+}
+
+void TestConcurrentAppend() {
+  const string dir = MakeTestDir("time_range_index_test_concurrent");
+  const int kNumFiles = 200;
+  for ( int i = 0; i < kNumFiles; ++i ) {
+    MakeRecording(dir, i);
+  }
+  thread::Thread recorder(NewCallback(&Record, dir, kNumFiles));
+  CHECK(recorder.SetJoinable());
+  CHECK(recorder.Start());
+  int num_rebuilds = 0;
+  while ( __sync_fetch_and_add(&g_num_recorded, 0) < kNumRecorded ||
+          num_rebuilds == 0 ) {
+    CHECK(TimeRangeIndex(dir).Rebuild());
+    ++num_rebuilds;
+    // (flock is not fair - let the recorder in)
+    ::usleep(1000);
+  }
+  CHECK(recorder.Join());
+
+  // no appended line is lost (and none is there twice)
+  TimeRangeIndex index(dir);
+  CHECK(index.Load());
+  CHECK_EQ(index.size(), kNumFiles + kNumRecorded);
+  for ( int i = 0; i < kNumFiles + kNumRecorded; ++i ) {
+    CHECK_EQ(index.range(i).begin_ts_, BeginTs(i));
+    CHECK_EQ(index.range(i).end_ts_, EndTs(i));
+  }
+  LOG_INFO << "TestConcurrentAppend OK, w/ " << num_rebuilds << " rebuilds";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestRebuildFind();
+  TestRefresh();
+  TestRebuildMark();
+  TestConcurrentAppend();
+  LOG_INFO << "PASS";
+  return 0;
+}
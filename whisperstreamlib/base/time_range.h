@@ -40,6 +40,9 @@ bool ParseTimeRangeMedia(const string& stream,
 // From the given 'streams' finds the media to play at the given 'play_time'.
 // Returns the index of the media containing 'play_time' or -1 if nothing
 // is found.
+// To find what to play in an element directory use
+// ElementMapper::FindTimeRangeMedia() - it uses the time range index of the
+// recording directories (see time_range_index.h) instead of a listing.
 int32 GetTimeRangeMediaIndex(const vector<string>& streams, int64 play_time);
 
 }
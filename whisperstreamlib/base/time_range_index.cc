@@ -0,0 +1,448 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <whisperlib/common/base/errno.h>
+#include <whisperlib/common/base/gflags.h>
+#include <whisperlib/common/base/strutil.h>
+#include <whisperlib/common/base/timer.h>
+#include <whisperlib/common/io/ioutil.h>
+#include <whisperlib/common/io/file/file.h>
+#include <whisperlib/common/io/file/file_input_stream.h>
+#include <whisperstreamlib/base/time_range.h>
+#include <whisperstreamlib/base/time_range_index.h>
+#include <whisperstreamlib/base/saver.h>
+
+//////////////////////////////////////////////////////////////////////
+
+DEFINE_int32(time_range_index_rescan_sec,
+             300,
+             "We rescan (in background) the directories w/ time range "
+             "indexes this often, to pick up the recordings not added "
+             "by us. 0 - never rescan.");
+
+//////////////////////////////////////////////////////////////////////
+
+namespace streaming {
+
+namespace {
+bool RangeBeginLess(const TimeRangeIndex::Range& a,
+                    const TimeRangeIndex::Range& b) {
+  return a.begin_ts_ < b.begin_ts_;
+}
+bool TsBeforeRange(int64 ts, const TimeRangeIndex::Range& r) {
+  return ts < r.begin_ts_;
+}
+string FormatRange(int64 begin_ts, int64 end_ts, const string& file) {
+  return strutil::StringPrintf("%" PRId64 " %" PRId64 " %s\n",
+                               begin_ts, end_ts, file.c_str());
+}
+// The inode of the given file, -1 on error
+int64 GetFileId(const string& filename) {
+  struct stat st;
+  if ( ::stat(filename.c_str(), &st) != 0 ) {
+    return -1;
+  }
+  return st.st_ino;
+}
+
+// Holds a flock on the index lock file of a directory (for its lifetime).
+// The readers go on w/o the lock if they cannot get it (e.g. a read only
+// directory, indexed by someone else).
+class IndexLock {
+ public:
+  IndexLock(const string& dir, bool exclusive)
+      : fd_(-1) {
+    const string lock_file = strutil::JoinPaths(dir,
+                                                TimeRangeIndex::kLockFile);
+    fd_ = exclusive ? ::open(lock_file.c_str(), O_RDWR | O_CREAT, 0644)
+                    : ::open(lock_file.c_str(), O_RDONLY);
+    if ( fd_ < 0 ) {
+      LOG_ERROR_IF(exclusive) << "Cannot open: [" << lock_file << "]: "
+                              << GetLastSystemErrorDescription();
+      return;
+    }
+    while ( ::flock(fd_, exclusive ? LOCK_EX : LOCK_SH) != 0 ) {
+      if ( errno != EINTR ) {
+        LOG_ERROR << "Cannot lock: [" << lock_file << "]: "
+                  << GetLastSystemErrorDescription();
+        break;
+      }
+    }
+  }
+  ~IndexLock() {
+    if ( fd_ >= 0 ) {
+      // releases the lock too
+      ::close(fd_);
+    }
+  }
+ private:
+  int fd_;
+  DISALLOW_EVIL_CONSTRUCTORS(IndexLock);
+};
+}
+
+const char TimeRangeIndex::kIndexFile[] = "timerange.idx";
+const char TimeRangeIndex::kLockFile[] = "timerange.idx.lock";
+const char TimeRangeIndex::kRebuildMark[] = "#rebuild";
+
+TimeRangeIndex::TimeRangeIndex(const string& dir)
+    : dir_(dir),
+      index_file_(strutil::JoinPaths(dir, kIndexFile)),
+      index_file_size_(0),
+      index_file_id_(-1),
+      needs_rebuild_(false) {
+}
+
+TimeRangeIndex::~TimeRangeIndex() {
+}
+
+bool TimeRangeIndex::Load() {
+  IndexLock lock(dir_, false);
+  return LoadLocked();
+}
+
+bool TimeRangeIndex::LoadLocked() {
+  string content;
+  if ( !io::FileInputStream::TryReadFile(index_file_, &content) ) {
+    return false;
+  }
+  ranges_.clear();
+  index_file_size_ = 0;
+  index_file_id_ = GetFileId(index_file_);
+  needs_rebuild_ = false;
+  ParseLines(content);
+  // the lines are mostly in order, but Rebuild() does not rely on that
+  std::stable_sort(ranges_.begin(), ranges_.end(), RangeBeginLess);
+  return !needs_rebuild_;
+}
+
+bool TimeRangeIndex::Refresh() {
+  IndexLock lock(dir_, false);
+  const int64 id = GetFileId(index_file_);
+  const int64 size = io::GetFileSize(index_file_);
+  if ( id < 0 || size < 0 ) {
+    return false;
+  }
+  if ( id != index_file_id_ || size < index_file_size_ ) {
+    // rewritten
+    return LoadLocked();
+  }
+  if ( size == index_file_size_ ) {
+    return true;
+  }
+  io::File f;
+  if ( !f.Open(index_file_, io::File::GENERIC_READ,
+               io::File::OPEN_EXISTING) ) {
+    return false;
+  }
+  string content(size - index_file_size_, '\0');
+  f.SetPosition(index_file_size_);
+  const int32 cb = f.Read(&content[0], content.size());
+  f.Close();
+  if ( cb < 0 ) {
+    return false;
+  }
+  content.resize(cb);
+  ParseLines(content);
+  return true;
+}
+
+bool TimeRangeIndex::Rebuild() {
+  // no appends while we list & rewrite (they would go to the old file)
+  IndexLock lock(dir_, true);
+  vector<string> files;
+  if ( !io::DirList(dir_, io::LIST_FILES | io::LIST_RECURSIVE,
+                    NULL, &files) ) {
+    LOG_ERROR << "Cannot list: [" << dir_ << "]";
+    return false;
+  }
+  ranges_.clear();
+  for ( int i = 0; i < files.size(); ++i ) {
+    int64 begin_ts, end_ts;
+    if ( GetFileTimeRange(dir_, files[i], &begin_ts, &end_ts) ) {
+      ranges_.push_back(Range(begin_ts, end_ts, files[i]));
+    }
+  }
+  std::stable_sort(ranges_.begin(), ranges_.end(), RangeBeginLess);
+
+  string content;
+  for ( int i = 0; i < ranges_.size(); ++i ) {
+    content.append(FormatRange(ranges_[i].begin_ts_, ranges_[i].end_ts_,
+                               ranges_[i].file_));
+  }
+  const string tmp_file = index_file_ + ".tmp";
+  io::File f;
+  if ( !f.Open(tmp_file, io::File::GENERIC_WRITE, io::File::CREATE_ALWAYS) ) {
+    LOG_ERROR << "Cannot create: [" << tmp_file << "]";
+    return false;
+  }
+  const int32 cb = f.Write(content);
+  f.Close();
+  if ( cb != content.size() || !io::Rename(tmp_file, index_file_, true) ) {
+    LOG_ERROR << "Cannot write: [" << index_file_ << "]";
+    return false;
+  }
+  index_file_size_ = content.size();
+  index_file_id_ = GetFileId(index_file_);
+  needs_rebuild_ = false;
+  return true;
+}
+
+int32 TimeRangeIndex::Find(int64 ts) const {
+  // the first range beginning after ts
+  const vector<Range>::const_iterator it = std::upper_bound(
+      ranges_.begin(), ranges_.end(), ts, TsBeforeRange);
+  if ( it == ranges_.begin() ) {
+    return -1;
+  }
+  const int32 index = it - ranges_.begin() - 1;
+  if ( ts <= ranges_[index].end_ts_ ) {
+    return index;
+  }
+  // in a gap (or after the last range)
+  return it == ranges_.end() ? -1 : index + 1;
+}
+
+void TimeRangeIndex::ListFiles(re::RE* regex, vector<string>* out) const {
+  for ( int i = 0; i < ranges_.size(); ++i ) {
+    if ( regex == NULL ||
+         regex->Matches(strutil::SplitLast(ranges_[i].file_, "/").second) ) {
+      out->push_back(ranges_[i].file_);
+    }
+  }
+}
+
+bool TimeRangeIndex::AppendToIndexFile(const string& dir,
+                                       int64 begin_ts, int64 end_ts,
+                                       const string& file) {
+  const string index_file = strutil::JoinPaths(dir, kIndexFile);
+  IndexLock lock(dir, true);
+  io::File f;
+  if ( !f.Open(index_file, io::File::GENERIC_WRITE,
+               io::File::OPEN_ALWAYS) ) {
+    LOG_ERROR << "Cannot open: [" << index_file << "]";
+    return false;
+  }
+  f.SetPosition(0, io::File::FILE_END);
+  const string line = FormatRange(begin_ts, end_ts, file);
+  const bool success = (f.Write(line) == line.size());
+  f.Close();
+  return success;
+}
+
+bool TimeRangeIndex::CreateIndexFile(const string& dir) {
+  const string index_file = strutil::JoinPaths(dir, kIndexFile);
+  IndexLock lock(dir, true);
+  if ( io::Exists(index_file) ) {
+    return true;
+  }
+  io::File f;
+  if ( !f.Open(index_file, io::File::GENERIC_WRITE,
+               io::File::CREATE_NEW) ) {
+    LOG_ERROR << "Cannot create: [" << index_file << "]";
+    return false;
+  }
+  const string line = string(kRebuildMark) + "\n";
+  const bool success = (f.Write(line) == line.size());
+  f.Close();
+  return success;
+}
+
+bool TimeRangeIndex::GetFileTimeRange(const string& dir, const string& file,
+                                      int64* out_begin_ts,
+                                      int64* out_end_ts) {
+  const string name = strutil::SplitLast(file, "/").second;
+  if ( IsValidTimeRangeMedia(name) ) {
+    return ParseTimeRangeMedia(name, out_begin_ts, out_end_ts);
+  }
+  if ( strutil::StrStartsWith(name, Saver::kFilePrefix) &&
+       strutil::StrEndsWith(name, Saver::kFileSuffix) &&
+       Saver::ParseFilename(name, out_begin_ts, NULL) ) {
+    *out_end_ts = io::GetFileModificationTime(strutil::JoinPaths(dir, file));
+    return *out_end_ts >= *out_begin_ts;
+  }
+  return false;
+}
+
+void TimeRangeIndex::ParseLines(const string& content) {
+  size_t begin = 0;
+  while ( true ) {
+    // we may see a partially written last line - leave it for later
+    const size_t end = content.find('\n', begin);
+    if ( end == string::npos ) {
+      break;
+    }
+    const char* const line = content.c_str() + begin;
+    if ( *line == '#' ) {
+      if ( content.compare(begin, end - begin, kRebuildMark) == 0 ) {
+        needs_rebuild_ = true;
+      }
+      index_file_size_ += end + 1 - begin;
+      begin = end + 1;
+      continue;
+    }
+    char* p = NULL;
+    const int64 begin_ts = ::strtoll(line, &p, 10);
+    const int64 end_ts = ::strtoll(p, &p, 10);
+    if ( *p == ' ' && p < content.c_str() + end ) {
+      ++p;
+      Add(begin_ts, end_ts, string(p, content.c_str() + end - p));
+    } else {
+      LOG_ERROR << "Invalid line in: [" << index_file_ << "]: ["
+                << content.substr(begin, end - begin) << "]";
+    }
+    index_file_size_ += end + 1 - begin;
+    begin = end + 1;
+  }
+}
+
+void TimeRangeIndex::Add(int64 begin_ts, int64 end_ts, const string& file) {
+  // usually the new recordings come at the end
+  const vector<Range>::iterator it = std::upper_bound(
+      ranges_.begin(), ranges_.end(), begin_ts, TsBeforeRange);
+  // A file closed during a Rebuild() is both listed and appended
+  for ( vector<Range>::iterator d = it;
+        d != ranges_.begin() && (d - 1)->begin_ts_ == begin_ts; --d ) {
+    if ( (d - 1)->file_ == file ) {
+      (d - 1)->end_ts_ = end_ts;
+      return;
+    }
+  }
+  ranges_.insert(it, Range(begin_ts, end_ts, file));
+}
+
+//////////////////////////////////////////////////////////////////////
+
+TimeRangeCatalog::TimeRangeCatalog()
+    : pool_(NULL) {
+}
+
+TimeRangeCatalog::~TimeRangeCatalog() {
+  if ( pool_ != NULL ) {
+    pool_->Stop(true);
+    delete pool_;
+  }
+  // the built_ ones are also pending_ in their slots
+  for ( SlotMap::iterator it = slots_.begin(); it != slots_.end(); ++it ) {
+    delete it->second.index_;
+    delete it->second.pending_;
+  }
+}
+
+const TimeRangeIndex* TimeRangeCatalog::GetIndex(const string& dir) {
+  CollectBuilt();
+  SlotMap::iterator it = slots_.find(dir);
+  if ( it == slots_.end() ) {
+    if ( !io::Exists(strutil::JoinPaths(dir, TimeRangeIndex::kIndexFile)) ) {
+      return NULL;
+    }
+    it = slots_.insert(make_pair(dir, Slot())).first;
+    StartBuild(&it->second, dir, false);
+    return NULL;
+  }
+  Slot& slot = it->second;
+  if ( slot.pending_ == NULL &&
+       FLAGS_time_range_index_rescan_sec > 0 &&
+       timer::TicksMsec() - slot.build_ts_ >
+       FLAGS_time_range_index_rescan_sec * 1000LL ) {
+    StartBuild(&slot, dir, slot.index_ != NULL);
+  }
+  if ( slot.index_ != NULL &&
+       !slot.index_->Refresh() &&
+       slot.index_->needs_rebuild() &&
+       slot.pending_ == NULL ) {
+    // recreated by a Saver (see TimeRangeIndex::CreateIndexFile())
+    StartBuild(&slot, dir, true);
+  }
+  return slot.index_;
+}
+
+void TimeRangeCatalog::StartBuild(Slot* slot, const string& dir,
+                                  bool rebuild) {
+  if ( pool_ == NULL ) {
+    pool_ = new thread::ThreadPool(1, 64);
+    pool_->Start();
+  }
+  slot->build_ts_ = timer::TicksMsec();
+  slot->pending_ = new TimeRangeIndex(dir);
+  Closure* const job = NewCallback(this, &TimeRangeCatalog::Build,
+                                   slot->pending_, rebuild);
+  if ( !pool_->jobs()->Put(job, 0) ) {
+    LOG_ERROR << "Too many time range indexes to build, skipping: ["
+              << dir << "]";
+    delete job;
+    delete slot->pending_;
+    slot->pending_ = NULL;
+  }
+}
+
+void TimeRangeCatalog::Build(TimeRangeIndex* index, bool rebuild) {
+  // if the index file is broken, rebuild it
+  const bool loaded = !rebuild && index->Load();
+  const bool success = loaded || index->Rebuild();
+  LOG_INFO << (loaded ? "Loaded" : "Rebuilt") << " time range index: ["
+           << index->dir() << "], ranges: " << index->size()
+           << (success ? "" : " - FAILED");
+  synch::MutexLocker l(&built_mutex_);
+  built_.push_back(make_pair(index, success));
+}
+
+void TimeRangeCatalog::CollectBuilt() {
+  vector< pair<TimeRangeIndex*, bool> > built;
+  {
+    synch::MutexLocker l(&built_mutex_);
+    if ( built_.empty() ) {
+      return;
+    }
+    built.swap(built_);
+  }
+  for ( int i = 0; i < built.size(); ++i ) {
+    TimeRangeIndex* const index = built[i].first;
+    const SlotMap::iterator it = slots_.find(index->dir());
+    CHECK(it != slots_.end() && it->second.pending_ == index);
+    it->second.pending_ = NULL;
+    if ( built[i].second ) {
+      delete it->second.index_;
+      it->second.index_ = index;
+    } else {
+      delete index;
+    }
+  }
+}
+
+}
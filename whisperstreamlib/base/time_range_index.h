@@ -0,0 +1,193 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+
+#ifndef __MEDIA_BASE_TIME_RANGE_INDEX_H__
+#define __MEDIA_BASE_TIME_RANGE_INDEX_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/re.h>
+#include <whisperlib/common/sync/mutex.h>
+#include <whisperlib/common/sync/thread_pool.h>
+
+namespace streaming {
+
+// The time ranges (wall clock, ms from epoch) of the recordings in a
+// directory, sorted by begin time - so we can find what to play at a
+// given time w/ a binary search, w/o listing the directory and w/o
+// parsing any filename.
+//
+// We know two kinds of recordings:
+//  - timerange files ("media_20111207-151246-601_20111207-151501-577.flv",
+//    see time_range.h) - the range is in the name
+//  - Saver chunks ("part_001335962291100C.part") - the name has the begin,
+//    the end is when the file was closed.
+//
+// The index is persisted in the directory (kIndexFile), one range per
+// line: "<begin_ts> <end_ts> <file>". Saver appends a line each time it
+// closes a file, and Refresh() picks up (only) the appended lines.
+// A directory where we just started to record gets an index file w/ only
+// kRebuildMark, and whoever loads it first rebuilds it (i.e. the
+// TimeRangeCatalog, on its thread).
+//
+// The writers (AppendToIndexFile() and Rebuild()) and the readers (Load()
+// and Refresh()) take a lock on kLockFile (flock - exclusive for writers,
+// shared for readers), so the lines appended during a Rebuild() are not
+// lost, and the readers do not see a file half rewritten.
+//
+// Not thread safe.
+class TimeRangeIndex {
+ public:
+  static const char kIndexFile[];
+  static const char kLockFile[];
+  // A line w/ this marks an index to be rebuilt
+  static const char kRebuildMark[];
+
+  struct Range {
+    int64 begin_ts_;
+    int64 end_ts_;
+    string file_;       // relative to the indexed directory
+    Range(int64 begin_ts, int64 end_ts, const string& file)
+        : begin_ts_(begin_ts), end_ts_(end_ts), file_(file) {
+    }
+  };
+
+  explicit TimeRangeIndex(const string& dir);
+  ~TimeRangeIndex();
+
+  const string& dir() const { return dir_; }
+  int32 size() const { return ranges_.size(); }
+  const Range& range(int32 i) const { return ranges_[i]; }
+
+  // Loads the index from the index file. Returns false if there is no
+  // (readable) index file, or if it needs a Rebuild().
+  bool Load();
+  // Reads the lines appended to the index file since we last read it.
+  // (If the index file got rewritten in the meantime, we load it again).
+  bool Refresh();
+  // The index file asks for a Rebuild() (see kRebuildMark)
+  bool needs_rebuild() const { return needs_rebuild_; }
+  // Lists the directory and rebuilds the index (then rewrites the index
+  // file). This is expensive - do not call it on a media thread.
+  bool Rebuild();
+
+  // Returns the index of the range containing ts. If ts falls in a gap
+  // between ranges, returns the index of the next range. Returns -1 if ts
+  // is before the first or after the last range (exactly like
+  // GetTimeRangeMediaIndex).
+  int32 Find(int64 ts) const;
+
+  // Appends the files in the index (in time order), w/ the names matching
+  // regex (if not NULL) - like io::DirList.
+  void ListFiles(re::RE* regex, vector<string>* out) const;
+
+  // Appends the given range to the index file in dir (creates the file).
+  static bool AppendToIndexFile(const string& dir,
+                                int64 begin_ts, int64 end_ts,
+                                const string& file);
+  // Creates the index file in dir (if not there), marked for rebuild -
+  // cheap, so it can be called on a media thread.
+  static bool CreateIndexFile(const string& dir);
+
+  // Extracts the time range of a recording from its name (plus the
+  // file itself for Saver chunks). Returns false for other files.
+  static bool GetFileTimeRange(const string& dir, const string& file,
+                               int64* out_begin_ts, int64* out_end_ts);
+
+ private:
+  // Load() w/ the lock held
+  bool LoadLocked();
+  // Parses index file lines from content
+  void ParseLines(const string& content);
+  void Add(int64 begin_ts, int64 end_ts, const string& file);
+
+  const string dir_;
+  const string index_file_;
+  // sorted by begin_ts_
+  vector<Range> ranges_;
+  // how much of the index file we read
+  int64 index_file_size_;
+  // the inode of the index file we read (a Rebuild() changes it)
+  int64 index_file_id_;
+  // we saw kRebuildMark
+  bool needs_rebuild_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TimeRangeIndex);
+};
+
+// Keeps the TimeRangeIndex-es of the directories we were asked about.
+// All the loading / listing happens on a background thread; GetIndex()
+// returns NULL until the index is ready, and keeps serving the old index
+// while we rescan the directory (every --time_range_index_rescan_sec,
+// to pick up the files added or removed by others than Saver).
+//
+// Only directories that have an index file are indexed (i.e. where we
+// record, or where someone ran a TimeRangeIndex::Rebuild()).
+//
+// Use from a single (media) thread.
+class TimeRangeCatalog {
+ public:
+  TimeRangeCatalog();
+  ~TimeRangeCatalog();
+
+  // Returns the up to date index of dir, or NULL if not available (yet).
+  const TimeRangeIndex* GetIndex(const string& dir);
+
+ private:
+  struct Slot {
+    TimeRangeIndex* index_;     // the one we serve - may be NULL
+    TimeRangeIndex* pending_;   // the one the worker builds - may be NULL
+    int64 build_ts_;            // when we started the last build
+    Slot() : index_(NULL), pending_(NULL), build_ts_(0) {}
+  };
+  typedef map<string, Slot> SlotMap;
+
+  void StartBuild(Slot* slot, const string& dir, bool rebuild);
+  // Runs on the worker thread
+  void Build(TimeRangeIndex* index, bool rebuild);
+  // Moves the indexes built by the worker in place
+  void CollectBuilt();
+
+  SlotMap slots_;
+  thread::ThreadPool* pool_;   // created when first needed
+
+  synch::Mutex built_mutex_;
+  // indexes done by the worker (w/ success), to be collected
+  vector< pair<TimeRangeIndex*, bool> > built_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TimeRangeCatalog);
+};
+}
+
+#endif  // __MEDIA_BASE_TIME_RANGE_INDEX_H__
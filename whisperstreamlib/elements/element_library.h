@@ -118,6 +118,14 @@ class ElementLibrary {
   // to create an element of given type
   virtual int64 GetElementNeeds(const string& element_type) = 0;
 
+  // Returns true if the elements of given type do nothing until asked for
+  // media (no upstream registration, no alarms, nothing exported in
+  // Initialize()), so they can be created on first use instead of at
+  // startup.
+  virtual bool IsLazyElementType(const string& element_type) {
+    return false;
+  }
+
   // Returns a combination of Needs (OR-ed), for what is needed in order
   // to create a policy  of given type
   virtual int64 GetPolicyNeeds(const string& policy_type) = 0;
@@ -38,6 +38,7 @@
 #include <whisperlib/net/rpc/lib/server/execution/rpc_execution_simple.h>
 #include <whisperlib/common/io/ioutil.h>
 #include <whisperlib/common/base/re.h>
+#include <whisperlib/common/base/gflags.h>
 
 //////////////////////////////////////////////////////////////////////
 
@@ -49,6 +50,23 @@
 #include "f4v/f4v_tag_splitter.h"
 #include "internal/internal_tag_splitter.h"
 #include "elements/factory_based_mapper.h"
+#include "base/authorizer_cache.h"
+
+//////////////////////////////////////////////////////////////////////
+
+DEFINE_int64(authorizer_cache_ttl_ms,
+             0,
+             "If non zero, we remember the grants of each authorizer "
+             "for this long (per user / token / resource / ip class), "
+             "so reauthorizations don't hit the authorizer each time.");
+DEFINE_int64(authorizer_cache_deny_ttl_ms,
+             1000,
+             "When caching authorizer decisions, we remember the denials "
+             "for this long.");
+DEFINE_int32(authorizer_cache_size,
+             10000,
+             "When caching authorizer decisions, we remember at most "
+             "these many decisions per authorizer.");
 
 //////////////////////////////////////////////////////////////////////
 
@@ -478,6 +496,12 @@ streaming::Authorizer* ElementFactory::CreateAuthorizer(
     return NULL;
   }
   LOG_INFO << " Created authorizer, type: " << type << " , name: " << name;
+  if ( FLAGS_authorizer_cache_ttl_ms > 0 ) {
+    return new streaming::CachingAuthorizer(auth,
+                                            FLAGS_authorizer_cache_ttl_ms,
+                                            FLAGS_authorizer_cache_deny_ttl_ms,
+                                            FLAGS_authorizer_cache_size);
+  }
   return auth;
 }
 
@@ -487,11 +511,16 @@ streaming::Authorizer* ElementFactory::CreateAuthorizer(
 bool ElementFactory::CreateAllElements(ElementMap* global_elements,
                                        PolicyMap* global_policies,
                                        ElementMap* non_global_elements,
-                                       PolicyMap* non_global_policies) const {
+                                       PolicyMap* non_global_policies,
+                                       vector<string>* lazy_elements) const {
   bool success = true;
   for ( ElementSpecMap::const_iterator it = elements_map_.begin();
         it != elements_map_.end(); ++it ) {
     const MediaElementSpecs* const spec = it->second;
+    if ( lazy_elements != NULL && IsLazyElement(it->first) ) {
+      lazy_elements->push_back(it->first);
+      continue;
+    }
     const bool is_global = spec->is_global_.get();
     Element* const element = CreateElement(spec->name_.get(),
                                            NULL,
@@ -514,6 +543,28 @@ bool ElementFactory::CreateAllElements(ElementMap* global_elements,
   return success;
 }
 
+bool ElementFactory::IsLazyElement(const string& name) const {
+  const MediaElementSpecs* const spec = GetElementSpec(name);
+  if ( spec == NULL ) {
+    return false;
+  }
+  const string& type = spec->type_.get();
+  const LibMap::const_iterator it_type = known_element_types_.find(type);
+  if ( it_type == known_element_types_.end() ) {
+    return false;
+  }
+  ElementLibrary* const lib = it_type->second;
+  if ( !lib->IsLazyElementType(type) ) {
+    return false;
+  }
+  int64 needs = lib->GetElementNeeds(type);
+  if ( spec->disable_rpc_.is_set() && spec->disable_rpc_.get() ) {
+    needs &= ~ElementLibrary::NEED_RPC_SERVER;
+  }
+  return (needs & (ElementLibrary::NEED_RPC_SERVER |
+                   ElementLibrary::NEED_HTTP_SERVER)) == 0;
+}
+
 //////////////////////////////////////////////////////////////////////
 
 void ElementFactory::GetAllNames(vector<string>* names) const {
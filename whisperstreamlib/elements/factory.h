@@ -130,13 +130,19 @@ class ElementFactory :
 
   // Creates all elements and puts them in the given maps, depending if they
   // are global or not.
-  // Returns the number of elements and policies which were not
-  // created correctly.
+  // If lazy_elements is not NULL, we skip the elements that can be
+  // created on first use (see IsLazyElement()) and return their names here.
   // Returns the success status.
   bool CreateAllElements(ElementMap* global_elements,
                          PolicyMap* global_policies,
                          ElementMap* non_global_elements,
-                         PolicyMap* non_global_policies) const;
+                         PolicyMap* non_global_policies,
+                         vector<string>* lazy_elements) const;
+
+  // Returns true if the element w/ the given name can be created when
+  // first needed, instead of at startup: its library says so, and it
+  // exports nothing (rpc, http paths) that should be there from start.
+  bool IsLazyElement(const string& name) const;
 
   // Creates a temporarely element (per request) and (maybe)
   // the associated policies.
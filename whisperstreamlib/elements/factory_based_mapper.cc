@@ -29,8 +29,22 @@
 //
 // Authors: Catalin Popescu
 
+#include <whisperlib/common/base/gflags.h>
 #include "elements/factory_based_mapper.h"
 
+//////////////////////////////////////////////////////////////////////
+
+// Element creation / Initialize() stay on the media selector (elements
+// register rpc services, alarms and state keepers from there) - so instead
+// of creating them on a worker pool, we defer the ones we can.
+DEFINE_bool(lazy_element_creation,
+            false,
+            "If on, at startup we create only the elements that do "
+            "something on their own; the ones that just wait for requests "
+            "(e.g. file or load balancing elements) are created on first use. "
+            "Note: the configuration errors of these show up on first use, "
+            "not at startup.");
+
 namespace streaming {
 
 bool InitializeElementsAndPolicies(const ElementMap& elements,
@@ -98,11 +112,23 @@ FactoryBasedElementMapper::~FactoryBasedElementMapper() {
 
 bool FactoryBasedElementMapper::Initialize() {
   LOG_DEBUG << "Initializing FactoryBasedElementMapper";
+  vector<string> lazy_elements;
   const bool creation_success =
       factory_->CreateAllElements(&global_element_map_,
                                   &global_policy_map_,
                                   &non_global_element_map_,
-                                  &non_global_policy_map_);
+                                  &non_global_policy_map_,
+                                  FLAGS_lazy_element_creation
+                                  ? &lazy_elements : NULL);
+  for ( int i = 0; i < lazy_elements.size(); ++i ) {
+    const MediaElementSpecs* const spec =
+        factory_->GetElementSpec(lazy_elements[i]);
+    lazy_elements_[lazy_elements[i]] = spec->is_global_.get();
+  }
+  LOG_INFO << "Created " << (global_element_map_.size() +
+                             non_global_element_map_.size())
+           << " elements, deferred " << lazy_elements_.size()
+           << " elements until first use";
   if ( !creation_success ) {
     LOG_ERROR << " Error creating initalized elements - some elements may not "
               << "be available";
@@ -144,6 +170,12 @@ void FactoryBasedElementMapper::Close(Closure* close_completed) {
   for ( int i = 0; i < names.size(); ++i  ) {
     RemoveElement(names[i]);
   }
+  if ( close_pending_element_count_ == 0 && close_completed_ != NULL ) {
+    // nothing was created (all elements were lazy)
+    selector_->RunInSelectLoop(close_completed_);
+    close_completed_ = NULL;
+    return;
+  }
   // NEXT: each element signals close completion through ElementClosed()
   //       There we check if all elements were closed, and then call
   //       close_completed_.
@@ -192,6 +224,11 @@ bool FactoryBasedElementMapper::AddElement(const string& name,
   }
   // If the element is global we create it. If eveything is bug-free
   // this should be successful
+  return CreateElement(name, is_global);
+}
+
+bool FactoryBasedElementMapper::CreateElement(const string& name,
+                                              bool is_global) {
   PolicyMap new_policies;
   Element* const element = factory_->CreateElement(name,
                                                    extra_element_spec_map_,
@@ -223,6 +260,19 @@ bool FactoryBasedElementMapper::AddElement(const string& name,
   return true;
 }
 
+void FactoryBasedElementMapper::MaybeCreateLazyElement(const string& name) {
+  const LazyElementMap::iterator it = lazy_elements_.find(name);
+  if ( it == lazy_elements_.end() ) {
+    return;
+  }
+  const bool is_global = it->second;
+  lazy_elements_.erase(it);
+  LOG_INFO << "Creating element on first use: [" << name << "]";
+  if ( !CreateElement(name, is_global) ) {
+    LOG_ERROR << "Cannot create element: [" << name << "]";
+  }
+}
+
 void FactoryBasedElementMapper::RemoveTempElement(const string& name) {
   // This is quite slow, but, hopefully we will not delete elements that often
   for ( RequestSet::iterator it = requests_set_.begin();
@@ -263,6 +313,7 @@ void FactoryBasedElementMapper::RemoveTempElement(const string& name) {
 }
 
 void FactoryBasedElementMapper::RemoveElement(const string& name) {
+  lazy_elements_.erase(name);
   //
   // Check first the global structures..
   //
@@ -316,7 +367,8 @@ void FactoryBasedElementMapper::ElementClosed(Element* element,
 
 bool FactoryBasedElementMapper::IsKnownElementName(const string& name) {
   if ( global_element_map_.find(name) != global_element_map_.end() ||
-       non_global_element_map_.find(name) != non_global_element_map_.end() ) {
+       non_global_element_map_.find(name) != non_global_element_map_.end() ||
+       lazy_elements_.find(name) != lazy_elements_.end() ) {
     return true;
   }
   string test;
@@ -335,6 +387,7 @@ bool FactoryBasedElementMapper::GetElementByName(
     vector<streaming::Policy*>** policies) {
   *element = NULL;
   *policies = NULL;
+  MaybeCreateLazyElement(name);
   const ElementMap::const_iterator
       it_perm = global_element_map_.find(name);
   if ( it_perm != global_element_map_.end() ) {
@@ -369,6 +422,12 @@ void FactoryBasedElementMapper::GetAllElements(
         it != global_element_map_.end(); ++it ) {
     out_elements->push_back(it->first);
   }
+  for ( LazyElementMap::const_iterator it = lazy_elements_.begin();
+        it != lazy_elements_.end(); ++it ) {
+    if ( it->second ) {
+      out_elements->push_back(it->first);
+    }
+  }
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -412,7 +471,8 @@ bool FactoryBasedElementMapper::SetMediaAlias(const string& alias_name,
   if ( global_element_map_.find(alias_name) !=
        global_element_map_.end() ||
        non_global_element_map_.find(alias_name) !=
-       non_global_element_map_.end() ) {
+       non_global_element_map_.end() ||
+       lazy_elements_.find(alias_name) != lazy_elements_.end() ) {
     *error = "Invalid alias name - matches some element name";
     return false;
   }
@@ -562,7 +622,8 @@ string FactoryBasedElementMapper::TranslateMedia(const string& m) const {
   if ( it_perm == global_element_map_.end() ) {
     const ElementMap::const_iterator
         it_non_perm = non_global_element_map_.find(media_pair.first);
-    if ( it_non_perm == non_global_element_map_.end() ) {
+    if ( it_non_perm == non_global_element_map_.end() &&
+         lazy_elements_.find(media_pair.first) == lazy_elements_.end() ) {
       string alias;
       if ( !GetMediaAlias(media_pair.first, &alias) ) {
         return media;
@@ -586,6 +647,7 @@ string FactoryBasedElementMapper::TranslateMedia(const string& m) const {
 bool FactoryBasedElementMapper::DescribeMedia(const string& media,
     MediaInfoCallback* callback) {
   pair<string, string> media_pair = strutil::SplitFirst(media.c_str(), '/');
+  MaybeCreateLazyElement(media_pair.first);
   const ElementMap::const_iterator it_perm =
       global_element_map_.find(media_pair.first);
   if ( it_perm != global_element_map_.end() ) {
@@ -626,6 +688,7 @@ bool FactoryBasedElementMapper::HasMedia(const string& m) {
   DLOG_DEBUG
   << "Looking for element: [" << media_pair.first << "] from media: "
             << "[" << media << "]";
+  MaybeCreateLazyElement(media_pair.first);
   const ElementMap::const_iterator
       it_perm = global_element_map_.find(media_pair.first);
   if ( it_perm != global_element_map_.end() ) {
@@ -667,6 +730,7 @@ void FactoryBasedElementMapper::ListMedia(const string& m,
     media++;
   }
   pair<string, string> media_pair = strutil::SplitFirst(media, '/');
+  MaybeCreateLazyElement(media_pair.first);
   const ElementMap::const_iterator
       it_perm = global_element_map_.find(media_pair.first);
   if ( it_perm != global_element_map_.end() ) {
@@ -701,6 +765,31 @@ void FactoryBasedElementMapper::ListMedia(const string& m,
   }
 }
 
+bool FactoryBasedElementMapper::FindTimeRangeMedia(const string& m,
+                                                   int64 play_ts,
+                                                   string* out_media) {
+  const char* media = m.c_str();
+  if ( media[0] == '/' ) {
+    media++;
+  }
+  pair<string, string> media_pair = strutil::SplitFirst(media, '/');
+  MaybeCreateLazyElement(media_pair.first);
+  const ElementMap::const_iterator
+      it_perm = global_element_map_.find(media_pair.first);
+  if ( it_perm != global_element_map_.end() ) {
+    return it_perm->second->FindTimeRangeMedia(media_pair.second, play_ts,
+                                               out_media);
+  }
+  const ElementMap::const_iterator
+      it_non_perm = non_global_element_map_.find(media_pair.first);
+  if ( it_non_perm != non_global_element_map_.end() ) {
+    return it_non_perm->second->FindTimeRangeMedia(media_pair.second, play_ts,
+                                                   out_media);
+  }
+  // aliases & fallback: through ListMedia()
+  return ElementMapper::FindTimeRangeMedia(m, play_ts, out_media);
+}
+
 //////////////////////////////////////////////////////////////////////
 
 bool FactoryBasedElementMapper::AddRequest(const string& m,
@@ -719,6 +808,7 @@ bool FactoryBasedElementMapper::AddRequest(const string& m,
              << ", callback: " << callback
              << ", element: [" << media_pair.first << "]" ;
 
+  MaybeCreateLazyElement(media_pair.first);
   const ElementMap::const_iterator
       it_perm = global_element_map_.find(media_pair.first);
   if ( it_perm != global_element_map_.end() ) {
@@ -136,6 +136,8 @@ class FactoryBasedElementMapper : public ElementMapper {
   virtual bool HasMedia(const string& media_name);
   virtual void ListMedia(const string& media_dir,
                          vector<string>* medias);
+  virtual bool FindTimeRangeMedia(const string& media_dir, int64 play_ts,
+                                  string* out_media);
 
   void set_extra_element_spec_map(ElementSpecMap* extra_element_spec_map) {
     extra_element_spec_map_ = extra_element_spec_map;
@@ -154,6 +156,11 @@ class FactoryBasedElementMapper : public ElementMapper {
 
  private:
   string GetElementName(const string& media);
+  // Creates and initializes the element (and its policies) per its spec
+  bool CreateElement(const string& name, bool is_global);
+  // If name is an element whose creation we deferred (see
+  // --lazy_element_creation), creates it now.
+  void MaybeCreateLazyElement(const string& name);
   void RemoveTempElement(const string& name);
   // each element signals Close completion by calling this
   void ElementClosed(Element* element, vector<streaming::Policy*>* policies);
@@ -173,6 +180,10 @@ class FactoryBasedElementMapper : public ElementMapper {
 
   AuthorizerMap authorizer_map_;
 
+  // The elements not created yet (name -> is_global)
+  typedef hash_map<string, bool> LazyElementMap;
+  LazyElementMap lazy_elements_;
+
   typedef hash_set<streaming::Request*> RequestSet;
 
   typedef hash_map<streaming::Request*, TempElementStruct*> TempMap;
@@ -720,8 +720,34 @@ bool AioFileElement::HasMedia(const string& media) {
 
 void AioFileElement::ListMedia(const string& media_dir,
                                vector<string>* out) {
-  io::DirList(strutil::JoinPaths(home_dir_, media_dir),
-              io::LIST_FILES | io::LIST_RECURSIVE, &file_pattern_, out);
+  const string dir = strutil::JoinPaths(home_dir_, media_dir);
+  // The recording directories (w/ a time range index) we list from their
+  // index - i.e. the recordings only, in time order.
+  const TimeRangeIndex* const index = time_range_catalog_.GetIndex(dir);
+  if ( index != NULL ) {
+    index->ListFiles(&file_pattern_, out);
+    return;
+  }
+  io::DirList(dir, io::LIST_FILES | io::LIST_RECURSIVE, &file_pattern_, out);
+}
+bool AioFileElement::FindTimeRangeMedia(const string& media_dir,
+                                        int64 play_ts,
+                                        string* out_media) {
+  const string dir = strutil::JoinPaths(home_dir_, media_dir);
+  const TimeRangeIndex* const index = time_range_catalog_.GetIndex(dir);
+  if ( index == NULL ) {
+    return Element::FindTimeRangeMedia(media_dir, play_ts, out_media);
+  }
+  // skip what we do not serve (if ts is in such a range, the next
+  // one we serve is what comes next - like for a gap)
+  for ( int32 i = index->Find(play_ts); i >= 0 && i < index->size(); ++i ) {
+    const string& file = index->range(i).file_;
+    if ( file_pattern_.Matches(strutil::SplitLast(file, "/").second) ) {
+      *out_media = file;
+      return true;
+    }
+  }
+  return false;
 }
 // declared in base/media_info_util.h
 namespace util {
@@ -41,6 +41,7 @@
 #include <whisperlib/common/io/file/buffer_manager.h>
 #include <whisperstreamlib/base/element.h>
 #include <whisperstreamlib/base/tag_splitter.h>
+#include <whisperstreamlib/base/time_range_index.h>
 
 namespace streaming {
 
@@ -102,6 +103,8 @@ class AioFileElement : public Element {
   virtual void RemoveRequest(streaming::Request* req);
   virtual bool HasMedia(const string& media);
   virtual void ListMedia(const string& media_dir, vector<string>* out);
+  virtual bool FindTimeRangeMedia(const string& media_dir, int64 play_ts,
+                                  string* out_media);
   virtual bool DescribeMedia(const string& media, MediaInfoCallback* callback);
   virtual void Close(Closure* call_on_close);
 
@@ -150,6 +153,10 @@ class AioFileElement : public Element {
   // filename -> MediaInfo*
   util::Cache<string, const MediaInfo*> media_info_cache_;
 
+  // The time range indexes of the recording directories we were asked to
+  // list (so we don't list them on our thread)
+  TimeRangeCatalog time_range_catalog_;
+
   // permanent callback to NotifyFrsClosed
   Callback1<AioFileReadingStruct*>* notify_frs_closed_callback_;
 
@@ -141,8 +141,10 @@ const char F4vToFlvConverterElement::kElementClassName[] =
 
 F4vToFlvConverterElement::F4vToFlvConverterElement(
     const string& name, ElementMapper* mapper,
-    net::Selector* selector)
-    : FilteringElement(kElementClassName, name, mapper, selector) {
+    net::Selector* selector,
+    bool share_upstream)
+    : FilteringElement(kElementClassName, name, mapper, selector),
+      share_upstream_(share_upstream) {
 }
 F4vToFlvConverterElement::~F4vToFlvConverterElement() {
 }
@@ -73,7 +73,8 @@ class F4vToFlvConverterElement : public FilteringElement {
   static const char kElementClassName[];
   F4vToFlvConverterElement(const string& name,
                            ElementMapper* mapper,
-                           net::Selector* selector);
+                           net::Selector* selector,
+                           bool share_upstream);
   virtual ~F4vToFlvConverterElement();
 
  protected:
@@ -81,8 +82,14 @@ class F4vToFlvConverterElement : public FilteringElement {
   virtual FilteringCallbackData* CreateCallbackData(const string& media_name,
                                                     streaming::Request* req);
   virtual void DeleteCallbackData(FilteringCallbackData* data);
+  virtual bool IsClientIndependentFiltering() const {
+    return share_upstream_;
+  }
 
  private:
+  // one converter for all the clients of a media (see FilteringElement)
+  const bool share_upstream_;
+
   DISALLOW_EVIL_CONSTRUCTORS(F4vToFlvConverterElement);
 };
 } // namespace streaming
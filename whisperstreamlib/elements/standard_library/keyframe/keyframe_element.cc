@@ -97,10 +97,12 @@ KeyFrameExtractorElement::KeyFrameExtractorElement(
     ElementMapper* mapper,
     net::Selector* selector,
     int64 ms_between_video_frames,
-    bool drop_audio)
+    bool drop_audio,
+    bool share_upstream)
     : FilteringElement(kElementClassName, name, mapper, selector),
       ms_between_video_frames_(ms_between_video_frames),
-      drop_audio_(drop_audio) {
+      drop_audio_(drop_audio),
+      share_upstream_(share_upstream) {
 }
 KeyFrameExtractorElement::~KeyFrameExtractorElement() {
 }
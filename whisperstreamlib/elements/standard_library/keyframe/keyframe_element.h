@@ -52,7 +52,8 @@ class KeyFrameExtractorElement : public FilteringElement {
                            ElementMapper* mapper,
                            net::Selector* selector,
                            int64 ms_between_video_frames,
-                           bool drop_audio);
+                           bool drop_audio,
+                           bool share_upstream);
   virtual ~KeyFrameExtractorElement();
 
   //////////////////////////////////////////////////////////////////
@@ -60,10 +61,15 @@ class KeyFrameExtractorElement : public FilteringElement {
   virtual bool Initialize();
   virtual FilteringCallbackData* CreateCallbackData(const string& media_name,
                                                     Request* req);
+  virtual bool IsClientIndependentFiltering() const {
+    return share_upstream_;
+  }
 
  private:
   const int64 ms_between_video_frames_;
   const bool drop_audio_;
+  // one filter for all the clients of a media (see FilteringElement)
+  const bool share_upstream_;
 
   DISALLOW_EVIL_CONSTRUCTORS(KeyFrameExtractorElement);
 };
@@ -31,8 +31,10 @@
 //
 
 #include <string>
+#include <algorithm>
 
 #include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/timer.h>
 #include WHISPER_HASH_SET_HEADER
 #include <whisperstreamlib/base/element.h>
 
@@ -40,54 +42,195 @@
 
 namespace streaming {
 
+namespace {
+// Rendezvous (highest random weight) hashing: each media is scored
+// against each sub element, and goes to the best score. When a sub element
+// is removed only its media move, and they spread evenly on the others.
+uint64 RendezvousScore(const string& sub_element, const string& media) {
+  uint64 h = 14695981039346656037ULL;   // 64 bit FNV-1a
+  for ( int i = 0; i < sub_element.size(); ++i ) {
+    h = (h ^ static_cast<uint8>(sub_element[i])) * 1099511628211ULL;
+  }
+  h = (h ^ '/') * 1099511628211ULL;
+  for ( int i = 0; i < media.size(); ++i ) {
+    h = (h ^ static_cast<uint8>(media[i])) * 1099511628211ULL;
+  }
+  // final mix, as FNV alone is weak in the high bits
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+struct ScoreGreater {
+  explicit ScoreGreater(const vector<uint64>& score) : score_(score) {}
+  bool operator()(int a, int b) const { return score_[a] > score_[b]; }
+  const vector<uint64>& score_;
+};
+}
+
 const char LoadBalancingElement::kElementClassName[] = "load_balancing";
 
+const char* LoadBalancingElement::StrategyName(Strategy strategy) {
+  switch ( strategy ) {
+    CONSIDER(ROUND_ROBIN);
+    CONSIDER(CONSISTENT_HASH);
+    CONSIDER(LEAST_ACTIVE);
+    CONSIDER(HEALTH_WEIGHTED);
+  }
+  LOG_FATAL << "Illegal strategy: " << strategy;
+  return "UNKNOWN";
+}
+bool LoadBalancingElement::StrategyFromName(const string& name,
+                                            Strategy* strategy) {
+  if ( name == "round_robin" ) {
+    *strategy = ROUND_ROBIN;
+  } else if ( name == "consistent_hash" ) {
+    *strategy = CONSISTENT_HASH;
+  } else if ( name == "least_active" ) {
+    *strategy = LEAST_ACTIVE;
+  } else if ( name == "health_weighted" ) {
+    *strategy = HEALTH_WEIGHTED;
+  } else {
+    return false;
+  }
+  return true;
+}
+
 LoadBalancingElement::LoadBalancingElement(const string& name,
                                            ElementMapper* mapper,
                                            net::Selector* selector,
-                                           const vector<string>& sub_elements)
+                                           const string& rpc_path,
+                                           rpc::HttpServer* rpc_server,
+                                           const vector<string>& sub_elements,
+                                           Strategy strategy,
+                                           int64 failure_penalty_ms)
     : Element(kElementClassName, name, mapper),
+      ServiceInvokerLoadBalancingElementService(
+          ServiceInvokerLoadBalancingElementService::GetClassName()),
+      strategy_(strategy),
+      failure_penalty_ms_(failure_penalty_ms),
+      next_element_(0),
+      num_decisions_(0),
+      num_fallbacks_(0),
+      num_rejected_(0),
       selector_(selector),
+      rpc_path_(rpc_path),
+      rpc_server_(rpc_server),
+      rpc_registered_(false),
       close_completed_(NULL) {
   for ( int i = 0; i < sub_elements.size(); ++i ) {
-    sub_elements_.push_back(sub_elements[i]);
+    sub_elements_.push_back(SubElement(sub_elements[i]));
   }
 }
 LoadBalancingElement::~LoadBalancingElement() {
   DCHECK(req_map_.empty());
   DCHECK(close_completed_ == NULL);
+  if ( rpc_registered_ ) {
+    rpc_server_->UnregisterService(rpc_path_, this);
+  }
 }
 bool LoadBalancingElement::Initialize() {
   if ( sub_elements_.empty() ) {
     return false;
   }
+  if ( rpc_server_ != NULL ) {
+    rpc_registered_ = rpc_server_->RegisterService(rpc_path_, this);
+    if ( !rpc_registered_ ) {
+      return false;
+    }
+  }
   return true;
 }
+
+bool LoadBalancingElement::IsHealthy(const SubElement& sub, int64 now) const {
+  return sub.last_failure_ts_ == 0 ||
+         now - sub.last_failure_ts_ >= failure_penalty_ms_;
+}
+
+void LoadBalancingElement::GetCandidates(const string& media,
+                                         vector<int>* out) {
+  const int n = sub_elements_.size();
+  // all strategies break ties in round robin order
+  for ( int i = 0; i < n; ++i ) {
+    out->push_back((next_element_ + i) % n);
+  }
+  next_element_ = (next_element_ + 1) % n;
+
+  switch ( strategy_ ) {
+    case ROUND_ROBIN:
+      break;
+    case CONSISTENT_HASH: {
+      vector<uint64> score(n);
+      for ( int i = 0; i < n; ++i ) {
+        score[i] = RendezvousScore(sub_elements_[i].name_, media);
+      }
+      std::sort(out->begin(), out->end(), ScoreGreater(score));
+      break;
+    }
+    case LEAST_ACTIVE: {
+      // few sub elements - a stable insertion sort keeps the ties in order
+      for ( int i = 1; i < n; ++i ) {
+        const int crt = (*out)[i];
+        int j = i;
+        while ( j > 0 && sub_elements_[(*out)[j - 1]].active_requests_ >
+                         sub_elements_[crt].active_requests_ ) {
+          (*out)[j] = (*out)[j - 1];
+          --j;
+        }
+        (*out)[j] = crt;
+      }
+      break;
+    }
+    case HEALTH_WEIGHTED: {
+      // the unhealthy ones are still tried, but last
+      const int64 now = timer::TicksMsec();
+      vector<int> unhealthy;
+      int k = 0;
+      for ( int i = 0; i < n; ++i ) {
+        if ( IsHealthy(sub_elements_[(*out)[i]], now) ) {
+          (*out)[k++] = (*out)[i];
+        } else {
+          unhealthy.push_back((*out)[i]);
+        }
+      }
+      std::copy(unhealthy.begin(), unhealthy.end(), out->begin() + k);
+      break;
+    }
+  }
+}
+
 bool LoadBalancingElement::AddRequest(const string& media,
     Request* req, ProcessingCallback* callback) {
-  next_element_ = (next_element_ + 1) % sub_elements_.size();
+  vector<int> candidates;
+  GetCandidates(media, &candidates);
 
   ReqStruct* rs = new ReqStruct(callback);
   rs->added_callback_ = NewPermanentCallback(this,
                                              &LoadBalancingElement::ProcessTag,
                                              rs);
-  for ( int i = 0; i < sub_elements_.size(); ++i ) {
-    int ndx = next_element_ + i;
-    if ( ndx >= sub_elements_.size() ) {
-      ndx -= sub_elements_.size();
-    }
-    rs->new_element_name_ = sub_elements_[ndx];
-    const string crt_name = sub_elements_[ndx] + "/" + media;
+  for ( int i = 0; i < candidates.size(); ++i ) {
+    SubElement& sub = sub_elements_[candidates[i]];
+    rs->new_element_name_ = sub.name_;
+    rs->sub_element_ = candidates[i];
+    const string crt_name = sub.name_ + "/" + media;
     if ( mapper_->AddRequest(crt_name, req, rs->added_callback_) ) {
       LOG_INFO << name() << " Successfully redirected to: [" << crt_name << "]";
       req_map_.insert(make_pair(req, rs));
-      next_element_ = (ndx + 1) >= sub_elements_.size() ? 0 : ndx;
+      ++sub.active_requests_;
+      ++sub.num_selected_;
+      ++num_decisions_;
+      if ( i > 0 ) {
+        ++num_fallbacks_;
+      }
       return true;
     }
+    ++sub.num_failures_;
+    sub.last_failure_ts_ = timer::TicksMsec();
     LOG_ERROR << name() << " cannot add media: [" << crt_name
               << "], trying the next prefix...";
   }
   LOG_ERROR << name() << " cannot add media: [" << media << "]";
+  ++num_rejected_;
   delete rs;
   return false;
 }
@@ -99,6 +242,7 @@ void LoadBalancingElement::RemoveRequest(streaming::Request* req) {
     return;
   }
   mapper_->RemoveRequest(req, it->second->added_callback_);
+  --sub_elements_[it->second->sub_element_].active_requests_;
   delete it->second;
   req_map_.erase(it);
 
@@ -113,7 +257,7 @@ void LoadBalancingElement::RemoveRequest(streaming::Request* req) {
 
 bool LoadBalancingElement::HasMedia(const string& media) {
   for ( int i = 0; i < sub_elements_.size(); ++i ) {
-    const string crt_name = strutil::JoinMedia(sub_elements_[i], media);
+    const string crt_name = strutil::JoinMedia(sub_elements_[i].name_, media);
     if ( mapper_->HasMedia(crt_name) ) {
       return true;
     }
@@ -126,7 +270,7 @@ void LoadBalancingElement::ListMedia(const string& media_dir,
   set<string> media_set;
   for ( int i = 0; i < sub_elements_.size(); ++i ) {
     vector<string> crt;
-    string crt_name = strutil::JoinMedia(sub_elements_[i], media_dir);
+    string crt_name = strutil::JoinMedia(sub_elements_[i].name_, media_dir);
     mapper_->ListMedia(crt_name, &crt);
     for ( int j = 0; j < crt.size(); ++j ) {
       media_set.insert(strutil::JoinPaths(name(), crt[j]));
@@ -138,7 +282,8 @@ void LoadBalancingElement::ListMedia(const string& media_dir,
 bool LoadBalancingElement::DescribeMedia(const string& media,
                                          MediaInfoCallback* callback) {
   for ( uint32 i = 0; i < sub_elements_.size(); ++i ) {
-    const string new_media = strutil::JoinMedia(sub_elements_[i], media);
+    const string new_media = strutil::JoinMedia(sub_elements_[i].name_,
+                                                media);
     if ( mapper_->DescribeMedia(new_media, callback) ) {
       return true;
     }
@@ -171,6 +316,31 @@ void LoadBalancingElement::Close(Closure* call_on_close) {
   //       When the req_map_ gets empty, close_completed_ is called.
 }
 
+void LoadBalancingElement::GetStats(
+    rpc::CallContext<LoadBalancingStats>* call) {
+  LoadBalancingStats stats;
+  GetStats(&stats);
+  call->Complete(stats);
+}
+void LoadBalancingElement::GetStats(LoadBalancingStats* out) const {
+  const int64 now = timer::TicksMsec();
+  out->strategy_.set(StrategyName(strategy_));
+  out->num_decisions_.set(num_decisions_);
+  out->num_fallbacks_.set(num_fallbacks_);
+  out->num_rejected_.set(num_rejected_);
+  out->sub_elements_.ref().clear();  // set, and empty
+  for ( int i = 0; i < sub_elements_.size(); ++i ) {
+    const SubElement& sub = sub_elements_[i];
+    LoadBalancingSubElementStats crt;
+    crt.name_.set(sub.name_);
+    crt.active_requests_.set(sub.active_requests_);
+    crt.num_selected_.set(sub.num_selected_);
+    crt.num_failures_.set(sub.num_failures_);
+    crt.healthy_.set(IsHealthy(sub, now));
+    out->sub_elements_.ref().push_back(crt);
+  }
+}
+
 
 void LoadBalancingElement::ProcessTag(ReqStruct* rs,
                                       const streaming::Tag* tag,
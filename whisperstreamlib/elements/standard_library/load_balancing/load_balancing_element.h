@@ -31,22 +31,48 @@
 //
 
 #include <string>
+#include <vector>
 
 #include <whisperlib/common/base/types.h>
 #include WHISPER_HASH_SET_HEADER
+#include <whisperlib/net/rpc/lib/server/rpc_http_server.h>
 #include <whisperstreamlib/base/element.h>
+#include "elements/standard_library/auto/standard_library_invokers.h"
 
 #ifndef __MEDIA_ELEMENTS_LOAD_BALANCING_ELEMENT_H__
 #define __MEDIA_ELEMENTS_LOAD_BALANCING_ELEMENT_H__
 
 namespace streaming {
 
-class LoadBalancingElement : public Element {
+// Serves media from one of several sub elements: a request for
+// <name>/<media> goes to <sub element>/<media>. The sub element is picked
+// by a strategy (see standard_library.rpc); if it refuses the request we
+// try the others, in the order given by the strategy.
+class LoadBalancingElement
+    : public Element,
+      public ServiceInvokerLoadBalancingElementService {
  public:
+  enum Strategy {
+    ROUND_ROBIN,
+    CONSISTENT_HASH,
+    // The sub element w/ the fewest requests routed by *this* element.
+    // The sub elements may serve others too (other load balancers, direct
+    // requests) - we do not see those.
+    LEAST_ACTIVE,
+    HEALTH_WEIGHTED
+  };
+  static const char* StrategyName(Strategy strategy);
+  // Returns false for an unknown name.
+  static bool StrategyFromName(const string& name, Strategy* strategy);
+
   LoadBalancingElement(const string& name,
                        ElementMapper* mapper,
                        net::Selector* selector,
-                       const vector<string>& sub_elements);
+                       const string& rpc_path,
+                       rpc::HttpServer* rpc_server,
+                       const vector<string>& sub_elements,
+                       Strategy strategy,
+                       int64 failure_penalty_ms);
   virtual ~LoadBalancingElement();
 
   static const char kElementClassName[];
@@ -61,16 +87,50 @@ class LoadBalancingElement : public Element {
   virtual bool DescribeMedia(const string& media, MediaInfoCallback* callback);
   virtual void Close(Closure* call_on_close);
 
+  // ServiceInvokerLoadBalancingElementService interface
+  virtual void GetStats(rpc::CallContext<LoadBalancingStats>* call);
+  // What GetStats() returns
+  void GetStats(LoadBalancingStats* out) const;
+
  private:
+  struct SubElement {
+    string name_;
+    int32 active_requests_;
+    int64 num_selected_;
+    int64 num_failures_;
+    int64 last_failure_ts_;   // 0 => never failed
+    explicit SubElement(const string& name)
+        : name_(name),
+          active_requests_(0),
+          num_selected_(0),
+          num_failures_(0),
+          last_failure_ts_(0) {
+    }
+  };
+  bool IsHealthy(const SubElement& sub, int64 now) const;
+  // Fills in the indices of all sub elements, in the order we should try
+  // them for the given media.
+  void GetCandidates(const string& media, vector<int>* out);
+
+  const Strategy strategy_;
+  const int64 failure_penalty_ms_;
+  vector<SubElement> sub_elements_;
+  // where round robin (and health weighted) start next
   int32 next_element_;
-  vector<string> sub_elements_;
+
+  int64 num_decisions_;
+  int64 num_fallbacks_;
+  int64 num_rejected_;
+
   struct ReqStruct {
     streaming::ProcessingCallback* callback_;
     string new_element_name_;
+    int sub_element_;
     streaming::ProcessingCallback* added_callback_;
     bool eos_received_;
     ReqStruct(streaming::ProcessingCallback* callback)
         : callback_(callback),
+          sub_element_(-1),
           added_callback_(NULL),
           eos_received_(false) {
     }
@@ -85,6 +145,10 @@ class LoadBalancingElement : public Element {
 
   net::Selector* selector_;
 
+  const string rpc_path_;
+  rpc::HttpServer* const rpc_server_;
+  bool rpc_registered_;
+
   // called when asynchronous Close completes
   Closure* close_completed_;
 
@@ -29,14 +29,60 @@
 //
 // Author: Catalin Popescu
 
+#include <whisperlib/common/base/gflags.h>
 #include <whisperlib/net/rpc/lib/codec/json/rpc_json_encoder.h>
 #include <whisperlib/net/rpc/lib/codec/json/rpc_json_decoder.h>
 #include "elements/standard_library/policies/policy.h"
 
+DEFINE_int32(playlist_prefetch_ahead_ms,
+             10000,
+             "The playlist policies announce the next item to their "
+             "element this much before switching to it");
+
 namespace streaming {
 
 //////////////////////////////////////////////////////////////////////
 
+int PlaylistPrefetcher::PeekNext(int crt, int next_to_play,
+                                 int size, bool loop) {
+  if ( next_to_play >= 0 && next_to_play < size ) {
+    return next_to_play;
+  }
+  if ( crt + 1 < size ) {
+    return crt + 1;
+  }
+  return loop && size > 0 ? 0 : -1;
+}
+
+void PlaylistPrefetcher::Announce(const string& crt_media,
+                                  const string& next_media) {
+  announced_ = true;
+  // replaying the current item is not something we can prepare
+  element_->PrefetchMedia(next_media == crt_media ? string("") : next_media);
+}
+
+bool PlaylistPrefetcher::IsDue(const Tag* tag, int64 timestamp_ms) {
+  if ( announced_ ) {
+    return false;
+  }
+  if ( tag->type() == Tag::TYPE_MEDIA_INFO ) {
+    item_duration_ms_ =
+        static_cast<const MediaInfoTag*>(tag)->info().duration_ms();
+    return false;
+  }
+  if ( item_duration_ms_ <= 0 ||
+       (!tag->is_audio_tag() && !tag->is_video_tag()) ) {
+    return false;
+  }
+  if ( item_start_ts_ < 0 ) {
+    item_start_ts_ = timestamp_ms;
+  }
+  return timestamp_ms - item_start_ts_ >=
+         item_duration_ms_ - FLAGS_playlist_prefetch_ahead_ms;
+}
+
+//////////////////////////////////////////////////////////////////////
+
 const char RandomPolicy::kPolicyClassName[] = "random_policy";
 const char PlaylistPolicy::kPolicyClassName[] = "playlist_policy";
 const char TimedPlaylistPolicy::kPolicyClassName[] = "timed_playlist_policy";
@@ -233,6 +279,8 @@ void PlaylistPolicy::SetPlaylist(
   }
   if ( playlist.switch_now_.is_set() && playlist.switch_now_.get() ) {
     GoToNext();
+  } else if ( prefetcher_.announced() ) {
+    PrefetchNext();
   }
   SaveState();
   call->Complete(MediaOpResult(true, ""));
@@ -307,6 +355,16 @@ void TimedPlaylistPolicy::ClearState() {
   }
 }
 
+void TimedPlaylistPolicy::ScheduleNext(int64 delay_ms) {
+  selector_->RegisterAlarm(alarm_callback_, delay_ms);
+  // Items may be long, so we don't keep the next one open (and paused)
+  // all this time - only announce it a little before the switch
+  prefetcher_.Switched();
+  selector_->RegisterAlarm(prefetch_alarm_callback_,
+      max(static_cast<int64>(0),
+          delay_ms - FLAGS_playlist_prefetch_ahead_ms));
+}
+
 //////////////////////////////////////////////////////////////////////
 
 bool OnCommandPolicy::Initialize() {
@@ -161,6 +161,66 @@ class RandomPolicy : public Policy {
 
 //////////////////////////////////////////////////////////////////////
 
+// Announces the next item of a playlist to the element (see
+// PolicyDrivenElement::PrefetchMedia) a little before the switch, so the
+// element can open it ahead of time. Used by the playlist policies.
+class PlaylistPrefetcher {
+ public:
+  explicit PlaylistPrefetcher(PolicyDrivenElement* element)
+      : element_(element),
+        announced_(false),
+        item_duration_ms_(0),
+        item_start_ts_(-1) {
+  }
+
+  // The index played after crt, -1 for nothing: next_to_play if valid,
+  // else the one after crt (w/ loop, the first one after the last one)
+  static int PeekNext(int crt, int next_to_play, int size, bool loop);
+
+  // Announces what the playlist plays after crt (as per PeekNext())
+  template <typename ITEM>
+  void AnnounceNext(const vector<ITEM>& playlist,
+                    int crt, int next_to_play, bool loop) {
+    const int next = PeekNext(crt, next_to_play, playlist.size(), loop);
+    Announce(crt >= 0 && crt < (int)playlist.size() ? Media(playlist[crt])
+                                                    : string(""),
+             next >= 0 ? Media(playlist[next]) : string(""));
+  }
+  // true after an announcement for the current item
+  bool announced() const { return announced_; }
+
+  // Call after each switch: starts over for the new item
+  void Switched() {
+    announced_ = false;
+    item_duration_ms_ = 0;
+    item_start_ts_ = -1;
+  }
+  // Follows the tags of the current item. Returns true (once) when its
+  // end, per the duration in its MediaInfo, is less than
+  // --playlist_prefetch_ahead_ms away. Items w/o a known duration
+  // (e.g. live streams) are never due.
+  bool IsDue(const Tag* tag, int64 timestamp_ms);
+
+ private:
+  static const string& Media(const string& item) {
+    return item;
+  }
+  static const string& Media(const pair<int64, string>& item) {
+    return item.second;
+  }
+  void Announce(const string& crt_media, const string& next_media);
+
+  PolicyDrivenElement* const element_;
+  bool announced_;
+  int64 item_duration_ms_;
+  // timestamp of the first media tag of the current item
+  int64 item_start_ts_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(PlaylistPrefetcher);
+};
+
+//////////////////////////////////////////////////////////////////////
+
 // A policy that picks from a list
 
 class PlaylistPolicy : public Policy,
@@ -191,7 +251,8 @@ class PlaylistPolicy : public Policy,
         rpc_path_(rpc_path),
         local_rpc_path_(local_rpc_path),
         rpc_server_(rpc_server),
-        is_registered_(false) {
+        is_registered_(false),
+        prefetcher_(element) {
     copy(playlist.begin(), playlist.end(), playlist_.begin());
   }
   virtual ~PlaylistPolicy() {
@@ -222,10 +283,15 @@ class PlaylistPolicy : public Policy,
     crt_ = -1;
     next_to_play_ = -1;
     next_next_to_play_ = -1;
+    prefetcher_.Switched();
     SaveState();
   }
 
-  virtual bool NotifyTag(const streaming::Tag*, int64) {
+  virtual bool NotifyTag(const streaming::Tag* tag, int64 timestamp_ms) {
+    // we do not know how long the items are - we learn it from their tags
+    if ( prefetcher_.IsDue(tag, timestamp_ms) ) {
+      PrefetchNext();
+    }
     return true;
   }
   virtual string GetPolicyConfig() { return ""; }
@@ -266,8 +332,10 @@ class PlaylistPolicy : public Policy,
     if ( !ret ) {
       LOG_WARNING << " Cannot switch for: " << element_->name()
                   << " to: " << playlist_[crt_] << " ending playlist";
+      return false;
     }
-    return ret;
+    prefetcher_.Switched();
+    return true;
   }
 
   bool GoToPrev() {
@@ -284,7 +352,11 @@ class PlaylistPolicy : public Policy,
       crt_ = playlist_.size() - 1;
     }
     SaveState();
-    return element_->SwitchCurrentMedia(playlist_[crt_], NULL, true);
+    if ( !element_->SwitchCurrentMedia(playlist_[crt_], NULL, true) ) {
+      return false;
+    }
+    prefetcher_.Switched();
+    return true;
   }
   bool AddToPlay(const string& name) {
     for ( uint32 i = 0; i < playlist_.size(); ++i ) {
@@ -294,6 +366,9 @@ class PlaylistPolicy : public Policy,
           local_state_keeper_->SetValue("next_next_to_play",
               strutil::StringPrintf("%d", next_to_play_));
         }
+        if ( prefetcher_.announced() ) {
+          PrefetchNext();
+        }
         return true;
       }
     }
@@ -315,6 +390,11 @@ class PlaylistPolicy : public Policy,
   void GetPlaylist(PlaylistPolicySpec* playlist) const;
   void SetPlaylist(const PlaylistPolicySpec& playlist);
 
+  // Announces what GoToNext() would play to the element
+  void PrefetchNext() {
+    prefetcher_.AnnounceNext(playlist_, crt_, next_to_play_, loop_playlist_);
+  }
+
   const bool is_temp_policy_;
   io::StateKeepUser* const global_state_keeper_;
   io::StateKeepUser* const local_state_keeper_;
@@ -327,6 +407,7 @@ class PlaylistPolicy : public Policy,
   const string local_rpc_path_;
   rpc::HttpServer* const rpc_server_;
   bool is_registered_;
+  PlaylistPrefetcher prefetcher_;
 
   DISALLOW_EVIL_CONSTRUCTORS(PlaylistPolicy);
 };
@@ -365,8 +446,11 @@ class TimedPlaylistPolicy : public Policy {
         next_to_play_(-1),
         next_next_to_play_(-1),
         last_switch_time_(-1),
+        prefetcher_(element),
         alarm_callback_(NewPermanentCallback(
-                            this, &TimedPlaylistPolicy::Next)) {
+                            this, &TimedPlaylistPolicy::Next)),
+        prefetch_alarm_callback_(NewPermanentCallback(
+                            this, &TimedPlaylistPolicy::PrefetchNext)) {
     copy(playlist.begin(), playlist.end(), playlist_.begin());
   }
   virtual ~TimedPlaylistPolicy() {
@@ -377,6 +461,8 @@ class TimedPlaylistPolicy : public Policy {
     delete local_state_keeper_;
     selector_->UnregisterAlarm(alarm_callback_);
     delete alarm_callback_;
+    selector_->UnregisterAlarm(prefetch_alarm_callback_);
+    delete prefetch_alarm_callback_;
   }
   virtual bool Initialize() {
     LoadState();
@@ -461,6 +547,9 @@ class TimedPlaylistPolicy : public Policy {
           local_state_keeper_->SetValue("next_next_to_play",
               strutil::StringPrintf("%d", next_to_play_));
         }
+        if ( prefetcher_.announced() ) {
+          PrefetchNext();
+        }
         return true;
       }
     }
@@ -472,6 +561,12 @@ class TimedPlaylistPolicy : public Policy {
   void Next() {
     GoToNext();
   }
+  // Announces what GoToNext() would play to the element
+  void PrefetchNext() {
+    prefetcher_.AnnounceNext(playlist_, crt_, next_to_play_, loop_playlist_);
+  }
+  // Sets the alarms for the end of the current item (in delay_ms)
+  void ScheduleNext(int64 delay_ms);
   bool PlayCurrent() {
     bool success = element_->SwitchCurrentMedia(playlist_[crt_].second,
                                                 NULL,
@@ -485,11 +580,9 @@ class TimedPlaylistPolicy : public Policy {
     if ( last_switch_time_ > 0 && last_switch_time > last_switch_time_ ) {
       const int64 delta = (playlist_[crt_].first -
                            (last_switch_time - last_switch_time_));
-      selector_->RegisterAlarm(alarm_callback_,
-                                 max(static_cast<int64>(0), delta));
+      ScheduleNext(max(static_cast<int64>(0), delta));
     } else {
-      selector_->RegisterAlarm(alarm_callback_,
-                                 playlist_[crt_].first);
+      ScheduleNext(playlist_[crt_].first);
     }
     last_switch_time_ = last_switch_time;
     success = SaveState() && success;
@@ -510,7 +603,10 @@ class TimedPlaylistPolicy : public Policy {
   int next_to_play_;
   int next_next_to_play_;  // used just to save state..
   int64 last_switch_time_;
+  PlaylistPrefetcher prefetcher_;
   Closure* alarm_callback_;
+  // announces the next item, a little before alarm_callback_
+  Closure* prefetch_alarm_callback_;
 
   DISALLOW_EVIL_CONSTRUCTORS(TimedPlaylistPolicy);
 };
@@ -38,28 +38,22 @@ RedirectingElement::RedirectingElement(
     const string& name, ElementMapper* mapper,
     const map<string, string>& redirection)
   : Element(kElementClassName, name, mapper),
+    redirection_re_(),
     redirections_(),
     req_map_() {
   for ( map<string, string>::const_iterator it = redirection.begin();
         it != redirection.end(); ++it ) {
     const string& str_reg = it->first;
     const string& str_replace = it->second;
-    re::RE* re = new re::RE(str_reg);
-    if ( re->HasError() ) {
-      LOG_ERROR << name << ": Invalid reg exp: [" << str_reg << "]"
-                    ", error: " << re->ErrorName();
-      delete re;
+    if ( redirection_re_.Add(str_reg) < 0 ) {
+      LOG_ERROR << name << ": Invalid reg exp: [" << str_reg << "]";
       continue;
     }
-    redirections_.push_back(new Redirection(re, str_replace));
+    redirections_.push_back(str_replace);
   }
+  redirection_re_.Compile();
 }
 RedirectingElement::~RedirectingElement() {
-  for ( uint32 i = 0; i < redirections_.size(); i++ ) {
-    const Redirection* redir = redirections_[i];
-    delete redir;
-  }
-  redirections_.clear();
 }
 
 void RedirectingElement::ProcessTag(ReqStruct* rs,
@@ -98,18 +92,12 @@ bool RedirectingElement::Initialize() {
 bool RedirectingElement::AddRequest(const string& media, Request* req,
     ProcessingCallback* callback) {
   // find a suitable redirection according to the sub-path
-  const Redirection* redir = NULL;
-  for ( uint32 i = 0; i < redirections_.size(); i++ ) {
-    redir = redirections_[i];
-    if ( redir->re_->Matches(media) ) {
-      break;
-    }
-  }
-  // NOTE: redir may be NULL , for request that do not match any redirection
+  const int redir = redirection_re_.FirstMatch(media);
+  // NOTE: redir may be -1, for request that do not match any redirection
 
   // build the NEW sub-path
   static const string kStrEmpty;
-  const string& redir_path = (redir == NULL ? kStrEmpty : redir->value_);
+  const string& redir_path = (redir < 0 ? kStrEmpty : redirections_[redir]);
   const string media_new_path = strutil::JoinMedia(redir_path, media);
 
   // make a ReqStruct to remember this redirection
@@ -154,7 +142,7 @@ void RedirectingElement::RemoveRequest(streaming::Request* req) {
 }
 bool RedirectingElement::HasMedia(const string& media) {
   for ( uint32 i = 0; i < redirections_.size(); i++ ) {
-    const string crt_name = strutil::JoinMedia(redirections_[i]->value_, media);
+    const string crt_name = strutil::JoinMedia(redirections_[i], media);
     if ( mapper_->HasMedia(crt_name) ) {
       return true;
     }
@@ -165,7 +153,7 @@ void RedirectingElement::ListMedia(const string& media,
                                    vector<string>* out) {
   for ( int i = 0; i < redirections_.size(); ++i ) {
     vector<string> elements;
-    const string crt_name = strutil::JoinMedia(redirections_[i]->value_, media);
+    const string crt_name = strutil::JoinMedia(redirections_[i], media);
     mapper_->ListMedia(crt_name, &elements);
     for ( int j = 0; j < elements.size(); ++j ) {
       out->push_back(strutil::JoinMedia(name(), elements[i]));
@@ -177,7 +165,7 @@ bool RedirectingElement::DescribeMedia(const string& media,
   if ( redirections_.empty() ) {
     return false;
   }
-  const string new_media = strutil::JoinMedia(redirections_[0]->value_, media);
+  const string new_media = strutil::JoinMedia(redirections_[0], media);
   return mapper_->DescribeMedia(new_media, callback);
 }
 void RedirectingElement::Close(Closure* call_on_close) {
@@ -85,19 +85,10 @@ class RedirectingElement : public Element {
   virtual void Close(Closure* call_on_close);
 
  private:
-  struct Redirection {
-    re::RE* re_;
-    string value_;
-    Redirection(re::RE* re, const string& value)
-      : re_(re), value_(value) {
-    }
-    ~Redirection() {
-      delete re_;
-      re_ = NULL;
-    }
-  };
-  typedef vector<Redirection*> RedirectionArray;
-  RedirectionArray redirections_;
+  // all the expressions, matched in one pass; expression i redirects
+  // to redirections_[i]
+  re::RESet redirection_re_;
+  vector<string> redirections_;
 
   struct ReqStruct {
     // we get this callback from the mapper
@@ -55,10 +55,12 @@
 #include "elements/standard_library/policies/policy.h"
 #include "elements/standard_library/policies/failover_policy.h"
 #include "elements/standard_library/simple_authorizer/simple_authorizer.h"
+#include "elements/standard_library/token_authorizer/token_authorizer.h"
 #include "elements/standard_library/remote_resolver/remote_resolver_element.h"
 #include "elements/standard_library/lookup/lookup_element.h"
 #include "elements/standard_library/f4v_to_flv_converter/f4v_to_flv_converter_element.h"
 #include "elements/standard_library/redirect/redirecting_element.h"
+#include "elements/standard_library/timeshift/timeshift_element.h"
 
 #include "elements/standard_library/auto/standard_library_invokers.h"
 
@@ -115,6 +117,7 @@ void StandardLibrary::GetExportedElementTypes(vector<string>* element_types) {
   element_types->push_back(LookupElement::kElementClassName);
   element_types->push_back(F4vToFlvConverterElement::kElementClassName);
   element_types->push_back(RedirectingElement::kElementClassName);
+  element_types->push_back(TimeShiftElement::kElementClassName);
 }
 
 void StandardLibrary::GetExportedPolicyTypes(vector<string>* policy_types) {
@@ -127,6 +130,7 @@ void StandardLibrary::GetExportedPolicyTypes(vector<string>* policy_types) {
 
 void StandardLibrary::GetExportedAuthorizerTypes(vector<string>* auth_types) {
   auth_types->push_back(SimpleAuthorizer::kAuthorizerClassName);
+  auth_types->push_back(TokenAuthorizer::kAuthorizerClassName);
 }
 
 int64 StandardLibrary::GetElementNeeds(const string& element_type) {
@@ -162,7 +166,8 @@ int64 StandardLibrary::GetElementNeeds(const string& element_type) {
   } else if ( element_type == LookupElement::kElementClassName ) {
     return (NEED_SELECTOR);
   } else if ( element_type == LoadBalancingElement::kElementClassName ) {
-    return (NEED_SELECTOR);
+    return (NEED_SELECTOR |
+            NEED_RPC_SERVER);
   } else if ( element_type == SavingElement::kElementClassName ) {
     return (NEED_SELECTOR |
             NEED_MEDIA_DIR);
@@ -176,12 +181,27 @@ int64 StandardLibrary::GetElementNeeds(const string& element_type) {
     return (NEED_SELECTOR);
   } else if ( element_type == RedirectingElement::kElementClassName ) {
     return 0;
+  } else if ( element_type == TimeShiftElement::kElementClassName ) {
+    return (NEED_SELECTOR);
   }
   LOG_ERROR << "GetElementNeeds: Unknown element type: ["
             << element_type << "]";
   return 0;
 }
 
+bool StandardLibrary::IsLazyElementType(const string& element_type) {
+  // These just wait for requests (the others register upstream, record,
+  // or accept publishers from the start)
+  return (element_type == AioFileElement::kElementClassName ||
+          element_type == DroppingElement::kElementClassName ||
+          element_type == KeyFrameExtractorElement::kElementClassName ||
+          element_type == StreamRenamerElement::kElementClassName ||
+          element_type == NormalizingElement::kElementClassName ||
+          element_type == LookupElement::kElementClassName ||
+          element_type == F4vToFlvConverterElement::kElementClassName ||
+          element_type == RedirectingElement::kElementClassName);
+}
+
 int64 StandardLibrary::GetPolicyNeeds(const string& policy_type) {
   if ( policy_type == RandomPolicy::kPolicyClassName ) {
     return (NEED_SELECTOR |
@@ -276,6 +296,9 @@ streaming::Element* StandardLibrary::CreateElement(
   } else if ( element_type == RedirectingElement::kElementClassName ) {
     CREATE_ELEMENT_HELPER(Redirecting);
     return ret;
+  } else if ( element_type == TimeShiftElement::kElementClassName ) {
+    CREATE_ELEMENT_HELPER(TimeShift);
+    return ret;
   }
   LOG_ERROR << "Dunno to create element of type: '" << element_type << "'";
   return NULL;
@@ -322,6 +345,10 @@ streaming::Authorizer* StandardLibrary::CreateAuthorizer(
     CREATE_AUTHORIZER_HELPER(Simple);
     return ret;
   }
+  if ( authorizer_type == TokenAuthorizer::kAuthorizerClassName ) {
+    CREATE_AUTHORIZER_HELPER(Token);
+    return ret;
+  }
   return ret;
 }
 
@@ -751,7 +778,8 @@ streaming::Element* StandardLibrary::CreateKeyFrameExtractorElement(
       mapper_,
       params.selector_,
       spec.ms_between_video_frames_,
-      spec.drop_audio_);
+      spec.drop_audio_,
+      spec.share_upstream_.is_set() && spec.share_upstream_.get());
 }
 
 /////// StreamRenamer
@@ -815,10 +843,29 @@ streaming::Element* StandardLibrary::CreateLoadBalancingElement(
   for ( int i = 0; i < spec.sub_elements_.size(); ++i ) {
     sub_elements.push_back(spec.sub_elements_[i]);
   }
+  streaming::LoadBalancingElement::Strategy strategy =
+      streaming::LoadBalancingElement::ROUND_ROBIN;
+  if ( spec.strategy_.is_set() &&
+       !streaming::LoadBalancingElement::StrategyFromName(
+           spec.strategy_.get(), &strategy) ) {
+    *error = "Unknown load balancing strategy: " + spec.strategy_.get();
+    return NULL;
+  }
+  const int64 failure_penalty_ms =
+      spec.failure_penalty_ms_.is_set()
+      ? spec.failure_penalty_ms_ : 30000;
+  string rpc_path(name() + "/" + element_name + "/");
+  if ( req != NULL ) {
+    rpc_path += req->info().GetPathId() + "/";
+  }
   return new streaming::LoadBalancingElement(element_name,
                                              mapper_,
                                              params.selector_,
-                                             sub_elements);
+                                             rpc_path,
+                                             params.rpc_server_,
+                                             sub_elements,
+                                             strategy,
+                                             failure_penalty_ms);
 }
 
 /////// Saving
@@ -913,9 +960,11 @@ streaming::Element* StandardLibrary::CreateF4vToFlvConverterElement(
     vector<string>* needed_policies,
     bool is_temporary_template,
     string* error) {
-  return new streaming::F4vToFlvConverterElement(element_name,
-                                                 mapper_,
-                                                 params.selector_);
+  return new streaming::F4vToFlvConverterElement(
+      element_name,
+      mapper_,
+      params.selector_,
+      spec.share_upstream_.is_set() && spec.share_upstream_.get());
 }
 
 /////// Redirecting
@@ -933,6 +982,40 @@ streaming::Element* StandardLibrary::CreateRedirectingElement(
                                            spec.redirections_);
 }
 
+/////// TimeShift
+
+streaming::Element* StandardLibrary::CreateTimeShiftElement(
+    const string& element_name,
+    const TimeShiftElementSpec& spec,
+    const streaming::Request* req,
+    const CreationObjectParams& params,
+    vector<string>* needed_policies,
+    bool is_temporary_template,
+    string* error) {
+  if ( spec.media_name_.get().empty() ) {
+    *error = "Please specify the media to timeshift";
+    return NULL;
+  }
+  int64 buffer_ms = 10 * 60 * 1000;
+  if ( spec.buffer_ms_.is_set() ) {
+    buffer_ms = spec.buffer_ms_;
+  }
+  int64 max_buffer_size = 256 << 20;
+  if ( spec.max_buffer_size_.is_set() ) {
+    max_buffer_size = spec.max_buffer_size_;
+  }
+  if ( buffer_ms <= 0 || max_buffer_size <= 0 ) {
+    *error = "Invalid buffer limits";
+    return NULL;
+  }
+  return new streaming::TimeShiftElement(element_name,
+                                         mapper_,
+                                         params.selector_,
+                                         spec.media_name_.get(),
+                                         buffer_ms,
+                                         max_buffer_size);
+}
+
 
 //////////////////////////////////////////////////////////////////////
 //
@@ -1132,6 +1215,31 @@ streaming::Authorizer* StandardLibrary::CreateSimpleAuthorizer(
                               params.rpc_server_);
 }
 
+streaming::Authorizer* StandardLibrary::CreateTokenAuthorizer(
+    const string& auth_name,
+    const TokenAuthorizerSpec& spec,
+    const CreationObjectParams& params,
+    string* error) {
+  delete params.local_state_keeper_;
+  if ( spec.secret_.get().empty() ) {
+    *error = "A token authorizer needs a secret";
+    return NULL;
+  }
+  int32 time_limit_ms = 0;
+  if ( spec.time_limit_ms_.is_set() ) {
+    time_limit_ms = spec.time_limit_ms_;
+  }
+  const bool bind_to_user = (spec.bind_to_user_.is_set() &&
+                             spec.bind_to_user_.get());
+  const bool bind_to_ip = (spec.bind_to_ip_.is_set() &&
+                           spec.bind_to_ip_.get());
+  return new TokenAuthorizer(auth_name,
+                             spec.secret_.get(),
+                             time_limit_ms,
+                             bind_to_user,
+                             bind_to_ip);
+}
+
 //////////////////////////////////////////////////////////////////////
 
 class ServiceInvokerStandardLibraryServiceImpl
@@ -1290,6 +1398,14 @@ class ServiceInvokerStandardLibraryServiceImpl
       const RedirectingElementSpec& spec) {
     STANDARD_RPC_ELEMENT_ADD(Redirecting);
   }
+  virtual void AddTimeShiftElementSpec(
+      rpc::CallContext< MediaOpResult >* call,
+      const string& name,
+      bool is_global,
+      bool disable_rpc,
+      const TimeShiftElementSpec& spec) {
+    STANDARD_RPC_ELEMENT_ADD(TimeShift);
+  }
 
   /////
 
@@ -1329,6 +1445,12 @@ class ServiceInvokerStandardLibraryServiceImpl
       const SimpleAuthorizerSpec& spec) {
     STANDARD_RPC_AUTHORIZER_ADD(Simple);
   }
+  virtual void AddTokenAuthorizerSpec(
+      rpc::CallContext< MediaOpResult >* call,
+      const string& name,
+      const TokenAuthorizerSpec& spec) {
+    STANDARD_RPC_AUTHORIZER_ADD(Token);
+  }
   virtual void ResolveMedia(
       rpc::CallContext< ResolveSpec >* call,
       const string& media);
@@ -69,6 +69,9 @@ class StandardLibrary : public ElementLibrary {
   // to create an element of given type
   virtual int64 GetElementNeeds(const string& element_type);
 
+  // Returns true for the elements that can be created on first use
+  virtual bool IsLazyElementType(const string& element_type);
+
   // Returns a combination of Needs (OR-ed), for what is needed in order
   // to a policy  of given type
   virtual int64 GetPolicyNeeds(const string& element_type);
@@ -246,6 +249,14 @@ class StandardLibrary : public ElementLibrary {
                            vector<string>* needed_policies,
                            bool is_temporary_template,
                            string* error);
+  streaming::Element*
+  CreateTimeShiftElement(const string& name,
+                         const TimeShiftElementSpec& spec,
+                         const streaming::Request* req,
+                         const CreationObjectParams& params,
+                         vector<string>* needed_policies,
+                         bool is_temporary_template,
+                         string* error);
 
   // Helpers for element creating policies
 
@@ -292,6 +303,11 @@ class StandardLibrary : public ElementLibrary {
                          const SimpleAuthorizerSpec& spec,
                          const CreationObjectParams& params,
                          string* error);
+  streaming::Authorizer*
+  CreateTokenAuthorizer(const string& name,
+                        const TokenAuthorizerSpec& spec,
+                        const CreationObjectParams& params,
+                        string* error);
  private:
   ServiceInvokerStandardLibraryServiceImpl* rpc_impl_;
   DISALLOW_EVIL_CONSTRUCTORS(StandardLibrary);
@@ -56,6 +56,21 @@ DEFINE_int32(switching_max_write_ahead_ms,
              "We keep the stream in the switching element "
              "at most this much ahead of the real time");
 
+DEFINE_bool(switching_prefetch_media,
+            true,
+            "Open ahead of time the media a policy announces it will "
+            "switch to next (buffering it up to its first keyframe)");
+
+DEFINE_int32(switching_prefetch_max_ms,
+             2000,
+             "When prefetching, we stop waiting for a video keyframe "
+             "after this much media (e.g. for audio only streams)");
+
+DEFINE_int32(switching_prefetch_max_size,
+             4 << 20,
+             "We give up a prefetch that buffers more than these many bytes "
+             "(e.g. for upstream elements that cannot pause)");
+
 namespace streaming {
 
 const char SwitchingElement::kElementClassName[] = "switching";
@@ -91,12 +106,17 @@ SwitchingElement::SwitchingElement(const string& _name,
       is_global_(is_global),
       is_temporary_template_(is_temporary_template),
       normalizer_(selector, FLAGS_switching_max_write_ahead_ms),
-      process_tag_callback_(
-          NewPermanentCallback(this, &SwitchingElement::ProcessTag)),
+      req_callback_(NULL),
+      prefetch_req_(NULL),
+      prefetch_callback_(NULL),
+      prefetch_size_(0),
+      prefetch_ready_(false),
+      prefetch_paused_(false),
       tag_timeout_alarm_(*selector),
       last_tag_timeout_registration_time_(0),
       register_alarm_(*selector),
       stream_ended_alarm_(*selector),
+      prefetch_cancel_alarm_(*selector),
       close_completed_(NULL) {
   for ( uint32 i = 0; i < NUMBEROF(distributors_); i++ ) {
     if ( caps_.flavour_mask_ & (1 << i) ) {
@@ -116,18 +136,20 @@ SwitchingElement::SwitchingElement(const string& _name,
   stream_ended_alarm_.Set(
       NewPermanentCallback(this, &SwitchingElement::StreamEnded),
       true, 0, false, false);
+  // prepare CancelPrefetch alarm. Don't start it.
+  prefetch_cancel_alarm_.Set(
+      NewPermanentCallback(this, &SwitchingElement::CancelPrefetch),
+      true, 0, false, false);
 }
 
 // DOES: nothing important, just free resources.
 SwitchingElement::~SwitchingElement() {
   CHECK(!is_registered()) << "name: " << name();
+  CHECK_NULL(prefetch_req_) << "name: " << name();
   if ( rpc_server_ != NULL ) {
     rpc_server_->UnregisterService(rpc_path_, this);
   }
 
-  delete process_tag_callback_;
-  process_tag_callback_ = NULL;
-
   for ( int i = 0; i < NUMBEROF(distributors_); ++i ) {
     // A previous Close() should have cleaned everything
     if ( distributors_[i] != NULL ) {
@@ -160,30 +182,27 @@ void SwitchingElement::Register(string media_name) {
   }
   CHECK(!is_registered()) << " Double register";
 
-  ILOG_DEBUG << "Registering to: [" << media_name << "]";
-  URL crt_url(string("http://x/") + media_name);
-  req_ = new streaming::Request(crt_url);
-  if ( req_info_ != NULL ) {
-    *req_->mutable_info() = *req_info_;
+  if ( PromotePrefetch(media_name) ) {
+    return;
   }
-  *req_->mutable_caps() = caps_;
-  req_->mutable_info()->is_temporary_requestor_ = !is_global_;
 
-  if (req_->info().write_ahead_ms_ <= 0 ) {
-    req_->mutable_info()->write_ahead_ms_ =
-        FLAGS_switching_default_write_ahead_ms;
-  }
+  ILOG_DEBUG << "Registering to: [" << media_name << "]";
+  req_ = NewUpstreamRequest(media_name);
+  req_callback_ = NewPermanentCallback(
+      this, &SwitchingElement::ProcessUpstreamTag, req_);
 
   normalizer_.Reset(req_);
 
   if ( !mapper_->AddRequest(req_->info().path_,
-                            req_, process_tag_callback_) ) {
+                            req_, req_callback_) ) {
     ILOG_ERROR << "Failed to register to: [" << media_name << "]";
     // Clear internals, so we end up in a valid state
     current_media_ = "";
     normalizer_.Reset(NULL);
     delete req_;
     req_ = NULL;
+    delete req_callback_;
+    req_callback_ = NULL;
     delete req_info_;
     req_info_ = NULL;
     return;
@@ -196,6 +215,23 @@ void SwitchingElement::Register(string media_name) {
   return;
 }
 
+streaming::Request* SwitchingElement::NewUpstreamRequest(
+    const string& media_name) const {
+  URL crt_url(string("http://x/") + media_name);
+  streaming::Request* req = new streaming::Request(crt_url);
+  if ( req_info_ != NULL ) {
+    *req->mutable_info() = *req_info_;
+  }
+  *req->mutable_caps() = caps_;
+  req->mutable_info()->is_temporary_requestor_ = !is_global_;
+
+  if ( req->info().write_ahead_ms_ <= 0 ) {
+    req->mutable_info()->write_ahead_ms_ =
+        FLAGS_switching_default_write_ahead_ms;
+  }
+  return req;
+}
+
 // DOES: RemoveRequest upstream, maybe send SourceEnded downstream
 void SwitchingElement::Unregister(bool send_source_ended) {
   tag_timeout_alarm_.Stop();
@@ -207,13 +243,16 @@ void SwitchingElement::Unregister(bool send_source_ended) {
 
   streaming::Request* req = req_;
   req_ = NULL;
+  streaming::ProcessingCallback* req_callback = req_callback_;
+  req_callback_ = NULL;
   normalizer_.Reset(NULL);
 
   delete req_info_;
   req_info_ = NULL;
 
   current_media_ = "";
-  mapper_->RemoveRequest(req, process_tag_callback_);
+  mapper_->RemoveRequest(req, req_callback);
+  selector_->DeleteInSelectLoop(req_callback);
 
   // send the end stream tags to the clients
   // which were compatible with the upstream flavour
@@ -258,8 +297,10 @@ bool SwitchingElement::SwitchCurrentMedia(const string& target_media_name,
     return true;
   }
   CHECK_GE(selector_->now(), register_alarm_.last_fire_ts());
-  int64 delay_register = max((int64)0LL, kRegisterMinIntervalMs -
-      (selector_->now() - register_alarm_.last_fire_ts()));
+  // A prefetched media already proved it plays, no reason to wait
+  int64 delay_register = is_prefetch_ready(target_media_name) ? 0 :
+      max((int64)0LL, kRegisterMinIntervalMs -
+          (selector_->now() - register_alarm_.last_fire_ts()));
   register_alarm_.Set(NewPermanentCallback(this,
       &SwitchingElement::Register, target_media_name),
       true, delay_register, false, true);
@@ -328,6 +369,145 @@ void SwitchingElement::ProcessTag(const Tag* tag, int64 timestamp_ms) {
   }
 }
 
+void SwitchingElement::ProcessUpstreamTag(streaming::Request* req,
+                                          const Tag* tag,
+                                          int64 timestamp_ms) {
+  if ( req == req_ ) {
+    ProcessTag(tag, timestamp_ms);
+  } else if ( req == prefetch_req_ ) {
+    PrefetchTag(tag, timestamp_ms);
+  }
+}
+
+// DOES: buffer tag, pause upstream once we have a keyframe
+void SwitchingElement::PrefetchTag(const Tag* tag, int64 timestamp_ms) {
+  if ( prefetch_cancel_alarm_.IsStarted() ) {
+    return;
+  }
+  prefetch_tags_.push_back(make_pair(scoped_ref<const Tag>(tag),
+                                     timestamp_ms));
+  prefetch_size_ += tag->size();
+  if ( prefetch_size_ > FLAGS_switching_prefetch_max_size ) {
+    ILOG_WARNING << "Prefetch of [" << prefetch_media_ << "] buffered "
+                 << prefetch_size_ << " bytes, giving up on it";
+    // not while upstream is calling us
+    prefetch_cancel_alarm_.Start();
+    return;
+  }
+  if ( prefetch_ready_ ) {
+    return;
+  }
+  if ( (tag->is_video_tag() && tag->can_resync()) ||
+       tag->type() == streaming::Tag::TYPE_EOS ||
+       timestamp_ms - prefetch_tags_.front().second >=
+           FLAGS_switching_prefetch_max_ms ) {
+    ILOG_DEBUG << "Prefetch of [" << prefetch_media_ << "] ready, "
+               << prefetch_tags_.size() << " tags, "
+               << prefetch_size_ << " bytes";
+    prefetch_ready_ = true;
+    // Hold the upstream until we switch to it. Pausing is counted, so
+    // this does not interfere w/ the flow control of the normalizer.
+    streaming::ElementController* controller = prefetch_req_->controller();
+    if ( controller != NULL && controller->SupportsPause() ) {
+      controller->Pause(true);
+      prefetch_paused_ = true;
+    }
+  }
+}
+
+// DOES: AddRequest upstream for the next media
+void SwitchingElement::PrefetchMedia(const string& media_name) {
+  if ( !FLAGS_switching_prefetch_media || is_temporary_template_ ||
+       close_completed_ != NULL ) {
+    return;
+  }
+  if ( prefetch_req_ != NULL && prefetch_media_ == media_name ) {
+    return;
+  }
+  CancelPrefetch();
+  if ( media_name.empty() || media_name == current_media_ ) {
+    return;
+  }
+  if ( media_only_when_used_ && CountClients() == 0 ) {
+    // nobody to play it for - we will register it when needed
+    return;
+  }
+
+  ILOG_DEBUG << "Prefetching: [" << media_name << "]";
+  prefetch_media_ = media_name;
+  prefetch_req_ = NewUpstreamRequest(media_name);
+  prefetch_callback_ = NewPermanentCallback(
+      this, &SwitchingElement::ProcessUpstreamTag, prefetch_req_);
+  if ( !mapper_->AddRequest(prefetch_req_->info().path_,
+                            prefetch_req_, prefetch_callback_) ) {
+    ILOG_WARNING << "Failed to prefetch: [" << media_name << "]";
+    prefetch_media_ = "";
+    delete prefetch_req_;
+    prefetch_req_ = NULL;
+    delete prefetch_callback_;
+    prefetch_callback_ = NULL;
+    prefetch_tags_.clear();
+    prefetch_size_ = 0;
+    prefetch_ready_ = false;
+  }
+}
+
+// DOES: the prefetched request becomes req_, send buffered tags downstream
+bool SwitchingElement::PromotePrefetch(const string& media_name) {
+  if ( prefetch_req_ == NULL || prefetch_media_ != media_name ||
+       prefetch_cancel_alarm_.IsStarted() ) {
+    return false;
+  }
+  ILOG_INFO << "Registering to prefetched: [" << media_name << "], "
+            << prefetch_tags_.size() << " tags buffered";
+  req_ = prefetch_req_;
+  req_callback_ = prefetch_callback_;
+  prefetch_req_ = NULL;
+  prefetch_callback_ = NULL;
+  prefetch_media_ = "";
+  current_media_ = media_name;
+
+  normalizer_.Reset(req_);
+  MaybeReregisterTagTimeout(true);
+
+  TagQueue tags;
+  tags.swap(prefetch_tags_);
+  prefetch_size_ = 0;
+  prefetch_ready_ = false;
+  streaming::Request* const req = req_;
+  for ( uint32 i = 0; i < tags.size() && req_ == req; ++i ) {
+    ProcessTag(tags[i].first.get(), tags[i].second);
+  }
+  if ( prefetch_paused_ ) {
+    prefetch_paused_ = false;
+    streaming::ElementController* controller = req->controller();
+    if ( req_ == req && controller != NULL ) {
+      controller->Pause(false);
+    }
+  }
+  return true;
+}
+
+// DOES: RemoveRequest upstream for the prefetched media
+void SwitchingElement::CancelPrefetch() {
+  prefetch_cancel_alarm_.Stop();
+  prefetch_tags_.clear();
+  prefetch_size_ = 0;
+  prefetch_ready_ = false;
+  prefetch_paused_ = false;
+  if ( prefetch_req_ == NULL ) {
+    return;
+  }
+  ILOG_DEBUG << "Dropping prefetched: [" << prefetch_media_ << "]";
+  streaming::Request* req = prefetch_req_;
+  prefetch_req_ = NULL;
+  streaming::ProcessingCallback* callback = prefetch_callback_;
+  prefetch_callback_ = NULL;
+  prefetch_media_ = "";
+  mapper_->RemoveRequest(req, callback);
+  selector_->DeleteInSelectLoop(callback);
+}
+
 // DOES: Send SourceEnded on behalf of upstream elements,
 //       RemoveRequest + AddRequest upstream
 void SwitchingElement::StreamEnded() {
@@ -409,6 +589,7 @@ void SwitchingElement::RemoveRequest(streaming::Request* req) {
               << " per empty request set.";
     media_name_to_register_ = current_media_;
     Unregister(true);
+    CancelPrefetch();
     if ( policy_ != NULL && !selector_->IsExiting() ) {
       policy_->Reset();
     }
@@ -445,6 +626,7 @@ void SwitchingElement::Close(Closure* call_on_close) {
 // DOES: send SourceEnded + EOS downstream, RemoveRequest upstream
 void SwitchingElement::InternalClose() {
   Unregister(true);
+  CancelPrefetch();
   CloseAllClients(true);
 }
 
@@ -35,6 +35,7 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 #include <whisperlib/common/base/types.h>
 #include <whisperlib/common/base/alarm.h>
 #include <whisperlib/net/base/selector.h>
@@ -122,6 +123,9 @@ class SwitchingElement :
   virtual const string& current_media() const {
     return current_media_;
   }
+  // Opens media_name upstream and buffers it up to its first keyframe,
+  // so switching to it later does not wait for the upstream to start.
+  virtual void PrefetchMedia(const string& media_name);
 
   ////////////////////////////////////////////////////////////////////
   // ServiceInvokerSwitchingElementService interface methods
@@ -139,6 +143,10 @@ class SwitchingElement :
   // callbacks
   void ProcessTag(const Tag* tag, int64 timestamp_ms);
 
+  // Processing function for the prefetched media - just buffers the tags
+  // until we switch to it
+  void PrefetchTag(const Tag* tag, int64 timestamp_ms);
+
   // We call this internally when the current element signals sends us an EOS.
   void StreamEnded();
 
@@ -166,6 +174,25 @@ class SwitchingElement :
   // too recently).
   void MaybeReregisterTagTimeout(bool force);
 
+  // Creates the request we use to register upstream to media_name.
+  streaming::Request* NewUpstreamRequest(const string& media_name) const;
+
+  // Upstream callbacks are bound to their request, as a prefetched
+  // request becomes the current one w/o registering it again.
+  void ProcessUpstreamTag(streaming::Request* req,
+                          const Tag* tag, int64 timestamp_ms);
+
+  // Makes the prefetched request the current one, and plays what
+  // we buffered for it. Returns false if media_name was not prefetched.
+  bool PromotePrefetch(const string& media_name);
+  // Removes the prefetch upstream link and drops its buffered tags.
+  void CancelPrefetch();
+  // True if we can switch to the prefetched media w/o waiting for it.
+  bool is_prefetch_ready(const string& media_name) const {
+    return prefetch_req_ != NULL && prefetch_ready_ &&
+           prefetch_media_ == media_name;
+  }
+
  protected:
   // We use this caps as defaults when we register ourselves..
   const streaming::Capabilities caps_;
@@ -199,8 +226,22 @@ class SwitchingElement :
   // tag normalizer for the input of the switching element
   streaming::TagNormalizer normalizer_;
 
-  // permanent callback to ProcessTag(..)
-  streaming::ProcessingCallback* process_tag_callback_;
+  // the callback we registered req_ with (to ProcessTag(..))
+  streaming::ProcessingCallback* req_callback_;
+
+  // The next media announced by the policy, opened ahead of time:
+  string prefetch_media_;
+  streaming::Request* prefetch_req_;
+  // the callback we registered prefetch_req_ with (to PrefetchTag(..))
+  streaming::ProcessingCallback* prefetch_callback_;
+  // what we received on prefetch_req_ so far
+  typedef vector< pair<scoped_ref<const Tag>, int64> > TagQueue;
+  TagQueue prefetch_tags_;
+  int64 prefetch_size_;
+  // we have the first keyframe of the prefetched media
+  bool prefetch_ready_;
+  // we paused the prefetched media upstream (waiting for the switch)
+  bool prefetch_paused_;
 
   // Tag timeout alarm
   util::Alarm tag_timeout_alarm_;
@@ -216,6 +257,8 @@ class SwitchingElement :
   util::Alarm register_alarm_;
   // Separate StreamEnded() call context
   util::Alarm stream_ended_alarm_;
+  // Separate CancelPrefetch() call context
+  util::Alarm prefetch_cancel_alarm_;
 
   // external closure, used to signal that asynchronous Close(..) completed
   Closure* close_completed_;
@@ -0,0 +1,363 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <map>
+#include <set>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/strutil.h>
+#include <whisperlib/common/base/callback.h>
+#include "elements/standard_library/load_balancing/load_balancing_element.h"
+
+using namespace streaming;
+
+namespace {
+
+// Routes nothing: records where the load balancer sends each request, and
+// refuses the requests for the sub elements in refuse_.
+class TestMapper : public ElementMapper {
+ public:
+  TestMapper() : ElementMapper(NULL) {}
+  virtual ~TestMapper() {
+    CHECK(added_.empty());
+  }
+  virtual bool AddRequest(const string& media, Request* req,
+                          ProcessingCallback* callback) {
+    const string sub = strutil::SplitFirst(media.c_str(), '/').first;
+    if ( refuse_.find(sub) != refuse_.end() ) {
+      return false;
+    }
+    CHECK(added_.find(req) == added_.end());
+    added_[req] = make_pair(media, callback);
+    return true;
+  }
+  virtual void RemoveRequest(Request* req, ProcessingCallback* callback) {
+    const AddedMap::iterator it = added_.find(req);
+    CHECK(it != added_.end());
+    CHECK(it->second.second == callback);
+    added_.erase(it);
+  }
+  virtual void GetMediaDetails(const string& protocol, const string& path,
+                               Request* req,
+                               Callback1<bool>* completion_callback) {
+  }
+  virtual Authorizer* GetAuthorizer(const string& name) { return NULL; }
+  virtual bool HasMedia(const string& media) { return true; }
+  virtual void ListMedia(const string& media_dir, vector<string>* out) {}
+  virtual bool GetElementByName(const string& name, Element** element,
+                                vector<Policy*>** policies) {
+    return false;
+  }
+  virtual void GetAllElements(vector<string>* out_elements) const {}
+  virtual bool IsKnownElementName(const string& name) { return false; }
+  virtual bool GetMediaAlias(const string& alias_name,
+                             string* media_name) const {
+    return false;
+  }
+  virtual string TranslateMedia(const string& media) const { return media; }
+  virtual bool DescribeMedia(const string& media,
+                             MediaInfoCallback* callback) {
+    return false;
+  }
+  virtual int32 AddExportClient(const string& protocol,
+                                const string& export_path) {
+    return 0;
+  }
+  virtual void RemoveExportClient(const string& protocol,
+                                  const string& export_path) {}
+  virtual bool AddImporter(Importer* importer) { return false; }
+  virtual void RemoveImporter(Importer* importer) {}
+  virtual Importer* GetImporter(Importer::Type importer_type,
+                                const string& path) {
+    return NULL;
+  }
+
+  // Where req went
+  string GetMedia(Request* req) const {
+    const AddedMap::const_iterator it = added_.find(req);
+    CHECK(it != added_.end());
+    return it->second.first;
+  }
+  // The sub element req went to
+  string GetSubElement(Request* req) const {
+    return strutil::SplitFirst(GetMedia(req).c_str(), '/').first;
+  }
+  void set_refuse(const string& sub, bool refuse) {
+    if ( refuse ) {
+      refuse_.insert(sub);
+    } else {
+      refuse_.erase(sub);
+    }
+  }
+
+ private:
+  typedef map<Request*, pair<string, ProcessingCallback*> > AddedMap;
+  AddedMap added_;
+  set<string> refuse_;
+};
+
+void IgnoreTag(const Tag* tag, int64 timestamp_ms) {
+}
+
+// Requests through a load balancing element
+class Clients {
+ public:
+  explicit Clients(LoadBalancingElement* element)
+      : element_(element),
+        callback_(NewPermanentCallback(&IgnoreTag)) {
+  }
+  ~Clients() {
+    while ( !reqs_.empty() ) {
+      Remove(0);
+    }
+    delete callback_;
+  }
+  int size() const { return reqs_.size(); }
+  Request* req(int i) const { return reqs_[i]; }
+
+  // Returns the index of the new request, -1 if refused
+  int Add(const string& media) {
+    Request* const req = new Request();
+    if ( !element_->AddRequest(media, req, callback_) ) {
+      delete req;
+      return -1;
+    }
+    reqs_.push_back(req);
+    return reqs_.size() - 1;
+  }
+  void Remove(int i) {
+    element_->RemoveRequest(reqs_[i]);
+    delete reqs_[i];
+    reqs_.erase(reqs_.begin() + i);
+  }
+
+ private:
+  LoadBalancingElement* const element_;
+  ProcessingCallback* const callback_;
+  vector<Request*> reqs_;
+};
+
+vector<string> SubElements() {
+  vector<string> sub_elements;
+  sub_elements.push_back("a");
+  sub_elements.push_back("b");
+  sub_elements.push_back("c");
+  return sub_elements;
+}
+
+const LoadBalancingSubElementStats& GetSubStats(
+    const LoadBalancingStats& stats, const string& name) {
+  const vector<LoadBalancingSubElementStats>& subs = stats.sub_elements_;
+  for ( int i = 0; i < subs.size(); ++i ) {
+    if ( subs[i].name_.get() == name ) {
+      return subs[i];
+    }
+  }
+  LOG_FATAL << "No stats for: " << name;
+  return subs[0];
+}
+
+void TestRoundRobin() {
+  TestMapper mapper;
+  LoadBalancingElement element("lb", &mapper, NULL, "", NULL, SubElements(),
+                               LoadBalancingElement::ROUND_ROBIN, 30000);
+  CHECK(element.Initialize());
+  {
+    Clients clients(&element);
+    for ( int i = 0; i < 6; ++i ) {
+      CHECK_EQ(clients.Add("live"), i);
+      CHECK_EQ(mapper.GetMedia(clients.req(i)),
+               SubElements()[i % 3] + "/live");
+    }
+    // a refusal falls through to the next one
+    mapper.set_refuse("a", true);
+    CHECK_EQ(clients.Add("live"), 6);
+    CHECK_EQ(mapper.GetSubElement(clients.req(6)), "b");
+
+    LoadBalancingStats stats;
+    element.GetStats(&stats);
+    CHECK_EQ(stats.strategy_.get(), "ROUND_ROBIN");
+    CHECK_EQ(stats.num_decisions_.get(), 7);
+    CHECK_EQ(stats.num_fallbacks_.get(), 1);
+    CHECK_EQ(stats.num_rejected_.get(), 0);
+    CHECK_EQ(GetSubStats(stats, "a").num_selected_.get(), 2);
+    CHECK_EQ(GetSubStats(stats, "a").num_failures_.get(), 1);
+    CHECK(!GetSubStats(stats, "a").healthy_.get());
+    CHECK_EQ(GetSubStats(stats, "b").num_selected_.get(), 3);
+    CHECK_EQ(GetSubStats(stats, "b").active_requests_.get(), 3);
+    CHECK(GetSubStats(stats, "b").healthy_.get());
+
+    // nobody takes it
+    mapper.set_refuse("b", true);
+    mapper.set_refuse("c", true);
+    CHECK_EQ(clients.Add("live"), -1);
+    element.GetStats(&stats);
+    CHECK_EQ(stats.num_rejected_.get(), 1);
+    CHECK_EQ(stats.num_decisions_.get(), 7);
+  }
+  // the active counts follow the removed requests
+  LoadBalancingStats stats;
+  element.GetStats(&stats);
+  CHECK_EQ(GetSubStats(stats, "a").active_requests_.get(), 0);
+  CHECK_EQ(GetSubStats(stats, "b").active_requests_.get(), 0);
+  CHECK_EQ(GetSubStats(stats, "c").active_requests_.get(), 0);
+  LOG_INFO << "TestRoundRobin OK";
+}
+
+void TestConsistentHash() {
+  TestMapper mapper;
+  LoadBalancingElement element("lb", &mapper, NULL, "", NULL, SubElements(),
+                               LoadBalancingElement::CONSISTENT_HASH, 30000);
+  CHECK(element.Initialize());
+  Clients clients(&element);
+  // the same media sticks to the same sub element
+  map<string, string> chosen;
+  set<string> used;
+  for ( int i = 0; i < 60; ++i ) {
+    const string media = strutil::StringPrintf("channel%d", i % 30);
+    const int r = clients.Add(media);
+    CHECK_GE(r, 0);
+    const string sub = mapper.GetSubElement(clients.req(r));
+    if ( chosen.find(media) == chosen.end() ) {
+      chosen[media] = sub;
+    }
+    CHECK_EQ(chosen[media], sub) << media;
+    used.insert(sub);
+  }
+  // .. and they spread
+  CHECK_EQ(used.size(), 3);
+
+  // when a sub element refuses, only its media move
+  mapper.set_refuse("a", true);
+  for ( map<string, string>::const_iterator it = chosen.begin();
+        it != chosen.end(); ++it ) {
+    const int r = clients.Add(it->first);
+    CHECK_GE(r, 0);
+    const string sub = mapper.GetSubElement(clients.req(r));
+    if ( it->second == "a" ) {
+      CHECK_NE(sub, "a");
+    } else {
+      CHECK_EQ(sub, it->second) << it->first;
+    }
+  }
+  LoadBalancingStats stats;
+  element.GetStats(&stats);
+  CHECK_EQ(stats.num_decisions_.get(), 90);
+  CHECK_EQ(stats.num_fallbacks_.get(),
+           GetSubStats(stats, "a").num_failures_.get());
+  CHECK_GT(stats.num_fallbacks_.get(), 0);
+  LOG_INFO << "TestConsistentHash OK";
+}
+
+void TestLeastActive() {
+  TestMapper mapper;
+  LoadBalancingElement element("lb", &mapper, NULL, "", NULL, SubElements(),
+                               LoadBalancingElement::LEAST_ACTIVE, 30000);
+  CHECK(element.Initialize());
+  Clients clients(&element);
+  for ( int i = 0; i < 3; ++i ) {
+    CHECK_EQ(clients.Add("live"), i);
+  }
+  // one on each; free the one on b - the next two go to b, then spread
+  for ( int i = 0; i < clients.size(); ++i ) {
+    if ( mapper.GetSubElement(clients.req(i)) == "b" ) {
+      clients.Remove(i);
+      break;
+    }
+  }
+  const int r = clients.Add("live");
+  CHECK_EQ(mapper.GetSubElement(clients.req(r)), "b");
+  // all equal now: the next ones go one on each
+  set<string> subs;
+  for ( int i = 0; i < 3; ++i ) {
+    subs.insert(mapper.GetSubElement(clients.req(clients.Add("live"))));
+  }
+  CHECK_EQ(subs.size(), 3);
+  LoadBalancingStats stats;
+  element.GetStats(&stats);
+  CHECK_EQ(GetSubStats(stats, "a").active_requests_.get(), 2);
+  CHECK_EQ(GetSubStats(stats, "b").active_requests_.get(), 2);
+  CHECK_EQ(GetSubStats(stats, "c").active_requests_.get(), 2);
+  CHECK_EQ(GetSubStats(stats, "b").num_selected_.get(), 3);
+  LOG_INFO << "TestLeastActive OK";
+}
+
+void TestHealthWeighted() {
+  TestMapper mapper;
+  LoadBalancingElement element("lb", &mapper, NULL, "", NULL, SubElements(),
+                               LoadBalancingElement::HEALTH_WEIGHTED, 200);
+  CHECK(element.Initialize());
+  Clients clients(&element);
+  // b fails once ..
+  mapper.set_refuse("b", true);
+  CHECK_EQ(mapper.GetSubElement(clients.req(clients.Add("live"))), "a");
+  CHECK_EQ(mapper.GetSubElement(clients.req(clients.Add("live"))), "c");
+  mapper.set_refuse("b", false);
+  // .. so it is skipped (while in penalty), although it works again
+  for ( int i = 0; i < 6; ++i ) {
+    CHECK_NE(mapper.GetSubElement(clients.req(clients.Add("live"))), "b");
+  }
+  LoadBalancingStats stats;
+  element.GetStats(&stats);
+  CHECK(!GetSubStats(stats, "b").healthy_.get());
+  CHECK_EQ(GetSubStats(stats, "b").num_failures_.get(), 1);
+  CHECK_EQ(GetSubStats(stats, "b").num_selected_.get(), 0);
+  // .. unless nobody else works
+  mapper.set_refuse("a", true);
+  mapper.set_refuse("c", true);
+  CHECK_EQ(mapper.GetSubElement(clients.req(clients.Add("live"))), "b");
+  mapper.set_refuse("a", false);
+  mapper.set_refuse("c", false);
+
+  // after the penalty it is back in turn
+  ::usleep(300000);
+  element.GetStats(&stats);
+  CHECK(GetSubStats(stats, "b").healthy_.get());
+  set<string> subs;
+  for ( int i = 0; i < 3; ++i ) {
+    subs.insert(mapper.GetSubElement(clients.req(clients.Add("live"))));
+  }
+  CHECK_EQ(subs.size(), 3);
+  LOG_INFO << "TestHealthWeighted OK";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestRoundRobin();
+  TestConsistentHash();
+  TestLeastActive();
+  TestHealthWeighted();
+  LOG_INFO << "PASS";
+  return 0;
+}
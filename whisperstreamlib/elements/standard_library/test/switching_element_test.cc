@@ -0,0 +1,490 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <map>
+#include <vector>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/strutil.h>
+#include <whisperlib/common/base/gflags.h>
+#include <whisperlib/common/base/callback.h>
+#include <whisperlib/net/base/selector.h>
+#include <whisperstreamlib/base/test/test_tag.h>
+#include "elements/standard_library/switching/switching_element.h"
+
+DECLARE_int32(switching_prefetch_max_size);
+
+using namespace streaming;
+
+namespace {
+
+// Counts how many times the upstream media was paused
+class TestController : public ElementController {
+ public:
+  TestController() : paused_(0) {}
+  virtual bool SupportsPause() const { return true; }
+  virtual bool Pause(bool pause) {
+    paused_ += pause ? 1 : -1;
+    CHECK_GE(paused_, 0);
+    return true;
+  }
+  int paused() const { return paused_; }
+ private:
+  int paused_;
+  DISALLOW_EVIL_CONSTRUCTORS(TestController);
+};
+
+// Stands for the upstream elements: keeps the requests the switching
+// element makes, and sends tags on them on demand.
+class TestMapper : public ElementMapper {
+ public:
+  explicit TestMapper(net::Selector* selector)
+      : ElementMapper(selector), selector_(selector), adds_(0) {}
+  virtual ~TestMapper() {
+    CHECK(upstream_.empty());
+    for ( ControllerMap::iterator it = controllers_.begin();
+          it != controllers_.end(); ++it ) {
+      delete it->second;
+    }
+  }
+  virtual bool AddRequest(const string& media, Request* req,
+                          ProcessingCallback* callback) {
+    CHECK(upstream_.find(media) == upstream_.end()) << media;
+    upstream_[media] = make_pair(req, callback);
+    if ( controllers_.find(media) == controllers_.end() ) {
+      controllers_[media] = new TestController();
+    }
+    req->set_controller(controllers_[media]);
+    ++adds_;
+    return true;
+  }
+  virtual void RemoveRequest(Request* req, ProcessingCallback* callback) {
+    for ( UpstreamMap::iterator it = upstream_.begin();
+          it != upstream_.end(); ++it ) {
+      if ( it->second.first == req ) {
+        CHECK(it->second.second == callback);
+        upstream_.erase(it);
+        // the caller may still look at it in this call
+        selector_->DeleteInSelectLoop(req);
+        return;
+      }
+    }
+    LOG_FATAL << "Unknown request: " << req;
+  }
+  virtual void GetMediaDetails(const string& protocol, const string& path,
+                               Request* req,
+                               Callback1<bool>* completion_callback) {
+  }
+  virtual Authorizer* GetAuthorizer(const string& name) { return NULL; }
+  virtual bool HasMedia(const string& media) { return true; }
+  virtual void ListMedia(const string& media_dir, vector<string>* out) {}
+  virtual bool GetElementByName(const string& name, Element** element,
+                                vector<Policy*>** policies) {
+    return false;
+  }
+  virtual void GetAllElements(vector<string>* out_elements) const {}
+  virtual bool IsKnownElementName(const string& name) { return false; }
+  virtual bool GetMediaAlias(const string& alias_name,
+                             string* media_name) const {
+    return false;
+  }
+  virtual string TranslateMedia(const string& media) const { return media; }
+  virtual bool DescribeMedia(const string& media,
+                             MediaInfoCallback* callback) {
+    return false;
+  }
+  virtual int32 AddExportClient(const string& protocol,
+                                const string& export_path) {
+    return 0;
+  }
+  virtual void RemoveExportClient(const string& protocol,
+                                  const string& export_path) {}
+  virtual bool AddImporter(Importer* importer) { return false; }
+  virtual void RemoveImporter(Importer* importer) {}
+  virtual Importer* GetImporter(Importer::Type importer_type,
+                                const string& path) {
+    return NULL;
+  }
+
+  bool empty() const { return upstream_.empty(); }
+  bool HasUpstream(const string& media) const {
+    return upstream_.find(media) != upstream_.end();
+  }
+  // How many times an upstream request was added
+  int adds() const { return adds_; }
+  int paused(const string& media) const {
+    const ControllerMap::const_iterator it = controllers_.find(media);
+    CHECK(it != controllers_.end()) << media;
+    return it->second->paused();
+  }
+  // Sends a tag from the upstream media
+  void Send(const string& media, const Tag* tag, int64 timestamp_ms) {
+    const UpstreamMap::iterator it = upstream_.find(media);
+    CHECK(it != upstream_.end()) << media;
+    scoped_ref<const Tag> ref(tag);
+    it->second.second->Run(tag, timestamp_ms);
+  }
+
+ private:
+  net::Selector* const selector_;
+  typedef map<string, pair<Request*, ProcessingCallback*> > UpstreamMap;
+  UpstreamMap upstream_;
+  typedef map<string, TestController*> ControllerMap;
+  ControllerMap controllers_;
+  int adds_;
+};
+
+const uint32 kAudio = Tag::ATTR_AUDIO;
+const uint32 kKeyframe = Tag::ATTR_VIDEO | Tag::ATTR_DROPPABLE |
+                         Tag::ATTR_CAN_RESYNC;
+const uint32 kInterframe = Tag::ATTR_VIDEO | Tag::ATTR_DROPPABLE;
+
+// Switches to what it is told, counts the EOS-es
+class TestPolicy : public Policy {
+ public:
+  explicit TestPolicy(PolicyDrivenElement* element)
+      : Policy("test_policy", "test", element), eos_count_(0) {}
+  virtual bool Initialize() { return true; }
+  virtual void Reset() {}
+  virtual bool NotifyEos() {
+    ++eos_count_;
+    return true;
+  }
+  virtual bool NotifyTag(const Tag* tag, int64 timestamp_ms) { return true; }
+  virtual string GetPolicyConfig() { return ""; }
+  int eos_count() const { return eos_count_; }
+ private:
+  int eos_count_;
+};
+
+// A downstream client, records the ids of the TestTag-s it gets
+class Client {
+ public:
+  Client(net::Selector* selector, SwitchingElement* element)
+      : selector_(selector),
+        element_(element),
+        req_(NULL),
+        callback_(NewPermanentCallback(this, &Client::ProcessTag)),
+        eos_(false) {
+  }
+  ~Client() {
+    CHECK_NULL(req_);
+    delete callback_;
+  }
+  const vector<int>& ids() const { return ids_; }
+  bool eos() const { return eos_; }
+
+  void Add() {
+    CHECK_NULL(req_);
+    req_ = new Request();
+    CHECK(element_->AddRequest("", req_, callback_));
+  }
+  void Remove() {
+    element_->RemoveRequest(req_);
+    delete req_;
+    req_ = NULL;
+  }
+
+ private:
+  void ProcessTag(const Tag* tag, int64 timestamp_ms) {
+    if ( tag->type() == Tag::TYPE_RAW ) {
+      ids_.push_back(static_cast<const TestTag*>(tag)->id());
+    } else if ( tag->type() == Tag::TYPE_EOS ) {
+      eos_ = true;
+      selector_->RunInSelectLoop(NewCallback(this, &Client::Remove));
+    }
+  }
+
+  net::Selector* const selector_;
+  SwitchingElement* const element_;
+  Request* req_;
+  ProcessingCallback* const callback_;
+  vector<int> ids_;
+  bool eos_;
+};
+
+string ToString(const vector<int>& v) {
+  string s;
+  for ( int i = 0; i < v.size(); ++i ) {
+    s += (i == 0 ? "" : ",") + strutil::IntToString(v[i]);
+  }
+  return s;
+}
+
+// A switching element w/ one client, on top of the TestMapper.
+// Each test is a sequence of steps, run in the select loop kStepMs apart
+// (so the alarms of the element in between get to fire); at the end we
+// close the element.
+class SwitchingTest {
+ public:
+  static const int64 kStepMs = 20;
+
+  SwitchingTest()
+      : mapper_(&selector_),
+        element_("sw", &mapper_, &selector_, "", NULL,
+                 Capabilities(kDefaultFlavourMask), 0, 0, 0,
+                 true, true, false),
+        policy_(&element_),
+        client_(&selector_, &element_),
+        next_step_(0) {
+    element_.set_policy(&policy_);
+    CHECK(element_.Initialize());
+  }
+  virtual ~SwitchingTest() {
+    CHECK(mapper_.empty());
+  }
+
+  void Run() {
+    AddStep(NewCallback(this, &SwitchingTest::Close));
+    selector_.RunInSelectLoop(NewCallback(this, &SwitchingTest::NextStep));
+    selector_.Loop();
+    CHECK_EQ(next_step_, steps_.size());
+  }
+  // Plays media a to our client
+  void Start() {
+    client_.Add();
+    element_.SwitchCurrentMedia("a", NULL, false);
+  }
+
+ protected:
+  void AddStep(Closure* step) {
+    steps_.push_back(step);
+  }
+  void Send(const string& media, int id, uint32 attributes,
+            int64 timestamp_ms) {
+    mapper_.Send(media, new TestTag(attributes, 100, id), timestamp_ms);
+  }
+  void SendEos(const string& media) {
+    mapper_.Send(media, new EosTag(0, kDefaultFlavourMask, false), 0);
+  }
+
+  net::Selector selector_;
+  TestMapper mapper_;
+  SwitchingElement element_;
+  TestPolicy policy_;
+  Client client_;
+
+ private:
+  void NextStep() {
+    steps_[next_step_++]->Run();
+    if ( next_step_ < steps_.size() ) {
+      selector_.RegisterAlarm(
+          NewCallback(this, &SwitchingTest::NextStep), kStepMs);
+    }
+  }
+  void Close() {
+    element_.Close(NewCallback(&selector_, &net::Selector::MakeLoopExit));
+  }
+
+  vector<Closure*> steps_;
+  int next_step_;
+};
+
+// Switching to the prefetched media plays what we buffered for it, w/o
+// a new upstream request, then lets the upstream go on.
+class PromoteTest : public SwitchingTest {
+ public:
+  PromoteTest() {
+    AddStep(NewCallback(static_cast<SwitchingTest*>(this),
+                        &SwitchingTest::Start));
+    AddStep(NewCallback(this, &PromoteTest::Prefetch));
+    AddStep(NewCallback(this, &PromoteTest::Switch));
+    AddStep(NewCallback(this, &PromoteTest::Check));
+  }
+ private:
+  void Prefetch() {
+    CHECK(element_.is_registered());
+    Send("a", 1, kKeyframe, 0);
+    element_.PrefetchMedia("b");
+    CHECK(mapper_.HasUpstream("b"));
+    CHECK_EQ(mapper_.adds(), 2);
+    Send("b", 10, kAudio, 0);
+    CHECK_EQ(mapper_.paused("b"), 0);
+    Send("b", 11, kKeyframe, 10);
+    // we have a keyframe, we hold the upstream
+    CHECK_EQ(mapper_.paused("b"), 1);
+    Send("b", 12, kInterframe, 20);
+    Send("a", 2, kInterframe, 10);
+    CHECK_EQ(ToString(client_.ids()), "1,2");
+  }
+  void Switch() {
+    element_.SwitchCurrentMedia("b", NULL, false);
+    CHECK(!mapper_.HasUpstream("a"));
+  }
+  void Check() {
+    CHECK(element_.is_registered());
+    CHECK_EQ(element_.current_media(), "b");
+    CHECK_EQ(mapper_.adds(), 2);
+    CHECK_EQ(ToString(client_.ids()), "1,2,10,11,12");
+    CHECK_EQ(mapper_.paused("b"), 0);
+    Send("b", 13, kInterframe, 30);
+    CHECK_EQ(ToString(client_.ids()), "1,2,10,11,12,13");
+  }
+};
+
+// The prefetch is dropped on a new announcement, and when the element
+// stops playing.
+class CancelTest : public SwitchingTest {
+ public:
+  explicit CancelTest(bool on_close) {
+    AddStep(NewCallback(static_cast<SwitchingTest*>(this),
+                        &SwitchingTest::Start));
+    AddStep(NewCallback(this, &CancelTest::Prefetch));
+    if ( !on_close ) {
+      AddStep(NewCallback(this, &CancelTest::RemoveClient));
+    }
+  }
+ private:
+  void Prefetch() {
+    element_.PrefetchMedia("b");
+    Send("b", 10, kKeyframe, 0);
+    CHECK_EQ(mapper_.paused("b"), 1);
+    element_.PrefetchMedia("c");
+    CHECK(!mapper_.HasUpstream("b"));
+    CHECK(mapper_.HasUpstream("c"));
+    element_.PrefetchMedia("");
+    CHECK(!mapper_.HasUpstream("c"));
+    element_.PrefetchMedia("b");
+    CHECK(mapper_.HasUpstream("b"));
+    CHECK_EQ(mapper_.adds(), 4);
+  }
+  void RemoveClient() {
+    client_.Remove();
+    CHECK(mapper_.empty());
+    // and nothing else to prefetch for
+    element_.PrefetchMedia("b");
+    CHECK(mapper_.empty());
+  }
+};
+
+// We give up a prefetch that buffers too much
+class GiveUpTest : public SwitchingTest {
+ public:
+  GiveUpTest() {
+    AddStep(NewCallback(static_cast<SwitchingTest*>(this),
+                        &SwitchingTest::Start));
+    AddStep(NewCallback(this, &GiveUpTest::Prefetch));
+    AddStep(NewCallback(this, &GiveUpTest::Check));
+  }
+ private:
+  void Prefetch() {
+    element_.PrefetchMedia("b");
+    for ( int i = 0; i < 15; ++i ) {
+      Send("b", 10 + i, kAudio, i);
+    }
+    // over the limit, but we do not remove it while it calls us
+    CHECK(mapper_.HasUpstream("b"));
+  }
+  void Check() {
+    CHECK(!mapper_.HasUpstream("b"));
+    CHECK(mapper_.HasUpstream("a"));
+    CHECK(client_.ids().empty());
+  }
+};
+
+// The EOS of a prefetched media is played after its tags when we switch
+// to it, and the policy hears of it.
+class EosTest : public SwitchingTest {
+ public:
+  EosTest() {
+    AddStep(NewCallback(static_cast<SwitchingTest*>(this),
+                        &SwitchingTest::Start));
+    AddStep(NewCallback(this, &EosTest::Prefetch));
+    AddStep(NewCallback(this, &EosTest::Switch));
+    AddStep(NewCallback(this, &EosTest::Check));
+  }
+ private:
+  void Prefetch() {
+    Send("a", 1, kAudio, 0);
+    element_.PrefetchMedia("b");
+    Send("b", 10, kAudio, 0);
+    SendEos("b");
+    // an EOS is as good as a keyframe
+    CHECK_EQ(mapper_.paused("b"), 1);
+  }
+  void Switch() {
+    element_.SwitchCurrentMedia("b", NULL, false);
+  }
+  void Check() {
+    CHECK_EQ(ToString(client_.ids()), "1,10");
+    CHECK_EQ(policy_.eos_count(), 1);
+    CHECK(!element_.is_registered());
+    CHECK(mapper_.empty());
+    CHECK(!client_.eos());
+  }
+};
+
+void TestPromote() {
+  PromoteTest test;
+  test.Run();
+  LOG_INFO << "OK promote";
+}
+
+void TestCancel() {
+  {
+    CancelTest test(false);
+    test.Run();
+  }
+  {
+    CancelTest test(true);
+    test.Run();
+  }
+  LOG_INFO << "OK cancel";
+}
+
+void TestGiveUp() {
+  const int32 max_size = FLAGS_switching_prefetch_max_size;
+  FLAGS_switching_prefetch_max_size = 1000;
+  {
+    GiveUpTest test;
+    test.Run();
+  }
+  FLAGS_switching_prefetch_max_size = max_size;
+  LOG_INFO << "OK give up";
+}
+
+void TestEos() {
+  EosTest test;
+  test.Run();
+  LOG_INFO << "OK eos";
+}
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestPromote();
+  TestCancel();
+  TestGiveUp();
+  TestEos();
+  LOG_INFO << "PASS";
+  common::Exit(0);
+}
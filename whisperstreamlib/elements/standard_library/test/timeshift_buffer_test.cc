@@ -0,0 +1,204 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperstreamlib/base/consts.h>
+#include <whisperstreamlib/base/test/test_tag.h>
+#include "elements/standard_library/timeshift/timeshift_buffer.h"
+
+using streaming::Tag;
+using streaming::TestTag;
+using streaming::TimeShiftBuffer;
+
+namespace {
+
+const int32 kTagSize = 100;
+
+void Add(TimeShiftBuffer* buffer, uint32 attributes, int64 ts) {
+  scoped_ref<TestTag> tag(new TestTag(attributes, kTagSize));
+  buffer->AddTag(tag.get(), ts);
+}
+// A video stream: a tag every 40 ms (audio / video), a key frame every
+// second
+void AddVideo(TimeShiftBuffer* buffer, int64 begin_ts, int64 end_ts) {
+  for ( int64 ts = begin_ts; ts < end_ts; ts += 40 ) {
+    Add(buffer,
+        ts % 1000 == 0 ? Tag::ATTR_VIDEO | Tag::ATTR_CAN_RESYNC :
+        ts % 80 == 0 ? Tag::ATTR_AUDIO : Tag::ATTR_VIDEO,
+        ts);
+  }
+}
+int64 GetTs(const TimeShiftBuffer& buffer, TimeShiftBuffer::Position pos) {
+  const TimeShiftBuffer::Entry* const entry = buffer.Get(&pos);
+  CHECK(entry != NULL);
+  return entry->timestamp_ms_;
+}
+
+void TestFind() {
+  TimeShiftBuffer buffer(60000, 1 << 30, 2000);
+  TimeShiftBuffer::Position none = buffer.Find(0);
+  CHECK(buffer.Get(&none) == NULL);
+  AddVideo(&buffer, 0, 10000);
+  // a gap, then the stream goes on
+  AddVideo(&buffer, 12000, 20000);
+  CHECK_EQ(buffer.num_segments(), 18);
+  CHECK_EQ(buffer.begin_ts(), 0);
+  CHECK_EQ(buffer.end_ts(), 19960);
+
+  // at the begin of the segment w/ ts
+  for ( int64 ts = 0; ts < 20000; ts += 250 ) {
+    if ( ts >= 10000 && ts < 12000 ) {
+      continue;
+    }
+    CHECK_EQ(GetTs(buffer, buffer.Find(ts)), ts / 1000 * 1000) << ts;
+  }
+  // the end of a segment is in it
+  CHECK_EQ(GetTs(buffer, buffer.Find(4960)), 4000);
+  // in the gap - the next segment
+  CHECK_EQ(GetTs(buffer, buffer.Find(9990)), 12000);
+  CHECK_EQ(GetTs(buffer, buffer.Find(11000)), 12000);
+  // outside - the first / last
+  CHECK_EQ(GetTs(buffer, buffer.Find(-5000)), 0);
+  CHECK_EQ(GetTs(buffer, buffer.Find(50000)), 19000);
+  CHECK_EQ(GetTs(buffer, buffer.Last()), 19000);
+
+  // reading goes across segments, in order, up to End()
+  TimeShiftBuffer::Position pos = buffer.Find(17500);
+  int64 last_ts = -1;
+  int num_tags = 0;
+  const TimeShiftBuffer::Entry* entry = NULL;
+  while ( (entry = buffer.Get(&pos)) != NULL ) {
+    CHECK_GT(entry->timestamp_ms_, last_ts);
+    last_ts = entry->timestamp_ms_;
+    ++pos.index_;
+    ++num_tags;
+  }
+  CHECK_EQ(num_tags, 75);
+  CHECK_EQ(last_ts, 19960);
+  TimeShiftBuffer::Position end = buffer.End();
+  CHECK(buffer.Get(&end) == NULL);
+  // .. where the next tag comes (in the same or in a new segment)
+  Add(&buffer, Tag::ATTR_AUDIO, 20000);
+  CHECK_EQ(GetTs(buffer, end), 20000);
+  ++end.index_;
+  Add(&buffer, Tag::ATTR_VIDEO | Tag::ATTR_CAN_RESYNC, 20040);
+  CHECK_EQ(GetTs(buffer, end), 20040);
+  LOG_INFO << "TestFind OK";
+}
+
+void TestAudioSegments() {
+  TimeShiftBuffer buffer(60000, 1 << 30, 2000);
+  for ( int64 ts = 0; ts < 10000; ts += 100 ) {
+    Add(&buffer, Tag::ATTR_AUDIO, ts);
+  }
+  CHECK_EQ(buffer.num_segments(), 5);
+  CHECK_EQ(GetTs(buffer, buffer.Find(5500)), 4000);
+  LOG_INFO << "TestAudioSegments OK";
+}
+
+void TestDropOldSegments() {
+  // by duration: we keep max 10 sec (plus the segment in progress)
+  TimeShiftBuffer buffer(10000, 1 << 30, 2000);
+  AddVideo(&buffer, 0, 30000);
+  CHECK_EQ(buffer.num_segments(), 11);
+  CHECK_EQ(buffer.begin_ts(), 19000);
+  CHECK_EQ(buffer.size(), 11 * 25 * kTagSize);
+  CHECK_LE(buffer.end_ts() - buffer.begin_ts(), 11000);
+
+  // by size
+  TimeShiftBuffer small(60000, 10 * kTagSize, 500);
+  for ( int64 ts = 0; ts < 10000; ts += 100 ) {
+    Add(&small, Tag::ATTR_AUDIO, ts);
+  }
+  CHECK_LE(small.size(), 10 * kTagSize);
+  CHECK_EQ(small.begin_ts(), 9000);
+
+  // .. but we always keep the segment in progress
+  TimeShiftBuffer tiny(60000, kTagSize, 60000);
+  for ( int64 ts = 0; ts < 1000; ts += 100 ) {
+    Add(&tiny, Tag::ATTR_AUDIO, ts);
+  }
+  CHECK_EQ(tiny.num_segments(), 1);
+  CHECK_EQ(tiny.size(), 10 * kTagSize);
+
+  // a new stream (the time went back) - we start over
+  Add(&buffer, Tag::ATTR_AUDIO, 10);
+  CHECK_EQ(buffer.num_segments(), 1);
+  CHECK_EQ(buffer.begin_ts(), 10);
+  CHECK_EQ(buffer.size(), kTagSize);
+  LOG_INFO << "TestDropOldSegments OK";
+}
+
+void TestGetDropped() {
+  TimeShiftBuffer buffer(10000, 1 << 30, 2000);
+  AddVideo(&buffer, 0, 5000);
+  // a reader in the middle of the first segment, one at the live end
+  TimeShiftBuffer::Position reader = buffer.Find(0);
+  reader.index_ = 10;
+  CHECK_EQ(GetTs(buffer, reader), 400);
+  TimeShiftBuffer::Position live = buffer.End();
+
+  AddVideo(&buffer, 5000, 30000);
+  CHECK_EQ(buffer.begin_ts(), 19000);
+  // both segments were dropped: they continue w/ the oldest we have
+  const TimeShiftBuffer::Entry* entry = buffer.Get(&reader);
+  CHECK(entry != NULL);
+  CHECK_EQ(entry->timestamp_ms_, 19000);
+  CHECK_EQ(reader.index_, 0);
+  CHECK_EQ(GetTs(buffer, live), 19000);
+  // .. and read on from there
+  ++reader.index_;
+  CHECK_EQ(GetTs(buffer, reader), 19040);
+
+  // all dropped (start over) - continue w/ what we have now
+  Add(&buffer, Tag::ATTR_VIDEO | Tag::ATTR_CAN_RESYNC, 0);
+  CHECK_EQ(GetTs(buffer, reader), 0);
+
+  // nothing left
+  buffer.Clear();
+  CHECK(buffer.empty());
+  CHECK(buffer.Get(&reader) == NULL);
+  LOG_INFO << "TestGetDropped OK";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestFind();
+  TestAudioSegments();
+  TestDropOldSegments();
+  TestGetDropped();
+  LOG_INFO << "PASS";
+  return 0;
+}
@@ -0,0 +1,157 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/strutil.h>
+#include "elements/standard_library/token_authorizer/token_authorizer.h"
+
+using streaming::AuthorizerRequest;
+using streaming::TokenAuthorizer;
+
+namespace {
+
+const int64 kNow = 1300000000;
+const char kResource[] = "rtmp://host/app/stream?x=y";
+
+AuthorizerRequest MakeRequest(const string& token, const string& user,
+                              const string& address,
+                              const string& resource) {
+  return AuthorizerRequest(user, "", token, address, resource, "view", 0);
+}
+
+void TestValid() {
+  TokenAuthorizer auth("auth", "secret", 0, false, false);
+  CHECK(auth.Initialize());
+  const string token = auth.Sign(kResource, kNow + 60, "", "");
+  CHECK_EQ(auth.Verify(MakeRequest(token, "", "1.2.3.4:80", kResource), kNow),
+           60000);
+  // only the path of the resource is signed
+  CHECK_EQ(auth.Verify(MakeRequest(token, "", "1.2.3.4:80",
+                                   "http://other/app/stream"), kNow),
+           60000);
+  // w/o a secret we refuse to start
+  TokenAuthorizer no_secret("auth", "", 0, false, false);
+  CHECK(!no_secret.Initialize());
+  LOG_INFO << "OK valid";
+}
+
+void TestExpired() {
+  TokenAuthorizer auth("auth", "secret", 0, false, false);
+  const string token = auth.Sign(kResource, kNow, "", "");
+  CHECK_EQ(auth.Verify(MakeRequest(token, "", "", kResource), kNow), 0);
+  CHECK_EQ(auth.Verify(MakeRequest(token, "", "", kResource), kNow + 1), 0);
+  CHECK_EQ(auth.Verify(MakeRequest(token, "", "", kResource), kNow - 1),
+           1000);
+  LOG_INFO << "OK expired";
+}
+
+void TestTampered() {
+  TokenAuthorizer auth("auth", "secret", 0, false, false);
+  const string token = auth.Sign(kResource, kNow + 60, "", "");
+  const size_t dash = token.find('-');
+  CHECK_NE(dash, string::npos);
+
+  // another signature digit
+  string bad(token);
+  bad[bad.size() - 1] = (bad[bad.size() - 1] == '0' ? '1' : '0');
+  CHECK_EQ(auth.Verify(MakeRequest(bad, "", "", kResource), kNow), 0);
+  // a later expiration w/ the same signature
+  bad = strutil::StringPrintf("%" PRId64, kNow + 3600) + token.substr(dash);
+  CHECK_EQ(auth.Verify(MakeRequest(bad, "", "", kResource), kNow), 0);
+  // w/o a signature, truncated, or padded
+  bad = token.substr(0, dash + 1);
+  CHECK_EQ(auth.Verify(MakeRequest(bad, "", "", kResource), kNow), 0);
+  bad = token.substr(0, token.size() - 1);
+  CHECK_EQ(auth.Verify(MakeRequest(bad, "", "", kResource), kNow), 0);
+  CHECK_EQ(auth.Verify(MakeRequest(token + "0", "", "", kResource), kNow), 0);
+  // garbage
+  CHECK_EQ(auth.Verify(MakeRequest("", "", "", kResource), kNow), 0);
+  CHECK_EQ(auth.Verify(MakeRequest("-", "", "", kResource), kNow), 0);
+  CHECK_EQ(auth.Verify(MakeRequest("x" + token, "", "", kResource), kNow), 0);
+  // another resource
+  CHECK_EQ(auth.Verify(MakeRequest(token, "", "", "rtmp://host/app/other"),
+                       kNow), 0);
+  // another secret
+  TokenAuthorizer other("auth", "secret2", 0, false, false);
+  CHECK_EQ(other.Verify(MakeRequest(token, "", "", kResource), kNow), 0);
+  LOG_INFO << "OK tampered";
+}
+
+void TestBinding() {
+  TokenAuthorizer auth("auth", "secret", 0, true, true);
+  const string token = auth.Sign(kResource, kNow + 60, "john", "1.2.3.4");
+  CHECK_GT(auth.Verify(MakeRequest(token, "john", "1.2.3.4:80", kResource),
+                       kNow), 0);
+  // the port does not matter
+  CHECK_GT(auth.Verify(MakeRequest(token, "john", "1.2.3.4:1935", kResource),
+                       kNow), 0);
+  // wrong ip
+  CHECK_EQ(auth.Verify(MakeRequest(token, "john", "1.2.3.5:80", kResource),
+                       kNow), 0);
+  // wrong user
+  CHECK_EQ(auth.Verify(MakeRequest(token, "jane", "1.2.3.4:80", kResource),
+                       kNow), 0);
+
+  TokenAuthorizer auth6("auth", "secret", 0, false, true);
+  const string token6 = auth6.Sign(kResource, kNow + 60, "", "2001:db8::1");
+  CHECK_GT(auth6.Verify(MakeRequest(token6, "", "[2001:db8::1]:80",
+                                    kResource), kNow), 0);
+  CHECK_EQ(auth6.Verify(MakeRequest(token6, "", "[2001:db8::2]:80",
+                                    kResource), kNow), 0);
+  LOG_INFO << "OK binding";
+}
+
+void TestCase() {
+  TokenAuthorizer auth("auth", "secret", 0, true, false);
+  const string token = auth.Sign(kResource, kNow + 60, "john", "");
+  // the hex signature is case insensitive ..
+  CHECK_GT(auth.Verify(MakeRequest(strutil::StrToUpper(token), "john", "",
+                                   kResource), kNow), 0);
+  // .. but the resource path and the user are not
+  CHECK_EQ(auth.Verify(MakeRequest(token, "john", "",
+                                   "rtmp://host/App/Stream"), kNow), 0);
+  CHECK_EQ(auth.Verify(MakeRequest(token, "John", "", kResource), kNow), 0);
+  LOG_INFO << "OK case";
+}
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestValid();
+  TestExpired();
+  TestTampered();
+  TestBinding();
+  TestCase();
+  LOG_INFO << "PASS";
+  common::Exit(0);
+}
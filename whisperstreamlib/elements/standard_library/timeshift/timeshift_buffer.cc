@@ -0,0 +1,193 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+
+#include <whisperlib/common/base/strutil.h>
+#include "elements/standard_library/timeshift/timeshift_buffer.h"
+
+namespace streaming {
+
+namespace {
+// If the stream time goes back more than this, we have a new stream
+// (and we start over)
+const int64 kMaxTimestampRegressionMs = 1000;
+}
+
+TimeShiftBuffer::TimeShiftBuffer(int64 max_duration_ms,
+                                 int64 max_size,
+                                 int64 audio_segment_ms)
+    : max_duration_ms_(max_duration_ms),
+      max_size_(max_size),
+      audio_segment_ms_(audio_segment_ms),
+      next_seq_(0),
+      size_(0),
+      has_video_(false) {
+}
+
+TimeShiftBuffer::~TimeShiftBuffer() {
+  Clear();
+}
+
+bool TimeShiftBuffer::IsBuffered(const Tag* tag) {
+  return tag->is_audio_tag() || tag->is_video_tag() ||
+         tag->is_metadata_tag();
+}
+
+void TimeShiftBuffer::AddTag(const Tag* tag, int64 timestamp_ms) {
+  DCHECK(IsBuffered(tag));
+  if ( !segments_.empty() &&
+       timestamp_ms < segments_.back()->end_ts_ - kMaxTimestampRegressionMs ) {
+    LOG_WARNING << "Stream time went back from: "
+                << segments_.back()->end_ts_ << " to: " << timestamp_ms
+                << ", starting over";
+    Clear();
+  }
+  if ( tag->is_video_tag() ) {
+    has_video_ = true;
+  }
+  // Cut a new segment ?
+  if ( segments_.empty() ||
+       (has_video_
+        ? (tag->is_video_tag() && tag->can_resync() &&
+           !segments_.back()->entries_.empty())
+        : (timestamp_ms - segments_.back()->begin_ts_ >= audio_segment_ms_)) ) {
+    Segment* const segment = new Segment(next_seq_++);
+    segment->begin_ts_ = timestamp_ms;
+    segments_.push_back(segment);
+  }
+  Segment* const segment = segments_.back();
+  segment->entries_.push_back(Entry(tag, timestamp_ms));
+  segment->end_ts_ = max(segment->end_ts_, timestamp_ms);
+  segment->size_ += tag->size();
+  size_ += tag->size();
+  DropOldSegments();
+}
+
+void TimeShiftBuffer::Clear() {
+  while ( !segments_.empty() ) {
+    delete segments_.front();
+    segments_.pop_front();
+  }
+  size_ = 0;
+  has_video_ = false;
+}
+
+int64 TimeShiftBuffer::begin_ts() const {
+  return segments_.empty() ? 0 : segments_.front()->begin_ts_;
+}
+int64 TimeShiftBuffer::end_ts() const {
+  return segments_.empty() ? 0 : segments_.back()->end_ts_;
+}
+
+TimeShiftBuffer::Position TimeShiftBuffer::Find(int64 ts) const {
+  if ( segments_.empty() ) {
+    return End();
+  }
+  // binary search the last segment beginning before ts
+  int32 left = 0;
+  int32 right = segments_.size();
+  while ( left < right ) {
+    const int32 mid = (left + right) / 2;
+    if ( segments_[mid]->begin_ts_ <= ts ) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  if ( left == 0 ) {
+    return Position(segments_.front()->seq_, 0);
+  }
+  int32 index = left - 1;
+  if ( ts > segments_[index]->end_ts_ && index + 1 < segments_.size() ) {
+    // in a gap
+    ++index;
+  }
+  return Position(segments_[index]->seq_, 0);
+}
+
+TimeShiftBuffer::Position TimeShiftBuffer::Last() const {
+  if ( segments_.empty() ) {
+    return End();
+  }
+  return Position(segments_.back()->seq_, 0);
+}
+
+TimeShiftBuffer::Position TimeShiftBuffer::End() const {
+  if ( segments_.empty() ) {
+    return Position(next_seq_, 0);
+  }
+  return Position(segments_.back()->seq_, segments_.back()->entries_.size());
+}
+
+const TimeShiftBuffer::Entry* TimeShiftBuffer::Get(Position* pos) const {
+  if ( segments_.empty() ) {
+    return NULL;
+  }
+  const int64 first_seq = segments_.front()->seq_;
+  if ( pos->seq_ < first_seq ) {
+    // dropped - continue w/ the oldest we have
+    *pos = Position(first_seq, 0);
+  }
+  while ( true ) {
+    const int64 index = pos->seq_ - first_seq;
+    if ( index >= segments_.size() ) {
+      return NULL;
+    }
+    const Segment* const segment = segments_[index];
+    if ( pos->index_ < segment->entries_.size() ) {
+      return &segment->entries_[pos->index_];
+    }
+    if ( index + 1 >= segments_.size() ) {
+      return NULL;
+    }
+    *pos = Position(pos->seq_ + 1, 0);
+  }
+}
+
+string TimeShiftBuffer::ToString() const {
+  return strutil::StringPrintf(
+      "TimeShiftBuffer{segments: %d, size: %" PRId64 ", "
+      "ts: [%" PRId64 ", %" PRId64 "]}",
+      static_cast<int>(segments_.size()), size_, begin_ts(), end_ts());
+}
+
+void TimeShiftBuffer::DropOldSegments() {
+  while ( segments_.size() > 1 &&
+          (size_ > max_size_ ||
+           segments_.back()->end_ts_ - segments_[1]->begin_ts_ >=
+           max_duration_ms_) ) {
+    size_ -= segments_.front()->size_;
+    delete segments_.front();
+    segments_.pop_front();
+  }
+}
+
+}
@@ -0,0 +1,135 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+
+#ifndef __MEDIA_ELEMENTS_TIMESHIFT_BUFFER_H__
+#define __MEDIA_ELEMENTS_TIMESHIFT_BUFFER_H__
+
+#include <deque>
+#include <vector>
+#include <whisperlib/common/base/types.h>
+#include <whisperstreamlib/base/tag.h>
+
+namespace streaming {
+
+// The last minutes of a live stream, kept in memory - in segments that
+// begin w/ a video key frame (or every audio_segment_ms for streams w/o
+// video), so we can start playing at the begin of any segment.
+//
+// The buffer is bounded both in time and in bytes: we drop the oldest
+// segments when over any of the limits (but we always keep the segment
+// in progress).
+//
+// Readers keep a Position in the buffer. Positions stay valid while we
+// add tags and drop segments (a reader behind the oldest segment simply
+// continues w/ the oldest one).
+class TimeShiftBuffer {
+ public:
+  struct Entry {
+    scoped_ref<const Tag> tag_;
+    int64 timestamp_ms_;
+    Entry(const Tag* tag, int64 timestamp_ms)
+        : tag_(tag), timestamp_ms_(timestamp_ms) {
+    }
+  };
+  struct Position {
+    int64 seq_;       // the segment sequence number
+    int32 index_;     // the entry in the segment
+    Position() : seq_(0), index_(0) {}
+    Position(int64 seq, int32 index) : seq_(seq), index_(index) {}
+  };
+
+  TimeShiftBuffer(int64 max_duration_ms,
+                  int64 max_size,
+                  int64 audio_segment_ms);
+  ~TimeShiftBuffer();
+
+  // Returns true for the tags we keep (the media tags)
+  static bool IsBuffered(const Tag* tag);
+
+  // Appends a media tag (see IsBuffered)
+  void AddTag(const Tag* tag, int64 timestamp_ms);
+  // Drops everything
+  void Clear();
+
+  bool empty() const { return segments_.empty(); }
+  int32 num_segments() const { return segments_.size(); }
+  int64 size() const { return size_; }
+  // The stream time of the oldest / newest tags
+  int64 begin_ts() const;
+  int64 end_ts() const;
+
+  // The begin of the segment containing the given stream time (or of the
+  // first segment after it, if ts falls in a gap; or of the first / last
+  // segment if ts is outside the buffer).
+  Position Find(int64 ts) const;
+  // The begin of the last segment (i.e. the last key frame)
+  Position Last() const;
+  // Where the next added tag will be
+  Position End() const;
+
+  // Returns the entry at pos (updating pos if it points past the end of
+  // a segment, or to a dropped segment). Returns NULL if pos is at the
+  // end of the buffer.
+  const Entry* Get(Position* pos) const;
+
+  string ToString() const;
+
+ private:
+  struct Segment {
+    const int64 seq_;
+    int64 begin_ts_;
+    int64 end_ts_;
+    int64 size_;
+    vector<Entry> entries_;
+    explicit Segment(int64 seq)
+        : seq_(seq), begin_ts_(0), end_ts_(0), size_(0) {
+    }
+  };
+  void DropOldSegments();
+
+  const int64 max_duration_ms_;
+  const int64 max_size_;
+  const int64 audio_segment_ms_;
+
+  deque<Segment*> segments_;
+  // the sequence number of the next segment
+  int64 next_seq_;
+  // total size of the tags
+  int64 size_;
+  // true if the stream has video (then we cut segments at key frames)
+  bool has_video_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TimeShiftBuffer);
+};
+}
+
+#endif  // __MEDIA_ELEMENTS_TIMESHIFT_BUFFER_H__
@@ -0,0 +1,445 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+
+#include <whisperlib/common/base/gflags.h>
+#include "elements/standard_library/timeshift/timeshift_element.h"
+
+#define ILOG(level)  LOG(level) << name() << ": "
+#define ILOG_INFO    ILOG(INFO)
+#define ILOG_WARNING ILOG(WARNING)
+#define ILOG_ERROR   ILOG(ERROR)
+
+DEFINE_int32(timeshift_write_ahead_ms,
+             5000,
+             "The timeshift element sends the clients that play from "
+             "its buffer this much ahead of the real time");
+
+DEFINE_int32(timeshift_audio_segment_ms,
+             2000,
+             "For streams w/o video, the timeshift element can start "
+             "playing (and seek) only at multiples of this");
+
+namespace streaming {
+
+const char TimeShiftElement::kElementClassName[] = "timeshift";
+
+//////////////////////////////////////////////////////////////////////
+
+class TimeShiftElement::Client : public ElementController {
+ public:
+  Client(const TimeShiftBuffer* buffer,
+         Request* req,
+         ProcessingCallback* callback)
+      : buffer_(buffer),
+        req_(req),
+        callback_(callback),
+        bootstrapped_(false),
+        seek_pending_(false),
+        pause_count_(0),
+        anchor_ts_(0),
+        anchor_time_(-1),
+        removed_(false),
+        eos_sent_(false) {
+    req_->set_controller(this);
+  }
+  virtual ~Client() {
+    if ( !removed_ ) {
+      req_->set_controller(NULL);
+    }
+  }
+
+  Request* req() const { return req_; }
+  ProcessingCallback* callback() const { return callback_; }
+  uint32 flavour_mask() const { return req_->caps().flavour_mask_; }
+
+  // Where we are in the buffer
+  TimeShiftBuffer::Position* mutable_pos() { return &pos_; }
+
+  bool bootstrapped() const { return bootstrapped_; }
+  void set_bootstrapped() { bootstrapped_ = true; }
+  bool seek_pending() const { return seek_pending_; }
+  void clear_seek_pending() { seek_pending_ = false; }
+  bool is_paused() const { return pause_count_ > 0; }
+  bool removed() const { return removed_; }
+  // Called on RemoveRequest: the req_ is no longer ours
+  void set_removed() {
+    req_->set_controller(NULL);
+    removed_ = true;
+  }
+  bool eos_sent() const { return eos_sent_; }
+  void set_eos_sent() { eos_sent_ = true; }
+
+  // The real time pacing: we can send a tag w/ timestamp ts at
+  // anchor_time_ + (ts - anchor_ts_) - write ahead.
+  bool CanSend(int64 ts, int64 now) {
+    if ( anchor_time_ < 0 || ts < anchor_ts_ ) {
+      anchor_ts_ = ts;
+      anchor_time_ = now;
+    }
+    return ts - anchor_ts_ <=
+        now - anchor_time_ + FLAGS_timeshift_write_ahead_ms;
+  }
+
+  // ElementController interface
+  virtual bool SupportsPause() const { return true; }
+  virtual bool SupportsSeek() const { return true; }
+  virtual bool Pause(bool pause) {
+    if ( pause ) {
+      ++pause_count_;
+    } else {
+      if ( pause_count_ == 0 ) {
+        return false;
+      }
+      --pause_count_;
+      if ( pause_count_ == 0 ) {
+        // continue in real time from where we stopped
+        anchor_time_ = -1;
+      }
+    }
+    return true;
+  }
+  virtual bool Seek(int64 position) {
+    if ( buffer_->empty() ) {
+      return false;
+    }
+    const int64 ts = position < 0 ? buffer_->end_ts() + position : position;
+    pos_ = buffer_->Find(ts);
+    anchor_time_ = -1;
+    // we send the SeekPerformedTag w/ the next tag
+    seek_pending_ = true;
+    return true;
+  }
+
+ private:
+  const TimeShiftBuffer* const buffer_;
+  Request* const req_;
+  ProcessingCallback* const callback_;
+
+  TimeShiftBuffer::Position pos_;
+  bool bootstrapped_;
+  bool seek_pending_;
+  int32 pause_count_;
+  // pacing: stream time anchor_ts_ is played at anchor_time_
+  int64 anchor_ts_;
+  int64 anchor_time_;
+  bool removed_;
+  bool eos_sent_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(Client);
+};
+
+//////////////////////////////////////////////////////////////////////
+
+TimeShiftElement::TimeShiftElement(const string& name,
+                                   ElementMapper* mapper,
+                                   net::Selector* selector,
+                                   const string& media_name,
+                                   int64 buffer_ms,
+                                   int64 max_buffer_size)
+    : Element(kElementClassName, name, mapper),
+      selector_(selector),
+      media_name_(media_name),
+      req_(NULL),
+      process_tag_callback_(
+          NewPermanentCallback(this, &TimeShiftElement::ProcessTag)),
+      bootstrapper_(false),
+      buffer_(buffer_ms, max_buffer_size, FLAGS_timeshift_audio_segment_ms),
+      in_processing_(0),
+      pump_alarm_(*selector),
+      register_alarm_(*selector),
+      stream_ended_alarm_(*selector),
+      close_completed_(NULL) {
+  pump_alarm_.Set(NewPermanentCallback(this, &TimeShiftElement::PumpAll),
+                  true, kPumpIntervalMs, true, false);
+  register_alarm_.Set(NewPermanentCallback(this, &TimeShiftElement::Register),
+                      true, kRegisterRetryMs, true, false);
+  stream_ended_alarm_.Set(
+      NewPermanentCallback(this, &TimeShiftElement::StreamEnded),
+      true, 0, false, false);
+}
+TimeShiftElement::~TimeShiftElement() {
+  pump_alarm_.Stop();
+  register_alarm_.Stop();
+  stream_ended_alarm_.Stop();
+  Unregister();
+  DCHECK(clients_.empty());
+  DCHECK(close_completed_ == NULL);
+  DeleteRemovedClients();
+  delete process_tag_callback_;
+}
+
+bool TimeShiftElement::Initialize() {
+  if ( media_name_.empty() ) {
+    ILOG_ERROR << "No media to timeshift";
+    return false;
+  }
+  Register();
+  pump_alarm_.Start();
+  return true;
+}
+
+void TimeShiftElement::Register() {
+  if ( is_registered() || close_completed_ != NULL ) {
+    register_alarm_.Stop();
+    return;
+  }
+  req_ = new streaming::Request();
+  req_->mutable_info()->is_internal_ = true;
+  if ( !mapper_->AddRequest(media_name_.c_str(), req_,
+                            process_tag_callback_) ) {
+    ILOG_WARNING << "Cannot register to: [" << media_name_
+                 << "], will retry in " << kRegisterRetryMs << " ms";
+    delete req_;
+    req_ = NULL;
+    if ( !register_alarm_.IsStarted() ) {
+      register_alarm_.Start();
+    }
+    return;
+  }
+  ILOG_INFO << "Registered to: [" << media_name_ << "]";
+  register_alarm_.Stop();
+}
+
+void TimeShiftElement::Unregister() {
+  if ( !is_registered() ) {
+    return;
+  }
+  ILOG_INFO << "Unregistering from: [" << media_name_ << "]";
+  streaming::Request* req = req_;
+  req_ = NULL;
+  mapper_->RemoveRequest(req, process_tag_callback_);
+}
+
+void TimeShiftElement::StreamEnded() {
+  Unregister();
+  // the clients keep playing from the buffer
+  bootstrapper_.ClearBootstrap();
+  if ( close_completed_ == NULL ) {
+    register_alarm_.Start();
+  }
+}
+
+bool TimeShiftElement::AddRequest(const string& media, Request* req,
+                                  ProcessingCallback* callback) {
+  if ( media != "" ) {
+    ILOG_ERROR << "Cannot AddRequest on submedia: [" << media << "]";
+    return false;
+  }
+  if ( close_completed_ != NULL ) {
+    ILOG_ERROR << "Cannot AddRequest while closing";
+    return false;
+  }
+  if ( req == req_ || clients_.find(req) != clients_.end() ) {
+    ILOG_ERROR << "Duplicate request: " << req->ToString();
+    return false;
+  }
+  if ( req->controller() != NULL ) {
+    ILOG_ERROR << "Request already controlled: " << req->ToString();
+    return false;
+  }
+  // NEXT: the client gets the bootstrap and the buffer on the next Pump()
+  clients_.insert(make_pair(req, new Client(&buffer_, req, callback)));
+  return true;
+}
+
+void TimeShiftElement::RemoveRequest(streaming::Request* req) {
+  ClientMap::iterator it = clients_.find(req);
+  if ( it == clients_.end() ) {
+    ILOG_ERROR << "Cannot find request: " << req->ToString();
+    return;
+  }
+  Client* const client = it->second;
+  clients_.erase(it);
+  client->set_removed();
+  if ( in_processing_ > 0 ) {
+    removed_clients_.push_back(client);
+  } else {
+    delete client;
+  }
+
+  // maybe complete close
+  if ( close_completed_ != NULL && clients_.empty() ) {
+    Closure* call_on_close = close_completed_;
+    close_completed_ = NULL;
+    selector_->RunInSelectLoop(call_on_close);
+  }
+}
+
+bool TimeShiftElement::HasMedia(const string& media) {
+  return media == "";
+}
+void TimeShiftElement::ListMedia(const string& media_dir,
+                                 vector<string>* out) {
+  out->push_back("");
+}
+bool TimeShiftElement::DescribeMedia(const string& media,
+                                     MediaInfoCallback* callback) {
+  return mapper_->DescribeMedia(media_name_, callback);
+}
+
+void TimeShiftElement::Close(Closure* call_on_close) {
+  CHECK_NULL(close_completed_);
+  pump_alarm_.Stop();
+  register_alarm_.Stop();
+  stream_ended_alarm_.Stop();
+  Unregister();
+  if ( clients_.empty() ) {
+    selector_->RunInSelectLoop(call_on_close);
+    return;
+  }
+  close_completed_ = call_on_close;
+
+  // Send EOS to all clients.
+  vector<Client*> clients;
+  for ( ClientMap::iterator it = clients_.begin(); it != clients_.end(); ++it ) {
+    if ( !it->second->eos_sent() ) {
+      it->second->set_eos_sent();
+      clients.push_back(it->second);
+    }
+  }
+  ++in_processing_;
+  for ( int i = 0; i < clients.size(); ++i ) {
+    if ( !clients[i]->removed() ) {
+      clients[i]->callback()->Run(scoped_ref<Tag>(new EosTag(
+          0, clients[i]->flavour_mask(), true)).get(), 0);
+    }
+  }
+  --in_processing_;
+  DeleteRemovedClients();
+
+  // NEXT: each client is responsible to call RemoveRequest() from us.
+  //       When the clients_ gets empty, close_completed_ is called.
+}
+
+void TimeShiftElement::ProcessTag(const Tag* tag, int64 timestamp_ms) {
+  if ( tag->type() == Tag::TYPE_EOS ) {
+    ILOG_INFO << "Upstream ended, keep serving from: " << buffer_.ToString();
+    stream_ended_alarm_.Start();
+    return;
+  }
+  bootstrapper_.ProcessTag(tag, timestamp_ms);
+
+  vector<Client*> clients;
+  for ( ClientMap::iterator it = clients_.begin(); it != clients_.end(); ++it ) {
+    clients.push_back(it->second);
+  }
+  ++in_processing_;
+  if ( TimeShiftBuffer::IsBuffered(tag) ) {
+    buffer_.AddTag(tag, timestamp_ms);
+    // the live clients get it now, the others when their time comes
+    for ( int i = 0; i < clients.size(); ++i ) {
+      Pump(clients[i]);
+    }
+  } else {
+    // Signaling tags go only to the live clients
+    // (the joining ones get them w/ the bootstrap)
+    for ( int i = 0; i < clients.size(); ++i ) {
+      Client* const client = clients[i];
+      if ( !client->removed() && !client->eos_sent() &&
+           client->bootstrapped() &&
+           (tag->flavour_mask() & client->flavour_mask()) != 0 &&
+           buffer_.Get(client->mutable_pos()) == NULL ) {
+        client->callback()->Run(tag, timestamp_ms);
+      }
+    }
+  }
+  --in_processing_;
+  DeleteRemovedClients();
+}
+
+void TimeShiftElement::Pump(Client* client) {
+  if ( client->removed() || client->eos_sent() || client->is_paused() ) {
+    return;
+  }
+  ++in_processing_;
+  if ( !client->bootstrapped() ) {
+    // start w/ the last key frame (unless seeked already)
+    client->set_bootstrapped();
+    if ( !client->seek_pending() ) {
+      *client->mutable_pos() = buffer_.Last();
+    }
+    const TimeShiftBuffer::Entry* const entry =
+        buffer_.Get(client->mutable_pos());
+    bootstrapper_.PlayAtBegin(client->callback(),
+                              entry == NULL ? 0 : entry->timestamp_ms_,
+                              client->flavour_mask());
+  }
+  const int64 now = selector_->now();
+  while ( !client->removed() && !client->eos_sent() && !client->is_paused() ) {
+    TimeShiftBuffer::Position* const pos = client->mutable_pos();
+    const TimeShiftBuffer::Entry* const entry = buffer_.Get(pos);
+    if ( entry == NULL || !client->CanSend(entry->timestamp_ms_, now) ) {
+      break;
+    }
+    // hold a reference, the callback may change the buffer position
+    const scoped_ref<const Tag> tag(entry->tag_);
+    const int64 timestamp_ms = entry->timestamp_ms_;
+    ++pos->index_;
+    if ( client->seek_pending() ) {
+      client->clear_seek_pending();
+      client->callback()->Run(scoped_ref<Tag>(new SeekPerformedTag(
+          0, client->flavour_mask())).get(), timestamp_ms);
+      if ( client->removed() ) {
+        break;
+      }
+    }
+    if ( (tag->flavour_mask() & client->flavour_mask()) != 0 ) {
+      client->callback()->Run(tag.get(), timestamp_ms);
+    }
+  }
+  --in_processing_;
+}
+
+void TimeShiftElement::PumpAll() {
+  vector<Client*> clients;
+  for ( ClientMap::iterator it = clients_.begin(); it != clients_.end(); ++it ) {
+    clients.push_back(it->second);
+  }
+  ++in_processing_;
+  for ( int i = 0; i < clients.size(); ++i ) {
+    Pump(clients[i]);
+  }
+  --in_processing_;
+  DeleteRemovedClients();
+}
+
+void TimeShiftElement::DeleteRemovedClients() {
+  if ( in_processing_ > 0 ) {
+    return;
+  }
+  for ( int i = 0; i < removed_clients_.size(); ++i ) {
+    delete removed_clients_[i];
+  }
+  removed_clients_.clear();
+}
+
+}
@@ -0,0 +1,138 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+
+#ifndef __MEDIA_ELEMENTS_TIMESHIFT_ELEMENT_H__
+#define __MEDIA_ELEMENTS_TIMESHIFT_ELEMENT_H__
+
+#include <string>
+#include <whisperlib/common/base/types.h>
+#include WHISPER_HASH_SET_HEADER
+#include <whisperlib/common/base/alarm.h>
+#include <whisperlib/net/base/selector.h>
+#include <whisperstreamlib/base/element.h>
+#include <whisperstreamlib/base/bootstrapper.h>
+#include "elements/standard_library/timeshift/timeshift_buffer.h"
+
+namespace streaming {
+
+// An element that registers once to a live stream, keeps its last
+// minutes in memory (a TimeShiftBuffer) and serves them to any number
+// of clients, each at its own position: the clients can pause and seek
+// back (e.g. "rewind 30 seconds") w/o going to the disk, and they all
+// share the same buffer.
+//
+// A new client starts at the last key frame (so it plays right away).
+// A client that paused or seeked plays from the buffer at the real time
+// speed (plus some write ahead) and becomes live again if it gets to the
+// head of the buffer (e.g. after seeking forward).
+//
+// Seek positions are stream times (the timestamps we send), or, if
+// negative, times relative to the head of the buffer (-30000 is 30
+// seconds behind the live).
+//
+// When the upstream ends we keep the buffer and the clients and
+// periodically try to register again.
+class TimeShiftElement : public Element {
+ public:
+  static const char kElementClassName[];
+  // how often we move the clients that play from the buffer
+  static const int64 kPumpIntervalMs = 100;
+  // how often we retry to register upstream
+  static const int64 kRegisterRetryMs = 3000;
+
+  TimeShiftElement(const string& name,
+                   ElementMapper* mapper,
+                   net::Selector* selector,
+                   const string& media_name,
+                   int64 buffer_ms,
+                   int64 max_buffer_size);
+  virtual ~TimeShiftElement();
+
+  // Element Interface:
+  virtual bool Initialize();
+  virtual bool AddRequest(const string& media, Request* req,
+                          ProcessingCallback* callback);
+  virtual void RemoveRequest(streaming::Request* req);
+  virtual bool HasMedia(const string& media);
+  virtual void ListMedia(const string& media_dir, vector<string>* out);
+  virtual bool DescribeMedia(const string& media, MediaInfoCallback* callback);
+  virtual void Close(Closure* call_on_close);
+
+ private:
+  class Client;
+
+  bool is_registered() const { return req_ != NULL; }
+  // AddRequest / RemoveRequest upstream
+  void Register();
+  void Unregister();
+  // Upstream EOS: unregister, and try again later
+  void StreamEnded();
+
+  // Receives the upstream tags
+  void ProcessTag(const Tag* tag, int64 timestamp_ms);
+  // Sends the client tags from the buffer, as much as its pacing allows
+  void Pump(Client* client);
+  // Pumps all the clients (periodically)
+  void PumpAll();
+  // Deletes the clients removed while we were sending them tags
+  void DeleteRemovedClients();
+
+  net::Selector* const selector_;
+  const string media_name_;
+
+  // the upstream registration
+  streaming::Request* req_;
+  streaming::ProcessingCallback* process_tag_callback_;
+
+  // headers / metadata to send to joining clients
+  Bootstrapper bootstrapper_;
+  TimeShiftBuffer buffer_;
+
+  typedef hash_map<Request*, Client*> ClientMap;
+  ClientMap clients_;
+  // > 0 while we send tags downstream (clients removed meanwhile
+  // are deleted after)
+  int32 in_processing_;
+  vector<Client*> removed_clients_;
+
+  util::Alarm pump_alarm_;
+  util::Alarm register_alarm_;
+  util::Alarm stream_ended_alarm_;
+
+  // called when asynchronous Close completes
+  Closure* close_completed_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TimeShiftElement);
+};
+}
+
+#endif  // __MEDIA_ELEMENTS_TIMESHIFT_ELEMENT_H__
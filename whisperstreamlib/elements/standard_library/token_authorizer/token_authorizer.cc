@@ -0,0 +1,180 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+
+#include <errno.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <whisperlib/common/base/strutil.h>
+#include <whisperlib/common/base/date.h>
+#include "elements/standard_library/token_authorizer/token_authorizer.h"
+
+namespace streaming {
+
+const char TokenAuthorizer::kAuthorizerClassName[] = "token_authorizer";
+
+TokenAuthorizer::TokenAuthorizer(const string& name,
+                                 const string& secret,
+                                 int32 time_limit_ms,
+                                 bool bind_to_user,
+                                 bool bind_to_ip)
+    : Authorizer(name),
+      secret_(secret),
+      time_limit_ms_(time_limit_ms),
+      bind_to_user_(bind_to_user),
+      bind_to_ip_(bind_to_ip) {
+}
+
+TokenAuthorizer::~TokenAuthorizer() {
+}
+
+bool TokenAuthorizer::Initialize() {
+  if ( secret_.empty() ) {
+    LOG_ERROR << "TokenAuthorizer: " << name() << " has no secret";
+    return false;
+  }
+  return true;
+}
+
+void TokenAuthorizer::Authorize(const AuthorizerRequest& req,
+                                CompletionCallback* completion) {
+  const int64 valid_ms = Verify(req, timer::Date::Now() / 1000);
+  if ( valid_ms <= 0 ) {
+    completion->Run(AuthorizerReply(false, 0));
+    return;
+  }
+  // We reauthorize when the token expires (or earlier, if configured so)
+  int64 time_limit_ms = valid_ms;
+  if ( time_limit_ms_ > 0 && time_limit_ms_ < time_limit_ms ) {
+    time_limit_ms = time_limit_ms_;
+  }
+  completion->Run(AuthorizerReply(
+      true, static_cast<int32>(min(time_limit_ms,
+                                   static_cast<int64>(kMaxInt32)))));
+}
+void TokenAuthorizer::Cancel(CompletionCallback* completion) {
+  // nothing to do, we authorize synchronously
+}
+
+int64 TokenAuthorizer::Verify(const AuthorizerRequest& req,
+                              int64 now_sec) const {
+  const size_t pos = req.token_.find('-');
+  if ( pos == string::npos || pos == 0 ) {
+    return 0;
+  }
+  const string expires(req.token_.substr(0, pos));
+  errno = 0;
+  char* end = NULL;
+  const int64 expires_sec = ::strtoll(expires.c_str(), &end, 10);
+  if ( errno != 0 || *end != '\0' || expires_sec <= now_sec ) {
+    return 0;
+  }
+  const string expected(Signature(GetResourcePath(req.resource_), expires,
+                                  req.user_, GetIp(req.net_address_)));
+  if ( expected.empty() ) {
+    // HMAC failed - "<expires>-" must not pass
+    return 0;
+  }
+  const char* const signature = req.token_.c_str() + pos + 1;
+  if ( req.token_.size() - pos - 1 != expected.size() ) {
+    return 0;
+  }
+  // constant time compare - do not leak how much of the signature matched
+  uint8 diff = 0;
+  for ( size_t i = 0; i < expected.size(); ++i ) {
+    diff |= (::tolower(signature[i]) ^ expected[i]);
+  }
+  if ( diff != 0 ) {
+    return 0;
+  }
+  return (expires_sec - now_sec) * 1000;
+}
+
+string TokenAuthorizer::Sign(const string& resource, int64 expires_sec,
+                             const string& user, const string& ip) const {
+  const string expires(strutil::StringPrintf("%" PRId64, expires_sec));
+  return expires + "-" + Signature(GetResourcePath(resource), expires,
+                                   user, ip);
+}
+
+string TokenAuthorizer::Signature(const string& resource_path,
+                                  const string& expires,
+                                  const string& user,
+                                  const string& ip) const {
+  string msg(resource_path + "|" + expires);
+  if ( bind_to_user_ ) {
+    msg += "|" + user;
+  }
+  if ( bind_to_ip_ ) {
+    msg += "|" + ip;
+  }
+  uint8 md[EVP_MAX_MD_SIZE];
+  unsigned int md_len = 0;
+  if ( NULL == HMAC(EVP_sha256(), secret_.data(), secret_.size(),
+                    reinterpret_cast<const uint8*>(msg.data()), msg.size(),
+                    md, &md_len) ) {
+    LOG_ERROR << "TokenAuthorizer: " << name() << " HMAC failed";
+    return "";
+  }
+  static const char kHex[] = "0123456789abcdef";
+  string ret(2 * md_len, '0');
+  for ( unsigned int i = 0; i < md_len; ++i ) {
+    ret[2 * i] = kHex[md[i] >> 4];
+    ret[2 * i + 1] = kHex[md[i] & 0x0f];
+  }
+  return ret;
+}
+
+string TokenAuthorizer::GetResourcePath(const string& resource) {
+  string path(resource.substr(0, resource.find_first_of("?#")));
+  const size_t scheme = path.find("://");
+  if ( scheme != string::npos ) {
+    const size_t slash = path.find('/', scheme + 3);
+    path = slash == string::npos ? string("/") : path.substr(slash);
+  }
+  return path;
+}
+
+string TokenAuthorizer::GetIp(const string& net_address) {
+  if ( !net_address.empty() && net_address[0] == '[' ) {
+    // [ipv6]:port
+    const size_t end = net_address.find(']');
+    return net_address.substr(1, end == string::npos ? end : end - 1);
+  }
+  const size_t pos = net_address.rfind(':');
+  if ( pos == string::npos || net_address.find(':') != pos ) {
+    // no port, or a plain ipv6 address
+    return net_address;
+  }
+  return net_address.substr(0, pos);
+}
+
+}
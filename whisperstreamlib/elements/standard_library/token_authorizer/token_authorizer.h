@@ -0,0 +1,101 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+
+#ifndef __MEDIA_STANDARD_LIBRARY_TOKEN_AUTHORIZER_H__
+#define __MEDIA_STANDARD_LIBRARY_TOKEN_AUTHORIZER_H__
+
+#include <string>
+#include <whisperstreamlib/base/stream_auth.h>
+
+namespace streaming {
+
+// This is an authorizer that verifies signed, expiring tokens - locally,
+// w/ no I/O (no round trip to an authorization server, per viewer).
+//
+// The token (AuthorizerRequest::token_, i.e. the "wtoken" url query
+// parameter / RTMP connect argument) looks like: <expires>-<signature>
+//   expires: the unix time (seconds) when the token expires
+//   signature: the hex HMAC-SHA256 (w/ the shared secret) of
+//              "<resource path>|<expires>[|<user>][|<ip>]"
+//              (the user and the ip are there if we bind the tokens to
+//              them).
+// The resource path is the path of the requested url (w/o the query).
+//
+// We grant the access until the token expires (or for time_limit_ms,
+// if shorter) - so the viewers get reauthorized (and dropped) when their
+// tokens expire.
+class TokenAuthorizer : public Authorizer {
+ public:
+  static const char kAuthorizerClassName[];
+  TokenAuthorizer(const string& name,
+                  const string& secret,
+                  int32 time_limit_ms,
+                  bool bind_to_user,
+                  bool bind_to_ip);
+  virtual ~TokenAuthorizer();
+
+  /////////////////////////////////////////
+  // Authorizer methods
+  virtual bool Initialize();
+  virtual void Authorize(const AuthorizerRequest& req,
+                         CompletionCallback* completion);
+  virtual void Cancel(CompletionCallback* completion);
+
+  // Verifies the token in req (at now_sec, unix time). Returns the number
+  // of ms the token is still valid for, or 0 if not valid.
+  int64 Verify(const AuthorizerRequest& req, int64 now_sec) const;
+
+  // Generates the token for the given resource, expiring at expires_sec
+  // (user / ip - used only if we bind to them).
+  string Sign(const string& resource, int64 expires_sec,
+              const string& user, const string& ip) const;
+
+  // The path of the url in resource ("rtmp://h/app/stream?x=y" ->
+  // "/app/stream")
+  static string GetResourcePath(const string& resource);
+  // The ip part of net_address ("1.2.3.4:80" -> "1.2.3.4")
+  static string GetIp(const string& net_address);
+
+ private:
+  string Signature(const string& resource_path, const string& expires,
+                   const string& user, const string& ip) const;
+
+  const string secret_;
+  const int32 time_limit_ms_;
+  const bool bind_to_user_;
+  const bool bind_to_ip_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TokenAuthorizer);
+};
+}
+
+#endif  // __MEDIA_STANDARD_LIBRARY_TOKEN_AUTHORIZER_H__
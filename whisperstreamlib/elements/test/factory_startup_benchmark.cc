@@ -0,0 +1,140 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+// Measures how long it takes to bring up the elements of a large
+// (synthetic) configuration. Run w/ and w/o --lazy_element_creation to
+// compare deferring the passive elements against creating everything
+// upfront.
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/gflags.h>
+#include <whisperlib/common/base/timer.h>
+#include <whisperlib/common/base/strutil.h>
+
+#include <whisperlib/net/base/selector.h>
+
+#include "elements/factory.h"
+#include "elements/factory_based_mapper.h"
+
+//////////////////////////////////////////////////////////////////////
+
+DEFINE_string(libraries_dir,
+              "",
+              "Where to load the element libraries from");
+DEFINE_int32(num_elements,
+             100000,
+             "Create a configuration w/ these many elements");
+DEFINE_string(element_type,
+              "normalizing",
+              "The type of the elements in the configuration");
+DEFINE_string(element_params,
+              "{}",
+              "The (JSON) parameters of each element");
+
+DECLARE_bool(lazy_element_creation);
+
+//////////////////////////////////////////////////////////////////////
+
+static void Report(const char* name, int64 start_ns) {
+  const int64 duration_ns = timer::TicksNsec() - start_ns;
+  LOG_INFO << name << ": " << FLAGS_num_elements << " elements in "
+           << duration_ns / 1000000LL << " ms";
+}
+
+// Same setup as whispercast's MediaMapper (the factory and the
+// mapper point to each other)
+class StartupBenchmark {
+ public:
+  explicit StartupBenchmark(net::Selector* selector)
+      : selector_(selector),
+        factory_(&mapper_, selector, NULL, NULL, NULL, NULL, "",
+                 NULL, NULL),
+        mapper_(selector, &factory_, NULL) {
+  }
+
+  void Run() {
+    CHECK(factory_.InitializeLibraries(FLAGS_libraries_dir, NULL))
+        << " Cannot load libraries from: [" << FLAGS_libraries_dir << "]";
+
+    ElementConfigurationSpecs specs;
+    for ( int32 i = 0; i < FLAGS_num_elements; ++i ) {
+      MediaElementSpecs spec;
+      spec.type_.set(FLAGS_element_type);
+      spec.name_.set(strutil::StringPrintf("e%d", i));
+      spec.is_global_.set(true);
+      spec.disable_rpc_.set(true);
+      spec.params_.set(FLAGS_element_params);
+      specs.elements_.ref().push_back(spec);
+    }
+
+    const int64 start = timer::TicksNsec();
+    vector<string> errors;
+    CHECK(factory_.AddSpecs(specs, &errors)) << strutil::ToString(errors);
+    Report("ElementFactory::AddSpecs", start);
+
+    const int64 start_init = timer::TicksNsec();
+    CHECK(mapper_.Initialize());
+    Report("FactoryBasedElementMapper::Initialize", start_init);
+
+    const int64 start_first = timer::TicksNsec();
+    const string media = strutil::StringPrintf("e%d", FLAGS_num_elements / 2);
+    CHECK(mapper_.HasMedia(media));
+    LOG_INFO << "First use of [" << media << "]: "
+             << (timer::TicksNsec() - start_first) / 1000 << " us";
+    Report("Total startup", start);
+
+    mapper_.Close(NewCallback(this, &StartupBenchmark::Closed));
+  }
+
+ private:
+  void Closed() {
+    selector_->MakeLoopExit();
+  }
+
+  net::Selector* const selector_;
+  streaming::ElementFactory factory_;
+  streaming::FactoryBasedElementMapper mapper_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(StartupBenchmark);
+};
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  LOG_INFO << "Lazy element creation: "
+           << (FLAGS_lazy_element_creation ? "on" : "off");
+  net::Selector selector;
+  StartupBenchmark benchmark(&selector);
+  selector.RunInSelectLoop(NewCallback(&benchmark, &StartupBenchmark::Run));
+  selector.Loop();
+  LOG_INFO << "DONE";
+}
@@ -54,6 +54,53 @@ void FlvHeader::AppendStandardHeader(io::MemoryStream* out,
   h->Write(out);
 }
 
+namespace {
+// Bodies at least this large are linked from the decode buffer, smaller
+// ones are copied (they would pin a whole buffer block for a few bytes).
+const uint32 kMinBodyReferenceSize = 512;
+void ReadBody(io::MemoryStream& in, uint32 size, io::MemoryStream* out) {
+  if ( size >= kMinBodyReferenceSize ) {
+    out->AppendStreamByReference(&in, size);
+  } else {
+    out->AppendStream(&in, size);
+  }
+}
+
+// Looks at the first VCL NALU in an AVC_NALU video body and returns true
+// if it has nal_ref_idc == 0 (i.e. no other picture references it).
+// Assumes the usual 4 byte NALU lengths.
+bool IsAvcNonReference(const io::MemoryStream& data) {
+  // We read w/ our own pointer (no copy of the body, no marker)
+  io::DataBlockPointer reader(data.GetReadPointer());
+  int32 left = data.Size();
+  // flags (1) + avc packet type (1) + composition time (3)
+  if ( left <= 5 || reader.Advance(5) != 5 ) {
+    return false;
+  }
+  left -= 5;
+  for ( int i = 0; i < 8 && left > 4; ++i ) {
+    // NALU size (4) + NALU header (1)
+    uint8 buf[5];
+    if ( reader.ReadData(reinterpret_cast<char*>(buf), 5) != 5 ) {
+      return false;
+    }
+    left -= 5;
+    const int32 nalu_size = (static_cast<int32>(buf[0]) << 24) |
+                            (buf[1] << 16) | (buf[2] << 8) | buf[3];
+    if ( nalu_size <= 0 || nalu_size - 1 > left ) {
+      return false;
+    }
+    const uint8 nalu_type = buf[4] & 0x1f;
+    if ( nalu_type >= 1 && nalu_type <= 5 ) {
+      return (buf[4] & 0x60) == 0;
+    }
+    reader.Advance(nalu_size - 1);
+    left -= nalu_size - 1;
+  }
+  return false;
+}
+}
+
 void FlvTag::LearnAttributes() {
   switch ( body().type() ) {
     case FLV_FRAMETYPE_VIDEO: {
@@ -61,6 +108,9 @@ void FlvTag::LearnAttributes() {
       add_attributes(Tag::ATTR_VIDEO);
       if ( video_body.frame_type() == FLV_FLAG_VIDEO_FRAMETYPE_KEYFRAME ) {
         add_attributes(Tag::ATTR_CAN_RESYNC);
+      } else if ( video_body.frame_type() ==
+                  FLV_FLAG_VIDEO_FRAMETYPE_DISPOSABLE ) {
+        add_attributes(Tag::ATTR_NON_REFERENCE);
       }
 
       if ( video_body.codec() == FLV_FLAG_VIDEO_CODEC_AVC ) {
@@ -70,6 +120,11 @@ void FlvTag::LearnAttributes() {
         if ( video_body.avc_packet_type() != AVC_SEQUENCE_HEADER ) {
           add_attributes(Tag::ATTR_DROPPABLE);
         }
+        if ( video_body.avc_packet_type() == AVC_NALU &&
+             !can_resync() &&
+             IsAvcNonReference(video_body.data()) ) {
+          add_attributes(Tag::ATTR_NON_REFERENCE);
+        }
       } else {
         add_attributes(Tag::ATTR_DROPPABLE);
       }
@@ -97,7 +152,7 @@ TagReadStatus FlvTag::Audio::Decode(io::MemoryStream& in, uint32 size) {
     return READ_NO_DATA;
   }
   data_.Clear();
-  data_.AppendStream(&in, size);
+  ReadBody(in, size, &data_);
   return FlvCoder::DecodeAudioFlags(data_, &type_, &format_,
       &rate_, &size_, &is_aac_header_);
 }
@@ -120,7 +175,7 @@ TagReadStatus FlvTag::Video::Decode(io::MemoryStream& in, uint32 size) {
     return READ_NO_DATA;
   }
   data_.Clear();
-  data_.AppendStream(&in, size);
+  ReadBody(in, size, &data_);
   return FlvCoder::DecodeVideoFlags(data_, &codec_,
       &frame_type_, &avc_packet_type_,
       &avc_composition_offset_ms_);
@@ -31,6 +31,7 @@
 
 #include <whisperlib/common/base/log.h>
 #include <whisperlib/common/io/buffer/memory_stream.h>
+#include "base/sync_scanner.h"
 #include "mp3/mp3_frame.h"
 
 namespace streaming {
@@ -50,21 +51,12 @@ streaming::TagReadStatus Mp3FrameTag::Read(io::MemoryStream* in,
                                        bool do_synchronize) {
   if ( version_ == VERSION_UNKNOWN ) {
     uint8 buffer[kMp3HeaderLen];
-    while ( do_synchronize ) {
-      if ( 2 != in->Peek(buffer, 2) ) {
-        return streaming::READ_NO_DATA;
-      }
-      if ( buffer[0] == 0xFF && (buffer[1] & 0xE0) == 0xE0 ) {
-        break;
-      }
-      in->Skip(1);
+    if ( do_synchronize && !SkipToAudioSync(in, kMp3SyncMask) ) {
+      return streaming::READ_NO_DATA;
     }
-    if ( in->Size() < kMp3HeaderLen ) {
+    if ( in->Peek(buffer, kMp3HeaderLen) < kMp3HeaderLen ) {
       return streaming::READ_NO_DATA;
     }
-    in->MarkerSet();
-    CHECK_EQ(in->Read(buffer, kMp3HeaderLen), kMp3HeaderLen);
-    in->MarkerRestore();
     streaming::TagReadStatus err = ExtractHeader(buffer);
     if ( err != streaming::READ_OK ) {
       return err;
@@ -0,0 +1,179 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+//
+// Measures (in MB/s, on one core) how fast we split raw elementary
+// streams: first just looking for sync words / start codes, then
+// Mp3TagSplitter on a synthetic MP3 stream, with junk between frames
+// (as we get from some HTTP radios), fed in network sized blocks.
+//
+// For reference, we also measure the byte by byte Peek() / Skip() search
+// that the splitters used before base/sync_scanner.h.
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/gflags.h>
+#include <whisperlib/common/base/timer.h>
+#include <whisperlib/common/io/buffer/memory_stream.h>
+
+#include <whisperstreamlib/base/sync_scanner.h>
+#include <whisperstreamlib/mp3/mp3_tag_splitter.h>
+
+//////////////////////////////////////////////////////////////////////
+
+DEFINE_int32(data_size,
+             64 << 20,
+             "Split these many bytes in each test");
+DEFINE_int32(block_size,
+             4096,
+             "Feed the data in blocks of this size");
+DEFINE_int32(junk_size,
+             256,
+             "Put these many junk bytes between MP3 frames");
+
+//////////////////////////////////////////////////////////////////////
+
+static void Report(const char* name, int64 start_ns, int64 size) {
+  const int64 duration_ns = max(timer::TicksNsec() - start_ns,
+                                static_cast<int64>(1));
+  LOG_INFO << name << ": " << size << " bytes in "
+           << duration_ns / 1000000LL << " ms => "
+           << static_cast<int64>(size * 1e9 / duration_ns / (1 << 20))
+           << " MB/s";
+}
+
+// Data with no sync words / start codes in it
+static void PrepareJunk(io::MemoryStream* out, int64 size) {
+  char* buffer = new char[FLAGS_block_size];
+  for ( int32 i = 0; i < FLAGS_block_size; ++i ) {
+    buffer[i] = static_cast<char>(1 + random() % 0xfe);
+  }
+  for ( int64 written = 0; written < size; written += FLAGS_block_size ) {
+    out->Write(buffer, FLAGS_block_size);
+  }
+  delete [] buffer;
+}
+
+void BenchmarkPeekSkip() {
+  io::MemoryStream in(FLAGS_block_size);
+  PrepareJunk(&in, FLAGS_data_size);
+  const int64 size = in.Size();
+  const int64 start = timer::TicksNsec();
+  uint8 buf2[2];
+  while ( 2 == in.Peek(buf2, 2) ) {
+    if ( buf2[0] == 0xff && (buf2[1] & 0xf0) == 0xf0 ) {
+      break;
+    }
+    in.Skip(1);
+  }
+  Report("Peek / Skip audio sync search", start, size);
+}
+
+void BenchmarkSkipToAudioSync() {
+  io::MemoryStream in(FLAGS_block_size);
+  PrepareJunk(&in, FLAGS_data_size);
+  const int64 size = in.Size();
+  const int64 start = timer::TicksNsec();
+  CHECK(!streaming::SkipToAudioSync(&in, streaming::kAdtsSyncMask));
+  Report("streaming::SkipToAudioSync", start, size);
+}
+
+void BenchmarkFindStartCode() {
+  io::MemoryStream in(FLAGS_block_size);
+  PrepareJunk(&in, FLAGS_data_size);
+  const int64 size = in.Size();
+  const int64 start = timer::TicksNsec();
+  CHECK_EQ(streaming::FindStartCode(in, 0), -1);
+  Report("streaming::FindStartCode", start, size);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// MPEG 1 Layer III, 128 kbps, 44100 Hz, stereo => 417 bytes frames
+static const uint8 kMp3Header[] = { 0xff, 0xfb, 0x90, 0x00 };
+static const int32 kMp3FrameSize = 417;
+
+static void PrepareMp3(io::MemoryStream* out, int64 size) {
+  string frame(reinterpret_cast<const char*>(kMp3Header),
+               sizeof(kMp3Header));
+  while ( frame.size() < kMp3FrameSize ) {
+    frame.push_back(static_cast<char>(random() % 0xff));
+  }
+  string junk;
+  for ( int32 i = 0; i < FLAGS_junk_size; ++i ) {
+    // no 0xff => no false sync words
+    junk.push_back(static_cast<char>(random() % 0xff));
+  }
+  for ( int64 written = 0; written < size;
+        written += frame.size() + junk.size() ) {
+    out->Write(frame);
+    out->Write(junk);
+  }
+}
+
+void BenchmarkMp3Splitter() {
+  io::MemoryStream data(FLAGS_block_size);
+  PrepareMp3(&data, FLAGS_data_size);
+  const int64 size = data.Size();
+  streaming::Mp3TagSplitter splitter("benchmark");
+  io::MemoryStream in;
+  int64 num_tags = 0;
+
+  const int64 start = timer::TicksNsec();
+  while ( !data.IsEmpty() ) {
+    // the way the data comes from the network
+    in.AppendStream(&data, FLAGS_block_size);
+    while ( true ) {
+      scoped_ref<streaming::Tag> tag;
+      int64 timestamp_ms;
+      const streaming::TagReadStatus err =
+          splitter.GetNextTag(&in, &tag, &timestamp_ms, false);
+      if ( err == streaming::READ_NO_DATA ) {
+        break;
+      }
+      CHECK_EQ(err, streaming::READ_OK)
+          << streaming::TagReadStatusName(err);
+      ++num_tags;
+    }
+  }
+  Report("streaming::Mp3TagSplitter", start, size);
+  LOG_INFO << "Mp3TagSplitter: " << num_tags << " tags";
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  BenchmarkPeekSkip();
+  BenchmarkSkipToAudioSync();
+  BenchmarkFindStartCode();
+  BenchmarkMp3Splitter();
+  LOG_INFO << "DONE";
+}
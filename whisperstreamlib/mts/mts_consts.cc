@@ -45,6 +45,16 @@ const char* DecodeStatusName(DecodeStatus status) {
   return "Unknown";
 }
 
+const char* StreamTypeName(uint8 stream_type) {
+  switch ( stream_type ) {
+    case kStreamTypeMpeg1Audio: return "Mpeg1Audio";
+    case kStreamTypeMpeg2Audio: return "Mpeg2Audio";
+    case kStreamTypeAacAdts: return "AacAdts";
+    case kStreamTypeH264: return "H264";
+  }
+  return "Unknown";
+}
+
 string PESStreamIdName(uint8 stream_id) {
   if ( stream_id == kPESStreamIdProgramMap ) { return "ProgramMap"; }
   if ( stream_id == kPESStreamIdPrivate1 ) { return "Private1"; }
@@ -52,6 +52,25 @@ const uint32 kTSPacketSize = 188;
 // transport stream packets start with this byte
 const uint8 kTSSyncByte = 0x47;
 
+// well known PIDs
+const uint16 kPATPid = 0x0000;
+const uint16 kNullPid = 0x1fff;
+
+// PSI table ids
+const uint8 kTableIdPAT = 0x00;
+const uint8 kTableIdPMT = 0x02;
+
+// stream_type values in the PMT, for the streams we know to demux
+const uint8 kStreamTypeMpeg1Audio = 0x03;
+const uint8 kStreamTypeMpeg2Audio = 0x04;
+const uint8 kStreamTypeAacAdts = 0x0f;
+const uint8 kStreamTypeH264 = 0x1b;
+const char* StreamTypeName(uint8 stream_type);
+
+// PCR base, PTS and DTS are 33 bit counters of a 90kHz clock
+const uint64 kTimestampMask = (1ULL << 33) - 1;
+const uint32 kTimestampClockRate = 90000;
+
 // PES packets start with this marker (Network Byte Order == BIGENDIAN)
 const uint32 kPESMarker = 0x000001;
 
@@ -29,6 +29,13 @@
 //
 // Author: Cosmin Tudorache
 
+#include <string.h>
+
+#include <whisperlib/common/io/buffer/data_block.h>
+#include <whisperstreamlib/base/media_info_util.h>
+#include <whisperstreamlib/base/sync_scanner.h>
+#include <whisperstreamlib/flv/flv_consts.h>
+#include <whisperstreamlib/mp3/mp3_frame.h>
 #include <whisperstreamlib/mts/mts_decoder.h>
 #include <whisperstreamlib/mts/mts_consts.h>
 #include <whisperstreamlib/mts/mts_tag.h>
@@ -36,6 +43,18 @@
 DEFINE_int32(mts_log_level, LERROR,
              "Enables MPEG TS debug messages. Set to 4 for all messages.");
 
+DEFINE_int32(mts_max_timestamp_jump_ms, 10000,
+             "MPEG TS timestamps that jump more than this (either way) are "
+             "considered a discontinuity in the source, and we stitch the "
+             "timeline over them.");
+
+#define MTS_LOG(level) if ( FLAGS_mts_log_level < level ); \
+                       else LOG(INFO) << name() << ": "
+#define MTS_LOG_DEBUG   MTS_LOG(LDEBUG)
+#define MTS_LOG_INFO    MTS_LOG(LINFO)
+#define MTS_LOG_WARNING MTS_LOG(LWARNING)
+#define MTS_LOG_ERROR   MTS_LOG(LERROR)
+
 namespace streaming {
 namespace mts {
 
@@ -65,30 +84,782 @@ DecodeStatus PESDecoder::Read(io::MemoryStream& in,
 
 ///////////////////////////////////////////////////////////////////
 
+Clock::Clock(int64 max_jump_ms)
+  : max_jump_(max_jump_ms * kTimestampClockRate / 1000),
+    initialized_(false),
+    discontinuity_(false),
+    last_ts_(0),
+    ticks_(0),
+    num_jumps_(0) {
+}
+
+void Clock::Reset() {
+  initialized_ = false;
+  discontinuity_ = false;
+  last_ts_ = 0;
+  ticks_ = 0;
+}
+
+void Clock::Discontinuity() {
+  discontinuity_ = true;
+}
+
+int64 Clock::ToMs(uint64 ts) {
+  ts &= kTimestampMask;
+  if ( !initialized_ ) {
+    initialized_ = true;
+    last_ts_ = ts;
+    ticks_ = 0;
+    return 0;
+  }
+  // the difference modulo 2^33 (this unrolls the wrap around),
+  // in [-2^32, 2^32)
+  int64 delta = static_cast<int64>((ts - last_ts_) & kTimestampMask);
+  if ( delta >= (1LL << 32) ) {
+    delta -= (1LL << 33);
+  }
+  if ( discontinuity_ || delta > max_jump_ || delta < -max_jump_ ) {
+    // a new timeline in the source, continue ours from where we are
+    discontinuity_ = false;
+    num_jumps_++;
+    delta = 0;
+  }
+  last_ts_ = ts;
+  ticks_ += delta;
+  // Timestamps of the other stream may be a bit behind the first one
+  return ticks_ > 0 ? ticks_ * 1000 / kTimestampClockRate : 0;
+}
+
+///////////////////////////////////////////////////////////////////
+
+namespace {
+// H.264 NALU types we care about
+const uint8 kNaluTypeIdr = 5;
+const uint8 kNaluTypeSps = 7;
+const uint8 kNaluTypePps = 8;
+const uint8 kNaluTypeAud = 9;
+
+// FLV audio flags: AAC, 44kHz, 16 bit, stereo (always so for AAC)
+const uint8 kFlvAudioFlagsAac = 0xaf;
+
+// ADTS sampling_frequency_index -> sample rate
+const uint32 kAdtsSampleRates[] = {
+  96000, 88200, 64000, 48000, 44100, 32000,
+  24000, 22050, 16000, 12000, 11025, 8000, 7350 };
+// samples in an AAC frame
+const uint32 kAacFrameSamples = 1024;
+
+// Larger pieces are linked from the PES buffer, smaller ones are copied
+// (they would pin a whole buffer block for a few bytes).
+const int32 kMinReferenceSize = 512;
+
+// composition offsets over this are surely broken timestamps
+const int32 kMaxCompositionOffsetMs = 10000;
+
+void MoveData(io::MemoryStream* in, int32 size, io::MemoryStream* out) {
+  if ( size >= kMinReferenceSize ) {
+    out->AppendStreamByReference(in, size);
+  } else {
+    out->AppendStream(in, size);
+  }
+}
+
+uint8 ByteAt(const io::MemoryStream& in, int32 offset) {
+  io::DataBlockPointer ptr(in.GetReadPointer());
+  ptr.Advance(offset);
+  const char* data = NULL;
+  int32 size = 1;
+  CHECK(ptr.ReadBlock(&data, &size));
+  return static_cast<uint8>(*data);
+}
+
+// Returns the offset of the first 'byte' in 'in', at or after 'from',
+// or -1 if none.
+int32 FindByte(const io::MemoryStream& in, int32 from, uint8 byte) {
+  if ( in.Size() <= static_cast<uint32>(from) ) {
+    return -1;
+  }
+  io::DataBlockPointer ptr(in.GetReadPointer());
+  if ( from > 0 ) {
+    ptr.Advance(from);
+  }
+  int32 offset = from;
+  const char* data = NULL;
+  int32 size = 0;
+  while ( ptr.ReadBlock(&data, &size) ) {
+    const char* p = reinterpret_cast<const char*>(memchr(data, byte, size));
+    if ( p != NULL ) {
+      return offset + (p - data);
+    }
+    offset += size;
+    size = 0;
+  }
+  return -1;
+}
+
+// Looks for the start of a TS packet: a sync byte followed, one packet
+// later, by another one (if we have the data to check that).
+int32 FindPacketStart(const io::MemoryStream& in) {
+  int32 pos = 0;
+  while ( (pos = FindByte(in, pos, kTSSyncByte)) >= 0 ) {
+    if ( pos + kTSPacketSize >= in.Size() ||
+         ByteAt(in, pos + kTSPacketSize) == kTSSyncByte ) {
+      return pos;
+    }
+    pos++;
+  }
+  return -1;
+}
+
+// Checks the continuity counter 'cc' of a packet w/ payload, against
+// the one of the previous packet, in '*last_cc'.
+// Returns false for a duplicate packet (to be ignored). Sets '*lost'
+// if there are packets missing in between.
+bool CheckContinuity(int8* last_cc, uint8 cc, bool discontinuity,
+                     bool* lost) {
+  *lost = false;
+  if ( *last_cc >= 0 && !discontinuity ) {
+    if ( cc == *last_cc ) {
+      return false;  // the same packet, sent twice
+    }
+    *lost = (cc != ((*last_cc + 1) & 0x0f));
+  }
+  *last_cc = cc;
+  return true;
+}
+
+FlvTag* NewVideoTag(int64 timestamp_ms, bool is_header, bool is_keyframe,
+                    int32 composition_offset_ms, io::MemoryStream* data) {
+  // 4 bits: frame type (1 keyframe, 2 interframe), 4 bits: codec (7 = AVC)
+  // 8 bits: AVC packet type (0 = sequence header, 1 = NALUs)
+  // 24 bits: composition time offset
+  io::MemoryStream buf;
+  io::NumStreamer::WriteByte(&buf,
+      (is_header || is_keyframe ? 0x10 : 0x20) | 0x07);
+  io::NumStreamer::WriteByte(&buf, is_header ? 0x00 : 0x01);
+  io::NumStreamer::WriteUInt24(&buf, composition_offset_ms,
+                               common::BIGENDIAN);
+  buf.AppendStream(data);
+
+  FlvTag* tag = new FlvTag(0, kDefaultFlavourMask, timestamp_ms,
+                           FLV_FRAMETYPE_VIDEO);
+  CHECK_EQ(tag->mutable_body().Decode(buf, buf.Size()), READ_OK);
+  tag->LearnAttributes();
+  return tag;
+}
+
+// FLV audio flags for MPEG audio: MP3, 16 bit, the rate and channels of
+// the frame. FLV has only the 44kHz rate and its divisors, each MPEG
+// version gets one of them (the decoders go by the frame header anyway).
+uint8 Mp3AudioFlags(const Mp3FrameTag& frame) {
+  FlvFlagSoundRate rate = FLV_FLAG_SOUND_RATE_44_KHZ;
+  if ( frame.version() == Mp3FrameTag::MPEG_VERSION_2 ) {
+    rate = FLV_FLAG_SOUND_RATE_22_KHZ;
+  } else if ( frame.version() == Mp3FrameTag::MPEG_VERSION_2_5 ) {
+    rate = FLV_FLAG_SOUND_RATE_11_KHZ;
+  }
+  return (FLV_FLAG_SOUND_FORMAT_MP3 << 4) | (rate << 2) |
+         (FLV_FLAG_SOUND_SIZE_16_BIT << 1) |
+         (frame.channels() == 2 ? FLV_FLAG_SOUND_TYPE_STEREO
+                                : FLV_FLAG_SOUND_TYPE_MONO);
+}
+
+FlvTag* NewAudioTag(int64 timestamp_ms, uint8 flags, bool is_header,
+                    io::MemoryStream* data) {
+  // 8 bits: audio flags (see kFlvAudioFlagsAac, Mp3AudioFlags())
+  // for AAC, 8 bits: packet type (0 = AAC header, 1 = AAC raw data)
+  io::MemoryStream buf;
+  io::NumStreamer::WriteByte(&buf, flags);
+  if ( flags == kFlvAudioFlagsAac ) {
+    io::NumStreamer::WriteByte(&buf, is_header ? 0x00 : 0x01);
+  }
+  buf.AppendStream(data);
+
+  FlvTag* tag = new FlvTag(0, kDefaultFlavourMask, timestamp_ms,
+                           FLV_FRAMETYPE_AUDIO);
+  CHECK_EQ(tag->mutable_body().Decode(buf, buf.Size()), READ_OK);
+  tag->LearnAttributes();
+  return tag;
+}
+}
+
+///////////////////////////////////////////////////////////////////
+
+Splitter::Stream::Stream(uint16 pid, uint8 type)
+  : pid_(pid),
+    type_(type),
+    cc_(-1),
+    synced_(false),
+    pes_size_(0),
+    pes_(),
+    last_ms_(0),
+    wait_keyframe_(true),
+    sps_(),
+    pps_(),
+    aac_config_(0),
+    sample_rate_(0),
+    channels_(0),
+    header_() {
+}
+
 Splitter::Splitter(const string& name)
   : streaming::TagSplitter(MFORMAT_MTS, name),
-    ts_decoder_(),
-    pes_buffer_(),
-    pes_decoder_() {
+    pat_(),
+    pmt_(),
+    pat_version_(-1),
+    pmt_version_(-1),
+    pcr_pid_(kNullPid),
+    video_(NULL),
+    audio_(NULL),
+    clock_(FLAGS_mts_max_timestamp_jump_ms),
+    tags_to_send_next_(),
+    mts_stats_() {
+  pat_.pid_ = kPATPid;
 }
 Splitter::~Splitter() {
+  ClearStreams();
+}
+
+void Splitter::ClearStreams() {
+  delete video_;
+  video_ = NULL;
+  delete audio_;
+  audio_ = NULL;
 }
 
-DecodeStatus Splitter::FetchTSPacket(io::MemoryStream* in) {
-  scoped_ref<TSPacket> p;
-  DecodeStatus status = ts_decoder_.Read(*in, &p);
-  if ( status != DECODE_SUCCESS ) { return status; }
-  LOG_WARNING << "# " << p.ToString();
-  if ( p->payload() != NULL ) {
-    pes_buffer_.AppendStreamNonDestructive(p->payload());
+void Splitter::ProcessPacket(const uint8* p) {
+  mts_stats_.num_packets_++;
+  const bool transport_error = (p[1] & 0x80) != 0;
+  const bool pusi = (p[1] & 0x40) != 0;
+  const uint16 pid = (static_cast<uint16>(p[1] & 0x1f) << 8) | p[2];
+  const uint8 scrambling = p[3] >> 6;
+  const bool has_adaptation = (p[3] & 0x20) != 0;
+  const bool has_payload = (p[3] & 0x10) != 0;
+  const uint8 cc = p[3] & 0x0f;
+
+  if ( pid == kNullPid ) {
+    return;
   }
-  return DECODE_SUCCESS;
+  Stream* const stream =
+      video_ != NULL && pid == video_->pid_ ? video_ :
+      audio_ != NULL && pid == audio_->pid_ ? audio_ : NULL;
+  if ( transport_error ) {
+    // the demodulator could not correct this one
+    MTS_LOG_WARNING << "Transport error on pid: " << pid;
+    if ( stream != NULL ) {
+      DropPes(stream);
+    }
+    return;
+  }
+
+  int32 offset = 4;
+  bool discontinuity = false;
+  if ( has_adaptation ) {
+    const uint8 adaptation_size = p[4];
+    offset = 5 + adaptation_size;
+    if ( offset > static_cast<int32>(kTSPacketSize) ) {
+      MTS_LOG_WARNING << "Invalid adaptation field size: "
+                      << static_cast<uint32>(adaptation_size)
+                      << " on pid: " << pid;
+      if ( stream != NULL ) {
+        DropPes(stream);
+      }
+      return;
+    }
+    if ( adaptation_size > 0 ) {
+      discontinuity = (p[5] & 0x80) != 0;
+      if ( pid == pcr_pid_ ) {
+        if ( discontinuity ) {
+          MTS_LOG_INFO << "Discontinuity signaled on PCR pid: " << pid;
+          clock_.Discontinuity();
+        }
+        if ( (p[5] & 0x10) != 0 && adaptation_size >= 7 ) {
+          // 33 bit PCR base (we ignore the 27MHz extension)
+          const uint64 pcr = (static_cast<uint64>(p[6]) << 25) |
+                             (static_cast<uint64>(p[7]) << 17) |
+                             (static_cast<uint64>(p[8]) << 9) |
+                             (static_cast<uint64>(p[9]) << 1) |
+                             (p[10] >> 7);
+          // Just keeps the clock going: the timeline starts at the
+          // first PES timestamp, not at the PCR (which comes before it)
+          if ( clock_.initialized() ) {
+            clock_.ToMs(pcr);
+          }
+        }
+      }
+    }
+  }
+  if ( !has_payload ) {
+    return;
+  }
+  const uint8* const data = p + offset;
+  const int32 size = kTSPacketSize - offset;
+  bool lost = false;
+
+  if ( pid == pat_.pid_ || pid == pmt_.pid_ ) {
+    Section* const section = (pid == pat_.pid_ ? &pat_ : &pmt_);
+    if ( !CheckContinuity(&section->cc_, cc, discontinuity, &lost) ) {
+      return;
+    }
+    if ( lost ) {
+      section->data_.Clear();
+    }
+    ProcessSection(section, pusi, data, size);
+    return;
+  }
+  if ( stream == NULL ) {
+    return;
+  }
+  if ( !CheckContinuity(&stream->cc_, cc, discontinuity, &lost) ) {
+    return;
+  }
+  if ( lost ) {
+    mts_stats_.num_cc_errors_++;
+    MTS_LOG_WARNING << "Continuity error on pid: " << pid
+                    << ", packets lost";
+    DropPes(stream);
+  }
+  if ( scrambling != NOT_SCRAMBLED ) {
+    MTS_LOG_WARNING << "Scrambled payload on pid: " << pid;
+    DropPes(stream);
+    return;
+  }
+  ProcessPesPayload(stream, pusi, data, size);
 }
-DecodeStatus Splitter::ReadPESPacket(scoped_ref<PESPacket>* out) {
-  DecodeStatus status = pes_decoder_.Read(pes_buffer_, out);
-  if ( status != DECODE_SUCCESS ) { return status; }
-  LOG_WARNING << "# " << out->ToString();
-  return DECODE_SUCCESS;
+
+void Splitter::ProcessSection(Section* section, bool pusi,
+                              const uint8* data, int32 size) {
+  if ( pusi ) {
+    // The bytes before the pointer field are the end of the previous
+    // section. PAT and PMT fit in one packet, so we ignore them.
+    section->data_.Clear();
+    if ( size < 1 ) {
+      return;
+    }
+    const int32 pointer = 1 + data[0];
+    if ( pointer >= size ) {
+      return;
+    }
+    data += pointer;
+    size -= pointer;
+  } else if ( section->data_.IsEmpty() ) {
+    return;   // not synced, wait for a section start
+  }
+  section->data_.Write(data, size);
+  uint8 h[3];
+  if ( section->data_.Peek(h, sizeof(h)) < static_cast<int32>(sizeof(h)) ) {
+    return;
+  }
+  const int32 length = 3 + ((static_cast<int32>(h[1] & 0x0f) << 8) | h[2]);
+  if ( section->data_.Size() < static_cast<uint32>(length) ) {
+    return;
+  }
+  io::MemoryStream table;
+  table.AppendStream(&section->data_, length);
+  // the rest is stuffing
+  section->data_.Clear();
+
+  if ( section == &pat_ && h[0] == kTableIdPAT ) {
+    ProcessPat(&table);
+  } else if ( section == &pmt_ && h[0] == kTableIdPMT ) {
+    ProcessPmt(&table);
+  }
+}
+
+void Splitter::ProcessPat(io::MemoryStream* in) {
+  ProgramAssociationTable pat;
+  DecodeStatus status = pat.Decode(in);
+  if ( status != DECODE_SUCCESS ) {
+    mts_stats_.num_dropped_sections_++;
+    MTS_LOG_ERROR << "Failed to decode PAT: " << DecodeStatusName(status);
+    return;
+  }
+  if ( pat.version_number() == pat_version_ ) {
+    return;
+  }
+  MTS_LOG_INFO << "New " << pat.ToString();
+  pat_version_ = pat.version_number();
+  if ( pat.program_map_pid().empty() ) {
+    MTS_LOG_ERROR << "No program in PAT";
+    return;
+  }
+  // we follow the first program
+  const uint16 pmt_pid = pat.program_map_pid().begin()->second;
+  if ( pmt_pid != pmt_.pid_ ) {
+    pmt_.pid_ = pmt_pid;
+    pmt_.cc_ = -1;
+    pmt_.data_.Clear();
+    pmt_version_ = -1;
+  }
+}
+
+void Splitter::ProcessPmt(io::MemoryStream* in) {
+  ProgramMapTable pmt;
+  DecodeStatus status = pmt.Decode(in);
+  if ( status != DECODE_SUCCESS ) {
+    mts_stats_.num_dropped_sections_++;
+    MTS_LOG_ERROR << "Failed to decode PMT: " << DecodeStatusName(status);
+    return;
+  }
+  if ( pmt.version_number() == pmt_version_ ) {
+    return;
+  }
+  MTS_LOG_INFO << "New " << pmt.ToString();
+  pmt_version_ = pmt.version_number();
+  pcr_pid_ = pmt.pcr_pid();
+
+  const ProgramMapTable::Stream* video = NULL;
+  const ProgramMapTable::Stream* audio = NULL;
+  for ( uint32 i = 0; i < pmt.streams().size(); i++ ) {
+    const ProgramMapTable::Stream& s = pmt.streams()[i];
+    if ( video == NULL && s.type_ == kStreamTypeH264 ) {
+      video = &s;
+    }
+    if ( audio == NULL && (s.type_ == kStreamTypeAacAdts ||
+                           s.type_ == kStreamTypeMpeg1Audio ||
+                           s.type_ == kStreamTypeMpeg2Audio) ) {
+      audio = &s;
+    }
+  }
+  if ( video == NULL && audio == NULL ) {
+    MTS_LOG_ERROR << "No stream we can demux in " << pmt.ToString();
+  }
+  // keep the streams that did not change
+  if ( video == NULL ||
+       (video_ != NULL && (video_->pid_ != video->pid_ ||
+                           video_->type_ != video->type_)) ) {
+    delete video_;
+    video_ = NULL;
+  }
+  if ( video != NULL && video_ == NULL ) {
+    video_ = new Stream(video->pid_, video->type_);
+  }
+  if ( audio == NULL ||
+       (audio_ != NULL && (audio_->pid_ != audio->pid_ ||
+                           audio_->type_ != audio->type_)) ) {
+    delete audio_;
+    audio_ = NULL;
+  }
+  if ( audio != NULL && audio_ == NULL ) {
+    audio_ = new Stream(audio->pid_, audio->type_);
+  }
+}
+
+void Splitter::ProcessPesPayload(Stream* stream, bool pusi,
+                                 const uint8* data, int32 size) {
+  if ( pusi ) {
+    // a new PES starts => the previous one is complete
+    FlushPes(stream);
+    stream->synced_ = true;
+    stream->pes_size_ = 0;
+    if ( size >= 6 ) {
+      // PES_packet_length: the size after these 6 bytes, 0 = unbounded
+      const uint32 pes_length = (static_cast<uint32>(data[4]) << 8) | data[5];
+      if ( pes_length > 0 ) {
+        stream->pes_size_ = 6 + pes_length;
+      }
+    }
+  } else if ( !stream->synced_ ) {
+    return;
+  }
+  stream->pes_.Write(data, size);
+  if ( stream->pes_size_ > 0 && stream->pes_.Size() >= stream->pes_size_ ) {
+    // complete, no need to wait for the next one
+    FlushPes(stream);
+    stream->synced_ = false;
+  }
+}
+
+void Splitter::DropPes(Stream* stream) {
+  if ( !stream->pes_.IsEmpty() ) {
+    mts_stats_.num_dropped_pes_++;
+    stream->pes_.Clear();
+  }
+  stream->synced_ = false;
+  stream->pes_size_ = 0;
+  if ( stream->is_video() ) {
+    // the following frames may reference the lost one
+    stream->wait_keyframe_ = true;
+  }
+}
+
+void Splitter::FlushPes(Stream* stream) {
+  io::MemoryStream& pes = stream->pes_;
+  if ( pes.IsEmpty() ) {
+    return;
+  }
+  if ( pes.Size() < 9 ||
+       (stream->pes_size_ > 0 && pes.Size() < stream->pes_size_) ) {
+    MTS_LOG_WARNING << "Incomplete PES on pid: " << stream->pid_
+                    << ", size: " << pes.Size()
+                    << ", expected: " << stream->pes_size_;
+    DropPes(stream);
+    return;
+  }
+  const uint32 initial_size = pes.Size();
+  uint8 h[8];
+  pes.Peek(h, sizeof(h));
+  if ( h[0] != 0x00 || h[1] != 0x00 || h[2] != 0x01 ) {
+    MTS_LOG_WARNING << "PES start code not found on pid: " << stream->pid_
+                    << ", in: " << pes.DumpContentInline(16);
+    DropPes(stream);
+    return;
+  }
+  // the PTS_DTS_flags, in the byte after the stream id + size + 1
+  const bool has_pts = (h[7] & 0x80) != 0;
+  pes.Skip(6);
+  PESPacket::Header header;
+  DecodeStatus status = header.Decode(&pes);
+  if ( status != DECODE_SUCCESS ) {
+    MTS_LOG_WARNING << "Failed to decode PES header on pid: " << stream->pid_
+                    << ", status: " << DecodeStatusName(status);
+    DropPes(stream);
+    return;
+  }
+
+  int64 dts_ms = stream->last_ms_;
+  int32 composition_offset_ms = 0;
+  if ( has_pts ) {
+    dts_ms = clock_.ToMs(header.dts_);
+    composition_offset_ms = static_cast<int32>(
+        ((header.pts_ - header.dts_) & kTimestampMask) * 1000 /
+        kTimestampClockRate);
+    if ( composition_offset_ms > kMaxCompositionOffsetMs ) {
+      composition_offset_ms = 0;
+    }
+  }
+  stream->last_ms_ = dts_ms;
+
+  // Anything after the declared size is not ours
+  io::MemoryStream* es = &pes;
+  io::MemoryStream trimmed;
+  if ( stream->pes_size_ > 0 && initial_size > stream->pes_size_ ) {
+    trimmed.AppendStreamByReference(&pes,
+        stream->pes_size_ - (initial_size - pes.Size()));
+    es = &trimmed;
+  }
+  switch ( stream->type_ ) {
+    case kStreamTypeH264:
+      ProcessH264(stream, es, dts_ms, composition_offset_ms);
+      break;
+    case kStreamTypeAacAdts:
+      ProcessAac(stream, es, dts_ms + composition_offset_ms);
+      break;
+    case kStreamTypeMpeg1Audio:
+    case kStreamTypeMpeg2Audio:
+      ProcessMp3(stream, es, dts_ms + composition_offset_ms);
+      break;
+  }
+  pes.Clear();
+}
+
+void Splitter::ProcessH264(Stream* stream, io::MemoryStream* es,
+                           int64 dts_ms, int32 composition_offset_ms) {
+  const int32 start = FindStartCode(*es, 0);
+  if ( start < 0 ) {
+    MTS_LOG_WARNING << "No NALU in H264 PES on pid: " << stream->pid_;
+    return;
+  }
+  es->Skip(start + 3);
+
+  // the frame NALUs, each prefixed by its 4 bytes size
+  io::MemoryStream frame;
+  bool is_keyframe = false;
+  bool new_parameters = false;
+  while ( !es->IsEmpty() ) {
+    const int32 next = FindStartCode(*es, 0);
+    const int32 size = (next < 0 ? es->Size() : next);
+    // trailing zeros (e.g. the first byte of a 4 bytes start code)
+    // are not part of the NALU
+    int32 nalu_size = size;
+    while ( nalu_size > 0 && ByteAt(*es, nalu_size - 1) == 0x00 ) {
+      nalu_size--;
+    }
+    if ( nalu_size > 0 ) {
+      const uint8 nalu_type = io::NumStreamer::PeekByte(es) & 0x1f;
+      if ( nalu_type == kNaluTypeSps || nalu_type == kNaluTypePps ) {
+        // parameter sets go in the AVC sequence header, not in frames
+        string* const ps = (nalu_type == kNaluTypeSps ? &stream->sps_
+                                                      : &stream->pps_);
+        string s;
+        es->ReadString(&s, nalu_size);
+        if ( s != *ps ) {
+          *ps = s;
+          new_parameters = true;
+        }
+      } else if ( nalu_type == kNaluTypeAud ) {
+        es->Skip(nalu_size);
+      } else {
+        if ( nalu_type == kNaluTypeIdr ) {
+          is_keyframe = true;
+        }
+        io::NumStreamer::WriteUInt32(&frame, nalu_size, common::BIGENDIAN);
+        MoveData(es, nalu_size, &frame);
+      }
+    }
+    es->Skip(size - nalu_size + (next < 0 ? 0 : 3));
+  }
+
+  if ( new_parameters && stream->sps_.size() >= 4 && !stream->pps_.empty() ) {
+    // AVCDecoderConfigurationRecord, w/ 4 bytes NALU sizes
+    io::MemoryStream avcc;
+    io::NumStreamer::WriteByte(&avcc, 0x01);  // configuration version
+    io::NumStreamer::WriteByte(&avcc, stream->sps_[1]);  // profile
+    io::NumStreamer::WriteByte(&avcc, stream->sps_[2]);  // compatibility
+    io::NumStreamer::WriteByte(&avcc, stream->sps_[3]);  // level
+    io::NumStreamer::WriteByte(&avcc, 0xff);  // NALU size - 1 = 3
+    io::NumStreamer::WriteByte(&avcc, 0xe1);  // 1 SPS
+    io::NumStreamer::WriteUInt16(&avcc, stream->sps_.size(),
+                                 common::BIGENDIAN);
+    avcc.Write(stream->sps_);
+    io::NumStreamer::WriteByte(&avcc, 0x01);  // 1 PPS
+    io::NumStreamer::WriteUInt16(&avcc, stream->pps_.size(),
+                                 common::BIGENDIAN);
+    avcc.Write(stream->pps_);
+    stream->header_ = NewVideoTag(dts_ms, true, true, 0, &avcc);
+    QueueTag(stream->header_.get(), dts_ms);
+  }
+  if ( frame.IsEmpty() ) {
+    return;
+  }
+  if ( stream->header_.get() == NULL ||
+       (stream->wait_keyframe_ && !is_keyframe) ) {
+    // cannot be decoded: no parameter sets yet, or lost references
+    mts_stats_.num_dropped_frames_++;
+    return;
+  }
+  stream->wait_keyframe_ = false;
+  QueueTag(scoped_ref<FlvTag>(NewVideoTag(dts_ms, false, is_keyframe,
+      composition_offset_ms, &frame)).get(), dts_ms);
+}
+
+void Splitter::ProcessAac(Stream* stream, io::MemoryStream* es,
+                          int64 pts_ms) {
+  // A PES may carry several ADTS frames. Only the first one is
+  // timestamped, the others follow at 1024 samples intervals.
+  int64 num_samples = 0;
+  while ( SkipToAudioSync(es, kAdtsSyncMask) && es->Size() >= 7 ) {
+    uint8 h[7];
+    es->Peek(h, sizeof(h));
+    const bool has_crc = (h[1] & 0x01) == 0;
+    const uint8 profile = h[2] >> 6;
+    const uint8 sample_rate_index = (h[2] >> 2) & 0x0f;
+    const uint8 channels = ((h[2] & 0x01) << 2) | (h[3] >> 6);
+    const int32 frame_size = (static_cast<int32>(h[3] & 0x03) << 11) |
+                             (static_cast<int32>(h[4]) << 3) |
+                             (h[5] >> 5);
+    const int32 header_size = has_crc ? 9 : 7;
+    if ( sample_rate_index >= NUMBEROF(kAdtsSampleRates) ||
+         frame_size <= header_size ) {
+      es->Skip(1);   // a false sync
+      continue;
+    }
+    if ( static_cast<uint32>(frame_size) > es->Size() ) {
+      MTS_LOG_WARNING << "Truncated ADTS frame on pid: " << stream->pid_
+                      << ", size: " << frame_size
+                      << ", available: " << es->Size();
+      break;
+    }
+    const uint32 sample_rate = kAdtsSampleRates[sample_rate_index];
+    const int64 timestamp_ms = pts_ms + num_samples * 1000 / sample_rate;
+    // AudioSpecificConfig: 5 bits object type, 4 bits sampling frequency
+    // index, 4 bits channel configuration, 3 bits 0
+    const uint16 config = (static_cast<uint16>(profile + 1) << 11) |
+                          (static_cast<uint16>(sample_rate_index) << 7) |
+                          (static_cast<uint16>(channels) << 3);
+    if ( config != stream->aac_config_ ) {
+      stream->aac_config_ = config;
+      stream->sample_rate_ = sample_rate;
+      stream->channels_ = channels;
+      io::MemoryStream asc;
+      io::NumStreamer::WriteUInt16(&asc, config, common::BIGENDIAN);
+      stream->header_ = NewAudioTag(timestamp_ms, kFlvAudioFlagsAac, true,
+                                    &asc);
+      QueueTag(stream->header_.get(), timestamp_ms);
+    }
+    es->Skip(header_size);
+    io::MemoryStream raw;
+    MoveData(es, frame_size - header_size, &raw);
+    QueueTag(scoped_ref<FlvTag>(NewAudioTag(timestamp_ms, kFlvAudioFlagsAac,
+        false, &raw)).get(), timestamp_ms);
+    num_samples += kAacFrameSamples;
+  }
+}
+
+void Splitter::ProcessMp3(Stream* stream, io::MemoryStream* es,
+                          int64 pts_ms) {
+  // The FLV flags are those of the first frame in the PES
+  Mp3FrameTag frame(0, kDefaultFlavourMask, pts_ms);
+  bool has_frame = false;
+  while ( !has_frame && SkipToAudioSync(es, kMp3SyncMask) &&
+          es->Size() >= 4 ) {
+    uint8 h[4];
+    es->Peek(h, sizeof(h));
+    has_frame = (frame.ExtractHeader(h) == streaming::READ_OK);
+    if ( !has_frame ) {
+      es->Skip(1);   // a false sync
+    }
+  }
+  if ( !has_frame ) {
+    MTS_LOG_WARNING << "No MPEG audio frame in PES on pid: " << stream->pid_;
+    return;
+  }
+  stream->sample_rate_ = frame.sampling_rate_hz();
+  stream->channels_ = frame.channels();
+  io::MemoryStream data;
+  MoveData(es, es->Size(), &data);
+  scoped_ref<FlvTag> tag = NewAudioTag(pts_ms, Mp3AudioFlags(frame), false,
+                                       &data);
+  if ( stream->header_.get() == NULL ) {
+    // the media info is extracted from it
+    stream->header_ = tag;
+  }
+  QueueTag(tag.get(), pts_ms);
+}
+
+void Splitter::QueueTag(FlvTag* tag, int64 timestamp_ms) {
+  tags_to_send_next_.push_back(TagToSend(tag, timestamp_ms));
+  MaybeExtractMediaInfo(false);
+}
+
+void Splitter::MaybeExtractMediaInfo(bool force) {
+  if ( media_info_extracted_ ) {
+    return;
+  }
+  const bool has_headers =
+      pmt_version_ >= 0 &&
+      (video_ == NULL || video_->header_.get() != NULL) &&
+      (audio_ == NULL || audio_->header_.get() != NULL);
+  if ( !has_headers ) {
+    if ( !force && tags_to_send_next_.size() <= kMediaInfoMaxWait ) {
+      return;
+    }
+    MTS_LOG_ERROR << "Failed to get the stream headers in the first "
+                  << tags_to_send_next_.size() << " tags"
+                  << ", video: " << (video_ == NULL ? "none" :
+                      video_->header_.ToString())
+                  << ", audio: " << (audio_ == NULL ? "none" :
+                      audio_->header_.ToString());
+  }
+  media_info_extracted_ = true;
+
+  // There is no onMetaData in TS, we know all there is from the headers
+  scoped_ref<FlvTag> metadata = new FlvTag(Tag::ATTR_METADATA,
+      kDefaultFlavourMask, 0,
+      new FlvTag::Metadata(kOnMetaData, rtmp::CMixedMap()));
+  util::ExtractMediaInfoFromFlv(*metadata.get(),
+      audio_ == NULL ? NULL : audio_->header_.get(),
+      video_ == NULL ? NULL : video_->header_.get(),
+      &media_info_);
+  if ( audio_ != NULL && audio_->sample_rate_ > 0 ) {
+    media_info_.mutable_audio()->sample_rate_ = audio_->sample_rate_;
+    media_info_.mutable_audio()->channels_ = audio_->channels_;
+  }
+  MTS_LOG_INFO << "Media info: " << media_info_.ToString();
+  if ( generic_tags_ ) {
+    tags_to_send_next_.push_front(TagToSend(
+        new MediaInfoTag(0, kDefaultFlavourMask, media_info_), 0));
+  }
 }
 
 streaming::TagReadStatus Splitter::GetNextTagInternal(
@@ -96,25 +867,57 @@ streaming::TagReadStatus Splitter::GetNextTagInternal(
       scoped_ref<Tag>* tag,
       int64* timestamp_ms,
       bool is_at_eos) {
-  scoped_ref<PESPacket> p;
+  *tag = NULL;
+  uint8 buffer[kTSPacketSize];
   while ( true ) {
-    DecodeStatus status = ReadPESPacket(&p);
-    if ( status == DECODE_SUCCESS ) { break; }
-    if ( status == DECODE_ERROR ) { return streaming::READ_CORRUPTED; }
-    CHECK(status == DECODE_NO_DATA) << "Illegal DecodeStatus: " << (int)status;
-
-    status = FetchTSPacket(in);
-    if ( status == DECODE_ERROR ) { return streaming::READ_CORRUPTED; }
-    if ( status == DECODE_NO_DATA ) { return is_at_eos ? streaming::READ_EOF : streaming::READ_NO_DATA; }
-    CHECK(status == DECODE_SUCCESS) << "Illegal DecodeStatus: " << (int)status;
-    continue;
-  }
+    if ( !tags_to_send_next_.empty() && media_info_extracted_ ) {
+      *tag = tags_to_send_next_.front().tag_;
+      *timestamp_ms = tags_to_send_next_.front().timestamp_ms_;
+      tags_to_send_next_.pop_front();
+      return streaming::READ_OK;
+    }
+    if ( in->Size() < kTSPacketSize ) {
+      if ( !is_at_eos ) {
+        return streaming::READ_NO_DATA;
+      }
+      // the last PES packets are complete now
+      if ( video_ != NULL && video_->synced_ ) {
+        FlushPes(video_);
+        video_->synced_ = false;
+      }
+      if ( audio_ != NULL && audio_->synced_ ) {
+        FlushPes(audio_);
+        audio_->synced_ = false;
+      }
+      MaybeExtractMediaInfo(true);
+      if ( !tags_to_send_next_.empty() ) {
+        continue;
+      }
+      return streaming::READ_EOF;
+    }
 
-  //*tag = new MtsTag();
-  //*timestamp_ms = 0;
-  //return streaming::READ_OK;
+    if ( io::NumStreamer::PeekByte(in) != kTSSyncByte ) {
+      mts_stats_.num_sync_losses_++;
+      const int32 pos = FindPacketStart(*in);
+      MTS_LOG_WARNING << "Lost sync, skipping: "
+                      << (pos < 0 ? in->Size() : pos) << " bytes";
+      in->Skip(pos < 0 ? in->Size() : pos);
+      continue;
+    }
 
-  return streaming::READ_SKIP;
+    // Look at the packet in place, if it is in one block
+    const uint8* p = buffer;
+    io::DataBlockPointer ptr(in->GetReadPointer());
+    const char* data = NULL;
+    int32 size = kTSPacketSize;
+    if ( ptr.ReadBlock(&data, &size) && size == kTSPacketSize ) {
+      p = reinterpret_cast<const uint8*>(data);
+    } else {
+      in->Peek(buffer, kTSPacketSize);
+    }
+    ProcessPacket(p);
+    in->Skip(kTSPacketSize);
+  }
 }
 
 }
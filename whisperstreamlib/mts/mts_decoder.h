@@ -32,9 +32,12 @@
 #ifndef __MEDIA_MTS_MTS_DECODER_H__
 #define __MEDIA_MTS_MTS_DECODER_H__
 
+#include <list>
+#include <string>
 #include <whisperstreamlib/base/media_info.h>
 #include <whisperstreamlib/base/tag.h>
 #include <whisperstreamlib/base/tag_splitter.h>
+#include <whisperstreamlib/flv/flv_tag.h>
 #include <whisperstreamlib/mts/mts_types.h>
 
 namespace streaming {
@@ -54,14 +57,134 @@ class PESDecoder {
   DecodeStatus Read(io::MemoryStream& in, scoped_ref<PESPacket>* out);
 };
 
+// Converts the 33 bit, 90kHz timestamps (PCR base, PTS, DTS) of a program
+// to milliseconds, on one continuous timeline that starts at 0.
+// The counter wrap around (every ~26 hours) is unrolled, and jumps larger
+// than max_jump_ms (a new source, a splice..) are stitched: the timeline
+// goes on from the last timestamp seen before the jump.
+class Clock {
+ public:
+  explicit Clock(int64 max_jump_ms);
+
+  // Forget everything, the next timestamp is 0 again.
+  void Reset();
+  // The source signaled a discontinuity: the next timestamp is stitched
+  // to the current timeline, no matter how close it is.
+  void Discontinuity();
+
+  // Returns the position of 'ts' on our timeline, in ms.
+  int64 ToMs(uint64 ts);
+
+  bool initialized() const { return initialized_; }
+  int64 num_jumps() const { return num_jumps_; }
+
+ private:
+  const int64 max_jump_;     // in 90kHz ticks
+  bool initialized_;
+  bool discontinuity_;
+  uint64 last_ts_;           // the last raw timestamp
+  int64 ticks_;              // the position of last_ts_ on our timeline
+  int64 num_jumps_;
+  DISALLOW_EVIL_CONSTRUCTORS(Clock);
+};
+
+// Demuxes an MPEG-TS stream (a file, or the feed of a hardware encoder)
+// into the FlvTags our FLV path produces: H.264 video, AAC and MP3 audio,
+// preceded by a MediaInfoTag.
+//
+// We follow the first program in the PAT, and in it the first video and
+// the first audio stream that we know. TS packets are not decoded into
+// objects: we look at their headers in place and append their payload to
+// the PES of their PID. The elementary data of a complete PES is then
+// linked (not copied) into the tags.
+//
+// Corrupted input is dropped, not fatal:
+//  - on a sync loss we skip to the next sync byte,
+//  - on a continuity counter error we drop the PES under construction, and
+//    for video we wait for the next key frame.
+//  - a PAT / PMT section w/ a bad CRC_32 is ignored, we keep the tables
+//    we have.
 class Splitter : public streaming::TagSplitter {
  public:
+  struct Stats {
+    Stats()
+      : num_packets_(0), num_sync_losses_(0), num_cc_errors_(0),
+        num_dropped_pes_(0), num_dropped_frames_(0),
+        num_dropped_sections_(0) {}
+    int64 num_packets_;       // TS packets processed
+    int64 num_sync_losses_;   // times we skipped bytes to find a sync byte
+    int64 num_cc_errors_;     // continuity counter errors (lost packets)
+    int64 num_dropped_pes_;   // PES packets dropped (incomplete, corrupted)
+    int64 num_dropped_frames_; // video frames dropped, waiting a key frame
+    int64 num_dropped_sections_; // PAT / PMT dropped (bad CRC_32, invalid)
+  };
+
   Splitter(const string& name);
   virtual ~Splitter();
 
+  const Stats& mts_stats() const { return mts_stats_; }
+  int64 num_clock_jumps() const { return clock_.num_jumps(); }
+
  private:
-  DecodeStatus FetchTSPacket(io::MemoryStream* in);
-  DecodeStatus ReadPESPacket(scoped_ref<PESPacket>* out);
+  // A PSI section (PAT, PMT) under construction
+  struct Section {
+    Section() : pid_(kNullPid), cc_(-1), data_() {}
+    uint16 pid_;
+    int8 cc_;
+    io::MemoryStream data_;
+  };
+  // An elementary stream we demux
+  struct Stream {
+    Stream(uint16 pid, uint8 type);
+    bool is_video() const { return type_ == kStreamTypeH264; }
+    const uint16 pid_;
+    const uint8 type_;
+    // last continuity counter, -1 = unknown
+    int8 cc_;
+    // false: we lost data, drop all payload until the next PES start
+    bool synced_;
+    // the size of the PES being reassembled (from its header), 0 = unknown
+    uint32 pes_size_;
+    io::MemoryStream pes_;
+    // the timestamp of the last PES (for the ones w/o timestamps)
+    int64 last_ms_;
+    // video: drop frames until the next key frame
+    bool wait_keyframe_;
+    // H.264: the current parameter sets (without start code)
+    string sps_;
+    string pps_;
+    // AAC: the current AudioSpecificConfig, 0 = none yet
+    uint16 aac_config_;
+    uint32 sample_rate_;
+    uint8 channels_;
+    // the sequence header (AVC / AAC) last sent, or the first MP3 tag:
+    // we extract the media info from it
+    scoped_ref<FlvTag> header_;
+  };
+
+  // Processes one 188 bytes TS packet.
+  void ProcessPacket(const uint8* p);
+  void ProcessSection(Section* section, bool pusi,
+                      const uint8* data, int32 size);
+  void ProcessPat(io::MemoryStream* in);
+  void ProcessPmt(io::MemoryStream* in);
+  void ProcessPesPayload(Stream* stream, bool pusi,
+                         const uint8* data, int32 size);
+
+  // The PES in 'stream' is complete: turn it into tags.
+  void FlushPes(Stream* stream);
+  void ProcessH264(Stream* stream, io::MemoryStream* es,
+                   int64 dts_ms, int32 composition_offset_ms);
+  void ProcessAac(Stream* stream, io::MemoryStream* es, int64 pts_ms);
+  void ProcessMp3(Stream* stream, io::MemoryStream* es, int64 pts_ms);
+
+  // Lost data on 'stream' (corruption, continuity error)
+  void DropPes(Stream* stream);
+
+  void ClearStreams();
+  void QueueTag(FlvTag* tag, int64 timestamp_ms);
+  // Maybe sends the MediaInfoTag, once we have the stream headers.
+  void MaybeExtractMediaInfo(bool force);
 
   ///////////////////////////////////////////////////////////////////
   // Methods from TagSplitter
@@ -74,9 +197,32 @@ class Splitter : public streaming::TagSplitter {
       bool is_at_eos);
 
  private:
-  TSDecoder ts_decoder_;
-  io::MemoryStream pes_buffer_;
-  PESDecoder pes_decoder_;
+  // wait at most this many tags to extract media info.
+  static const uint32 kMediaInfoMaxWait = 50;
+
+  Section pat_;
+  Section pmt_;
+  int16 pat_version_;
+  int16 pmt_version_;
+  uint16 pcr_pid_;
+
+  Stream* video_;
+  Stream* audio_;
+
+  Clock clock_;
+
+  struct TagToSend {
+    TagToSend(Tag* tag, int64 timestamp_ms):
+      tag_(tag),
+      timestamp_ms_(timestamp_ms) {
+    }
+    scoped_ref<Tag> tag_;
+    int64 timestamp_ms_;
+  };
+  list<TagToSend> tags_to_send_next_;
+
+  Stats mts_stats_;
+
   DISALLOW_EVIL_CONSTRUCTORS(Splitter);
 };
 }
@@ -25,6 +25,53 @@ const char* TSScramblingName(TSScrambling scrambling) {
   return "Unknown";
 }
 
+namespace {
+// CRC_32 lookup table: polynomial 0x04c11db7, MSB first
+struct Crc32Table {
+  Crc32Table() {
+    for ( uint32 i = 0; i < 256; ++i ) {
+      uint32 crc = i << 24;
+      for ( int j = 0; j < 8; ++j ) {
+        crc = (crc & 0x80000000) ? ((crc << 1) ^ 0x04c11db7) : (crc << 1);
+      }
+      table_[i] = crc;
+    }
+  }
+  uint32 table_[256];
+};
+const Crc32Table kCrc32Table;
+
+// Checks the CRC_32 of the PSI section at the start of 'in', w/o
+// consuming anything.
+DecodeStatus CheckSectionCrc(const io::MemoryStream* in, const char* name) {
+  uint8 h[3];
+  if ( in->Peek(h, sizeof(h)) < static_cast<int32>(sizeof(h)) ) {
+    return DECODE_NO_DATA;
+  }
+  const int32 size = 3 + ((static_cast<int32>(h[1] & 0x0f) << 8) | h[2]);
+  if ( in->Size() < static_cast<uint32>(size) ) {
+    return DECODE_NO_DATA;
+  }
+  uint8* const section = new uint8[size];
+  in->Peek(section, size);
+  const uint32 crc = Crc32(section, size);
+  delete [] section;
+  if ( crc != 0 ) {
+    LOG_ERROR << "Cannot decode " << name << ", CRC_32 mismatch";
+    return DECODE_ERROR;
+  }
+  return DECODE_SUCCESS;
+}
+}
+
+uint32 Crc32(const uint8* data, uint32 size) {
+  uint32 crc = 0xffffffff;
+  for ( uint32 i = 0; i < size; ++i ) {
+    crc = (crc << 8) ^ kCrc32Table.table_[((crc >> 24) ^ data[i]) & 0xff];
+  }
+  return crc;
+}
+
 DecodeStatus TSPacket::Decode(io::MemoryStream* in) {
   if ( in->Size() < kTSPacketSize ) {
     return DECODE_NO_DATA;
@@ -93,6 +140,12 @@ DecodeStatus ProgramAssociationTable::Decode(io::MemoryStream* in) {
   if ( in->Size() < 8 ) {
     return DECODE_NO_DATA;
   }
+  // A corrupted table could remap our PIDs
+  const DecodeStatus crc_status = CheckSectionCrc(in,
+                                                  "ProgramAssociationTable");
+  if ( crc_status != DECODE_SUCCESS ) {
+    return crc_status;
+  }
   io::BitArray data;
   data.PutMS(*in, 8);
 
@@ -129,7 +182,7 @@ DecodeStatus ProgramAssociationTable::Decode(io::MemoryStream* in) {
   for ( uint32 i = 5; i < section_length - 4; i += 4 ) {
     uint16 program_number = io::NumStreamer::ReadUInt16(in, common::BIGENDIAN);
     io::BitArray a;
-    a.PutMS(*in, 16);
+    a.PutMS(*in, 2);
     a.Skip(3);
     uint16 pid = a.Read<uint16>(13);
     if ( program_number == 0 ) {
@@ -159,12 +212,95 @@ string ProgramAssociationTable::ToString() const {
 
 ////////////////////////////////////////////////////////////////////////
 
+DecodeStatus ProgramMapTable::Decode(io::MemoryStream* in) {
+  if ( in->Size() < 12 ) {
+    return DECODE_NO_DATA;
+  }
+  // A corrupted table could change our stream PIDs and types
+  const DecodeStatus crc_status = CheckSectionCrc(in, "ProgramMapTable");
+  if ( crc_status != DECODE_SUCCESS ) {
+    return crc_status;
+  }
+  io::BitArray data;
+  data.PutMS(*in, 12);
+
+  table_id_ = data.Read<uint8>(8);
+  CHECK_MARKER_BIT(data); // 1 bit: section_syntax_indicator, must be 1
+  CHECK_ZERO_BIT(data);
+  data.Skip(2); // 2 reserved bits
+  uint16 section_length = data.Read<uint16>(12);
+  program_number_ = data.Read<uint16>(16);
+  data.Skip(2); // 2 reserved bits
+  version_number_ = data.Read<uint8>(5);
+  currently_applicable_ = data.Read<bool>(1);
+  data.Skip(16); // section_number, last_section_number: always 0 for PMT
+  data.Skip(3); // 3 reserved bits
+  pcr_pid_ = data.Read<uint16>(13);
+  data.Skip(4); // 4 reserved bits
+  uint16 program_info_length = data.Read<uint16>(12);
+
+  // section_length counts from program_number_ up to and including the
+  // CRC. We've already decoded 9 bytes from this length.
+  if ( section_length < 13 + program_info_length ) {
+    LOG_ERROR << "Cannot decode ProgramMapTable, invalid section_length"
+                 ": " << section_length << ", program_info_length: "
+              << program_info_length;
+    return DECODE_ERROR;
+  }
+  if ( in->Size() < section_length - 9 ) {
+    return DECODE_NO_DATA;
+  }
+  in->Skip(program_info_length);
+  int32 es_size = section_length - 13 - program_info_length;
+  streams_.clear();
+  while ( es_size >= 5 ) {
+    io::BitArray a;
+    a.PutMS(*in, 5);
+    uint8 stream_type = a.Read<uint8>(8);
+    a.Skip(3);
+    uint16 pid = a.Read<uint16>(13);
+    a.Skip(4);
+    uint16 es_info_length = a.Read<uint16>(12);
+    if ( es_info_length + 5 > es_size ) {
+      LOG_ERROR << "Cannot decode ProgramMapTable, ES_info_length: "
+                << es_info_length << " over the section end";
+      return DECODE_ERROR;
+    }
+    in->Skip(es_info_length);
+    streams_.push_back(Stream(stream_type, pid));
+    es_size -= 5 + es_info_length;
+  }
+  in->Skip(es_size);
+  crc_ = io::NumStreamer::ReadUInt32(in, common::BIGENDIAN);
+  return DECODE_SUCCESS;
+}
+
+string ProgramMapTable::ToString() const {
+  ostringstream oss;
+  oss << "ProgramMapTable{table_id_: " << (uint32)table_id_
+      << ", program_number_: " << program_number_
+      << ", version_number_: " << (uint32)version_number_
+      << ", currently_applicable_: " << strutil::BoolToString(currently_applicable_)
+      << ", pcr_pid_: " << pcr_pid_
+      << ", streams_: [";
+  for ( uint32 i = 0; i < streams_.size(); i++ ) {
+    oss << (i == 0 ? "" : ", ") << StreamTypeName(streams_[i].type_)
+        << "(0x" << strutil::StringPrintf("%02x", streams_[i].type_)
+        << ") @" << streams_[i].pid_;
+  }
+  oss << "], crc_: " << crc_
+      << "}";
+  return oss.str();
+}
+
+////////////////////////////////////////////////////////////////////////
+
 DecodeStatus PESPacket::Header::Decode(io::MemoryStream* in) {
-  if ( in->Size() < 2 ) {
+  if ( in->Size() < 3 ) {
     return DECODE_NO_DATA;
   }
   io::BitArray h;
-  h.PutMS(*in, 1);
+  h.PutMS(*in, 2);
   uint8 mark = h.Read<uint8>(2);
   scrambling_ = (TSScrambling)h.Read<uint8>(2);
   is_priority_ = h.Read<bool>(1);
@@ -182,7 +318,7 @@ DecodeStatus PESPacket::Header::Decode(io::MemoryStream* in) {
   uint8 size = io::NumStreamer::ReadByte(in);
   uint32 start_size = in->Size();
 
-  if ( mark != 0b01 ) {
+  if ( mark != 0b10 ) {
     LOG_ERROR << "Invalid marker before PES: " << strutil::ToBinary(mark);
     return DECODE_ERROR;
   }
@@ -198,6 +334,7 @@ DecodeStatus PESPacket::Header::Decode(io::MemoryStream* in) {
     CHECK_MARKER_BIT(data);
     pts_ = pts_ << 15 | data.Read<uint16>(15);
     CHECK_MARKER_BIT(data);
+    dts_ = pts_; // no DTS => decoded and presented at the same time
   } else if ( has_PTS && has_DTS ) {
     io::BitArray data;
     data.PutMS(*in, 10);
@@ -48,6 +48,11 @@ enum TSScrambling {
 };
 const char* TSScramblingName(TSScrambling scrambling);
 
+// The MPEG-2 CRC_32 (ISO/IEC 13818-1, Annex A) of some data. Over a whole
+// PSI section, w/ its CRC_32 field included, this is 0 for an intact
+// section.
+uint32 Crc32(const uint8* data, uint32 size);
+
 class TSPacket : public RefCounted {
  public:
   struct AdaptationField {
@@ -129,6 +134,11 @@ class ProgramAssociationTable : public RefCounted {
       crc_(0) {}
   virtual ~ProgramAssociationTable() {}
 
+  uint8 version_number() const { return version_number_; }
+  const map<uint16, uint16>& program_map_pid() const {
+    return program_map_pid_;
+  }
+
   DecodeStatus Decode(io::MemoryStream* in);
   void Encode(io::MemoryStream* out) const;
 
@@ -149,6 +159,45 @@ class ProgramAssociationTable : public RefCounted {
 
 ////////////////////////////////////////////////////////////////////////
 
+// Program map table: the elementary streams of one program
+class ProgramMapTable : public RefCounted {
+ public:
+  struct Stream {
+    Stream(uint8 type, uint16 pid) : type_(type), pid_(pid) {}
+    uint8 type_; // e.g. kStreamTypeH264
+    uint16 pid_;
+  };
+  ProgramMapTable()
+    : table_id_(0),
+      program_number_(0),
+      version_number_(0),
+      currently_applicable_(false),
+      pcr_pid_(kNullPid),
+      streams_(),
+      crc_(0) {}
+  virtual ~ProgramMapTable() {}
+
+  uint16 program_number() const { return program_number_; }
+  uint8 version_number() const { return version_number_; }
+  uint16 pcr_pid() const { return pcr_pid_; }
+  const vector<Stream>& streams() const { return streams_; }
+
+  DecodeStatus Decode(io::MemoryStream* in);
+
+  string ToString() const;
+ private:
+  uint8 table_id_;
+  uint16 program_number_;
+  uint8 version_number_;
+  bool currently_applicable_;
+  // the packets of this PID carry the PCR for the program
+  uint16 pcr_pid_;
+  vector<Stream> streams_;
+  uint32 crc_;
+};
+
+////////////////////////////////////////////////////////////////////////
+
 // Packetized Elementary Stream
 class PESPacket : public RefCounted {
  public:
@@ -162,7 +211,7 @@ class PESPacket : public RefCounted {
     bool is_original_;
     // Presentation Time Stamp
     uint64 pts_;
-    // Decoding Time Stamp
+    // Decoding Time Stamp (same as pts_ when the packet has none)
     uint64 dts_;
     // Elementary Stream Clock Reference
     uint64 escr_base_;
@@ -0,0 +1,654 @@
+// Copyright (c) 2012, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Cosmin Tudorache
+//
+// Muxes a small MPEG-TS stream (H.264 + AAC or MP3) and checks the tags that
+// mts::Splitter makes out of it: in one piece or in small chunks, with
+// junk between packets, with lost packets, with damaged PAT / PMT and with
+// timestamps that wrap around or jump.
+// Captured .ts files can be checked too: --ts_file=...
+
+#include <vector>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/gflags.h>
+#include <whisperlib/common/io/buffer/memory_stream.h>
+#include <whisperlib/common/io/file/file_input_stream.h>
+
+#include <whisperstreamlib/flv/flv_tag.h>
+#include <whisperstreamlib/mts/mts_consts.h>
+#include <whisperstreamlib/mts/mts_decoder.h>
+
+//////////////////////////////////////////////////////////////////////
+
+DEFINE_int32(rand_seed,
+             0,
+             "Seed the random with this guy");
+DEFINE_string(ts_file,
+              "",
+              "If specified, we also split this .ts file, and check that "
+              "we get some media out of it");
+
+//////////////////////////////////////////////////////////////////////
+
+using namespace streaming;
+
+static unsigned int rand_seed;
+
+static const uint16 kPmtPid = 0x100;
+static const uint16 kVideoPid = 0x101;
+static const uint16 kAudioPid = 0x102;
+
+static const int32 kNumFrames = 50;          // video frames
+static const int32 kGopSize = 10;            // frames between IDRs
+static const uint64 kFrameTicks = 3600;      // 40ms, at 90kHz
+static const uint64 kCompositionTicks = 7200; // 80ms
+static const int32 kAdtsPerPes = 2;          // AAC frames in a PES
+static const uint64 kAdtsTicks = 1024 * 90000 / 44100;
+
+static const uint8 kSps[] = { 0x67, 0x42, 0xc0, 0x1e, 0xda, 0x02, 0x80 };
+static const uint8 kPps[] = { 0x68, 0xce, 0x3c, 0x80 };
+
+// Mux parameters
+struct Options {
+  Options() : first_ts_(900000), jump_frame_(-1), jump_ticks_(0),
+              corrupt_tables_(false) {}
+  uint64 first_ts_;   // the first DTS
+  int32 jump_frame_;  // from this frame on, timestamps jump w/ jump_ticks_
+  uint64 jump_ticks_;
+  string mp3_header_; // if set, the audio is MPEG audio w/ these frames
+  bool corrupt_tables_; // the repeated PAT / PMT are damaged after the CRC
+};
+
+class Muxer {
+ public:
+  Muxer() : cc_(), packets_(), corrupt_(false) {}
+
+  // The following PAT / PMT are changed, but w/ the CRC of the
+  // original section.
+  void set_corrupt(bool corrupt) { corrupt_ = corrupt; }
+
+  void AddPsi(uint16 pid, string section, uint32 corrupt_offset) {
+    const uint32 crc = mts::Crc32(
+        reinterpret_cast<const uint8*>(section.data()), section.size());
+    if ( corrupt_ ) {
+      section[corrupt_offset] ^= 0x01;
+    }
+    string payload(1, '\0');  // pointer field
+    payload += section;
+    AppendUInt16(&payload, crc >> 16);
+    AppendUInt16(&payload, crc & 0xffff);
+    AddPayload(pid, payload, 0, false);
+  }
+  void AddPat() {
+    string s;
+    s += '\x00';                                  // table id
+    AppendUInt16(&s, 0xb000 | (5 + 4 + 4));       // section length
+    AppendUInt16(&s, 0x0001);                     // ts id
+    s += '\xc1';                                  // version 0, current
+    s += '\x00';
+    s += '\x00';
+    AppendUInt16(&s, 0x0001);                     // program number
+    AppendUInt16(&s, 0xe000 | kPmtPid);
+    AddPsi(0, s, s.size() - 1);                   // the PMT pid
+  }
+  void AddPmt(uint8 audio_stream_type) {
+    string s;
+    s += '\x02';                                  // table id
+    AppendUInt16(&s, 0xb000 | (9 + 2 * 5 + 4));   // section length
+    AppendUInt16(&s, 0x0001);                     // program number
+    s += '\xc1';                                  // version 0, current
+    s += '\x00';
+    s += '\x00';
+    AppendUInt16(&s, 0xe000 | kVideoPid);         // PCR pid
+    AppendUInt16(&s, 0xf000);                     // program info length
+    s += static_cast<char>(mts::kStreamTypeH264);
+    AppendUInt16(&s, 0xe000 | kVideoPid);
+    AppendUInt16(&s, 0xf000);
+    s += static_cast<char>(audio_stream_type);
+    AppendUInt16(&s, 0xe000 | kAudioPid);
+    AppendUInt16(&s, 0xf000);
+    AddPsi(kPmtPid, s, s.size() - 5);             // the audio type
+  }
+  // Splits a PES into packets. 'pcr' > 0 => we put it in the first one.
+  void AddPes(uint16 pid, uint8 stream_id, uint64 pts, uint64 dts,
+              const string& es, uint64 pcr, bool bounded) {
+    string pes;
+    pes += string("\x00\x00\x01", 3);
+    pes += static_cast<char>(stream_id);
+    const int32 header_size = (pts != dts ? 10 : 5);
+    AppendUInt16(&pes, bounded ? 3 + header_size + es.size() : 0);
+    pes += '\x80';
+    pes += (pts != dts ? '\xc0' : '\x80');
+    pes += static_cast<char>(header_size);
+    AppendTimestamp(&pes, pts != dts ? 0x3 : 0x2, pts);
+    if ( pts != dts ) {
+      AppendTimestamp(&pes, 0x1, dts);
+    }
+    pes += es;
+    AddPayload(pid, pes, pcr, true);
+  }
+  const vector<string>& packets() const { return packets_; }
+  vector<string>* mutable_packets() { return &packets_; }
+
+ private:
+  static void AppendUInt16(string* s, uint32 value) {
+    *s += static_cast<char>((value >> 8) & 0xff);
+    *s += static_cast<char>(value & 0xff);
+  }
+  static void AppendTimestamp(string* s, uint8 prefix, uint64 ts) {
+    ts &= mts::kTimestampMask;
+    *s += static_cast<char>((prefix << 4) | ((ts >> 29) & 0x0e) | 0x01);
+    *s += static_cast<char>((ts >> 22) & 0xff);
+    *s += static_cast<char>(((ts >> 14) & 0xfe) | 0x01);
+    *s += static_cast<char>((ts >> 7) & 0xff);
+    *s += static_cast<char>(((ts << 1) & 0xfe) | 0x01);
+  }
+  void AddPayload(uint16 pid, const string& payload, uint64 pcr,
+                  bool stuff_with_adaptation) {
+    uint32 pos = 0;
+    bool first = true;
+    while ( first || pos < payload.size() ) {
+      string p;
+      p += static_cast<char>(mts::kTSSyncByte);
+      p += static_cast<char>((first ? 0x40 : 0x00) | (pid >> 8));
+      p += static_cast<char>(pid & 0xff);
+      string adaptation;
+      if ( first && pcr > 0 ) {
+        adaptation += '\x10';  // PCR flag
+        adaptation += static_cast<char>((pcr >> 25) & 0xff);
+        adaptation += static_cast<char>((pcr >> 17) & 0xff);
+        adaptation += static_cast<char>((pcr >> 9) & 0xff);
+        adaptation += static_cast<char>((pcr >> 1) & 0xff);
+        adaptation += static_cast<char>(((pcr & 0x01) << 7) | 0x7e);
+        adaptation += '\x00';
+      }
+      uint32 room = 184 - (adaptation.empty() ? 0 : 1 + adaptation.size());
+      uint32 size = min(room, static_cast<uint32>(payload.size() - pos));
+      if ( size < room && stuff_with_adaptation ) {
+        // fill the packet w/ adaptation field stuffing
+        uint32 stuffing = room - size;
+        if ( adaptation.empty() ) {
+          stuffing--;  // the adaptation field size
+          if ( stuffing > 0 ) {
+            adaptation += '\x00';  // flags
+            stuffing--;
+          }
+        }
+        adaptation += string(stuffing, '\xff');
+      }
+      const bool has_adaptation = !adaptation.empty() ||
+                                  (size < room && stuff_with_adaptation);
+      p += static_cast<char>((has_adaptation ? 0x30 : 0x10) |
+                             (cc_[pid] & 0x0f));
+      cc_[pid]++;
+      if ( has_adaptation ) {
+        p += static_cast<char>(adaptation.size());
+        p += adaptation;
+      }
+      p += payload.substr(pos, size);
+      pos += size;
+      // PSI: stuff after the section
+      p += string(188 - p.size(), '\xff');
+      CHECK_EQ(p.size(), 188);
+      packets_.push_back(p);
+      first = false;
+    }
+  }
+
+  map<uint16, uint8> cc_;
+  vector<string> packets_;
+  bool corrupt_;
+};
+
+static string VideoFrameData(int32 frame) {
+  // Bytes that never make a start code
+  string s;
+  const int32 size = (frame % kGopSize == 0 ? 3000 : 200 + frame * 7);
+  for ( int32 i = 0; i < size; ++i ) {
+    s += static_cast<char>(0x10 + (frame + i) % 0xe0);
+  }
+  return s;
+}
+static string AudioFrameData(int32 frame) {
+  return string(100 + frame % 50, static_cast<char>(0x20 + frame % 0x40));
+}
+
+static uint64 FrameDts(const Options& options, int32 frame) {
+  uint64 dts = options.first_ts_ + frame * kFrameTicks;
+  if ( options.jump_frame_ >= 0 && frame >= options.jump_frame_ ) {
+    dts += options.jump_ticks_;
+  }
+  return dts;
+}
+
+// Returns the packets of a test stream
+static vector<string> MakeStream(const Options& options) {
+  const uint8 audio_stream_type = options.mp3_header_.empty() ?
+      mts::kStreamTypeAacAdts : mts::kStreamTypeMpeg2Audio;
+  Muxer muxer;
+  muxer.AddPat();
+  muxer.AddPmt(audio_stream_type);
+  int32 audio_frame = 0;
+  for ( int32 i = 0; i < kNumFrames; ++i ) {
+    const uint64 dts = FrameDts(options, i);
+    string es(string("\x00\x00\x00\x01\x09\xf0", 6));  // AUD
+    const bool is_idr = (i % kGopSize == 0);
+    if ( is_idr ) {
+      es += string("\x00\x00\x00\x01", 4);
+      es += string(reinterpret_cast<const char*>(kSps), sizeof(kSps));
+      es += string("\x00\x00\x00\x01", 4);
+      es += string(reinterpret_cast<const char*>(kPps), sizeof(kPps));
+      muxer.set_corrupt(options.corrupt_tables_);
+      muxer.AddPat();
+      muxer.AddPmt(audio_stream_type);
+      muxer.set_corrupt(false);
+    }
+    es += string("\x00\x00\x01", 3);
+    es += (is_idr ? '\x65' : '\x41');
+    es += VideoFrameData(i);
+    muxer.AddPes(kVideoPid, 0xe0, dts + kCompositionTicks, dts, es,
+                 dts - 9000, false);
+
+    // the audio goes along
+    while ( options.first_ts_ + audio_frame * kAdtsTicks <=
+            options.first_ts_ + i * kFrameTicks ) {
+      string aes;
+      for ( int32 j = 0; j < kAdtsPerPes; ++j ) {
+        const string data = AudioFrameData(audio_frame + j);
+        if ( !options.mp3_header_.empty() ) {
+          aes += options.mp3_header_ + data;
+          continue;
+        }
+        const uint32 size = 7 + data.size();
+        aes += '\xff';
+        aes += '\xf1';                                  // MPEG-4, no CRC
+        aes += static_cast<char>(0x40 | (4 << 2) | 0);  // LC, 44100
+        aes += static_cast<char>(0x80 | (size >> 11));  // 2 channels
+        aes += static_cast<char>((size >> 3) & 0xff);
+        aes += static_cast<char>(((size & 0x07) << 5) | 0x1f);
+        aes += '\xfc';
+        aes += data;
+      }
+      uint64 pts = options.first_ts_ + audio_frame * kAdtsTicks;
+      if ( options.jump_frame_ >= 0 &&
+           audio_frame * kAdtsTicks >= options.jump_frame_ * kFrameTicks ) {
+        pts += options.jump_ticks_;
+      }
+      muxer.AddPes(kAudioPid, 0xc0, pts, pts, aes, 0, true);
+      audio_frame += kAdtsPerPes;
+    }
+  }
+  return muxer.packets();
+}
+
+struct Result {
+  Result() : media_info_(), num_video_headers_(0), num_audio_headers_(0) {}
+  scoped_ref<const MediaInfoTag> media_info_;
+  int32 num_video_headers_;
+  int32 num_audio_headers_;
+  vector<scoped_ref<const FlvTag> > video_;
+  vector<int64> video_ts_;
+  vector<scoped_ref<const FlvTag> > audio_;
+  vector<int64> audio_ts_;
+  string dump_;   // all the tags, to compare results
+};
+
+// Splits 'data', fed in chunks of at most 'chunk_size' bytes, in a
+// stream w/ 'block_size' blocks.
+static void Split(mts::Splitter* splitter, const string& data,
+                  int32 block_size, int32 chunk_size, Result* out) {
+  io::MemoryStream in(block_size);
+  uint32 pos = 0;
+  while ( true ) {
+    if ( pos < data.size() ) {
+      const int32 size = min(static_cast<int32>(data.size() - pos),
+                             1 + static_cast<int32>(
+                                 rand_r(&rand_seed) % chunk_size));
+      in.Write(data.data() + pos, size);
+      pos += size;
+    }
+    const bool is_eos = (pos >= data.size());
+    while ( true ) {
+      scoped_ref<Tag> tag;
+      int64 timestamp_ms = 0;
+      TagReadStatus status = splitter->GetNextTag(&in, &tag, &timestamp_ms,
+                                                  is_eos);
+      if ( status == READ_EOF ) {
+        return;
+      }
+      if ( status == READ_NO_DATA ) {
+        CHECK(!is_eos);
+        break;
+      }
+      if ( status == READ_SKIP ) {
+        continue;
+      }
+      CHECK_EQ(status, READ_OK);
+      out->dump_ += strutil::StringPrintf("%"PRId64" ", timestamp_ms) +
+                    tag->ToString() + "\n";
+      if ( tag->type() == Tag::TYPE_MEDIA_INFO ) {
+        CHECK_NULL(out->media_info_.get()) << " Second MediaInfoTag";
+        CHECK(out->video_.empty() && out->audio_.empty());
+        out->media_info_ = static_cast<const MediaInfoTag*>(tag.get());
+        continue;
+      }
+      CHECK_EQ(tag->type(), Tag::TYPE_FLV) << tag->ToString();
+      const FlvTag* flv_tag = static_cast<const FlvTag*>(tag.get());
+      if ( flv_tag->body().type() == FLV_FRAMETYPE_VIDEO ) {
+        if ( flv_tag->video_body().avc_packet_type() == AVC_SEQUENCE_HEADER ) {
+          out->num_video_headers_++;
+        } else {
+          out->video_.push_back(flv_tag);
+          out->video_ts_.push_back(timestamp_ms);
+        }
+      } else if ( flv_tag->body().type() == FLV_FRAMETYPE_AUDIO ) {
+        if ( flv_tag->audio_body().is_aac_header() ) {
+          out->num_audio_headers_++;
+        } else {
+          out->audio_.push_back(flv_tag);
+          out->audio_ts_.push_back(timestamp_ms);
+        }
+      }
+    }
+  }
+}
+
+static string Join(const vector<string>& packets) {
+  string s;
+  for ( uint32 i = 0; i < packets.size(); ++i ) {
+    s += packets[i];
+  }
+  return s;
+}
+
+// The checks that hold for any of our streams, w/o losses
+static void CheckResult(const Result& r) {
+  CHECK_NOT_NULL(r.media_info_.get());
+  const MediaInfo& info = r.media_info_->info();
+  CHECK(info.has_video());
+  CHECK(info.has_audio());
+  CHECK_EQ(info.video().format_, MediaInfo::Video::FORMAT_H264);
+  CHECK_EQ(info.video().h264_profile_, kSps[1]);
+  CHECK_EQ(info.video().h264_level_, kSps[3]);
+  CHECK_EQ(info.video().h264_sps_.size(), 1);
+  CHECK_EQ(info.video().h264_pps_.size(), 1);
+  CHECK_EQ(info.audio().format_, MediaInfo::Audio::FORMAT_AAC);
+  CHECK_EQ(info.audio().sample_rate_, 44100);
+  CHECK_EQ(info.audio().channels_, 2);
+  // AAC LC (2), 44100 (4), 2 channels
+  CHECK_EQ(info.audio().aac_config_[0], 0x12);
+  CHECK_EQ(info.audio().aac_config_[1], 0x10);
+
+  // the same parameter sets are repeated, a header is sent once
+  CHECK_EQ(r.num_video_headers_, 1);
+  CHECK_EQ(r.num_audio_headers_, 1);
+  CHECK_EQ(r.video_.size(), kNumFrames);
+  for ( int32 i = 0; i < kNumFrames; ++i ) {
+    const FlvTag::Video& v = r.video_[i]->video_body();
+    CHECK_EQ(v.codec(), FLV_FLAG_VIDEO_CODEC_AVC);
+    CHECK_EQ(v.avc_packet_type(), AVC_NALU);
+    CHECK_EQ(r.video_[i]->can_resync(), i % kGopSize == 0) << i;
+    CHECK_EQ(v.avc_composition_offset_ms(), 80);
+    // 5 bytes flags, 4 bytes size, 1 byte NALU header, then the data
+    const string expected = VideoFrameData(i);
+    io::MemoryStream& data = const_cast<io::MemoryStream&>(v.data());
+    data.MarkerSet();
+    data.Skip(5);
+    CHECK_EQ(io::NumStreamer::ReadUInt32(&data, common::BIGENDIAN),
+             1 + expected.size());
+    data.Skip(1);
+    string s;
+    data.ReadString(&s);
+    data.MarkerRestore();
+    CHECK(s == expected) << " frame: " << i;
+  }
+  for ( uint32 i = 1; i < r.video_ts_.size(); ++i ) {
+    CHECK_GE(r.video_ts_[i], r.video_ts_[i - 1]);
+  }
+  CHECK_GT(r.audio_.size(), 0);
+  for ( uint32 i = 0; i < r.audio_.size(); ++i ) {
+    CHECK_EQ(r.audio_[i]->audio_body().format(), FLV_FLAG_SOUND_FORMAT_AAC);
+    // 2 bytes flags + the raw frame
+    CHECK_EQ(r.audio_[i]->audio_body().data().Size(),
+             2 + AudioFrameData(i).size());
+  }
+}
+
+void TestBasic() {
+  Options options;
+  const string data = Join(MakeStream(options));
+  mts::Splitter splitter("test");
+  Result r;
+  Split(&splitter, data, 4096, data.size(), &r);
+  CheckResult(r);
+  for ( int32 i = 0; i < kNumFrames; ++i ) {
+    CHECK_EQ(r.video_ts_[i], i * 40) << i;
+  }
+  for ( uint32 i = 0; i < r.audio_ts_.size(); ++i ) {
+    // the PES timestamp, then 1024 samples per frame
+    const uint32 pes_start = i - i % kAdtsPerPes;
+    CHECK_EQ(r.audio_ts_[i],
+             pes_start * kAdtsTicks * 1000 / 90000 +
+             (i % kAdtsPerPes) * 1024 * 1000 / 44100) << i;
+  }
+  CHECK_EQ(splitter.mts_stats().num_cc_errors_, 0);
+  CHECK_EQ(splitter.mts_stats().num_sync_losses_, 0);
+  CHECK_EQ(splitter.mts_stats().num_dropped_frames_, 0);
+  CHECK_EQ(splitter.mts_stats().num_dropped_sections_, 0);
+  CHECK_EQ(splitter.num_clock_jumps(), 0);
+
+  // The same tags, no matter how the data comes
+  const int32 kBlockSizes[] = { 100, 188, 1000, 4096 };
+  for ( uint32 i = 0; i < NUMBEROF(kBlockSizes); ++i ) {
+    mts::Splitter chunked_splitter("test");
+    Result chunked;
+    Split(&chunked_splitter, data, kBlockSizes[i], 500, &chunked);
+    CHECK(chunked.dump_ == r.dump_) << " block size: " << kBlockSizes[i];
+  }
+}
+
+void TestJunk() {
+  Options options;
+  vector<string> packets = MakeStream(options);
+  string data;
+  for ( uint32 i = 0; i < packets.size(); ++i ) {
+    if ( i == 3 || i == 50 || i == packets.size() / 2 ) {
+      // also a false sync byte in there
+      data += string("\x12\x47\x34\x56", 4) + string(i % 100, '\x00');
+    }
+    data += packets[i];
+  }
+  mts::Splitter splitter("test");
+  Result r;
+  Split(&splitter, data, 1000, 2000, &r);
+  CheckResult(r);
+  CHECK_EQ(splitter.mts_stats().num_sync_losses_, 3);
+  CHECK_EQ(splitter.mts_stats().num_cc_errors_, 0);
+}
+
+void TestLoss() {
+  Options options;
+  vector<string> packets = MakeStream(options);
+  // Lose a packet in the middle of the video frame 13 (a P frame): this
+  // one and the following ones up to the IDR at 20 cannot be decoded.
+  int32 frame = -1;
+  for ( uint32 i = 0; i < packets.size(); ++i ) {
+    const uint8* p = reinterpret_cast<const uint8*>(packets[i].data());
+    const uint16 pid = (static_cast<uint16>(p[1] & 0x1f) << 8) | p[2];
+    if ( pid == kVideoPid && (p[1] & 0x40) != 0 ) {
+      frame++;
+    }
+    if ( frame == 13 && pid == kVideoPid && (p[1] & 0x40) == 0 ) {
+      packets.erase(packets.begin() + i);
+      break;
+    }
+  }
+  mts::Splitter splitter("test");
+  Result r;
+  Split(&splitter, Join(packets), 4096, 4096, &r);
+  CHECK_EQ(splitter.mts_stats().num_cc_errors_, 1);
+  CHECK_EQ(splitter.mts_stats().num_dropped_pes_, 1);
+  CHECK_EQ(splitter.mts_stats().num_dropped_frames_, 20 - 14);
+  CHECK_EQ(r.video_.size(), kNumFrames - (20 - 13));
+  for ( uint32 i = 0; i < r.video_.size(); ++i ) {
+    const int32 expected = i < 13 ? i : i + (20 - 13);
+    CHECK_EQ(r.video_ts_[i], expected * 40);
+  }
+  CHECK(r.video_[13]->can_resync());
+}
+
+void TestWrapAround() {
+  Options options;
+  // wraps around a second in
+  options.first_ts_ = mts::kTimestampMask + 1 - 90000;
+  mts::Splitter splitter("test");
+  Result r;
+  Split(&splitter, Join(MakeStream(options)), 4096, 4096, &r);
+  CheckResult(r);
+  for ( int32 i = 0; i < kNumFrames; ++i ) {
+    CHECK_EQ(r.video_ts_[i], i * 40) << i;
+  }
+  CHECK_EQ(splitter.num_clock_jumps(), 0);
+}
+
+void TestJump() {
+  Options options;
+  // an hour ahead, from frame 30 on
+  options.jump_frame_ = 30;
+  options.jump_ticks_ = 3600ULL * 90000;
+  mts::Splitter splitter("test");
+  Result r;
+  Split(&splitter, Join(MakeStream(options)), 4096, 4096, &r);
+  CheckResult(r);
+  CHECK_GE(splitter.num_clock_jumps(), 1);
+  // the timeline goes on
+  CHECK_LE(r.video_ts_[kNumFrames - 1], kNumFrames * 40 + 200);
+  for ( int32 i = 31; i < kNumFrames; ++i ) {
+    CHECK_EQ(r.video_ts_[i] - r.video_ts_[i - 1], 40) << i;
+  }
+}
+
+void TestCorruptTables() {
+  Options options;
+  mts::Splitter good_splitter("test");
+  Result good;
+  Split(&good_splitter, Join(MakeStream(options)), 4096, 4096, &good);
+
+  // The damaged tables are dropped, we keep demuxing w/ the first ones
+  options.corrupt_tables_ = true;
+  mts::Splitter splitter("test");
+  Result r;
+  Split(&splitter, Join(MakeStream(options)), 4096, 4096, &r);
+  CheckResult(r);
+  CHECK(r.dump_ == good.dump_);
+  CHECK_EQ(splitter.mts_stats().num_dropped_sections_,
+           2 * kNumFrames / kGopSize);
+  CHECK_EQ(splitter.mts_stats().num_cc_errors_, 0);
+}
+
+void TestMp3() {
+  struct {
+    const char* header_;
+    uint8 flv_flags_;
+    int32 sample_rate_;
+    int32 channels_;
+  } kTests[] = {
+    // MPEG-1 layer III, 48000, stereo: MP3, 44kHz, 16 bit, stereo
+    { "\xff\xfb\x94\x00", 0x2f, 48000, 2 },
+    // MPEG-2 layer III, 22050, mono: MP3, 22kHz, 16 bit, mono
+    { "\xff\xf3\x80\xc0", 0x2a, 22050, 1 },
+    // MPEG-2.5 layer III, 8000, joint stereo: MP3, 11kHz, 16 bit, stereo
+    { "\xff\xe3\x88\x40", 0x27, 8000, 2 },
+  };
+  for ( uint32 t = 0; t < NUMBEROF(kTests); ++t ) {
+    Options options;
+    // a false sync first
+    options.mp3_header_ = string("\xff\xff\x00\x00", 4) +
+                          string(kTests[t].header_, 4);
+    mts::Splitter splitter("test");
+    Result r;
+    Split(&splitter, Join(MakeStream(options)), 4096, 4096, &r);
+    CHECK_NOT_NULL(r.media_info_.get());
+    const MediaInfo& info = r.media_info_->info();
+    CHECK(info.has_audio());
+    CHECK_EQ(info.audio().format_, MediaInfo::Audio::FORMAT_MP3);
+    CHECK_EQ(info.audio().sample_rate_, kTests[t].sample_rate_) << t;
+    CHECK_EQ(info.audio().channels_, kTests[t].channels_) << t;
+    CHECK_EQ(r.num_audio_headers_, 0);
+    CHECK_GT(r.audio_.size(), 0);
+    for ( uint32 i = 0; i < r.audio_.size(); ++i ) {
+      const FlvTag::Audio& a = r.audio_[i]->audio_body();
+      CHECK_EQ(a.format(), FLV_FLAG_SOUND_FORMAT_MP3);
+      io::MemoryStream& data = const_cast<io::MemoryStream&>(a.data());
+      data.MarkerSet();
+      CHECK_EQ(io::NumStreamer::ReadByte(&data), kTests[t].flv_flags_) << t;
+      data.MarkerRestore();
+      // the flags, then the frames in the PES from the first sync on
+      CHECK_EQ(a.data().Size(), 1 + kAdtsPerPes * 8 - 4 +
+               AudioFrameData(i * kAdtsPerPes).size() +
+               AudioFrameData(i * kAdtsPerPes + 1).size());
+    }
+  }
+}
+
+void TestFile(const string& filename) {
+  string data;
+  CHECK(io::FileInputStream::TryReadFile(filename.c_str(), &data))
+      << " Cannot read: " << filename;
+  mts::Splitter splitter("test");
+  Result r;
+  Split(&splitter, data, 4096, 1 << 16, &r);
+  LOG_INFO << filename << ": " << r.video_.size() << " video tags, "
+           << r.audio_.size() << " audio tags, "
+           << splitter.mts_stats().num_packets_ << " packets, "
+           << splitter.mts_stats().num_cc_errors_ << " cc errors, "
+           << splitter.mts_stats().num_sync_losses_ << " sync losses";
+  CHECK_NOT_NULL(r.media_info_.get());
+  CHECK(!r.video_.empty() || !r.audio_.empty());
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  rand_seed = FLAGS_rand_seed;
+
+  TestBasic();
+  TestJunk();
+  TestLoss();
+  TestWrapAround();
+  TestJump();
+  TestCorruptTables();
+  TestMp3();
+  if ( !FLAGS_ts_file.empty() ) {
+    TestFile(FLAGS_ts_file);
+  }
+  LOG_INFO << "PASS";
+}
@@ -165,7 +165,8 @@ class BulkDataEvent : public Event {
   }
   virtual AmfUtil::ReadStatus DecodeBody(io::MemoryStream* in,
       AmfUtil::Version version) {
-    data_.AppendStream(in, in->Size());
+    // the body was just assembled by the coder, no need to copy it again
+    data_.AppendStreamByReference(in, in->Size());
     return AmfUtil::READ_OK;
   }
   virtual void EncodeBody(io::MemoryStream* out,
@@ -259,6 +260,22 @@ class EventStreamMetadata : public BulkDataEvent {
   DISALLOW_EVIL_CONSTRUCTORS(EventStreamMetadata);
 };
 
+// Same trick for the invokes we send: the body comes already AMF0 encoded
+// (usually from an Amf0Template), so no PendingCall / CObject tree is
+// built for it. They are read as EventInvoke !
+
+class EventEncodedInvoke : public BulkDataEvent {
+ public:
+  // the bodies are small (status replies and such)
+  static const int kBlockSize = 512;
+  explicit EventEncodedInvoke(const Header& header)
+      : BulkDataEvent(header, EVENT_INVOKE, SUBTYPE_SERVICE_CALL,
+                      kBlockSize) {
+  }
+ private:
+  DISALLOW_EVIL_CONSTRUCTORS(EventEncodedInvoke);
+};
+
 //////////////////////////////////////////////////////////////////////
 
 // Events that have just one uint32 included
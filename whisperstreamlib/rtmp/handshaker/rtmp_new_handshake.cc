@@ -7,8 +7,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
-#include "sha256.h"
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
 
 static const int kHandshakeSize = 1536;   // protocol specific
 static const int kDigestPosBegin = 2 * 4; // sizeof(int32);
@@ -18,6 +20,7 @@ static const int kDigestPosBegin_V_3 = 772;
 
 static const int kDigestPosSize  = 4;     // sizeof(int32);
 static const int kSha256DigestSize  = 32;
+static const int kSha256BlockSize  = 64;
 static const int kHandshakeDataSize = kHandshakeSize - kSha256DigestSize;
 
 // Versions (what we get in bytes 4-7 from client handshake:
@@ -83,6 +86,85 @@ static const byte kHandshakeClientKey[] =  {
 };
 
 
+//////////////////////////////////////////////////////////////////////
+//
+// HMAC-SHA256 through OpenSSL (which uses the SHA extensions / AVX2 code
+// when the CPU has them).
+//
+// For the fixed keys we hash the padded key blocks only once (the HMAC
+// "key schedule") and, for each handshake, start from a copy of the
+// resulting inner / outer digest states.
+//
+
+struct HmacKeyState {
+  EVP_MD_CTX* inner_;
+  EVP_MD_CTX* outer_;
+};
+
+static HmacKeyState glb_server_key_state;
+static bool glb_server_key_state_ok = false;
+static pthread_once_t glb_key_state_once = PTHREAD_ONCE_INIT;
+
+static bool InitHmacKeyState(const byte* key, size_t key_len,
+                             HmacKeyState* state) {
+  byte key_block[kSha256BlockSize];
+  memset(key_block, 0, sizeof(key_block));
+  if ( key_len > kSha256BlockSize ) {
+    if ( !EVP_Digest(key, key_len, key_block, NULL, EVP_sha256(), NULL) ) {
+      return false;
+    }
+  } else {
+    memcpy(key_block, key, key_len);
+  }
+  byte ipad[kSha256BlockSize];
+  byte opad[kSha256BlockSize];
+  for ( int i = 0; i < kSha256BlockSize; ++i ) {
+    ipad[i] = key_block[i] ^ 0x36;
+    opad[i] = key_block[i] ^ 0x5c;
+  }
+  state->inner_ = EVP_MD_CTX_create();
+  state->outer_ = EVP_MD_CTX_create();
+  return (state->inner_ != NULL && state->outer_ != NULL &&
+          EVP_DigestInit_ex(state->inner_, EVP_sha256(), NULL) &&
+          EVP_DigestUpdate(state->inner_, ipad, sizeof(ipad)) &&
+          EVP_DigestInit_ex(state->outer_, EVP_sha256(), NULL) &&
+          EVP_DigestUpdate(state->outer_, opad, sizeof(opad)));
+}
+
+static void InitKeyStates() {
+  glb_server_key_state_ok = InitHmacKeyState(kHandshakeServerKey,
+                                             sizeof(kHandshakeServerKey),
+                                             &glb_server_key_state);
+}
+
+static bool HmacSha256WithState(const HmacKeyState* state,
+                                const byte* data, size_t data_len,
+                                byte result[kSha256DigestSize]) {
+  EVP_MD_CTX* const ctx = EVP_MD_CTX_create();
+  if ( ctx == NULL ) {
+    return false;
+  }
+  byte inner_digest[kSha256DigestSize];
+  const bool success =
+      EVP_MD_CTX_copy_ex(ctx, state->inner_) &&
+      EVP_DigestUpdate(ctx, data, data_len) &&
+      EVP_DigestFinal_ex(ctx, inner_digest, NULL) &&
+      EVP_MD_CTX_copy_ex(ctx, state->outer_) &&
+      EVP_DigestUpdate(ctx, inner_digest, sizeof(inner_digest)) &&
+      EVP_DigestFinal_ex(ctx, result, NULL);
+  EVP_MD_CTX_destroy(ctx);
+  return success;
+}
+
+static bool HmacSha256(const byte* key, size_t key_len,
+                       const byte* data, size_t data_len,
+                       byte result[kSha256DigestSize]) {
+  return NULL != HMAC(EVP_sha256(), key, key_len, data, data_len,
+                      result, NULL);
+}
+
+//////////////////////////////////////////////////////////////////////
+
 int GetDigestPosition(const byte* data, int cb, u_int32_t version) {
   const int begin_offset = IsV3Handshake(version)
                            ? kDigestPosBegin_V_3 : kDigestPosBegin_V_1_2;
@@ -527,10 +609,16 @@ bool PrepareServerHandshake(const byte* data, int cb,
   if ( client_key_pos < 0 ) {
     return false;
   }
+  pthread_once(&glb_key_state_once, InitKeyStates);
+  if ( !glb_server_key_state_ok ) {
+    return false;
+  }
   byte client_key[kSha256DigestSize];
-  HmacSha256(kHandshakeServerKey, sizeof(kHandshakeServerKey),
-             data + client_key_pos, kSha256DigestSize,
-             client_key);
+  if ( !HmacSha256WithState(&glb_server_key_state,
+                            data + client_key_pos, kSha256DigestSize,
+                            client_key) ) {
+    return false;
+  }
 
   // Prepare some pseudo-random data
   byte* crt = p + kHandshakeSize;
@@ -542,11 +630,9 @@ bool PrepareServerHandshake(const byte* data, int cb,
     *crt = (prev ^ data[i]);
     prev = *crt++;
   }
-  HmacSha256(client_key, sizeof(client_key),
-             p + kHandshakeSize, kHandshakeDataSize,
-             p + kHandshakeSize + kHandshakeDataSize);
-
-  return true;
+  return HmacSha256(client_key, sizeof(client_key),
+                    p + kHandshakeSize, kHandshakeDataSize,
+                    p + kHandshakeSize + kHandshakeDataSize);
 }
 
 
@@ -0,0 +1,416 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <string.h>
+#include "rtmp/objects/amf/amf0_streaming.h"
+
+namespace rtmp {
+
+namespace {
+// AMF0 numbers are big endian IEEE doubles, prefixed by their marker
+static const int32 kNumberSize = 1 + sizeof(double);
+static const int32 kMaxSkipDepth = 64;
+
+void EncodeNumber(double value, char* out) {
+  uint64 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  out[0] = Amf0Util::AMF0_TYPE_NUMBER;
+  for ( int i = 8; i > 0; --i ) {
+    out[i] = static_cast<char>(bits & 0xff);
+    bits >>= 8;
+  }
+}
+double DecodeNumber(const char* in) {
+  uint64 bits = 0;
+  for ( int i = 0; i < 8; ++i ) {
+    bits = (bits << 8) | static_cast<uint8>(in[i]);
+  }
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+// Encodes the marker and length of a string (w/o the characters),
+// returns the number of bytes used in out (at most 5).
+int32 EncodeStringHeader(int32 len, char* out) {
+  if ( len < Amf0Util::LONG_STRING_LENGTH ) {
+    out[0] = Amf0Util::AMF0_TYPE_STRING;
+    out[1] = static_cast<char>((len >> 8) & 0xff);
+    out[2] = static_cast<char>(len & 0xff);
+    return 3;
+  }
+  out[0] = Amf0Util::AMF0_TYPE_LONG_STRING;
+  out[1] = static_cast<char>((len >> 24) & 0xff);
+  out[2] = static_cast<char>((len >> 16) & 0xff);
+  out[3] = static_cast<char>((len >> 8) & 0xff);
+  out[4] = static_cast<char>(len & 0xff);
+  return 5;
+}
+uint32 DecodeUInt(const char* in, int size) {
+  uint32 value = 0;
+  for ( int i = 0; i < size; ++i ) {
+    value = (value << 8) | static_cast<uint8>(in[i]);
+  }
+  return value;
+}
+
+inline void Append(io::MemoryStream* out, const char* data, int32 size) {
+  out->Write(data, size);
+}
+inline void Append(string* out, const char* data, int32 size) {
+  out->append(data, size);
+}
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void Amf0Writer::WriteNumber(double value) {
+  char buf[kNumberSize];
+  EncodeNumber(value, buf);
+  out_->append(buf, sizeof(buf));
+}
+
+void Amf0Writer::WriteBoolean(bool value) {
+  out_->push_back(Amf0Util::AMF0_TYPE_BOOLEAN);
+  out_->push_back(value ? Amf0Util::VALUE_TRUE : Amf0Util::VALUE_FALSE);
+}
+
+void Amf0Writer::WriteNull() {
+  out_->push_back(Amf0Util::AMF0_TYPE_NULL);
+}
+
+void Amf0Writer::WriteString(const char* s, int32 len) {
+  char buf[5];
+  out_->append(buf, EncodeStringHeader(len, buf));
+  out_->append(s, len);
+}
+
+void Amf0Writer::WriteObjectBegin() {
+  out_->push_back(Amf0Util::AMF0_TYPE_OBJECT);
+}
+
+void Amf0Writer::WriteProperty(const char* name, int32 len) {
+  // property names are always short strings, w/o marker
+  DCHECK_LT(len, Amf0Util::LONG_STRING_LENGTH);
+  out_->push_back(static_cast<char>((len >> 8) & 0xff));
+  out_->push_back(static_cast<char>(len & 0xff));
+  out_->append(name, len);
+}
+
+void Amf0Writer::WriteObjectEnd() {
+  static const char kObjectEnd[] = { 0x00, 0x00,
+                                     Amf0Util::AMF0_TYPE_END_OF_OBJECT };
+  out_->append(kObjectEnd, sizeof(kObjectEnd));
+}
+
+void Amf0Writer::WriteMixedArrayBegin(uint32 count) {
+  out_->push_back(Amf0Util::AMF0_TYPE_MIXED_ARRAY);
+  out_->push_back(static_cast<char>((count >> 24) & 0xff));
+  out_->push_back(static_cast<char>((count >> 16) & 0xff));
+  out_->push_back(static_cast<char>((count >> 8) & 0xff));
+  out_->push_back(static_cast<char>(count & 0xff));
+}
+
+//////////////////////////////////////////////////////////////////////
+
+AmfUtil::ReadStatus Amf0Reader::PeekType(Amf0Util::Type* type) const {
+  if ( IsEmpty() ) {
+    return AmfUtil::READ_NO_DATA;
+  }
+  *type = Amf0Util::Type(static_cast<uint8>(data_[pos_]));
+  return AmfUtil::READ_OK;
+}
+
+AmfUtil::ReadStatus Amf0Reader::ReadNumber(double* value) {
+  if ( remaining() < kNumberSize ) {
+    return AmfUtil::READ_NO_DATA;
+  }
+  if ( data_[pos_] != Amf0Util::AMF0_TYPE_NUMBER ) {
+    return AmfUtil::READ_CORRUPTED_DATA;
+  }
+  *value = DecodeNumber(data_ + pos_ + 1);
+  pos_ += kNumberSize;
+  return AmfUtil::READ_OK;
+}
+
+AmfUtil::ReadStatus Amf0Reader::ReadBoolean(bool* value) {
+  if ( remaining() < 2 ) {
+    return AmfUtil::READ_NO_DATA;
+  }
+  if ( data_[pos_] != Amf0Util::AMF0_TYPE_BOOLEAN ) {
+    return AmfUtil::READ_CORRUPTED_DATA;
+  }
+  *value = (data_[pos_ + 1] != Amf0Util::VALUE_FALSE);
+  pos_ += 2;
+  return AmfUtil::READ_OK;
+}
+
+AmfUtil::ReadStatus Amf0Reader::ReadNull() {
+  if ( IsEmpty() ) {
+    return AmfUtil::READ_NO_DATA;
+  }
+  if ( data_[pos_] != Amf0Util::AMF0_TYPE_NULL &&
+       data_[pos_] != Amf0Util::AMF0_TYPE_UNDEFINED ) {
+    return AmfUtil::READ_CORRUPTED_DATA;
+  }
+  pos_++;
+  return AmfUtil::READ_OK;
+}
+
+AmfUtil::ReadStatus Amf0Reader::ReadString(const char** s, int32* len) {
+  if ( IsEmpty() ) {
+    return AmfUtil::READ_NO_DATA;
+  }
+  int32 header_size = 0;
+  if ( data_[pos_] == Amf0Util::AMF0_TYPE_STRING ) {
+    header_size = 1 + sizeof(uint16);
+  } else if ( data_[pos_] == Amf0Util::AMF0_TYPE_LONG_STRING ) {
+    header_size = 1 + sizeof(uint32);
+  } else {
+    return AmfUtil::READ_CORRUPTED_DATA;
+  }
+  if ( remaining() < header_size ) {
+    return AmfUtil::READ_NO_DATA;
+  }
+  const uint32 size = DecodeUInt(data_ + pos_ + 1, header_size - 1);
+  if ( size > AmfUtil::kMaximumStringReadableData ) {
+    return AmfUtil::READ_STRUCT_TOO_LONG;
+  }
+  if ( remaining() - header_size < static_cast<int32>(size) ) {
+    return AmfUtil::READ_NO_DATA;
+  }
+  *s = data_ + pos_ + header_size;
+  *len = size;
+  pos_ += header_size + size;
+  return AmfUtil::READ_OK;
+}
+
+AmfUtil::ReadStatus Amf0Reader::ReadString(string* s) {
+  const char* p = NULL;
+  int32 len = 0;
+  const AmfUtil::ReadStatus err = ReadString(&p, &len);
+  if ( err == AmfUtil::READ_OK ) {
+    s->assign(p, len);
+  }
+  return err;
+}
+
+AmfUtil::ReadStatus Amf0Reader::ReadObjectBegin() {
+  if ( IsEmpty() ) {
+    return AmfUtil::READ_NO_DATA;
+  }
+  if ( data_[pos_] != Amf0Util::AMF0_TYPE_OBJECT ) {
+    return AmfUtil::READ_CORRUPTED_DATA;
+  }
+  pos_++;
+  return AmfUtil::READ_OK;
+}
+
+AmfUtil::ReadStatus Amf0Reader::ReadProperty(const char** name, int32* len) {
+  if ( remaining() < static_cast<int32>(sizeof(uint16)) ) {
+    return AmfUtil::READ_NO_DATA;
+  }
+  const int32 size = DecodeUInt(data_ + pos_, sizeof(uint16));
+  if ( size == 0 ) {
+    // the end of object marker follows
+    if ( remaining() < static_cast<int32>(sizeof(uint16)) + 1 ) {
+      return AmfUtil::READ_NO_DATA;
+    }
+    if ( data_[pos_ + sizeof(uint16)] != Amf0Util::AMF0_TYPE_END_OF_OBJECT ) {
+      return AmfUtil::READ_CORRUPTED_DATA;
+    }
+    *name = data_ + pos_;
+    *len = 0;
+    pos_ += sizeof(uint16) + 1;
+    return AmfUtil::READ_OK;
+  }
+  if ( remaining() - static_cast<int32>(sizeof(uint16)) < size ) {
+    return AmfUtil::READ_NO_DATA;
+  }
+  *name = data_ + pos_ + sizeof(uint16);
+  *len = size;
+  pos_ += sizeof(uint16) + size;
+  return AmfUtil::READ_OK;
+}
+
+AmfUtil::ReadStatus Amf0Reader::ReadMixedArrayBegin(uint32* count) {
+  if ( remaining() < 1 + static_cast<int32>(sizeof(uint32)) ) {
+    return AmfUtil::READ_NO_DATA;
+  }
+  if ( data_[pos_] != Amf0Util::AMF0_TYPE_MIXED_ARRAY ) {
+    return AmfUtil::READ_CORRUPTED_DATA;
+  }
+  *count = DecodeUInt(data_ + pos_ + 1, sizeof(uint32));
+  pos_ += 1 + sizeof(uint32);
+  return AmfUtil::READ_OK;
+}
+
+AmfUtil::ReadStatus Amf0Reader::Skip() {
+  int32 pos = pos_;
+  const AmfUtil::ReadStatus err = SkipValue(&pos, 0);
+  if ( err == AmfUtil::READ_OK ) {
+    pos_ = pos;
+  }
+  return err;
+}
+
+AmfUtil::ReadStatus Amf0Reader::SkipValue(int32* pos, int depth) const {
+  if ( depth > kMaxSkipDepth ) {
+    return AmfUtil::READ_STRUCT_TOO_LONG;
+  }
+  if ( *pos >= size_ ) {
+    return AmfUtil::READ_NO_DATA;
+  }
+  const int32 avail = size_ - *pos;
+  const char* const p = data_ + *pos;
+  switch ( static_cast<uint8>(p[0]) ) {
+    case Amf0Util::AMF0_TYPE_NUMBER:
+      if ( avail < kNumberSize ) return AmfUtil::READ_NO_DATA;
+      *pos += kNumberSize;
+      return AmfUtil::READ_OK;
+    case Amf0Util::AMF0_TYPE_BOOLEAN:
+      if ( avail < 2 ) return AmfUtil::READ_NO_DATA;
+      *pos += 2;
+      return AmfUtil::READ_OK;
+    case Amf0Util::AMF0_TYPE_NULL:
+    case Amf0Util::AMF0_TYPE_UNDEFINED:
+      *pos += 1;
+      return AmfUtil::READ_OK;
+    case Amf0Util::AMF0_TYPE_DATE:
+      // the number of milliseconds + 2 bytes of timezone
+      if ( avail < kNumberSize + 2 ) return AmfUtil::READ_NO_DATA;
+      *pos += kNumberSize + 2;
+      return AmfUtil::READ_OK;
+    case Amf0Util::AMF0_TYPE_STRING:
+    case Amf0Util::AMF0_TYPE_LONG_STRING: {
+      const int32 header_size =
+          p[0] == Amf0Util::AMF0_TYPE_STRING ? 3 : 5;
+      if ( avail < header_size ) return AmfUtil::READ_NO_DATA;
+      const uint32 len = DecodeUInt(p + 1, header_size - 1);
+      if ( len > AmfUtil::kMaximumStringReadableData ) {
+        return AmfUtil::READ_STRUCT_TOO_LONG;
+      }
+      if ( avail - header_size < static_cast<int32>(len) ) {
+        return AmfUtil::READ_NO_DATA;
+      }
+      *pos += header_size + len;
+      return AmfUtil::READ_OK;
+    }
+    case Amf0Util::AMF0_TYPE_OBJECT:
+    case Amf0Util::AMF0_TYPE_MIXED_ARRAY: {
+      int32 crt = *pos + (p[0] == Amf0Util::AMF0_TYPE_OBJECT ? 1 : 5);
+      while ( true ) {
+        if ( size_ - crt < 2 ) return AmfUtil::READ_NO_DATA;
+        const int32 len = DecodeUInt(data_ + crt, 2);
+        crt += 2;
+        if ( len == 0 ) {
+          if ( crt >= size_ ) return AmfUtil::READ_NO_DATA;
+          if ( data_[crt] != Amf0Util::AMF0_TYPE_END_OF_OBJECT ) {
+            return AmfUtil::READ_CORRUPTED_DATA;
+          }
+          *pos = crt + 1;
+          return AmfUtil::READ_OK;
+        }
+        if ( size_ - crt < len ) return AmfUtil::READ_NO_DATA;
+        crt += len;
+        const AmfUtil::ReadStatus err = SkipValue(&crt, depth + 1);
+        if ( err != AmfUtil::READ_OK ) return err;
+      }
+    }
+    case Amf0Util::AMF0_TYPE_ARRAY: {
+      if ( avail < 5 ) return AmfUtil::READ_NO_DATA;
+      const uint32 count = DecodeUInt(p + 1, 4);
+      if ( count > AmfUtil::kMaximumArraySize ) {
+        return AmfUtil::READ_STRUCT_TOO_LONG;
+      }
+      int32 crt = *pos + 5;
+      for ( uint32 i = 0; i < count; ++i ) {
+        const AmfUtil::ReadStatus err = SkipValue(&crt, depth + 1);
+        if ( err != AmfUtil::READ_OK ) return err;
+      }
+      *pos = crt;
+      return AmfUtil::READ_OK;
+    }
+    case Amf0Util::AMF0_TYPE_REFERENCE:
+      return AmfUtil::READ_UNSUPPORTED_REFERENCES;
+    case Amf0Util::AMF0_TYPE_END_OF_OBJECT:
+      return AmfUtil::READ_CORRUPTED_DATA;
+    default:
+      return AmfUtil::READ_NOT_IMPLEMENTED;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void Amf0Template::AppendNumberSlot() {
+  slots_.push_back(Slot(bytes_.size(), true));
+  ++num_numbers_;
+}
+
+void Amf0Template::AppendStringSlot() {
+  slots_.push_back(Slot(bytes_.size(), false));
+  ++num_strings_;
+}
+
+template <class T>
+void Amf0Template::EmitTo(T* out,
+                          const double* numbers,
+                          const string* const* strings) const {
+  char buf[kNumberSize];
+  int32 last = 0;
+  for ( int i = 0; i < slots_.size(); ++i ) {
+    const Slot& slot = slots_[i];
+    Append(out, bytes_.data() + last, slot.offset_ - last);
+    last = slot.offset_;
+    if ( slot.is_number_ ) {
+      EncodeNumber(*numbers++, buf);
+      Append(out, buf, kNumberSize);
+    } else {
+      const string* const s = *strings++;
+      Append(out, buf, EncodeStringHeader(s->size(), buf));
+      Append(out, s->data(), s->size());
+    }
+  }
+  Append(out, bytes_.data() + last, bytes_.size() - last);
+}
+
+void Amf0Template::Emit(io::MemoryStream* out,
+                        const double* numbers,
+                        const string* const* strings) const {
+  EmitTo(out, numbers, strings);
+}
+
+void Amf0Template::Emit(string* out,
+                        const double* numbers,
+                        const string* const* strings) const {
+  out->reserve(out->size() + bytes_.size() + kNumberSize * num_numbers_);
+  EmitTo(out, numbers, strings);
+}
+}
@@ -0,0 +1,215 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#ifndef __NET_RTMP_OBJECTS_AMF_AMF0_STREAMING_H__
+#define __NET_RTMP_OBJECTS_AMF_AMF0_STREAMING_H__
+
+#include <string>
+#include <vector>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/io/buffer/memory_stream.h>
+#include <whisperstreamlib/rtmp/objects/amf/amf_util.h>
+#include <whisperstreamlib/rtmp/objects/amf/amf0_util.h>
+
+namespace rtmp {
+
+//
+// Streaming AMF0 helpers, working directly on flat buffers.
+//
+// Unlike CObject::Encode/Decode, these never build an object tree:
+// the writer appends values to a string, the reader walks a buffer
+// in place (strings are returned as pointers into that buffer).
+// The bytes produced are identical to what the equivalent CObject
+// tree would encode.
+//
+
+class Amf0Writer {
+ public:
+  // Appends to *out (which we do not own, nor clear).
+  explicit Amf0Writer(string* out)
+      : out_(out) {
+  }
+
+  void WriteNumber(double value);
+  void WriteBoolean(bool value);
+  void WriteNull();
+  void WriteString(const char* s, int32 len);
+  void WriteString(const char* s) {
+    WriteString(s, strlen(s));
+  }
+  void WriteString(const string& s) {
+    WriteString(s.data(), s.size());
+  }
+
+  // An object is: WriteObjectBegin(), then pairs of
+  // WriteProperty(name) + Write<Value>(..), then WriteObjectEnd().
+  void WriteObjectBegin();
+  void WriteProperty(const char* name, int32 len);
+  void WriteProperty(const char* name) {
+    WriteProperty(name, strlen(name));
+  }
+  void WriteProperty(const string& name) {
+    WriteProperty(name.data(), name.size());
+  }
+  void WriteObjectEnd();
+  // Mixed arrays (i.e. onMetaData values) are closed w/ WriteObjectEnd()
+  void WriteMixedArrayBegin(uint32 count);
+
+  const string& buffer() const { return *out_; }
+  int32 size() const { return out_->size(); }
+
+ private:
+  string* const out_;
+  DISALLOW_EVIL_CONSTRUCTORS(Amf0Writer);
+};
+
+// Reads AMF0 values from a flat buffer. On any error the read position
+// is left untouched, so a READ_NO_DATA can be retried w/ more data.
+class Amf0Reader {
+ public:
+  Amf0Reader(const char* data, int32 size)
+      : data_(data), size_(size), pos_(0) {
+  }
+
+  int32 position() const { return pos_; }
+  int32 remaining() const { return size_ - pos_; }
+  bool IsEmpty() const { return pos_ >= size_; }
+
+  // Returns the marker of the next value, without consuming it.
+  AmfUtil::ReadStatus PeekType(Amf0Util::Type* type) const;
+
+  AmfUtil::ReadStatus ReadNumber(double* value);
+  AmfUtil::ReadStatus ReadBoolean(bool* value);
+  // Accepts both null and undefined
+  AmfUtil::ReadStatus ReadNull();
+  // Accepts short and long strings. *s points inside our buffer.
+  AmfUtil::ReadStatus ReadString(const char** s, int32* len);
+  AmfUtil::ReadStatus ReadString(string* s);
+
+  AmfUtil::ReadStatus ReadObjectBegin();
+  // Reads the next property name of an object (or mixed array).
+  // An empty name (*len == 0) means the object ended - the end marker
+  // was consumed too.
+  AmfUtil::ReadStatus ReadProperty(const char** name, int32* len);
+  AmfUtil::ReadStatus ReadMixedArrayBegin(uint32* count);
+
+  // Passes over the next value, whatever its type (objects, mixed maps
+  // and arrays included).
+  AmfUtil::ReadStatus Skip();
+
+ private:
+  AmfUtil::ReadStatus SkipValue(int32* pos, int depth) const;
+
+  const char* const data_;
+  const int32 size_;
+  int32 pos_;
+  DISALLOW_EVIL_CONSTRUCTORS(Amf0Reader);
+};
+
+// A precompiled AMF0 message body: the fixed bytes are encoded once,
+// and only a few slots (transaction id, stream id, a details string ..)
+// are filled in on each Emit(). Number slots and string slots are
+// numbered independently, in the order they were appended.
+//
+// E.g. an onStatus body:
+//   Amf0Template t;
+//   t.writer()->WriteString("onStatus");
+//   t.AppendNumberSlot();                 // invoke id
+//   t.writer()->WriteNull();
+//   t.writer()->WriteObjectBegin();
+//   t.writer()->WriteProperty("code");
+//   t.writer()->WriteString("NetStream.Play.Start");
+//   t.writer()->WriteProperty("details");
+//   t.AppendStringSlot();                 // stream name
+//   t.writer()->WriteObjectEnd();
+//   ...
+//   t.Emit(out, invoke_id, stream_name);
+//
+class Amf0Template {
+ public:
+  Amf0Template()
+      : writer_(&bytes_),
+        num_numbers_(0),
+        num_strings_(0) {
+  }
+
+  // Use this to append the fixed parts
+  Amf0Writer* writer() { return &writer_; }
+
+  void AppendNumberSlot();
+  void AppendStringSlot();
+
+  int num_number_slots() const { return num_numbers_; }
+  int num_string_slots() const { return num_strings_; }
+  // The size of the fixed part
+  int32 fixed_size() const { return bytes_.size(); }
+
+  // Appends the template to 'out' with the slots filled from 'numbers'
+  // and 'strings' (at least num_number_slots() / num_string_slots()
+  // elements in them).
+  void Emit(io::MemoryStream* out,
+            const double* numbers, const string* const* strings) const;
+  // Same, but to a flat buffer
+  void Emit(string* out,
+            const double* numbers, const string* const* strings) const;
+
+  // Helpers for the common shapes
+  void Emit(io::MemoryStream* out, double number) const {
+    Emit(out, &number, NULL);
+  }
+  void Emit(io::MemoryStream* out, double number, const string& s) const {
+    const string* strings[] = { &s };
+    Emit(out, &number, strings);
+  }
+
+ private:
+  struct Slot {
+    Slot(int32 offset, bool is_number)
+        : offset_(offset), is_number_(is_number) {
+    }
+    int32 offset_;     // in bytes_
+    bool is_number_;
+  };
+  template <class T>
+  void EmitTo(T* out,
+              const double* numbers, const string* const* strings) const;
+
+  string bytes_;
+  Amf0Writer writer_;
+  vector<Slot> slots_;
+  int num_numbers_;
+  int num_strings_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(Amf0Template);
+};
+}
+
+#endif  // __NET_RTMP_OBJECTS_AMF_AMF0_STREAMING_H__
@@ -0,0 +1,304 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+// Compares encoding / decoding the RTMP commands we send the most
+// (onStatus, _result, onMetaData) through CObject trees against the
+// streaming Amf0Writer / Amf0Reader and the precompiled Amf0Template.
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/gflags.h>
+#include <whisperlib/common/base/timer.h>
+#include <whisperlib/common/io/buffer/memory_stream.h>
+
+#include "rtmp/objects/rtmp_objects.h"
+#include "rtmp/objects/amf/amf0_util.h"
+#include "rtmp/objects/amf/amf0_streaming.h"
+
+//////////////////////////////////////////////////////////////////////
+
+DEFINE_int32(num_iterations,
+             1000000,
+             "Encode / decode each message these many times");
+DEFINE_string(stream_name,
+              "live/some_stream_name",
+              "The details of the status messages");
+
+//////////////////////////////////////////////////////////////////////
+
+static void Report(const char* name, int64 start_ns, int64 bytes) {
+  const int64 duration_ns = max(timer::TicksNsec() - start_ns,
+                                static_cast<int64>(1));
+  LOG_INFO << name << ": " << FLAGS_num_iterations << " messages in "
+           << duration_ns / 1000000LL << " ms => "
+           << duration_ns / max(FLAGS_num_iterations, 1) << " ns/message, "
+           << static_cast<int64>(bytes * 1e3 / duration_ns) << " MB/s";
+}
+
+// What ServerConnection::CreateStatusEvent used to do
+static void EncodeStatusTree(double invoke_id, const string& details,
+                             io::MemoryStream* out) {
+  rtmp::CStringMap arg;
+  arg.Set("level", new rtmp::CString("status"));
+  arg.Set("code", new rtmp::CString("NetStream.Play.Start"));
+  arg.Set("description", new rtmp::CString("Play started"));
+  arg.Set("details", new rtmp::CString(details));
+  rtmp::Amf0Util::WriteString(out, "onStatus");
+  rtmp::CNumber(invoke_id).Encode(out, rtmp::AmfUtil::AMF0_VERSION);
+  rtmp::CNull().Encode(out, rtmp::AmfUtil::AMF0_VERSION);
+  arg.Encode(out, rtmp::AmfUtil::AMF0_VERSION);
+}
+
+static void EncodeStatusWriter(double invoke_id, const string& details,
+                               string* buffer, io::MemoryStream* out) {
+  buffer->clear();
+  rtmp::Amf0Writer w(buffer);
+  w.WriteString("onStatus");
+  w.WriteNumber(invoke_id);
+  w.WriteNull();
+  w.WriteObjectBegin();
+  w.WriteProperty("level");
+  w.WriteString("status");
+  w.WriteProperty("code");
+  w.WriteString("NetStream.Play.Start");
+  w.WriteProperty("description");
+  w.WriteString("Play started");
+  w.WriteProperty("details");
+  w.WriteString(details);
+  w.WriteObjectEnd();
+  out->Write(buffer->data(), buffer->size());
+}
+
+static void BuildStatusTemplate(rtmp::Amf0Template* t) {
+  rtmp::Amf0Writer* const w = t->writer();
+  w->WriteString("onStatus");
+  t->AppendNumberSlot();
+  w->WriteNull();
+  w->WriteObjectBegin();
+  w->WriteProperty("level");
+  w->WriteString("status");
+  w->WriteProperty("code");
+  w->WriteString("NetStream.Play.Start");
+  w->WriteProperty("description");
+  w->WriteString("Play started");
+  w->WriteProperty("details");
+  t->AppendStringSlot();
+  w->WriteObjectEnd();
+}
+
+static void FillMetadata(rtmp::CMixedMap* values) {
+  values->Set("duration", new rtmp::CNumber(0));
+  values->Set("width", new rtmp::CNumber(1280));
+  values->Set("height", new rtmp::CNumber(720));
+  values->Set("videodatarate", new rtmp::CNumber(2000));
+  values->Set("framerate", new rtmp::CNumber(25));
+  values->Set("videocodecid", new rtmp::CNumber(7));
+  values->Set("audiodatarate", new rtmp::CNumber(128));
+  values->Set("audiosamplerate", new rtmp::CNumber(44100));
+  values->Set("audiosamplesize", new rtmp::CNumber(16));
+  values->Set("stereo", new rtmp::CBoolean(true));
+  values->Set("audiocodecid", new rtmp::CNumber(10));
+  values->Set("encoder", new rtmp::CString("whispercast"));
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void BenchmarkEncodeStatus() {
+  const string& details = FLAGS_stream_name;
+  io::MemoryStream out;
+  int64 bytes = 0;
+
+  int64 start = timer::TicksNsec();
+  for ( int32 i = 0; i < FLAGS_num_iterations; ++i ) {
+    EncodeStatusTree(i, details, &out);
+    bytes += out.Size();
+    out.Clear();
+  }
+  Report("onStatus / CObject tree", start, bytes);
+
+  string buffer;
+  bytes = 0;
+  start = timer::TicksNsec();
+  for ( int32 i = 0; i < FLAGS_num_iterations; ++i ) {
+    EncodeStatusWriter(i, details, &buffer, &out);
+    bytes += out.Size();
+    out.Clear();
+  }
+  Report("onStatus / Amf0Writer", start, bytes);
+
+  rtmp::Amf0Template t;
+  BuildStatusTemplate(&t);
+  bytes = 0;
+  start = timer::TicksNsec();
+  for ( int32 i = 0; i < FLAGS_num_iterations; ++i ) {
+    t.Emit(&out, i, details);
+    bytes += out.Size();
+    out.Clear();
+  }
+  Report("onStatus / Amf0Template", start, bytes);
+
+  // _result(invoke_id, null, stream_id), as createStream replies
+  bytes = 0;
+  start = timer::TicksNsec();
+  for ( int32 i = 0; i < FLAGS_num_iterations; ++i ) {
+    rtmp::Amf0Util::WriteString(&out, "_result");
+    rtmp::CNumber(i).Encode(&out, rtmp::AmfUtil::AMF0_VERSION);
+    rtmp::CNull().Encode(&out, rtmp::AmfUtil::AMF0_VERSION);
+    rtmp::CNumber(1).Encode(&out, rtmp::AmfUtil::AMF0_VERSION);
+    bytes += out.Size();
+    out.Clear();
+  }
+  Report("_result / CObject", start, bytes);
+
+  rtmp::Amf0Template result;
+  result.writer()->WriteString("_result");
+  result.AppendNumberSlot();
+  result.writer()->WriteNull();
+  result.AppendNumberSlot();
+  bytes = 0;
+  start = timer::TicksNsec();
+  for ( int32 i = 0; i < FLAGS_num_iterations; ++i ) {
+    const double numbers[] = { static_cast<double>(i), 1 };
+    result.Emit(&out, numbers, NULL);
+    bytes += out.Size();
+    out.Clear();
+  }
+  Report("_result / Amf0Template", start, bytes);
+}
+
+void BenchmarkEncodeMetadata() {
+  io::MemoryStream out;
+  int64 bytes = 0;
+
+  int64 start = timer::TicksNsec();
+  for ( int32 i = 0; i < FLAGS_num_iterations; ++i ) {
+    rtmp::CMixedMap values;
+    FillMetadata(&values);
+    rtmp::CString("onMetaData").Encode(&out, rtmp::AmfUtil::AMF0_VERSION);
+    values.Encode(&out, rtmp::AmfUtil::AMF0_VERSION);
+    bytes += out.Size();
+    out.Clear();
+  }
+  Report("onMetaData / CObject tree", start, bytes);
+
+  string buffer;
+  bytes = 0;
+  start = timer::TicksNsec();
+  for ( int32 i = 0; i < FLAGS_num_iterations; ++i ) {
+    buffer.clear();
+    rtmp::Amf0Writer w(&buffer);
+    w.WriteString("onMetaData");
+    w.WriteMixedArrayBegin(0);
+    w.WriteProperty("audiocodecid");    w.WriteNumber(10);
+    w.WriteProperty("audiodatarate");   w.WriteNumber(128);
+    w.WriteProperty("audiosamplerate"); w.WriteNumber(44100);
+    w.WriteProperty("audiosamplesize"); w.WriteNumber(16);
+    w.WriteProperty("duration");        w.WriteNumber(0);
+    w.WriteProperty("encoder");         w.WriteString("whispercast");
+    w.WriteProperty("framerate");       w.WriteNumber(25);
+    w.WriteProperty("height");          w.WriteNumber(720);
+    w.WriteProperty("stereo");          w.WriteBoolean(true);
+    w.WriteProperty("videocodecid");    w.WriteNumber(7);
+    w.WriteProperty("videodatarate");   w.WriteNumber(2000);
+    w.WriteProperty("width");           w.WriteNumber(1280);
+    w.WriteObjectEnd();
+    out.Write(buffer.data(), buffer.size());
+    bytes += out.Size();
+    out.Clear();
+  }
+  Report("onMetaData / Amf0Writer", start, bytes);
+}
+
+void BenchmarkDecodeStatus() {
+  io::MemoryStream ms;
+  EncodeStatusTree(7, FLAGS_stream_name, &ms);
+  const string encoded = ms.ToString();
+  int64 bytes = 0;
+
+  int64 start = timer::TicksNsec();
+  for ( int32 i = 0; i < FLAGS_num_iterations; ++i ) {
+    io::MemoryStream in;
+    in.Write(encoded.data(), encoded.size());
+    string method;
+    CHECK_EQ(rtmp::Amf0Util::ReadString(&in, &method),
+             rtmp::AmfUtil::READ_OK);
+    for ( int j = 0; j < 3; ++j ) {
+      rtmp::CObject* obj = NULL;
+      CHECK_EQ(rtmp::Amf0Util::ReadNextObject(&in, &obj),
+               rtmp::AmfUtil::READ_OK);
+      delete obj;
+    }
+    bytes += encoded.size();
+  }
+  Report("onStatus decode / CObject tree", start, bytes);
+
+  bytes = 0;
+  start = timer::TicksNsec();
+  for ( int32 i = 0; i < FLAGS_num_iterations; ++i ) {
+    rtmp::Amf0Reader r(encoded.data(), encoded.size());
+    const char* s;
+    int32 len;
+    double invoke_id;
+    CHECK_EQ(r.ReadString(&s, &len), rtmp::AmfUtil::READ_OK);
+    CHECK_EQ(r.ReadNumber(&invoke_id), rtmp::AmfUtil::READ_OK);
+    CHECK_EQ(r.ReadNull(), rtmp::AmfUtil::READ_OK);
+    CHECK_EQ(r.ReadObjectBegin(), rtmp::AmfUtil::READ_OK);
+    while ( true ) {
+      CHECK_EQ(r.ReadProperty(&s, &len), rtmp::AmfUtil::READ_OK);
+      if ( len == 0 ) break;
+      CHECK_EQ(r.ReadString(&s, &len), rtmp::AmfUtil::READ_OK);
+    }
+    bytes += encoded.size();
+  }
+  Report("onStatus decode / Amf0Reader", start, bytes);
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+
+  // all paths must produce the same bytes
+  io::MemoryStream tree, streamed, templated;
+  string buffer;
+  rtmp::Amf0Template t;
+  BuildStatusTemplate(&t);
+  EncodeStatusTree(3, FLAGS_stream_name, &tree);
+  EncodeStatusWriter(3, FLAGS_stream_name, &buffer, &streamed);
+  t.Emit(&templated, 3, FLAGS_stream_name);
+  CHECK(tree.Equals(streamed));
+  CHECK(tree.Equals(templated));
+
+  BenchmarkEncodeStatus();
+  BenchmarkEncodeMetadata();
+  BenchmarkDecodeStatus();
+
+  common::Exit(0);
+}
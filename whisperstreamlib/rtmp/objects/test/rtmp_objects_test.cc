@@ -40,8 +40,139 @@
 
 #include "rtmp/objects/rtmp_objects.h"
 #include "rtmp/objects/amf/amf0_util.h"
+#include "rtmp/objects/amf/amf0_streaming.h"
 #include "rtmp/objects/amf/amf_util.h"
 
+// The streaming writer / reader / templates must produce (and understand)
+// exactly the bytes of the equivalent CObject tree.
+void TestStreaming() {
+  // onStatus(7, null, {level, code, description, details}), as a tree
+  rtmp::CStringMap status;
+  status.Set("level", new rtmp::CString("status"));
+  status.Set("code", new rtmp::CString("NetStream.Play.Start"));
+  status.Set("description", new rtmp::CString("Play started"));
+  status.Set("details", new rtmp::CString("some/stream"));
+  io::MemoryStream ms;
+  rtmp::Amf0Util::WriteString(&ms, "onStatus");
+  rtmp::CNumber(7).Encode(&ms, rtmp::AmfUtil::AMF0_VERSION);
+  rtmp::CNull().Encode(&ms, rtmp::AmfUtil::AMF0_VERSION);
+  status.Encode(&ms, rtmp::AmfUtil::AMF0_VERSION);
+  const string expected = ms.ToString();
+
+  // .. streamed
+  string buffer;
+  rtmp::Amf0Writer w(&buffer);
+  w.WriteString("onStatus");
+  w.WriteNumber(7);
+  w.WriteNull();
+  w.WriteObjectBegin();
+  w.WriteProperty("level");
+  w.WriteString("status");
+  w.WriteProperty("code");
+  w.WriteString("NetStream.Play.Start");
+  w.WriteProperty("description");
+  w.WriteString("Play started");
+  w.WriteProperty("details");
+  w.WriteString("some/stream");
+  w.WriteObjectEnd();
+  CHECK(buffer == expected);
+
+  // .. from a template
+  rtmp::Amf0Template t;
+  t.writer()->WriteString("onStatus");
+  t.AppendNumberSlot();
+  t.writer()->WriteNull();
+  t.writer()->WriteObjectBegin();
+  t.writer()->WriteProperty("level");
+  t.writer()->WriteString("status");
+  t.writer()->WriteProperty("code");
+  t.writer()->WriteString("NetStream.Play.Start");
+  t.writer()->WriteProperty("description");
+  t.writer()->WriteString("Play started");
+  t.writer()->WriteProperty("details");
+  t.AppendStringSlot();
+  t.writer()->WriteObjectEnd();
+  CHECK_EQ(t.num_number_slots(), 1);
+  CHECK_EQ(t.num_string_slots(), 1);
+  io::MemoryStream out;
+  t.Emit(&out, 7, "some/stream");
+  CHECK(out.ToString() == expected);
+  // a different stream name changes the string length too
+  out.Clear();
+  t.Emit(&out, 1234, "other");
+  rtmp::CObject* obj = NULL;
+  string method;
+  CHECK_EQ(rtmp::Amf0Util::ReadString(&out, &method), rtmp::AmfUtil::READ_OK);
+  CHECK_EQ(method, "onStatus");
+  CHECK_EQ(rtmp::Amf0Util::ReadNextObject(&out, &obj), rtmp::AmfUtil::READ_OK);
+  CHECK_EQ(static_cast<rtmp::CNumber*>(obj)->int_value(), 1234);
+  delete obj;
+  CHECK_EQ(rtmp::Amf0Util::ReadNextObject(&out, &obj), rtmp::AmfUtil::READ_OK);
+  delete obj;
+  CHECK_EQ(rtmp::Amf0Util::ReadNextObject(&out, &obj), rtmp::AmfUtil::READ_OK);
+  CHECK_EQ(static_cast<rtmp::CStringMap*>(obj)->Find("details")->ToString(),
+           rtmp::CString("other").ToString());
+  delete obj;
+  CHECK(out.IsEmpty());
+
+  // Read it back, in place
+  rtmp::Amf0Reader r(expected.data(), expected.size());
+  const char* s = NULL;
+  int32 len = 0;
+  double number = 0;
+  CHECK_EQ(r.ReadString(&s, &len), rtmp::AmfUtil::READ_OK);
+  CHECK_EQ(string(s, len), "onStatus");
+  CHECK_EQ(r.ReadNumber(&number), rtmp::AmfUtil::READ_OK);
+  CHECK_EQ(number, 7);
+  CHECK_EQ(r.ReadNull(), rtmp::AmfUtil::READ_OK);
+  CHECK_EQ(r.ReadObjectBegin(), rtmp::AmfUtil::READ_OK);
+  int num_properties = 0;
+  while ( true ) {
+    CHECK_EQ(r.ReadProperty(&s, &len), rtmp::AmfUtil::READ_OK);
+    if ( len == 0 ) break;
+    ++num_properties;
+    if ( string(s, len) == "code" ) {
+      string code;
+      CHECK_EQ(r.ReadString(&code), rtmp::AmfUtil::READ_OK);
+      CHECK_EQ(code, "NetStream.Play.Start");
+    } else {
+      CHECK_EQ(r.Skip(), rtmp::AmfUtil::READ_OK);
+    }
+  }
+  CHECK_EQ(num_properties, 4);
+  CHECK(r.IsEmpty());
+
+  // Skipping must pass exactly over any (nested) value ..
+  rtmp::CMixedMap metadata;
+  metadata.Set("duration", new rtmp::CNumber(12.5));
+  metadata.Set("stereo", new rtmp::CBoolean(true));
+  metadata.Set("created", new rtmp::CDate(12873242, 3600));
+  rtmp::CArray* keyframes = new rtmp::CArray();
+  keyframes->mutable_data().push_back(new rtmp::CNumber(0));
+  keyframes->mutable_data().push_back(status.Clone());
+  metadata.Set("keyframes", keyframes);
+  ms.Clear();
+  metadata.Encode(&ms, rtmp::AmfUtil::AMF0_VERSION);
+  rtmp::CString("tail").Encode(&ms, rtmp::AmfUtil::AMF0_VERSION);
+  const string encoded = ms.ToString();
+  rtmp::Amf0Reader r2(encoded.data(), encoded.size());
+  CHECK_EQ(r2.Skip(), rtmp::AmfUtil::READ_OK);
+  string tail;
+  CHECK_EQ(r2.ReadString(&tail), rtmp::AmfUtil::READ_OK);
+  CHECK_EQ(tail, "tail");
+  CHECK(r2.IsEmpty());
+
+  // .. and not move on truncated data
+  for ( int i = 0; i < encoded.size() - 7; ++i ) {
+    rtmp::Amf0Reader r3(encoded.data(), i);
+    CHECK_EQ(r3.Skip(), rtmp::AmfUtil::READ_NO_DATA) << " at: " << i;
+    CHECK_EQ(r3.position(), 0);
+  }
+  rtmp::Amf0Reader r4(encoded.data(), encoded.size());
+  CHECK_EQ(r4.ReadNumber(&number), rtmp::AmfUtil::READ_CORRUPTED_DATA);
+  CHECK_EQ(r4.position(), 0);
+}
+
 int main(int argc, char* argv[]) {
   common::Init(argc, argv);
 
@@ -133,6 +264,8 @@ int main(int argc, char* argv[]) {
   }
   CHECK(ms.IsEmpty());
 
+  TestStreaming();
+
   LOG_INFO << "PASS";
 
   common::Exit(0);
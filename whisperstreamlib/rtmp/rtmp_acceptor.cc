@@ -32,6 +32,7 @@
 // TODO(cpopescu) : make relative timestamps on options !!
 
 #include <whisperlib/net/util/ipclassifier.h>
+#include <whisperlib/net/util/admission_controller.h>
 #include <whisperlib/common/io/buffer/memory_stream.h>
 
 #include <whisperstreamlib/rtmp/rtmp_acceptor.h>
@@ -53,6 +54,7 @@ ServerAcceptor::ServerAcceptor(
     ssl_context_(NULL),
     net_acceptor_(NULL),
     classifiers_(classifiers),
+    admission_controller_(NULL),
     stats_collector_(stats_collector),
     next_connection_id_(0),
     num_accepted_connections_(0),
@@ -137,6 +139,10 @@ bool ServerAcceptor::AcceptorFilterHandler(const net::HostPort& peer) {
                 << ", flags_->max_num_connections_: " << flags_->max_num_connections_;
     return false;
   }
+  if ( admission_controller_ != NULL &&
+       !admission_controller_->Admit(peer) ) {
+    return false;
+  }
   return true;
 }
 
@@ -44,6 +44,7 @@
 
 namespace net {
 class IpClassifier;
+class AdmissionController;
 }
 
 namespace rtmp {
@@ -64,6 +65,13 @@ class ServerAcceptor {
 
   void StopServing();
 
+  // Consulted for every new client (after the max_num_connections_ check).
+  // Not owned, NULL to turn off. RTMP has nothing to say before the
+  // handshake, so the refused clients are just closed.
+  void set_admission_controller(net::AdmissionController* ac) {
+    admission_controller_ = ac;
+  }
+
  private:
   // Callback in the accepting connection when a serving connection dies
   void NotifyConnectionClose();
@@ -87,6 +95,9 @@ class ServerAcceptor {
 
   const vector<const net::IpClassifier*>* const classifiers_;
 
+  // Accept time admission control (may be NULL)
+  net::AdmissionController* admission_controller_;
+
   // used for stats logging
   streaming::StatsCollector* stats_collector_;
 
@@ -61,6 +61,11 @@ DEFINE_bool(rtmp_debug_dump_sent_events,
 DEFINE_bool(rtmp_debug_dump_only_control,
             false,
             "For debugging, dump just the control events (no audio/video)");
+DEFINE_int32(rtmp_min_chunk_reference_size,
+             8192,
+             "Chunk payloads of at least this size are linked (not copied) "
+             "from the network buffers into the event bodies. Smaller "
+             "ones are cheaper to copy.");
 
 //////////////////////////////////////////////////////////////////////
 
@@ -110,7 +115,11 @@ AmfUtil::ReadStatus Coder::Decode(io::MemoryStream* in,
       in->MarkerRestore();
       return AmfUtil::READ_NO_DATA;
     }
-    event_body.AppendStream(in, to_read);
+    if ( to_read >= FLAGS_rtmp_min_chunk_reference_size ) {
+      event_body.AppendStreamByReference(in, to_read);
+    } else {
+      event_body.AppendStream(in, to_read);
+    }
     memory_used_ += (event_body.Size() - initial_event_body_size);
     if ( memory_used_ > memory_limit_ ) {
       in->MarkerRestore();
@@ -33,11 +33,14 @@
 #include <whisperlib/common/base/date.h>
 #include <whisperlib/common/base/gflags.h>
 #include <whisperlib/common/base/log.h>
+#include <whisperlib/common/sync/mutex.h>
 #include <whisperlib/net/url/url.h>
+#include <whisperlib/net/base/outbuf_budget.h>
 #include <whisperlib/net/util/ipclassifier.h>
 #include <whisperstreamlib/rtmp/events/rtmp_call.h>
 #include <whisperstreamlib/rtmp/events/rtmp_event_invoke.h>
 #include <whisperstreamlib/rtmp/events/rtmp_event_notify.h>
+#include <whisperstreamlib/rtmp/objects/amf/amf0_streaming.h>
 #include <whisperstreamlib/rtmp/rtmp_connection.h>
 #include <whisperstreamlib/rtmp/rtmp_play_stream.h>
 #include <whisperstreamlib/rtmp/rtmp_publish_stream.h>
@@ -205,28 +208,150 @@ void ServerConnection::CloseConnection() {
   connection_->FlushAndClose();
 }
 
+namespace {
+// The replies we send over and over (status notifications, _result ..)
+// are precompiled into AMF0 templates, keyed by their fixed fields.
+// Only the invoke id (and the status details) are filled in per event.
+// Templates are never removed, so they can be used outside the lock.
+class InvokeTemplates {
+ public:
+  // Descriptions may be dynamic, don't let the cache grow unbounded.
+  static const int kMaxTemplates = 512;
+
+  InvokeTemplates() {
+  }
+  ~InvokeTemplates() {
+    for ( Map::iterator it = templates_.begin();
+          it != templates_.end(); ++it ) {
+      delete it->second;
+    }
+  }
+
+  // Returns NULL if the cache is full - build your own then.
+  const Amf0Template* GetStatus(const char* method, const char* level,
+                                const string& code,
+                                const string& description) {
+    string key(method);
+    key.append(1, '\0').append(level);
+    key.append(1, '\0').append(code);
+    key.append(1, '\0').append(description);
+    synch::MutexLocker l(&mutex_);
+    Map::const_iterator it = templates_.find(key);
+    if ( it != templates_.end() ) {
+      return it->second;
+    }
+    if ( templates_.size() >= static_cast<size_t>(kMaxTemplates) ) {
+      return NULL;
+    }
+    Amf0Template* t = new Amf0Template();
+    BuildStatus(method, level, code, description, t);
+    templates_.insert(make_pair(key, t));
+    return t;
+  }
+
+  // Slots: invoke id, details
+  static void BuildStatus(const char* method, const char* level,
+                          const string& code, const string& description,
+                          Amf0Template* t) {
+    Amf0Writer* const w = t->writer();
+    w->WriteString(method);
+    t->AppendNumberSlot();
+    w->WriteNull();
+    w->WriteObjectBegin();
+    w->WriteProperty("level");
+    w->WriteString(level);
+    w->WriteProperty("code");
+    w->WriteString(code);
+    w->WriteProperty("description");
+    w->WriteString(description);
+    w->WriteProperty("details");
+    t->AppendStringSlot();
+    w->WriteObjectEnd();
+  }
+  // Slots: invoke id, [ result ]
+  static void BuildResult(const char* method, bool number_result,
+                          Amf0Template* t) {
+    Amf0Writer* const w = t->writer();
+    w->WriteString(method);
+    t->AppendNumberSlot();
+    w->WriteNull();
+    if ( number_result ) {
+      t->AppendNumberSlot();
+    } else {
+      w->WriteNull();
+    }
+  }
+
+ private:
+  typedef map<string, Amf0Template*> Map;
+  synch::Mutex mutex_;
+  Map templates_;
+  DISALLOW_EVIL_CONSTRUCTORS(InvokeTemplates);
+};
+InvokeTemplates g_invoke_templates;
+
+// The few _result / _error shapes we send, compiled once
+class ResultTemplates {
+ public:
+  ResultTemplates() {
+    InvokeTemplates::BuildResult(kMethodResult, false, &result_);
+    InvokeTemplates::BuildResult(kMethodError, false, &error_);
+    InvokeTemplates::BuildResult(kMethodResult, true, &result_number_);
+  }
+  const Amf0Template* Get(const string& method) const {
+    if ( method == kMethodResult ) return &result_;
+    if ( method == kMethodError ) return &error_;
+    return NULL;
+  }
+  const Amf0Template& result_number() const { return result_number_; }
+ private:
+  Amf0Template result_;
+  Amf0Template error_;
+  Amf0Template result_number_;
+  DISALLOW_EVIL_CONSTRUCTORS(ResultTemplates);
+};
+const ResultTemplates& result_templates() {
+  // built on first use - kMethodResult & co. may not be initialized
+  // before us at static initialization time
+  static const ResultTemplates templates;
+  return templates;
+}
+}
+
 scoped_ref<Event> ServerConnection::CreateInvokeResultEvent(
     const string& method, int stream_id, int channel_id, int invoke_id) {
-  return new EventInvoke(
-      Header(channel_id, stream_id, rtmp::EVENT_INVOKE, 0, false),
-      new PendingCall("", method, invoke_id,
-            Call::STATUS_PENDING, NULL, new CNull()));
+  EventEncodedInvoke* const event = new EventEncodedInvoke(
+      Header(channel_id, stream_id, rtmp::EVENT_INVOKE, 0, false));
+  const Amf0Template* t = result_templates().Get(method);
+  if ( t != NULL ) {
+    t->Emit(event->mutable_data(), invoke_id);
+  } else {
+    Amf0Template tmp;
+    InvokeTemplates::BuildResult(method.c_str(), false, &tmp);
+    tmp.Emit(event->mutable_data(), invoke_id);
+  }
+  return event;
 }
 
 scoped_ref<Event> ServerConnection::CreateStatusEvent(
     int stream_id, int channel_id, int invoke_id, const string& code,
     const string& description, const string& detail, const char* method,
     const char* level) {
-  CStringMap* const arg = new  CStringMap();
-  arg->Set("level", (level != NULL) ? new CString(level):new CString("status"));
-  arg->Set("code", new CString(code));
-  arg->Set("description", new  CString(description));
-  arg->Set("details", new CString(detail));
-
-  return new EventInvoke(
-      Header(channel_id, stream_id, rtmp::EVENT_INVOKE, 0, false),
-      new PendingCall("", method != NULL ? method : "onStatus",
-          invoke_id, Call::STATUS_PENDING, NULL, arg));
+  if ( method == NULL ) method = "onStatus";
+  if ( level == NULL ) level = "status";
+
+  EventEncodedInvoke* const event = new EventEncodedInvoke(
+      Header(channel_id, stream_id, rtmp::EVENT_INVOKE, 0, false));
+  const Amf0Template* t = g_invoke_templates.GetStatus(
+      method, level, code, description);
+  if ( t != NULL ) {
+    t->Emit(event->mutable_data(), invoke_id, detail);
+  } else {
+    Amf0Template tmp;
+    InvokeTemplates::BuildStatus(method, level, code, description, &tmp);
+    tmp.Emit(event->mutable_data(), invoke_id, detail);
+  }
+  return event;
 }
 
 void ServerConnection::SendEvent(const Event& event,
@@ -300,7 +425,15 @@ bool ServerConnection::ConnectionWriteHandler() {
                  << ", closing connection";
     return false;
   }
-  if ( outbuf_size() < flags_->max_outbuf_size_/2 ) {
+  if ( net::OutbufBudget::ShouldEvict(connection_->outbuf_account()) ) {
+    LOG_WARNING << "output memory budget exhausted, dropping slow client"
+                   " w/ outbuf size: " << outbuf_size();
+    return false;
+  }
+  // Under memory pressure we feed the streams less (we do not close for it -
+  // the hard limit above stays the same)
+  if ( outbuf_size() <
+       net::OutbufBudget::ScaledLimit(flags_->max_outbuf_size_)/2 ) {
     for ( StreamMap::iterator it = streams_.begin();
           it != streams_.end(); ++it) {
       it->second->NotifyOutbufEmpty(outbuf_size());
@@ -631,13 +764,15 @@ bool ServerConnection::InvokeCreateStream(const Event* event, int invoke_id) {
   invoke_create_stream_called_ = true;
   next_stream_params_.stream_id_++;
 
-  scoped_ref<EventInvoke> reply = new EventInvoke(
+  scoped_ref<EventEncodedInvoke> reply = new EventEncodedInvoke(
       Header(event->header().channel_id(),
              event->header().stream_id(),
-             EVENT_INVOKE, 0, false),
-      new PendingCall("", kMethodResult,
-              invoke_id, Call::STATUS_PENDING, NULL, new CNumber(
-              next_stream_params_.stream_id_)));
+             EVENT_INVOKE, 0, false));
+  const double numbers[] = {
+    static_cast<double>(invoke_id),
+    static_cast<double>(next_stream_params_.stream_id_) };
+  result_templates().result_number().Emit(reply->mutable_data(),
+                                          numbers, NULL);
   system_stream_->SendEvent(reply.get(), -1, NULL, true);
   return true;
 }
@@ -116,6 +116,15 @@ class ServerConnection {
     DCHECK(connection_ != NULL);
     return connection_->outbuf()->Size();
   }
+  // bytes already written to the socket, not yet acknowledged by the peer
+  int32 kernel_outbuf_size() const {
+    DCHECK(connection_ != NULL);
+    return connection_->kernel_outbuf_size();
+  }
+  bool SetMaxPacingRate(int64 bytes_per_sec) {
+    DCHECK(connection_ != NULL);
+    return connection_->SetMaxPacingRate(bytes_per_sec);
+  }
 
   MissingStreamCache* missing_stream_cache() {
     return missing_stream_cache_;
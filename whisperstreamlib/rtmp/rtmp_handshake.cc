@@ -118,5 +118,10 @@ bool PrepareServerHandshake(const char* data, int cb,
   return true;
 }
 
+bool HasHandshakeLibrary() {
+  pthread_once(&glb_once_control, InitHandshakeLib);
+  return glb_handshake_fun != NULL;
+}
+
 //////////////////////////////////////////////////////////////////////
 }
@@ -35,5 +35,9 @@
 
 namespace rtmp {
 bool PrepareServerHandshake(const char* data, int cb, const char** response);
+// True if the handshakes are answered by the handshake library
+// (--rtmp_handshake_library / --element_libraries_dir), false if we send
+// the pre-cooked response.
+bool HasHandshakeLibrary();
 }
 #endif
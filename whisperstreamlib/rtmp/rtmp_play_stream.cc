@@ -30,6 +30,7 @@
 
 #include <whisperlib/net/url/url.h>
 #include <whisperlib/common/base/gflags.h>
+#include <whisperlib/net/base/outbuf_budget.h>
 #include <whisperstreamlib/base/media_info_util.h>
 #include <whisperstreamlib/rtmp/rtmp_play_stream.h>
 
@@ -442,7 +443,20 @@ bool PlayStream::CanSendTag() const {
   }
   const int32 outbuf_size = connection_->outbuf_size() +
       ((media_event_.get() != NULL) ? media_event_->data().Size() : 0);
-  return outbuf_size < connection_->flags().max_outbuf_size_/2;
+  return outbuf_size <
+      net::OutbufBudget::ScaledLimit(connection_->flags().max_outbuf_size_)/2;
+}
+int32 PlayStream::PendingOutputBytes() const {
+  if ( is_closed() ) {
+    return 0;
+  }
+  return connection_->outbuf_size() + connection_->kernel_outbuf_size();
+}
+bool PlayStream::SetMaxPacingRate(int64 bytes_per_sec) {
+  if ( is_closed() ) {
+    return false;
+  }
+  return connection_->SetMaxPacingRate(bytes_per_sec);
 }
 void PlayStream::SetNotifyReady() {
   if ( is_closed() ) {
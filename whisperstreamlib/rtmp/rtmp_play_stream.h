@@ -137,6 +137,8 @@ class PlayStream : public Stream, protected streaming::Exporter {
   virtual bool CanSendTag() const;
   virtual void SetNotifyReady();
   virtual void SendTag(const streaming::Tag* tag, int64 tag_timestamp_ms);
+  virtual int32 PendingOutputBytes() const;
+  virtual bool SetMaxPacingRate(int64 bytes_per_sec);
 
  private:
   void SendSimpleTag(const streaming::Tag* tag, int64 tag_timestamp_ms);
@@ -390,28 +390,21 @@ void PublishStream::InternalStop(bool send_eos, bool forced, bool dec_ref) {
   //       may be asynchronous
 }
 
-void PublishStream::SendTag(scoped_ref<streaming::Tag> tag, int64 timestamp_ms,
-    bool dec_ref) {
-  if ( !connection_->media_selector()->IsInSelectThread() ) {
-    IncRef();
-    connection_->media_selector()->RunInSelectLoop(
-        NewCallback(this, &PublishStream::SendTag, tag, timestamp_ms, true));
-    return;
-  }
-  AutoDecRef auto_dec_ref(dec_ref ? this : NULL);
-
-  if ( importer_ == NULL ) {
-    // an old scheduled SendTag(), we have been Closed in the meanwhile
+void PublishStream::SendTag(const streaming::Tag* tag,
+                            int64 timestamp_ms) {
+  CHECK(connection_->net_selector()->IsInSelectThread());
+  if ( !tag_queue_.Push(tag, timestamp_ms) ) {
     return;
   }
+  IncRef();
+  connection_->media_selector()->RunInSelectLoop(
+      NewCallback(this, &PublishStream::DrainTags));
+}
 
-  //  send it downstream
-  importer_->ProcessTag(tag.get(), timestamp_ms);
-
-  // EOS is the last tag sent downstream
-  if ( tag->type() == streaming::Tag::TYPE_EOS ) {
-    importer_ = NULL;
-  }
+void PublishStream::DrainTags() {
+  CHECK(connection_->media_selector()->IsInSelectThread());
+  AutoDecRef auto_dec_ref(this);
+  tag_queue_.Drain(&importer_);
 }
 
 } // namespace rtmp
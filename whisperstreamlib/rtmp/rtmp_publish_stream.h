@@ -33,10 +33,12 @@
 #define __NET_RTMP_RTMP_PUBLISH_STREAM_H__
 
 
+#include <vector>
 #include <whisperstreamlib/base/request.h>
 #include <whisperstreamlib/base/importer.h>
 #include <whisperstreamlib/rtmp/rtmp_stream.h>
 #include <whisperstreamlib/rtmp/rtmp_connection.h>
+#include <whisperstreamlib/rtmp/rtmp_tag_queue.h>
 #include <whisperstreamlib/rtmp/events/rtmp_event_invoke.h>
 #include <whisperstreamlib/rtmp/events/rtmp_event_notify.h>
 
@@ -74,7 +76,12 @@ class PublishStream : public Stream, public streaming::Publisher {
   // internally stop everything, close network connection
   void InternalStop(bool send_eos, bool forced, bool dec_ref = false);
 
-  void SendTag(scoped_ref<streaming::Tag> tag, int64 timestamp_ms, bool dec_ref = false);
+  // Queues a tag for the importer. Called from the net selector; the
+  // queue is drained in the media selector, in one closure for all the
+  // tags queued meanwhile (not one closure per tag).
+  void SendTag(const streaming::Tag* tag, int64 timestamp_ms);
+  // Runs in the media selector: sends the queued tags to the importer.
+  void DrainTags();
 
   ///////////////////////////////////////////////////////////////////////////
   // Publisher methods
@@ -116,6 +123,9 @@ class PublishStream : public Stream, public streaming::Publisher {
   streaming::MediaInfo media_info_;
   bool media_info_extracted_;
 
+  // The tags on their way from the net selector to the media selector
+  TagQueue tag_queue_;
+
   DISALLOW_EVIL_CONSTRUCTORS(PublishStream);
 };
 
@@ -0,0 +1,116 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+
+#ifndef __NET_RTMP_RTMP_TAG_QUEUE_H__
+#define __NET_RTMP_RTMP_TAG_QUEUE_H__
+
+#include <vector>
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/sync/mutex.h>
+#include <whisperstreamlib/base/tag.h>
+#include <whisperstreamlib/base/importer.h>
+
+namespace rtmp {
+
+// The tags of a publisher on their way from the net selector to the
+// importer, in the media selector. A single producer (net) and a single
+// consumer (media): Push() queues a tag and says when a Drain() has to be
+// scheduled - one closure for all the tags queued meanwhile (not one
+// closure per tag). Drain() just swaps the vectors under the mutex, so in
+// steady state nothing is allocated.
+class TagQueue {
+ public:
+  TagQueue()
+      : drain_scheduled_(false) {
+  }
+  ~TagQueue() {
+  }
+
+  // Producer side. Returns true if the caller has to schedule a Drain()
+  // (the first tag after the last Drain() started).
+  bool Push(const streaming::Tag* tag, int64 timestamp_ms) {
+    synch::MutexLocker l(&mutex_);
+    queue_.push_back(make_pair(scoped_ref<const streaming::Tag>(tag),
+                               timestamp_ms));
+    if ( drain_scheduled_ ) {
+      return false;
+    }
+    drain_scheduled_ = true;
+    return true;
+  }
+
+  // Consumer side: sends the queued tags to *importer, in order.
+  // We stop when *importer becomes NULL (closed in the meanwhile, maybe
+  // by the importer itself, from ProcessTag()) - the rest is dropped.
+  // EOS is the last tag sent downstream: after it we set *importer = NULL.
+  template <typename IMPORTER>
+  void Drain(IMPORTER** importer) {
+    {
+      synch::MutexLocker l(&mutex_);
+      CHECK(draining_.empty());
+      draining_.swap(queue_);
+      drain_scheduled_ = false;
+    }
+    for ( uint32 i = 0; i < draining_.size(); ++i ) {
+      if ( *importer == NULL ) {
+        break;
+      }
+      const streaming::Tag* tag = draining_[i].first.get();
+      (*importer)->ProcessTag(tag, draining_[i].second);
+      if ( tag->type() == streaming::Tag::TYPE_EOS ) {
+        *importer = NULL;
+      }
+    }
+    draining_.clear();
+  }
+
+  // The tags waiting for a Drain()
+  int32 size() const {
+    synch::MutexLocker l(&mutex_);
+    return queue_.size();
+  }
+
+ private:
+  typedef vector< pair<scoped_ref<const streaming::Tag>, int64> > Tags;
+  mutable synch::Mutex mutex_;
+  Tags queue_;
+  // true while a Drain() is due
+  bool drain_scheduled_;
+  // consumer only: the tags being sent downstream
+  Tags draining_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TagQueue);
+};
+
+} // namespace rtmp
+
+#endif  // __NET_RTMP_RTMP_TAG_QUEUE_H__
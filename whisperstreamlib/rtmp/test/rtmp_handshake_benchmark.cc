@@ -0,0 +1,324 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+// Measures how many RTMP handshakes per second (on one core) we can
+// answer: first just the response generation, then complete handshakes
+// over loopback (clients and server in the same selector).
+//
+// Use --element_libraries_dir (or --rtmp_handshake_library) to point to
+// libwhisper_streamlib_rtmp_extra.so. W/o it we would measure only the
+// fallback (pre-cooked) response, so we refuse to run (unless
+// --allow_fallback_handshake).
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/gflags.h>
+#include <whisperlib/common/base/timer.h>
+#include <whisperlib/common/io/buffer/memory_stream.h>
+#include <whisperlib/common/io/num_streaming.h>
+#include <whisperlib/net/base/selector.h>
+#include <whisperlib/net/base/connection.h>
+
+#include <whisperstreamlib/rtmp/rtmp_consts.h>
+#include <whisperstreamlib/rtmp/rtmp_handshake.h>
+
+//////////////////////////////////////////////////////////////////////
+
+DEFINE_int32(num_handshakes,
+             10000,
+             "Perform these many handshakes in each test");
+DEFINE_int32(num_parallel_clients,
+             32,
+             "Keep these many clients handshaking at the same time");
+DEFINE_int32(port,
+             19350,
+             "Our server listens on this (loopback) port");
+DEFINE_bool(allow_fallback_handshake,
+            false,
+            "Run even if the handshake library is not loaded (and measure "
+            "the pre-cooked response)");
+
+//////////////////////////////////////////////////////////////////////
+
+static void Report(const char* name, int64 start_ns, int32 num) {
+  const int64 duration_ns = max(timer::TicksNsec() - start_ns,
+                                static_cast<int64>(1));
+  LOG_INFO << name << ": " << num << " handshakes in "
+           << duration_ns / 1000000LL << " ms => "
+           << static_cast<int64>(num * 1e9 / duration_ns)
+           << " handshakes/s";
+}
+
+// A C1 as sent by a Flash Player 10 client (v3 digest position)
+static void PrepareClientData(char* data) {
+  for ( int i = 0; i < rtmp::kHandshakeSize; ++i ) {
+    data[i] = static_cast<char>(random());
+  }
+  data[4] = 0x80;
+  data[5] = 0x00;
+  data[6] = 0x03;
+  data[7] = 0x02;
+}
+
+void BenchmarkPrepareServerHandshake() {
+  char client_data[rtmp::kHandshakeSize];
+  PrepareClientData(client_data);
+  const int64 start = timer::TicksNsec();
+  for ( int32 i = 0; i < FLAGS_num_handshakes; ++i ) {
+    const char* response;
+    CHECK(rtmp::PrepareServerHandshake(client_data, rtmp::kHandshakeSize,
+                                       &response));
+    delete [] response;
+  }
+  Report("rtmp::PrepareServerHandshake", start, FLAGS_num_handshakes);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+class LoopbackBenchmark;
+
+// Base for both ends: deletes itself when the connection is closed
+class HandshakePeer {
+ public:
+  HandshakePeer(net::Selector* selector, net::NetConnection* conn)
+      : selector_(selector),
+        conn_(conn) {
+    conn_->SetReadHandler(NewPermanentCallback(
+        this, &HandshakePeer::HandleRead), true);
+    conn_->SetWriteHandler(NewPermanentCallback(
+        this, &HandshakePeer::HandleWrite), true);
+    conn_->SetCloseHandler(NewPermanentCallback(
+        this, &HandshakePeer::HandleClose), true);
+  }
+  virtual ~HandshakePeer() {
+    delete conn_;
+  }
+
+ protected:
+  virtual bool HandleRead() = 0;
+  virtual void Closed() {}
+
+  net::Selector* const selector_;
+  net::NetConnection* const conn_;
+
+ private:
+  bool HandleWrite() {
+    return true;
+  }
+  void HandleClose(int err, net::NetConnection::CloseWhat what) {
+    if ( what != net::NetConnection::CLOSE_READ_WRITE ) {
+      conn_->FlushAndClose();
+      return;
+    }
+    Closed();
+    selector_->DeleteInSelectLoop(this);
+  }
+
+  DISALLOW_EVIL_CONSTRUCTORS(HandshakePeer);
+};
+
+// The server side (what rtmp::ServerConnection does): C0 + C1 ->
+// S0 + S1 + S2, then waits for C2.
+class ServerPeer : public HandshakePeer {
+ public:
+  ServerPeer(net::Selector* selector, net::NetConnection* conn)
+      : HandshakePeer(selector, conn),
+        replied_(false) {
+  }
+
+ private:
+  virtual bool HandleRead() {
+    io::MemoryStream* const in = conn_->inbuf();
+    if ( !replied_ ) {
+      if ( in->Size() < rtmp::kHandshakeSize + 1 ) {
+        return true;
+      }
+      CHECK_EQ(io::NumStreamer::ReadByte(in), rtmp::kHandshakeLeadByte);
+      char client_data[rtmp::kHandshakeSize];
+      CHECK_EQ(in->Read(client_data, rtmp::kHandshakeSize),
+               rtmp::kHandshakeSize);
+      const char* response;
+      CHECK(rtmp::PrepareServerHandshake(client_data, rtmp::kHandshakeSize,
+                                         &response));
+      io::NumStreamer::WriteByte(conn_->outbuf(), rtmp::kHandshakeLeadByte);
+      conn_->Write(response, 2 * rtmp::kHandshakeSize);
+      delete [] response;
+      replied_ = true;
+    }
+    if ( in->Size() >= rtmp::kHandshakeSize ) {
+      in->Skip(rtmp::kHandshakeSize);
+      conn_->FlushAndClose();
+    }
+    return true;
+  }
+
+  bool replied_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ServerPeer);
+};
+
+// The client side: C0 + C1, waits for S0 + S1 + S2, then sends C2.
+class ClientPeer : public HandshakePeer {
+ public:
+  ClientPeer(net::Selector* selector, LoopbackBenchmark* benchmark);
+
+  void Start() {
+    CHECK(conn_->Connect(net::HostPort("127.0.0.1", FLAGS_port)));
+  }
+
+ private:
+  void HandleConnect() {
+    char client_data[rtmp::kHandshakeSize];
+    PrepareClientData(client_data);
+    io::NumStreamer::WriteByte(conn_->outbuf(), rtmp::kHandshakeLeadByte);
+    conn_->Write(client_data, rtmp::kHandshakeSize);
+  }
+  virtual bool HandleRead();
+  virtual void Closed();
+
+  LoopbackBenchmark* const benchmark_;
+  bool done_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ClientPeer);
+};
+
+class LoopbackBenchmark {
+ public:
+  explicit LoopbackBenchmark(net::Selector* selector)
+      : selector_(selector),
+        acceptor_(selector),
+        num_started_(0),
+        num_completed_(0),
+        num_closed_(0),
+        start_ns_(0) {
+    acceptor_.SetAcceptHandler(NewPermanentCallback(
+        this, &LoopbackBenchmark::HandleAccept), true);
+  }
+
+  void Start() {
+    CHECK(acceptor_.Listen(net::HostPort("127.0.0.1", FLAGS_port)))
+        << " Cannot listen on port: " << FLAGS_port;
+    start_ns_ = timer::TicksNsec();
+    for ( int32 i = 0; i < FLAGS_num_parallel_clients; ++i ) {
+      StartClient();
+    }
+  }
+
+  void ClientCompleted() {
+    ++num_completed_;
+    if ( num_completed_ == FLAGS_num_handshakes ) {
+      Report("Loopback handshakes", start_ns_, num_completed_);
+    }
+  }
+  void ClientClosed() {
+    ++num_closed_;
+    if ( num_closed_ == FLAGS_num_handshakes ) {
+      acceptor_.Close();
+      selector_->MakeLoopExit();
+      return;
+    }
+    StartClient();
+  }
+
+ private:
+  void StartClient() {
+    if ( num_started_ >= FLAGS_num_handshakes ) {
+      return;
+    }
+    ++num_started_;
+    (new ClientPeer(selector_, this))->Start();
+  }
+  void HandleAccept(net::NetConnection* conn) {
+    new ServerPeer(selector_, conn);
+  }
+
+  net::Selector* const selector_;
+  net::TcpAcceptor acceptor_;
+  int32 num_started_;
+  int32 num_completed_;
+  int32 num_closed_;
+  int64 start_ns_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(LoopbackBenchmark);
+};
+
+ClientPeer::ClientPeer(net::Selector* selector, LoopbackBenchmark* benchmark)
+    : HandshakePeer(selector, new net::TcpConnection(selector)),
+      benchmark_(benchmark),
+      done_(false) {
+  conn_->SetConnectHandler(NewPermanentCallback(
+      this, &ClientPeer::HandleConnect), true);
+}
+
+bool ClientPeer::HandleRead() {
+  io::MemoryStream* const in = conn_->inbuf();
+  if ( done_ || in->Size() < 2 * rtmp::kHandshakeSize + 1 ) {
+    return true;
+  }
+  CHECK_EQ(io::NumStreamer::ReadByte(in), rtmp::kHandshakeLeadByte);
+  char server_data[2 * rtmp::kHandshakeSize];
+  CHECK_EQ(in->Read(server_data, sizeof(server_data)),
+           sizeof(server_data));
+  // C2 echoes S1
+  conn_->Write(server_data, rtmp::kHandshakeSize);
+  conn_->FlushAndClose();
+  done_ = true;
+  benchmark_->ClientCompleted();
+  return true;
+}
+
+void ClientPeer::Closed() {
+  CHECK(done_) << " Handshake not completed";
+  benchmark_->ClientClosed();
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  if ( !rtmp::HasHandshakeLibrary() ) {
+    if ( !FLAGS_allow_fallback_handshake ) {
+      LOG_FATAL << "No handshake library loaded - we would measure only the "
+                   "pre-cooked response. Set --element_libraries_dir or "
+                   "--rtmp_handshake_library (or --allow_fallback_handshake).";
+    }
+    LOG_ERROR << "=== No handshake library loaded: MEASURING THE FALLBACK "
+                 "(PRE-COOKED) RESPONSE, NOT THE HMAC PATH ===";
+  }
+  BenchmarkPrepareServerHandshake();
+
+  net::Selector selector;
+  LoopbackBenchmark benchmark(&selector);
+  selector.RunInSelectLoop(NewCallback(&benchmark, &LoopbackBenchmark::Start));
+  selector.Loop();
+  LOG_INFO << "DONE";
+}
@@ -0,0 +1,148 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+// Golden vectors for the handshake module (handshaker/rtmp_new_handshake.cc,
+// built in here): the S1 / S2 we send for some fixed C1 blocks. They were
+// produced by the original (bundled sha256) implementation, so they pin
+// the OpenSSL HMAC path to the same bytes.
+
+#include <openssl/sha.h>
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperstreamlib/rtmp/rtmp_consts.h>
+
+// The module entry point (usually dlopen-ed by rtmp::PrepareServerHandshake)
+extern "C" bool PrepareServerHandshake(const uint8* data, int cb,
+                                       const char** response);
+
+namespace {
+
+struct GoldenVector {
+  uint32 version_;     // client version (C1 bytes 4-7)
+  uint32 seed_;        // for the rest of C1
+  const char* s1_sha256_;
+  const char* s2_sha256_;
+  const char* s2_digest_;  // the last 32 bytes of S2
+};
+
+const GoldenVector kGoldenVectors[] = {
+  // Flash Player 10.0.12.36 (v1 digest position)
+  { 0x0a000c02, 1,
+    "eb09074983c5c0d4996ca06a163da18e52510e0dd06f984d205b08525590e48a",
+    "bebc57c2f29775bded03bfc1df440d166e5f556e62a145cdff8824c7bc7acdd7",
+    "33c1c311ba4bab340b2098a4765f9b3f82a2dd82cb562fbe80bbfed0511075b2" },
+  // Flash Player 10.0.22.87 (v1)
+  { 0x80000102, 2,
+    "eb09074983c5c0d4996ca06a163da18e52510e0dd06f984d205b08525590e48a",
+    "27da7cd3ee0a0317fa4925e5ac0dbff194ce7cdb4252ef9b41058e9ebc4e9a07",
+    "317440579c1284ab5e7f52335b3d09c4b053b7aee0add8dea02cb5a4879ff7f2" },
+  // Flash Player 10.0.32.18 (v3 digest position)
+  { 0x80000302, 1,
+    "9aebff8f5171696798f96fbcf61cf2e91fa99253dd735db48e333cad58d0cbbf",
+    "60f01b04375df50ccd88f727fe3aa60ede616fede11b86dd6065107585d27129",
+    "d50733b4fe490e9421faf279af79ffc56fbce5f0b3abcad2244808e8e020b68a" },
+  { 0x80000302, 2,
+    "9aebff8f5171696798f96fbcf61cf2e91fa99253dd735db48e333cad58d0cbbf",
+    "c518a0b5ded3a4dbd196124a25a24440902a1d146d0c7575f42df42de56bc6bf",
+    "860201c0d1f4018a1aeca3875f5e867e4472d7f6931ce31706b66f8780dac095" },
+};
+
+// A C1 w/ the given version, and the rest from a fixed LCG
+void MakeClientData(uint32 version, uint32 seed, uint8* data) {
+  uint32 x = seed;
+  for ( int i = 0; i < rtmp::kHandshakeSize; ++i ) {
+    x = x * 1103515245 + 12345;
+    data[i] = (x >> 16) & 0xff;
+  }
+  data[4] = (version >> 24) & 0xff;
+  data[5] = (version >> 16) & 0xff;
+  data[6] = (version >> 8) & 0xff;
+  data[7] = version & 0xff;
+}
+
+string Hex(const uint8* data, int size) {
+  static const char kDigits[] = "0123456789abcdef";
+  string s;
+  for ( int i = 0; i < size; ++i ) {
+    s.push_back(kDigits[data[i] >> 4]);
+    s.push_back(kDigits[data[i] & 0x0f]);
+  }
+  return s;
+}
+
+string Sha256Hex(const uint8* data, int size) {
+  uint8 digest[SHA256_DIGEST_LENGTH];
+  SHA256(data, size, digest);
+  return Hex(digest, sizeof(digest));
+}
+
+void TestGoldenVectors() {
+  for ( int i = 0; i < NUMBEROF(kGoldenVectors); ++i ) {
+    const GoldenVector& v = kGoldenVectors[i];
+    uint8 client_data[rtmp::kHandshakeSize];
+    MakeClientData(v.version_, v.seed_, client_data);
+    const char* response = NULL;
+    CHECK(PrepareServerHandshake(client_data, sizeof(client_data),
+                                 &response));
+    const uint8* const s1 = reinterpret_cast<const uint8*>(response);
+    const uint8* const s2 = s1 + rtmp::kHandshakeSize;
+    CHECK_EQ(Sha256Hex(s1, rtmp::kHandshakeSize), v.s1_sha256_)
+        << " vector #" << i;
+    CHECK_EQ(Hex(s2 + rtmp::kHandshakeSize - SHA256_DIGEST_LENGTH,
+                 SHA256_DIGEST_LENGTH), v.s2_digest_)
+        << " vector #" << i;
+    CHECK_EQ(Sha256Hex(s2, rtmp::kHandshakeSize), v.s2_sha256_)
+        << " vector #" << i;
+    delete [] response;
+  }
+  LOG_INFO << "OK golden vectors";
+}
+
+void TestShortClientData() {
+  // no room for the digest => no response
+  uint8 client_data[rtmp::kHandshakeSize];
+  MakeClientData(0x80000302, 1, client_data);
+  const char* response = NULL;
+  CHECK(!PrepareServerHandshake(client_data, 776, &response));
+  delete [] response;
+  LOG_INFO << "OK short client data";
+}
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestGoldenVectors();
+  TestShortClientData();
+  LOG_INFO << "PASS";
+  common::Exit(0);
+}
@@ -0,0 +1,525 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+//
+// Measures the publish side ingest: demuxing RTMP chunks into events,
+// extracting the FLV tags and handing them to a media thread. First
+// in memory, then over loopback w/ many publishers in parallel (the
+// publishers run in their own thread, the tags go to a third one).
+//
+// The session is either a recorded one (--session_file: the raw bytes
+// sent by an encoder, after the handshake) or a synthetic one.
+// Use --rtmp_min_chunk_reference_size=1000000000 to compare against
+// copying the chunks, --per_tag_closures to compare against sending
+// each tag to the media thread in its own closure.
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/gflags.h>
+#include <whisperlib/common/base/timer.h>
+#include <whisperlib/common/base/ref_counted.h>
+#include <whisperlib/common/io/buffer/memory_stream.h>
+#include <whisperlib/common/io/file/file_input_stream.h>
+#include <whisperlib/net/base/selector.h>
+#include <whisperlib/net/base/connection.h>
+
+#include <whisperstreamlib/flv/flv_tag.h>
+#include <whisperstreamlib/rtmp/rtmp_consts.h>
+#include <whisperstreamlib/rtmp/rtmp_coder.h>
+#include <whisperstreamlib/rtmp/rtmp_util.h>
+#include <whisperstreamlib/rtmp/rtmp_tag_queue.h>
+#include <whisperstreamlib/rtmp/events/rtmp_event.h>
+
+//////////////////////////////////////////////////////////////////////
+
+DEFINE_string(session_file,
+              "",
+              "Replay this recorded publish session (client to server "
+              "bytes, w/o the handshake). If empty, we make up one.");
+DEFINE_int32(synthetic_duration_sec,
+             60,
+             "Length of the synthetic session");
+DEFINE_int32(synthetic_video_kbps,
+             2000,
+             "Video bitrate of the synthetic session (25 fps)");
+DEFINE_int32(synthetic_audio_kbps,
+             128,
+             "Audio bitrate of the synthetic session (AAC, 44.1 kHz)");
+DEFINE_int32(synthetic_chunk_size,
+             4096,
+             "The synthetic publisher sets this chunk size");
+DEFINE_int32(num_replays,
+             10,
+             "Each publisher sends the session these many times");
+DEFINE_int32(num_parallel_publishers,
+             32,
+             "Publish on these many connections at the same time "
+             "(0 => just the in memory test)");
+DEFINE_bool(per_tag_closures,
+            false,
+            "Send each tag to the media thread in its own closure "
+            "(instead of queueing them and draining the queue once "
+            "per loop)");
+DEFINE_int32(port,
+             19351,
+             "Our server listens on this (loopback) port");
+
+//////////////////////////////////////////////////////////////////////
+
+static const int64 kCoderMemoryLimit = 8 << 20;
+
+struct IngestStats {
+  IngestStats() : bytes_(0), events_(0), tags_(0) {}
+  int64 bytes_;
+  int64 events_;
+  int64 tags_;
+};
+
+static void Report(const char* name, int64 duration_ns,
+                   const IngestStats& stats) {
+  duration_ns = max(duration_ns, static_cast<int64>(1));
+  LOG_INFO << name << ": " << stats.bytes_ << " bytes, "
+           << stats.events_ << " events, " << stats.tags_ << " tags in "
+           << duration_ns / 1000000LL << " ms => "
+           << static_cast<int64>(stats.bytes_ * 1e3 / duration_ns)
+           << " MB/s, "
+           << static_cast<int64>(stats.events_ * 1e9 / duration_ns)
+           << " events/s, "
+           << static_cast<int64>(stats.tags_ * 1e9 / duration_ns)
+           << " tags/s";
+}
+
+static void AppendEvent(rtmp::Coder* coder, rtmp::Event* event,
+                        io::MemoryStream* out) {
+  scoped_ref<rtmp::Event> ref(event);
+  coder->Encode(*event, rtmp::AmfUtil::AMF0_VERSION, out);
+}
+
+static rtmp::Event* MakeMediaEvent(rtmp::EventType type,
+                                   uint32 timestamp_ms,
+                                   const char* flags, int32 flags_size,
+                                   const string& payload, int32 size) {
+  // audio on channel 4, video on channel 5 (like the Flash Player)
+  const rtmp::Header header(type == rtmp::EVENT_AUDIO_DATA ? 4 : 5,
+                            1, type, timestamp_ms, false);
+  rtmp::BulkDataEvent* const event =
+      (type == rtmp::EVENT_AUDIO_DATA
+       ? static_cast<rtmp::BulkDataEvent*>(new rtmp::EventAudioData(header))
+       : static_cast<rtmp::BulkDataEvent*>(new rtmp::EventVideoData(header)));
+  event->mutable_data()->Write(flags, flags_size);
+  size = max(size - flags_size, 1);
+  while ( size > 0 ) {
+    const int32 len = min(size, static_cast<int32>(payload.size()));
+    event->mutable_data()->Write(payload.data(), len);
+    size -= len;
+  }
+  return event;
+}
+
+// What an encoder sends after publish: a chunk size, then AAC and
+// H.264 (in AVC NALU packets) interleaved by timestamp.
+static void SynthesizeSession(io::MemoryStream* out) {
+  rtmp::Coder coder(kCoderMemoryLimit);
+  AppendEvent(&coder, new rtmp::EventChunkSize(
+      rtmp::Header(2, 0, rtmp::EVENT_CHUNK_SIZE, 0, false),
+      FLAGS_synthetic_chunk_size), out);
+
+  string payload;
+  for ( int32 i = 0; i < 65536; ++i ) {
+    payload.push_back(static_cast<char>(random()));
+  }
+  const int32 video_frame_size = FLAGS_synthetic_video_kbps * 1000 / 8 / 25;
+  const int32 audio_frame_size = FLAGS_synthetic_audio_kbps * 1000 / 8 / 43;
+  const char audio_flags[] = { '\xaf', '\x01' };
+  int64 audio_frame = 0;
+  for ( int32 frame = 0; frame < FLAGS_synthetic_duration_sec * 25;
+        ++frame ) {
+    const uint32 video_ts = frame * 40;
+    // AAC frames are 1024 samples
+    while ( audio_frame * 1024 * 1000 / 44100 <= video_ts ) {
+      AppendEvent(&coder, MakeMediaEvent(
+          rtmp::EVENT_AUDIO_DATA, audio_frame * 1024 * 1000 / 44100,
+          audio_flags, sizeof(audio_flags), payload, audio_frame_size),
+          out);
+      ++audio_frame;
+    }
+    // a key frame every 2 seconds, 4 times larger than the rest. The
+    // frame is one IDR / non IDR slice NALU.
+    const bool is_key = (frame % 50) == 0;
+    const int32 size = is_key ? 4 * video_frame_size : video_frame_size;
+    const int32 nalu_size = max(size - 9, 1);
+    const char video_flags[] = {
+      is_key ? '\x17' : '\x27', '\x01', '\x00', '\x00', '\x00',
+      static_cast<char>(nalu_size >> 24), static_cast<char>(nalu_size >> 16),
+      static_cast<char>(nalu_size >> 8), static_cast<char>(nalu_size),
+      is_key ? '\x65' : '\x41' };
+    AppendEvent(&coder, MakeMediaEvent(
+        rtmp::EVENT_VIDEO_DATA, video_ts,
+        video_flags, sizeof(video_flags), payload, size), out);
+  }
+}
+
+static void PrepareSession(io::MemoryStream* session) {
+  if ( FLAGS_session_file.empty() ) {
+    SynthesizeSession(session);
+    LOG_INFO << "Synthetic session: " << session->Size() << " bytes";
+  } else {
+    session->Write(io::FileInputStream::ReadFileOrDie(FLAGS_session_file));
+    LOG_INFO << "Session from: " << FLAGS_session_file << ": "
+             << session->Size() << " bytes";
+  }
+}
+
+// Decodes all the events available in 'in', returns false on error
+static bool DecodeEvents(rtmp::Coder* coder, io::MemoryStream* in,
+                         IngestStats* stats,
+                         vector< scoped_ref<streaming::FlvTag> >* tags) {
+  while ( true ) {
+    scoped_ref<rtmp::Event> event;
+    const rtmp::AmfUtil::ReadStatus err = coder->Decode(
+        in, rtmp::AmfUtil::AMF0_VERSION, &event);
+    if ( err == rtmp::AmfUtil::READ_NO_DATA ) {
+      return true;
+    }
+    if ( err != rtmp::AmfUtil::READ_OK ) {
+      LOG_ERROR << "Error decoding the session: "
+                << rtmp::AmfUtil::ReadStatusName(err);
+      return false;
+    }
+    ++stats->events_;
+    const int32 initial_tags = tags->size();
+    rtmp::ExtractFlvTags(*event.get(), event->header().timestamp_ms(), tags);
+    stats->tags_ += tags->size() - initial_tags;
+  }
+}
+
+void BenchmarkDecode(const io::MemoryStream& session) {
+  IngestStats stats;
+  int64 duration_ns = 0;
+  for ( int32 i = 0; i < FLAGS_num_replays; ++i ) {
+    io::MemoryStream in;
+    in.AppendStreamNonDestructive(&session);
+    const int64 start = timer::TicksNsec();
+    rtmp::Coder coder(kCoderMemoryLimit);
+    vector< scoped_ref<streaming::FlvTag> > tags;
+    stats.bytes_ += in.Size();
+    CHECK(DecodeEvents(&coder, &in, &stats, &tags));
+    duration_ns += timer::TicksNsec() - start;
+  }
+  Report("In memory rtmp::Coder::Decode + ExtractFlvTags",
+         duration_ns, stats);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Stands for the importer: runs in the media thread.
+class MediaSink {
+ public:
+  MediaSink() : num_tags_(0) {}
+  void ProcessTag(const streaming::Tag* tag, int64 timestamp_ms) {
+    ++num_tags_;
+  }
+  void ProcessFlvTag(scoped_ref<streaming::FlvTag> tag) {
+    ProcessTag(tag.get(), tag->timestamp_ms());
+  }
+  int64 num_tags() const { return num_tags_; }
+ private:
+  int64 num_tags_;
+  DISALLOW_EVIL_CONSTRUCTORS(MediaSink);
+};
+
+// Moves the tags of one publisher to the media thread, through the
+// rtmp::TagQueue of rtmp::PublishStream (drained once per media loop).
+class TagForwarder : public RefCounted {
+ public:
+  TagForwarder(net::Selector* media_selector, MediaSink* sink)
+      : media_selector_(media_selector),
+        sink_(sink) {
+  }
+  void Send(const vector< scoped_ref<streaming::FlvTag> >& tags) {
+    if ( FLAGS_per_tag_closures ) {
+      for ( uint32 i = 0; i < tags.size(); ++i ) {
+        media_selector_->RunInSelectLoop(
+            NewCallback(sink_, &MediaSink::ProcessFlvTag, tags[i]));
+      }
+      return;
+    }
+    bool schedule_drain = false;
+    for ( uint32 i = 0; i < tags.size(); ++i ) {
+      if ( queue_.Push(tags[i].get(), tags[i]->timestamp_ms()) ) {
+        schedule_drain = true;
+      }
+    }
+    if ( !schedule_drain ) {
+      return;
+    }
+    IncRef();
+    media_selector_->RunInSelectLoop(
+        NewCallback(this, &TagForwarder::Drain));
+  }
+
+ private:
+  void Drain() {
+    // we never send EOS, the sink stays
+    MediaSink* sink = sink_;
+    queue_.Drain(&sink);
+    DecRef();
+  }
+
+  net::Selector* const media_selector_;
+  MediaSink* const sink_;
+  rtmp::TagQueue queue_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TagForwarder);
+};
+
+class LoopbackBenchmark;
+
+// Base for both ends: deletes itself when the connection is closed
+class IngestPeer {
+ public:
+  IngestPeer(net::Selector* selector, net::NetConnection* conn)
+      : selector_(selector),
+        conn_(conn) {
+    conn_->SetReadHandler(NewPermanentCallback(
+        this, &IngestPeer::HandleRead), true);
+    conn_->SetWriteHandler(NewPermanentCallback(
+        this, &IngestPeer::HandleWrite), true);
+    conn_->SetCloseHandler(NewPermanentCallback(
+        this, &IngestPeer::HandleClose), true);
+  }
+  virtual ~IngestPeer() {
+    delete conn_;
+  }
+
+ protected:
+  virtual bool HandleRead() = 0;
+  virtual bool HandleWrite() {
+    return true;
+  }
+  virtual void Closed() {}
+
+  net::Selector* const selector_;
+  net::NetConnection* const conn_;
+
+ private:
+  void HandleClose(int err, net::NetConnection::CloseWhat what) {
+    if ( what != net::NetConnection::CLOSE_READ_WRITE ) {
+      conn_->FlushAndClose();
+      return;
+    }
+    Closed();
+    selector_->DeleteInSelectLoop(this);
+  }
+
+  DISALLOW_EVIL_CONSTRUCTORS(IngestPeer);
+};
+
+// The server side (what rtmp::ServerConnection + rtmp::PublishStream do)
+class ServerPeer : public IngestPeer {
+ public:
+  ServerPeer(net::Selector* selector, net::NetConnection* conn,
+             LoopbackBenchmark* benchmark, TagForwarder* forwarder)
+      : IngestPeer(selector, conn),
+        benchmark_(benchmark),
+        coder_(kCoderMemoryLimit),
+        forwarder_(forwarder) {
+  }
+
+ private:
+  virtual bool HandleRead();
+  virtual void Closed();
+
+  LoopbackBenchmark* const benchmark_;
+  rtmp::Coder coder_;
+  scoped_ref<TagForwarder> forwarder_;
+  IngestStats stats_;
+  vector< scoped_ref<streaming::FlvTag> > tags_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ServerPeer);
+};
+
+// The publisher: sends the session --num_replays times, then closes.
+class ClientPeer : public IngestPeer {
+ public:
+  ClientPeer(net::Selector* selector, const io::MemoryStream* session)
+      : IngestPeer(selector, new net::TcpConnection(selector)),
+        session_(session),
+        num_sent_(0) {
+    conn_->SetConnectHandler(NewPermanentCallback(
+        this, &ClientPeer::HandleConnect), true);
+  }
+
+  void Start() {
+    CHECK(conn_->Connect(net::HostPort("127.0.0.1", FLAGS_port)));
+  }
+
+ private:
+  void HandleConnect() {
+    HandleWrite();
+  }
+  virtual bool HandleRead() {
+    conn_->inbuf()->Clear();
+    return true;
+  }
+  virtual bool HandleWrite() {
+    // keep about one session in the output buffer
+    if ( conn_->outbuf()->Size() < session_->Size() / 2 ) {
+      if ( num_sent_ < FLAGS_num_replays ) {
+        conn_->outbuf()->AppendStreamNonDestructive(session_);
+        conn_->RequestWriteEvents(true);
+        ++num_sent_;
+      } else if ( conn_->outbuf()->IsEmpty() ) {
+        conn_->FlushAndClose();
+      }
+    }
+    return true;
+  }
+
+  const io::MemoryStream* const session_;
+  int32 num_sent_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ClientPeer);
+};
+
+class LoopbackBenchmark {
+ public:
+  LoopbackBenchmark(net::Selector* selector,
+                    net::Selector* client_selector,
+                    net::Selector* media_selector,
+                    const io::MemoryStream* session)
+      : selector_(selector),
+        client_selector_(client_selector),
+        media_selector_(media_selector),
+        session_(session),
+        acceptor_(selector),
+        num_closed_(0),
+        start_ns_(0) {
+    acceptor_.SetAcceptHandler(NewPermanentCallback(
+        this, &LoopbackBenchmark::HandleAccept), true);
+  }
+
+  void Start() {
+    CHECK(acceptor_.Listen(net::HostPort("127.0.0.1", FLAGS_port)))
+        << " Cannot listen on port: " << FLAGS_port;
+    start_ns_ = timer::TicksNsec();
+    for ( int32 i = 0; i < FLAGS_num_parallel_publishers; ++i ) {
+      client_selector_->RunInSelectLoop(
+          NewCallback(this, &LoopbackBenchmark::StartClient));
+    }
+  }
+
+  void ServerClosed(const IngestStats& stats) {
+    stats_.bytes_ += stats.bytes_;
+    stats_.events_ += stats.events_;
+    stats_.tags_ += stats.tags_;
+    ++num_closed_;
+    if ( num_closed_ < FLAGS_num_parallel_publishers ) {
+      return;
+    }
+    Report("Loopback ingest", timer::TicksNsec() - start_ns_, stats_);
+    acceptor_.Close();
+    // the media thread still has to consume what we sent it
+    media_selector_->RunInSelectLoop(
+        NewCallback(this, &LoopbackBenchmark::MediaCompleted));
+  }
+
+ private:
+  void StartClient() {
+    (new ClientPeer(client_selector_, session_))->Start();
+  }
+  void HandleAccept(net::NetConnection* conn) {
+    new ServerPeer(selector_, conn, this,
+                   new TagForwarder(media_selector_, &sink_));
+  }
+  void MediaCompleted() {
+    IngestStats stats(stats_);
+    stats.tags_ = sink_.num_tags();
+    Report("Loopback ingest + media thread", timer::TicksNsec() - start_ns_,
+           stats);
+    CHECK_EQ(sink_.num_tags(), stats_.tags_);
+    selector_->RunInSelectLoop(NewCallback(selector_,
+                                           &net::Selector::MakeLoopExit));
+  }
+
+  net::Selector* const selector_;
+  net::Selector* const client_selector_;
+  net::Selector* const media_selector_;
+  const io::MemoryStream* const session_;
+  net::TcpAcceptor acceptor_;
+  MediaSink sink_;
+  int32 num_closed_;
+  IngestStats stats_;
+  int64 start_ns_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(LoopbackBenchmark);
+};
+
+bool ServerPeer::HandleRead() {
+  io::MemoryStream* const in = conn_->inbuf();
+  const int32 initial_size = in->Size();
+  if ( !DecodeEvents(&coder_, in, &stats_, &tags_) ) {
+    return false;
+  }
+  stats_.bytes_ += initial_size - in->Size();
+  forwarder_->Send(tags_);
+  tags_.clear();
+  return true;
+}
+
+void ServerPeer::Closed() {
+  benchmark_->ServerClosed(stats_);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  io::MemoryStream session;
+  PrepareSession(&session);
+  BenchmarkDecode(session);
+
+  if ( FLAGS_num_parallel_publishers > 0 ) {
+    net::SelectorThread client_thread;
+    net::SelectorThread media_thread;
+    client_thread.Start();
+    media_thread.Start();
+    net::Selector selector;
+    LoopbackBenchmark benchmark(&selector,
+                                client_thread.mutable_selector(),
+                                media_thread.mutable_selector(),
+                                &session);
+    selector.RunInSelectLoop(NewCallback(&benchmark,
+                                         &LoopbackBenchmark::Start));
+    selector.Loop();
+  }
+  LOG_INFO << "DONE";
+}
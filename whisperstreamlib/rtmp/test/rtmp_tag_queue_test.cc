@@ -0,0 +1,281 @@
+// Copyright (c) 2009, Whispersoft s.r.l.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// * Neither the name of Whispersoft s.r.l. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Catalin Popescu
+
+#include <whisperlib/common/base/types.h>
+#include <whisperlib/common/base/log.h>
+#include <whisperlib/common/base/system.h>
+#include <whisperlib/common/base/callback.h>
+#include <whisperlib/common/sync/event.h>
+#include <whisperlib/net/base/selector.h>
+#include <whisperstreamlib/base/consts.h>
+#include <whisperstreamlib/base/tag.h>
+#include <whisperstreamlib/rtmp/rtmp_tag_queue.h>
+
+namespace {
+
+// Records what it receives. Can stop the publisher (i.e. what
+// PublishStream::Stop() does) when it gets a given tag.
+class TestImporter : public streaming::RtmpImporter {
+ public:
+  TestImporter()
+      : publisher_importer_(NULL),
+        stop_at_(-1) {
+  }
+  virtual string ImportPath() const { return "test"; }
+  virtual void Start(string subpath,
+                     streaming::AuthorizerRequest auth,
+                     string command,
+                     streaming::Publisher* publisher) {
+  }
+  virtual void ProcessTag(const streaming::Tag* tag, int64 timestamp_ms) {
+    if ( tag->type() == streaming::Tag::TYPE_EOS ) {
+      received_.push_back(-1);
+    } else {
+      received_.push_back(timestamp_ms);
+    }
+    if ( timestamp_ms == stop_at_ ) {
+      *publisher_importer_ = NULL;
+    }
+  }
+  // the publisher's pointer to us
+  void set_stop_at(streaming::RtmpImporter** publisher_importer,
+                   int64 stop_at) {
+    publisher_importer_ = publisher_importer;
+    stop_at_ = stop_at;
+  }
+  // the timestamps we got, -1 for EOS
+  const vector<int64>& received() const { return received_; }
+
+ private:
+  streaming::RtmpImporter** publisher_importer_;
+  int64 stop_at_;
+  vector<int64> received_;
+};
+
+// Pushes a media tag w/ the given timestamp
+bool PushTag(rtmp::TagQueue* queue, int64 timestamp_ms) {
+  scoped_ref<streaming::CuePointTag> tag(new streaming::CuePointTag(
+      0, streaming::kDefaultFlavourMask));
+  return queue->Push(tag.get(), timestamp_ms);
+}
+bool PushEos(rtmp::TagQueue* queue) {
+  scoped_ref<streaming::EosTag> tag(new streaming::EosTag(
+      0, streaming::kDefaultFlavourMask, false));
+  return queue->Push(tag.get(), 0);
+}
+
+string ToString(const vector<int64>& v) {
+  ostringstream oss;
+  oss << "[";
+  for ( int i = 0; i < v.size(); ++i ) {
+    oss << (i > 0 ? ", " : "") << v[i];
+  }
+  oss << "]";
+  return oss.str();
+}
+
+void TestBatching() {
+  rtmp::TagQueue queue;
+  TestImporter importer;
+  streaming::RtmpImporter* crt_importer = &importer;
+  // one drain for all the tags queued before it runs
+  CHECK(PushTag(&queue, 1));
+  CHECK(!PushTag(&queue, 2));
+  CHECK(!PushTag(&queue, 3));
+  CHECK_EQ(queue.size(), 3);
+  queue.Drain(&crt_importer);
+  CHECK_EQ(queue.size(), 0);
+  CHECK_EQ(ToString(importer.received()), "[1, 2, 3]");
+  CHECK(crt_importer == &importer);
+  // .. then a new one is due
+  CHECK(PushTag(&queue, 4));
+  queue.Drain(&crt_importer);
+  CHECK_EQ(ToString(importer.received()), "[1, 2, 3, 4]");
+  LOG_INFO << "TestBatching OK";
+}
+
+void TestEos() {
+  // EOS is the last thing the importer gets
+  rtmp::TagQueue queue;
+  TestImporter importer;
+  streaming::RtmpImporter* crt_importer = &importer;
+  CHECK(PushTag(&queue, 1));
+  CHECK(!PushEos(&queue));
+  CHECK(!PushTag(&queue, 2));
+  queue.Drain(&crt_importer);
+  CHECK_EQ(ToString(importer.received()), "[1, -1]");
+  CHECK(crt_importer == NULL);
+  // a drain after is a no op
+  CHECK(PushTag(&queue, 3));
+  queue.Drain(&crt_importer);
+  CHECK_EQ(ToString(importer.received()), "[1, -1]");
+  CHECK_EQ(queue.size(), 0);
+  LOG_INFO << "TestEos OK";
+}
+
+void TestCloseWithPendingDrain() {
+  // Stop() (importer_ = NULL) comes while a drain is pending: the queued
+  // tags, EOS included, are dropped
+  rtmp::TagQueue queue;
+  TestImporter importer;
+  streaming::RtmpImporter* crt_importer = &importer;
+  CHECK(PushTag(&queue, 1));
+  CHECK(!PushEos(&queue));
+  crt_importer = NULL;
+  queue.Drain(&crt_importer);
+  CHECK(importer.received().empty());
+  CHECK_EQ(queue.size(), 0);
+
+  // the importer stops us while processing a tag: nothing more goes to it
+  crt_importer = &importer;
+  importer.set_stop_at(&crt_importer, 2);
+  CHECK(PushTag(&queue, 1));
+  CHECK(!PushTag(&queue, 2));
+  CHECK(!PushTag(&queue, 3));
+  CHECK(!PushEos(&queue));
+  queue.Drain(&crt_importer);
+  CHECK_EQ(ToString(importer.received()), "[1, 2]");
+  CHECK(crt_importer == NULL);
+  LOG_INFO << "TestCloseWithPendingDrain OK";
+}
+
+// Queues an EOS when it gets the tag w/ timestamp 1 - as if the net
+// selector got to InternalStop() meanwhile
+class PushingImporter : public TestImporter {
+ public:
+  PushingImporter(rtmp::TagQueue* queue, bool* eos_needs_drain)
+      : queue_(queue),
+        eos_needs_drain_(eos_needs_drain) {
+  }
+  virtual void ProcessTag(const streaming::Tag* tag, int64 timestamp_ms) {
+    TestImporter::ProcessTag(tag, timestamp_ms);
+    if ( timestamp_ms == 1 ) {
+      *eos_needs_drain_ = PushEos(queue_);
+    }
+  }
+ private:
+  rtmp::TagQueue* const queue_;
+  bool* const eos_needs_drain_;
+};
+
+void TestEosDuringDrain() {
+  // The net side queues EOS (InternalStop) while a drain runs, after it
+  // took the queue: EOS waits for (and schedules) the next drain
+  rtmp::TagQueue queue;
+  bool eos_needs_drain = false;
+  PushingImporter pushing_importer(&queue, &eos_needs_drain);
+  streaming::RtmpImporter* crt_importer = &pushing_importer;
+  CHECK(PushTag(&queue, 1));
+  CHECK(!PushTag(&queue, 2));
+  queue.Drain(&crt_importer);
+  CHECK(eos_needs_drain);
+  CHECK_EQ(ToString(pushing_importer.received()), "[1, 2]");
+  CHECK(crt_importer == &pushing_importer);
+  CHECK_EQ(queue.size(), 1);
+  queue.Drain(&crt_importer);
+  CHECK_EQ(ToString(pushing_importer.received()), "[1, 2, -1]");
+  CHECK(crt_importer == NULL);
+  LOG_INFO << "TestEosDuringDrain OK";
+}
+
+// The producer in this thread, the drains in a media thread - like
+// PublishStream::SendTag / DrainTags
+class Publisher {
+ public:
+  Publisher(net::Selector* media_selector)
+      : media_selector_(media_selector),
+        importer_(&test_importer_),
+        num_drains_(0),
+        done_(false, true) {
+  }
+  void Send(int64 timestamp_ms, bool eos) {
+    const bool schedule = eos ? PushEos(&queue_)
+                              : PushTag(&queue_, timestamp_ms);
+    if ( schedule ) {
+      media_selector_->RunInSelectLoop(
+          NewCallback(this, &Publisher::Drain));
+    }
+  }
+  void Wait() {
+    done_.Wait();
+  }
+  const vector<int64>& received() const { return test_importer_.received(); }
+  int32 num_drains() const { return num_drains_; }
+
+ private:
+  void Drain() {
+    ++num_drains_;
+    queue_.Drain(&importer_);
+    if ( importer_ == NULL ) {
+      done_.Signal();
+    }
+  }
+  net::Selector* const media_selector_;
+  TestImporter test_importer_;
+  streaming::RtmpImporter* importer_;
+  rtmp::TagQueue queue_;
+  int32 num_drains_;
+  synch::Event done_;
+};
+
+void TestThreads() {
+  net::SelectorThread media_thread;
+  media_thread.Start();
+  const int kNumTags = 100000;
+  Publisher publisher(media_thread.mutable_selector());
+  for ( int i = 0; i < kNumTags; ++i ) {
+    publisher.Send(i, false);
+  }
+  publisher.Send(0, true);
+  publisher.Wait();
+  const vector<int64>& received = publisher.received();
+  CHECK_EQ(received.size(), kNumTags + 1);
+  for ( int i = 0; i < kNumTags; ++i ) {
+    CHECK_EQ(received[i], i);
+  }
+  CHECK_EQ(received.back(), -1);
+  CHECK_GT(publisher.num_drains(), 0);
+  CHECK_LE(publisher.num_drains(), kNumTags + 1);
+  LOG_INFO << "TestThreads OK, " << publisher.num_drains() << " drains";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  common::Init(argc, argv);
+  TestBatching();
+  TestEos();
+  TestCloseWithPendingDrain();
+  TestEosDuringDrain();
+  TestThreads();
+  LOG_INFO << "PASS";
+  common::Exit(0);
+}
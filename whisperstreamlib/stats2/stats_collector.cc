@@ -34,6 +34,7 @@
 
 #include <whisperlib/common/base/errno.h>
 #include <whisperlib/common/base/timer.h>
+#include <whisperlib/net/base/outbuf_budget.h>
 #include "stats2/stats_collector.h"
 
 namespace streaming {
@@ -455,4 +456,25 @@ void StatsCollector::GetDetailedMediaStats(
   call->Complete(ret);
 }
 
+void StatsCollector::GetOutputBufferStats(
+    rpc::CallContext<OutputBufferStats>* call,
+    int32 max_consumers) {
+  OutputBufferStats ret;
+  ret.budget_ = net::OutbufBudget::budget();
+  ret.usage_ = net::OutbufBudget::usage();
+  ret.num_connections_ = net::OutbufBudget::num_accounts();
+  ret.level_ = string(
+      net::OutbufBudget::LevelName(net::OutbufBudget::level()));
+  ret.top_consumers_.ref();  // force is-set on this field
+  vector< pair<string, int64> > top;
+  net::OutbufBudget::GetTopConsumers(max_consumers, &top);
+  for ( int i = 0; i < top.size(); ++i ) {
+    OutputBufferConsumer consumer;
+    consumer.name_ = top[i].first;
+    consumer.bytes_ = top[i].second;
+    ret.top_consumers_.ref().push_back(consumer);
+  }
+  call->Complete(ret);
+}
+
 }
@@ -63,6 +63,9 @@ class StatsCollector : public ServiceInvokerMediaStats {
   virtual void GetDetailedMediaStats(
       rpc::CallContext< map<string, MediaBeginEnd> >* call,
       int32 start, int32 limit);
+  virtual void GetOutputBufferStats(
+      rpc::CallContext<OutputBufferStats>* call,
+      int32 max_consumers);
 
  private:
   // StatsCollector own thread. This thread invokes the savers to actually
@@ -46,7 +46,7 @@ void StatsKeeper::OpenMediaStats(const StreamBegin& stream_begin_stats,
   MediaBegin* media_begin_stats = new MediaBegin(media_id, timer::Date::Now(),
       stream_begin_stats, content_id, media_time_ms, stream_time_ms);
   MediaEnd* media_end_stats = new MediaEnd(media_id, timer::Date::Now(),
-      0, 0, 0, 0, 0, 0, 0, MediaResult("RUNNING"));
+      0, 0, 0, 0, 0, 0, 0, MediaResult("RUNNING"), 0, 0);
 
   DLOG_DEBUG << "Sending media stats: " << *media_begin_stats;
   media_stats_.insert(make_pair(content_id,
@@ -93,6 +93,26 @@ void StatsKeeper::audio_frames_dropped_add(int amount) {
 void StatsKeeper::video_frames_dropped_add(int amount) {
   UPDATE_ALL_MEDIA_STATS(video_frames_dropped_, amount);
 }
+void StatsKeeper::congestion_non_reference_dropped_add(int amount) {
+  UPDATE_ALL_MEDIA_STATS(video_frames_dropped_, amount);
+  UPDATE_ALL_MEDIA_STATS(congestion_non_reference_dropped_, amount);
+  synch::MutexLocker lock(&mutex_);
+  congestion_non_reference_dropped_ += amount;
+}
+void StatsKeeper::congestion_interframes_dropped_add(int amount) {
+  UPDATE_ALL_MEDIA_STATS(video_frames_dropped_, amount);
+  UPDATE_ALL_MEDIA_STATS(congestion_interframes_dropped_, amount);
+  synch::MutexLocker lock(&mutex_);
+  congestion_interframes_dropped_ += amount;
+}
+int64 StatsKeeper::congestion_non_reference_dropped() const {
+  synch::MutexLocker lock(&mutex_);
+  return congestion_non_reference_dropped_;
+}
+int64 StatsKeeper::congestion_interframes_dropped() const {
+  synch::MutexLocker lock(&mutex_);
+  return congestion_interframes_dropped_;
+}
 
 void StatsKeeper::CloseMediaStats(MediaStatsMap::iterator it,
                                   const string& result,
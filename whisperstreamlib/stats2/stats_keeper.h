@@ -44,7 +44,9 @@ class StatsKeeper {
  public:
   StatsKeeper(streaming::StatsCollector* stats_collector)
       : stats_collector_(stats_collector),
-        media_stats_() {
+        media_stats_(),
+        congestion_non_reference_dropped_(0),
+        congestion_interframes_dropped_(0) {
   }
   ~StatsKeeper() {
   }
@@ -68,6 +70,14 @@ class StatsKeeper {
   void audio_frames_dropped_add(int amount);
   void video_frames_dropped_add(int amount);
 
+  // Video frames we dropped for this connection because the viewer could
+  // not keep up (see SendScheduler). These also go in video_frames_dropped,
+  // and in the congestion_*_dropped of each open MediaEnd.
+  void congestion_non_reference_dropped_add(int amount);
+  void congestion_interframes_dropped_add(int amount);
+  int64 congestion_non_reference_dropped() const;
+  int64 congestion_interframes_dropped() const;
+
   // map: content id -> stats
   // This streams are like the chapters / paragraphs of a book.
   //  e.g. start Show
@@ -90,10 +100,13 @@ class StatsKeeper {
 
   StatsCollector* stats_collector_;
   MediaStatsMap media_stats_;
+  // Per connection congestion drop counters (not per media)
+  int64 congestion_non_reference_dropped_;
+  int64 congestion_interframes_dropped_;
   // Synchronize access to media_stats_ map.
   // Usually OpenMediaStats()/CloseMediaStats() executes in media thread,
   // while bytes_up_add() executes in network thread.
-  synch::Mutex mutex_;
+  mutable synch::Mutex mutex_;
 
   DISALLOW_EVIL_CONSTRUCTORS(StatsKeeper);
 };